@@ -146,7 +146,7 @@ static void bench_memcpy(void)
     size_t srcalign, dstalign;
 
     printf("memcpy speed test\n");
-    thread_sleep(200); // let the debug string clear the serial port
+    thread_sleep(LK_MSEC(200)); // let the debug string clear the serial port
 
     for (srcalign = 0; srcalign < 64; ) {
         for (dstalign = 0; dstalign < 64; ) {
@@ -157,10 +157,10 @@ static void bench_memcpy(void)
             mine = bench_memcpy_routine(&mymemcpy, srcalign, dstalign);
 
             printf("srcalign %zu, dstalign %zu: ", srcalign, dstalign);
-            printf("   null memcpy %u msecs\n", null);
-            printf("c memcpy %u msecs, %llu bytes/sec; ", c, (uint64_t)BUFFER_SIZE * ITERATIONS * 1000ULL / c);
-            printf("libc memcpy %u msecs, %llu bytes/sec; ", libc, (uint64_t)BUFFER_SIZE * ITERATIONS * 1000ULL / libc);
-            printf("my memcpy %u msecs, %llu bytes/sec; ", mine, (uint64_t)BUFFER_SIZE * ITERATIONS * 1000ULL / mine);
+            printf("   null memcpy %u msecs\n", (uint)(null / LK_MSEC(1)));
+            printf("c memcpy %u msecs, %llu bytes/sec; ", (uint)(c / LK_MSEC(1)), (uint64_t)BUFFER_SIZE * ITERATIONS * LK_SEC(1) / c);
+            printf("libc memcpy %u msecs, %llu bytes/sec; ", (uint)(libc / LK_MSEC(1)), (uint64_t)BUFFER_SIZE * ITERATIONS * LK_SEC(1) / libc);
+            printf("my memcpy %u msecs, %llu bytes/sec; ", (uint)(mine / LK_MSEC(1)), (uint64_t)BUFFER_SIZE * ITERATIONS * LK_SEC(1) / mine);
             printf("\n");
 
             if (dstalign < 8)
@@ -239,7 +239,7 @@ static void bench_memset(void)
     size_t dstalign;
 
     printf("memset speed test\n");
-    thread_sleep(200); // let the debug string clear the serial port
+    thread_sleep(LK_MSEC(200)); // let the debug string clear the serial port
 
     for (dstalign = 0; dstalign < 64; dstalign++) {
 
@@ -248,9 +248,9 @@ static void bench_memset(void)
         mine = bench_memset_routine(&mymemset, dstalign, BUFFER_SIZE);
 
         printf("dstalign %zu: ", dstalign);
-        printf("c memset %u msecs, %llu bytes/sec; ", c, (uint64_t)BUFFER_SIZE * ITERATIONS * 1000ULL / c);
-        printf("libc memset %u msecs, %llu bytes/sec; ", libc, (uint64_t)BUFFER_SIZE * ITERATIONS * 1000ULL / libc);
-        printf("my memset %u msecs, %llu bytes/sec; ", mine, (uint64_t)BUFFER_SIZE * ITERATIONS * 1000ULL / mine);
+        printf("c memset %u msecs, %llu bytes/sec; ", (uint)(c / LK_MSEC(1)), (uint64_t)BUFFER_SIZE * ITERATIONS * LK_SEC(1) / c);
+        printf("libc memset %u msecs, %llu bytes/sec; ", (uint)(libc / LK_MSEC(1)), (uint64_t)BUFFER_SIZE * ITERATIONS * LK_SEC(1) / libc);
+        printf("my memset %u msecs, %llu bytes/sec; ", (uint)(mine / LK_MSEC(1)), (uint64_t)BUFFER_SIZE * ITERATIONS * LK_SEC(1) / mine);
         printf("\n");
     }
 }
@@ -69,7 +69,7 @@ int fibo(int argc, const cmd_args *argv)
     tim = current_time() - tim;
 
     printf("fibo %d\n", retcode);
-    printf("took %u msecs to calculate\n", tim);
+    printf("took %u msecs to calculate\n", (uint)(tim / LK_MSEC(1)));
 
     return NO_ERROR;
 }
@@ -10,15 +10,15 @@
 #include <platform.h>
 #include <app/tests.h>
 
-// Tests that thread_sleep and current_time_hires() are consistent.
+// Tests that thread_sleep and current_time() are consistent.
 static int thread_sleep_test(void)
 {
     int early = 0;
     for (int i = 0; i < 5; i++) {
-        lk_bigtime_t now = current_time_hires();
-        thread_sleep(500);
-        lk_bigtime_t actual_delay = current_time_hires() - now;
-        if (actual_delay < 500 * 1000) {
+        lk_time_t now = current_time();
+        thread_sleep(LK_MSEC(500));
+        lk_time_t actual_delay = current_time() - now;
+        if (actual_delay < LK_MSEC(500)) {
             early = 1;
             printf("thread_sleep(500) returned after %" PRIu64 " ns\n", actual_delay);
         }
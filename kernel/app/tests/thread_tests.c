@@ -22,7 +22,7 @@ static int sleep_thread(void *arg)
 {
     for (;;) {
         printf("sleeper %p\n", get_current_thread());
-        thread_sleep(rand() % 500);
+        thread_sleep(LK_MSEC(rand() % 500));
     }
     return 0;
 }
@@ -88,12 +88,64 @@ static int mutex_test(void)
     return 0;
 }
 
+/* short critical sections with no yields, so that contended acquires
+ * mostly find the holder running and spin */
+static volatile uint64_t mutex_spin_counter;
+
+static int mutex_spin_thread(void *arg)
+{
+    mutex_t *m = (mutex_t *)arg;
+
+    for (int i = 0; i < 100000; i++) {
+        mutex_acquire(m);
+        mutex_spin_counter = mutex_spin_counter + 1;
+        mutex_release(m);
+    }
+
+    return 0;
+}
+
+static int mutex_spin_test(void)
+{
+    mutex_t m;
+    mutex_init(&m);
+    mutex_spin_counter = 0;
+
+    thread_t *threads[4];
+    ulong spins = 0, blocks = 0;
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        spins -= thread_stats[i].mutex_spins;
+        blocks -= thread_stats[i].mutex_blocks;
+    }
+
+    for (uint i=0; i < countof(threads); i++) {
+        threads[i] = thread_create("mutex spinner", &mutex_spin_thread, &m, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
+        thread_resume(threads[i]);
+    }
+
+    for (uint i=0; i < countof(threads); i++) {
+        thread_join(threads[i], NULL, INFINITE_TIME);
+    }
+
+    if (mutex_spin_counter != countof(threads) * 100000)
+        panic("mutex spin test: lost updates, counter %" PRIu64 "\n", mutex_spin_counter);
+
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        spins += thread_stats[i].mutex_spins;
+        blocks += thread_stats[i].mutex_blocks;
+    }
+    printf("done with mutex spin tests: %lu spins, %lu blocks\n", spins, blocks);
+
+    mutex_destroy(&m);
+    return 0;
+}
+
 static event_t e;
 
 static int event_signaler(void *arg)
 {
     printf("event signaler pausing\n");
-    thread_sleep(1000);
+    thread_sleep(LK_MSEC(1000));
 
 //  for (;;) {
     printf("signaling event\n");
@@ -152,7 +204,7 @@ static void event_test(void)
     for (uint i = 0; i < countof(threads); i++)
         thread_join(threads[i], NULL, INFINITE_TIME);
 
-    thread_sleep(2000);
+    thread_sleep(LK_MSEC(2000));
     printf("destroying event\n");
     event_destroy(&e);
 
@@ -168,7 +220,7 @@ static void event_test(void)
     for (uint i = 0; i < countof(threads); i++)
         thread_resume(threads[i]);
 
-    thread_sleep(2000);
+    thread_sleep(LK_MSEC(2000));
 
     for (uint i = 0; i < countof(threads); i++) {
         thread_kill(threads[i], true);
@@ -213,7 +265,7 @@ static int context_switch_tester(void *arg)
         thread_yield();
     }
     total_count += arch_cycle_count() - count;
-    thread_sleep(1000);
+    thread_sleep(LK_MSEC(1000));
     printf("took %u cycles to yield %d times, %u per yield, %u per yield per thread\n",
            total_count, iter, total_count / iter, total_count / iter / thread_count);
 
@@ -228,19 +280,19 @@ static void context_switch_test(void)
     event_init(&context_switch_done_event, false, 0);
 
     thread_detach_and_resume(thread_create("context switch idle", &context_switch_tester, (void *)1, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE));
-    thread_sleep(100);
+    thread_sleep(LK_MSEC(100));
     event_signal(&context_switch_event, true);
     event_wait(&context_switch_done_event);
-    thread_sleep(100);
+    thread_sleep(LK_MSEC(100));
 
     event_unsignal(&context_switch_event);
     event_unsignal(&context_switch_done_event);
     thread_detach_and_resume(thread_create("context switch 2a", &context_switch_tester, (void *)2, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE));
     thread_detach_and_resume(thread_create("context switch 2b", &context_switch_tester, (void *)2, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE));
-    thread_sleep(100);
+    thread_sleep(LK_MSEC(100));
     event_signal(&context_switch_event, true);
     event_wait(&context_switch_done_event);
-    thread_sleep(100);
+    thread_sleep(LK_MSEC(100));
 
     event_unsignal(&context_switch_event);
     event_unsignal(&context_switch_done_event);
@@ -248,10 +300,10 @@ static void context_switch_test(void)
     thread_detach_and_resume(thread_create("context switch 4b", &context_switch_tester, (void *)4, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE));
     thread_detach_and_resume(thread_create("context switch 4c", &context_switch_tester, (void *)4, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE));
     thread_detach_and_resume(thread_create("context switch 4d", &context_switch_tester, (void *)4, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE));
-    thread_sleep(100);
+    thread_sleep(LK_MSEC(100));
     event_signal(&context_switch_event, true);
     event_wait(&context_switch_done_event);
-    thread_sleep(100);
+    thread_sleep(LK_MSEC(100));
 }
 
 static volatile int atomic;
@@ -311,7 +363,7 @@ static int preempt_tester(void *arg)
 {
     spin(1000000);
 
-    printf("exiting ts %" PRIu64 " ns\n", current_time_hires());
+    printf("exiting ts %" PRIu64 " ns\n", current_time());
 
     atomic_add(&preempt_count, -1);
 #undef COUNT
@@ -332,7 +384,7 @@ static void preempt_test(void)
         thread_detach_and_resume(thread_create("preempt tester", &preempt_tester, NULL, LOW_PRIORITY, DEFAULT_STACK_SIZE));
 
     while (preempt_count > 0) {
-        thread_sleep(1000);
+        thread_sleep(LK_MSEC(1000));
     }
 
     printf("done with preempt test, above time stamps should be very close\n");
@@ -351,7 +403,7 @@ static void preempt_test(void)
     }
 
     while (preempt_count > 0) {
-        thread_sleep(1000);
+        thread_sleep(LK_MSEC(1000));
     }
 
     printf("done with real-time preempt test, above time stamps should be 1 second apart\n");
@@ -362,7 +414,7 @@ static int join_tester(void *arg)
     long val = (long)arg;
 
     printf("\t\tjoin tester starting\n");
-    thread_sleep(500);
+    thread_sleep(LK_MSEC(500));
     printf("\t\tjoin tester exiting with result %ld\n", val);
 
     return val;
@@ -388,7 +440,7 @@ static int join_tester_server(void *arg)
     printf("\tcreating and waiting on thread to exit with thread_join, after thread has exited\n");
     t = thread_create("join tester", &join_tester, (void *)2, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
     thread_resume(t);
-    thread_sleep(1000); // wait until thread is already dead
+    thread_sleep(LK_MSEC(1000)); // wait until thread is already dead
     ret = 99;
     printf("\tthread magic is 0x%x (should be 0x%x)\n", t->magic, THREAD_MAGIC);
     err = thread_join(t, &ret, INFINITE_TIME);
@@ -399,13 +451,13 @@ static int join_tester_server(void *arg)
     t = thread_create("join tester", &join_tester, (void *)3, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
     thread_detach(t);
     thread_resume(t);
-    thread_sleep(1000); // wait until the thread should be dead
+    thread_sleep(LK_MSEC(1000)); // wait until the thread should be dead
     printf("\tthread magic is 0x%x (should be 0)\n", t->magic);
 
     printf("\tcreating a thread, detaching it after it should be dead\n");
     t = thread_create("join tester", &join_tester, (void *)4, DEFAULT_PRIORITY, DEFAULT_STACK_SIZE);
     thread_resume(t);
-    thread_sleep(1000); // wait until thread is already dead
+    thread_sleep(LK_MSEC(1000)); // wait until thread is already dead
     printf("\tthread magic is 0x%x (should be 0x%x)\n", t->magic, THREAD_MAGIC);
     thread_detach(t);
     printf("\tthread magic is 0x%x\n", t->magic);
@@ -478,12 +530,12 @@ static void sleeper_thread_exit(void *arg)
 
 static int sleeper_kill_thread(void *arg)
 {
-    thread_sleep(100);
+    thread_sleep(LK_MSEC(100));
 
     lk_time_t t = current_time();
-    status_t err = thread_sleep_etc(5000, true);
+    status_t err = thread_sleep_etc(LK_SEC(5), true);
     t = current_time() - t;
-    TRACEF("thread_sleep_etc returns %d after %u msecs\n", err, t);
+    TRACEF("thread_sleep_etc returns %d after %" PRIu64 " msecs\n", err, t / LK_MSEC(1));
 
     return 0;
 }
@@ -497,12 +549,12 @@ static int waiter_kill_thread_infinite_wait(void *arg)
 {
     event_t *e = (event_t *)arg;
 
-    thread_sleep(100);
+    thread_sleep(LK_MSEC(100));
 
     lk_time_t t = current_time();
     status_t err = event_wait_timeout(e, INFINITE_TIME, true);
     t = current_time() - t;
-    TRACEF("event_wait_timeout returns %d after %u msecs\n", err, t);
+    TRACEF("event_wait_timeout returns %d after %" PRIu64 " msecs\n", err, t / LK_MSEC(1));
 
     return 0;
 }
@@ -511,12 +563,12 @@ static int waiter_kill_thread(void *arg)
 {
     event_t *e = (event_t *)arg;
 
-    thread_sleep(100);
+    thread_sleep(LK_MSEC(100));
 
     lk_time_t t = current_time();
-    status_t err = event_wait_timeout(e, 5000, true);
+    status_t err = event_wait_timeout(e, LK_SEC(5), true);
     t = current_time() - t;
-    TRACEF("event_wait_timeout with timeout returns %d after %u msecs\n", err, t);
+    TRACEF("event_wait_timeout with timeout returns %d after %" PRIu64 " msecs\n", err, t / LK_MSEC(1));
 
     return 0;
 }
@@ -529,7 +581,7 @@ static void kill_tests(void)
     t = thread_create("sleeper", sleeper_kill_thread, 0, LOW_PRIORITY, DEFAULT_STACK_SIZE);
     thread_set_exit_callback(t, &sleeper_thread_exit, (void *)t);
     thread_resume(t);
-    thread_sleep(200);
+    thread_sleep(LK_MSEC(200));
     thread_kill(t, true);
     thread_join(t, NULL, INFINITE_TIME);
 
@@ -554,7 +606,7 @@ static void kill_tests(void)
     t = thread_create("waiter", waiter_kill_thread_infinite_wait, &e, LOW_PRIORITY, DEFAULT_STACK_SIZE);
     thread_set_exit_callback(t, &waiter_thread_exit, (void *)t);
     thread_resume(t);
-    thread_sleep(200);
+    thread_sleep(LK_MSEC(200));
     thread_kill(t, true);
     thread_join(t, NULL, INFINITE_TIME);
     event_destroy(&e);
@@ -573,7 +625,7 @@ static void kill_tests(void)
     t = thread_create("waiter", waiter_kill_thread, &e, LOW_PRIORITY, DEFAULT_STACK_SIZE);
     thread_set_exit_callback(t, &waiter_thread_exit, (void *)t);
     thread_resume(t);
-    thread_sleep(200);
+    thread_sleep(LK_MSEC(200));
     thread_kill(t, true);
     thread_join(t, NULL, INFINITE_TIME);
     event_destroy(&e);
@@ -593,12 +645,13 @@ int thread_tests(void)
     kill_tests();
 
     mutex_test();
+    mutex_spin_test();
     event_test();
 
     spinlock_test();
     atomic_test();
 
-    thread_sleep(200);
+    thread_sleep(LK_MSEC(200));
     context_switch_test();
 
     preempt_test();
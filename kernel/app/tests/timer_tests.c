@@ -5,8 +5,10 @@
 // https://opensource.org/licenses/MIT
 
 #include <stdio.h>
+#include <stdlib.h>
 #include <err.h>
 #include <inttypes.h>
+#include <arch/ops.h>
 #include <kernel/timer.h>
 #include <kernel/event.h>
 #include <kernel/thread.h>
@@ -29,7 +31,7 @@ static int timer_do_one_thread(void* arg)
     event_init(&event, false, 0);
     timer_initialize(&timer);
 
-    timer_set_oneshot(&timer, 10, timer_cb, &event);
+    timer_set_oneshot(&timer, current_time() + LK_MSEC(10), timer_cb, &event);
     event_wait(&event);
 
     printf("got timer on cpu %u\n", arch_curr_cpu_num());
@@ -67,15 +69,184 @@ static void timer_test_all_cpus(void)
     }
     uint joined = 0;
     for (i = 0; i < max; i++) {
-        if (thread_join(timer_threads(i), NULL, 1000) == 0) {
+        if (thread_join(timer_threads(i), NULL, LK_SEC(1)) == 0) {
             joined += 1;
         }
     }
     printf("%u threads created, %u threads joined\n", max, joined);
 }
 
+struct timer_accuracy_args {
+    event_t event;
+    lk_time_t deadline;
+    lk_time_t fired;
+};
+
+static enum handler_return timer_accuracy_cb(struct timer* timer, lk_time_t now, void* arg)
+{
+    struct timer_accuracy_args* args = (struct timer_accuracy_args*)arg;
+    args->fired = current_time();
+    event_signal(&args->event, false);
+
+    return INT_RESCHEDULE;
+}
+
+// Deadlines are nanoseconds, so a timer must never fire before its deadline
+// and should fire well within a millisecond after it, however short the delay.
+static void timer_test_accuracy(void)
+{
+    static const lk_time_t delays[] = {
+        LK_USEC(10), LK_USEC(50), LK_USEC(100), LK_USEC(500), LK_MSEC(1), LK_MSEC(5),
+    };
+    const int iterations = 10;
+    uint early = 0;
+
+    printf("timer accuracy:\n");
+    for (size_t i = 0; i < countof(delays); i++) {
+        lk_time_t min = INFINITE_TIME;
+        lk_time_t max = 0;
+        lk_time_t total = 0;
+        uint count = 0;
+
+        for (int j = 0; j < iterations; j++) {
+            struct timer_accuracy_args args;
+            timer_t timer;
+
+            event_init(&args.event, false, 0);
+            timer_initialize(&timer);
+
+            args.deadline = current_time() + delays[i];
+            timer_set_oneshot(&timer, args.deadline, timer_accuracy_cb, &args);
+            event_wait(&args.event);
+            timer_cancel(&timer);
+            event_destroy(&args.event);
+
+            if (args.fired < args.deadline) {
+                printf("timer with deadline %" PRIu64 " fired early at %" PRIu64 "\n",
+                       args.deadline, args.fired);
+                early++;
+                continue;
+            }
+            lk_time_t late = args.fired - args.deadline;
+            min = MIN(min, late);
+            max = MAX(max, late);
+            total += late;
+            count++;
+        }
+
+        if (count == 0)
+            continue;
+        printf("  delay %7" PRIu64 " ns: late by min %" PRIu64 " avg %" PRIu64 " max %" PRIu64 " ns\n",
+               delays[i], min, total / count, max);
+        if (total / count > LK_MSEC(1)) {
+            printf("  WARNING: %" PRIu64 " ns timers average more than 1 ms late\n", delays[i]);
+        }
+    }
+
+    // thread_sleep goes through the same timers
+    lk_time_t start = current_time();
+    thread_sleep(LK_USEC(100));
+    lk_time_t slept = current_time() - start;
+    printf("  thread_sleep(100 us) took %" PRIu64 " ns\n", slept);
+    if (slept < LK_USEC(100)) {
+        early++;
+    }
+
+    printf("timer accuracy: %u early\n", early);
+}
+
+static enum handler_return timer_count_cb(struct timer* timer, lk_time_t now, void* arg)
+{
+    atomic_add((volatile int*)arg, 1);
+
+    return INT_NO_RESCHEDULE;
+}
+
+static uint64_t timer_interrupts(void)
+{
+    uint64_t total = 0;
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        total += thread_stats[i].timer_ints;
+    }
+    return total;
+}
+
+// Arms count timers with deadlines spread evenly over 10 ms, each allowed to be
+// slack late, waits for them all and returns how many timer interrupts it took.
+static uint64_t timer_fire_spread(timer_t* timers, uint count, lk_time_t slack)
+{
+    volatile int fired = 0;
+    lk_time_t base = current_time() + LK_MSEC(1);
+
+    uint64_t ints = timer_interrupts();
+    for (uint i = 0; i < count; i++) {
+        timer_initialize(&timers[i]);
+        timer_set_oneshot_etc(&timers[i], base + LK_MSEC(10) * i / count, slack,
+                              timer_count_cb, (void*)&fired);
+    }
+    while (fired < (int)count) {
+        thread_sleep(LK_MSEC(1));
+    }
+    ints = timer_interrupts() - ints;
+
+    for (uint i = 0; i < count; i++) {
+        timer_cancel(&timers[i]);
+    }
+    return ints;
+}
+
+// Arms and cancels 100,000 concurrent timeouts, the load a busy server puts on
+// the timer queues, then shows slack folding nearby deadlines into fewer
+// interrupts.
+static void timer_test_scale(void)
+{
+    const uint count = 100000;
+    timer_t* timers = malloc(count * sizeof(timer_t));
+    if (timers == NULL) {
+        printf("failed to allocate %u timers\n", count);
+        return;
+    }
+
+    // deadlines a minute out in a scrambled order, so that none fire and the
+    // queue sees no helpful pattern
+    volatile int fired = 0;
+    lk_time_t base = current_time() + LK_SEC(60);
+    uint32_t seed = 1;
+    lk_time_t start = current_time();
+    for (uint i = 0; i < count; i++) {
+        seed = seed * 1664525 + 1013904223;
+        timer_initialize(&timers[i]);
+        timer_set_oneshot(&timers[i], base + (seed % LK_SEC(1)), timer_count_cb, (void*)&fired);
+    }
+    lk_time_t armed = current_time() - start;
+
+    // cancel in a different order than they were armed
+    start = current_time();
+    for (uint i = 0; i < count; i++) {
+        timer_cancel(&timers[(i * 7919u) % count]);
+    }
+    lk_time_t cancelled = current_time() - start;
+
+    printf("%u timers: arm %" PRIu64 " ns each, cancel %" PRIu64 " ns each\n",
+           count, armed / count, cancelled / count);
+
+    const uint spread = 1000;
+    uint64_t exact = timer_fire_spread(timers, spread, 0);
+    uint64_t coalesced = timer_fire_spread(timers, spread, LK_MSEC(1));
+    printf("%u timers over 10 ms: %" PRIu64 " interrupts with no slack, %" PRIu64
+           " with 1 ms of slack\n", spread, exact, coalesced);
+
+    free(timers);
+}
+
 void timer_tests(void)
 {
     // timer fires on all cpus
     timer_test_all_cpus();
+
+    // timers fire at their deadlines, to well under a millisecond
+    timer_test_accuracy();
+
+    // arming and cancelling stays cheap with many timers outstanding
+    timer_test_scale();
 }
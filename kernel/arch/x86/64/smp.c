@@ -90,7 +90,7 @@ status_t x86_bringup_aps(uint32_t *apic_ids, uint32_t count)
     }
 
     // Wait 10 ms and then send the startup signals
-    thread_sleep(10);
+    thread_sleep(LK_MSEC(10));
 
     // Actually send the startups
     ASSERT(PHYS_BOOTSTRAP_PAGE < 1 * MB);
@@ -110,7 +110,7 @@ status_t x86_bringup_aps(uint32_t *apic_ids, uint32_t count)
         }
         // Wait 1ms for cores to boot.  The docs recommend 200us between STARTUP
         // IPIs.
-        thread_sleep(1);
+        thread_sleep(LK_MSEC(1));
     }
 
     // The docs recommend waiting 200us for cores to boot.  We do a bit more
@@ -119,7 +119,7 @@ status_t x86_bringup_aps(uint32_t *apic_ids, uint32_t count)
          aps_still_booting != 0 && tries_left > 0;
          --tries_left) {
 
-        thread_sleep(5);
+        thread_sleep(LK_MSEC(5));
     }
 
     uint failed_aps = (uint)atomic_swap(&aps_still_booting, 0);
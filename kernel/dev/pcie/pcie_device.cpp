@@ -301,8 +301,8 @@ status_t PcieDevice::DoFunctionLevelReset() {
                 ret = NO_ERROR;
                 break;
             }
-            thread_sleep(1);
-        } while ((current_time() - start) < 5000);
+            thread_sleep(LK_MSEC(1));
+        } while ((current_time() - start) < LK_SEC(5));
 
         if (ret != NO_ERROR) {
             TRACEF("Timeout waiting for pending transactions to clear the bus "
@@ -319,7 +319,7 @@ status_t PcieDevice::DoFunctionLevelReset() {
             cfg_->Write(pci_af_->af_ctrl(), PCS_ADVCAPS_CTRL_INITIATE_FLR);
 
             // 5) Software waits 100mSec
-            thread_sleep(100);
+            thread_sleep(LK_MSEC(100));
         }
 
         // NOTE: Even though the spec says that the reset operation is supposed
@@ -335,8 +335,8 @@ status_t PcieDevice::DoFunctionLevelReset() {
                 ret = NO_ERROR;
                 break;
             }
-            thread_sleep(1);
-        } while ((current_time() - start) < 5000);
+            thread_sleep(LK_MSEC(1));
+        } while ((current_time() - start) < LK_SEC(5));
 
         if (ret == NO_ERROR) {
             // 6) Software reconfigures the function and enables it for normal operation
@@ -10,6 +10,7 @@
 #include <debug.h>
 #include <sys/types.h>
 #include <err.h>
+#include <inttypes.h>
 #include <stdio.h>
 #include <assert.h>
 #include <trace.h>
@@ -59,11 +60,10 @@ static addr_t scu_control_base;
 static spin_lock_t lock = SPIN_LOCK_INITIAL_VALUE;
 
 static lk_time_t periodic_interval;
-static lk_time_t oneshot_interval;
+static lk_time_t oneshot_deadline;
 static uint32_t timer_freq;
-static struct fp_32_64 timer_freq_msec_conversion;
-static struct fp_32_64 timer_freq_usec_conversion_inverse;
-static struct fp_32_64 timer_freq_msec_conversion_inverse;
+static struct fp_32_64 timer_freq_nsec_conversion;
+static struct fp_32_64 timer_freq_nsec_conversion_inverse;
 
 static void arm_cortex_a9_timer_init_percpu(uint level);
 
@@ -80,29 +80,20 @@ retry:
     return ((uint64_t)hi << 32 | lo);
 }
 
-lk_bigtime_t current_time_hires(void)
-{
-    lk_bigtime_t time;
-
-    time = u64_mul_u64_fp32_64(get_global_val(), timer_freq_usec_conversion_inverse);
-
-    return time;
-}
-
 lk_time_t current_time(void)
 {
     lk_time_t time;
 
-    time = u32_mul_u64_fp32_64(get_global_val(), timer_freq_msec_conversion_inverse);
+    time = u64_mul_u64_fp32_64(get_global_val(), timer_freq_nsec_conversion_inverse);
 
     return time;
 }
 
 status_t platform_set_periodic_timer(platform_timer_callback callback, void *arg, lk_time_t interval)
 {
-    LTRACEF("callback %p, arg %p, interval %u\n", callback, arg, interval);
+    LTRACEF("callback %p, arg %p, interval %" PRIu64 "\n", callback, arg, interval);
 
-    uint64_t ticks = u64_mul_u64_fp32_64(interval, timer_freq_msec_conversion);
+    uint64_t ticks = u64_mul_u64_fp32_64(interval, timer_freq_nsec_conversion);
     if (unlikely(ticks == 0))
         ticks = 1;
     if (unlikely(ticks > 0xffffffff))
@@ -126,11 +117,15 @@ status_t platform_set_periodic_timer(platform_timer_callback callback, void *arg
     return NO_ERROR;
 }
 
-status_t platform_set_oneshot_timer (platform_timer_callback callback, void *arg, lk_time_t interval)
+status_t platform_set_oneshot_timer (platform_timer_callback callback, void *arg, lk_time_t deadline)
 {
-    LTRACEF("callback %p, arg %p, timeout %u\n", callback, arg, interval);
+    LTRACEF("callback %p, arg %p, deadline %" PRIu64 "\n", callback, arg, deadline);
 
-    uint64_t ticks = u64_mul_u64_fp32_64(interval, timer_freq_msec_conversion);
+    /* the private timer counts down, so program the time left until the deadline.
+     * if it is too far out to fit, we fire early and get re-armed */
+    lk_time_t now = current_time();
+    lk_time_t interval = (deadline > now) ? deadline - now : 0;
+    uint64_t ticks = u64_mul_u64_fp32_64(interval, timer_freq_nsec_conversion);
     if (unlikely(ticks == 0))
         ticks = 1;
     if (unlikely(ticks > 0xffffffff))
@@ -140,7 +135,7 @@ status_t platform_set_oneshot_timer (platform_timer_callback callback, void *arg
     spin_lock_irqsave(&lock, state);
 
     t_callback = callback;
-    oneshot_interval = interval;
+    oneshot_deadline = deadline;
 
     // disable timer
     TIMREG(TIMER_CONTROL) = 0;
@@ -183,9 +178,8 @@ void arm_cortex_a9_timer_init(addr_t _scu_control_base, uint32_t freq)
     timer_freq = freq;
 
     /* precompute the conversion factor for global time to real time */
-    fp_32_64_div_32_32(&timer_freq_msec_conversion, timer_freq, 1000);
-    fp_32_64_div_32_32(&timer_freq_usec_conversion_inverse, 1000000, timer_freq);
-    fp_32_64_div_32_32(&timer_freq_msec_conversion_inverse, 1000, timer_freq);
+    fp_32_64_div_32_32(&timer_freq_nsec_conversion, timer_freq, 1000 * 1000 * 1000);
+    fp_32_64_div_32_32(&timer_freq_nsec_conversion_inverse, 1000 * 1000 * 1000, timer_freq);
 }
 
 static void arm_cortex_a9_timer_init_percpu(uint level)
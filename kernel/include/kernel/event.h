@@ -53,11 +53,14 @@ typedef struct event {
 void event_init(event_t *, bool initial, uint flags);
 void event_destroy(event_t *);
 
-/* Wait for up to timeout amount of time.
+/* Wait until the deadline, in ns, passes.
  * Interruptable arg allows it to return early with ERR_INTERRUPTED if thread
  * is signaled for kill.
  */
-status_t event_wait_timeout(event_t *, lk_time_t, bool interruptable);
+status_t event_wait_deadline(event_t *, lk_time_t deadline, bool interruptable);
+
+/* Wait for up to timeout amount of time, in ns. */
+status_t event_wait_timeout(event_t *, lk_time_t timeout, bool interruptable);
 
 /* no timeout, non interruptable version of the above. */
 static inline status_t event_wait(event_t *e) { return event_wait_timeout(e, INFINITE_TIME, false); }
@@ -19,24 +19,30 @@ __BEGIN_CDECLS;
 
 #define MUTEX_MAGIC (0x6D757478)  // 'mutx'
 
+/* val holds the owning thread, or 0 when the mutex is free. The low bit is
+ * set while threads may be blocked on it, so that the owner releases it
+ * through the wait queue; otherwise it is acquired and released with a
+ * single atomic operation, without taking the thread lock. */
+#define MUTEX_FLAG_CONTESTED ((uintptr_t)1)
+
 typedef struct TA_CAP("mutex") mutex {
     uint32_t magic;
-    thread_t *holder;
-    int count;
+    uintptr_t val;
     wait_queue_t wait;
 } mutex_t;
 
 #define MUTEX_INITIAL_VALUE(m) \
 { \
     .magic = MUTEX_MAGIC, \
-    .holder = NULL, \
-    .count = 0, \
+    .val = 0, \
     .wait = WAIT_QUEUE_INITIAL_VALUE((m).wait), \
 }
 
 /* Rules for Mutexes:
  * - Mutexes are only safe to use from thread context.
  * - Mutexes are non-recursive.
+ * - A contended acquire spins for a short while if the owner is running on
+ *   another cpu, and blocks otherwise.
 */
 
 void mutex_init(mutex_t *);
@@ -48,10 +54,15 @@ void mutex_release(mutex_t *m) TA_REL(m);
 status_t mutex_acquire_internal(mutex_t *m) TA_ACQ(m);
 void mutex_release_internal(mutex_t *m, bool reschedule) TA_REL(m);
 
+static inline thread_t *mutex_holder(const mutex_t *m)
+{
+    return (thread_t *)(__atomic_load_n(&m->val, __ATOMIC_RELAXED) & ~MUTEX_FLAG_CONTESTED);
+}
+
 /* does the current thread hold the mutex? */
 static bool is_mutex_held(const mutex_t *m)
 {
-    return m->holder == get_current_thread();
+    return mutex_holder(m) == get_current_thread();
 }
 
 __END_CDECLS;
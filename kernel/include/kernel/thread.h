@@ -75,8 +75,8 @@ typedef struct thread {
     struct list_node queue_node;
     int priority;
     enum thread_state state;
-    lk_bigtime_t last_started_running;
-    lk_bigtime_t remaining_time_slice;
+    lk_time_t last_started_running;
+    lk_time_t remaining_time_slice;
     unsigned int flags;
     unsigned int signals;
 #if WITH_SMP
@@ -95,7 +95,7 @@ typedef struct thread {
     /* Total time in THREAD_RUNNING state.  If the thread is currently in
      * THREAD_RUNNING state, this excludes the time it has accrued since it
      * left the scheduler. */
-    lk_bigtime_t runtime_ns;
+    lk_time_t runtime_ns;
 
     /* if blocked, a pointer to the wait queue */
     struct wait_queue *blocking_wait_queue;
@@ -106,6 +106,10 @@ typedef struct thread {
     /* are we allowed to be interrupted on the current thing we're blocked/sleeping on */
     bool interruptable;
 
+    /* how long past its deadline a sleep or wait timeout may fire, so that it
+     * can share a timer interrupt with others */
+    lk_time_t timer_slack;
+
     /* non-NULL if stopped in an exception */
     const struct arch_exception_context *exception_context;
 
@@ -206,7 +210,7 @@ status_t thread_sleep_etc(lk_time_t delay, bool interruptable);
 static inline status_t thread_sleep(lk_time_t delay) { return thread_sleep_etc(delay, false); }
 
 /* return the number of nanoseconds a thread has been running for */
-lk_bigtime_t thread_runtime(const thread_t *t);
+lk_time_t thread_runtime(const thread_t *t);
 
 /* deliver a kill signal to a thread */
 void thread_kill(thread_t *t, bool block);
@@ -248,6 +252,11 @@ void set_current_thread(thread_t *);
 /* the idle thread(s) (statically allocated) */
 extern thread_t idle_threads[SMP_MAX_CPUS];
 
+/* is the thread running on some other cpu right now? a hint for spinning
+ * waiters, which may be stale by the time it returns. never dereferences t,
+ * so it is safe to call with a thread that may have exited */
+bool thread_is_running_elsewhere(const thread_t *t);
+
 /* scheduler lock */
 extern spin_lock_t thread_lock;
 
@@ -261,8 +270,8 @@ static inline bool thread_lock_held(void)
 
 /* thread/cpu level statistics */
 struct thread_stats {
-    lk_bigtime_t idle_time;
-    lk_bigtime_t last_idle_timestamp;
+    lk_time_t idle_time;
+    lk_time_t last_idle_timestamp;
     ulong reschedules;
     ulong context_switches;
     ulong irq_preempts;
@@ -276,6 +285,10 @@ struct thread_stats {
     ulong exceptions; /* exceptions such as page fault or undefined opcode */
     ulong syscalls;
 
+    /* contended mutex acquires */
+    ulong mutex_spins; /* acquired by spinning while the holder ran */
+    ulong mutex_blocks; /* had to block */
+
 #if WITH_SMP
     /* inter-processor interrupts */
     ulong reschedule_ipis;
@@ -9,7 +9,6 @@
 #define __KERNEL_TIMER_H
 
 #include <magenta/compiler.h>
-#include <list.h>
 #include <sys/types.h>
 #include <kernel/spinlock.h>
 
@@ -24,9 +23,19 @@ typedef enum handler_return (*timer_callback)(struct timer *, lk_time_t now, voi
 
 typedef struct timer {
     int magic;
-    struct list_node node;
 
-    lk_time_t scheduled_time;
+    /* links in a cpu's timer queue, a pairing heap ordered by latest_time.
+     * heap_prev is the parent for a first child, the previous sibling
+     * otherwise, and NULL for the root. */
+    struct timer *heap_child;
+    struct timer *heap_next;
+    struct timer *heap_prev;
+    /* >= 0 while queued; for the root of a queue, the cpu that owns it */
+    int queue_cpu;
+
+    lk_time_t scheduled_time;   // earliest the callback may run
+    lk_time_t latest_time;      // scheduled_time + slack
+    lk_time_t slack;
     lk_time_t periodic_time;
 
     timer_callback callback;
@@ -39,8 +48,13 @@ typedef struct timer {
 #define TIMER_INITIAL_VALUE(t) \
 { \
     .magic = TIMER_MAGIC, \
-    .node = LIST_INITIAL_CLEARED_VALUE, \
+    .heap_child = NULL, \
+    .heap_next = NULL, \
+    .heap_prev = NULL, \
+    .queue_cpu = -1, \
     .scheduled_time = 0, \
+    .latest_time = 0, \
+    .slack = 0, \
     .periodic_time = 0, \
     .callback = NULL, \
     .arg = NULL, \
@@ -49,6 +63,9 @@ typedef struct timer {
 }
 
 /* Rules for Timers:
+ * - Deadlines are absolute, in nanoseconds on the current_time() clock
+ * - A timer with slack may run as late as deadline + slack, so that timers with
+ *   nearby deadlines can share one interrupt
  * - Timer callbacks occur from interrupt context
  * - Timers may be programmed or canceled from interrupt or thread context
  * - Timers may be canceled or reprogrammed from within their callback
@@ -56,11 +73,14 @@ typedef struct timer {
  * - timer_cancel() may spin waiting for a pending timer to complete on another cpu
 */
 void timer_initialize(timer_t *);
-void timer_set_oneshot(timer_t *, lk_time_t delay, timer_callback, void *arg);
+void timer_set_oneshot(timer_t *, lk_time_t deadline, timer_callback, void *arg);
+void timer_set_oneshot_etc(timer_t *, lk_time_t deadline, lk_time_t slack,
+                           timer_callback, void *arg);
 void timer_set_periodic(timer_t *, lk_time_t period, timer_callback, void *arg);
 void timer_cancel(timer_t *);
 
 void timer_transition_off_cpu(uint old_cpu);
+void timer_migrate_idle(void);
 void timer_thaw_percpu(void);
 
 /* special helper routine to simultaneously try to acquire a spinlock and check for
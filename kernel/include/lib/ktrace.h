@@ -9,6 +9,8 @@
 #include <err.h>
 #include <magenta/compiler.h>
 #include <magenta/ktrace.h>
+#include <stdbool.h>
+#include <stddef.h>
 
 __BEGIN_CDECLS
 
@@ -22,31 +24,28 @@ struct ktrace_probe_info {
     uint32_t num;
 };
 
-void* ktrace_open(uint32_t tag);
+// writes a record with the given payload, which is zero filled or cut to
+// the length in tag; returns false if the record was dropped
+bool ktrace_record(uint32_t tag, const void* payload, size_t size);
 void ktrace_tiny(uint32_t tag, uint32_t arg);
 static inline void ktrace(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {
-    uint32_t* data = (uint32_t*) ktrace_open(tag);
-    if (data) {
-        data[0] = a; data[1] = b; data[2] = c; data[3] = d;
-    }
+    uint32_t data[4] = { a, b, c, d };
+    ktrace_record(tag, data, sizeof(data));
 }
 #define ktrace_probe0(_name) { \
     static __SECTION("ktrace_probe") ktrace_probe_info_t info = { .name = _name }; \
-    ktrace_open(TAG_PROBE_16(info.num)); \
+    ktrace_record(TAG_PROBE_16(info.num), NULL, 0); \
 }
 #define ktrace_probe2(_name,arg0,arg1) { \
     static __SECTION("ktrace_probe") ktrace_probe_info_t info = { .name = _name }; \
-    uint32_t* args = ktrace_open(TAG_PROBE_24(info.num)); \
-    if (args) { \
-        args[0] = arg0; \
-        args[1] = arg1; \
-    } \
+    uint32_t args[2] = { (uint32_t)(arg0), (uint32_t)(arg1) }; \
+    ktrace_record(TAG_PROBE_24(info.num), args, sizeof(args)); \
 }
 void ktrace_name(uint32_t tag, uint32_t id, uint32_t arg, const char* name);
 int ktrace_read_user(void* ptr, uint32_t off, uint32_t len);
 status_t ktrace_control(uint32_t action, uint32_t options, void* ptr);
 #else
-static inline void* ktrace_open(uint32_t tag) { return NULL; }
+static inline bool ktrace_record(uint32_t tag, const void* payload, size_t size) { return false; }
 static inline void ktrace_tiny(uint32_t tag, uint32_t arg) {}
 static inline void ktrace(uint32_t tag, uint32_t a, uint32_t b, uint32_t c, uint32_t d) {}
 static inline void ktrace_probe0(const char* name) {}
@@ -65,8 +64,17 @@ static inline status_t ktrace_control(uint32_t action, uint32_t options, void* p
 #endif
 
 #define KTRACE_DEFAULT_BUFSIZE 32 // MB
-#define KTRACE_DEFAULT_GRPMASK 0xFFF
+// every group but LOCKS, which is too noisy to trace unless asked for
+#define KTRACE_DEFAULT_GRPMASK (KTRACE_GRP_ALL & ~KTRACE_GRP_LOCKS)
 
 void ktrace_report_live_threads(void);
 
 __END_CDECLS
+
+#if defined(__cplusplus) && WITH_LIB_KTRACE
+#include <kernel/vm/vm_object.h>
+#include <mxtl/ref_ptr.h>
+
+// The VM object holding the trace buffer, or null if tracing is disabled.
+mxtl::RefPtr<VmObject> ktrace_get_vmo(void);
+#endif
@@ -33,11 +33,17 @@ typedef enum {
     HALT_REASON_SW_UPDATE,      // SW triggered reboot in order to begin firmware update
 } platform_halt_reason;
 
-/* current time in milliseconds */
+/* current time in nanoseconds */
 lk_time_t current_time(void);
 
-/* current time in nanoseconds */
-lk_bigtime_t current_time_hires(void);
+/* the deadline timeout nanoseconds from now, saturating at INFINITE_TIME */
+static inline lk_time_t deadline_after(lk_time_t timeout)
+{
+    lk_time_t now = current_time();
+    if (timeout >= INFINITE_TIME - now)
+        return INFINITE_TIME;
+    return now + timeout;
+}
 
 /* high-precision timer ticks per second */
 uint64_t ticks_per_second(void);
@@ -15,7 +15,9 @@ typedef enum handler_return (*platform_timer_callback)(void *arg, lk_time_t now)
 status_t platform_set_periodic_timer(platform_timer_callback callback, void *arg, lk_time_t interval);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-status_t platform_set_oneshot_timer (platform_timer_callback callback, void *arg, lk_time_t interval);
+/* fire callback once the current time reaches deadline, or as soon as possible if it
+ * already has. the timer may fire early, in which case the callback re-arms it. */
+status_t platform_set_oneshot_timer (platform_timer_callback callback, void *arg, lk_time_t deadline);
 void     platform_stop_timer(void);
 #endif
 
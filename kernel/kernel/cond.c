@@ -11,6 +11,7 @@
 #include <err.h>
 #include <kernel/mutex.h>
 #include <kernel/thread.h>
+#include <platform.h>
 
 void cond_init(cond_t *cond)
 {
@@ -50,7 +51,7 @@ status_t cond_wait_timeout(cond_t *cond, mutex_t *mutex, lk_time_t timeout, bool
         result = ERR_INTERRUPTED;
     } else {
         current_thread->interruptable = interruptable;
-        result = wait_queue_block(&cond->wait, timeout);
+        result = wait_queue_block(&cond->wait, deadline_after(timeout));
         current_thread->interruptable = false;
     }
 
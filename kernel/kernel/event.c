@@ -30,6 +30,7 @@
 #include <assert.h>
 #include <err.h>
 #include <kernel/thread.h>
+#include <platform.h>
 
 /**
  * @brief  Initialize an event object
@@ -72,18 +73,18 @@ void event_destroy(event_t *e)
  * If the event has already been signaled, this function
  * returns immediately.  Otherwise, the current thread
  * goes to sleep until the event object is signaled,
- * the timeout is reached, or the event object is destroyed
+ * the deadline is reached, or the event object is destroyed
  * by another thread.
  *
  * @param e        Event object
- * @param timeout  Timeout value, in ms
+ * @param deadline Time at which to give up, in ns, or INFINITE_TIME
  * @param interruptable  Allowed to interrupt if thread is signaled
  *
  * @return  0 on success, ERR_TIMED_OUT on timeout,
  *          other values depending on wait_result value
  *          when event_signal_etc is used.
  */
-status_t event_wait_timeout(event_t *e, lk_time_t timeout, bool interruptable)
+status_t event_wait_deadline(event_t *e, lk_time_t deadline, bool interruptable)
 {
     thread_t *current_thread = get_current_thread();
     status_t ret = NO_ERROR;
@@ -109,7 +110,7 @@ status_t event_wait_timeout(event_t *e, lk_time_t timeout, bool interruptable)
         }
     } else {
         /* unsignaled, block here */
-        ret = wait_queue_block(&e->wait, timeout);
+        ret = wait_queue_block(&e->wait, deadline);
     }
 
     current_thread->interruptable = false;
@@ -120,6 +121,14 @@ out:
     return ret;
 }
 
+/**
+ * @brief  Wait for event to be signaled, for up to timeout ns
+ */
+status_t event_wait_timeout(event_t *e, lk_time_t timeout, bool interruptable)
+{
+    return event_wait_deadline(e, deadline_after(timeout), interruptable);
+}
+
 /**
  * @brief  Signal an event
  *
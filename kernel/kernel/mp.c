@@ -20,6 +20,9 @@
 #include <kernel/mutex.h>
 #include <kernel/spinlock.h>
 #include <kernel/timer.h>
+#if WITH_LIB_DPC
+#include <lib/dpc.h>
+#endif
 
 #define LOCAL_TRACE 0
 
@@ -312,6 +315,10 @@ status_t mp_unplug_cpu(uint cpu_id) {
 
     /* Now that the CPU is no longer processing tasks, move all of its timers */
     timer_transition_off_cpu(cpu_id);
+#if WITH_LIB_DPC
+    /* and any dpcs waiting for it */
+    dpc_transition_off_cpu(cpu_id);
+#endif
 
     status = platform_mp_cpu_unplug(cpu_id);
     if (status != NO_ERROR) {
@@ -19,7 +19,21 @@
 #include <debug.h>
 #include <assert.h>
 #include <err.h>
+#include <arch/ops.h>
 #include <kernel/thread.h>
+#include <lib/ktrace.h>
+#include <platform.h>
+
+/* how long a contended acquire may spin on a running owner before blocking,
+ * about the cost of blocking and being woken up again */
+#define MUTEX_SPIN_MAX LK_USEC(50)
+
+static inline bool mutex_try_acquire(mutex_t *m, uintptr_t newval)
+{
+    uintptr_t oldval = 0;
+    return __atomic_compare_exchange_n(&m->val, &oldval, newval, false,
+                                       __ATOMIC_ACQUIRE, __ATOMIC_RELAXED);
+}
 
 /**
  * @brief  Initialize a mutex_t
@@ -42,15 +56,16 @@ void mutex_destroy(mutex_t *m)
 
     THREAD_LOCK(state);
 #if LK_DEBUGLEVEL > 0
-    if (unlikely(m->count > 0)) {
+    thread_t *holder = mutex_holder(m);
+    if (unlikely(holder)) {
         panic("mutex_destroy: thread %p (%s) tried to destroy locked mutex %p,"
               " locked by %p (%s)\n",
               get_current_thread(), get_current_thread()->name, m,
-              m->holder, m->holder->name);
+              holder, holder->name);
     }
 #endif
     m->magic = 0;
-    m->count = 0;
+    m->val = 0;
     wait_queue_destroy(&m->wait);
     THREAD_UNLOCK(state);
 }
@@ -61,7 +76,26 @@ status_t mutex_acquire_internal(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
     DEBUG_ASSERT(!arch_in_int_handler());
 
-    if (unlikely(++m->count > 1)) {
+    uintptr_t self = (uintptr_t)get_current_thread();
+
+    for (;;) {
+        uintptr_t oldval = __atomic_load_n(&m->val, __ATOMIC_RELAXED);
+        if (oldval == 0) {
+            /* keep the mutex marked if others are still waiting for it */
+            uintptr_t newval = self | (m->wait.count > 0 ? MUTEX_FLAG_CONTESTED : 0);
+            if (mutex_try_acquire(m, newval))
+                return NO_ERROR;
+            continue;
+        }
+
+        /* mark the mutex so that the owner wakes us when it lets go. the owner
+         * can only release it through the wait queue once this is set, which
+         * needs the thread lock, so we are queued before it can wake anyone */
+        if (!(oldval & MUTEX_FLAG_CONTESTED) &&
+            !__atomic_compare_exchange_n(&m->val, &oldval, oldval | MUTEX_FLAG_CONTESTED,
+                                         false, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+            continue;
+
         status_t ret = wait_queue_block(&m->wait, INFINITE_TIME);
         if (unlikely(ret < NO_ERROR)) {
             /* mutexes are not interruptable and cannot time out, so it
@@ -71,10 +105,32 @@ status_t mutex_acquire_internal(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
                    ret, m, get_current_thread(), __GET_FRAME());
         }
     }
+}
+
+/* Spin while the owner is running on another cpu, in the hope that it lets
+ * go before blocking would pay off. Returns true if the mutex was acquired. */
+static bool mutex_spin(mutex_t *m, uintptr_t self)
+{
+    lk_time_t deadline = current_time() + MUTEX_SPIN_MAX;
+
+    for (;;) {
+        uintptr_t oldval = __atomic_load_n(&m->val, __ATOMIC_RELAXED);
+        if (oldval == 0) {
+            if (mutex_try_acquire(m, self))
+                return true;
+            continue;
+        }
 
-    m->holder = get_current_thread();
+        /* threads are already blocked waiting: queue up behind them */
+        if (oldval & MUTEX_FLAG_CONTESTED)
+            return false;
+        if (!thread_is_running_elsewhere((thread_t *)oldval))
+            return false;
+        if (current_time() >= deadline)
+            return false;
 
-    return NO_ERROR;
+        arch_spinloop_pause();
+    }
 }
 
 /**
@@ -82,20 +138,40 @@ status_t mutex_acquire_internal(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
  *
  * @return  NO_ERROR on success, other values on error
  */
-status_t mutex_acquire(mutex_t *m)
+status_t mutex_acquire(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
 {
     DEBUG_ASSERT(m->magic == MUTEX_MAGIC);
     DEBUG_ASSERT(!arch_in_int_handler());
 
+    thread_t *current_thread = get_current_thread();
+    uintptr_t self = (uintptr_t)current_thread;
+
+    /* uncontended: a single atomic operation */
+    if (likely(mutex_try_acquire(m, self)))
+        return NO_ERROR;
+
 #if LK_DEBUGLEVEL > 0
-    if (unlikely(get_current_thread() == m->holder))
+    if (unlikely(current_thread == mutex_holder(m)))
         panic("mutex_acquire: thread %p (%s) tried to acquire mutex %p it already owns.\n",
-              get_current_thread(), get_current_thread()->name, m);
+              current_thread, current_thread->name, m);
 #endif
 
+    lk_time_t start = current_time();
+    if (mutex_spin(m, self)) {
+        THREAD_STATS_INC(mutex_spins);
+        ktrace(TAG_MUTEX_SPIN, (uint32_t)(uintptr_t)m, (uint32_t)((uintptr_t)m >> 32),
+               (uint32_t)(current_time() - start), 0);
+        return NO_ERROR;
+    }
+    lk_time_t spun = current_time();
+
     THREAD_LOCK(state);
     status_t ret = mutex_acquire_internal(m);
     THREAD_UNLOCK(state);
+
+    THREAD_STATS_INC(mutex_blocks);
+    ktrace(TAG_MUTEX_BLOCK, (uint32_t)(uintptr_t)m, (uint32_t)((uintptr_t)m >> 32),
+           (uint32_t)(spun - start), (uint32_t)(current_time() - spun));
     return ret;
 }
 
@@ -105,31 +181,41 @@ void mutex_release_internal(mutex_t *m, bool reschedule) TA_NO_THREAD_SAFETY_ANA
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
     DEBUG_ASSERT(!arch_in_int_handler());
 
-    m->holder = 0;
+    uintptr_t oldval = (uintptr_t)get_current_thread();
+    if (__atomic_compare_exchange_n(&m->val, &oldval, 0, false,
+                                    __ATOMIC_RELEASE, __ATOMIC_RELAXED))
+        return;
 
-    if (unlikely(--m->count >= 1)) {
-        /* release a thread */
-        wait_queue_wake_one(&m->wait, reschedule, NO_ERROR);
-    }
+    /* contested: let go, then release a thread to try again */
+    __atomic_store_n(&m->val, 0, __ATOMIC_RELEASE);
+    wait_queue_wake_one(&m->wait, reschedule, NO_ERROR);
 }
 
 /**
  * @brief  Release mutex
  */
-void mutex_release(mutex_t *m)
+void mutex_release(mutex_t *m) TA_NO_THREAD_SAFETY_ANALYSIS
 {
     DEBUG_ASSERT(m->magic == MUTEX_MAGIC);
     DEBUG_ASSERT(!arch_in_int_handler());
 
+    thread_t *current_thread = get_current_thread();
+
 #if LK_DEBUGLEVEL > 0
-    if (unlikely(get_current_thread() != m->holder)) {
+    thread_t *holder = mutex_holder(m);
+    if (unlikely(current_thread != holder)) {
         panic("mutex_release: thread %p (%s) tried to release mutex %p it doesn't own. owned by %p (%s)\n",
-              get_current_thread(), get_current_thread()->name, m, m->holder, m->holder ? m->holder->name : "none");
+              current_thread, current_thread->name, m, holder, holder ? holder->name : "none");
     }
 #endif
 
+    /* uncontended: a single atomic operation */
+    uintptr_t oldval = (uintptr_t)current_thread;
+    if (likely(__atomic_compare_exchange_n(&m->val, &oldval, 0, false,
+                                           __ATOMIC_RELEASE, __ATOMIC_RELAXED)))
+        return;
+
     THREAD_LOCK(state);
     mutex_release_internal(m, true);
     THREAD_UNLOCK(state);
 }
-
@@ -47,9 +47,8 @@ struct thread_stats thread_stats[SMP_MAX_CPUS];
 #define TRACE_CONTEXT_SWITCH(str, x...) \
     do { if (DEBUG_THREAD_CONTEXT_SWITCH) printf("CS " str, ## x); } while (0)
 
-#define THREAD_INITIAL_TIME_SLICE ((lk_bigtime_t)50000000u) // 50ms
-#define THREAD_TICK_RATE ((lk_bigtime_t)10000000u) // 10ms
-#define THREAD_TICK_RATE_MS (THREAD_TICK_RATE / 1000000u) // 10ms
+#define THREAD_INITIAL_TIME_SLICE LK_MSEC(50)
+#define THREAD_TICK_RATE LK_MSEC(10) // only on platforms without a dynamic timer
 
 /* global thread list */
 static struct list_node thread_list = LIST_INITIAL_VALUE(thread_list);
@@ -60,6 +59,9 @@ spin_lock_t thread_lock = SPIN_LOCK_INITIAL_VALUE;
 /* the idle thread(s) (statically allocated) */
 thread_t idle_threads[SMP_MAX_CPUS];
 
+/* the thread each cpu is running, only ever compared against */
+static thread_t *volatile running_threads[SMP_MAX_CPUS];
+
 /* local routines */
 void thread_resched(void);
 static int idle_thread_routine(void *) __NO_RETURN;
@@ -68,8 +70,10 @@ static void thread_exit_locked(thread_t *current_thread, int retcode) __NO_RETUR
 /* scheduler */
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-/* preemption timer */
+/* preemption timer, armed as a one shot for the end of the running thread's time slice */
 static timer_t preempt_timer[SMP_MAX_CPUS];
+
+static enum handler_return thread_preempt_timer_expired(timer_t *timer, lk_time_t now, void *arg);
 #endif
 
 static void init_thread_struct(thread_t *t, const char *name)
@@ -282,7 +286,7 @@ status_t thread_join(thread_t *t, int *retcode, lk_time_t timeout)
 
     /* wait for the thread to die */
     if (t->state != THREAD_DEATH) {
-        status_t err = wait_queue_block(&t->retcode_wait_queue, timeout);
+        status_t err = wait_queue_block(&t->retcode_wait_queue, deadline_after(timeout));
         if (err < 0) {
             THREAD_UNLOCK(state);
             return err;
@@ -550,13 +554,32 @@ void thread_resched(void)
     thread_t *oldthread = current_thread;
 
     /* if it's the same thread as we're already running, exit */
-    if (newthread == oldthread)
+    if (newthread == oldthread) {
+#if PLATFORM_HAS_DYNAMIC_TIMER
+        /* nothing else wants the cpu; if the thread's slice ran out, give it another */
+        if (newthread->remaining_time_slice == 0 && !thread_is_real_time_or_idle(newthread)) {
+            newthread->remaining_time_slice = THREAD_INITIAL_TIME_SLICE;
+            timer_cancel(&preempt_timer[cpu]);
+            timer_set_oneshot(&preempt_timer[cpu], current_time() + THREAD_INITIAL_TIME_SLICE,
+                              thread_preempt_timer_expired, NULL);
+        }
+#endif
         return;
+    }
 
-    lk_bigtime_t now = current_time_hires();
-    oldthread->runtime_ns += now - oldthread->last_started_running;
+    lk_time_t now = current_time();
+    lk_time_t ran = now - oldthread->last_started_running;
+    oldthread->runtime_ns += ran;
     newthread->last_started_running = now;
 
+#if PLATFORM_HAS_DYNAMIC_TIMER
+    /* charge the old thread for the part of its slice it used. without a dynamic
+     * timer the periodic tick does this in thread_timer_tick() */
+    if (!thread_is_real_time_or_idle(oldthread)) {
+        oldthread->remaining_time_slice -= MIN(ran, oldthread->remaining_time_slice);
+    }
+#endif
+
     /* set up quantum for the new thread if it was consumed */
     if (newthread->remaining_time_slice == 0) {
         newthread->remaining_time_slice = THREAD_INITIAL_TIME_SLICE;
@@ -591,20 +614,21 @@ void thread_resched(void)
            (uint32_t)(uintptr_t)oldthread, (uint32_t)(uintptr_t)newthread);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-    if (thread_is_real_time_or_idle(newthread)) {
-        if (!thread_is_real_time_or_idle(oldthread)) {
-            /* if we're switching from a non real time to a real time, cancel
-             * the preemption timer. */
-            TRACE_CONTEXT_SWITCH("stop preempt, cpu %u, old %p (%s), new %p (%s)\n",
-                    cpu, oldthread, oldthread->name, newthread, newthread->name);
-            timer_cancel(&preempt_timer[cpu]);
-        }
-    } else if (thread_is_real_time_or_idle(oldthread)) {
-        /* if we're switching from a real time (or idle thread) to a regular one,
-         * set up a periodic timer to run our preemption tick. */
-        TRACE_CONTEXT_SWITCH("start preempt, cpu %u, old %p (%s), new %p (%s)\n",
-                cpu, oldthread, oldthread->name, newthread, newthread->name);
-        timer_set_periodic(&preempt_timer[cpu], THREAD_TICK_RATE_MS, (timer_callback)thread_timer_tick, NULL);
+    /* there is no periodic tick. a regular thread gets a one shot timer for the end
+     * of its slice; real time and idle threads run with no timer at all, so an idle
+     * cpu takes no interrupts until some other timer comes due. */
+    if (!thread_is_real_time_or_idle(oldthread)) {
+        timer_cancel(&preempt_timer[cpu]);
+    }
+    if (!thread_is_real_time_or_idle(newthread)) {
+        TRACE_CONTEXT_SWITCH("start preempt, cpu %u, old %p (%s), new %p (%s), slice %" PRIu64 "\n",
+                cpu, oldthread, oldthread->name, newthread, newthread->name,
+                newthread->remaining_time_slice);
+        timer_set_oneshot(&preempt_timer[cpu], now + newthread->remaining_time_slice,
+                          thread_preempt_timer_expired, NULL);
+    } else if (thread_is_idle(newthread)) {
+        /* let a busy cpu service our timers if it can, so that we stay idle longer */
+        timer_migrate_idle();
     }
 #endif
 
@@ -612,6 +636,7 @@ void thread_resched(void)
     target_set_debug_led(0, !thread_is_idle(newthread));
 
     /* do the switch */
+    running_threads[cpu] = newthread;
     set_current_thread(newthread);
 
     TRACE_CONTEXT_SWITCH("cpu %u, old %p (%s, pri %d, flags 0x%x), new %p (%s, pri %d, flags 0x%x)\n",
@@ -645,6 +670,16 @@ void thread_resched(void)
     arch_context_switch(oldthread, newthread);
 }
 
+bool thread_is_running_elsewhere(const thread_t *t)
+{
+    uint curr_cpu = arch_curr_cpu_num();
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        if (i != curr_cpu && running_threads[i] == t)
+            return true;
+    }
+    return false;
+}
+
 /**
  * @brief Yield the cpu to another thread
  *
@@ -711,6 +746,24 @@ void thread_preempt(bool interrupt)
     THREAD_UNLOCK(state);
 }
 
+#if PLATFORM_HAS_DYNAMIC_TIMER
+/* the running thread has used up its time slice */
+static enum handler_return thread_preempt_timer_expired(timer_t *timer, lk_time_t now, void *arg)
+{
+    thread_t *current_thread = get_current_thread();
+
+    if (thread_is_real_time_or_idle(current_thread))
+        return INT_NO_RESCHEDULE;
+
+    current_thread->remaining_time_slice = 0;
+
+    ktrace_probe2("timer_tick", (uint32_t)current_thread->user_tid, 0);
+
+    return INT_RESCHEDULE;
+}
+#endif
+
+/* periodic tick, used to expire time slices on platforms without a dynamic timer */
 enum handler_return thread_timer_tick(void)
 {
     thread_t *current_thread = get_current_thread();
@@ -758,14 +811,15 @@ static enum handler_return thread_sleep_handler(timer_t *timer, lk_time_t now, v
 }
 
 /**
- * @brief  Put thread to sleep; delay specified in ms
+ * @brief  Put thread to sleep; delay specified in ns
  *
  * This function puts the current thread to sleep until the specified
- * delay in ms has expired.
+ * delay in ns has expired.
  *
  * Note that this function could sleep for longer than the specified delay if
- * other threads are running.  When the timer expires, this thread will
- * be placed at the head of the run queue.
+ * other threads are running, and the wakeup may be late by up to the thread's
+ * timer_slack.  When the timer expires, this thread will be placed at the head
+ * of the run queue.
  *
  * interruptable argument allows this routine to return early if the thread was signaled
  * for something.
@@ -792,7 +846,8 @@ status_t thread_sleep_etc(lk_time_t delay, bool interruptable)
     }
 
     /* set a one shot timer to wake us up and reschedule */
-    timer_set_oneshot(&timer, delay, thread_sleep_handler, (void *)current_thread);
+    timer_set_oneshot_etc(&timer, deadline_after(delay), current_thread->timer_slack,
+                          thread_sleep_handler, (void *)current_thread);
     current_thread->state = THREAD_SLEEPING;
     current_thread->blocked_status = NO_ERROR;
 
@@ -817,13 +872,13 @@ out:
  * This takes the thread_lock to ensure there are no races while calculating the
  * runtime of the thread.
  */
-lk_bigtime_t thread_runtime(const thread_t *t)
+lk_time_t thread_runtime(const thread_t *t)
 {
     THREAD_LOCK(state);
 
-    lk_bigtime_t runtime = t->runtime_ns;
+    lk_time_t runtime = t->runtime_ns;
     if (t->state == THREAD_RUNNING) {
-        runtime += current_time_hires() - t->last_started_running;
+        runtime += current_time() - t->last_started_running;
     }
 
     THREAD_UNLOCK(state);
@@ -1056,9 +1111,9 @@ void dump_thread(thread_t *t, bool full_dump)
         dprintf(INFO, "dump_thread WARNING: thread at %p has bad magic\n", t);
     }
 
-    lk_bigtime_t runtime = t->runtime_ns;
+    lk_time_t runtime = t->runtime_ns;
     if (t->state == THREAD_RUNNING) {
-        runtime += current_time_hires() - t->last_started_running;
+        runtime += current_time() - t->last_started_running;
     }
 
     char oname[THREAD_NAME_LENGTH];
@@ -1174,17 +1229,17 @@ static enum handler_return wait_queue_timeout_handler(timer_t *timer, lk_time_t
  * up again.
  *
  * @param  wait     The wait queue to enter
- * @param  timeout  The maximum time, in ms, to wait
+ * @param  deadline The time, in ns, at which to give up waiting
  *
- * If the timeout is zero, this function returns immediately with
- * ERR_TIMED_OUT.  If the timeout is INFINITE_TIME, this function
+ * If the deadline has already passed, this function returns immediately
+ * with ERR_TIMED_OUT.  If the deadline is INFINITE_TIME, this function
  * waits indefinitely.  Otherwise, this function returns with
- * ERR_TIMED_OUT at the end of the timeout period.
+ * ERR_TIMED_OUT once the current time reaches the deadline.
  *
  * @return ERR_TIMED_OUT on timeout, else returns the return
  * value specified when the queue was woken by wait_queue_wake_one().
  */
-status_t wait_queue_block(wait_queue_t *wait, lk_time_t timeout)
+status_t wait_queue_block(wait_queue_t *wait, lk_time_t deadline)
 {
     timer_t timer;
 
@@ -1195,7 +1250,7 @@ status_t wait_queue_block(wait_queue_t *wait, lk_time_t timeout)
     DEBUG_ASSERT(arch_ints_disabled());
     DEBUG_ASSERT(spin_lock_held(&thread_lock));
 
-    if (timeout == 0)
+    if (deadline != INFINITE_TIME && deadline <= current_time())
         return ERR_TIMED_OUT;
 
     list_add_tail(&wait->list, &current_thread->queue_node);
@@ -1204,16 +1259,17 @@ status_t wait_queue_block(wait_queue_t *wait, lk_time_t timeout)
     current_thread->blocking_wait_queue = wait;
     current_thread->blocked_status = NO_ERROR;
 
-    /* if the timeout is nonzero or noninfinite, set a callback to yank us out of the queue */
-    if (timeout != INFINITE_TIME) {
+    /* if the deadline is noninfinite, set a callback to yank us out of the queue */
+    if (deadline != INFINITE_TIME) {
         timer_initialize(&timer);
-        timer_set_oneshot(&timer, timeout, wait_queue_timeout_handler, (void *)current_thread);
+        timer_set_oneshot_etc(&timer, deadline, current_thread->timer_slack,
+                              wait_queue_timeout_handler, (void *)current_thread);
     }
 
     sched_block();
 
     /* we don't really know if the timer fired or not, so it's better safe to try to cancel it */
-    if (timeout != INFINITE_TIME) {
+    if (deadline != INFINITE_TIME) {
         timer_cancel(&timer);
     }
 
@@ -17,13 +17,22 @@
  *
  * Timer callback functions are called in interrupt context.
  *
+ * Each cpu keeps its pending timers in a pairing heap, ordered by the latest
+ * time each may fire, so arming and cancelling stay cheap with many thousands
+ * of timeouts outstanding.  The hardware timer is programmed for the earliest
+ * of those latest times.  When it fires, timers are run from the head of the
+ * heap until one is reached whose deadline has not yet passed.  A timer with
+ * slack thus shares an earlier interrupt when it is next in line by latest
+ * time; otherwise it waits for its own latest time.
+ *
  * @{
  */
 #include <debug.h>
 #include <err.h>
+#include <inttypes.h>
 #include <trace.h>
 #include <assert.h>
-#include <list.h>
+#include <kernel/mp.h>
 #include <kernel/thread.h>
 #include <kernel/timer.h>
 #include <kernel/spinlock.h>
@@ -35,7 +44,10 @@
 spin_lock_t timer_lock;
 
 struct timer_state {
-    struct list_node timer_queue;
+    /* root of the pairing heap of pending timers */
+    timer_t *queue;
+    /* when the hardware timer is next due to fire, INFINITE_TIME if stopped */
+    lk_time_t armed_time;
 } __CPU_ALIGN;
 
 static struct timer_state timers[SMP_MAX_CPUS];
@@ -50,42 +62,150 @@ void timer_initialize(timer_t *timer)
     *timer = (timer_t)TIMER_INITIAL_VALUE(*timer);
 }
 
-static void insert_timer_in_queue(uint cpu, timer_t *timer)
+/* combine two heaps, neither of which may be part of another */
+static timer_t *heap_meld(timer_t *a, timer_t *b)
+{
+    if (a == NULL)
+        return b;
+    if (b == NULL)
+        return a;
+
+    if (b->latest_time < a->latest_time) {
+        timer_t *tmp = a;
+        a = b;
+        b = tmp;
+    }
+
+    /* b becomes the first child of a */
+    b->heap_prev = a;
+    b->heap_next = a->heap_child;
+    if (a->heap_child)
+        a->heap_child->heap_prev = b;
+    a->heap_child = b;
+
+    return a;
+}
+
+/* combine a list of siblings into one heap: meld them in pairs from the front,
+ * then meld the pairs together from the back */
+static timer_t *heap_merge_pairs(timer_t *first)
 {
-    timer_t *entry;
+    timer_t *pairs = NULL;
+    while (first) {
+        timer_t *a = first;
+        timer_t *b = a->heap_next;
+        first = b ? b->heap_next : NULL;
+
+        a->heap_prev = a->heap_next = NULL;
+        if (b)
+            b->heap_prev = b->heap_next = NULL;
+
+        timer_t *pair = heap_meld(a, b);
+        pair->heap_next = pairs;
+        pairs = pair;
+    }
+
+    timer_t *root = NULL;
+    while (pairs) {
+        timer_t *next = pairs->heap_next;
+        pairs->heap_next = NULL;
+        root = heap_meld(root, pairs);
+        pairs = next;
+    }
+
+    return root;
+}
 
+static void insert_timer_in_queue(uint cpu, timer_t *timer)
+{
     DEBUG_ASSERT(arch_ints_disabled());
 
-    LTRACEF("timer %p, cpu %u, scheduled %u, periodic %u\n", timer, cpu, timer->scheduled_time, timer->periodic_time);
+    timer->latest_time = timer->scheduled_time + timer->slack;
+    if (timer->latest_time < timer->scheduled_time)
+        timer->latest_time = INFINITE_TIME;
+
+    LTRACEF("timer %p, cpu %u, scheduled %" PRIu64 ", latest %" PRIu64 ", periodic %" PRIu64 "\n",
+            timer, cpu, timer->scheduled_time, timer->latest_time, timer->periodic_time);
 
-    list_for_every_entry(&timers[cpu].timer_queue, entry, timer_t, node) {
-        if (TIME_GT(entry->scheduled_time, timer->scheduled_time)) {
-            list_add_before(&entry->node, &timer->node);
-            return;
+    timer->heap_child = timer->heap_next = timer->heap_prev = NULL;
+    timer->queue_cpu = cpu;
+
+    timers[cpu].queue = heap_meld(timers[cpu].queue, timer);
+    timers[cpu].queue->queue_cpu = cpu;
+}
+
+static void remove_timer_from_queue(timer_t *timer)
+{
+    DEBUG_ASSERT(timer->queue_cpu >= 0);
+
+    timer_t *children = heap_merge_pairs(timer->heap_child);
+
+    if (timer->heap_prev == NULL) {
+        /* the root of a queue */
+        uint cpu = timer->queue_cpu;
+        DEBUG_ASSERT(timers[cpu].queue == timer);
+
+        timers[cpu].queue = children;
+        if (children)
+            children->queue_cpu = cpu;
+    } else {
+        /* none of the children fire before the timer's parent, so they can
+         * take the timer's place without disturbing the rest of the heap */
+        timer_t *prev = timer->heap_prev;
+        timer_t *next = timer->heap_next;
+        timer_t *replacement;
+        if (children) {
+            children->heap_prev = prev;
+            children->heap_next = next;
+            if (next)
+                next->heap_prev = children;
+            replacement = children;
+        } else {
+            if (next)
+                next->heap_prev = prev;
+            replacement = next;
+        }
+
+        if (prev->heap_child == timer) {
+            prev->heap_child = replacement;
+        } else {
+            prev->heap_next = replacement;
         }
     }
 
-    /* walked off the end of the list */
-    list_add_tail(&timers[cpu].timer_queue, &timer->node);
+    timer->heap_child = timer->heap_next = timer->heap_prev = NULL;
+    timer->queue_cpu = -1;
 }
 
-static void timer_set(timer_t *timer, lk_time_t delay, lk_time_t period, timer_callback callback, void *arg)
+#if PLATFORM_HAS_DYNAMIC_TIMER
+/* program this cpu's hardware timer for the head of its queue */
+static void update_platform_timer(uint cpu)
 {
-    lk_time_t now;
+    timer_t *head = timers[cpu].queue;
+    if (head) {
+        LTRACEF("setting new timer for %" PRIu64 "\n", head->latest_time);
+        platform_set_oneshot_timer(timer_tick, NULL, head->latest_time);
+        timers[cpu].armed_time = head->latest_time;
+    } else {
+        LTRACEF("clearing old hw timer, nothing in the queue\n");
+        platform_stop_timer();
+        timers[cpu].armed_time = INFINITE_TIME;
+    }
+}
+#endif
 
-    LTRACEF("timer %p, delay %u, period %u, callback %p, arg %p\n", timer, delay, period, callback, arg);
+static void timer_set(timer_t *timer, lk_time_t deadline, lk_time_t slack, lk_time_t period,
+                      timer_callback callback, void *arg)
+{
+    LTRACEF("timer %p, deadline %" PRIu64 ", slack %" PRIu64 ", period %" PRIu64 ", callback %p, arg %p\n",
+            timer, deadline, slack, period, callback, arg);
 
     DEBUG_ASSERT(timer->magic == TIMER_MAGIC);
 
-    if (list_in_list(&timer->node)) {
+    if (timer->queue_cpu >= 0) {
         panic("timer %p already in list\n", timer);
     }
 
-    /* Bump the delay, since we're probably straddling a millisecond */
-    delay += 1;
-
-    now = current_time();
-
     spin_lock_saved_state_t state;
     spin_lock_irqsave(&timer_lock, state);
 
@@ -100,22 +220,20 @@ static void timer_set(timer_t *timer, lk_time_t delay, lk_time_t period, timer_c
     }
 
     /* set up the structure */
-    timer->scheduled_time = now + delay;
+    timer->scheduled_time = deadline;
+    timer->slack = slack;
     timer->periodic_time = period;
     timer->callback = callback;
     timer->arg = arg;
     timer->active_cpu = -1;
     timer->cancel = false;
 
-    LTRACEF("scheduled time %u\n", timer->scheduled_time);
-
     insert_timer_in_queue(cpu, timer);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-    if (list_peek_head_type(&timers[cpu].timer_queue, timer_t, node) == timer) {
+    if (timers[cpu].queue == timer) {
         /* we just modified the head of the timer queue */
-        LTRACEF("setting new timer for %u msecs\n", delay);
-        platform_set_oneshot_timer(timer_tick, NULL, delay);
+        update_platform_timer(cpu);
     }
 #endif
 
@@ -126,22 +244,40 @@ out:
 /**
  * @brief  Set up a timer that executes once
  *
- * This function specifies a callback function to be called after a specified
- * delay.  The function will be called one time.
+ * This function specifies a callback function to be called once the current
+ * time reaches a deadline.  The function will be called one time.  A deadline
+ * that has already passed fires on the next timer interrupt.
  *
  * @param  timer The timer to use
- * @param  delay The delay, in ms, before the timer is executed
+ * @param  deadline The time, in ns, at which the timer is executed
  * @param  callback  The function to call when the timer expires
  * @param  arg  The argument to pass to the callback
  *
  * The timer function is declared as:
  *   enum handler_return callback(struct timer *, lk_time_t now, void *arg) { ... }
  */
-void timer_set_oneshot(timer_t *timer, lk_time_t delay, timer_callback callback, void *arg)
+void timer_set_oneshot(timer_t *timer, lk_time_t deadline, timer_callback callback, void *arg)
 {
-    if (delay == 0)
-        delay = 1;
-    timer_set(timer, delay, 0, callback, arg);
+    timer_set(timer, deadline, 0, 0, callback, arg);
+}
+
+/**
+ * @brief  Set up a timer that executes once, at some point in a window
+ *
+ * Like timer_set_oneshot(), except that the callback may be delayed by up to
+ * slack past the deadline so that it can run in the same interrupt as a
+ * neighbouring timer.
+ *
+ * @param  timer The timer to use
+ * @param  deadline The time, in ns, before which the timer will not execute
+ * @param  slack How much later, in ns, the timer may execute
+ * @param  callback  The function to call when the timer expires
+ * @param  arg  The argument to pass to the callback
+ */
+void timer_set_oneshot_etc(timer_t *timer, lk_time_t deadline, lk_time_t slack,
+                           timer_callback callback, void *arg)
+{
+    timer_set(timer, deadline, slack, 0, callback, arg);
 }
 
 /**
@@ -151,7 +287,7 @@ void timer_set_oneshot(timer_t *timer, lk_time_t delay, timer_callback callback,
  * delay.  The function will be called repeatedly.
  *
  * @param  timer The timer to use
- * @param  delay The delay, in ms, before the timer is executed
+ * @param  period The interval, in ns, between executions of the timer
  * @param  callback  The function to call when the timer expires
  * @param  arg  The argument to pass to the callback
  *
@@ -162,7 +298,7 @@ void timer_set_periodic(timer_t *timer, lk_time_t period, timer_callback callbac
 {
     if (period == 0)
         period = 1;
-    timer_set(timer, period, period, callback, arg);
+    timer_set(timer, current_time() + period, 0, period, callback, arg);
 }
 
 /**
@@ -197,33 +333,20 @@ void timer_cancel(timer_t *timer)
     }
 
     /* if the timer is in a queue, remove it and adjust hardware timers if needed */
-    if (list_in_list(&timer->node)) {
+    if (timer->queue_cpu >= 0) {
 #if PLATFORM_HAS_DYNAMIC_TIMER
-        timer_t *oldhead = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+        timer_t *oldhead = timers[cpu].queue;
 #endif
 
         /* remove it from the queue */
-        list_delete(&timer->node);
+        remove_timer_from_queue(timer);
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
         /* see if we've just modified the head of this cpu's timer queue */
         /* if we modified another cpu's queue, we'll just let it fire and sort itself out */
-        timer_t *newhead = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
-        if (newhead == NULL) {
-            LTRACEF("clearing old hw timer, nothing in the queue\n");
-            platform_stop_timer();
-        } else if (newhead != oldhead) {
-            lk_time_t delay;
-            lk_time_t now = current_time();
-
-            if (TIME_LT(newhead->scheduled_time, now))
-                delay = 0;
-            else
-                delay = newhead->scheduled_time - now;
-
-            LTRACEF("setting new timer to %u\n", (uint) delay);
-            platform_set_oneshot_timer(timer_tick, NULL, delay);
-        }
+        timer_t *newhead = timers[cpu].queue;
+        if (newhead == NULL || newhead != oldhead)
+            update_platform_timer(cpu);
 #endif
     }
 
@@ -252,17 +375,20 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 
     uint cpu = arch_curr_cpu_num();
 
-    LTRACEF("cpu %u now %u, sp %p\n", cpu, now, __GET_FRAME());
+    LTRACEF("cpu %u now %" PRIu64 ", sp %p\n", cpu, now, __GET_FRAME());
 
     spin_lock(&timer_lock);
 
     for (;;) {
-        /* see if there's an event to process */
-        timer = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+        /* see if there's an event to process. the head is the timer that must
+         * fire soonest; a later one whose deadline has also passed but whose
+         * slack has not run out waits for the interrupt after this one */
+        timer = timers[cpu].queue;
         if (likely(timer == 0))
             break;
-        LTRACEF("next item on timer queue %p at %u now %u (%p, arg %p)\n", timer, timer->scheduled_time, now, timer->callback, timer->arg);
-        if (likely(TIME_LT(now, timer->scheduled_time)))
+        LTRACEF("next item on timer queue %p at %" PRIu64 " now %" PRIu64 " (%p, arg %p)\n",
+                timer, timer->scheduled_time, now, timer->callback, timer->arg);
+        if (likely(now < timer->scheduled_time))
             break;
 
         /* process it */
@@ -270,7 +396,7 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
         DEBUG_ASSERT_MSG(timer && timer->magic == TIMER_MAGIC,
                 "ASSERT: timer failed magic check: timer %p, magic 0x%x\n",
                 timer, (uint)timer->magic);
-        list_delete(&timer->node);
+        remove_timer_from_queue(timer);
 
         /* mark the timer busy */
         timer->active_cpu = cpu;
@@ -279,7 +405,8 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
         /* we pulled it off the list, release the list lock to handle it */
         spin_unlock(&timer_lock);
 
-        LTRACEF("dequeued timer %p, scheduled %u periodic %u\n", timer, timer->scheduled_time, timer->periodic_time);
+        LTRACEF("dequeued timer %p, scheduled %" PRIu64 " periodic %" PRIu64 "\n",
+                timer, timer->scheduled_time, timer->periodic_time);
 
         THREAD_STATS_INC(timers);
 
@@ -306,9 +433,12 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
             /* if it is a periodic timer and it hasn't been requeued
              * by the callback put it back in the list
              */
-            if (timer->periodic_time > 0 && !list_in_list(&timer->node)) {
-                LTRACEF("periodic timer, period %u\n", timer->periodic_time);
-                timer->scheduled_time = now + timer->periodic_time;
+            if (timer->periodic_time > 0 && timer->queue_cpu < 0) {
+                LTRACEF("periodic timer, period %" PRIu64 "\n", timer->periodic_time);
+                /* stay on the original cadence unless we've fallen a whole period behind */
+                timer->scheduled_time += timer->periodic_time;
+                if (timer->scheduled_time <= now)
+                    timer->scheduled_time = now + timer->periodic_time;
                 insert_timer_in_queue(cpu, timer);
             }
         }
@@ -316,15 +446,17 @@ static enum handler_return timer_tick(void *arg, lk_time_t now)
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
     /* reset the timer to the next event */
-    timer = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+    timer = timers[cpu].queue;
     if (timer) {
         /* has to be the case or it would have fired already */
-        DEBUG_ASSERT(TIME_GT(timer->scheduled_time, now));
-
-        lk_time_t delay = timer->scheduled_time - now;
-
-        LTRACEF("setting new timer for %u msecs for event %p\n", (uint)delay, timer);
-        platform_set_oneshot_timer(timer_tick, NULL, delay);
+        DEBUG_ASSERT(timer->latest_time > now);
+
+        LTRACEF("setting new timer for %" PRIu64 " for event %p\n", timer->latest_time, timer);
+        platform_set_oneshot_timer(timer_tick, NULL, timer->latest_time);
+        timers[cpu].armed_time = timer->latest_time;
+    } else {
+        /* the one shot that brought us here has fired, so nothing is armed */
+        timers[cpu].armed_time = INFINITE_TIME;
     }
 
     /* we're done manipulating the timer queue */
@@ -366,33 +498,63 @@ void timer_transition_off_cpu(uint old_cpu)
     spin_lock_irqsave(&timer_lock, state);
     uint cpu = arch_curr_cpu_num();
 
-    timer_t *old_head = list_peek_head_type(&timers[old_cpu].timer_queue, timer_t, node);
+    timer_t *old_head = timers[cpu].queue;
 
-    timer_t *entry = NULL, *tmp_entry = NULL;
     /* Move all timers from old_cpu to this cpu */
-    list_for_every_entry_safe(&timers[old_cpu].timer_queue, entry, tmp_entry, timer_t, node) {
-        list_delete(&entry->node);
-        insert_timer_in_queue(cpu, entry);
-    }
+    timers[cpu].queue = heap_meld(timers[cpu].queue, timers[old_cpu].queue);
+    if (timers[cpu].queue)
+        timers[cpu].queue->queue_cpu = cpu;
+    timers[old_cpu].queue = NULL;
+    timers[old_cpu].armed_time = INFINITE_TIME;
 
 #if PLATFORM_HAS_DYNAMIC_TIMER
-    timer_t *new_head = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
+    timer_t *new_head = timers[cpu].queue;
     if (new_head != NULL && new_head != old_head) {
-        lk_time_t now = current_time();
-        lk_time_t delay = 0;
-        if (TIME_LT(now, new_head->scheduled_time)) {
-            delay = new_head->scheduled_time - now;
-        }
-
         /* we just modified the head of the timer queue */
-        LTRACEF("setting new timer for %u msecs\n", delay);
-        platform_set_oneshot_timer(timer_tick, NULL, delay);
+        update_platform_timer(cpu);
     }
 #endif
 
     spin_unlock_irqrestore(&timer_lock, state);
 }
 
+/* Called by the scheduler, with interrupts disabled, as this cpu switches to
+ * its idle thread.  If a busy cpu's hardware timer is due to fire before any
+ * of ours must, hand it our whole queue so that this cpu can stay asleep.  The
+ * busy cpu picks our timers up when it next reprograms, so it needs no IPI. */
+void timer_migrate_idle(void)
+{
+#if PLATFORM_HAS_DYNAMIC_TIMER && WITH_SMP
+    DEBUG_ASSERT(arch_ints_disabled());
+    spin_lock(&timer_lock);
+
+    uint cpu = arch_curr_cpu_num();
+    timer_t *head = timers[cpu].queue;
+    if (head == NULL)
+        goto out;
+
+    mp_cpu_mask_t busy = mp_get_active_mask() & ~mp_get_idle_mask() & ~(1U << cpu);
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        if (!(busy & (1U << i)))
+            continue;
+        if (timers[i].armed_time > head->latest_time)
+            continue;
+
+        LTRACEF("cpu %u idle, moving timers to cpu %u\n", cpu, i);
+        timers[i].queue = heap_meld(timers[i].queue, head);
+        timers[i].queue->queue_cpu = i;
+        timers[cpu].queue = NULL;
+
+        platform_stop_timer();
+        timers[cpu].armed_time = INFINITE_TIME;
+        break;
+    }
+
+out:
+    spin_unlock(&timer_lock);
+#endif
+}
+
 /* This function is to be invoked after resume on each CPU that may have
  * had timers still on it, in order to restart hardware timers. */
 void timer_thaw_percpu(void)
@@ -403,15 +565,9 @@ void timer_thaw_percpu(void)
 
     uint cpu = arch_curr_cpu_num();
 
-    timer_t *t = list_peek_head_type(&timers[cpu].timer_queue, timer_t, node);
-    if (t) {
-        lk_time_t now = current_time();
-        lk_time_t delay = 0;
-        if (TIME_LT(now, t->scheduled_time)) {
-            delay = t->scheduled_time - now;
-        }
-        LTRACEF("rescheduling timer for %u msecs\n", delay);
-        platform_set_oneshot_timer(timer_tick, NULL, delay);
+    if (timers[cpu].queue) {
+        LTRACEF("rescheduling timer for %" PRIu64 "\n", timers[cpu].queue->latest_time);
+        update_platform_timer(cpu);
     }
 
     spin_unlock(&timer_lock);
@@ -422,10 +578,11 @@ void timer_init(void)
 {
     timer_lock = SPIN_LOCK_INITIAL_VALUE;
     for (uint i = 0; i < SMP_MAX_CPUS; i++) {
-        list_initialize(&timers[i].timer_queue);
+        timers[i].queue = NULL;
+        timers[i].armed_time = INFINITE_TIME;
     }
 #if !PLATFORM_HAS_DYNAMIC_TIMER
     /* register for a periodic timer tick */
-    platform_set_periodic_timer(timer_tick, NULL, 10); /* 10ms */
+    platform_set_periodic_timer(timer_tick, NULL, LK_MSEC(10));
 #endif
 }
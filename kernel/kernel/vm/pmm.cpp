@@ -352,7 +352,7 @@ static int cmd_pmm(int argc, const cmd_args* argv) {
         if (!show_mem) {
             printf("pmm free: issue the same command to stop.\n");
             timer_initialize(&timer);
-            timer_set_periodic(&timer, 1000, &pmm_dump_timer, NULL);
+            timer_set_periodic(&timer, LK_SEC(1), &pmm_dump_timer, NULL);
             show_mem = true;
         } else {
             timer_cancel(&timer);
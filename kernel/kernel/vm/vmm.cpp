@@ -268,7 +268,7 @@ static int cmd_vmm(int argc, const cmd_args* argv) {
 
         test_aspace = aspace;
         get_current_thread()->aspace = aspace;
-        thread_sleep(1); // XXX hack to force it to reschedule and thus load the aspace
+        thread_sleep(LK_MSEC(1)); // XXX hack to force it to reschedule and thus load the aspace
     } else if (!strcmp(argv[1].str, "free_aspace")) {
         if (argc < 2)
             goto notenoughargs;
@@ -279,7 +279,7 @@ static int cmd_vmm(int argc, const cmd_args* argv) {
 
         if (get_current_thread()->aspace == aspace) {
             get_current_thread()->aspace = nullptr;
-            thread_sleep(1); // hack
+            thread_sleep(LK_MSEC(1)); // hack
         }
 
         status_t err = vmm_free_aspace(aspace);
@@ -290,7 +290,7 @@ static int cmd_vmm(int argc, const cmd_args* argv) {
 
         test_aspace = (vmm_aspace_t*)(void*)argv[2].u;
         get_current_thread()->aspace = test_aspace;
-        thread_sleep(1); // XXX hack to force it to reschedule and thus load the aspace
+        thread_sleep(LK_MSEC(1)); // XXX hack to force it to reschedule and thus load the aspace
     } else {
         printf("unknown command\n");
         goto usage;
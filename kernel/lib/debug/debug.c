@@ -19,10 +19,9 @@
 
 void spin(uint32_t usecs)
 {
-    lk_bigtime_t start = current_time_hires();
+    lk_time_t start = current_time();
 
-    lk_bigtime_t nsecs = (lk_bigtime_t)usecs * 1000;
-    while ((current_time_hires() - start) < nsecs)
+    while ((current_time() - start) < LK_USEC(usecs))
         ;
 }
 
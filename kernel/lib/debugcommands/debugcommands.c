@@ -298,10 +298,10 @@ static int cmd_chain(int argc, const cmd_args *argv)
 
 static int cmd_sleep(int argc, const cmd_args *argv)
 {
-    lk_time_t t = 1000; /* default to 1 second */
+    lk_time_t t = LK_SEC(1); /* default to 1 second */
 
     if (argc >= 2) {
-        t = argv[1].u;
+        t = LK_MSEC(argv[1].u);
         if (!strcmp(argv[0].str, "sleep"))
             t *= 1000;
     }
@@ -348,7 +348,7 @@ static int cmd_stackstomp(int argc, const cmd_args *argv)
         uint8_t death[i];
 
         memset(death, 0xaa, i);
-        thread_sleep(1);
+        thread_sleep(LK_MSEC(1));
     }
 
     printf("survived.\n");
@@ -6,14 +6,17 @@
 
 #include <lib/debuglog.h>
 
+#include <arch/ops.h>
 #include <err.h>
 #include <dev/udisplay.h>
 #include <kernel/spinlock.h>
 #include <kernel/thread.h>
+#include <kernel/vm.h>
 #include <lib/user_copy.h>
 #include <lib/io.h>
 #include <lk/init.h>
 #include <platform.h>
+#include <stddef.h>
 #include <string.h>
 
 #include "git-version.h"
@@ -25,13 +28,17 @@ static_assert((DLOG_SIZE & DLOG_MASK) == 0u, "must be power of two");
 static_assert(DLOG_MAX_RECORD <= DLOG_SIZE, "wat");
 static_assert((DLOG_MAX_RECORD & 3) == 0, "E_DONT_DO_THAT");
 
-static uint8_t DLOG_DATA[DLOG_SIZE];
+// The log is page aligned so that it can be handed to userspace as a
+// read-only vmo: a page holding the mx_log_buffer_t, then the ring.
+static struct dlog_pages {
+    mx_log_buffer_t hdr;
+    uint8_t data[DLOG_SIZE] __ALIGNED(PAGE_SIZE);
+} DLOG_BUFFER __ALIGNED(PAGE_SIZE);
 
 static dlog_t DLOG = {
     .lock = SPIN_LOCK_INITIAL_VALUE,
-    .head = 0,
-    .tail = 0,
-    .data = DLOG_DATA,
+    .buffer = &DLOG_BUFFER.hdr,
+    .data = DLOG_BUFFER.data,
     .event = EVENT_INITIAL_VALUE(DLOG.event, 0, EVENT_FLAG_AUTOUNSIGNAL),
 
     .readers_lock = MUTEX_INITIAL_VALUE(DLOG.readers_lock),
@@ -63,9 +70,48 @@ static dlog_t DLOG = {
 //       T                     T
 //  [....XXXX....]  [XX........XX]
 //           H         H
+//
+// Writers only hold the lock while they reserve space: moving tail past
+// the records they are about to overwrite, marking the new record as
+// in progress (a header word with a read length of 0) and moving head.
+// The record is then copied in and committed by storing its real header
+// word. Interrupts stay disabled from reservation to commit, so each cpu
+// has at most one record in progress, and a writer that must discard one
+// only waits for another cpu to finish a short copy.
+//
+// Readers never take the lock. They copy out committed records between
+// their tail and head, stopping at one in progress, and then check that
+// tail has not moved past what they copied, in which case it may have
+// been overwritten under them and they start over from the new tail.
 
 
 #define ALIGN4(n) (((n) + 3) & (~3))
+#define ALIGN8(n) (((n) + 7) & (~7))
+
+static inline volatile int* dlog_header_word(dlog_t* log, uint64_t pos) {
+    return (volatile int*) (log->data + (pos & DLOG_MASK));
+}
+
+// copy into or out of the fifo at offset, wrapping around its end
+static void fifo_write(dlog_t* log, size_t offset, const void* ptr, size_t len) {
+    size_t fifospace = DLOG_SIZE - offset;
+    if (fifospace >= len) {
+        memcpy(log->data + offset, ptr, len);
+    } else {
+        memcpy(log->data + offset, ptr, fifospace);
+        memcpy(log->data, ptr + fifospace, len - fifospace);
+    }
+}
+
+static void fifo_read(dlog_t* log, size_t offset, void* ptr, size_t len) {
+    size_t fifospace = DLOG_SIZE - offset;
+    if (fifospace >= len) {
+        memcpy(ptr, log->data + offset, len);
+    } else {
+        memcpy(ptr, log->data + offset, fifospace);
+        memcpy(ptr + fifospace, log->data, len - fifospace);
+    }
+}
 
 status_t dlog_write(uint32_t flags, const void* ptr, size_t len) {
     dlog_t* log = &DLOG;
@@ -83,12 +129,12 @@ status_t dlog_write(uint32_t flags, const void* ptr, size_t len) {
     // the last n bytes when the fifo wraps
     size_t wiresize = DLOG_MIN_RECORD + ALIGN4(len);
 
-    // Prepare the record header before taking the lock
+    // Prepare the record header before reserving space
     dlog_header_t hdr;
     hdr.header = DLOG_HDR_SET(wiresize, DLOG_MIN_RECORD + len);
     hdr.datalen = len;
     hdr.flags = flags;
-    hdr.timestamp = current_time_hires();
+    hdr.timestamp = current_time();
     thread_t *t = get_current_thread();
     if (t) {
         hdr.pid = t->user_pid;
@@ -99,94 +145,124 @@ status_t dlog_write(uint32_t flags, const void* ptr, size_t len) {
     }
 
     spin_lock_saved_state_t state;
-    spin_lock_irqsave(&log->lock, state);
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+    spin_lock(&log->lock);
 
     // Discard records at tail until there is enough
     // space for the new record.
-    while ((log->head - log->tail) > (DLOG_SIZE - wiresize)) {
-        uint32_t header = *((uint32_t*) (log->data + (log->tail & DLOG_MASK)));
-        log->tail += DLOG_HDR_GET_FIFOLEN(header);
+    uint64_t head = log->buffer->head;
+    uint64_t tail = log->buffer->tail;
+    while ((head - tail) > (DLOG_SIZE - wiresize)) {
+        uint32_t header;
+        while (DLOG_HDR_GET_READLEN(header = atomic_load(dlog_header_word(log, tail))) == 0) {
+            // still being written by another cpu
+            arch_spinloop_pause();
+        }
+        tail += DLOG_HDR_GET_FIFOLEN(header);
+    }
+    if (tail != log->buffer->tail) {
+        atomic_store_u64(&log->buffer->tail, tail);
+        smp_wmb();
     }
 
-    size_t offset = (log->head & DLOG_MASK);
+    // Mark the record in progress before it becomes visible to readers
+    volatile int* word = dlog_header_word(log, head);
+    atomic_store(word, DLOG_HDR_SET(wiresize, 0));
+    atomic_store_u64(&log->buffer->head, head + wiresize);
 
-    size_t fifospace = DLOG_SIZE - offset;
+    spin_unlock(&log->lock);
 
-    if (fifospace >= wiresize) {
-        // everything fits in one write, simple case!
-        memcpy(log->data + offset, &hdr, sizeof(hdr));
-        memcpy(log->data + offset + sizeof(hdr), ptr, len);
-    } else if (fifospace < sizeof(hdr)) {
-        // the wrap happens in the header
-        memcpy(log->data + offset, &hdr, fifospace);
-        memcpy(log->data, ((void*) &hdr) + fifospace, sizeof(hdr) - fifospace);
-        memcpy(log->data + (sizeof(hdr) - fifospace), ptr, len);
-    } else {
-        // the wrap happens in the data
-        memcpy(log->data + offset, &hdr, sizeof(hdr));
-        offset += sizeof(hdr);
-        fifospace -= sizeof(hdr);
-        memcpy(log->data + offset, ptr, fifospace);
-        memcpy(log->data, ptr + fifospace, len - fifospace);
-    }
-    log->head += wiresize;
+    // Fill in everything after the header word, then commit
+    size_t offset = (head + sizeof(hdr.header)) & DLOG_MASK;
+    fifo_write(log, offset, ((void*) &hdr) + sizeof(hdr.header), sizeof(hdr) - sizeof(hdr.header));
+    offset = (head + sizeof(hdr)) & DLOG_MASK;
+    fifo_write(log, offset, ptr, len);
+    smp_wmb();
+    atomic_store(word, hdr.header);
 
-    event_signal(&log->event, false);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
 
-    spin_unlock_irqrestore(&log->lock, state);
+    event_signal(&log->event, false);
 
     return NO_ERROR;
 }
 
-// TODO: support reading multiple messages at a time
+// With DLOG_FLAG_BATCH, records are copied out at 8-byte aligned offsets,
+// so that the batch can be walked as mx_log_record_ts.
 // TODO: filter with flags
 status_t dlog_read(dlog_reader_t* rdr, uint32_t flags, void* ptr, size_t len, size_t* _actual) {
-    // must be room for worst-case read
-    if (len < DLOG_MAX_RECORD) {
-        return ERR_BUFFER_TOO_SMALL;
-    }
-
     dlog_t* log = rdr->log;
-    status_t status = ERR_SHOULD_WAIT;
-
-    spin_lock_saved_state_t state;
-    spin_lock_irqsave(&log->lock, state);
-
-    size_t rtail = rdr->tail;
-
-    // If the read-tail is not within the range of log-tail..log-head
-    // this reader has been lapped by a writer and we reset our read-tail
-    // to the current log-tail.
-    //
-    if ((log->head - log->tail) < (log->head - rtail)) {
-        rtail = log->tail;
-    }
-
-    if (rtail != log->head) {
-        size_t offset = (rtail & DLOG_MASK);
-        uint32_t header = *((uint32_t*) (log->data + offset));
+    uint64_t rtail = rdr->tail;
+    size_t actual = 0;
 
-        size_t actual = DLOG_HDR_GET_READLEN(header);
-        size_t fifospace = DLOG_SIZE - offset;
-
-        if (fifospace >= actual) {
-            memcpy(ptr, log->data + offset, actual);
-        } else {
-            memcpy(ptr, log->data + offset, fifospace);
-            memcpy(ptr + fifospace, log->data, actual - fifospace);
+    for (;;) {
+        uint64_t head = atomic_load_u64(&log->buffer->head);
+        uint64_t tail = atomic_load_u64(&log->buffer->tail);
+
+        // If the read-tail is not within the range of log-tail..log-head
+        // this reader has been lapped by a writer and we reset our read-tail
+        // to the current log-tail.
+        if ((head - tail) < (head - rtail)) {
+            rtail = tail;
+        }
+        if (rtail == head) {
+            break;
         }
 
-        *_actual = actual;
-        status = NO_ERROR;
+        uint32_t header = atomic_load(dlog_header_word(log, rtail));
+        size_t readlen = DLOG_HDR_GET_READLEN(header);
+        if (readlen == 0) {
+            // in progress, and the records after it wait their turn
+            break;
+        }
+        bool fits = (readlen <= (len - actual));
+        if (fits) {
+            smp_rmb();
+            fifo_read(log, rtail & DLOG_MASK, ptr + actual, readlen);
+        }
+        smp_rmb();
+
+        // If a writer reserved space over the record while we were
+        // reading it, tail has moved past it: drop it and start over.
+        tail = atomic_load_u64(&log->buffer->tail);
+        if ((int64_t)(rtail - tail) < 0) {
+            rtail = tail;
+            continue;
+        }
+        if (!fits) {
+            if (actual == 0) {
+                rdr->tail = rtail;
+                return ERR_BUFFER_TOO_SMALL;
+            }
+            break;
+        }
 
         rtail += DLOG_HDR_GET_FIFOLEN(header);
+
+        if (!(flags & DLOG_FLAG_BATCH)) {
+            actual = readlen;
+            break;
+        }
+        size_t padded = ALIGN8(readlen);
+        if (padded > (len - actual)) {
+            padded = len - actual;
+        }
+        memset(ptr + actual + readlen, 0, padded - readlen);
+        actual += padded;
     }
 
     rdr->tail = rtail;
 
-    spin_unlock_irqrestore(&log->lock, state);
+    if (actual == 0) {
+        return ERR_SHOULD_WAIT;
+    }
+    *_actual = actual;
+    return NO_ERROR;
+}
 
-    return status;
+void dlog_get_buffer(void** ptr, size_t* size) {
+    *ptr = &DLOG_BUFFER;
+    *size = sizeof(DLOG_BUFFER);
 }
 
 void dlog_reader_init(dlog_reader_t* rdr, void (*notify)(void*), void* cookie) {
@@ -199,13 +275,9 @@ void dlog_reader_init(dlog_reader_t* rdr, void (*notify)(void*), void* cookie) {
     mutex_acquire(&log->readers_lock);
     list_add_tail(&log->readers, &rdr->node);
 
-    bool do_notify = false;
-
-    spin_lock_saved_state_t state;
-    spin_lock_irqsave(&log->lock, state);
-    rdr->tail = log->tail;
-    do_notify = (log->tail != log->head);
-    spin_unlock_irqrestore(&log->lock, state);
+    uint64_t head = atomic_load_u64(&log->buffer->head);
+    rdr->tail = atomic_load_u64(&log->buffer->tail);
+    bool do_notify = (rdr->tail != head);
 
     // simulate notify callback for events that arrived
     // before we were initialized
@@ -259,11 +331,9 @@ static void debuglog_dumper_notify(void* cookie) {
 static int debuglog_dumper(void *arg) {
     // assembly buffer with room for log text plus header text
     char tmp[DLOG_MAX_DATA + 128];
+    char data[DLOG_MAX_DATA + 1];
 
-    struct {
-        dlog_header_t hdr;
-        char data[DLOG_MAX_DATA + 1];
-    } rec;
+    uint8_t batch[DLOG_MAX_RECORD * 4] __ALIGNED(8);
 
     event_t event = EVENT_INITIAL_VALUE(event, 0, EVENT_FLAG_AUTOUNSIGNAL);
 
@@ -275,22 +345,29 @@ static int debuglog_dumper(void *arg) {
 
         // dump records to kernel console
         size_t actual;
-        while (dlog_read(&reader, 0, &rec, DLOG_MAX_RECORD, &actual) == NO_ERROR) {
-            if (rec.hdr.datalen && (rec.data[rec.hdr.datalen - 1] == '\n')) {
-                rec.data[rec.hdr.datalen - 1] = 0;
-            } else {
-                rec.data[rec.hdr.datalen] = 0;
-            }
-            int n;
-            n = snprintf(tmp, sizeof(tmp), "[%05d.%03d] %05" PRIu64 ".%05" PRIu64 "> %s\n",
-                         (int) (rec.hdr.timestamp / 1000000000ULL),
-                         (int) ((rec.hdr.timestamp / 1000000ULL) % 1000ULL),
-                         rec.hdr.pid, rec.hdr.tid, rec.data);
-            if (n > (int)sizeof(tmp)) {
-                n = sizeof(tmp);
+        while (dlog_read(&reader, DLOG_FLAG_BATCH, batch, sizeof(batch), &actual) == NO_ERROR) {
+            size_t off = 0;
+            while (off < actual) {
+                dlog_record_t* rec = (dlog_record_t*) (batch + off);
+                off += ALIGN8(DLOG_MIN_RECORD + rec->hdr.datalen);
+
+                size_t datalen = rec->hdr.datalen;
+                if (datalen && (rec->data[datalen - 1] == '\n')) {
+                    datalen--;
+                }
+                memcpy(data, rec->data, datalen);
+                data[datalen] = 0;
+                int n;
+                n = snprintf(tmp, sizeof(tmp), "[%05d.%03d] %05" PRIu64 ".%05" PRIu64 "> %s\n",
+                             (int) (rec->hdr.timestamp / 1000000000ULL),
+                             (int) ((rec->hdr.timestamp / 1000000ULL) % 1000ULL),
+                             rec->hdr.pid, rec->hdr.tid, data);
+                if (n > (int)sizeof(tmp)) {
+                    n = sizeof(tmp);
+                }
+                __kernel_console_write(tmp, n);
+                __kernel_serial_write(tmp, n);
             }
-            __kernel_console_write(tmp, n);
-            __kernel_serial_write(tmp, n);
         }
     }
 
@@ -312,6 +389,10 @@ void dlog_bluescreen_init(void) {
 }
 
 static void dlog_init_hook(uint level) {
+    DLOG_BUFFER.hdr.magic = MX_LOG_BUFFER_MAGIC;
+    DLOG_BUFFER.hdr.size = DLOG_SIZE;
+    DLOG_BUFFER.hdr.offset = offsetof(struct dlog_pages, data);
+
     thread_t* rthread;
 
     if ((rthread = thread_create("debuglog-notifier", debuglog_notifier, NULL,
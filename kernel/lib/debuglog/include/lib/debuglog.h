@@ -10,6 +10,7 @@
 #include <kernel/event.h>
 #include <kernel/mutex.h>
 #include <list.h>
+#include <magenta/syscalls/log.h>
 #include <stdint.h>
 
 __BEGIN_CDECLS
@@ -28,6 +29,11 @@ __BEGIN_CDECLS
 #define DLOG_FLAG_DEVICE    0x0800
 #define DLOG_FLAG_MASK      0x0F00
 
+// dlog_read(): return as many whole records as fit
+#define DLOG_FLAG_BATCH     0x20000000
+
+static_assert(DLOG_FLAG_BATCH == MX_LOG_FLAG_BATCH, "");
+
 // clang-format on
 
 typedef struct dlog dlog_t;
@@ -36,12 +42,13 @@ typedef struct dlog_record dlog_record_t;
 typedef struct dlog_reader dlog_reader_t;
 
 struct dlog {
+    // serializes reserving space in the ring; records are filled
+    // in and committed outside of it
     spin_lock_t lock;
 
-    size_t head;
-    size_t tail;
-
-    void* data;
+    // head and tail, shared with mapped readers
+    mx_log_buffer_t* buffer;
+    uint8_t* data;
 
     bool panic;
 
@@ -55,7 +62,7 @@ struct dlog_reader {
     struct list_node node;
 
     dlog_t* log;
-    size_t tail;
+    uint64_t tail;
 
     void (*notify)(void* cookie);
     void *cookie;
@@ -64,8 +71,8 @@ struct dlog_reader {
 #define DLOG_HDR_SET(fifosize, readsize) \
     ((((readsize) & 0xFFF) << 12) | ((fifosize) & 0xFFF))
 
-#define DLOG_HDR_GET_FIFOLEN(n)   ((n) & 0xFFF)
-#define DLOG_HDR_GET_READLEN(n)  (((n) >> 12) & 0xFFF)
+#define DLOG_HDR_GET_FIFOLEN(n)   MX_LOG_RECORD_RINGLEN(n)
+#define DLOG_HDR_GET_READLEN(n)   MX_LOG_RECORD_READLEN(n)
 
 #define DLOG_MIN_RECORD          (32u)
 #define DLOG_MAX_DATA            (224u)
@@ -93,6 +100,9 @@ void dlog_reader_destroy(dlog_reader_t* rdr);
 status_t dlog_write(uint32_t flags, const void* ptr, size_t len);
 status_t dlog_read(dlog_reader_t* rdr, uint32_t flags, void* ptr, size_t len, size_t* actual);
 
+// the pages holding the log, for mapping read-only
+void dlog_get_buffer(void** ptr, size_t* size);
+
 // bluescreen_init should be called at the "start" of a fatal fault or
 // panic to ensure that the fault output (via kernel printf/dprintf)
 // is captured or displayed to the user
@@ -7,30 +7,65 @@
 
 #include <assert.h>
 #include <err.h>
+#include <inttypes.h>
 #include <list.h>
+#include <platform.h>
+#include <stdio.h>
 #include <trace.h>
 
+#include <arch/ops.h>
 #include <kernel/event.h>
+#include <kernel/mp.h>
 #include <kernel/spinlock.h>
+#include <kernel/thread.h>
 #include <lk/init.h>
 
-static spin_lock_t dpc_lock = SPIN_LOCK_INITIAL_VALUE;
-static struct list_node dpc_list = LIST_INITIAL_VALUE(dpc_list);
-static event_t dpc_event = EVENT_INITIAL_VALUE(dpc_event, false, 0);
+#if WITH_LIB_CONSOLE
+#include <lib/console.h>
+#endif
+
+// Each cpu has its own queue and worker thread, pinned to it. dpc_queue()
+// adds to the queue of the cpu it is called on, so a dpc that runs for a
+// long time only holds up the dpcs queued on its cpu.
+struct dpc_queue {
+    spin_lock_t lock;
+    struct list_node list;
+    event_t event;
+    thread_t *thread;
+
+    // statistics, guarded by lock
+    uint depth;
+    uint max_depth;
+    uint64_t queued;
+    uint64_t ran;
+    lk_time_t total_latency;
+    lk_time_t max_latency;
+};
+
+static struct dpc_queue dpc_queues[SMP_MAX_CPUS];
 
 status_t dpc_queue(dpc_t *dpc, bool reschedule)
 {
     DEBUG_ASSERT(dpc);
     DEBUG_ASSERT(dpc->func);
 
+    // keep interrupts off so that we stay on this cpu until the dpc is queued
     spin_lock_saved_state_t state;
-    spin_lock_irqsave(&dpc_lock, state);
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    struct dpc_queue *q = &dpc_queues[arch_curr_cpu_num()];
+    spin_lock(&q->lock);
 
     // put the dpc at the tail of the list and signal the worker
-    list_add_tail(&dpc_list, &dpc->node);
-    event_signal(&dpc_event, false);
+    dpc->queue_time = current_time();
+    list_add_tail(&q->list, &dpc->node);
+    q->queued++;
+    if (++q->depth > q->max_depth)
+        q->max_depth = q->depth;
+    event_signal(&q->event, false);
 
-    spin_unlock_irqrestore(&dpc_lock, state);
+    spin_unlock(&q->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
 
     // reschedule here if asked to
     if (reschedule)
@@ -41,22 +76,32 @@ status_t dpc_queue(dpc_t *dpc, bool reschedule)
 
 static int dpc_thread(void *arg)
 {
+    struct dpc_queue *q = arg;
+
     for (;;) {
         // wait for a dpc to fire
-        __UNUSED status_t err = event_wait(&dpc_event);
+        __UNUSED status_t err = event_wait(&q->event);
         DEBUG_ASSERT(err == NO_ERROR);
 
         spin_lock_saved_state_t state;
-        spin_lock_irqsave(&dpc_lock, state);
+        spin_lock_irqsave(&q->lock, state);
 
         // pop a dpc off the list
-        dpc_t *dpc = list_remove_head_type(&dpc_list, dpc_t, node);
+        dpc_t *dpc = list_remove_head_type(&q->list, dpc_t, node);
 
         // if the list is now empty, unsignal the event so we block until it is
-        if (!dpc)
-            event_unsignal(&dpc_event);
-
-        spin_unlock_irqrestore(&dpc_lock, state);
+        if (!dpc) {
+            event_unsignal(&q->event);
+        } else {
+            q->depth--;
+            q->ran++;
+            lk_time_t latency = current_time() - dpc->queue_time;
+            q->total_latency += latency;
+            if (latency > q->max_latency)
+                q->max_latency = latency;
+        }
+
+        spin_unlock_irqrestore(&q->lock, state);
 
         // call the dpc
         if (dpc && dpc->func)
@@ -67,10 +112,94 @@ static int dpc_thread(void *arg)
     return 0;
 }
 
+void dpc_transition_off_cpu(uint old_cpu)
+{
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    struct dpc_queue *src = &dpc_queues[old_cpu];
+    struct dpc_queue *dst = &dpc_queues[arch_curr_cpu_num()];
+    DEBUG_ASSERT(src != dst);
+
+    // cpus are unplugged one at a time, so the order these are taken in
+    // cannot deadlock against another transition
+    spin_lock(&src->lock);
+    spin_lock(&dst->lock);
+
+    // move all dpcs from old_cpu to this cpu
+    dpc_t *dpc;
+    while ((dpc = list_remove_head_type(&src->list, dpc_t, node)) != NULL) {
+        list_add_tail(&dst->list, &dpc->node);
+        dst->depth++;
+    }
+    src->depth = 0;
+    if (dst->depth > dst->max_depth)
+        dst->max_depth = dst->depth;
+    if (dst->depth > 0)
+        event_signal(&dst->event, false);
+
+    spin_unlock(&dst->lock);
+    spin_unlock(&src->lock);
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+}
+
+static void dpc_init_queues(unsigned int level)
+{
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        struct dpc_queue *q = &dpc_queues[i];
+        spin_lock_init(&q->lock);
+        list_initialize(&q->list);
+        event_init(&q->event, false, 0);
+    }
+}
+
 static void dpc_init(unsigned int level)
 {
-    thread_t *t = thread_create("dpc", &dpc_thread, NULL, HIGH_PRIORITY, DEFAULT_STACK_SIZE);
+    uint cpu = arch_curr_cpu_num();
+    struct dpc_queue *q = &dpc_queues[cpu];
+
+    // a cpu coming back online finds its thread still waiting
+    if (q->thread)
+        return;
+
+    char name[16];
+    snprintf(name, sizeof(name), "dpc-%u", cpu);
+    thread_t *t = thread_create(name, &dpc_thread, q, HIGH_PRIORITY, DEFAULT_STACK_SIZE);
+    thread_set_pinned_cpu(t, cpu);
+    q->thread = t;
     thread_detach_and_resume(t);
 }
 
-LK_INIT_HOOK(dpc, dpc_init, LK_INIT_LEVEL_THREADING);
+LK_INIT_HOOK(dpc_queues, dpc_init_queues, LK_INIT_LEVEL_THREADING - 1);
+LK_INIT_HOOK_FLAGS(dpc, dpc_init, LK_INIT_LEVEL_THREADING, LK_INIT_FLAG_ALL_CPUS);
+
+#if WITH_LIB_CONSOLE
+static int cmd_dpc(int argc, const cmd_args *argv)
+{
+    printf("cpu  depth  max depth      queued         ran  avg latency (us)  max latency (us)\n");
+    for (uint i = 0; i < SMP_MAX_CPUS; i++) {
+        struct dpc_queue *q = &dpc_queues[i];
+        if (!q->thread)
+            continue;
+
+        spin_lock_saved_state_t state;
+        spin_lock_irqsave(&q->lock, state);
+        uint depth = q->depth;
+        uint max_depth = q->max_depth;
+        uint64_t queued = q->queued;
+        uint64_t ran = q->ran;
+        lk_time_t total_latency = q->total_latency;
+        lk_time_t max_latency = q->max_latency;
+        spin_unlock_irqrestore(&q->lock, state);
+
+        printf("%3u %6u %10u %11" PRIu64 " %11" PRIu64 " %17" PRIu64 " %17" PRIu64 "\n",
+               i, depth, max_depth, queued, ran,
+               ran ? (total_latency / ran) / 1000 : 0, max_latency / 1000);
+    }
+    return NO_ERROR;
+}
+
+STATIC_COMMAND_START
+STATIC_COMMAND("dpc", "dump per-cpu dpc queue statistics", &cmd_dpc)
+STATIC_COMMAND_END(dpc);
+#endif
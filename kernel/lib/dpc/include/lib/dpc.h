@@ -19,9 +19,15 @@ typedef struct dpc {
 
     dpc_func_t func;
     void *arg;
+
+    lk_time_t queue_time;
 } dpc_t;
 
+// Queue a dpc to run on the current cpu's dpc thread.
 status_t dpc_queue(dpc_t *dpc, bool reschedule);
 
+// Move the dpcs queued on an unplugged cpu to the current cpu.
+void dpc_transition_off_cpu(uint old_cpu);
+
 __END_CDECLS
 
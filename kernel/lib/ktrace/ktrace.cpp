@@ -6,12 +6,18 @@
 
 #include <debug.h>
 #include <err.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <arch/ops.h>
 #include <arch/user_copy.h>
+#include <kernel/auto_lock.h>
 #include <kernel/cmdline.h>
+#include <kernel/mp.h>
+#include <kernel/mutex.h>
+#include <kernel/spinlock.h>
 #include <kernel/vm/vm_aspace.h>
+#include <kernel/vm/vm_object.h>
 #include <lib/ktrace.h>
 #include <lk/init.h>
 #include <magenta/user_thread.h>
@@ -22,7 +28,7 @@ extern "C" uint64_t get_tsc_ticks_per_ms(void);
 #define ktrace_ticks_per_ms() get_tsc_ticks_per_ms()
 #else
 #include <platform.h>
-#define ktrace_timestamp() current_time_hires()
+#define ktrace_timestamp() current_time()
 #define ktrace_ticks_per_ms() (1000000)
 #endif
 
@@ -83,84 +89,117 @@ static void ktrace_report_probes(void) {
 }
 
 typedef struct ktrace_state {
-    // where the next record will be written
-    int offset;
-
     // mask of groups we allow, 0 == tracing disabled
     int grpmask;
 
-    // total size of the trace buffer
-    uint32_t bufsize;
+    // when a cpu's ring fills, drop its oldest records instead of stopping
+    bool circular;
 
-    // offset where tracing was stopped, 0 if tracing active
-    uint32_t marker;
+    // a REWIND while stopped waits for the next START,
+    // so that the stopped trace can still be read
+    bool rewind_pending;
 
-    // raw trace buffer
-    uint8_t* buffer;
+    // the whole trace buffer, as laid out in ktrace_buffer_header_t
+    ktrace_buffer_header_t* hdr;
+    uint8_t* names;
+    uint8_t* rings;
+    uint32_t cpu_bufsize;
+    uint32_t size;
 } ktrace_state_t;
 
 static ktrace_state_t KTRACE_STATE;
 
+// serializes ktrace_control()
+static mutex_t ktrace_lock = MUTEX_INITIAL_VALUE(ktrace_lock);
+
+// backs the trace buffer, so that readers can map it
+static mxtl::RefPtr<VmObject> ktrace_vmo;
+
+mxtl::RefPtr<VmObject> ktrace_get_vmo(void) {
+    return ktrace_vmo;
+}
+
 int ktrace_read_user(void* ptr, uint32_t off, uint32_t len) {
     ktrace_state_t* ks = &KTRACE_STATE;
 
-    // Buffer size is limited by the marker if set,
-    // otherwise limited by offset (last written point).
-    // Offset can end up pointing past the end, so clip
-    // it to the actual buffer size to be safe.
-    uint32_t max;
-    if (ks->marker) {
-        max = ks->marker;
-    } else {
-        max = ks->offset;
-        if (max > ks->bufsize) {
-            max = ks->bufsize;
-        }
-    }
-
     // null read is a query for trace buffer size
     if (ptr == NULL) {
-        return max;
+        return ks->size;
     }
 
     // constrain read to available buffer
-    if (off >= max) {
+    if (off >= ks->size) {
         return 0;
     }
-    if (len > (max - off)) {
-        len = max - off;
+    if (len > (ks->size - off)) {
+        len = ks->size - off;
     }
 
-    if (arch_copy_to_user(ptr, ks->buffer + off, len) != NO_ERROR) {
+    if (arch_copy_to_user(ptr, (uint8_t*)ks->hdr + off, len) != NO_ERROR) {
         return ERR_INVALID_ARGS;
     }
     return len;
 }
 
+static void ktrace_sync_task(void* context) {
+}
+
+// Empties the rings and the names area. Called with ktrace_lock held.
+static void ktrace_rewind(ktrace_state_t* ks) {
+    // Stop every cpu from writing records, then wait out any that is part way
+    // through one. Records are written with interrupts off, and grpmask is
+    // checked again once they are off, so after every other cpu has run an
+    // ipi, none of them is still writing.
+    int grpmask = atomic_swap(&ks->grpmask, 0);
+    mp_sync_exec(MP_CPU_ALL_BUT_LOCAL, ktrace_sync_task, nullptr);
+
+    for (uint cpu = 0; cpu < ks->hdr->cpu_count; cpu++) {
+        atomic_store_u64(&ks->hdr->cpu[cpu].head, 0);
+        atomic_store_u64(&ks->hdr->cpu[cpu].tail, 0);
+    }
+    atomic_store((volatile int*)&ks->hdr->names_used, 0);
+    ktrace_report_syscalls(kt_syscall_info);
+    ktrace_report_probes();
+
+    atomic_store(&ks->grpmask, grpmask);
+}
+
+static void ktrace_start(ktrace_state_t* ks, uint32_t options, bool circular) {
+    if (ks->hdr == nullptr) {
+        return;
+    }
+    options = KTRACE_GRP_TO_MASK(options);
+    ks->circular = circular;
+    if (ks->rewind_pending) {
+        ks->rewind_pending = false;
+        ktrace_rewind(ks);
+    }
+    atomic_store(&ks->grpmask, options ? options : KTRACE_GRP_TO_MASK(KTRACE_DEFAULT_GRPMASK));
+    ktrace_report_live_threads();
+}
+
 status_t ktrace_control(uint32_t action, uint32_t options, void* ptr) {
     ktrace_state_t* ks = &KTRACE_STATE;
+    AutoLock lock(&ktrace_lock);
     switch (action) {
     case KTRACE_ACTION_START:
-        options = KTRACE_GRP_TO_MASK(options);
-        ks->marker = 0;
-        atomic_store(&ks->grpmask, options ? options : KTRACE_GRP_TO_MASK(KTRACE_GRP_ALL));
-        ktrace_report_live_threads();
+        ktrace_start(ks, options, false);
         break;
-    case KTRACE_ACTION_STOP: {
+    case KTRACE_ACTION_START_CIRCULAR:
+        ktrace_start(ks, options, true);
+        break;
+    case KTRACE_ACTION_STOP:
         atomic_store(&ks->grpmask, 0);
-        uint32_t n = ks->offset;
-        if (n > ks->bufsize) {
-            ks->marker = ks->bufsize;
-        } else {
-            ks->marker = n;
-        }
         break;
-    }
     case KTRACE_ACTION_REWIND:
-        // roll back to just after the metadata
-        atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
-        ktrace_report_syscalls(kt_syscall_info);
-        ktrace_report_probes();
+        if (ks->hdr == nullptr) {
+            break;
+        }
+        if (atomic_load(&ks->grpmask)) {
+            ktrace_rewind(ks);
+        } else {
+            ks->rewind_pending = true;
+        }
         break;
     case KTRACE_ACTION_NEW_PROBE: {
         ktrace_probe_info_t* probe;
@@ -201,19 +240,52 @@ void ktrace_init(unsigned level) {
 
     mb *= (1024*1024);
 
+    // Names are rare but must survive a flight recording, so they get a
+    // slice of their own. The rest is split evenly between the cpus.
+    uint cpus = arch_max_num_cpus();
+    uint32_t hdrsize = ROUNDUP(sizeof(ktrace_buffer_header_t) +
+                               cpus * sizeof(ktrace_cpu_header_t), PAGE_SIZE);
+    uint32_t namesize = ROUNDUP(MAX(mb / 16, 64u * 1024), PAGE_SIZE);
+    uint32_t cpu_bufsize = ROUNDDOWN((mb - namesize) / cpus, PAGE_SIZE);
+    if (mb <= namesize || cpu_bufsize == 0) {
+        dprintf(INFO, "ktrace: buffer of %u bytes too small\n", mb);
+        return;
+    }
+    uint32_t size = hdrsize + namesize + cpus * cpu_bufsize;
+
+    ktrace_vmo = VmObjectPaged::Create(PMM_ALLOC_FLAG_ANY, size);
+    if (!ktrace_vmo) {
+        dprintf(INFO, "ktrace: cannot alloc buffer\n");
+        return;
+    }
     status_t status;
+    void* ptr;
     VmAspace* aspace = VmAspace::kernel_aspace();
-    if ((status = aspace->Alloc("ktrace", mb, (void**)&ks->buffer, 0, 0, VMM_FLAG_COMMIT,
-                                ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE)) < 0) {
-        dprintf(INFO, "ktrace: cannot alloc buffer %d\n", status);
+    if ((status = aspace->MapObject(ktrace_vmo, "ktrace", 0, size, &ptr, 0, 0, VMM_FLAG_COMMIT,
+                                    ARCH_MMU_FLAG_PERM_READ | ARCH_MMU_FLAG_PERM_WRITE)) < 0) {
+        dprintf(INFO, "ktrace: cannot map buffer %d\n", status);
+        ktrace_vmo.reset();
         return;
     }
 
-    // The last packet written can overhang the end of the buffer,
-    // so we reduce the reported size by the max size of a record
-    ks->bufsize = mb - 256;
-
-    dprintf(INFO, "ktrace: buffer at %p (%u bytes)\n", ks->buffer, mb);
+    dprintf(INFO, "ktrace: buffer at %p (%u bytes, %u per cpu)\n", ptr, size, cpu_bufsize);
+
+    ktrace_buffer_header_t* hdr = (ktrace_buffer_header_t*) ptr;
+    hdr->magic = KTRACE_BUFFER_MAGIC;
+    hdr->version = KTRACE_VERSION;
+    hdr->ticks_per_ms = ktrace_ticks_per_ms();
+    hdr->cpu_count = cpus;
+    hdr->cpu_bufsize = cpu_bufsize;
+    hdr->names_offset = hdrsize;
+    hdr->names_size = namesize;
+    hdr->buffer_offset = hdrsize + namesize;
+
+    ks->names = (uint8_t*) ptr + hdrsize;
+    ks->rings = (uint8_t*) ptr + hdr->buffer_offset;
+    ks->cpu_bufsize = cpu_bufsize;
+    ks->size = size;
+    ks->circular = cmdline_get_bool("ktrace.circular", false);
+    ks->hdr = hdr;
 
     // register all static probes
     ktrace_probe_info_t *probe;
@@ -223,84 +295,143 @@ void ktrace_init(unsigned level) {
     }
     mutex_release(&probe_list_lock);
 
-    // write metadata to the first two event slots
-    uint64_t n = ktrace_ticks_per_ms();
-    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*) ks->buffer;
-    rec[0].tag = TAG_VERSION;
-    rec[0].a = KTRACE_VERSION;
-    rec[1].tag = TAG_TICKS_PER_MS;
-    rec[1].a = (uint32_t)n;
-    rec[1].b = (uint32_t)(n >> 32);
-
     // enable tracing
-    atomic_store(&ks->offset, KTRACE_RECSIZE * 2);
     ktrace_report_syscalls(kt_syscall_info);
-    ktrace_report_probes();
     atomic_store(&ks->grpmask, KTRACE_GRP_TO_MASK(grpmask));
 
     // report names of existing threads
     ktrace_report_live_threads();
 }
 
+// Writes a record to this cpu's ring: the header from tag and tid, then
+// size bytes of payload, zero filled to the record's length. Interrupts stay
+// off from taking the timestamp until the whole record is written, and head
+// only moves past the record once it is complete. So each ring is in
+// timestamp order, readers never see a partial record, and a circular ring
+// only ever drops finished ones. Returns false if the record was dropped.
+static bool ktrace_write(ktrace_state_t* ks, uint32_t tag, uint32_t tid,
+                         const void* payload, size_t size) {
+    uint32_t len = KTRACE_LEN(tag);
+    uint32_t ringsize = ks->cpu_bufsize;
+    bool written = false;
+
+    if (len < KTRACE_HDRSIZE) {
+        return false;
+    }
+
+    spin_lock_saved_state_t state;
+    arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+
+    // checked again now that nothing can preempt us: see ktrace_rewind()
+    if (!(tag & atomic_load(&ks->grpmask))) {
+        goto done;
+    }
+
+    {
+        uint64_t ts = ktrace_timestamp();
+        uint cpu = arch_curr_cpu_num();
+        ktrace_cpu_header_t* ch = &ks->hdr->cpu[cpu];
+        uint8_t* ring = ks->rings + cpu * ringsize;
+        uint64_t head = ch->head;
+        uint64_t tail = ch->tail;
+
+        // records don't wrap, so pad out the end of the ring if need be
+        uint32_t off = (uint32_t)(head % ringsize);
+        uint32_t pad = (ringsize - off < len) ? ringsize - off : 0;
+        uint64_t end = head + pad + len;
+
+        if (end - tail > ringsize) {
+            if (!ks->circular) {
+                // if we arrive at the end, stop
+                atomic_store(&ks->grpmask, 0);
+                goto done;
+            }
+            // make room by dropping the oldest records. readers check tail
+            // after copying, so it has to move before the records change
+            while (end - tail > ringsize) {
+                uint32_t n = KTRACE_LEN(*(uint32_t*)(ring + tail % ringsize));
+                if (n == 0) {
+                    // a corrupt ring: start over
+                    tail = head;
+                    break;
+                }
+                tail += n;
+            }
+            atomic_store_u64(&ch->tail, tail);
+            smp_wmb();
+        }
+
+        if (pad) {
+            *(uint32_t*)(ring + off) = KTRACE_TAG(0, 0, pad);
+            off = 0;
+        }
+        ktrace_header_t* hdr = (ktrace_header_t*)(ring + off);
+        hdr->ts = ts;
+        hdr->tag = tag;
+        hdr->tid = tid;
+        size_t n = len - KTRACE_HDRSIZE;
+        if (size > n) {
+            size = n;
+        }
+        if (size) {
+            memcpy(hdr + 1, payload, size);
+        }
+        memset((uint8_t*)(hdr + 1) + size, 0, n - size);
+
+        // publish the record; the store orders the writes above before it
+        atomic_store_u64(&ch->head, end);
+        written = true;
+    }
+
+done:
+    arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
+    return written;
+}
+
 void ktrace_tiny(uint32_t tag, uint32_t arg) {
-    uint64_t ts = ktrace_timestamp();
     ktrace_state_t* ks = &KTRACE_STATE;
     if (tag & atomic_load(&ks->grpmask)) {
         tag = (tag & 0xFFFFFFF0) | 2;
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_HDRSIZE)) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
-            hdr->ts = ts;
-            hdr->tag = tag;
-            hdr->tid = arg;
-        }
+        ktrace_write(ks, tag, arg, nullptr, 0);
     }
 }
 
-void* ktrace_open(uint32_t tag) {
-    uint64_t ts = ktrace_timestamp();
+bool ktrace_record(uint32_t tag, const void* payload, size_t size) {
     ktrace_state_t* ks = &KTRACE_STATE;
     if (!(tag & atomic_load(&ks->grpmask))) {
-        return NULL;
+        return false;
     }
-
-    int off;
-    if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-        // if we arrive at the end, stop
-        atomic_store(&ks->grpmask, 0);
-        return NULL;
-    }
-
-    ktrace_header_t* hdr = (ktrace_header_t*) (ks->buffer + off);
-    hdr->ts = ts;
-    hdr->tag = tag;
-    hdr->tid = (uint32_t)get_current_thread()->user_tid;
-    return hdr + 1;
+    return ktrace_write(ks, tag, (uint32_t)get_current_thread()->user_tid, payload, size);
 }
 
 static void ktrace_name_etc(uint32_t tag, uint32_t id, uint32_t arg, const char* name, bool always) {
     ktrace_state_t* ks = &KTRACE_STATE;
+    if (ks->hdr == nullptr) {
+        return;
+    }
     if ((tag & atomic_load(&ks->grpmask)) || always) {
         uint32_t len = static_cast<uint32_t>(strnlen(name, 31));
 
         // set size to: sizeof(hdr) + len + 1, round up to multiple of 8
         tag = (tag & 0xFFFFFFF0) | ((KTRACE_NAMESIZE + len + 1 + 7) >> 3);
 
-        int off;
-        if ((off = atomic_add(&ks->offset, KTRACE_LEN(tag))) >= (int)ks->bufsize) {
-            // if we arrive at the end, stop
-            atomic_store(&ks->grpmask, 0);
-        } else {
-            ktrace_rec_name_t* rec = (ktrace_rec_name_t*) (ks->buffer + off);
-            rec->tag = tag;
-            rec->id = id;
-            rec->arg = arg;
-            memcpy(rec->name, name, len);
-            rec->name[len] = 0;
+        // names are rare enough to share one area, and are dropped once
+        // it fills rather than stopping the trace. like other records they
+        // are written with interrupts off, so that a rewind can wait them out
+        spin_lock_saved_state_t state;
+        arch_interrupt_save(&state, SPIN_LOCK_FLAG_INTERRUPTS);
+        if ((tag & atomic_load(&ks->grpmask)) || always) {
+            uint32_t off = atomic_add((volatile int*)&ks->hdr->names_used, KTRACE_LEN(tag));
+            if (off + KTRACE_LEN(tag) <= ks->hdr->names_size) {
+                ktrace_rec_name_t* rec = (ktrace_rec_name_t*) (ks->names + off);
+                rec->tag = tag;
+                rec->id = id;
+                rec->arg = arg;
+                memcpy(rec->name, name, len);
+                rec->name[len] = 0;
+            }
         }
+        arch_interrupt_restore(state, SPIN_LOCK_FLAG_INTERRUPTS);
     }
 }
 
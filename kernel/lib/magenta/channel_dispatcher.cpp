@@ -11,6 +11,7 @@
 #include <assert.h>
 #include <err.h>
 #include <new.h>
+#include <platform.h>
 #include <trace.h>
 
 #include <kernel/event.h>
@@ -54,8 +55,8 @@ public:
 
     uint32_t get_txid() const { return txid_; }
 
-    mx_status_t Wait(lk_time_t timeout) {
-        return event_.Wait(timeout);
+    mx_status_t Wait(lk_time_t deadline) {
+        return event_.Wait(deadline);
     }
 
     // Returns any delivered message via out and the status.
@@ -235,7 +236,7 @@ status_t ChannelDispatcher::Call(mxtl::unique_ptr<MessagePacket> msg,
 
     // (2) Wait for notification via waiter's event or
     // timeout to occur.
-    mx_status_t status = waiter.Wait(mx_time_to_lk(timeout));
+    mx_status_t status = waiter.Wait(deadline_after(timeout));
 
     // (3) see (3A), (3B) above or (3C) below for paths where
     // the waiter could be signaled and removed from the list.
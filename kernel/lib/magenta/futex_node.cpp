@@ -8,6 +8,7 @@
 #include <err.h>
 #include <magenta/futex_node.h>
 #include <magenta/magenta.h>
+#include <platform.h>
 #include <trace.h>
 
 #define LOCAL_TRACE 0
@@ -103,7 +104,7 @@ FutexNode* FutexNode::RemoveFromHead(FutexNode* list_head, uint32_t count,
 // must be held when BlockThread() is called).  To reduce contention, it
 // does not reclaim the mutex on return.
 status_t FutexNode::BlockThread(Mutex* mutex, mx_time_t timeout) TA_NO_THREAD_SAFETY_ANALYSIS {
-    lk_time_t t = mx_time_to_lk(timeout);
+    lk_time_t deadline = deadline_after(timeout);
 
     THREAD_LOCK(state);
 
@@ -121,7 +122,7 @@ status_t FutexNode::BlockThread(Mutex* mutex, mx_time_t timeout) TA_NO_THREAD_SA
         result = ERR_INTERRUPTED;
     } else {
         current_thread->interruptable = true;
-        result = wait_queue_block(&wait_queue_, t);
+        result = wait_queue_block(&wait_queue_, deadline);
         current_thread->interruptable = false;
     }
 
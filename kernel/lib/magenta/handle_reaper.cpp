@@ -32,11 +32,19 @@ void ReapHandles(Handle** handles, uint32_t num_handles) {
     ReapHandles(&list);
 }
 
+// Handles are deleted a batch at a time, with the dpc requeued behind
+// any other dpcs on this cpu in between, so that a process closing a very
+// large number of handles doesn't hold up all other deferred work.
+static constexpr uint32_t kReapBatch = 1024;
+
 static void ReaperRoutine(dpc_t* dpc) {
     mxtl::DoublyLinkedList<Handle*> list;
     {
         AutoLock lock(reaper_mutex);
-        list.swap(reaper_handles);
+        for (uint32_t i = 0; i < kReapBatch && !reaper_handles.is_empty(); i++)
+            list.push_back(reaper_handles.pop_front());
+        if (!reaper_handles.is_empty() && !list_in_list(&reaper_dpc.node))
+            dpc_queue(&reaper_dpc, false);
     }
     Handle* handle;
     while ((handle = list.pop_front()) != nullptr)
@@ -350,6 +350,10 @@ mx_status_t sys_log_read(
     void* buffer,
     uint32_t options);
 
+mx_status_t sys_log_get_buffer(
+    mx_handle_t handle,
+    mx_handle_t out[1]);
+
 mx_status_t sys_ktrace_read(
     mx_handle_t handle,
     void* data,
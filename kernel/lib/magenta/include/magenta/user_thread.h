@@ -137,6 +137,10 @@ public:
     // privileged and unprivileged fields.
     status_t WriteState(uint32_t state_kind, const void* buffer, uint32_t buffer_len, bool priv);
 
+    // How late the thread's timeouts may fire. See MX_PROP_TIMER_SLACK.
+    lk_time_t get_timer_slack() const { return thread_.timer_slack; }
+    void set_timer_slack(lk_time_t slack) { thread_.timer_slack = slack; }
+
     mx_koid_t get_koid() const { return koid_; }
     void set_dispatcher(ThreadDispatcher* dispatcher);
 
@@ -29,10 +29,10 @@ public:
 
     // Returns:
     // NO_ERROR - signaled
-    // ERR_TIMED_OUT - time out expired
+    // ERR_TIMED_OUT - deadline passed
     // ERR_INTERRUPTED - thread killed
-    status_t Wait(lk_time_t timeout) {
-        return event_wait_timeout(&event_, timeout, true);
+    status_t Wait(lk_time_t deadline) {
+        return event_wait_deadline(&event_, deadline, true);
     }
 
     // returns number of ready threads
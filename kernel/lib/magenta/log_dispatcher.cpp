@@ -59,7 +59,7 @@ status_t LogDispatcher::Read(uint32_t flags, void* ptr, size_t len, size_t* actu
 
     AutoLock lock(&lock_);
 
-    mx_status_t status = dlog_read(&reader_, 0, ptr, len, actual);
+    mx_status_t status = dlog_read(&reader_, flags & DLOG_FLAG_BATCH, ptr, len, actual);
     if (status == ERR_SHOULD_WAIT) {
         state_tracker_.UpdateState(MX_CHANNEL_READABLE, 0);
     }
@@ -155,12 +155,8 @@ bool magenta_rights_check(const Handle* handle, mx_rights_t desired) {
 }
 
 mx_status_t magenta_sleep(mx_time_t nanoseconds) {
-    lk_time_t t = mx_time_to_lk(nanoseconds);
-    if ((nanoseconds > 0ull) && (t == 0u))
-        t = 1u;
-
     /* sleep with interruptable flag set */
-    return thread_sleep_etc(t, true);
+    return thread_sleep_etc(nanoseconds, true);
 }
 
 mx_status_t validate_resource_handle(mx_handle_t handle) {
@@ -9,6 +9,7 @@
 #include <assert.h>
 #include <err.h>
 #include <new.h>
+#include <platform.h>
 
 #include <arch/ops.h>
 #include <arch/user_copy.h>
@@ -182,6 +183,7 @@ void* PortDispatcher::Signal(void* cookie, uint64_t key, mx_signals_t signal) {
 }
 
 mx_status_t PortDispatcher::Wait(mx_time_t timeout, IOP_Packet** packet) {
+    lk_time_t deadline = deadline_after(timeout);
     while (true) {
         {
             AutoLock al(&lock_);
@@ -214,8 +216,7 @@ mx_status_t PortDispatcher::Wait(mx_time_t timeout, IOP_Packet** packet) {
         if (timeout == 0ull)
             return ERR_TIMED_OUT;
 
-        lk_time_t t = mx_time_to_lk(timeout);
-        status_t st = event_wait_timeout(&event_, (t == 0u) ? 1u : t, true);
+        status_t st = event_wait_deadline(&event_, deadline, true);
         if (st != NO_ERROR)
             return st;
     }
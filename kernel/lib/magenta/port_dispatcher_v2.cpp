@@ -9,6 +9,7 @@
 #include <assert.h>
 #include <err.h>
 #include <new.h>
+#include <platform.h>
 
 #include <arch/ops.h>
 
@@ -180,6 +181,7 @@ mx_status_t PortDispatcherV2::Queue(PortPacket* packet) {
 }
 
 mx_status_t PortDispatcherV2::DeQueue(mx_time_t timeout, PortPacket** packet) {
+    lk_time_t deadline = deadline_after(timeout);
     while (true) {
         {
             AutoLock al(&lock_);
@@ -192,8 +194,7 @@ mx_status_t PortDispatcherV2::DeQueue(mx_time_t timeout, PortPacket** packet) {
         if (timeout == 0ull)
             return ERR_TIMED_OUT;
 
-        lk_time_t to = mx_time_to_lk(timeout);
-        status_t st = event_.Wait((to == 0u) ? 1u : to);
+        status_t st = event_.Wait(deadline);
         if (st != NO_ERROR)
             return st;
     }
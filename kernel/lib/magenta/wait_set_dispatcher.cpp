@@ -291,8 +291,7 @@ status_t WaitSetDispatcher::Wait(mx_time_t timeout,
                                  mx_waitset_result_t* results,
                                  uint32_t* max_results) {
 
-    lk_time_t lk_timeout = mx_time_to_lk(timeout);
-    status_t result = event_wait_timeout(&event_, lk_timeout, true);
+    status_t result = event_wait_timeout(&event_, timeout, true);
 
     if (result != NO_ERROR && result != ERR_TIMED_OUT) {
         DEBUG_ASSERT(result == ERR_INTERRUPTED);
@@ -30,6 +30,7 @@
 #include <magenta/process_dispatcher.h>
 #include <magenta/syscalls/debug.h>
 #include <magenta/user_copy.h>
+#include <magenta/vm_object_dispatcher.h>
 
 #include <mxtl/array.h>
 
@@ -162,6 +163,31 @@ mx_status_t sys_ktrace_control(mx_handle_t handle, uint32_t action, uint32_t opt
         name[sizeof(name) - 1] = 0;
         return ktrace_control(action, options, name);
     }
+#if WITH_LIB_KTRACE
+    case KTRACE_ACTION_GET_BUFFER: {
+        mxtl::RefPtr<VmObject> vmo = ktrace_get_vmo();
+        if (!vmo)
+            return ERR_NOT_SUPPORTED;
+
+        mxtl::RefPtr<Dispatcher> dispatcher;
+        mx_rights_t rights;
+        status = VmObjectDispatcher::Create(mxtl::move(vmo), &dispatcher, &rights);
+        if (status != NO_ERROR)
+            return status;
+
+        // readers only
+        HandleOwner out(MakeHandle(mxtl::move(dispatcher), rights & ~MX_RIGHT_WRITE));
+        if (!out)
+            return ERR_NO_MEMORY;
+
+        auto up = ProcessDispatcher::GetCurrent();
+        if (make_user_ptr(static_cast<mx_handle_t*>(_ptr)).copy_to_user(
+                up->MapHandleToValue(out)) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        up->AddHandle(mxtl::move(out));
+        return NO_ERROR;
+    }
+#endif
     default:
         return ktrace_control(action, options, nullptr);
     }
@@ -178,14 +204,11 @@ mx_status_t sys_ktrace_write(mx_handle_t handle, uint32_t event_id, uint32_t arg
         return ERR_INVALID_ARGS;
     }
 
-    uint32_t* args = static_cast<uint32_t*>(ktrace_open(TAG_PROBE_24(event_id)));
-    if (!args) {
+    uint32_t args[2] = { arg0, arg1 };
+    if (!ktrace_record(TAG_PROBE_24(event_id), args, sizeof(args))) {
         //  There is not a single reason for failure. Assume it reached the end.
         return ERR_UNAVAILABLE;
     }
-
-    args[0] = arg0;
-    args[1] = arg1;
     return NO_ERROR;
 }
 
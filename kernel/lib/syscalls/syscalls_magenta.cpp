@@ -19,8 +19,11 @@
 #include <kernel/auto_lock.h>
 #include <kernel/mp.h>
 #include <kernel/thread.h>
+#include <kernel/vm.h>
+#include <kernel/vm/vm_object.h>
 
 #include <lib/crypto/global_prng.h>
+#include <lib/debuglog.h>
 #include <lib/ktrace.h>
 #include <lib/user_copy.h>
 #include <lib/user_copy/user_ptr.h>
@@ -37,6 +40,7 @@
 #include <magenta/syscalls/log.h>
 #include <magenta/user_copy.h>
 #include <magenta/user_thread.h>
+#include <magenta/vm_object_dispatcher.h>
 #include <magenta/wait_set_dispatcher.h>
 
 #include <mxtl/ref_ptr.h>
@@ -67,9 +71,9 @@ static int64_t utc_offset;
 uint64_t sys_time_get(uint32_t clock_id) {
     switch (clock_id) {
     case MX_CLOCK_MONOTONIC:
-        return current_time_hires();
+        return current_time();
     case MX_CLOCK_UTC:
-        return current_time_hires() + atomic_load_64(&utc_offset);
+        return current_time() + atomic_load_64(&utc_offset);
     case MX_CLOCK_THREAD:
         return UserThread::GetCurrent()->runtime_ns();
     default:
@@ -237,15 +241,74 @@ mx_status_t sys_log_read(mx_handle_t log_handle, uint32_t len, void* _ptr, uint3
     if (status != NO_ERROR)
         return status;
 
-    char buf[DLOG_MAX_RECORD];
-    size_t actual;
-    if ((status = log->Read(flags, buf, DLOG_MAX_RECORD, &actual)) < 0)
+    if (!(flags & MX_LOG_FLAG_BATCH)) {
+        char buf[DLOG_MAX_RECORD];
+        size_t actual;
+        if ((status = log->Read(flags, buf, DLOG_MAX_RECORD, &actual)) < 0)
+            return status;
+
+        if (make_user_ptr(_ptr).copy_array_to_user(buf, actual) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+
+        return static_cast<mx_status_t>(actual);
+    }
+
+    // Batches are copied out a few records at a time. The chunk size is a
+    // multiple of the record alignment, so records stay aligned across chunks.
+    char buf[DLOG_MAX_RECORD * 4];
+    static_assert(sizeof(buf) % MX_LOG_RECORD_ALIGN == 0, "");
+    size_t total = 0;
+    while (total < len) {
+        size_t actual;
+        size_t chunk = MIN(len - total, sizeof(buf));
+        if ((status = log->Read(flags, buf, chunk, &actual)) < 0)
+            break;
+
+        auto out = make_user_ptr(static_cast<char*>(_ptr) + total);
+        if (out.copy_array_to_user(buf, actual) != NO_ERROR)
+            return ERR_INVALID_ARGS;
+        total += actual;
+    }
+    if (total == 0)
+        return status;
+
+    return static_cast<mx_status_t>(total);
+}
+
+mx_status_t sys_log_get_buffer(mx_handle_t log_handle, mx_handle_t* _out) {
+    LTRACEF("log handle %d\n", log_handle);
+
+    auto up = ProcessDispatcher::GetCurrent();
+
+    // only readers may see the whole log
+    mxtl::RefPtr<LogDispatcher> log;
+    mx_status_t status = up->GetDispatcherWithRights(log_handle, MX_RIGHT_READ, &log);
+    if (status != NO_ERROR)
+        return status;
+
+    void* ptr;
+    size_t size;
+    dlog_get_buffer(&ptr, &size);
+    mxtl::RefPtr<VmObject> vmo = VmObjectPhysical::Create(vaddr_to_paddr(ptr), size);
+    if (!vmo)
+        return ERR_NO_MEMORY;
+
+    mxtl::RefPtr<Dispatcher> dispatcher;
+    mx_rights_t rights;
+    status = VmObjectDispatcher::Create(mxtl::move(vmo), &dispatcher, &rights);
+    if (status != NO_ERROR)
         return status;
 
-    if (make_user_ptr(_ptr).copy_array_to_user(buf, actual) != NO_ERROR)
+    HandleOwner handle(MakeHandle(mxtl::move(dispatcher), rights & ~MX_RIGHT_WRITE));
+    if (!handle)
+        return ERR_NO_MEMORY;
+
+    if (make_user_ptr(_out).copy_to_user(up->MapHandleToValue(handle)) != NO_ERROR)
         return ERR_INVALID_ARGS;
 
-    return static_cast<mx_status_t>(actual);
+    up->AddHandle(mxtl::move(handle));
+
+    return NO_ERROR;
 }
 
 mx_status_t sys_cprng_draw(void* _buffer, size_t len, size_t* _actual) {
@@ -373,6 +373,17 @@ mx_status_t sys_object_get_property(mx_handle_t handle_value, uint32_t property,
                 return ERR_INVALID_ARGS;
             return NO_ERROR;
         }
+        case MX_PROP_TIMER_SLACK: {
+            if (size < sizeof(mx_time_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto thread = DownCastDispatcher<ThreadDispatcher>(&dispatcher);
+            if (!thread)
+                return ERR_WRONG_TYPE;
+            mx_time_t value = thread->thread()->get_timer_slack();
+            if (make_user_ptr(_value).reinterpret<mx_time_t>().copy_to_user(value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            return NO_ERROR;
+        }
         default:
             return ERR_INVALID_ARGS;
     }
@@ -421,6 +432,24 @@ mx_status_t sys_object_set_property(mx_handle_t handle_value, uint32_t property,
                 return ERR_INVALID_ARGS;
             return dispatcher->set_name(name, size);
         }
+        case MX_PROP_TIMER_SLACK: {
+            if (size < sizeof(mx_time_t))
+                return ERR_BUFFER_TOO_SMALL;
+            auto thread = DownCastDispatcher<ThreadDispatcher>(&dispatcher);
+            if (!thread)
+                return up->BadHandle(handle_value, ERR_WRONG_TYPE);
+            mx_time_t value = 0;
+            if (make_user_ptr(_value).reinterpret<const mx_time_t>().copy_from_user(&value) != NO_ERROR)
+                return ERR_INVALID_ARGS;
+            // a negative slack is a caller bug; a huge one would push the
+            // thread's timeouts out to INFINITE_TIME
+            if (static_cast<int64_t>(value) < 0)
+                return ERR_INVALID_ARGS;
+            if (value > MX_TIMER_SLACK_MAX)
+                value = MX_TIMER_SLACK_MAX;
+            thread->thread()->set_timer_slack(value);
+            return NO_ERROR;
+        }
 #if ARCH_X86_64
         case MX_PROP_REGISTER_FS: {
             if (size < sizeof(uintptr_t))
@@ -6,6 +6,7 @@
 
 #include <err.h>
 #include <inttypes.h>
+#include <platform.h>
 #include <trace.h>
 
 #include <kernel/auto_lock.h>
@@ -67,7 +68,7 @@ mx_status_t sys_object_wait_one(mx_handle_t handle_value,
     // even if timeout is 0.  It will return ERR_TIMED_OUT
     // after the timeout expires if the event has not been
     // signaled.
-    result = event.Wait(mx_time_to_lk(timeout));
+    result = event.Wait(deadline_after(timeout));
 
     // Regardless of wait outcome, we must call End().
     auto signals_state = wait_state_observer.End();
@@ -148,7 +149,7 @@ mx_status_t sys_object_wait_many(mx_wait_item_t* _items, uint32_t count, mx_time
     // even if timeout is 0.  It will return ERR_TIMED_OUT
     // after the timeout expires if the event has not been
     // signaled.
-    result = event.Wait(mx_time_to_lk(timeout));
+    result = event.Wait(deadline_after(timeout));
 
     // Regardless of wait outcome, we must call End().
     mx_signals_t combined = 0;
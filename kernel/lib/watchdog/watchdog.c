@@ -23,7 +23,7 @@ static spin_lock_t lock = SPIN_LOCK_INITIAL_VALUE;
 __WEAK void watchdog_handler(watchdog_t *dog)
 {
     dprintf(INFO, "Watchdog \"%s\" (timeout %u mSec) just fired!!\n",
-            dog->name, (uint32_t)dog->timeout);
+            dog->name, (uint32_t)(dog->timeout / LK_MSEC(1)));
     platform_halt(HALT_ACTION_HALT, HALT_REASON_SW_WATCHDOG);
 }
 
@@ -63,7 +63,7 @@ void watchdog_set_enabled(watchdog_t *dog, bool enabled)
 
     dog->enabled = enabled;
     if (enabled)
-        timer_set_oneshot(&dog->expire_timer, dog->timeout, watchdog_timer_callback, dog);
+        timer_set_oneshot(&dog->expire_timer, current_time() + dog->timeout, watchdog_timer_callback, dog);
     else
         timer_cancel(&dog->expire_timer);
 
@@ -82,7 +82,7 @@ void watchdog_pet(watchdog_t *dog)
         goto done;
 
     timer_cancel(&dog->expire_timer);
-    timer_set_oneshot(&dog->expire_timer, dog->timeout, watchdog_timer_callback, dog);
+    timer_set_oneshot(&dog->expire_timer, current_time() + dog->timeout, watchdog_timer_callback, dog);
 
 done:
     spin_unlock_irqrestore(&lock, state);
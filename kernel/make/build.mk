@@ -112,6 +112,20 @@ $(USER_MANIFEST): usermanifestfile $(USER_MANIFEST_DEBUG_INPUTS)
 
 GENERATED += $(USER_MANIFEST)
 
+# index the drivers installed in lib/driver, so that devhost can find the
+# drivers that may bind to a device without loading all of them
+USER_DRIVER_INDEX := $(BUILDDIR)/driver.index
+USER_DRIVER_LINES := $(filter lib/driver/%,$(USER_MANIFEST_LINES))
+
+$(USER_DRIVER_INDEX): $(DRIVERINDEX) $(USER_MANIFEST) $(foreach x,$(USER_DRIVER_LINES),$(lastword $(subst =,$(SPACE),$(strip $(x)))))
+	@echo generating $@
+	@$(MKDIR)
+	$(NOECHO)$(DRIVERINDEX) -o $@ $(USER_DRIVER_LINES)
+
+USER_MANIFEST_LINES += lib/driver.index=$(USER_DRIVER_INDEX)
+
+GENERATED += $(USER_DRIVER_INDEX)
+
 # Manifest Lines are bootfspath=buildpath
 # Extract the part after the = for each line
 # to generate dependencies
@@ -67,7 +67,7 @@ void platform_debug_start_uart_timer(void)
     if (!started) {
         started = true;
         timer_initialize(&uart_rx_poll_timer);
-        timer_set_periodic(&uart_rx_poll_timer, 10, uart_rx_poll, NULL);
+        timer_set_periodic(&uart_rx_poll_timer, LK_MSEC(10), uart_rx_poll, NULL);
     }
 }
 
@@ -91,6 +91,7 @@ static uint8_t apic_divisor = 0;
 // TSC timer calibration values
 static uint64_t tsc_ticks_per_ms;
 static struct fp_32_64 ns_per_tsc;
+static struct fp_32_64 tsc_per_ns;
 
 // HPET calibration values
 static struct fp_32_64 ns_per_hpet;
@@ -106,9 +107,12 @@ uint64_t get_tsc_ticks_per_ms(void) {
 
 #define INTERNAL_FREQ_TICKS_PER_MS (INTERNAL_FREQ/1000)
 
-/* Maximum amount of time that can be program on the timer to schedule the next
- *  interrupt, in miliseconds */
-#define MAX_TIMER_INTERVAL 55
+/* Maximum amount of time that can be programmed on the APIC timer count to
+ * schedule the next interrupt. Later deadlines are reached in steps. */
+#define MAX_TIMER_INTERVAL LK_MSEC(55)
+/* The TSC deadline is absolute and 64 bits wide; this only keeps the
+ * conversion from nanoseconds from overflowing. */
+#define MAX_TSC_DEADLINE_INTERVAL LK_SEC(60 * 60)
 
 #define LOCAL_TRACE 0
 
@@ -116,33 +120,6 @@ lk_time_t current_time(void)
 {
     lk_time_t time;
 
-    switch (wall_clock) {
-        case CLOCK_TSC: {
-            uint64_t tsc = rdtsc();
-            time = tsc / tsc_ticks_per_ms;
-            break;
-        }
-        case CLOCK_HPET: {
-            uint64_t counter = hpet_get_value();
-            time = counter / hpet_ticks_per_ms();
-            break;
-        }
-        case CLOCK_PIT: {
-            // XXX slight race
-            time = (lk_time_t) (timer_current_time >> 32);
-            break;
-        }
-        default:
-            panic("Invalid wall clock source\n");
-    }
-
-    return time;
-}
-
-lk_bigtime_t current_time_hires(void)
-{
-    lk_bigtime_t time;
-
     switch (wall_clock) {
         case CLOCK_TSC: {
             uint64_t tsc = rdtsc();
@@ -156,7 +133,7 @@ lk_bigtime_t current_time_hires(void)
         }
         case CLOCK_PIT: {
             // XXX slight race
-            time = (lk_bigtime_t) ((timer_current_time >> 22) * 1000) >> 10;
+            time = (lk_time_t) ((timer_current_time >> 22) * 1000) >> 10;
             time *= 1000;
             break;
         }
@@ -185,9 +162,6 @@ enum handler_return platform_handle_apic_timer_tick(void) {
     uint cpu = arch_curr_cpu_num();
 
     lk_time_t time = current_time();
-    //lk_bigtime_t btime = current_time_hires();
-    //printf_xy(71, 0, WHITE, "%08u", (uint32_t) time);
-    //printf_xy(63, 1, WHITE, "%016llu", (uint64_t) btime);
 
     if (t_callback[cpu] && timer_current_time >= next_trigger_time) {
         lk_time_t delta = timer_current_time - next_trigger_time;
@@ -428,6 +402,7 @@ static void calibrate_tsc(void)
     LTRACEF("TSC calibrated: %" PRIu64 " ticks/ms\n", tsc_ticks_per_ms);
 
     fp_32_64_div_32_32(&ns_per_tsc, 1000 * 1000 * 1000, tsc_ticks_per_ms * 1000);
+    fp_32_64_div_32_32(&tsc_per_ns, tsc_ticks_per_ms, 1000 * 1000);
     LTRACEF("ns_per_tsc: %08x.%08x%08x\n", ns_per_tsc.l0, ns_per_tsc.l32, ns_per_tsc.l64);
 }
 
@@ -506,7 +481,7 @@ static void platform_init_timer(uint level)
 LK_INIT_HOOK(timer, &platform_init_timer, LK_INIT_LEVEL_VM + 3);
 
 status_t platform_set_oneshot_timer(platform_timer_callback callback,
-                                    void *arg, lk_time_t interval)
+                                    void *arg, lk_time_t deadline)
 {
     DEBUG_ASSERT(arch_ints_disabled());
     uint cpu = arch_curr_cpu_num();
@@ -514,30 +489,35 @@ status_t platform_set_oneshot_timer(platform_timer_callback callback,
     t_callback[cpu] = callback;
     callback_arg[cpu] = arg;
 
-    if (interval > MAX_TIMER_INTERVAL)
-        interval = MAX_TIMER_INTERVAL;
-    if (interval < 1) interval = 1;
+    lk_time_t now = current_time();
+    lk_time_t interval = (deadline > now) ? deadline - now : 0;
 
     if (use_tsc_deadline) {
-        if (UINT64_MAX / interval < tsc_ticks_per_ms) {
-            return ERR_INVALID_ARGS;
-        }
-        uint64_t tsc_interval = interval * tsc_ticks_per_ms;
-        uint64_t deadline = rdtsc() + tsc_interval;
-        LTRACEF("Scheduling oneshot timer: %" PRIu64 " deadline\n", deadline);
-        apic_timer_set_tsc_deadline(deadline, false /* unmasked */);
+        if (interval > MAX_TSC_DEADLINE_INTERVAL)
+            interval = MAX_TSC_DEADLINE_INTERVAL;
+        // Round up by a tick so that current_time() has reached the deadline
+        // by the time the interrupt arrives. A deadline in the past fires at once.
+        uint64_t tsc_deadline = rdtsc() + u64_mul_u64_fp32_64(interval, tsc_per_ns) + 1;
+        LTRACEF("Scheduling oneshot timer: %" PRIu64 " deadline\n", tsc_deadline);
+        apic_timer_set_tsc_deadline(tsc_deadline, false /* unmasked */);
         return NO_ERROR;
     }
 
+    if (interval > MAX_TIMER_INTERVAL)
+        interval = MAX_TIMER_INTERVAL;
+
+    uint64_t count = interval * apic_ticks_per_ms / LK_MSEC(1);
+    if (count == 0)
+        count = 1;
     uint8_t extra_divisor = 1;
-    while (apic_ticks_per_ms > UINT32_MAX / interval / extra_divisor) {
+    while (count > UINT32_MAX) {
+        count /= 2;
         extra_divisor *= 2;
     }
-    uint32_t count = (apic_ticks_per_ms / extra_divisor) * interval;
     uint32_t divisor = apic_divisor * extra_divisor;
     ASSERT(divisor <= UINT8_MAX);
-    LTRACEF("Scheduling oneshot timer: %u count, %u div\n", count, divisor);
-    return apic_timer_set_oneshot(count, divisor, false /* unmasked */);
+    LTRACEF("Scheduling oneshot timer: %" PRIu64 " count, %u div\n", count, divisor);
+    return apic_timer_set_oneshot((uint32_t)count, divisor, false /* unmasked */);
 }
 
 void platform_stop_timer(void)
@@ -9,10 +9,10 @@
 
 static volatile uint64_t watchdog_last_time = 0;
 
-#define WATCHDOG_CHECKIN_PERIOD_MS 50
+#define WATCHDOG_CHECKIN_PERIOD LK_MSEC(50)
 
 // If the LK timer hasn't checked in in this long, reset the machine.
-#define ASSUMED_DEAD_PERIOD_MS 150
+#define ASSUMED_DEAD_PERIOD LK_MSEC(150)
 
 void platform_handle_watchdog(void);
 void platform_handle_watchdog(void)
@@ -20,8 +20,8 @@ void platform_handle_watchdog(void)
     uint64_t last_time = watchdog_last_time;
 
     uint64_t now = current_time();
-    uint64_t deadline = last_time + ASSUMED_DEAD_PERIOD_MS;
-    if (now < last_time - 2 || now > deadline) {
+    uint64_t deadline = last_time + ASSUMED_DEAD_PERIOD;
+    if (now < last_time - LK_MSEC(2) || now > deadline) {
         // Shoot all other cores
         apic_send_broadcast_ipi(0, DELIVERY_MODE_INIT);
 
@@ -58,7 +58,7 @@ static void install_watchdog_timer(uint level)
 {
     if (cmdline_get_bool("kernel.watchdog", false)) {
         watchdog_last_time = current_time();
-        timer_set_periodic(&watchdog_timer, WATCHDOG_CHECKIN_PERIOD_MS, checkin_callback, NULL);
+        timer_set_periodic(&watchdog_timer, WATCHDOG_CHECKIN_PERIOD, checkin_callback, NULL);
 
         platform_configure_watchdog(20); // 50ms granularity
     }
@@ -16,4 +16,12 @@ typedef struct dev_coordinator_msg {
 #define DC_OP_STATUS 0
 #define DC_OP_ADD 1
 #define DC_OP_REMOVE 2
-#define DC_OP_SHUTDOWN 3
\ No newline at end of file
+#define DC_OP_SHUTDOWN 3
+// arg is nonzero while the devhost has device binds queued, running,
+// or pending. Sent on the devhost's root device.
+#define DC_OP_BIND_STATE 4
+
+// DC_OP_ADD arg flags
+// a devhost will be launched for the new device, which is busy binding
+// until the devhost reports otherwise
+#define DC_ADD_FLAG_DEVHOST 1
@@ -87,6 +87,12 @@ static void _device_set_bindable(mx_device_t* dev, bool bindable) {
     DM_UNLOCK();
 }
 
+static void _device_bind_complete(mx_device_t* dev, mx_status_t status) {
+    DM_LOCK();
+    devhost_device_bind_complete(dev, status);
+    DM_UNLOCK();
+}
+
 mx_status_t device_bind(mx_device_t* dev, const char* drv_name) {
     mx_status_t r;
     DM_LOCK();
@@ -137,6 +143,7 @@ driver_api_t devhost_api = {
     .device_remove = _device_remove,
     .device_rebind = _device_rebind,
     .device_set_bindable = _device_set_bindable,
+    .device_bind_complete = _device_bind_complete,
     .get_root_resource = _get_root_resource,
     .load_firmware = _load_firmware,
 };
@@ -8,6 +8,8 @@
 
 #include <stdio.h>
 
+#include "devhost.h"
+
 typedef struct {
     const mx_device_prop_t* props;
     const mx_device_prop_t* end;
@@ -165,3 +167,35 @@ bool devhost_is_bindable(magenta_driver_info_t* di, uint32_t protocol_id,
     ctx.name = di->note->name;
     return is_bindable(&ctx);
 }
+
+static void init_ctx_for_device(bpctx_t* ctx, mx_device_t* dev) {
+    ctx->props = dev->props;
+    ctx->end = dev->props + dev->prop_count;
+    ctx->protocol_id = dev->protocol_id;
+}
+
+uint32_t devhost_get_prop(mx_device_t* dev, uint32_t id) {
+    bpctx_t ctx;
+    init_ctx_for_device(&ctx, dev);
+    return dev_get_prop(&ctx, id);
+}
+
+bool devhost_is_bindable_index(const driver_index_entry_t* entry, mx_device_t* dev) {
+    bpctx_t ctx;
+    init_ctx_for_device(&ctx, dev);
+
+    // cheap checks first: most devices fail on protocol or vendor
+    if ((entry->protocol_id != 0) &&
+        (dev_get_prop(&ctx, BIND_PROTOCOL) != entry->protocol_id)) {
+        return false;
+    }
+    if ((entry->key_id != BIND_FLAGS) &&
+        (dev_get_prop(&ctx, entry->key_id) != entry->key_value)) {
+        return false;
+    }
+
+    ctx.binding = (const mx_bind_inst_t*)(entry + 1);
+    ctx.binding_size = entry->bindcount * sizeof(mx_bind_inst_t);
+    ctx.name = entry->name;
+    return is_bindable(&ctx);
+}
@@ -119,9 +119,43 @@ static mx_status_t default_resume(mx_device_t* dev) {
 
 static struct list_node unmatched_device_list = LIST_INITIAL_VALUE(unmatched_device_list);
 static struct list_node driver_list = LIST_INITIAL_VALUE(driver_list);
+// drivers added on demand from the driver index
+static struct list_node index_driver_list = LIST_INITIAL_VALUE(index_driver_list);
 
 #define device_is_bound(dev) (!!dev->owner)
 
+// New devices are probed by a pool of bind workers rather than by the thread
+// that added them. Since bind() runs without the DM lock, the workers bring up
+// independent parts of the device tree in parallel: a slow probe (USB
+// enumeration, disk spin-up) no longer holds up everything after it.
+#define BIND_WORKERS 4
+
+// devices waiting for a worker, linked by their unode
+static struct list_node bind_queue = LIST_INITIAL_VALUE(bind_queue);
+static cnd_t bind_queue_cnd = CND_INIT;
+static bool bind_workers_started;
+
+// Probes queued or running, plus binds pending, plus one until
+// devhost_init_finished(). The coordinator treats the devhost as busy
+// from launch until this reaches zero.
+static uint32_t binds_outstanding = 1;
+
+static void bind_started(void) {
+    if (binds_outstanding++ == 0) {
+        devhost_report_binding(root_dev, true);
+    }
+}
+
+static void bind_finished(void) {
+    if (--binds_outstanding == 0) {
+        devhost_report_binding(root_dev, false);
+    }
+}
+
+void devhost_init_finished(void) {
+    bind_finished();
+}
+
 void dev_ref_release(mx_device_t* dev) {
     dev->refcount--;
     if (dev->refcount == 0) {
@@ -159,6 +193,11 @@ static mx_status_t devhost_device_probe(mx_device_t* dev, mx_driver_t* drv) {
     xprintf("devhost: probe dev=%p(%s) drv=%p(%s)\n",
             dev, dev->name, drv, drv->name ? drv->name : "<NULL>");
 
+    // don't bind to a device which is being removed
+    if (dev->flags & DEV_FLAG_DEAD) {
+        return ERR_BAD_STATE;
+    }
+
     // don't bind to the driver that published this device
     if (drv == dev->driver) {
         return ERR_NOT_SUPPORTED;
@@ -176,9 +215,21 @@ static mx_status_t devhost_device_probe(mx_device_t* dev, mx_driver_t* drv) {
     if (status < 0) {
         return status;
     }
+    if (dev->flags & DEV_FLAG_DEAD) {
+        // removed while bind() ran: detach the driver again, as
+        // devhost_device_remove() would have
+        if (drv->ops.unbind) {
+            drv->ops.unbind(drv, dev, cookie);
+        }
+        return ERR_BAD_STATE;
+    }
     dev->owner = drv;
     dev->owner_cookie = cookie;
     dev_ref_acquire(dev);
+    if (status == DRV_BIND_PENDING) {
+        dev->flags |= DEV_FLAG_BIND_PENDING;
+        bind_started();
+    }
 
     // remove from unbound list if we succeeded
     if (list_in_list(&dev->unode)) {
@@ -187,6 +238,25 @@ static mx_status_t devhost_device_probe(mx_device_t* dev, mx_driver_t* drv) {
     return NO_ERROR;
 }
 
+// Probes dev with the drivers in the driver index, in index order whether or
+// not they have been added yet, so that which driver binds does not depend
+// on which devices happened to turn up first.
+static void devhost_device_probe_index(mx_device_t* dev, bool autobind) {
+    devhost_index_iter_t it = {};
+    mx_driver_t* drv;
+    bool loaded;
+    while (!device_is_bound(dev) && !(dev->flags & DEV_FLAG_DEAD) &&
+           ((drv = devhost_index_next_driver(dev, &it, &loaded)) != NULL)) {
+        // adding a driver probes the unmatched devices with it, so if this
+        // device is on that list it has already been tried
+        if ((autobind && drv->flags & DRV_FLAG_NO_AUTOBIND) ||
+            (loaded && list_in_list(&dev->unode))) {
+            continue;
+        }
+        devhost_device_probe(dev, drv);
+    }
+}
+
 static void devhost_device_probe_all(mx_device_t* dev, bool autobind) {
     if ((dev->flags & DEV_FLAG_UNBINDABLE) == 0) {
         if (!device_is_bound(dev)) {
@@ -201,13 +271,61 @@ static void devhost_device_probe_all(mx_device_t* dev, bool autobind) {
             }
         }
 
+        // then drivers from the driver index
+        devhost_device_probe_index(dev, autobind);
+
         // if no driver is bound, add the device to the unmatched list
-        if (!device_is_bound(dev)) {
+        if (!device_is_bound(dev) && !(dev->flags & DEV_FLAG_DEAD)) {
             list_add_tail(&unmatched_device_list, &dev->unode);
         }
     }
 }
 
+static int bind_worker(void* arg) {
+    DM_LOCK();
+    for (;;) {
+        mx_device_t* dev;
+        while ((dev = list_remove_head_type(&bind_queue, mx_device_t, unode)) == NULL) {
+            cnd_wait(&bind_queue_cnd, &__devhost_api_lock);
+        }
+        dev->flags &= ~DEV_FLAG_BIND_QUEUED;
+        // the probes drop the DM lock, so hold a reference rather than
+        // marking dev busy: its parent may still remove it meanwhile
+        dev_ref_acquire(dev);
+        devhost_device_probe_all(dev, true);
+        dev_ref_release(dev);
+        bind_finished();
+    }
+    return 0;
+}
+
+static void devhost_queue_bind(mx_device_t* dev) {
+    if (!bind_workers_started) {
+        bind_workers_started = true;
+        for (int n = 0; n < BIND_WORKERS; n++) {
+            thrd_t t;
+            if (thrd_create_with_name(&t, bind_worker, NULL, "devhost-bind") != thrd_success) {
+                printf("devhost: cannot start bind worker\n");
+                continue;
+            }
+            thrd_detach(t);
+        }
+    }
+    bind_started();
+    dev->flags |= DEV_FLAG_BIND_QUEUED;
+    list_add_tail(&bind_queue, &dev->unode);
+    cnd_signal(&bind_queue_cnd);
+}
+
+// takes dev off the bind queue, if it is still waiting there
+static void devhost_unqueue_bind(mx_device_t* dev) {
+    if (dev->flags & DEV_FLAG_BIND_QUEUED) {
+        dev->flags &= ~DEV_FLAG_BIND_QUEUED;
+        list_delete(&dev->unode);
+        bind_finished();
+    }
+}
+
 void devhost_device_init(mx_device_t* dev, mx_driver_t* driver,
                         const char* name, mx_protocol_device_t* ops) {
     xprintf("devhost: init '%s' drv=%p, ops=%p\n",
@@ -366,10 +484,12 @@ mx_status_t devhost_device_add(mx_device_t* dev, mx_device_t* parent) {
         }
     }
 
-    // probe the device
-    devhost_device_probe_all(dev, true);
-
     dev->flags &= (~DEV_FLAG_BUSY);
+
+    // probe the device, unless nothing may bind to it
+    if ((dev->flags & DEV_FLAG_UNBINDABLE) == 0) {
+        devhost_queue_bind(dev);
+    }
     return NO_ERROR;
 }
 
@@ -440,7 +560,13 @@ mx_status_t devhost_device_remove(mx_device_t* dev) {
         dev_ref_release(dev->parent);
     }
 
-    // remove from list of unbound devices, if on that list
+    // remove from the bind queue or the list of unbound devices,
+    // if on either list
+    devhost_unqueue_bind(dev);
+    if (dev->flags & DEV_FLAG_BIND_PENDING) {
+        dev->flags &= ~DEV_FLAG_BIND_PENDING;
+        bind_finished();
+    }
     if (list_in_list(&dev->unode)) {
         list_delete(&dev->unode);
     }
@@ -460,20 +586,29 @@ mx_status_t devhost_device_bind(mx_device_t* dev, const char* drv_name) {
     if (dev->flags & DEV_FLAG_UNBINDABLE) {
         return NO_ERROR;
     }
+    // bind here and now rather than on a worker
+    devhost_unqueue_bind(dev);
     dev->flags |= DEV_FLAG_BUSY;
     if (!drv_name) {
         devhost_device_probe_all(dev, false);
     } else {
         // bind the driver with matching name
         mx_driver_t* drv = NULL;
+        bool found = false;
         list_for_every_entry (&driver_list, drv, mx_driver_t, node) {
             if (strcmp(drv->name, drv_name)) {
                 continue;
             }
+            found = true;
             if (devhost_device_probe(dev, drv) == NO_ERROR) {
                 break;
             }
         }
+        // or get it from the driver index, loading it if need be
+        if (!found && ((drv = devhost_load_driver_named(drv_name)) != NULL) &&
+            !device_is_bound(dev)) {
+            devhost_device_probe(dev, drv);
+        }
     }
     dev->flags &= ~DEV_FLAG_BUSY;
     return NO_ERROR;
@@ -481,6 +616,7 @@ mx_status_t devhost_device_bind(mx_device_t* dev, const char* drv_name) {
 
 mx_status_t devhost_device_rebind(mx_device_t* dev) {
     dev->flags |= DEV_FLAG_REBIND;
+    devhost_unqueue_bind(dev);
 
     // remove children
     mx_device_t* child = NULL;
@@ -493,6 +629,10 @@ mx_status_t devhost_device_rebind(mx_device_t* dev) {
 
     // detach from owner and downref
     if (dev->owner) {
+        if (dev->flags & DEV_FLAG_BIND_PENDING) {
+            dev->flags &= ~DEV_FLAG_BIND_PENDING;
+            bind_finished();
+        }
         dev->owner = NULL;
         dev_ref_release(dev);
     }
@@ -504,6 +644,26 @@ mx_status_t devhost_device_rebind(mx_device_t* dev) {
     return NO_ERROR;
 }
 
+void devhost_device_bind_complete(mx_device_t* dev, mx_status_t status) {
+    if (!(dev->flags & DEV_FLAG_BIND_PENDING)) {
+        printf("device: %p(%s): no bind pending\n", dev, dev->name);
+        return;
+    }
+    dev->flags &= ~DEV_FLAG_BIND_PENDING;
+    if ((status < 0) && dev->owner) {
+        // as if bind() had failed. other drivers may still bind explicitly,
+        // but the one that failed is not tried again
+        xprintf("device: %p(%s): pending bind failed %d\n", dev, dev->name, status);
+        dev->owner = NULL;
+        dev->owner_cookie = NULL;
+        if (!(dev->flags & DEV_FLAG_DEAD)) {
+            list_add_tail(&unmatched_device_list, &dev->unode);
+        }
+        dev_ref_release(dev);
+    }
+    bind_finished();
+}
+
 mx_status_t devhost_device_openat(mx_device_t* dev, mx_device_t** out, const char* path, uint32_t flags) {
     if (dev->flags & DEV_FLAG_DEAD) {
         printf("device open: %p(%s) is dead!\n", dev, dev->name);
@@ -543,7 +703,7 @@ mx_status_t devhost_device_close(mx_device_t* dev, uint32_t flags) {
     return r;
 }
 
-mx_status_t devhost_driver_add(mx_driver_t* drv) {
+static mx_status_t devhost_driver_add_to(struct list_node* list, mx_driver_t* drv) {
     xprintf("driver add: %p(%s)\n", drv, drv->name);
 
     if (drv->ops.init) {
@@ -556,7 +716,7 @@ mx_status_t devhost_driver_add(mx_driver_t* drv) {
     }
 
     // add the driver to the driver list
-    list_add_tail(&driver_list, &drv->node);
+    list_add_tail(list, &drv->node);
 
     // probe unmatched devices with the driver and initialize if the probe is successful
     mx_device_t* dev = NULL;
@@ -567,6 +727,33 @@ mx_status_t devhost_driver_add(mx_driver_t* drv) {
     return NO_ERROR;
 }
 
+mx_status_t devhost_driver_add(mx_driver_t* drv) {
+    return devhost_driver_add_to(&driver_list, drv);
+}
+
+mx_status_t devhost_index_driver_add(mx_driver_t* drv) {
+    return devhost_driver_add_to(&index_driver_list, drv);
+}
+
+void devhost_bind_unmatched(void) {
+    // walk the driver index for each device that went unmatched before the
+    // index was read. adding a driver probes the unmatched devices with it,
+    // so take them all off the list first and put back the ones left over
+    struct list_node pending = LIST_INITIAL_VALUE(pending);
+    mx_device_t* dev;
+    while ((dev = list_remove_head_type(&unmatched_device_list, mx_device_t, unode)) != NULL) {
+        list_add_tail(&pending, &dev->unode);
+    }
+    while ((dev = list_remove_head_type(&pending, mx_device_t, unode)) != NULL) {
+        dev_ref_acquire(dev);
+        devhost_device_probe_index(dev, true);
+        if (!device_is_bound(dev) && !(dev->flags & DEV_FLAG_DEAD)) {
+            list_add_tail(&unmatched_device_list, &dev->unode);
+        }
+        dev_ref_release(dev);
+    }
+}
+
 mx_status_t devhost_driver_remove(mx_driver_t* drv) {
     // TODO: implement
     return ERR_NOT_SUPPORTED;
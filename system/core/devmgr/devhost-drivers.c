@@ -7,9 +7,12 @@
 
 #include <dirent.h>
 #include <dlfcn.h>
+#include <fcntl.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
 
 #include <ddk/device.h>
 #include <ddk/driver.h>
@@ -20,11 +23,20 @@
 #include <magenta/syscalls.h>
 #include <magenta/types.h>
 
+#define TRACE 0
+
+#if TRACE
+#define xprintf(fmt...) printf(fmt)
+#else
+#define xprintf(fmt...) \
+    do {                \
+    } while (0)
+#endif
 
 // driver rpc client
 
 mx_status_t devhost_add_internal(mx_device_t* parent,
-                                 const char* name, uint32_t protocol_id,
+                                 const char* name, uint32_t protocol_id, uint32_t flags,
                                  mx_handle_t* _hdevice, mx_handle_t* _hrpc) {
 
     size_t len = strlen(name);
@@ -49,7 +61,7 @@ mx_status_t devhost_add_internal(mx_device_t* parent,
     //printf("devhost_add(%p, %p)\n", dev, parent);
     dev_coordinator_msg_t msg;
     msg.op = DC_OP_ADD;
-    msg.arg = 0;
+    msg.arg = flags;
     msg.protocol_id = protocol_id;
     memcpy(msg.name, name, len + 1);
 
@@ -97,13 +109,27 @@ mx_status_t devhost_add(mx_device_t* parent, mx_device_t* child) {
     mx_handle_t hdevice, hrpc;
     mx_status_t status;
     //printf("devhost_add(%p:%s,%p:%s)\n", parent, parent->name, child, child->name);
-    if ((status = devhost_add_internal(parent, child->name, child->protocol_id,
+    if ((status = devhost_add_internal(parent, child->name, child->protocol_id, 0,
                                        &hdevice, &hrpc)) < 0) {
         return status;
     }
     return devhost_connect(child, hdevice, hrpc);
 }
 
+void devhost_report_binding(mx_device_t* root, bool binding) {
+    if ((root == NULL) || (root->rpc == 0)) {
+        return;
+    }
+    dev_coordinator_msg_t msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.op = DC_OP_BIND_STATE;
+    msg.arg = binding;
+    mx_status_t status;
+    if ((status = mx_channel_write(root->rpc, 0, &msg, sizeof(msg), NULL, 0)) < 0) {
+        printf("devhost_report_binding: failed to write channel: %d\n", status);
+    }
+}
+
 mx_status_t devhost_remove(mx_device_t* dev) {
     dev_coordinator_msg_t msg;
     memset(&msg, 0, sizeof(msg));
@@ -143,10 +169,10 @@ static void init_driver(mx_driver_t* drv, bool for_root) {
         driver_add(drv);
 }
 
-static bool is_driver_disabled(magenta_driver_info_t* di) {
+static bool is_driver_disabled(const char* name) {
     // driver.<driver_name>.disable
     char opt[16 + DRIVER_NAME_LEN_MAX];
-    snprintf(opt, 16 + DRIVER_NAME_LEN_MAX, "driver.%s.disable", di->note->name);
+    snprintf(opt, 16 + DRIVER_NAME_LEN_MAX, "driver.%s.disable", name);
     return getenv(opt) != NULL;
 }
 
@@ -160,6 +186,29 @@ static void init_from_driver_info(magenta_driver_info_t* di, bool for_root) {
 
 static list_node_t driver_list = LIST_INITIAL_VALUE(driver_list);
 
+static magenta_driver_info_t* dlopen_driver(const char* libname) {
+    void* dl = dlopen(libname, RTLD_NOW);
+    if (dl == NULL) {
+        printf("devhost: cannot load '%s': %s\n", libname, dlerror());
+        return NULL;
+    }
+    magenta_driver_info_t* di = dlsym(dl, "__magenta_driver__");
+    if (di == NULL) {
+        printf("devhost: driver '%s' missing __magenta_driver__ symbol\n", libname);
+    }
+    return di;
+}
+
+static void add_loaded_driver(magenta_driver_info_t* di, bool priority) {
+    if (priority) {
+        // debugging / development hack
+        // prioritize drivers with version "!..." over others
+        list_add_head(&driver_list, &di->node);
+    } else {
+        list_add_tail(&driver_list, &di->node);
+    }
+}
+
 static void load_loadable_drivers(const char* path) {
     DIR* dir = opendir(path);
     if (dir == NULL) {
@@ -175,26 +224,270 @@ static void load_loadable_drivers(const char* path) {
         if ((r < 0) || (r >= (int)sizeof(libname))) {
             continue;
         }
-        void* dl = dlopen(libname, RTLD_NOW);
-        if (dl == NULL) {
-            printf("devhost: cannot load '%s': %s\n", libname, dlerror());
-            continue;
+        magenta_driver_info_t* di = dlopen_driver(libname);
+        if ((di != NULL) && !is_driver_disabled(di->note->name)) {
+            add_loaded_driver(di, di->note->version[0] == '!');
         }
-        magenta_driver_info_t* di = dlsym(dl, "__magenta_driver__");
-        if (di == NULL) {
-            printf("devhost: driver '%s' missing __magenta_driver__ symbol\n", libname);
+    }
+    closedir(dir);
+}
+
+// The driver index for a directory of drivers (see magenta/driver-index.h)
+// lets us leave a driver uninitialized until a device turns up that it may
+// bind to, and skip running the binding programs of drivers that can't.
+// Every driver is still dlopen()ed up front, like the drivers in a directory
+// without an index: see init_loaded_drivers().
+typedef struct {
+    char* data;
+    // entries in data, sorted by protocol_id
+    driver_index_entry_t** entries;
+    uint8_t* state;
+    // the driver dlopen()ed for each entry not in state ENTRY_SKIPPED
+    mx_driver_t** drivers;
+    uint32_t count;
+} driver_index_t;
+
+// entry states
+// dlopen()ed, but not yet initialized or added
+#define ENTRY_LOADED 0
+#define ENTRY_ADDING 1
+#define ENTRY_ADDED 2
+// failed to load or initialize, or may not bind here
+#define ENTRY_SKIPPED 3
+
+// signalled when an entry leaves ENTRY_ADDING
+static cnd_t driver_index_cnd = CND_INIT;
+
+// for /system/lib/driver and /boot/lib/driver
+#define DRIVER_INDEX_MAX 2
+
+static driver_index_t driver_indexes[DRIVER_INDEX_MAX];
+static uint32_t driver_index_count;
+
+static char* read_driver_index(const char* path, size_t* size) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    char* data = NULL;
+    struct stat s;
+    if ((fstat(fd, &s) == 0) && (s.st_size > 0) && ((data = malloc(s.st_size)) != NULL)) {
+        if (read(fd, data, s.st_size) != s.st_size) {
+            free(data);
+            data = NULL;
         } else {
-            if (is_driver_disabled(di)) continue;
-            if (di->note->version[0] == '!') {
-                // debugging / development hack
-                // prioritize drivers with version "!..." over others
-                list_add_head(&driver_list, &di->node);
+            *size = s.st_size;
+        }
+    }
+    close(fd);
+    return data;
+}
+
+static bool parse_driver_index(driver_index_t* index, char* data, size_t size) {
+    driver_index_header_t* hdr = (driver_index_header_t*)data;
+    if ((size < sizeof(*hdr)) || (hdr->magic != DRIVER_INDEX_MAGIC) ||
+        (hdr->version != DRIVER_INDEX_VERSION)) {
+        return false;
+    }
+    index->data = data;
+    index->count = hdr->count;
+    index->entries = calloc(hdr->count, sizeof(driver_index_entry_t*));
+    index->state = calloc(hdr->count, sizeof(uint8_t));
+    index->drivers = calloc(hdr->count, sizeof(mx_driver_t*));
+    if ((index->entries == NULL) || (index->state == NULL) || (index->drivers == NULL)) {
+        return false;
+    }
+
+    size_t off = sizeof(*hdr);
+    for (uint32_t i = 0; i < hdr->count; i++) {
+        if (size - off < sizeof(driver_index_entry_t)) {
+            return false;
+        }
+        driver_index_entry_t* entry = (driver_index_entry_t*)(data + off);
+        off += sizeof(*entry);
+        if (entry->bindcount > (size - off) / sizeof(mx_bind_inst_t)) {
+            return false;
+        }
+        off += entry->bindcount * sizeof(mx_bind_inst_t);
+        if ((i > 0) && (entry->protocol_id < index->entries[i - 1]->protocol_id)) {
+            return false;
+        }
+        entry->libname[sizeof(entry->libname) - 1] = 0;
+        entry->name[sizeof(entry->name) - 1] = 0;
+        index->entries[i] = entry;
+    }
+    return true;
+}
+
+// Loads the driver index for the drivers in path, if there is one, and
+// dlopen()s the drivers it lists. The root devhost's drivers without binding
+// programs are added like drivers found without an index. The rest are
+// skipped if they may not bind in this devhost, and otherwise wait for
+// devhost_index_next_driver() to add them.
+static bool load_driver_index(const char* path, bool for_root) {
+    if (driver_index_count == DRIVER_INDEX_MAX) {
+        return false;
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "%s.index", path);
+    size_t size;
+    char* data = read_driver_index(name, &size);
+    if (data == NULL) {
+        return false;
+    }
+    driver_index_t* index = &driver_indexes[driver_index_count];
+    if (!parse_driver_index(index, data, size)) {
+        printf("devhost: bad driver index '%s'\n", name);
+        free(index->entries);
+        free(index->state);
+        free(index->drivers);
+        free(data);
+        memset(index, 0, sizeof(*index));
+        return false;
+    }
+
+    for (uint32_t i = 0; i < index->count; i++) {
+        driver_index_entry_t* entry = index->entries[i];
+        if (is_driver_disabled(entry->name)) {
+            index->state[i] = ENTRY_SKIPPED;
+        } else if (entry->bindcount == 0) {
+            // only load root-level drivers in the root devhost
+            index->state[i] = ENTRY_SKIPPED;
+            if (for_root) {
+                magenta_driver_info_t* di = dlopen_driver(entry->libname);
+                if (di != NULL) {
+                    add_loaded_driver(di, entry->flags & DRIVER_INDEX_FLAG_PRIORITY);
+                }
+            }
+        }
+#if !ONLY_ONE_DEVHOST
+        else if (for_root) {
+            index->state[i] = ENTRY_SKIPPED;
+        }
+#endif
+        else {
+            magenta_driver_info_t* di = dlopen_driver(entry->libname);
+            if (di != NULL) {
+                mx_driver_t* drv = di->driver;
+                drv->name = di->note->name;
+                drv->binding = di->binding;
+                drv->binding_size = di->binding_size;
+                index->drivers[i] = drv;
             } else {
-                list_add_tail(&driver_list, &di->node);
+                index->state[i] = ENTRY_SKIPPED;
             }
         }
     }
-    closedir(dir);
+
+    // bind workers may already be looking for drivers
+    DM_LOCK();
+    driver_index_count++;
+    DM_UNLOCK();
+    return true;
+}
+
+static void load_drivers(const char* path, bool for_root) {
+    if (!load_driver_index(path, for_root)) {
+        load_loadable_drivers(path);
+    }
+}
+
+// Adds the driver for an entry, which must be ENTRY_LOADED. This never
+// dlopen()s anything: by now other drivers may have started threads.
+static mx_driver_t* add_index_entry(driver_index_t* index, uint32_t i) {
+    mx_driver_t* drv = index->drivers[i];
+    index->state[i] = ENTRY_ADDING;
+
+    // drops the DM lock while the driver initializes
+    if (devhost_index_driver_add(drv) < 0) {
+        drv = NULL;
+    } else {
+        xprintf("devhost: added '%s' on demand\n", index->entries[i]->libname);
+    }
+
+    index->drivers[i] = drv;
+    index->state[i] = (drv != NULL) ? ENTRY_ADDED : ENTRY_SKIPPED;
+    cnd_broadcast(&driver_index_cnd);
+    return drv;
+}
+
+// the driver for an entry, adding it if need be; NULL if it cannot be added
+static mx_driver_t* index_entry_driver(driver_index_t* index, uint32_t i, bool* loaded) {
+    *loaded = false;
+    // another bind worker is adding it: wait, so that it is not passed over
+    while (index->state[i] == ENTRY_ADDING) {
+        cnd_wait(&driver_index_cnd, &__devhost_api_lock);
+    }
+    if (index->state[i] == ENTRY_LOADED) {
+        *loaded = true;
+        return add_index_entry(index, i);
+    }
+    return index->drivers[i];
+}
+
+// index of the first entry for protocol_id, or count if there is none
+static uint32_t find_protocol(driver_index_t* index, uint32_t protocol_id) {
+    uint32_t lo = 0;
+    uint32_t hi = index->count;
+    while (lo < hi) {
+        uint32_t mid = lo + (hi - lo) / 2;
+        if (index->entries[mid]->protocol_id < protocol_id) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+// The walk takes the priority drivers of every index, then the rest. Within
+// an index, drivers for the device's protocol come before drivers for any
+// protocol, each in the order the index lists them.
+mx_driver_t* devhost_index_next_driver(mx_device_t* dev, devhost_index_iter_t* it,
+                                       bool* loaded) {
+    uint32_t protocol_id = devhost_get_prop(dev, BIND_PROTOCOL);
+    for (; it->pass < 2; it->pass++, it->index = 0) {
+        for (; it->index < driver_index_count; it->index++, it->any = 0) {
+            driver_index_t* index = &driver_indexes[it->index];
+            for (; (it->any < 2) && !(it->any && (protocol_id == 0)); it->any++, it->entry = 0) {
+                uint32_t id = it->any ? 0 : protocol_id;
+                uint32_t first = find_protocol(index, id);
+                for (; (first + it->entry < index->count) &&
+                       (index->entries[first + it->entry]->protocol_id == id); it->entry++) {
+                    uint32_t i = first + it->entry;
+                    driver_index_entry_t* entry = index->entries[i];
+                    bool priority = (entry->flags & DRIVER_INDEX_FLAG_PRIORITY) != 0;
+                    if ((priority != (it->pass == 0)) ||
+                        (index->state[i] == ENTRY_SKIPPED) ||
+                        !devhost_is_bindable_index(entry, dev)) {
+                        continue;
+                    }
+                    mx_driver_t* drv = index_entry_driver(index, i, loaded);
+                    if (drv != NULL) {
+                        it->entry++;
+                        return drv;
+                    }
+                }
+            }
+        }
+    }
+    return NULL;
+}
+
+mx_driver_t* devhost_load_driver_named(const char* name) {
+    for (uint32_t n = 0; n < driver_index_count; n++) {
+        driver_index_t* index = &driver_indexes[n];
+        for (uint32_t i = 0; i < index->count; i++) {
+            if ((index->state[i] != ENTRY_SKIPPED) && !strcmp(index->entries[i]->name, name)) {
+                bool loaded;
+                mx_driver_t* drv = index_entry_driver(index, i, &loaded);
+                if (drv != NULL) {
+                    return drv;
+                }
+            }
+        }
+    }
+    return NULL;
 }
 
 static void init_loaded_drivers(bool for_root) {
@@ -212,7 +505,7 @@ extern magenta_driver_info_t __stop_magenta_drivers[] __WEAK;
 static void init_builtin_drivers(bool for_root) {
     magenta_driver_info_t* di;
     for (di = __start_magenta_drivers; di < __stop_magenta_drivers; di++) {
-        if (is_driver_disabled(di)) continue;
+        if (is_driver_disabled(di->note->name)) continue;
         init_from_driver_info(di, for_root);
     }
 }
@@ -228,7 +521,14 @@ void devhost_init_drivers(bool as_root) {
         driver_add(&_driver_acpi_root);
     }
     init_builtin_drivers(as_root);
-    load_loadable_drivers("/system/lib/driver");
-    load_loadable_drivers("/boot/lib/driver");
+    load_drivers("/system/lib/driver", as_root);
+    load_drivers("/boot/lib/driver", as_root);
     init_loaded_drivers(as_root);
+
+    // drivers in an index are added when a device turns up that they may
+    // bind to, starting with the devices that are already waiting
+    DM_LOCK();
+    devhost_bind_unmatched();
+    devhost_init_finished();
+    DM_UNLOCK();
 }
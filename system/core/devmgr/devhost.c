@@ -7,6 +7,7 @@
 // only for devmgr_launch_devhost()
 #include "devmgr.h"
 
+#include "devcoordinator.h"
 #include "devhost.h"
 #include "driver-api.h"
 
@@ -234,7 +235,8 @@ int main(int argc, char** argv) {
 void devhost_launch_devhost(mx_device_t* parent, const char* name, uint32_t protocol_id,
                             const char* procname, int argc, char** argv) {
     mx_handle_t hdevice, hrpc;
-    if (devhost_add_internal(parent, name, protocol_id, &hdevice, &hrpc) < 0) {
+    if (devhost_add_internal(parent, name, protocol_id, DC_ADD_FLAG_DEVHOST,
+                             &hdevice, &hrpc) < 0) {
         return;
     }
 
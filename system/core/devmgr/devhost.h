@@ -13,6 +13,7 @@
 #include <mxio/dispatcher.h>
 #include <mxio/remoteio.h>
 
+#include <magenta/driver-index.h>
 #include <magenta/types.h>
 
 #include <threads.h>
@@ -41,6 +42,7 @@ mx_status_t devhost_device_add_root(mx_device_t* dev);
 mx_status_t devhost_device_remove(mx_device_t* dev);
 mx_status_t devhost_device_bind(mx_device_t* dev, const char* drv_name);
 mx_status_t devhost_device_rebind(mx_device_t* dev);
+void devhost_device_bind_complete(mx_device_t* dev, mx_status_t status);
 mx_status_t devhost_device_create(mx_device_t** dev, mx_driver_t* driver,
                                  const char* name, mx_protocol_device_t* ops);
 void devhost_device_init(mx_device_t* dev, mx_driver_t* driver,
@@ -55,6 +57,45 @@ bool devhost_is_bindable_di(magenta_driver_info_t* di, mx_device_t* dev);
 bool devhost_is_bindable(magenta_driver_info_t* di, uint32_t protocol_id,
                          mx_device_prop_t* props, uint32_t prop_count);
 
+// lookups in the driver index, for devhost-drivers.c
+uint32_t devhost_get_prop(mx_device_t* dev, uint32_t id);
+bool devhost_is_bindable_index(const driver_index_entry_t* entry, mx_device_t* dev);
+
+// Adds a driver from the driver index once a device may bind to it. Unlike drivers added
+// with devhost_driver_add(), devices are probed with it in index order.
+mx_status_t devhost_index_driver_add(mx_driver_t* driver);
+
+// A walk through the drivers in the driver index that may bind to a device,
+// in priority order. Zero it to start.
+typedef struct {
+    uint32_t pass;
+    uint32_t index;
+    uint32_t any;
+    uint32_t entry;
+} devhost_index_iter_t;
+
+// Returns the next driver in the walk, adding it with
+// devhost_index_driver_add() if it has not been added yet (and then setting
+// *loaded), or NULL at the end.
+// Called with the DM lock held.
+mx_driver_t* devhost_index_next_driver(mx_device_t* dev, devhost_index_iter_t* it,
+                                       bool* loaded);
+
+// Returns the driver in the driver index with this name, adding it if need
+// be, or NULL if there is none.
+// Called with the DM lock held.
+mx_driver_t* devhost_load_driver_named(const char* name);
+
+// Binds unmatched devices to drivers from the driver index.
+// Called with the DM lock held.
+void devhost_bind_unmatched(void);
+
+// Devices are probed by a pool of bind workers. The devhost counts as busy
+// binding from startup until devhost_init_drivers() calls this, and while
+// any probe is queued or running or any bind() is pending.
+// Called with the DM lock held.
+void devhost_init_finished(void);
+
 mx_status_t devhost_load_firmware(mx_driver_t* drv, const char* path,
                                   mx_handle_t* fw, size_t* size);
 
@@ -73,9 +114,10 @@ mx_status_t devhost_rio_handler(mxrio_msg_t* msg, mx_handle_t rh, void* cookie);
 mx_status_t devhost_add(mx_device_t* dev, mx_device_t* child);
 mx_status_t devhost_remove(mx_device_t* dev);
 mx_status_t devhost_add_internal(mx_device_t* parent,
-                                 const char* name, uint32_t protocol_id,
+                                 const char* name, uint32_t protocol_id, uint32_t flags,
                                  mx_handle_t* _hdevice, mx_handle_t* _hrpc);
 mx_status_t devhost_connect(mx_device_t* dev, mx_handle_t hdevice, mx_handle_t hrpc);
+void devhost_report_binding(mx_device_t* root, bool binding);
 
 extern mxio_dispatcher_t* devhost_rio_dispatcher;
 
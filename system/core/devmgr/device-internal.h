@@ -12,6 +12,8 @@
 #define DEV_FLAG_BUSY           0x00000010  // device being created
 #define DEV_FLAG_INSTANCE       0x00000020  // this device was created-on-open
 #define DEV_FLAG_REBIND         0x00000040  // this device is being rebound
+#define DEV_FLAG_BIND_QUEUED    0x00000080  // waiting for a bind worker
+#define DEV_FLAG_BIND_PENDING   0x00000100  // owner's bind() returned DRV_BIND_PENDING
 
 #define DEV_MAGIC 'MDEV'
 
@@ -11,6 +11,7 @@
 #include <ddk/device.h>
 #include <ddk/driver.h>
 
+#include <magenta/device/devmgr.h>
 #include <magenta/syscalls.h>
 #include <magenta/types.h>
 #include <magenta/processargs.h>
@@ -45,9 +46,38 @@ typedef struct device_ctx {
     mx_handle_t hdevice;
     uint32_t protocol_id;
     vnode_t* vnode;
+    // for the root device of a devhost: the devhost is binding devices
+    bool binding;
     char name[MX_DEVICE_NAME_MAX];
 } device_ctx_t;
 
+// Devhosts that are binding devices, and an event that is signaled with
+// DEVMGR_SIGNAL_SETTLED while there are none. Once devfs has settled, every
+// device that is going to turn up without new hardware arriving has been
+// published, so a path that is still missing is not coming.
+static uint32_t devhosts_binding;
+static mx_handle_t settled_event;
+
+static void set_binding(device_ctx_t* ctx, bool binding) {
+    if (ctx->binding == binding) {
+        return;
+    }
+    ctx->binding = binding;
+    if (binding) {
+        if (devhosts_binding++ == 0) {
+            mx_object_signal(settled_event, DEVMGR_SIGNAL_SETTLED, 0);
+        }
+    } else {
+        if (--devhosts_binding == 0) {
+            mx_object_signal(settled_event, 0, DEVMGR_SIGNAL_SETTLED);
+        }
+    }
+}
+
+mx_status_t devmgr_get_settled_event(mx_handle_t* out) {
+    return mx_handle_duplicate(settled_event, MX_RIGHT_READ | MX_RIGHT_TRANSFER, out);
+}
+
 
 #define PNMAX 16
 static const char* proto_name(uint32_t id, char buf[PNMAX]) {
@@ -148,7 +178,7 @@ static mx_status_t do_remote_create(const char* name, uint32_t protocol_id, devi
 }
 
 static mx_status_t do_remote_add(device_ctx_t* parent, const char* name, uint32_t protocol_id,
-                                 mx_handle_t hdevice, mx_handle_t hrpc) {
+                                 uint32_t flags, mx_handle_t hdevice, mx_handle_t hrpc) {
 
     size_t len = strlen(name);
     if (len >= MX_DEVICE_NAME_MAX) {
@@ -172,12 +202,16 @@ static mx_status_t do_remote_add(device_ctx_t* parent, const char* name, uint32_
         return status;
     }
 
+    // the new devhost reports when it has finished binding
+    set_binding(ctx, flags & DC_ADD_FLAG_DEVHOST);
+
     do_publish(parent, ctx);
     return NO_ERROR;
 }
 
 static mx_status_t do_remote_remove(device_ctx_t* dev, bool clean) {
     //printf("devmgr: del ctx %p(%s) %s\n", dev, dev->name, clean ? "" : "unexpected!");
+    set_binding(dev, false);
     devfs_remove(dev->vnode);
     mx_handle_close(dev->hdevice);
     dev->vnode = NULL;
@@ -214,7 +248,7 @@ static mx_status_t coordinator_handler(mx_handle_t h, void* cb, void* cookie) {
         if (hcount != 2) {
             goto fail;
         }
-        do_remote_add(dev, msg.name, msg.protocol_id, handles[0], handles[1]);
+        do_remote_add(dev, msg.name, msg.protocol_id, msg.arg, handles[0], handles[1]);
         return NO_ERROR;
     case DC_OP_REMOVE:
         if (hcount != 0) {
@@ -223,6 +257,12 @@ static mx_status_t coordinator_handler(mx_handle_t h, void* cb, void* cookie) {
         do_remote_remove(dev, true);
         // positive return indicates clean shutdown
         return 1;
+    case DC_OP_BIND_STATE:
+        if (hcount != 0) {
+            goto fail;
+        }
+        set_binding(dev, msg.arg != 0);
+        return NO_ERROR;
     case DC_OP_SHUTDOWN:
         devmgr_vfs_exit();
         mx_handle_close(h);
@@ -251,6 +291,11 @@ void devmgr_init(mx_handle_t root_job) {
         printf("unable to create devhost job\n");
     }
 
+    // nothing is binding yet, but the root devhost will be shortly
+    if (mx_event_create(0, &settled_event) < 0) {
+        printf("devmgr: cannot create settled event\n");
+    }
+
     mxio_dispatcher_create(&coordinator_dispatcher, coordinator_handler);
 }
 
@@ -263,6 +308,7 @@ void devmgr_handle_messages(void) {
         return;
     }
     root->vnode = vnroot;
+    set_binding(root, true);
     const char* args[2] = { "/boot/bin/devhost", "root" };
     devmgr_launch_devhost(devhost_job_handle, "devhost:root", 2, (char**)args, hdevice, hrpc);
 
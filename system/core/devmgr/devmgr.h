@@ -21,6 +21,7 @@ void devmgr_launch_devhost(mx_handle_t job,
                            const char* name, int argc, char** argv,
                            mx_handle_t hdevice, mx_handle_t hrpc);
 ssize_t devmgr_add_systemfs_vmo(mx_handle_t vmo);
+mx_status_t devmgr_get_settled_event(mx_handle_t* out);
 bool secondary_bootfs_ready(void);
 int devmgr_start_system_init(void* arg);
 
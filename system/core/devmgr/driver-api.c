@@ -56,6 +56,10 @@ __EXPORT void device_set_bindable(mx_device_t* dev, bool bindable) {
     return API->device_set_bindable(dev, bindable);
 }
 
+__EXPORT void device_bind_complete(mx_device_t* dev, mx_status_t status) {
+    API->device_bind_complete(dev, status);
+}
+
 
 __EXPORT mx_handle_t get_root_resource(void) {
     return API->get_root_resource();
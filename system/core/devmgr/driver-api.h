@@ -22,6 +22,7 @@ typedef struct driver_api {
     mx_status_t (*device_remove)(mx_device_t* dev);
     mx_status_t (*device_rebind)(mx_device_t* dev);
     void (*device_set_bindable)(mx_device_t* dev, bool bindable);
+    void (*device_bind_complete)(mx_device_t* dev, mx_status_t status);
 
     mx_handle_t (*get_root_resource)(void);
     mx_status_t (*load_firmware)(mx_driver_t* drv, const char* path,
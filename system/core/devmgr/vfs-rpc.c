@@ -62,6 +62,16 @@ ssize_t vfs_do_local_ioctl(vnode_t* vn, uint32_t op, const void* in_buf,
         }
         const mx_handle_t* vmo = in_buf;
         return devmgr_add_systemfs_vmo(*vmo);
+    case IOCTL_DEVMGR_GET_SETTLED_EVENT: {
+        if ((in_len != 0) || (out_len != sizeof(mx_handle_t))) {
+            return ERR_INVALID_ARGS;
+        }
+        mx_status_t status = devmgr_get_settled_event((mx_handle_t*)out_buf);
+        if (status < 0) {
+            return status;
+        }
+        return sizeof(mx_handle_t);
+    }
     default:
         return vn->ops->ioctl(vn, op, in_buf, in_len, out_buf, out_len);
     }
@@ -10,6 +10,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <unistd.h>
+#include <sys/param.h>
 #include <sys/stat.h>
 
 #include <inet6/inet6.h>
@@ -52,6 +53,19 @@ static int netfile_mkdir(const char* filename) {
     }
 }
 
+// block size for windowed transfers: as large as a frame on this link
+// will carry
+static uint32_t netfile_blocksize(void) {
+    uint8_t mac[6];
+    uint16_t mtu;
+    netifc_get_info(mac, &mtu);
+    if (mtu < IP6_MIN_MTU) {
+        mtu = IP6_MIN_MTU;
+    }
+    size_t size = MIN(mtu, ETH_MTU) - ETH_HDR_LEN - IP6_HDR_LEN - UDP_HDR_LEN - sizeof(nbmsg) - 1;
+    return MIN(size, NETFILE_BLOCK_MAX);
+}
+
 void netfile_open(const char *filename, uint32_t cookie, uint32_t arg,
                   const ip6_addr_t* saddr, uint16_t sport, uint16_t dport) {
     nbmsg m;
@@ -69,6 +83,9 @@ void netfile_open(const char *filename, uint32_t cookie, uint32_t arg,
     strlcpy(netfile.filename, filename, sizeof(netfile.filename));
     netfile.blocknum = 0;
     netfile.cookie = cookie;
+    netfile.windowed = (arg & NB_OPEN_WINDOW) != 0;
+    netfile.window_map = 0;
+    arg &= ~NB_OPEN_WINDOW;
 
     struct stat st;
 again: // label here to catch filename=/path/to/new/directory/
@@ -92,7 +109,7 @@ again: // label here to catch filename=/path/to/new/directory/
         }
         strcat(netfile.filename, TMP_SUFFIX);
         netfile.needs_rename = true;
-        netfile.fd = open(netfile.filename, O_WRONLY|O_CREAT|O_TRUNC);
+        netfile.fd = open(netfile.filename, O_WRONLY|O_CREAT|O_TRUNC, 0664);
         netfile.filename[len] = '\0';
         if (netfile.fd < 0 && errno == ENOENT) {
             if (netfile_mkdir(filename) == 0) {
@@ -110,6 +127,10 @@ again: // label here to catch filename=/path/to/new/directory/
     } else {
         strlcpy(netfile.filename, filename, sizeof(netfile.filename));
     }
+    if (netfile.windowed) {
+        netfile.blocksize = netfile_blocksize();
+        m.arg = netfile.blocksize;
+    }
 
     udp6_send(&m, sizeof(m), saddr, sport, dport);
     return;
@@ -119,6 +140,26 @@ err:
     udp6_send(&m, sizeof(m), saddr, sport, dport);
 }
 
+// windowed reads are served out of order, as requested
+static void netfile_window_read(uint32_t cookie, uint32_t arg,
+                                const ip6_addr_t* saddr, uint16_t sport, uint16_t dport) {
+    netfilewmsg m;
+    m.hdr.magic = NB_MAGIC;
+    m.hdr.cookie = cookie;
+    m.hdr.cmd = NB_ACK;
+
+    ssize_t n = pread(netfile.fd, m.data, netfile.blocksize,
+                      (off_t)arg * netfile.blocksize);
+    if (n < 0) {
+        printf("netsvc: error reading '%s': %d\n", netfile.filename, errno);
+        m.hdr.arg = -errno;
+        udp6_send(&m.hdr, sizeof(m.hdr), saddr, sport, dport);
+        return;
+    }
+    m.hdr.arg = arg;
+    udp6_send(&m, sizeof(m.hdr) + n, saddr, sport, dport);
+}
+
 void netfile_read(uint32_t cookie, uint32_t arg,
                   const ip6_addr_t* saddr, uint16_t sport, uint16_t dport) {
     netfilemsg m;
@@ -132,6 +173,10 @@ void netfile_read(uint32_t cookie, uint32_t arg,
         udp6_send(&m.hdr, sizeof(m.hdr), saddr, sport, dport);
         return;
     }
+    if (netfile.windowed) {
+        netfile_window_read(cookie, arg, saddr, sport, dport);
+        return;
+    }
     if (arg == (netfile.blocknum - 1)) {
         // repeat of last block read, probably due to dropped packet
         // unless cookie doesn't match, in which case it's an error
@@ -164,6 +209,54 @@ void netfile_read(uint32_t cookie, uint32_t arg,
     udp6_send(&m, sizeof(m.hdr) + netfile.datasize, saddr, sport, dport);
 }
 
+// windowed writes: blocks arriving ahead of the next one needed are held
+// until the gap fills; every block is acked with what is held so far,
+// which lets the host resend only what went missing
+static void netfile_window_write(const char* data, size_t len, uint32_t cookie, uint32_t arg,
+                                 const ip6_addr_t* saddr, uint16_t sport, uint16_t dport) {
+    netfileack m;
+    m.hdr.magic = NB_MAGIC;
+    m.hdr.cookie = cookie;
+    m.hdr.cmd = NB_ACK;
+
+    // blocks behind the window are duplicates; those are only acked
+    uint32_t n = arg - netfile.blocknum;
+    if ((len <= netfile.blocksize) && (n > 0) && (n < NB_WINDOW_BLOCKS)) {
+        uint32_t slot = arg % NB_WINDOW_BLOCKS;
+        memcpy(netfile.window[slot], data, len);
+        netfile.window_len[slot] = len;
+        netfile.window_map |= 1u << n;
+    } else if ((len <= netfile.blocksize) && (n == 0)) {
+        // write this block and any held behind it
+        for (;;) {
+            ssize_t r = write(netfile.fd, data, len);
+            if (r != (ssize_t)len) {
+                printf("netsvc: error writing %s: %d\n", netfile.filename, errno);
+                m.hdr.arg = -errno;
+                if (m.hdr.arg == 0) {
+                    m.hdr.arg = -EIO;
+                }
+                close(netfile.fd);
+                netfile.fd = -1;
+                udp6_send(&m.hdr, sizeof(m.hdr), saddr, sport, dport);
+                return;
+            }
+            netfile.blocknum++;
+            netfile.window_map >>= 1;
+            if (!(netfile.window_map & 1)) {
+                break;
+            }
+            uint32_t slot = netfile.blocknum % NB_WINDOW_BLOCKS;
+            data = (const char*)netfile.window[slot];
+            len = netfile.window_len[slot];
+        }
+    }
+
+    m.hdr.arg = netfile.blocknum;
+    m.map = netfile.window_map;
+    udp6_send(&m, sizeof(m), saddr, sport, dport);
+}
+
 void netfile_write(const char* data, size_t len, uint32_t cookie, uint32_t arg,
                    const ip6_addr_t* saddr, uint16_t sport, uint16_t dport) {
     nbmsg m;
@@ -178,6 +271,10 @@ void netfile_write(const char* data, size_t len, uint32_t cookie, uint32_t arg,
         udp6_send(&m, sizeof(m), saddr, sport, dport);
         return;
     }
+    if (netfile.windowed) {
+        netfile_window_write(data, len, cookie, arg, saddr, sport, dport);
+        return;
+    }
 
     if (arg == (netfile.blocknum - 1)) {
         // repeat of last block write, probably due to dropped packet
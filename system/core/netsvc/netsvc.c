@@ -30,22 +30,35 @@
 
 static mx_handle_t loghandle;
 
+// records read from the log, and those left to format
+static char logbuf[MX_LOG_RECORD_MAX * 8] __ALIGNED(MX_LOG_RECORD_ALIGN);
+static size_t logbuf_off;
+static size_t logbuf_len;
+
 int get_log_line(char* out) {
-    char buf[MX_LOG_RECORD_MAX + 1];
-    mx_log_record_t* rec = (mx_log_record_t*)buf;
-    if (mx_log_read(loghandle, MX_LOG_RECORD_MAX, rec, 0) > 0) {
-        if (rec->datalen && (rec->data[rec->datalen - 1] == '\n')) {
-            rec->datalen--;
+    if (logbuf_off >= logbuf_len) {
+        mx_status_t r = mx_log_read(loghandle, sizeof(logbuf), logbuf, MX_LOG_FLAG_BATCH);
+        logbuf_off = 0;
+        logbuf_len = (r > 0) ? (size_t)r : 0;
+        if (logbuf_len == 0) {
+            return 0;
         }
-        rec->data[rec->datalen] = 0;
-        snprintf(out, MAX_LOG_LINE, "[%05d.%03d] %05" PRIu64 ".%05" PRIu64 "> %s\n",
-                 (int)(rec->timestamp / 1000000000ULL),
-                 (int)((rec->timestamp / 1000000ULL) % 1000ULL),
-                 rec->pid, rec->tid, rec->data);
-        return strlen(out);
-    } else {
-        return 0;
     }
+    mx_log_record_t* rec = (mx_log_record_t*)(logbuf + logbuf_off);
+    logbuf_off += MX_LOG_RECORD_SIZE(rec);
+
+    char data[MX_LOG_RECORD_MAX];
+    size_t datalen = rec->datalen;
+    if (datalen && (rec->data[datalen - 1] == '\n')) {
+        datalen--;
+    }
+    memcpy(data, rec->data, datalen);
+    data[datalen] = 0;
+    snprintf(out, MAX_LOG_LINE, "[%05d.%03d] %05" PRIu64 ".%05" PRIu64 "> %s\n",
+             (int)(rec->timestamp / 1000000000ULL),
+             (int)((rec->timestamp / 1000000ULL) % 1000ULL),
+             rec->pid, rec->tid, data);
+    return strlen(out);
 }
 
 #define MAX_LOG_DATA 1280
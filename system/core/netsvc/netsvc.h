@@ -11,6 +11,11 @@
 
 #include <magenta/netboot.h>
 
+// largest windowed block which fits a single (non-jumbo) frame, leaving
+// room for the NUL the host appends to NB_WRITE
+#define NETFILE_BLOCK_MAX \
+    (ETH_MTU - ETH_HDR_LEN - IP6_HDR_LEN - UDP_HDR_LEN - sizeof(nbmsg) - 1)
+
 typedef struct netfile_state_t {
     int      fd;
     // false: Filename is the open file and final destination
@@ -21,6 +26,14 @@ typedef struct netfile_state_t {
     uint32_t cookie;
     uint8_t  data[1024];
     size_t   datasize;
+    // windowed transfers (NB_OPEN_WINDOW): blocks written ahead of
+    // blocknum are held until it arrives; bit n of window_map is set
+    // while block blocknum + n is held
+    bool     windowed;
+    uint32_t blocksize;
+    uint32_t window_map;
+    uint32_t window_len[NB_WINDOW_BLOCKS];
+    uint8_t  window[NB_WINDOW_BLOCKS][NETFILE_BLOCK_MAX];
 } netfile_state;
 
 extern netfile_state netfile;
@@ -30,6 +43,16 @@ typedef struct netfilemsg_t {
     uint8_t data[1024];
 } netfilemsg;
 
+typedef struct netfilewmsg_t {
+    nbmsg   hdr;
+    uint8_t data[NETFILE_BLOCK_MAX];
+} netfilewmsg;
+
+typedef struct netfileack_t {
+    nbmsg    hdr;
+    uint32_t map;
+} netfileack;
+
 void netfile_open(const char* filename, uint32_t cookie, uint32_t arg,
                 const ip6_addr_t* saddr, uint16_t sport, uint16_t dport);
 
@@ -5,6 +5,7 @@
 #pragma once
 
 #include <limits.h>
+#include <stdint.h>
 #include <magenta/device/ioctl.h>
 #include <magenta/device/ioctl-wrapper.h>
 
@@ -20,6 +21,28 @@
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_BLOCK, 5)
 #define IOCTL_BLOCK_RR_PART \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_BLOCK, 6)
+#define IOCTL_BLOCK_GET_STATS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_BLOCK, 7)
+
+// Number of buckets in a block_stats_t latency histogram.  Bucket n counts
+// requests which completed in [2^n, 2^(n+1)) microseconds after they were
+// queued; the first bucket also counts anything faster and the last anything
+// slower.
+#define BLOCK_LATENCY_BUCKETS 24
+
+// Per-device I/O statistics, accumulated since the device was bound
+typedef struct block_stats {
+    uint64_t reads;             // read requests completed
+    uint64_t writes;            // write requests completed
+    uint64_t bytes_read;
+    uint64_t bytes_written;
+    uint64_t dispatched;        // requests issued to the underlying device
+    uint64_t merged;            // requests which were merged into a neighbor
+    uint64_t expired;           // requests dispatched because their deadline passed
+    uint64_t throttled;         // requests held back by the per-client queue limit
+    uint64_t read_latency[BLOCK_LATENCY_BUCKETS];
+    uint64_t write_latency[BLOCK_LATENCY_BUCKETS];
+} block_stats_t;
 
 // ssize_t ioctl_block_get_size(int fd, uint64_t* out);
 IOCTL_WRAPPER_OUT(ioctl_block_get_size, IOCTL_BLOCK_GET_SIZE, uint64_t);
@@ -38,3 +61,6 @@ IOCTL_WRAPPER_VAROUT(ioctl_block_get_name, IOCTL_BLOCK_GET_NAME, char);
 
 // ssize_t ioctl_block_rr_part(int fd);
 IOCTL_WRAPPER(ioctl_block_rr_part, IOCTL_BLOCK_RR_PART);
+
+// ssize_t ioctl_block_get_stats(int fd, block_stats_t* out);
+IOCTL_WRAPPER_OUT(ioctl_block_get_stats, IOCTL_BLOCK_GET_STATS, block_stats_t);
@@ -19,6 +19,13 @@
 // Add a bootfs vmo to the system fs.
 #define IOCTL_DEVMGR_MOUNT_BOOTFS_VMO \
     IOCTL(IOCTL_KIND_SET_HANDLE, IOCTL_FAMILY_DEVMGR, 3)
+// Get an event that is signaled with DEVMGR_SIGNAL_SETTLED while no devhost
+// is binding devices. A device path that is missing once devfs has settled
+// will not appear until new hardware does. Works on /dev and its directories.
+#define IOCTL_DEVMGR_GET_SETTLED_EVENT \
+    IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_DEVMGR, 4)
+
+#define DEVMGR_SIGNAL_SETTLED MX_USER_SIGNAL_0
 
 // ssize_t ioctl_devmgr_mount_fs(int fd, mx_handle_t* in);
 IOCTL_WRAPPER_IN(ioctl_devmgr_mount_fs, IOCTL_DEVMGR_MOUNT_FS, mx_handle_t);
@@ -31,3 +38,6 @@ IOCTL_WRAPPER_OUT(ioctl_devmgr_unmount_node, IOCTL_DEVMGR_UNMOUNT_NODE, mx_handl
 
 // ssize_t ioctl_devmgr_mount_bootfs_vmo(int fd, mx_handle_t* in);
 IOCTL_WRAPPER_IN(ioctl_devmgr_mount_bootfs_vmo, IOCTL_DEVMGR_MOUNT_BOOTFS_VMO, mx_handle_t);
+
+// ssize_t ioctl_devmgr_get_settled_event(int fd, mx_handle_t* out);
+IOCTL_WRAPPER_OUT(ioctl_devmgr_get_settled_event, IOCTL_DEVMGR_GET_SETTLED_EVENT, mx_handle_t);
@@ -60,6 +60,53 @@ typedef struct eth_fifos_t {
 #define IOCTL_ETHERNET_TX_LISTEN_STOP \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 6)
 
+// Set the rx coalescing latency bound, in microseconds
+// Received packets may be held for up to this long so that they are
+// returned through the rx fifo together.  Zero (the default) returns
+// each burst from the ethermac as soon as it has been copied.
+//   in: uint32_t
+//  out: none
+#define IOCTL_ETHERNET_SET_RX_COALESCE \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 7)
+
+// Get the ethernet device's traffic counters
+// These are totals for the device, across all clients.
+//   in: none
+//  out: eth_stats_t*
+#define IOCTL_ETHERNET_GET_STATS \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 8)
+
+typedef struct eth_stats_t {
+    uint64_t rx_packets;
+    uint64_t rx_bytes;
+    // received packets lost for want of a buffer, in the
+    // ethermac's ring or in a client's rx fifo
+    uint64_t rx_dropped;
+    uint64_t tx_packets;
+    uint64_t tx_bytes;
+    uint64_t tx_dropped;
+    // interrupts taken, and passes made polling the ethermac
+    // instead while under load
+    uint64_t irqs;
+    uint64_t polls;
+    uint64_t reserved[8];
+} eth_stats_t;
+
+// Set the ethermac's interrupt moderation
+// ERR_NOT_SUPPORTED if the ethermac has no such controls.
+//   in: eth_moderation_t*
+//  out: none
+#define IOCTL_ETHERNET_SET_MODERATION \
+    IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_ETH, 9)
+
+typedef struct eth_moderation_t {
+    // minimum interval between interrupts, in microseconds (0 = none)
+    uint32_t irq_usec;
+    // packets handled per interrupt before the driver stops taking
+    // interrupts and polls until the load falls off (0 = never poll)
+    uint32_t poll_budget;
+} eth_moderation_t;
+
 
 // Operation
 //
@@ -90,6 +137,7 @@ typedef struct eth_fifos_t {
 #define ETH_FIFO_TX_OK   (1u)   // packet transmitted okay
 #define ETH_FIFO_INVALID (2u)   // offset+length not within io_vmo bounds
 #define ETH_FIFO_RX_TX   (4u)   // received our own tx packet (when TX_LISTEN)
+#define ETH_FIFO_RX_CSUM (8u)   // tcp/udp checksum already verified by the device
 
 typedef struct eth_fifo_entry {
     // offset from start of io_vmo to packet data
@@ -121,4 +169,13 @@ IOCTL_WRAPPER(ioctl_ethernet_stop, IOCTL_ETHERNET_STOP);
 IOCTL_WRAPPER(ioctl_ethernet_tx_listen_start, IOCTL_ETHERNET_TX_LISTEN_START);
 
 // ssize_t ioctl_ethernet_tx_listen_stop(int fd);
-IOCTL_WRAPPER(ioctl_ethernet_tx_listen_stop, IOCTL_ETHERNET_TX_LISTEN_STOP);
\ No newline at end of file
+IOCTL_WRAPPER(ioctl_ethernet_tx_listen_stop, IOCTL_ETHERNET_TX_LISTEN_STOP);
+
+// ssize_t ioctl_ethernet_set_rx_coalesce(int fd, const uint32_t* usec);
+IOCTL_WRAPPER_IN(ioctl_ethernet_set_rx_coalesce, IOCTL_ETHERNET_SET_RX_COALESCE, uint32_t);
+
+// ssize_t ioctl_ethernet_get_stats(int fd, eth_stats_t* out);
+IOCTL_WRAPPER_OUT(ioctl_ethernet_get_stats, IOCTL_ETHERNET_GET_STATS, eth_stats_t);
+
+// ssize_t ioctl_ethernet_set_moderation(int fd, const eth_moderation_t* in);
+IOCTL_WRAPPER_IN(ioctl_ethernet_set_moderation, IOCTL_ETHERNET_SET_MODERATION, eth_moderation_t);
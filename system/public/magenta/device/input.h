@@ -5,8 +5,10 @@
 #pragma once
 
 #include <stdint.h>
+#include <sys/types.h>
 #include <magenta/device/ioctl.h>
 #include <magenta/device/ioctl-wrapper.h>
+#include <magenta/types.h>
 
 #define IOCTL_INPUT_GET_PROTOCOL \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_INPUT, 0)
@@ -27,6 +29,14 @@
 #define IOCTL_INPUT_SET_REPORT \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_INPUT, 8)
 
+// Get a ring of input reports in shared memory, so that a reader can take
+// every report that arrived while it slept in one wakeup. Once an instance
+// has a ring, new reports go to it instead of to read().
+//   in: none
+//  out: input_report_ring_t
+#define IOCTL_INPUT_GET_REPORT_RING \
+    IOCTL(IOCTL_KIND_GET_TWO_HANDLES, IOCTL_FAMILY_INPUT, 9)
+
 enum {
     INPUT_PROTO_NONE = 0,
     INPUT_PROTO_KBD = 1,
@@ -73,6 +83,59 @@ typedef struct boot_mouse_report {
 
 extern const boot_kbd_report_t report_err_rollover;
 
+typedef struct input_report_ring {
+    // an input_ring_t, to be mapped read/write
+    mx_handle_t vmo;
+    // signalled with INPUT_RING_SIGNAL_READABLE when a report is added to a
+    // ring the reader had emptied, and INPUT_RING_SIGNAL_CLOSED when the
+    // device goes away
+    mx_handle_t event;
+    // bytes to map
+    uint32_t size;
+} input_report_ring_t;
+
+#define INPUT_RING_SIGNAL_READABLE MX_USER_SIGNAL_0
+#define INPUT_RING_SIGNAL_CLOSED   MX_USER_SIGNAL_1
+
+// Each report in the ring is a 16 bit little endian length followed by the
+// bytes read() would have returned, wrapping at the end of data. head and
+// tail are free running byte counts. The driver owns head and dropped, and
+// the reader owns tail.
+typedef struct input_ring {
+    uint32_t head;
+    uint32_t tail;
+    uint32_t data_size;     // a power of two
+    uint32_t dropped;       // reports lost because the ring was full
+    uint8_t data[];
+} input_ring_t;
+
+// Returns true if the ring holds a report.
+static inline bool input_ring_pending(input_ring_t* ring) {
+    return __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST) != ring->tail;
+}
+
+// Takes the next report from the ring. Returns its length, 0 if the ring is
+// empty, or ERR_BUFFER_TOO_SMALL, leaving the report in place, if it doesn't
+// fit in len bytes.
+static inline ssize_t input_ring_read(input_ring_t* ring, void* buf, size_t len) {
+    uint32_t tail = ring->tail;
+    uint32_t head = __atomic_load_n(&ring->head, __ATOMIC_SEQ_CST);
+    if (head == tail) {
+        return 0;
+    }
+    uint32_t mask = ring->data_size - 1;
+    size_t size = ring->data[tail & mask] | (ring->data[(tail + 1) & mask] << 8);
+    if (size > len) {
+        return ERR_BUFFER_TOO_SMALL;
+    }
+    uint8_t* out = (uint8_t*)buf;
+    for (size_t i = 0; i < size; i++) {
+        out[i] = ring->data[(tail + 2 + i) & mask];
+    }
+    __atomic_store_n(&ring->tail, tail + 2 + (uint32_t)size, __ATOMIC_SEQ_CST);
+    return size;
+}
+
 // ssize_t ioctl_input_get_protocol(int fd, int* out);
 IOCTL_WRAPPER_OUT(ioctl_input_get_protocol, IOCTL_INPUT_GET_PROTOCOL, int);
 
@@ -103,3 +166,6 @@ IOCTL_WRAPPER_IN_VAROUT(ioctl_input_get_report, IOCTL_INPUT_GET_REPORT,
 
 // ssize_t ioctl_input_set_report(int fd, const input_set_report_t* in, size_t in_len);
 IOCTL_WRAPPER_VARIN(ioctl_input_set_report, IOCTL_INPUT_SET_REPORT, input_set_report_t);
+
+// ssize_t ioctl_input_get_report_ring(int fd, input_report_ring_t* out);
+IOCTL_WRAPPER_OUT(ioctl_input_get_report_ring, IOCTL_INPUT_GET_REPORT_RING, input_report_ring_t);
@@ -22,7 +22,13 @@
 #define IOCTL_KTRACE_ADD_PROBE \
     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_KTRACE, 2)
 
+// return a read-only VMO of the trace buffer, for reading it in place
+// (see ktrace_buffer_header_t)
+#define IOCTL_KTRACE_GET_BUFFER \
+    IOCTL(IOCTL_KIND_GET_HANDLE, IOCTL_FAMILY_KTRACE, 3)
+
 IOCTL_WRAPPER_OUT(ioctl_ktrace_get_handle, IOCTL_KTRACE_GET_HANDLE, mx_handle_t);
+IOCTL_WRAPPER_OUT(ioctl_ktrace_get_buffer, IOCTL_KTRACE_GET_BUFFER, mx_handle_t);
 
 static inline mx_status_t ioctl_ktrace_add_probe(int fd, const char* name, uint32_t* probe_id) {
     return mxio_ioctl(fd, IOCTL_KTRACE_ADD_PROBE,
@@ -86,6 +86,37 @@ __BEGIN_CDECLS
 // call with in_len = sizeof(int)
 #define IOCTL_USB_SET_CONFIGURATION     IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_USB, 13)
 
+// allocates streams on a SuperSpeed bulk endpoint of the current alternate setting
+// called with in_buf pointing to an array of two ints,
+// the first being the endpoint address and the second the number of streams wanted.
+// returns the number of streams allocated, numbered from 1, which may be fewer
+// than asked for; a count of zero frees them again
+#define IOCTL_USB_ENABLE_STREAMS        IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_USB, 14)
+
+// cancels everything queued on an endpoint and clears a halt on the host side
+// called with in_buf pointing to an int holding the endpoint address
+#define IOCTL_USB_RESET_ENDPOINT        IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_USB, 15)
+
+// the following are made on a host controller's usb-hci device
+
+// sets the controller's interrupt moderation: the minimum interval between
+// interrupts, in microseconds, or 0 for an interrupt per event
+// called with in_buf pointing to a uint32_t
+#define IOCTL_USB_HCI_SET_IRQ_INTERVAL  IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_USB, 16)
+
+// returns the controller's interrupt statistics
+// call with out_len = sizeof(usb_hci_stats_t)
+#define IOCTL_USB_HCI_GET_STATS         IOCTL(IOCTL_KIND_DEFAULT, IOCTL_FAMILY_USB, 17)
+
+typedef struct usb_hci_stats {
+    // interrupts taken, and the events handled in them
+    uint64_t irqs;
+    uint64_t events;
+    // the interrupt moderation interval in use, in microseconds
+    uint32_t irq_usec;
+    uint32_t reserved;
+} usb_hci_stats_t;
+
 IOCTL_WRAPPER_OUT(ioctl_usb_get_device_type, IOCTL_USB_GET_DEVICE_TYPE, int);
 IOCTL_WRAPPER_OUT(ioctl_usb_get_device_speed, IOCTL_USB_GET_DEVICE_SPEED, int);
 IOCTL_WRAPPER_OUT(ioctl_usb_get_device_desc, IOCTL_USB_GET_DEVICE_DESC, usb_device_descriptor_t);
@@ -104,5 +135,7 @@ IOCTL_WRAPPER_OUT(ioctl_usb_get_device_id, IOCTL_USB_GET_DEVICE_ID, uint64_t);
 IOCTL_WRAPPER_OUT(ioctl_usb_get_device_hub_id, IOCTL_USB_GET_DEVICE_HUB_ID, uint64_t);
 IOCTL_WRAPPER_OUT(ioctl_usb_get_configuration, IOCTL_USB_GET_CONFIGURATION, int);
 IOCTL_WRAPPER_IN(ioctl_usb_set_configuration, IOCTL_USB_SET_CONFIGURATION, int);
+IOCTL_WRAPPER_IN(ioctl_usb_hci_set_irq_interval, IOCTL_USB_HCI_SET_IRQ_INTERVAL, uint32_t);
+IOCTL_WRAPPER_OUT(ioctl_usb_hci_get_stats, IOCTL_USB_HCI_GET_STATS, usb_hci_stats_t);
 
 __END_CDECLS
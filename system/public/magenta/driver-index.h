@@ -0,0 +1,55 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <magenta/compiler.h>
+#include <stdint.h>
+
+// "DRVINDEX" in ASCII (little-endian)
+#define DRIVER_INDEX_MAGIC 0x5845444e49565244ULL
+#define DRIVER_INDEX_VERSION 1
+
+__BEGIN_CDECLS;
+
+// A driver index describes the driver libraries in a directory and their
+// binding programs, so that a devhost can find the drivers that may bind to a
+// device without loading every library. The build writes one next to each
+// driver directory: lib/driver.index for lib/driver.
+//
+// The file is a driver_index_header_t followed by count entries. Each entry is
+// a driver_index_entry_t followed by bindcount binding instructions
+// ({ op, arg } pairs of uint32_t). Entries are sorted by protocol_id, so that
+// the drivers for one protocol are adjacent. All fields are little-endian.
+// Any change to the layout must change the version as well.
+typedef struct {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t count;
+} driver_index_header_t;
+
+// the driver's version string starts with "!": try it before other drivers
+#define DRIVER_INDEX_FLAG_PRIORITY (1u << 0)
+
+typedef struct {
+    // path that dlopen() resolves, relative to lib/ (eg "driver/foo.so")
+    char libname[64];
+    // name from the driver's note
+    char name[32];
+    uint32_t flags;
+
+    // Requirements every matching device meets, taken from the unconditional
+    // ABORT_IF(NE, ...) instructions at the start of the binding program.
+    // protocol_id is 0 if the program does not fix the protocol, and key_id is
+    // 0 (BIND_FLAGS) if there is no other fixed property, such as a vendor id.
+    // These only narrow the search: the binding program has the final say.
+    uint32_t protocol_id;
+    uint32_t key_id;
+    uint32_t key_value;
+
+    // 0 for drivers without a binding program, which only load in the root devhost
+    uint32_t bindcount;
+} driver_index_entry_t;
+
+__END_CDECLS;
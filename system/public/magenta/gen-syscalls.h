@@ -729,6 +729,14 @@ extern mx_status_t _mx_log_read(
     void* buffer,
     uint32_t options) __attribute__((__leaf__));
 
+extern mx_status_t mx_log_get_buffer(
+    mx_handle_t handle,
+    mx_handle_t out[1]) __attribute__((__leaf__));
+
+extern mx_status_t _mx_log_get_buffer(
+    mx_handle_t handle,
+    mx_handle_t out[1]) __attribute__((__leaf__));
+
 extern mx_status_t mx_ktrace_read(
     mx_handle_t handle,
     void* data,
@@ -51,6 +51,9 @@ KTRACE_DEF(0x143,32B,PORT_QUEUE,IPC) // id, size
 KTRACE_DEF(0x150,32B,WAIT_ONE,IPC) // id, signals, timeoutlo, timeouthi
 KTRACE_DEF(0x151,32B,WAIT_ONE_DONE,IPC) // id, status, pending
 
+KTRACE_DEF(0x160,32B,MUTEX_SPIN,LOCKS) // mutex_lo, mutex_hi, spin_ns
+KTRACE_DEF(0x161,32B,MUTEX_BLOCK,LOCKS) // mutex_lo, mutex_hi, spin_ns, block_ns
+
 // events from 0x200-0x2ff are for arch-specific needs
 
 #ifdef __x86_64__
@@ -46,6 +46,7 @@ __BEGIN_CDECLS
 #define KTRACE_GRP_IRQ            0x020
 #define KTRACE_GRP_PROBE          0x040
 #define KTRACE_GRP_ARCH           0x080
+#define KTRACE_GRP_LOCKS          0x100 // not traced by default
 
 #define KTRACE_GRP_TO_MASK(grp)   ((grp) << 20)
 
@@ -88,5 +89,53 @@ enum {
 #define KTRACE_ACTION_STOP      2 // options ignored
 #define KTRACE_ACTION_REWIND    3 // options ignored
 #define KTRACE_ACTION_NEW_PROBE 4 // options ignored, ptr = name
+#define KTRACE_ACTION_START_CIRCULAR 5 // options = grpmask, 0 = all
+#define KTRACE_ACTION_GET_BUFFER 6 // options ignored, ptr = mx_handle_t out
+
+// The trace buffer, as mapped from the VMO KTRACE_ACTION_GET_BUFFER returns.
+//
+// Each cpu writes events to its own ring of cpu_bufsize bytes, which starts
+// at buffer_offset + cpu * cpu_bufsize. head and tail count the bytes ever
+// written to and dropped from the ring, so the records still in it run from
+// tail % cpu_bufsize to head % cpu_bufsize. A record never wraps: a record
+// whose KTRACE_GROUP is 0 is padding up to the end of the ring.
+//
+// When a ring fills, tracing stops, unless it was started with
+// KTRACE_ACTION_START_CIRCULAR (or the ktrace.circular boot option), in
+// which case the oldest records are dropped. A reader that streams the rings
+// keeps its own cursor per cpu: it copies from max(cursor, tail) up to head,
+// then reads tail again and discards anything below it, which was
+// overwritten during the copy.
+//
+// Name records go to a separate area of names_size bytes at names_offset,
+// which is never overwritten, so that a flight recording can still be
+// decoded. version and ticks_per_ms stand in for the TAG_VERSION and
+// TAG_TICKS_PER_MS records.
+#define KTRACE_BUFFER_MAGIC 0x4655424b // "KBUF"
+
+typedef struct ktrace_cpu_header {
+    volatile uint64_t head;
+    volatile uint64_t tail;
+    uint64_t reserved[6];
+} ktrace_cpu_header_t;
+
+typedef struct ktrace_buffer_header {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ticks_per_ms;
+    uint32_t cpu_count;
+    uint32_t cpu_bufsize;
+    uint32_t buffer_offset;
+    uint32_t names_offset;
+    uint32_t names_size;
+    volatile uint32_t names_used; // may exceed names_size once it fills
+    uint32_t reserved[6];
+    ktrace_cpu_header_t cpu[];
+} ktrace_buffer_header_t;
+
+static_assert(sizeof(ktrace_cpu_header_t) == 64,
+              "ktrace_cpu_header_t should be one cache line");
+static_assert(sizeof(ktrace_buffer_header_t) == 64,
+              "ktrace_buffer_header_t should be one cache line");
 
 __END_CDECLS
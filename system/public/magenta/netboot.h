@@ -20,7 +20,7 @@
 #define NB_BOOT               4 // arg=0
 #define NB_QUERY              5 // arg=0, data=hostname (or "*")
 #define NB_SHELL_CMD          6 // arg=0, data=command string
-#define NB_OPEN               7 // arg=O_RDONLY|O_WRONLY, data=filename
+#define NB_OPEN               7 // arg=O_RDONLY|O_WRONLY (|NB_OPEN_WINDOW), data=filename
 #define NB_READ               8 // arg=blocknum
 #define NB_WRITE              9 // arg=blocknum, data=data
 #define NB_CLOSE             10 // arg=0
@@ -31,6 +31,17 @@
 
 #define NB_ADVERTISE          0x77777777
 
+// Windowed file transfer.  NB_OPEN with NB_OPEN_WINDOW set asks for it;
+// a peer which supports it acks with arg=the block size it will use,
+// and one which does not fails the open with -EINVAL.
+// Once open, up to NB_WINDOW_BLOCKS blocks may be outstanding:
+//   NB_READ:  arg=blocknum; ack arg=blocknum, data=the block (short at EOF)
+//   NB_WRITE: arg=blocknum, data=data; ack arg=the next block needed,
+//             data=uint32_t map, bit n set if block arg+n is already held
+#define NB_OPEN_WINDOW        0x40000000
+#define NB_WINDOW_BLOCKS      32
+#define NB_WINDOW_BLOCK_MAX   8192
+
 #define NB_ERROR              0x80000000
 #define NB_ERROR_BAD_CMD      0x80000001
 #define NB_ERROR_BAD_PARAM    0x80000002
@@ -173,6 +173,46 @@ struct mx_loader_svc_msg {
 #define LOADER_SVC_OP_DEBUG_PRINT 3
 // arg=0, data[] debug text (asciiz)
 
+#define LOADER_SVC_OP_LOAD_SYMCACHE 4
+// arg=0, data[] symbol cache key (asciiz)
+// reply includes vmo handle on success
+
+#define LOADER_SVC_OP_STORE_SYMCACHE 5
+// arg=0, data[] symbol cache key (asciiz)
+// request includes vmo handle with the cache contents
+
+// Symbol cache tables, as the dynamic linker records them with LD_SYMCACHE
+// set.  The key is the build ID of each DSO in the search list, in hex and
+// in search order, separated by '/'.  A table is an mx_symcache_header_t,
+// then an mx_symcache_dso_t for each DSO in the key, then each DSO's slots
+// (two per symbol table entry) at the offset its mx_symcache_dso_t gives.
+// The loader service checks the layout before storing a table, and a newer
+// table stored under a key replaces the older one.
+#define MX_SYMCACHE_MAGIC 0x45484341434d5953ULL // "SYMCACHE"
+#define MX_SYMCACHE_VERSION 2
+#define MX_SYMCACHE_BUILDID_MAX 132
+
+typedef struct mx_symcache_header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t dso_count;
+} mx_symcache_header_t;
+
+typedef struct mx_symcache_dso {
+    char buildid[MX_SYMCACHE_BUILDID_MAX];
+    uint32_t nsyms;
+    uint32_t offset;
+} mx_symcache_dso_t;
+
+// The defining DSO, by its position in the key, and its symbol index.
+typedef struct mx_symcache_slot {
+    uint32_t dso;
+    uint32_t sym;
+} mx_symcache_slot_t;
+
+#define MX_SYMCACHE_UNSET UINT32_MAX // not looked up when recorded
+#define MX_SYMCACHE_NONE (UINT32_MAX - 1) // no definition when recorded
+
 #ifdef __cplusplus
 }
 #endif
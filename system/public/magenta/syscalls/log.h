@@ -24,12 +24,48 @@ typedef struct mx_log_record {
 
 #define MX_LOG_RECORD_MAX     256
 
+// With MX_LOG_FLAG_BATCH, mx_log_read() returns as many whole records
+// as fit in the buffer, each starting on an MX_LOG_RECORD_ALIGN boundary.
+#define MX_LOG_RECORD_ALIGN   8
+#define MX_LOG_RECORD_SIZE(rec) \
+    ((sizeof(mx_log_record_t) + (rec)->datalen + (MX_LOG_RECORD_ALIGN - 1)) & \
+     ~(MX_LOG_RECORD_ALIGN - 1))
+
 #define MX_LOG_FLAG_KERNEL    0x0100
 #define MX_LOG_FLAG_DEVMGR    0x0200
 #define MX_LOG_FLAG_CONSOLE   0x0400
 #define MX_LOG_FLAG_DEVICE    0x0800
 #define MX_LOG_FLAG_MASK      0x0F00
 
+#define MX_LOG_FLAG_BATCH     0x20000000
 #define MX_LOG_FLAG_READABLE  0x40000000
 
+// mx_log_get_buffer() returns a read-only vmo holding the log itself, for
+// readers that want to avoid copying it. The vmo starts with an
+// mx_log_buffer_t, and the ring of records is size bytes at offset.
+//
+// head and tail are positions in the ring, which only ever increase: the
+// record at position p is at offset + (p % size). Records are 4-byte
+// aligned, and a record may wrap around the end of the ring, but its first
+// word never does. That word (reserved, in mx_log_record_t) holds the
+// space the record takes in the ring and its length. A length of 0 means
+// the record is still being written.
+//
+// To read, load head and tail, copy out records from tail up to head, then
+// load tail again: any record before the new tail may have been overwritten
+// while it was being copied.
+#define MX_LOG_BUFFER_MAGIC   0x474f4c44 // "DLOG"
+
+typedef struct mx_log_buffer {
+    uint32_t magic;
+    uint32_t size;
+    uint32_t offset;
+    uint32_t reserved;
+    uint64_t head;
+    uint64_t tail;
+} mx_log_buffer_t;
+
+#define MX_LOG_RECORD_RINGLEN(n)  ((n) & 0xFFF)
+#define MX_LOG_RECORD_READLEN(n)  (((n) >> 12) & 0xFFF)
+
 __END_CDECLS
@@ -106,6 +106,13 @@ typedef struct mx_info_vmar {
 #define MX_PROP_REGISTER_FS                 4u
 #endif
 
+// Argument is an mx_time_t: how many nanoseconds past its deadline a
+// thread's wait or sleep may end, so that nearby timeouts can share
+// a timer interrupt. Defaults to 0. Values with the top bit set are
+// rejected; values above MX_TIMER_SLACK_MAX are clamped to it.
+#define MX_PROP_TIMER_SLACK                 5u
+#define MX_TIMER_SLACK_MAX                  MX_SEC(1)
+
 // Policies for MX_PROP_BAD_HANDLE_POLICY:
 #define MX_POLICY_BAD_HANDLE_IGNORE         0u
 #define MX_POLICY_BAD_HANDLE_LOG            1u
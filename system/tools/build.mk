@@ -8,9 +8,11 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 
 SUBDIR_INCLUDES := \
     $(LOCAL_DIR)/bootserver/build.mk \
+    $(LOCAL_DIR)/driverindex/build.mk \
     $(LOCAL_DIR)/loglistener/build.mk \
     $(LOCAL_DIR)/mkbootfs/build.mk \
     $(LOCAL_DIR)/netprotocol/build.mk \
     $(LOCAL_DIR)/sysgen/build.mk \
+    $(LOCAL_DIR)/virtio-net-test/build.mk \
 
 include $(SUBDIR_INCLUDES)
@@ -0,0 +1,255 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// driverindex reads the Magenta driver note out of each driver library and
+// writes the driver index that devhost uses to load drivers on demand.
+//
+// usage: driverindex -o <output> <bootfspath>=<buildpath>...
+// where bootfspath is where the library is installed, eg lib/driver/foo.so
+
+#include <elf.h>
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <magenta/driver-index.h>
+
+// From ddk/binding.h, which can't be used on the host.
+#define MAGENTA_NOTE_DRIVER 0x00010000
+
+#define BINDINST_CC(n) ((n) >> 28)
+#define BINDINST_OP(n) (((n) >> 24) & 0xF)
+#define BINDINST_PB(n) ((n) & 0xFFFF)
+
+#define OP_ABORT 0x0
+#define COND_NE 0x2
+#define BIND_FLAGS 0x0000
+#define BIND_PROTOCOL 0x0001
+
+typedef struct {
+    uint32_t bindcount;
+    uint32_t reserved;
+    char name[32];
+    char vendor[16];
+    char version[16];
+} note_driver_t;
+
+typedef struct {
+    driver_index_entry_t entry;
+    uint32_t* binding;
+    unsigned order;
+} driver_t;
+
+static char* read_file(const char* path, size_t* size) {
+    FILE* fp = fopen(path, "rb");
+    if (fp == NULL) {
+        fprintf(stderr, "error: cannot open '%s': %s\n", path, strerror(errno));
+        return NULL;
+    }
+    char* data = NULL;
+    if (fseek(fp, 0, SEEK_END) == 0) {
+        long len = ftell(fp);
+        if ((len > 0) && (fseek(fp, 0, SEEK_SET) == 0) && ((data = malloc(len)) != NULL)) {
+            if (fread(data, 1, len, fp) != (size_t)len) {
+                free(data);
+                data = NULL;
+            } else {
+                *size = len;
+            }
+        }
+    }
+    if (data == NULL) {
+        fprintf(stderr, "error: cannot read '%s'\n", path);
+    }
+    fclose(fp);
+    return data;
+}
+
+// Finds the driver note in the SHT_NOTE sections of a 64bit ELF file.
+// Returns a pointer to the note's descriptor.
+static const char* find_driver_note(const char* data, size_t size, uint32_t* descsz) {
+    const Elf64_Ehdr* eh = (const Elf64_Ehdr*)data;
+    if ((size < sizeof(*eh)) || memcmp(eh->e_ident, ELFMAG, SELFMAG) ||
+        (eh->e_ident[EI_CLASS] != ELFCLASS64) ||
+        (eh->e_shentsize != sizeof(Elf64_Shdr)) ||
+        (eh->e_shoff > size) ||
+        ((size - eh->e_shoff) / sizeof(Elf64_Shdr) < eh->e_shnum)) {
+        return NULL;
+    }
+    const Elf64_Shdr* sh = (const Elf64_Shdr*)(data + eh->e_shoff);
+    for (unsigned i = 0; i < eh->e_shnum; i++, sh++) {
+        if ((sh->sh_type != SHT_NOTE) || (sh->sh_offset > size) ||
+            (sh->sh_size > size - sh->sh_offset)) {
+            continue;
+        }
+        const char* p = data + sh->sh_offset;
+        const char* end = p + sh->sh_size;
+        while ((size_t)(end - p) >= sizeof(Elf64_Nhdr)) {
+            const Elf64_Nhdr* nh = (const Elf64_Nhdr*)p;
+            size_t namesz = (nh->n_namesz + 3) & ~3u;
+            size_t notesz = sizeof(*nh) + namesz + ((nh->n_descsz + 3) & ~3u);
+            if (notesz > (size_t)(end - p)) {
+                break;
+            }
+            if ((nh->n_type == MAGENTA_NOTE_DRIVER) && (nh->n_namesz == 7) &&
+                !memcmp(p + sizeof(*nh), "Magenta", 7)) {
+                *descsz = nh->n_descsz;
+                return p + sizeof(*nh) + namesz;
+            }
+            p += notesz;
+        }
+    }
+    return NULL;
+}
+
+// Records the properties that the start of the binding program requires,
+// stopping at the first instruction that is not an ABORT_IF(NE, ...).
+static void derive_keys(driver_index_entry_t* entry, const uint32_t* binding) {
+    for (uint32_t i = 0; i < entry->bindcount; i++) {
+        uint32_t op = binding[i * 2];
+        uint32_t arg = binding[i * 2 + 1];
+        if ((BINDINST_OP(op) != OP_ABORT) || (BINDINST_CC(op) != COND_NE) ||
+            (BINDINST_PB(op) == BIND_FLAGS)) {
+            break;
+        }
+        if (BINDINST_PB(op) == BIND_PROTOCOL) {
+            if (entry->protocol_id == 0) {
+                entry->protocol_id = arg;
+            }
+        } else if (entry->key_id == BIND_FLAGS) {
+            entry->key_id = BINDINST_PB(op);
+            entry->key_value = arg;
+        }
+    }
+}
+
+static int add_driver(driver_t* drv, const char* line) {
+    const char* eq = strchr(line, '=');
+    if (eq == NULL) {
+        fprintf(stderr, "error: expected <bootfspath>=<buildpath>: '%s'\n", line);
+        return -1;
+    }
+    const char* path = eq + 1;
+
+    // devhost dlopen()s by the path under lib/
+    const char* libname = line;
+    if (!strncmp(libname, "lib/", 4)) {
+        libname += 4;
+    }
+    size_t len = eq - libname;
+    if (len >= sizeof(drv->entry.libname)) {
+        fprintf(stderr, "error: library name too long: '%s'\n", line);
+        return -1;
+    }
+    memset(drv, 0, sizeof(*drv));
+    memcpy(drv->entry.libname, libname, len);
+
+    size_t size;
+    char* data = read_file(path, &size);
+    if (data == NULL) {
+        return -1;
+    }
+    uint32_t descsz;
+    const char* desc = find_driver_note(data, size, &descsz);
+    if ((desc == NULL) || (descsz < sizeof(note_driver_t))) {
+        fprintf(stderr, "error: '%s' has no driver note\n", path);
+        free(data);
+        return -1;
+    }
+    note_driver_t note;
+    memcpy(&note, desc, sizeof(note));
+    if (note.bindcount > (descsz - sizeof(note)) / (2 * sizeof(uint32_t))) {
+        fprintf(stderr, "error: '%s' has a truncated binding program\n", path);
+        free(data);
+        return -1;
+    }
+    memcpy(drv->entry.name, note.name, sizeof(note.name));
+    drv->entry.name[sizeof(drv->entry.name) - 1] = 0;
+    if (note.version[0] == '!') {
+        drv->entry.flags |= DRIVER_INDEX_FLAG_PRIORITY;
+    }
+    drv->entry.bindcount = note.bindcount;
+    if (note.bindcount > 0) {
+        size_t bytes = note.bindcount * 2 * sizeof(uint32_t);
+        if ((drv->binding = malloc(bytes)) == NULL) {
+            free(data);
+            return -1;
+        }
+        memcpy(drv->binding, desc + sizeof(note), bytes);
+        derive_keys(&drv->entry, drv->binding);
+    }
+    free(data);
+    return 0;
+}
+
+// by protocol, priority drivers first, then in command line order
+static int compare_drivers(const void* _a, const void* _b) {
+    const driver_t* a = _a;
+    const driver_t* b = _b;
+    if (a->entry.protocol_id != b->entry.protocol_id) {
+        return (a->entry.protocol_id < b->entry.protocol_id) ? -1 : 1;
+    }
+    uint32_t apri = a->entry.flags & DRIVER_INDEX_FLAG_PRIORITY;
+    uint32_t bpri = b->entry.flags & DRIVER_INDEX_FLAG_PRIORITY;
+    if (apri != bpri) {
+        return apri ? -1 : 1;
+    }
+    return (a->order < b->order) ? -1 : (a->order > b->order);
+}
+
+int main(int argc, char** argv) {
+    const char* output = NULL;
+    if ((argc > 2) && !strcmp(argv[1], "-o")) {
+        output = argv[2];
+        argc -= 2;
+        argv += 2;
+    }
+    if (output == NULL) {
+        fprintf(stderr, "usage: driverindex -o <output> <bootfspath>=<buildpath>...\n");
+        return -1;
+    }
+    argc--;
+    argv++;
+
+    driver_t* drivers = calloc(argc ? argc : 1, sizeof(driver_t));
+    if (drivers == NULL) {
+        return -1;
+    }
+    for (int i = 0; i < argc; i++) {
+        if (add_driver(&drivers[i], argv[i]) < 0) {
+            return -1;
+        }
+        drivers[i].order = i;
+    }
+    qsort(drivers, argc, sizeof(driver_t), compare_drivers);
+
+    FILE* fp = fopen(output, "wb");
+    if (fp == NULL) {
+        fprintf(stderr, "error: cannot create '%s': %s\n", output, strerror(errno));
+        return -1;
+    }
+    driver_index_header_t hdr = {
+        .magic = DRIVER_INDEX_MAGIC,
+        .version = DRIVER_INDEX_VERSION,
+        .count = argc,
+    };
+    bool ok = (fwrite(&hdr, sizeof(hdr), 1, fp) == 1);
+    for (int i = 0; ok && (i < argc); i++) {
+        size_t len = drivers[i].entry.bindcount * 2 * sizeof(uint32_t);
+        ok = (fwrite(&drivers[i].entry, sizeof(driver_index_entry_t), 1, fp) == 1) &&
+             ((len == 0) || (fwrite(drivers[i].binding, len, 1, fp) == 1));
+    }
+    if (fclose(fp) != 0) {
+        ok = false;
+    }
+    if (!ok) {
+        fprintf(stderr, "error: cannot write '%s'\n", output);
+        remove(output);
+        return -1;
+    }
+    return 0;
+}
@@ -8,8 +8,9 @@ LOCAL_DIR := $(GET_LOCAL_DIR)
 
 NETRUNCMD := $(BUILDDIR)/tools/netruncmd
 NETCP := $(BUILDDIR)/tools/netcp
+NETCPTEST := $(BUILDDIR)/tools/netcp-test
 
-TOOLS := $(NETRUNCMD) $(NETCP)
+TOOLS := $(NETRUNCMD) $(NETCP) $(NETCPTEST)
 
 $(NETRUNCMD): $(LOCAL_DIR)/netruncmd.c $(LOCAL_DIR)/netprotocol.c
 	@echo compiling $@
@@ -21,6 +22,15 @@ $(NETCP): $(LOCAL_DIR)/netcp.c $(LOCAL_DIR)/netprotocol.c
 	@$(MKDIR)
 	$(NOECHO)$(HOST_CC) $(HOST_COMPILEFLAGS) $(HOST_CFLAGS) -o $@ $^
 
+# loopback test of netcp against netsvc's netfile.c, which it includes
+$(NETCPTEST): $(LOCAL_DIR)/netcp-test.c $(LOCAL_DIR)/netprotocol.c \
+              $(LOCAL_DIR)/netcp.c system/core/netsvc/netfile.c system/core/netsvc/netsvc.h
+	@echo compiling $@
+	@$(MKDIR)
+	$(NOECHO)$(HOST_CC) $(HOST_COMPILEFLAGS) $(HOST_CFLAGS) \
+	    -Isystem/ulib/inet6/include -Isystem/ulib/launchpad/include \
+	    -o $@ $(word 1,$^) $(word 2,$^) -lpthread
+
 GENERATED += $(TOOLS)
 EXTRA_BUILDDEPS += $(TOOLS)
 
@@ -0,0 +1,272 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Loopback test for netcp's windowed transfers.
+//
+// netsvc's netfile handlers run on a thread behind a UDP socket on
+// localhost, and netcp's push and pull run against it.  The device side
+// drops a share of the packets in each direction.  Each transfer must
+// arrive intact, and the blocks sent more than once must stay in line
+// with the packets lost: a go-back-N sender resends the whole window
+// behind every loss.
+//
+// usage: netcp-test [loss-percent]
+
+#define _GNU_SOURCE
+
+#include <string.h>
+
+// older host libcs lack strlcpy, which netfile.c uses
+#define strlcpy netcp_test_strlcpy
+static size_t strlcpy(char* dst, const char* src, size_t size) {
+    size_t len = strlen(src);
+    if (size > 0) {
+        size_t n = (len < size) ? len : size - 1;
+        memcpy(dst, src, n);
+        dst[n] = 0;
+    }
+    return len;
+}
+
+#define main netcp_main
+#include "netcp.c"
+#undef main
+
+#include "../../core/netsvc/netfile.c"
+
+#include <pthread.h>
+#include <stdatomic.h>
+
+static int dev_sock = -1;
+static struct sockaddr_in dev_peer;
+static atomic_bool dev_stop;
+
+static unsigned loss_percent;
+static unsigned loss_seed = 1;
+
+// blocks netcp asked for more than once, and packets the device side
+// dropped
+#define MAX_BLOCKS 4096
+static atomic_bool seen[MAX_BLOCKS];
+static atomic_uint resent;
+static atomic_uint dropped_in;
+static atomic_uint dropped_out;
+
+static bool lose(void) {
+    return (unsigned)(rand_r(&loss_seed) % 100) < loss_percent;
+}
+
+void netifc_get_info(uint8_t* addr, uint16_t* mtu) {
+    memset(addr, 0, 6);
+    *mtu = 1500;
+}
+
+int udp6_send(const void* data, size_t len,
+              const ip6_addr_t* daddr, uint16_t dport,
+              uint16_t sport) {
+    if (lose()) {
+        dropped_out++;
+        return 0;
+    }
+    if (sendto(dev_sock, data, len, 0, (void*)&dev_peer, sizeof(dev_peer)) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// the NB_OPEN/READ/WRITE/CLOSE half of netsvc's udp6_recv()
+static void* device_thread(void* arg) {
+    static uint8_t buf[sizeof(nbmsg) + NB_WINDOW_BLOCK_MAX + 1];
+    nbmsg* msg = (nbmsg*)buf;
+
+    while (!dev_stop) {
+        struct pollfd pfd = { .fd = dev_sock, .events = POLLIN };
+        if (poll(&pfd, 1, 50) <= 0) {
+            continue;
+        }
+        struct sockaddr_in from;
+        socklen_t fromlen = sizeof(from);
+        ssize_t len = recvfrom(dev_sock, buf, sizeof(buf), 0, (void*)&from, &fromlen);
+        if ((len < (ssize_t)(sizeof(nbmsg) + 1)) || (msg->magic != NB_MAGIC)) {
+            continue;
+        }
+        if (((msg->cmd == NB_READ) || (msg->cmd == NB_WRITE)) && (msg->arg < MAX_BLOCKS)) {
+            if (seen[msg->arg]) {
+                resent++;
+            }
+            seen[msg->arg] = true;
+        }
+        if (lose()) {
+            dropped_in++;
+            continue;
+        }
+        dev_peer = from;
+
+        len -= sizeof(nbmsg);
+        msg->data[len - 1] = 0;
+        switch (msg->cmd) {
+        case NB_OPEN:
+            netfile_open((char*)msg->data, msg->cookie, msg->arg, NULL, 0, 0);
+            break;
+        case NB_READ:
+            netfile_read(msg->cookie, msg->arg, NULL, 0, 0);
+            break;
+        case NB_WRITE:
+            len--; // NB NUL-terminator is not part of the data
+            netfile_write((char*)msg->data, len, msg->cookie, msg->arg, NULL, 0, 0);
+            break;
+        case NB_CLOSE:
+            netfile_close(msg->cookie, NULL, 0, 0);
+            break;
+        }
+    }
+    return NULL;
+}
+
+static int write_file(const char* path, const uint8_t* data, size_t len) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        return -1;
+    }
+    ssize_t r = write(fd, data, len);
+    close(fd);
+    return (r == (ssize_t)len) ? 0 : -1;
+}
+
+static bool same_file(const char* path, const uint8_t* data, size_t len) {
+    uint8_t* buf = malloc(len + 1);
+    if (buf == NULL) {
+        return false;
+    }
+    bool same = false;
+    int fd = open(path, O_RDONLY);
+    if (fd >= 0) {
+        ssize_t r = read(fd, buf, len + 1);
+        same = (r == (ssize_t)len) && (memcmp(buf, data, len) == 0);
+        close(fd);
+    }
+    free(buf);
+    return same;
+}
+
+// run one transfer and check what arrived and how much was resent
+static bool transfer(int s, bool push, const char* dir, const uint8_t* data, size_t len) {
+    char local[MAXPATHLEN], remote[MAXPATHLEN];
+    snprintf(local, sizeof(local), "%s/local", dir);
+    snprintf(remote, sizeof(remote), "%s/remote", dir);
+    unlink(local);
+    unlink(remote);
+    if (write_file(push ? local : remote, data, len) < 0) {
+        fprintf(stderr, "%s: cannot create test file: %s\n", appname, strerror(errno));
+        return false;
+    }
+
+    for (unsigned n = 0; n < MAX_BLOCKS; n++) {
+        seen[n] = false;
+    }
+    resent = 0;
+    dropped_in = 0;
+    dropped_out = 0;
+
+    int r = push ? push_file(s, remote, local) : pull_file(s, local, remote);
+    const char* what = push ? "push" : "pull";
+    if (r < 0) {
+        fprintf(stderr, "%s: %s of %zu bytes failed\n", appname, what, len);
+        return false;
+    }
+    if (!same_file(push ? remote : local, data, len)) {
+        fprintf(stderr, "%s: %s of %zu bytes arrived corrupt\n", appname, what, len);
+        return false;
+    }
+
+    unsigned lost = dropped_in + dropped_out;
+    printf("%s: %zu bytes, %u lost, %u resent\n", what, len, lost, (unsigned)resent);
+    if (resent > 2 * lost + NB_WINDOW_BLOCKS) {
+        fprintf(stderr, "%s: %s resent too much\n", appname, what);
+        return false;
+    }
+    return true;
+}
+
+int main(int argc, char** argv) {
+    appname = argv[0];
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [loss-percent]\n", appname);
+        return -1;
+    }
+    unsigned max_loss = (argc > 1) ? (unsigned)atoi(argv[1]) : 20;
+
+    char dir[] = "/tmp/netcp-test.XXXXXX";
+    if (mkdtemp(dir) == NULL) {
+        fprintf(stderr, "%s: cannot create %s: %s\n", appname, dir, strerror(errno));
+        return -1;
+    }
+
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t addrlen = sizeof(addr);
+    int s = -1;
+    if (((dev_sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0) ||
+        (bind(dev_sock, (void*)&addr, sizeof(addr)) < 0) ||
+        (getsockname(dev_sock, (void*)&addr, &addrlen) < 0) ||
+        ((s = socket(AF_INET, SOCK_DGRAM, 0)) < 0) ||
+        (connect(s, (void*)&addr, sizeof(addr)) < 0)) {
+        fprintf(stderr, "%s: cannot set up loopback sockets: %s\n", appname, strerror(errno));
+        return -1;
+    }
+    // as netboot_open() does
+    struct timeval tv;
+    tv.tv_sec = 0;
+    tv.tv_usec = 250 * 1000;
+    setsockopt(s, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, device_thread, NULL) != 0) {
+        fprintf(stderr, "%s: cannot start device thread\n", appname);
+        return -1;
+    }
+
+    // empty, ending on a block boundary, and ending part way into one
+    uint32_t blocksize = netfile_blocksize();
+    size_t sizes[] = { 0, blocksize * 3 * NB_WINDOW_BLOCKS, 1024 * 1024 + 123 };
+    size_t max = sizes[sizeof(sizes) / sizeof(sizes[0]) - 1];
+    uint8_t* data = malloc(max);
+    if (data == NULL) {
+        fprintf(stderr, "%s: out of memory\n", appname);
+        return -1;
+    }
+    unsigned seed = 42;
+    for (size_t n = 0; n < max; n++) {
+        data[n] = rand_r(&seed);
+    }
+
+    bool ok = true;
+    unsigned losses[] = { 0, max_loss };
+    for (size_t l = 0; l < sizeof(losses) / sizeof(losses[0]); l++) {
+        loss_percent = losses[l];
+        printf("loss %u%%\n", loss_percent);
+        for (size_t n = 0; n < sizeof(sizes) / sizeof(sizes[0]); n++) {
+            ok &= transfer(s, true, dir, data, sizes[n]);
+            ok &= transfer(s, false, dir, data, sizes[n]);
+        }
+    }
+
+    dev_stop = true;
+    pthread_join(thread, NULL);
+    close(s);
+    close(dev_sock);
+    free(data);
+
+    char path[MAXPATHLEN];
+    snprintf(path, sizeof(path), "%s/local", dir);
+    unlink(path);
+    snprintf(path, sizeof(path), "%s/remote", dir);
+    unlink(path);
+    rmdir(dir);
+
+    printf("%s\n", ok ? "PASSED" : "FAILED");
+    return ok ? 0 : -1;
+}
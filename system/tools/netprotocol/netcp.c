@@ -16,9 +16,12 @@
 
 #include <fcntl.h>
 #include <libgen.h>
+#include <poll.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <errno.h>
@@ -28,6 +31,257 @@
 
 static const char* appname;
 
+// Windowed transfers keep up to NB_WINDOW_BLOCKS blocks in flight.  A
+// block is sent again once it has gone unanswered for WINDOW_RTO_MS, or
+// as soon as the remote end reports a block sent after it.
+#define WINDOW_RTO_MS 50
+#define WINDOW_RETRIES 40
+
+typedef struct {
+    struct nbmsg_t hdr;
+    uint8_t data[NB_WINDOW_BLOCK_MAX + 1];
+} wmsg;
+
+typedef struct {
+    uint64_t sent;  // when last sent
+    uint64_t seq;   // order in which last sent
+    int tries;
+    bool done;      // acked (writes) or received (reads)
+    size_t len;
+    wmsg m;
+} window_slot;
+
+static window_slot window[NB_WINDOW_BLOCKS];
+static uint64_t window_seq;
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static int window_send(int s, window_slot* slot, size_t len) {
+    if (slot->tries++ == WINDOW_RETRIES) {
+        errno = ETIMEDOUT;
+        return -1;
+    }
+    slot->m.hdr.magic = NB_MAGIC;
+    slot->m.hdr.cookie = (uint32_t)window_seq;
+    slot->sent = now_ms();
+    slot->seq = window_seq++;
+    if (write(s, &slot->m, len) < 0) {
+        return -1;
+    }
+    return 0;
+}
+
+// wait for an ack until the oldest outstanding block is due again;
+// returns the payload length, or -1 if nothing arrived
+static ssize_t window_recv(int s, wmsg* in, uint32_t base, uint32_t next) {
+    uint64_t due = UINT64_MAX;
+    for (uint32_t b = base; b != next; b++) {
+        window_slot* slot = &window[b % NB_WINDOW_BLOCKS];
+        if (!slot->done && slot->sent + WINDOW_RTO_MS < due) {
+            due = slot->sent + WINDOW_RTO_MS;
+        }
+    }
+    uint64_t now = now_ms();
+    struct pollfd pfd = { .fd = s, .events = POLLIN };
+    if (poll(&pfd, 1, (due > now) ? (int)(due - now) : 0) <= 0) {
+        return -1;
+    }
+    ssize_t r = recv(s, in, sizeof(*in), 0);
+    if ((r < (ssize_t)sizeof(in->hdr)) ||
+        (in->hdr.magic != NB_MAGIC) || (in->hdr.cmd != NB_ACK)) {
+        return -1;
+    }
+    return r - sizeof(in->hdr);
+}
+
+// resend blocks which are overdue, or which were sent before |seq| and
+// are still outstanding when the remote end has answered a later one
+static int window_resend(int s, uint32_t base, uint32_t next, uint64_t seq) {
+    uint64_t now = now_ms();
+    for (uint32_t b = base; b != next; b++) {
+        window_slot* slot = &window[b % NB_WINDOW_BLOCKS];
+        if (slot->done) {
+            continue;
+        }
+        if ((slot->seq < seq) || (now - slot->sent >= WINDOW_RTO_MS)) {
+            if (window_send(s, slot, sizeof(slot->m.hdr) + slot->len + 1) < 0) {
+                return -1;
+            }
+        }
+    }
+    return 0;
+}
+
+// discard acks for blocks that were sent more than once, so that they
+// do not meet the close
+static void window_drain(int s) {
+    wmsg in;
+    while (recv(s, &in, sizeof(in), MSG_DONTWAIT) >= 0)
+        ;
+}
+
+static int pull_window(int s, int fd, uint32_t blocksize, int* total) {
+    uint32_t base = 0;      // next block to write locally
+    uint32_t next = 0;      // next block to ask for
+    uint32_t end = UINT32_MAX; // first block past the end of the file
+    wmsg in;
+
+    for (;;) {
+        while ((next != end) && (next - base < NB_WINDOW_BLOCKS)) {
+            window_slot* slot = &window[next % NB_WINDOW_BLOCKS];
+            memset(&slot->m.hdr, 0, sizeof(slot->m.hdr));
+            slot->m.hdr.cmd = NB_READ;
+            slot->m.hdr.arg = next;
+            slot->m.data[0] = 0;
+            slot->len = 0;
+            slot->tries = 0;
+            slot->done = false;
+            if (window_send(s, slot, sizeof(slot->m.hdr) + 1) < 0) {
+                return -1;
+            }
+            next++;
+        }
+
+        uint64_t seq = 0;
+        ssize_t r = window_recv(s, &in, base, next);
+        if (r >= 0) {
+            if ((int32_t)in.hdr.arg < 0) {
+                errno = -(int32_t)in.hdr.arg;
+                return -1;
+            }
+            uint32_t b = in.hdr.arg;
+            window_slot* slot = &window[b % NB_WINDOW_BLOCKS];
+            if ((b - base < next - base) && !slot->done && (r <= blocksize)) {
+                memcpy(slot->m.data, in.data, r);
+                slot->len = r;
+                slot->done = true;
+                seq = slot->seq;
+                if (r < blocksize) {
+                    end = MIN(end, b + 1);
+                }
+            }
+        }
+
+        // write out what has arrived in order
+        while ((base != next) && (base != end) && window[base % NB_WINDOW_BLOCKS].done) {
+            window_slot* slot = &window[base % NB_WINDOW_BLOCKS];
+            if (write(fd, slot->m.data, slot->len) < (ssize_t)slot->len) {
+                fprintf(stderr, "%s: pull short local write: %s\n",
+                        appname, strerror(errno));
+                return -1;
+            }
+            *total += slot->len;
+            base++;
+        }
+        if (base == end) {
+            window_drain(s);
+            return 0;
+        }
+        if (end != UINT32_MAX) {
+            next = MIN(next, end);
+        }
+
+        if (window_resend(s, base, next, seq) < 0) {
+            return -1;
+        }
+    }
+}
+
+static int push_window(int s, int fd, uint32_t blocksize, int* total) {
+    uint32_t base = 0;      // oldest block not yet acked
+    uint32_t next = 0;      // next block to send
+    bool eof = false;
+    wmsg in;
+
+    for (;;) {
+        while (!eof && (next - base < NB_WINDOW_BLOCKS)) {
+            window_slot* slot = &window[next % NB_WINDOW_BLOCKS];
+            ssize_t len = read(fd, slot->m.data, blocksize);
+            if (len < 0) {
+                fprintf(stderr, "%s: error reading block %u (%d)\n",
+                        appname, next, errno);
+                return -1;
+            }
+            if (len == 0) {
+                eof = true;
+                break;
+            }
+            memset(&slot->m.hdr, 0, sizeof(slot->m.hdr));
+            slot->m.hdr.cmd = NB_WRITE;
+            slot->m.hdr.arg = next;
+            slot->m.data[len] = 0;
+            slot->len = len;
+            slot->tries = 0;
+            slot->done = false;
+            if (window_send(s, slot, sizeof(slot->m.hdr) + len + 1) < 0) {
+                return -1;
+            }
+            *total += len;
+            next++;
+        }
+        if (eof && (base == next)) {
+            window_drain(s);
+            return 0;
+        }
+
+        uint64_t seq = 0;
+        ssize_t r = window_recv(s, &in, base, next);
+        if (r >= 0) {
+            if ((int32_t)in.hdr.arg < 0) {
+                errno = -(int32_t)in.hdr.arg;
+                return -1;
+            }
+            uint32_t ack = in.hdr.arg;
+            uint32_t map = 0;
+            if (r >= (ssize_t)sizeof(map)) {
+                memcpy(&map, in.data, sizeof(map));
+            }
+            if (ack - base <= next - base) {
+                base = ack;
+                // note what the remote end holds beyond the gap, and the
+                // latest of it to have been sent
+                for (uint32_t n = 1; n < NB_WINDOW_BLOCKS; n++) {
+                    window_slot* slot = &window[(base + n) % NB_WINDOW_BLOCKS];
+                    if ((map & (1u << n)) && (n < next - base)) {
+                        slot->done = true;
+                        seq = MAX(seq, slot->seq);
+                    }
+                }
+            }
+        }
+
+        if (window_resend(s, base, next, seq) < 0) {
+            return -1;
+        }
+    }
+}
+
+// open a remote file, asking for a windowed transfer first; returns the
+// block size to use, 0 if the remote end only does one block at a time,
+// or -1 on error
+static int open_remote(int s, msg* in, msg* out, size_t outlen) {
+    out->hdr.arg |= NB_OPEN_WINDOW;
+    int r = netboot_txn(s, in, out, outlen);
+    out->hdr.arg &= ~NB_OPEN_WINDOW;
+    if (r < 0 && errno == EINVAL) {
+        r = netboot_txn(s, in, out, outlen);
+    }
+    if (r < 0) {
+        return r;
+    }
+    uint32_t blocksize = in->hdr.arg;
+    if (blocksize > NB_WINDOW_BLOCK_MAX) {
+        // larger than the remote end may offer
+        errno = EPROTO;
+        return -1;
+    }
+    return blocksize;
+}
+
 static int pull_file(int s, const char* dst, const char* src) {
     int r;
     msg in, out;
@@ -38,11 +292,11 @@ static int pull_file(int s, const char* dst, const char* src) {
     memcpy(out.data, src, src_len);
     out.data[src_len] = 0;
 
-    r = netboot_txn(s, &in, &out, sizeof(out.hdr) + src_len + 1);
-    if (r < 0) {
+    int blocksize = open_remote(s, &in, &out, sizeof(out.hdr) + src_len + 1);
+    if (blocksize < 0) {
         fprintf(stderr, "%s: error opening remote file %s (%d)\n",
                 appname, src, errno);
-        return r;
+        return blocksize;
     }
 
     char final_dst[MAXPATHLEN];
@@ -61,7 +315,14 @@ static int pull_file(int s, const char* dst, const char* src) {
 
     int n = 0;
     int blocknum = 0;
-    for (;;) {
+    if (blocksize > 0) {
+        if (pull_window(s, fd, blocksize, &n) < 0) {
+            fprintf(stderr, "%s: error reading %s (%d)\n", appname, src, errno);
+            close(fd);
+            return -1;
+        }
+    }
+    while (blocksize == 0) {
         memset(&out, 0, sizeof(out));
         out.hdr.cmd = NB_READ;
         out.hdr.arg = blocknum;
@@ -118,8 +379,9 @@ static int push_file(int s, const char* dst, const char* src) {
     memcpy(out.data, dst, dst_len);
     out.data[dst_len] = 0;
 
+    int blocksize;
 again:
-    r = netboot_txn(s, &in, &out, sizeof(out.hdr) + dst_len + 1);
+    blocksize = r = open_remote(s, &in, &out, sizeof(out.hdr) + dst_len + 1);
     if (r < 0) {
         if (errno == EISDIR) {
             ptr = strrchr(src, '/');
@@ -153,7 +415,14 @@ again:
     int n = 0;
     int len = 0;
     int blocknum = 0;
-    for (;;) {
+    if (blocksize > 0) {
+        if (push_window(s, fd, blocksize, &n) < 0) {
+            fprintf(stderr, "%s: error writing %s (%d)\n", appname, dst, errno);
+            close(fd);
+            return -1;
+        }
+    }
+    while (blocksize == 0) {
         memset(&out, 0, sizeof(out));
         out.hdr.cmd = NB_WRITE;
         out.hdr.arg = blocknum;
@@ -0,0 +1,31 @@
+# Copyright 2017 The Fuchsia Authors
+#
+# Use of this source code is governed by a MIT-style
+# license that can be found in the LICENSE file or at
+# https://opensource.org/licenses/MIT
+
+LOCAL_DIR := $(GET_LOCAL_DIR)
+
+VIRTIONETTEST := $(BUILDDIR)/tools/virtio-net-test
+
+TOOLS := $(VIRTIONETTEST)
+
+# loopback test of the virtio-net driver, which it includes, against a
+# device model
+$(VIRTIONETTEST): $(LOCAL_DIR)/virtio-net-test.cpp system/ulib/mxcpp/new.cpp \
+                  system/udev/virtio/net.cpp system/udev/virtio/net.h \
+                  system/udev/virtio/ring.cpp system/udev/virtio/ring.h
+	@echo compiling $@
+	@$(MKDIR)
+	$(NOECHO)$(HOST_CXX) $(HOST_COMPILEFLAGS) $(HOST_CPPFLAGS) -std=c++14 -Wno-multichar \
+	    -Isystem/ulib/ddk/include -Isystem/ulib/magenta/include -Isystem/ulib/mx/include \
+	    -Isystem/ulib/mxcpp/include -Isystem/ulib/mxtl/include -Isystem/ulib/system/include \
+	    -Isystem/public -Isystem/private \
+	    -o $@ $(word 1,$^) $(word 2,$^) -lpthread
+
+GENERATED += $(TOOLS)
+EXTRA_BUILDDEPS += $(TOOLS)
+
+# phony rule to build just the tools
+.PHONY: tools
+tools: $(TOOLS)
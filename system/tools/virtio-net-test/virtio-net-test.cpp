@@ -0,0 +1,829 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Loopback throughput test for the batched virtio-net path.
+//
+// The driver's net.cpp and ring.cpp run on the host against a device
+// model: a thread which takes each frame off a tx virtqueue and writes it
+// into the rx virtqueue of the same pair, and an interrupt thread which
+// runs the driver's IrqRingUpdate().  The model follows the event index
+// protocol, so the kicks and interrupts it counts are the ones a device
+// would see.  In every configuration each frame must arrive intact and in
+// order per sender, nothing may be dropped, and no kick may go missing.
+//
+// usage: virtio-net-test [frames]
+
+// host libcs have neither; a zeroed mtx_t is an unlocked mutex
+#define MTX_INIT {}
+#define PAGE_SIZE 4096
+
+#include "../../udev/virtio/net.cpp"
+#include "../../udev/virtio/ring.cpp"
+
+#include <atomic>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
+
+namespace {
+
+const char* appname;
+
+const uint16_t kRingSize = 256;
+const uint16_t kMaxPairs = 4;
+const uint16_t kRings = 2 * kMaxPairs + 1;
+
+// frames a sender has outstanding; with four senders on one pair this
+// still leaves the tx ring room for two descriptor chains
+const uint32_t kWindow = 32;
+
+const uint8_t kMac[6] = {0x52, 0x54, 0x00, 0x12, 0x34, 0x56};
+
+// where each test frame keeps its checksum, sender and sequence number
+const size_t kCsumStart = 14;
+const size_t kIdOffset = 16;
+const size_t kSeqOffset = 17;
+const size_t kMinFrame = 60;
+const size_t kMaxFrame = 1514;
+
+struct Config {
+    const char* name;
+    uint32_t features;
+    unsigned senders;
+    // most frame bytes put in one rx buffer, 0 for as many as fit
+    size_t rx_chunk;
+    // publish rx buffers one at a time rather than a frame at a time
+    bool trickle;
+    // VIRTIO_NET_HDR_F_* for every received frame
+    uint8_t csum_flags;
+};
+
+const uint32_t kBase = VIRTIO_NET_F_MAC | VIRTIO_NET_F_STATUS;
+const uint32_t kBatched = kBase | VIRTIO_F_ANY_LAYOUT | (1u << VIRTIO_RING_F_EVENT_IDX);
+const uint32_t kMerged = kBatched | VIRTIO_NET_F_MRG_RXBUF | VIRTIO_NET_F_GUEST_CSUM;
+
+const Config configs[] = {
+    // a separate header descriptor, and a kick and interrupt per frame
+    {"plain", kBase, 1, 0, false, 0},
+    {"event-idx", kBatched, 1, 0, false, 0},
+    // frames spread over several buffers, with checksums left to finish
+    {"mrg-rxbuf", kMerged, 1, 512, false, VIRTIO_NET_HDR_F_NEEDS_CSUM},
+    {"mq", kMerged | VIRTIO_NET_F_CTRL_VQ | VIRTIO_NET_F_MQ, kMaxPairs, 256, true,
+     VIRTIO_NET_HDR_F_DATA_VALID},
+};
+
+// the device's view of one virtqueue; pa == va on the host
+struct DevRing {
+    uint16_t num = 0;
+    vring_desc* desc = nullptr;
+    vring_avail* avail = nullptr;
+    vring_used* used = nullptr;
+    uint16_t last_avail = 0;
+    uint16_t used_idx = 0;
+    // used index when interrupts were last considered
+    uint16_t notified_idx = 0;
+
+    bool ready() const { return num != 0; }
+    uint16_t pending() const {
+        return (uint16_t)(__atomic_load_n(&avail->idx, __ATOMIC_ACQUIRE) - last_avail);
+    }
+    uint16_t peek(uint16_t n) const { return avail->ring[(uint16_t)(last_avail + n) & (num - 1)]; }
+    uint16_t& avail_event() { return *(uint16_t*)&used->ring[num]; }
+    uint16_t used_event() const { return __atomic_load_n(&avail->ring[num], __ATOMIC_RELAXED); }
+
+    void push(uint16_t head, uint32_t len) {
+        vring_used_elem* e = &used->ring[used_idx++ & (num - 1)];
+        e->id = head;
+        e->len = len;
+    }
+    void publish() { __atomic_store_n(&used->idx, used_idx, __ATOMIC_RELEASE); }
+
+    // the descriptors of the chain at |head|, and the bytes they hold
+    size_t chain(uint16_t head, vring_desc** out, size_t max) const {
+        size_t n = 0;
+        for (;;) {
+            if (n == max)
+                return 0;
+            out[n++] = &desc[head];
+            if (!(desc[head].flags & VRING_DESC_F_NEXT))
+                return n;
+            head = desc[head].next;
+        }
+    }
+    size_t capacity(uint16_t head) const {
+        vring_desc* d[4];
+        size_t n = chain(head, d, 4);
+        size_t len = 0;
+        for (size_t i = 0; i < n; i++) {
+            len += d[i]->len;
+        }
+        return len;
+    }
+};
+
+struct Loopback {
+    const Config* cfg = nullptr;
+    uint32_t features = 0;
+    DevRing rings[kRings];
+    uint16_t pairs = 1;
+    virtio::Device* owner = nullptr;
+    mx_device_t* added = nullptr;
+
+    // rx buffers the frame at the head of each tx queue waits for
+    uint16_t rx_need[kMaxPairs] = {};
+
+    pthread_mutex_t lock = PTHREAD_MUTEX_INITIALIZER;
+    pthread_cond_t cond = PTHREAD_COND_INITIALIZER;
+    bool kicked = false;
+    bool irq = false;
+    bool stop = false;
+    bool started = false;
+    pthread_t device_thread;
+    pthread_t irq_thread;
+
+    uint64_t kicks = 0;
+    uint64_t irqs = 0;
+    uint64_t missed_kicks = 0;
+    uint64_t bad_chains = 0;
+
+    bool event_idx() const { return features & (1u << VIRTIO_RING_F_EVENT_IDX); }
+    size_t hdr_len() const {
+        return (features & VIRTIO_NET_F_MRG_RXBUF) ? 12 : 10;
+    }
+    uint16_t ctrl_index() const {
+        return (features & VIRTIO_NET_F_MQ) ? 2 * kMaxPairs : 2;
+    }
+};
+
+Loopback* dev;
+
+// frame bytes the rx buffer at |head| takes, the header aside
+size_t rx_take(DevRing& rx, uint16_t head, bool first, size_t left) {
+    size_t cap = rx.capacity(head);
+    if (first)
+        cap = (cap > dev->hdr_len()) ? cap - dev->hdr_len() : 0;
+    if (dev->cfg->rx_chunk && (dev->features & VIRTIO_NET_F_MRG_RXBUF))
+        cap = MIN(cap, dev->cfg->rx_chunk);
+    return MIN(cap, left);
+}
+
+// rx buffers a frame of |len| bytes needs, going by those posted so far
+uint16_t rx_needed(DevRing& rx, size_t len) {
+    uint16_t avail = rx.pending();
+    uint16_t n = 0;
+    do {
+        if (n == avail)
+            return (uint16_t)(n + 1);
+        len -= rx_take(rx, rx.peek(n), n == 0, len);
+        n++;
+    } while (len > 0 && (dev->features & VIRTIO_NET_F_MRG_RXBUF));
+    return n;
+}
+
+// scatter |len| bytes over the writable chain at |head|
+void rx_write(DevRing& rx, uint16_t head, const uint8_t* data, size_t len) {
+    vring_desc* d[4];
+    size_t n = rx.chain(head, d, 4);
+    for (size_t i = 0; i < n && len > 0; i++) {
+        if (!(d[i]->flags & VRING_DESC_F_WRITE))
+            dev->bad_chains++;
+        size_t part = MIN(len, d[i]->len);
+        memcpy((void*)(uintptr_t)d[i]->addr, data, part);
+        data += part;
+        len -= part;
+    }
+}
+
+void deliver(DevRing& rx, const uint8_t* frame, size_t len, uint16_t count) {
+    uint8_t hdr[12] = {};
+    hdr[0] = dev->cfg->csum_flags;
+    if (dev->cfg->csum_flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) {
+        uint16_t start = kCsumStart;
+        memcpy(hdr + 6, &start, 2);
+    }
+    if (dev->features & VIRTIO_NET_F_MRG_RXBUF)
+        memcpy(hdr + 10, &count, 2);
+
+    uint8_t buf[2048];
+    for (uint16_t n = 0; n < count; n++) {
+        uint16_t head = rx.peek(0);
+        size_t part = rx_take(rx, head, n == 0, len);
+        size_t off = 0;
+        if (n == 0) {
+            memcpy(buf, hdr, dev->hdr_len());
+            off = dev->hdr_len();
+        }
+        memcpy(buf + off, frame, part);
+        rx_write(rx, head, buf, off + part);
+        frame += part;
+        len -= part;
+
+        rx.last_avail++;
+        rx.push(head, (uint32_t)(off + part));
+        if (dev->cfg->trickle && n + 1 < count) {
+            // and give the driver the chance to see the frame half done
+            rx.publish();
+            sched_yield();
+        }
+    }
+    rx.publish();
+}
+
+// move what the driver has queued on tx queue |pair| over to its rx queue
+bool service_tx(uint16_t pair) {
+    DevRing& tx = dev->rings[2 * pair + 1];
+    DevRing& rx = dev->rings[2 * pair];
+    bool progress = false;
+
+    while (tx.pending() > 0) {
+        uint16_t head = tx.peek(0);
+        uint8_t pkt[2048];
+        size_t len = 0;
+        vring_desc* d[4];
+        size_t n = tx.chain(head, d, 4);
+        for (size_t i = 0; i < n; i++) {
+            if ((d[i]->flags & VRING_DESC_F_WRITE) || len + d[i]->len > sizeof(pkt)) {
+                dev->bad_chains++;
+                break;
+            }
+            memcpy(pkt + len, (void*)(uintptr_t)d[i]->addr, d[i]->len);
+            len += d[i]->len;
+        }
+
+        if (n == 0 || len <= dev->hdr_len()) {
+            dev->bad_chains++;
+        } else {
+            size_t flen = len - dev->hdr_len();
+            uint16_t need = rx_needed(rx, flen);
+            dev->rx_need[pair] = need;
+            if (rx.pending() < need)
+                break;
+            deliver(rx, pkt + dev->hdr_len(), flen, need);
+        }
+
+        tx.last_avail++;
+        tx.push(head, 0);
+        progress = true;
+    }
+    if (progress)
+        tx.publish();
+    return progress;
+}
+
+bool service_ctrl() {
+    if (!(dev->features & VIRTIO_NET_F_CTRL_VQ))
+        return false;
+    DevRing& c = dev->rings[dev->ctrl_index()];
+    bool progress = false;
+
+    while (c.pending() > 0) {
+        uint16_t head = c.peek(0);
+        vring_desc* d[4];
+        uint8_t ack = VIRTIO_NET_ERR;
+        if (c.chain(head, d, 4) == 3 && d[0]->len == 2 && d[1]->len == 2 &&
+            (d[2]->flags & VRING_DESC_F_WRITE)) {
+            const uint8_t* cmd = (const uint8_t*)(uintptr_t)d[0]->addr;
+            uint16_t pairs;
+            memcpy(&pairs, (void*)(uintptr_t)d[1]->addr, sizeof(pairs));
+            if (cmd[0] == VIRTIO_NET_CTRL_MQ && cmd[1] == VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET &&
+                (dev->features & VIRTIO_NET_F_MQ) && pairs >= 1 && pairs <= kMaxPairs) {
+                dev->pairs = pairs;
+                ack = VIRTIO_NET_OK;
+            }
+            *(uint8_t*)(uintptr_t)d[2]->addr = ack;
+        } else {
+            dev->bad_chains++;
+        }
+        c.last_avail++;
+        c.push(head, 1);
+        progress = true;
+    }
+    if (progress)
+        c.publish();
+    return progress;
+}
+
+// whether the driver wants to hear about what was just put on |r|
+bool notify(DevRing& r) {
+    uint16_t old = r.notified_idx;
+    r.notified_idx = r.used_idx;
+    if (old == r.used_idx)
+        return false;
+
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (dev->event_idx())
+        return vring_need_event(r.used_event(), r.used_idx, old);
+    return !(__atomic_load_n(&r.avail->flags, __ATOMIC_RELAXED) & VRING_AVAIL_F_NO_INTERRUPT);
+}
+
+bool service() {
+    bool progress = service_ctrl();
+    for (uint16_t i = 0; i < dev->pairs; i++) {
+        progress |= service_tx(i);
+    }
+
+    bool irq = false;
+    for (uint16_t i = 0; i < kRings; i++) {
+        if (dev->rings[i].ready())
+            irq |= notify(dev->rings[i]);
+    }
+    if (irq) {
+        pthread_mutex_lock(&dev->lock);
+        dev->irq = true;
+        dev->irqs++;
+        pthread_cond_broadcast(&dev->cond);
+        pthread_mutex_unlock(&dev->lock);
+    }
+    return progress;
+}
+
+bool has_work() {
+    if ((dev->features & VIRTIO_NET_F_CTRL_VQ) && dev->rings[dev->ctrl_index()].pending() > 0)
+        return true;
+    for (uint16_t i = 0; i < dev->pairs; i++) {
+        if (dev->rings[2 * i + 1].pending() > 0 &&
+            dev->rings[2 * i].pending() >= dev->rx_need[i])
+            return true;
+    }
+    return false;
+}
+
+// ask to be kicked for anything queued from here on; an rx queue only
+// once enough buffers are posted for the frame waiting on it
+void arm() {
+    if (!dev->event_idx())
+        return;
+    for (uint16_t i = 0; i < kRings; i++) {
+        DevRing& r = dev->rings[i];
+        if (!r.ready())
+            continue;
+        uint16_t event = r.last_avail;
+        if (i < 2 * kMaxPairs && !(i & 1) && dev->rx_need[i / 2] > 1)
+            event = (uint16_t)(event + dev->rx_need[i / 2] - 1);
+        __atomic_store_n(&r.avail_event(), event, __ATOMIC_RELAXED);
+    }
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+}
+
+void* device_thread(void* arg) {
+    pthread_mutex_lock(&dev->lock);
+    while (!dev->stop) {
+        dev->kicked = false;
+        pthread_mutex_unlock(&dev->lock);
+
+        while (service()) {
+        }
+        arm();
+        bool work = has_work();
+
+        pthread_mutex_lock(&dev->lock);
+        if (work || dev->kicked || dev->stop)
+            continue;
+
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += 200 * 1000 * 1000;
+        if (deadline.tv_nsec >= 1000 * 1000 * 1000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000 * 1000 * 1000;
+        }
+        while (!dev->kicked && !dev->stop) {
+            if (pthread_cond_timedwait(&dev->cond, &dev->lock, &deadline) != 0) {
+                // the driver queued work, and did not tell us
+                if (has_work())
+                    dev->missed_kicks++;
+                break;
+            }
+        }
+    }
+    pthread_mutex_unlock(&dev->lock);
+    return NULL;
+}
+
+// as Device::IrqWorker() does, with the device model for the interrupt
+void* irq_thread(void* arg) {
+    pthread_mutex_lock(&dev->lock);
+    while (!dev->stop) {
+        if (!dev->irq) {
+            pthread_cond_wait(&dev->cond, &dev->lock);
+            continue;
+        }
+        dev->irq = false;
+        pthread_mutex_unlock(&dev->lock);
+        dev->owner->IrqRingUpdate();
+        pthread_mutex_lock(&dev->lock);
+    }
+    pthread_mutex_unlock(&dev->lock);
+    return NULL;
+}
+
+} // namespace
+
+// the parts of virtio::Device which talk to pci, against the model
+
+namespace virtio {
+
+Device::Device(mx_driver_t* driver, mx_device_t* bus_device)
+    : driver_(driver), bus_device_(bus_device) {}
+
+Device::~Device() {}
+
+mx_status_t Device::Bind(pci_protocol_t*, mx_handle_t pci_config_handle, const pci_config_t*) {
+    return ERR_NOT_SUPPORTED;
+}
+
+void Device::StartIrqThread() {
+    dev->owner = this;
+    pthread_create(&dev->device_thread, NULL, device_thread, NULL);
+    pthread_create(&dev->irq_thread, NULL, irq_thread, NULL);
+    dev->started = true;
+}
+
+uint16_t Device::GetRingSize(uint16_t index) {
+    return (index < kRings) ? kRingSize : 0;
+}
+
+void Device::SetRing(uint16_t index, uint16_t count, mx_paddr_t pa_desc, mx_paddr_t pa_avail,
+                     mx_paddr_t pa_used) {
+    DevRing* r = &dev->rings[index];
+    r->num = count;
+    r->desc = (vring_desc*)pa_desc;
+    r->avail = (vring_avail*)pa_avail;
+    r->used = (vring_used*)pa_used;
+}
+
+void Device::RingKick(uint16_t ring_index) {
+    pthread_mutex_lock(&dev->lock);
+    dev->kicks++;
+    dev->kicked = true;
+    pthread_cond_broadcast(&dev->cond);
+    pthread_mutex_unlock(&dev->lock);
+}
+
+mx_status_t Device::CopyDeviceConfig(void* _buf, size_t len) {
+    uint8_t config[10];
+    uint16_t status = VIRTIO_NET_S_LINK_UP;
+    uint16_t pairs = kMaxPairs;
+    memcpy(config, kMac, 6);
+    memcpy(config + 6, &status, 2);
+    memcpy(config + 8, &pairs, 2);
+    memcpy(_buf, config, MIN(len, sizeof(config)));
+    return NO_ERROR;
+}
+
+void Device::Reset() {}
+void Device::StatusAcknowledgeDriver() {}
+void Device::StatusDriverOK() {}
+
+uint32_t Device::ReadFeatures() {
+    return dev->cfg->features;
+}
+
+mx_status_t Device::WriteFeatures(uint32_t features) {
+    if (features & ~dev->cfg->features)
+        return ERR_NOT_SUPPORTED;
+    dev->features = features;
+    return NO_ERROR;
+}
+
+mx_status_t map_contiguous_memory(size_t size, uintptr_t* va, mx_paddr_t* pa) {
+    size = (size + PAGE_SIZE - 1) & ~(size_t)(PAGE_SIZE - 1);
+    void* p = aligned_alloc(PAGE_SIZE, size);
+    if (p == NULL)
+        return ERR_NO_MEMORY;
+    memset(p, 0, size);
+    *va = (uintptr_t)p;
+    *pa = (mx_paddr_t)p;
+    return NO_ERROR;
+}
+
+} // namespace virtio
+
+// what the driver needs from the devhost and the kernel
+
+mx_handle_t __magenta_vmar_root_self;
+
+extern "C" {
+
+void device_init(mx_device_t* device, mx_driver_t* driver,
+                 const char* name, mx_protocol_device_t* ops) {
+    memset(device, 0, sizeof(*device));
+    device->ops = ops;
+}
+
+mx_status_t device_add(mx_device_t* device, mx_device_t* parent) {
+    dev->added = device;
+    return NO_ERROR;
+}
+
+uint32_t mx_num_cpus(void) {
+    return kMaxPairs;
+}
+
+mx_status_t mx_cprng_draw(void* buffer, size_t len, size_t* actual) {
+    memset(buffer, 0x5a, len);
+    *actual = len;
+    return NO_ERROR;
+}
+
+mx_status_t mx_nanosleep(mx_time_t nanoseconds) {
+    struct timespec ts = {(time_t)(nanoseconds / MX_SEC(1)), (long)(nanoseconds % MX_SEC(1))};
+    nanosleep(&ts, NULL);
+    return NO_ERROR;
+}
+
+mx_status_t mx_vmar_unmap(mx_handle_t vmar_handle, uintptr_t addr, size_t len) {
+    free((void*)addr);
+    return NO_ERROR;
+}
+
+mx_status_t mx_handle_close(mx_handle_t handle) {
+    return NO_ERROR;
+}
+
+} // extern "C"
+
+namespace {
+
+struct Sender {
+    unsigned id;
+    uint32_t frames;
+    ethmac_protocol_t* ops;
+    uint64_t bytes;
+    pthread_t thread;
+
+    // the receive side's progress through this sender's frames
+    uint32_t expect;
+    std::atomic<uint32_t> received;
+};
+
+Sender senders[kMaxPairs];
+unsigned sender_count;
+std::atomic<bool> abort_run;
+
+uint64_t batches;
+uint64_t errors;
+
+size_t frame_length(unsigned id, uint32_t seq) {
+    return kMinFrame + (seq * 7919u + id * 131u) % (kMaxFrame - kMinFrame + 1);
+}
+
+void fill_frame(uint8_t* frame, size_t len, unsigned id, uint32_t seq) {
+    memcpy(frame, kMac, 6);
+    const uint8_t src[6] = {0x02, 0, 0, 0, 0, (uint8_t)id};
+    memcpy(frame + 6, src, 6);
+    frame[12] = 0x88;
+    frame[13] = 0xb5;
+    frame[kCsumStart] = 0;
+    frame[kCsumStart + 1] = 0;
+    frame[kIdOffset] = (uint8_t)id;
+    memcpy(frame + kSeqOffset, &seq, sizeof(seq));
+    for (size_t n = kSeqOffset + sizeof(seq); n < len; n++) {
+        frame[n] = (uint8_t)(seq + n);
+    }
+}
+
+void fail(const char* fmt, uint32_t a, uint32_t b) {
+    if (errors++ < 10) {
+        fprintf(stderr, "%s: ", appname);
+        fprintf(stderr, fmt, a, b);
+        fprintf(stderr, "\n");
+    }
+}
+
+// one's complement sum over the frame from kCsumStart, checksum included
+bool csum_ok(const uint8_t* frame, size_t len) {
+    uint32_t sum = 0;
+    size_t i;
+    for (i = kCsumStart; i + 1 < len; i += 2) {
+        sum += (uint32_t)((frame[i] << 8) | frame[i + 1]);
+    }
+    if (i < len)
+        sum += (uint32_t)(frame[i] << 8);
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    return sum == 0xffff;
+}
+
+void check_frame(const ethmac_rx_frame_t* f) {
+    const uint8_t* frame = (const uint8_t*)f->data;
+    uint32_t seq;
+    if (f->length < kMinFrame || frame[kIdOffset] >= sender_count) {
+        fail("frame of %u bytes from sender %u", (uint32_t)f->length,
+             (f->length > kIdOffset) ? frame[kIdOffset] : 0);
+        return;
+    }
+    Sender* s = &senders[frame[kIdOffset]];
+    memcpy(&seq, frame + kSeqOffset, sizeof(seq));
+    if (seq != s->expect)
+        fail("frame %u arrived when %u was due", seq, s->expect);
+    s->expect = seq + 1;
+
+    size_t len = frame_length(s->id, seq);
+    if (f->length != len) {
+        fail("frame %u is %u bytes long", seq, (uint32_t)f->length);
+    } else {
+        for (size_t n = kSeqOffset + sizeof(seq); n < len; n++) {
+            if (frame[n] != (uint8_t)(seq + n)) {
+                fail("frame %u is corrupt at byte %u", seq, (uint32_t)n);
+                break;
+            }
+        }
+    }
+
+    uint32_t flags = 0;
+    if ((dev->features & VIRTIO_NET_F_GUEST_CSUM) && dev->cfg->csum_flags)
+        flags = ETHMAC_RX_CSUM_VALID;
+    if (f->flags != flags)
+        fail("frame %u has flags %#x", seq, f->flags);
+    if ((dev->cfg->csum_flags & VIRTIO_NET_HDR_F_NEEDS_CSUM) && !csum_ok(frame, f->length))
+        fail("frame %u has a bad checksum, %#x", seq, (uint32_t)((frame[14] << 8) | frame[15]));
+
+    s->received.store(seq + 1);
+}
+
+void test_status(void* cookie, uint32_t status) {}
+
+void test_recv(void* cookie, void* data, size_t length, uint32_t flags) {
+    ethmac_rx_frame_t f = {data, length, flags};
+    check_frame(&f);
+}
+
+void test_recv_batch(void* cookie, ethmac_rx_frame_t* frames, size_t count) {
+    batches++;
+    for (size_t n = 0; n < count; n++) {
+        check_frame(&frames[n]);
+    }
+}
+
+ethmac_ifc_t test_ifc;
+
+void* send_thread(void* arg) {
+    Sender* s = (Sender*)arg;
+    uint8_t frame[kMaxFrame];
+    for (uint32_t seq = 0; seq < s->frames; seq++) {
+        while (seq - s->received.load() >= kWindow) {
+            if (abort_run)
+                return NULL;
+            sched_yield();
+        }
+        size_t len = frame_length(s->id, seq);
+        fill_frame(frame, len, s->id, seq);
+        s->ops->send(dev->added, 0, frame, len);
+        s->bytes += len;
+    }
+    return NULL;
+}
+
+double now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+bool all_received() {
+    for (unsigned n = 0; n < sender_count; n++) {
+        if (senders[n].received.load() != senders[n].frames)
+            return false;
+    }
+    return true;
+}
+
+uint32_t received_count() {
+    uint32_t count = 0;
+    for (unsigned n = 0; n < sender_count; n++) {
+        count += senders[n].received.load();
+    }
+    return count;
+}
+
+bool run(const Config* cfg, uint32_t frames) {
+    Loopback loopback;
+    loopback.cfg = cfg;
+    dev = &loopback;
+    batches = 0;
+    errors = 0;
+    abort_run = false;
+
+    mx_driver_t driver = {};
+    mx_device_t bus = {};
+    virtio::NetDevice* nd = new virtio::NetDevice(&driver, &bus);
+    if (nd->Init() != NO_ERROR || dev->added == nullptr) {
+        fprintf(stderr, "%s: %s: driver did not come up\n", appname, cfg->name);
+        return false;
+    }
+    ethmac_protocol_t* ops = (ethmac_protocol_t*)dev->added->protocol_ops;
+    test_ifc.status = test_status;
+    test_ifc.recv = test_recv;
+    test_ifc.recv_batch = test_recv_batch;
+    if (ops->start(dev->added, &test_ifc, nullptr) != NO_ERROR) {
+        fprintf(stderr, "%s: %s: cannot start\n", appname, cfg->name);
+        return false;
+    }
+
+    sender_count = cfg->senders;
+    double start = now();
+    for (unsigned n = 0; n < sender_count; n++) {
+        Sender* s = &senders[n];
+        s->id = n;
+        s->frames = frames / sender_count;
+        s->ops = ops;
+        s->bytes = 0;
+        s->expect = 0;
+        s->received.store(0);
+        pthread_create(&s->thread, NULL, send_thread, s);
+    }
+
+    // give up once nothing has come in for a second
+    uint32_t last = 0;
+    double progress = start;
+    while (!all_received()) {
+        uint32_t count = received_count();
+        if (count != last) {
+            last = count;
+            progress = now();
+        } else if (now() - progress > 1.0) {
+            fprintf(stderr, "%s: %s: stalled after %u frames\n", appname, cfg->name, count);
+            abort_run = true;
+            errors++;
+            break;
+        }
+        struct timespec ts = {0, 1000 * 1000};
+        nanosleep(&ts, NULL);
+    }
+    double elapsed = now() - start;
+    uint32_t received = received_count();
+
+    uint64_t bytes = 0;
+    uint32_t sent = 0;
+    for (unsigned n = 0; n < sender_count; n++) {
+        pthread_join(senders[n].thread, NULL);
+        bytes += senders[n].bytes;
+        sent += senders[n].frames;
+    }
+
+    eth_stats_t stats;
+    ops->get_stats(dev->added, &stats);
+    ops->stop(dev->added);
+
+    pthread_mutex_lock(&dev->lock);
+    dev->stop = true;
+    pthread_cond_broadcast(&dev->cond);
+    pthread_mutex_unlock(&dev->lock);
+    if (dev->started) {
+        pthread_join(dev->device_thread, NULL);
+        pthread_join(dev->irq_thread, NULL);
+    }
+    delete nd;
+
+    uint16_t pairs = (cfg->features & VIRTIO_NET_F_MQ) ? kMaxPairs : 1;
+    if (dev->pairs != pairs) {
+        fprintf(stderr, "%s: %s: %u queue pairs enabled, not %u\n", appname, cfg->name,
+                dev->pairs, pairs);
+        errors++;
+    }
+    if (stats.tx_packets != sent || stats.rx_packets != sent ||
+        stats.tx_dropped != 0 || stats.rx_dropped != 0) {
+        fprintf(stderr, "%s: %s: sent %" PRIu64 ", received %" PRIu64 ", dropped %" PRIu64
+                        " and %" PRIu64 "\n",
+                appname, cfg->name, stats.tx_packets, stats.rx_packets,
+                stats.tx_dropped, stats.rx_dropped);
+        errors++;
+    }
+    if (dev->missed_kicks != 0 || dev->bad_chains != 0) {
+        fprintf(stderr, "%s: %s: %" PRIu64 " missed kicks, %" PRIu64 " bad chains\n",
+                appname, cfg->name, dev->missed_kicks, dev->bad_chains);
+        errors++;
+    }
+
+    printf("%-10s %u pair%s: %u frames, %.0f frames/s, %.1f MB/s, "
+           "%.1f frames/irq, %.1f frames/batch, %.2f kicks/frame\n",
+           cfg->name, dev->pairs, (dev->pairs == 1) ? "" : "s", received,
+           received / elapsed, bytes / elapsed / 1e6,
+           (double)received / (double)MAX(dev->irqs, 1u),
+           (double)received / (double)MAX(batches, 1u),
+           (double)dev->kicks / (double)MAX(received, 1u));
+    dev = nullptr;
+    return errors == 0;
+}
+
+} // namespace
+
+int main(int argc, char** argv) {
+    appname = argv[0];
+    if (argc > 2) {
+        fprintf(stderr, "usage: %s [frames]\n", appname);
+        return -1;
+    }
+    uint32_t frames = (argc > 1) ? (uint32_t)atoi(argv[1]) : 200000;
+
+    bool ok = true;
+    for (size_t n = 0; n < sizeof(configs) / sizeof(configs[0]); n++) {
+        ok &= run(&configs[n], frames);
+    }
+
+    printf("%s\n", ok ? "PASSED" : "FAILED");
+    return ok ? 0 : -1;
+}
@@ -9,10 +9,15 @@
 #include <string.h>
 #include <unistd.h>
 #include <limits.h>
+#include <stdbool.h>
 #include <sys/param.h>
+#include <threads.h>
 
+#include <magenta/syscalls.h>
 #include <magenta/types.h>
 #include <magenta/device/block.h>
+#include <magenta/hw/usb.h>
+#include <magenta/device/usb.h>
 
 #include <mxio/io.h>
 
@@ -106,6 +111,172 @@ fail:
     return rc;
 }
 
+typedef struct {
+    const char* dev;
+    uint64_t index;
+    uint64_t threads;
+    uint64_t xfer;
+    uint64_t count;
+    ssize_t rc;
+} perf_thread_t;
+
+static int perf_thread(void* arg) {
+    perf_thread_t* pt = arg;
+    void* buf = NULL;
+    pt->rc = -1;
+
+    // each thread is a separate client of the device
+    int fd = open(pt->dev, O_RDONLY);
+    if (fd < 0) {
+        printf("Cannot open %s!\n", pt->dev);
+        return 0;
+    }
+    if ((buf = malloc(pt->xfer)) == NULL) {
+        printf("Out of memory!\n");
+        goto fail;
+    }
+
+    // the threads interleave, so that together they read the device
+    // sequentially and a scheduler sees adjacent requests from different
+    // clients
+    for (uint64_t n = 0; n < pt->count; n++) {
+        mx_off_t offset = (n * pt->threads + pt->index) * pt->xfer;
+        if (lseek(fd, offset, SEEK_SET) < 0) {
+            printf("Error seeking to offset %" PRIu64 "\n", offset);
+            goto fail;
+        }
+        ssize_t actual = read(fd, buf, pt->xfer);
+        if (actual != (ssize_t)pt->xfer) {
+            printf("Error reading %" PRIu64 " bytes at offset %" PRIu64 ": %zd\n",
+                   pt->xfer, offset, actual);
+            goto fail;
+        }
+    }
+    pt->rc = 0;
+
+fail:
+    free(buf);
+    close(fd);
+    return 0;
+}
+
+static int do_perf(const char* dev, uint64_t threads, uint64_t xfer) {
+    int fd = open(dev, O_RDONLY);
+    if (fd < 0) {
+        printf("Cannot open %s!\n", dev);
+        return fd;
+    }
+
+    uint64_t size;
+    uint64_t blksize;
+    if ((ioctl_block_get_size(fd, &size) != sizeof(size)) ||
+        (ioctl_block_get_blocksize(fd, &blksize) < 0)) {
+        printf("Error getting size for %s\n", dev);
+        close(fd);
+        return -1;
+    }
+    xfer = MAX(xfer - xfer % blksize, blksize);
+    threads = MAX(threads, 1);
+    uint64_t count = MIN(size, 64 * 1024 * 1024) / (xfer * threads);
+    if (count == 0) {
+        printf("Device %s is too small\n", dev);
+        close(fd);
+        return -1;
+    }
+
+    // statistics are only available from the block scheduler
+    block_stats_t before, after;
+    bool stats = (ioctl_block_get_stats(fd, &before) == sizeof(before));
+
+    perf_thread_t pt[threads];
+    thrd_t thr[threads];
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (uint64_t i = 0; i < threads; i++) {
+        pt[i] = (perf_thread_t) {
+            .dev = dev, .index = i, .threads = threads, .xfer = xfer, .count = count, .rc = -1,
+        };
+        if (thrd_create(&thr[i], perf_thread, &pt[i]) != thrd_success) {
+            printf("Cannot create thread!\n");
+            threads = i;
+            break;
+        }
+    }
+    int rc = 0;
+    for (uint64_t i = 0; i < threads; i++) {
+        thrd_join(thr[i], NULL);
+        if (pt[i].rc < 0) {
+            rc = -1;
+        }
+    }
+    mx_time_t elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+
+    uint64_t ops = count * threads;
+    uint64_t usec = MAX(elapsed / MX_USEC(1), 1);
+    printf("%" PRIu64 " threads reading %" PRIu64 " bytes: %" PRIu64 " reads in %" PRIu64 " ms, "
+           "%" PRIu64 " reads/s, %" PRIu64 " KB/s\n", threads, xfer, ops, usec / 1000,
+           ops * 1000000 / usec, ops * xfer * 1000000 / 1024 / usec);
+
+    if (stats && (ioctl_block_get_stats(fd, &after) == sizeof(after))) {
+        printf("dispatched %" PRIu64 " merged %" PRIu64 " expired %" PRIu64
+               " throttled %" PRIu64 "\n",
+               after.dispatched - before.dispatched, after.merged - before.merged,
+               after.expired - before.expired, after.throttled - before.throttled);
+        printf("read latency:\n");
+        for (int i = 0; i < BLOCK_LATENCY_BUCKETS; i++) {
+            uint64_t n = after.read_latency[i] - before.read_latency[i];
+            if (n) {
+                printf("  < %8" PRIu64 " us: %" PRIu64 "\n", (uint64_t)2 << i, n);
+            }
+        }
+    }
+
+    close(fd);
+    return rc;
+}
+
+// run do_perf() against a usb mass storage device with the host controller's
+// interrupt moderation at a range of intervals
+static int do_usb_perf(const char* dev, const char* hci, uint64_t threads, uint64_t xfer) {
+    int fd = open(hci, O_RDWR);
+    if (fd < 0) {
+        printf("Cannot open %s!\n", hci);
+        return fd;
+    }
+    usb_hci_stats_t before, after;
+    if (ioctl_usb_hci_get_stats(fd, &before) != sizeof(before)) {
+        printf("Cannot get interrupt statistics for %s\n", hci);
+        close(fd);
+        return -1;
+    }
+    uint32_t saved = before.irq_usec;
+
+    static const uint32_t intervals[] = { 0, 10, 40, 100, 250 };
+    int rc = 0;
+    for (size_t i = 0; i < countof(intervals); i++) {
+        uint32_t usec = intervals[i];
+        if (ioctl_usb_hci_set_irq_interval(fd, &usec) < 0) {
+            printf("Cannot set interrupt interval of %u us on %s\n", usec, hci);
+            rc = -1;
+            break;
+        }
+        printf("interrupt interval %u us:\n", usec);
+        ioctl_usb_hci_get_stats(fd, &before);
+        if (do_perf(dev, threads, xfer) < 0) {
+            rc = -1;
+        }
+        ioctl_usb_hci_get_stats(fd, &after);
+        uint64_t irqs = after.irqs - before.irqs;
+        uint64_t events = after.events - before.events;
+        printf("%" PRIu64 " interrupts, %" PRIu64 " events, %" PRIu64 ".%" PRIu64
+               " events/interrupt\n", irqs, events, events / MAX(irqs, 1),
+               events * 10 / MAX(irqs, 1) % 10);
+    }
+
+    ioctl_usb_hci_set_irq_interval(fd, &saved);
+    close(fd);
+    return rc;
+}
+
 static uint64_t arg_to_u64(const char* arg) {
     int base = 10;
     if ((arg[0] == '0') && ((arg[1] == 'x') || arg[1] == 'X')) {
@@ -120,6 +291,22 @@ int main(int argc, const char** argv) {
         printf("not enough arguments!\n");
         goto usage;
     }
+    if (!strcmp(argv[1], "-p")) {
+        if (argc < 3) {
+            goto usage;
+        }
+        uint64_t threads = argc >= 4 ? arg_to_u64(argv[3]) : 4;
+        uint64_t xfer = argc >= 5 ? arg_to_u64(argv[4]) : 4096;
+        return do_perf(argv[2], threads, xfer);
+    }
+    if (!strcmp(argv[1], "-u")) {
+        if (argc < 4) {
+            goto usage;
+        }
+        uint64_t threads = argc >= 5 ? arg_to_u64(argv[4]) : 4;
+        uint64_t xfer = argc >= 6 ? arg_to_u64(argv[5]) : 65536;
+        return do_usb_perf(argv[2], argv[3], threads, xfer);
+    }
     const char* dev = argv[1];
     mx_off_t offset = argc >= 3 ? arg_to_u64(argv[2]) : 0;
     mx_off_t count = argc >= 4 ? arg_to_u64(argv[3]) : UINT64_MAX;
@@ -133,5 +320,9 @@ int main(int argc, const char** argv) {
 usage:
     printf("Usage:\n");
     printf("%s <dev> [<offset>] [<count>]\n", argv[0]);
+    printf("%s -p <dev> [<threads>] [<xfer size>]  (measure concurrent read throughput)\n",
+           argv[0]);
+    printf("%s -u <dev> <usb-hci dev> [<threads>] [<xfer size>]  (the same, over a range of\n"
+           "    host controller interrupt intervals)\n", argv[0]);
     return 0;
 }
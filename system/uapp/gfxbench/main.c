@@ -0,0 +1,182 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures libgfx throughput, in megapixels per second, for each operation
+// and pixel format under every kernel set this cpu supports. Surfaces are
+// off screen, so the numbers are free of framebuffer effects.
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <magenta/syscalls.h>
+
+#include <gfx/gfx.h>
+
+typedef struct {
+    unsigned format;
+    const char* name;
+} format_t;
+
+static const format_t formats[] = {
+    { MX_PIXEL_FORMAT_ARGB_8888, "argb8888" },
+    { MX_PIXEL_FORMAT_RGB_x888, "rgbx888" },
+    { MX_PIXEL_FORMAT_RGB_565, "rgb565" },
+    { MX_PIXEL_FORMAT_RGB_332, "rgb332" },
+    { MX_PIXEL_FORMAT_RGB_2220, "rgb2220" },
+    { MX_PIXEL_FORMAT_MONO_1, "mono" },
+};
+
+#define NFORMATS (sizeof(formats) / sizeof(formats[0]))
+
+static unsigned width = 1024;
+static unsigned height = 768;
+static unsigned iters = 20;
+
+typedef enum {
+    OP_FILL,
+    OP_SCROLL,
+    OP_COPY,
+    OP_BLEND,
+    OP_BLEND_PREMUL,
+} op_t;
+
+static const char* op_names[] = {
+    "fill", "scroll", "copy", "blend", "blend-premul",
+};
+
+// Runs one operation over the whole target iters times. The blend sources
+// hold a mix of opaque, clear and translucent pixels so that no single
+// fast path decides the result.
+static double run(op_t op, gfx_surface* target, gfx_surface* src) {
+    unsigned line = 16;
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    for (unsigned i = 0; i < iters; i++) {
+        switch (op) {
+        case OP_FILL:
+            gfx_fillrect(target, 0, 0, target->width, target->height, 0xff000000 | (i * 0x10101));
+            break;
+        case OP_SCROLL:
+            // what the console does for each new line of text
+            gfx_copyrect(target, 0, line, target->width, target->height - line, 0, 0);
+            break;
+        case OP_COPY:
+        case OP_BLEND:
+        case OP_BLEND_PREMUL:
+            gfx_blend(target, src, 0, 0, src->width, src->height, 0, 0);
+            break;
+        }
+    }
+    mx_time_t elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+    if (elapsed == 0) {
+        elapsed = 1;
+    }
+    uint64_t pixels = (uint64_t)target->width * target->height * iters;
+    return (double)pixels * 1000.0 / (double)elapsed;
+}
+
+static void fill_source(gfx_surface* src, bool premultiply) {
+    uint32_t* p = src->ptr;
+    uint32_t seed = 0x12345678;
+    for (unsigned y = 0; y < src->height; y++) {
+        for (unsigned x = 0; x < src->width; x++) {
+            seed = seed * 1103515245 + 12345;
+            uint32_t px = seed >> 8;
+            uint32_t a;
+            switch ((x / 64 + y / 64) % 3) {
+            case 0:
+                a = 0xff;
+                break;
+            case 1:
+                a = 0;
+                break;
+            default:
+                a = seed >> 24;
+                break;
+            }
+            if (premultiply) {
+                uint32_t r = ((px >> 16) & 0xff) * a / 255;
+                uint32_t g = ((px >> 8) & 0xff) * a / 255;
+                uint32_t b = (px & 0xff) * a / 255;
+                px = (r << 16) | (g << 8) | b;
+            }
+            p[x + y * src->stride] = (a << 24) | (px & 0xffffff);
+        }
+    }
+}
+
+static void usage(void) {
+    fprintf(stderr, "usage: gfxbench [-w width] [-h height] [-n iterations]\n");
+}
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; i++) {
+        if (i + 1 >= argc) {
+            usage();
+            return -1;
+        }
+        if (!strcmp(argv[i], "-w")) {
+            width = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-h")) {
+            height = strtoul(argv[++i], NULL, 0);
+        } else if (!strcmp(argv[i], "-n")) {
+            iters = strtoul(argv[++i], NULL, 0);
+        } else {
+            usage();
+            return -1;
+        }
+    }
+    if (width == 0 || height == 0 || iters == 0) {
+        usage();
+        return -1;
+    }
+
+    gfx_surface* straight = gfx_create_surface(NULL, width, height, width,
+                                               MX_PIXEL_FORMAT_ARGB_8888, 0);
+    gfx_surface* premul = gfx_create_surface(NULL, width, height, width,
+                                             MX_PIXEL_FORMAT_ARGB_8888, GFX_FLAG_PREMULTIPLIED);
+    gfx_surface* opaque = gfx_create_surface(NULL, width, height, width,
+                                             MX_PIXEL_FORMAT_RGB_x888, 0);
+    if (!straight || !premul || !opaque) {
+        fprintf(stderr, "gfxbench: out of memory\n");
+        return -1;
+    }
+    fill_source(straight, false);
+    fill_source(premul, true);
+    gfx_fillrect(opaque, 0, 0, width, height, 0xff336699);
+
+    printf("%ux%u, %u iterations, default kernels: %s\n", width, height, iters,
+           gfx_simd_name(gfx_get_simd()));
+    printf("%-8s %-10s %-13s %10s\n", "kernels", "format", "op", "Mpix/s");
+
+    unsigned initial = gfx_get_simd();
+    unsigned simds[] = { GFX_SIMD_NONE, GFX_SIMD_SSE2, GFX_SIMD_AVX2, GFX_SIMD_NEON };
+    for (unsigned s = 0; s < sizeof(simds) / sizeof(simds[0]); s++) {
+        if (gfx_set_simd(simds[s]) != NO_ERROR) {
+            continue;
+        }
+        for (unsigned f = 0; f < NFORMATS; f++) {
+            gfx_surface* target = gfx_create_surface(NULL, width, height, width,
+                                                     formats[f].format, 0);
+            if (!target) {
+                fprintf(stderr, "gfxbench: out of memory\n");
+                return -1;
+            }
+            for (op_t op = OP_FILL; op <= OP_BLEND_PREMUL; op++) {
+                gfx_surface* src = (op == OP_COPY) ? opaque :
+                                   (op == OP_BLEND_PREMUL) ? premul : straight;
+                printf("%-8s %-10s %-13s %10.1f\n", gfx_simd_name(simds[s]), formats[f].name,
+                       op_names[op], run(op, target, src));
+            }
+            gfx_surface_destroy(target);
+        }
+    }
+    gfx_set_simd(initial);
+
+    gfx_surface_destroy(straight);
+    gfx_surface_destroy(premul);
+    gfx_surface_destroy(opaque);
+    return 0;
+}
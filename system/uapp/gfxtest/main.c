@@ -49,12 +49,21 @@ int main(int argc, char* argv[]) {
     ioctl_display_set_fullscreen(vfd, &fs);
     ioctl_console_set_active_vc(vfd);
 
+    ioctl_display_flush_fb(vfd);
+
+    // only the square changes from here on, so only it needs flushing
     int d = gfx->height / 5;
+    ioctl_display_region_t r = {
+        .x = (gfx->width - d) / 2,
+        .y = (gfx->height - d) / 2,
+        .width = d,
+        .height = d,
+    };
     int i = 10;
     while (i--) {
         mx_nanosleep(MX_SEC(1));
-        gfx_fillrect(gfx, (gfx->width - d) / 2, (gfx->height - d) / 2, d, d, i % 2 ? 0xff55ff55 : 0xffaa00aa);
-        ioctl_display_flush_fb(vfd);
+        gfx_fillrect(gfx, r.x, r.y, r.width, r.height, i % 2 ? 0xff55ff55 : 0xffaa00aa);
+        ioctl_display_flush_fb_region(vfd, &r);
     }
 
     gfx_surface_destroy(gfx);
@@ -5,75 +5,313 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <fs/trace.h>
 
+#include <mxtl/algorithm.h>
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_ptr.h>
 
 #include "minfs.h"
 #include "minfs-private.h"
 
-mx_status_t Bcache::Readblk(uint32_t bno, void* data) {
-    off_t off = bno * kMinfsBlockSize;
-    trace(IO, "readblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
+constexpr uint32_t kModeFind = 0;
+constexpr uint32_t kModeLoad = 1;
+constexpr uint32_t kModeZero = 2;
+constexpr uint32_t kModeAlloc = 3; // assign a block without reading or clearing it
+
+static const char* modestr(uint32_t mode) {
+    switch (mode) {
+    case kModeFind: return "FIND";
+    case kModeLoad: return "LOAD";
+    case kModeZero: return "ZERO";
+    case kModeAlloc: return "ALLOC";
+    default: return "????";
+    }
+}
+
+namespace {
+
+// Scoped acquisition of a BcacheLock.
+class BcacheAutoLock {
+public:
+    explicit BcacheAutoLock(BcacheLock* lock) : lock_(lock) { lock_->Acquire(); }
+    ~BcacheAutoLock() { lock_->Release(); }
+
+private:
+    BcacheLock* lock_;
+};
+
+int bno_cmp(const void* a, const void* b) {
+    uint32_t x = (*static_cast<BlockNode* const*>(a))->GetKey();
+    uint32_t y = (*static_cast<BlockNode* const*>(b))->GetKey();
+    return (x > y) - (x < y);
+}
+
+} // namespace
+
+mx_status_t Bcache::ReadRun(uint32_t bno, uint32_t count, void* data) {
+    off_t off = static_cast<off_t>(bno) * blocksize_;
+    size_t len = static_cast<size_t>(count) * blocksize_;
+    trace(IO, "readblk() bno=%u count=%u off=%#llx\n", bno, count, (unsigned long long)off);
     if (lseek(fd_, off, SEEK_SET) < 0) {
         error("minfs: cannot seek to block %u\n", bno);
         return ERR_IO;
     }
-    if (read(fd_, data, kMinfsBlockSize) != kMinfsBlockSize) {
-        error("minfs: cannot read block %u\n", bno);
+    if (read(fd_, data, len) != static_cast<ssize_t>(len)) {
+        error("minfs: cannot read block %u (count %u)\n", bno, count);
         return ERR_IO;
     }
     return NO_ERROR;
 }
 
-mx_status_t Bcache::Writeblk(uint32_t bno, const void* data) {
-    off_t off = bno * kMinfsBlockSize;
-    trace(IO, "writeblk() bno=%u off=%#llx\n", bno, (unsigned long long)off);
+mx_status_t Bcache::WriteRun(uint32_t bno, uint32_t count, const void* data) {
+    off_t off = static_cast<off_t>(bno) * blocksize_;
+    size_t len = static_cast<size_t>(count) * blocksize_;
+    trace(IO, "writeblk() bno=%u count=%u off=%#llx\n", bno, count, (unsigned long long)off);
     if (lseek(fd_, off, SEEK_SET) < 0) {
         error("minfs: cannot seek to block %u\n", bno);
         return ERR_IO;
     }
-    if (write(fd_, data, kMinfsBlockSize) != kMinfsBlockSize) {
-        error("minfs: cannot write block %u\n", bno);
+    unsynced_ = true;
+    if (write(fd_, data, len) != static_cast<ssize_t>(len)) {
+        error("minfs: cannot write block %u (count %u)\n", bno, count);
         return ERR_IO;
     }
     return NO_ERROR;
 }
 
-constexpr uint32_t kModeFind = 0;
-constexpr uint32_t kModeLoad = 1;
-constexpr uint32_t kModeZero = 2;
+mx_status_t Bcache::SyncRuns() {
+    if (unsynced_) {
+        if (fsync(fd_) < 0) {
+            return ERR_IO;
+        }
+        unsynced_ = false;
+    }
+    return NO_ERROR;
+}
 
-static const char* modestr(uint32_t mode) {
-    switch (mode) {
-    case kModeFind: return "FIND";
-    case kModeLoad: return "LOAD";
-    case kModeZero: return "ZERO";
-    default: return "????";
+mx_status_t Bcache::Readblk(uint32_t bno, void* data) {
+    BcacheAutoLock lock(&lock_);
+    auto iter = hash_.find(bno);
+    if (iter.IsValid()) {
+        memcpy(data, iter->data(), blocksize_);
+        return NO_ERROR;
+    }
+    BcacheAutoLock io_lock(&io_lock_);
+    return ReadRun(bno, 1, data);
+}
+
+mx_status_t Bcache::Readblks(uint32_t bno, uint32_t count, void* data) {
+    if ((bno >= blockmax_) || (blockmax_ - bno < count)) {
+        return ERR_INVALID_ARGS;
+    }
+    BcacheAutoLock lock(&lock_);
+    mx_status_t status;
+    {
+        BcacheAutoLock io_lock(&io_lock_);
+        if ((status = ReadRun(bno, count, data)) != NO_ERROR) {
+            return status;
+        }
+    }
+    // cached copies may be newer than the disk
+    for (uint32_t n = 0; n < count; n++) {
+        auto iter = hash_.find(bno + n);
+        if (iter.IsValid()) {
+            memcpy((void*)((uintptr_t)data + n * blocksize_), iter->data(), blocksize_);
+        }
+    }
+    return NO_ERROR;
+}
+
+mx_status_t Bcache::Writeblk(uint32_t bno, const void* data, uint32_t flags) {
+    // Stage the write in the cache; it reaches the disk with its neighbours
+    // when the dirty blocks are flushed.
+    mxtl::RefPtr<BlockNode> blk = Get(bno, kModeFind);
+    if (blk == nullptr && (blk = Get(bno, kModeAlloc)) == nullptr) {
+        return ERR_IO;
+    }
+    memcpy(blk->data(), data, blocksize_);
+    Put(mxtl::move(blk), kBlockDirty | flags);
+    return NO_ERROR;
+}
+
+void Bcache::MarkDirty(BlockNode* blk, uint32_t flags) {
+    // File data bypasses the journal, unless the journal still holds an
+    // older copy of the block from when it was metadata: replay would write
+    // that over the data, so the data must be journaled after it.
+    if ((jnl_count_ != 0) && !(blk->flags_ & kBlockJournal) &&
+        (!(flags & kBlockData) || JournalHolds(blk->bno_))) {
+        blk->flags_ |= kBlockJournal;
+        jnl_dirty_++;
+    }
+    if (blk->flags_ & kBlockDirty) {
+        return;
+    }
+    assert(dirty_count_ < dirty_cap_);
+    blk->flags_ |= kBlockDirty;
+    dirty_.get()[dirty_count_++] = blk;
+}
+
+uint32_t Bcache::CollectRun(uint32_t* bno_out) {
+    BlockNode** dirty = dirty_.get();
+    qsort(dirty, dirty_count_, sizeof(BlockNode*), bno_cmp);
+
+    // busy blocks are still being modified; they are picked up after their
+    // Put(). Journaled blocks wait for their transaction to commit.
+    const uint32_t skip = kBlockBusy | kBlockJournal;
+    uint32_t first = 0;
+    while ((first < dirty_count_) && (dirty[first]->flags_ & skip)) {
+        first++;
+    }
+    if (first == dirty_count_) {
+        return 0;
+    }
+    uint32_t end = first + 1;
+    while ((end < dirty_count_) && (end - first < kMinfsMaxRun) &&
+           (dirty[end]->bno_ == dirty[end - 1]->bno_ + 1) &&
+           !(dirty[end]->flags_ & skip)) {
+        end++;
+    }
+
+    char* buf = run_buf_.get();
+    for (uint32_t n = first; n < end; n++) {
+        memcpy(buf + (n - first) * blocksize_, dirty[n]->data(), blocksize_);
+        dirty[n]->flags_ &= ~kBlockDirty;
+    }
+    *bno_out = dirty[first]->bno_;
+    memmove(&dirty[first], &dirty[end], (dirty_count_ - end) * sizeof(BlockNode*));
+    dirty_count_ -= end - first;
+    return end - first;
+}
+
+void Bcache::FlushLocked() {
+    BcacheAutoLock io_lock(&io_lock_);
+    uint32_t bno;
+    uint32_t count;
+    while ((count = CollectRun(&bno)) > 0) {
+        if (WriteRun(bno, count, run_buf_.get()) != NO_ERROR) {
+            error("minfs: block write error!\n");
+            write_error_ = true;
+        }
+    }
+}
+
+#ifdef __Fuchsia__
+int Bcache::FlusherThread(void* arg) {
+    Bcache* bc = static_cast<Bcache*>(arg);
+    bc->lock_.Acquire();
+    while (!bc->flusher_exit_) {
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_sec += kMinfsFlushIntervalMs / 1000;
+        deadline.tv_nsec += (kMinfsFlushIntervalMs % 1000) * 1000000;
+        if (deadline.tv_nsec >= 1000000000) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000;
+        }
+        cnd_timedwait(&bc->flush_cnd_, bc->lock_.GetInternal(), &deadline);
+        bc->CommitLocked();
+
+        // Write back one run at a time. Holding io_lock_ (but not lock_)
+        // across each transfer lets cache hits proceed while it is in flight,
+        // while anything that must touch the disk waits for it to land.
+        uint32_t bno;
+        uint32_t count;
+        bc->io_lock_.Acquire();
+        while ((count = bc->CollectRun(&bno)) > 0) {
+            bc->lock_.Release();
+            if (bc->WriteRun(bno, count, bc->run_buf_.get()) != NO_ERROR) {
+                error("minfs: block write error!\n");
+                bc->write_error_ = true;
+            }
+            bc->io_lock_.Release();
+            bc->lock_.Acquire();
+            bc->io_lock_.Acquire();
+        }
+        bc->io_lock_.Release();
     }
+    bc->lock_.Release();
+    return 0;
 }
+#endif
 
 void Bcache::Invalidate() {
+    BcacheAutoLock lock(&lock_);
+    CommitLocked();
+    FlushLocked();
     mxtl::RefPtr<BlockNode> blk;
     uint32_t n = 0;
     while ((blk = lists_.PopFront(kBlockLRU)) != nullptr) {
         // remove from hash, bno to be reassigned
-        assert(!(blk->flags_ & kBlockBusy));
+        assert(!(blk->flags_ & (kBlockBusy | kBlockDirty)));
         hash_.erase(*blk);
         lists_.PushBack(mxtl::move(blk), kBlockFree);
         n++;
     }
+    last_miss_ = 0;
+    ra_window_ = 0;
     trace(BCACHE, "[ %d blocks dropped ]\n", n);
 }
 
+mx_status_t Bcache::Grow() {
+    if (lists_.Count() == dirty_cap_) {
+        uint32_t cap = dirty_cap_ * 2;
+        void* dirty = realloc(dirty_.get(), cap * sizeof(BlockNode*));
+        if (dirty == nullptr) {
+            return ERR_NO_MEMORY;
+        }
+        dirty_.release();
+        dirty_.reset(static_cast<BlockNode**>(dirty));
+        dirty_cap_ = cap;
+    }
+    trace(BCACHE, "bcache: growing to %u blocks\n", lists_.Count() + 1);
+    return BlockNode::Create(this);
+}
+
+mxtl::RefPtr<BlockNode> Bcache::Reclaim() {
+    mxtl::RefPtr<BlockNode> blk;
+    if ((blk = lists_.PopFront(kBlockFree)) != nullptr) {
+        return blk;
+    }
+    for (uint32_t n = lists_.Count(); n > 0; n--) {
+        if ((blk = lists_.PopFront(kBlockLRU)) == nullptr) {
+            break;
+        }
+        if (blk->flags_ & kBlockDirty) {
+            // write back everything rather than just this block, so that
+            // neighbouring dirty blocks share the transfer
+            bool journaled = blk->flags_ & kBlockJournal;
+            lists_.PushBack(mxtl::move(blk), kBlockLRU);
+            if (journaled) {
+                if (txn_depth_ > 0) {
+                    // pinned until the open transaction commits
+                    continue;
+                }
+                CommitLocked();
+            }
+            FlushLocked();
+            continue;
+        }
+        // remove from hash, bno to be reassigned
+        hash_.erase(*blk);
+        return blk;
+    }
+    // every block is busy, or pinned by the open transaction
+    if (Grow() != NO_ERROR) {
+        return nullptr;
+    }
+    return lists_.PopFront(kBlockFree);
+}
+
 mxtl::RefPtr<BlockNode> Bcache::Get(uint32_t bno, uint32_t mode) {
     trace(BCACHE,"bcache_get() bno=%u %s\n", bno, modestr(mode));
     if (bno >= blockmax_) {
         return nullptr;
     }
+    BcacheAutoLock lock(&lock_);
     mxtl::RefPtr<BlockNode> blk = hash_.find(bno).CopyPointer();
     if (blk != nullptr) {
         // remove from lru
@@ -81,7 +319,7 @@ mxtl::RefPtr<BlockNode> Bcache::Get(uint32_t bno, uint32_t mode) {
         assert(!(blk->flags_ & kBlockBusy));
         lists_.Erase(blk, kBlockLRU);
         if (mode == kModeZero) {
-            blk->flags_ |= kBlockDirty;
+            MarkDirty(blk.get(), 0);
             memset(blk->data(), 0, blocksize_);
         }
         goto done;
@@ -89,23 +327,30 @@ mxtl::RefPtr<BlockNode> Bcache::Get(uint32_t bno, uint32_t mode) {
     if (mode == kModeFind) {
         blk = nullptr;
     } else {
-        if ((blk = lists_.PopFront(kBlockFree)) != nullptr) {
-            // nothing extra to do
-        } else if ((blk = lists_.PopFront(kBlockLRU)) != nullptr) {
-            // remove from hash, bno to be reassigned
-            hash_.erase(*blk);
-        } else {
-            panic("bcache: out of blocks\n");
+        if ((blk = Reclaim()) == nullptr) {
+            error("bcache: out of blocks\n");
+            return nullptr;
         }
         blk->bno_ = bno;
         hash_.insert(blk);
-        assert(hash_.size() <= kMinfsBlockCacheSize);
+        assert(hash_.size() <= lists_.Count());
         if (mode == kModeZero) {
-            blk->flags_ |= kBlockDirty;
+            MarkDirty(blk.get(), 0);
             memset(blk->data(), 0, blocksize_);
-        } else if (Readblk(bno, blk->data()) < 0) {
-            panic("bcache: bno %u read error!\n", bno);
+            goto done;
+        } else if (mode == kModeAlloc) {
+            goto done;
+        }
+        lists_.PushBack(blk, kBlockBusy);
+        if (Load(blk) != NO_ERROR) {
+            error("bcache: bno %u read error!\n", bno);
+            hash_.erase(*blk);
+            lists_.Erase(blk, kBlockBusy);
+            lists_.PushBack(mxtl::move(blk), kBlockFree);
+            return nullptr;
         }
+        trace(BCACHE, "bcache_get bno=%u %p\n", bno, blk.get());
+        return blk;
     }
 done:
     if (blk) {
@@ -115,6 +360,57 @@ done:
     return blk;
 }
 
+mx_status_t Bcache::Load(const mxtl::RefPtr<BlockNode>& blk) {
+    uint32_t bno = blk->bno_;
+
+    // Misses on consecutive blocks open a readahead window, doubling up
+    // to kMinfsMaxRun blocks (or a quarter of the cache) per transfer.
+    if ((last_miss_ != 0) && (bno == last_miss_ + 1)) {
+        ra_window_ = (ra_window_ == 0) ? 2 : ra_window_ * 2;
+        ra_window_ = mxtl::min(ra_window_, mxtl::min(kMinfsMaxRun, lists_.Count() / 4));
+    } else {
+        ra_window_ = 0;
+    }
+    last_miss_ = bno;
+
+    // Gather blocks for the readahead before touching the disk, since
+    // Reclaim() may need to write back dirty blocks. They stay busy until
+    // they hold valid data.
+    mxtl::RefPtr<BlockNode> ra[kMinfsMaxRun];
+    uint32_t count = 1;
+    while ((count < ra_window_) && (bno + count < blockmax_) &&
+           !hash_.find(bno + count).IsValid()) {
+        if ((ra[count] = Reclaim()) == nullptr) {
+            break;
+        }
+        ra[count]->bno_ = bno + count;
+        lists_.PushBack(ra[count], kBlockBusy);
+        count++;
+    }
+
+    mx_status_t status;
+    {
+        BcacheAutoLock io_lock(&io_lock_);
+        if ((status = ReadRun(bno, count, run_buf_.get())) == NO_ERROR) {
+            for (uint32_t n = 0; n < count; n++) {
+                BlockNode* dst = (n == 0) ? blk.get() : ra[n].get();
+                memcpy(dst->data(), run_buf_.get() + n * blocksize_, blocksize_);
+            }
+        }
+    }
+    for (uint32_t n = 1; n < count; n++) {
+        lists_.Erase(ra[n], kBlockBusy);
+        if (status == NO_ERROR) {
+            hash_.insert(ra[n]);
+            lists_.PushBack(mxtl::move(ra[n]), kBlockLRU);
+        } else {
+            lists_.PushBack(mxtl::move(ra[n]), kBlockFree);
+        }
+    }
+    last_miss_ = bno + count - 1;
+    return status;
+}
+
 mxtl::RefPtr<BlockNode> Bcache::Get(uint32_t bno) {
     return Get(bno, kModeLoad);
 }
@@ -125,16 +421,24 @@ mxtl::RefPtr<BlockNode> Bcache::GetZero(uint32_t bno) {
 
 void Bcache::Put(mxtl::RefPtr<BlockNode> blk, uint32_t flags) {
     trace(BCACHE, "bcache_put() bno=%u%s\n", blk->bno_, (flags & kBlockDirty) ? " DIRTY" : "");
+    BcacheAutoLock lock(&lock_);
     assert(blk->flags_ & kBlockBusy);
     // remove from busy list
     lists_.Erase(blk, kBlockBusy);
-    if ((flags | blk->flags_) & kBlockDirty) {
-        if (Writeblk(blk->bno_, blk->data()) < 0) {
-            error("block write error!\n");
-        }
-        blk->flags_ &= ~kBlockDirty;
+    if (flags & kBlockDirty) {
+        MarkDirty(blk.get(), flags);
     }
     lists_.PushBack(mxtl::move(blk), kBlockLRU);
+
+    if (dirty_count_ - jnl_dirty_ >= lists_.Count() / kMinfsDirtyRatio) {
+#ifdef __Fuchsia__
+        if (flusher_running_) {
+            cnd_signal(&flush_cnd_);
+            return;
+        }
+#endif
+        FlushLocked();
+    }
 }
 
 mx_status_t Bcache::Read(uint32_t bno, void* data, uint32_t off, uint32_t len) {
@@ -153,8 +457,32 @@ mx_status_t Bcache::Read(uint32_t bno, void* data, uint32_t off, uint32_t len) {
     }
 }
 
+void Bcache::BeginTxn() {
+    BcacheAutoLock lock(&lock_);
+    txn_depth_++;
+}
+
+void Bcache::EndTxn() {
+    BcacheAutoLock lock(&lock_);
+    assert(txn_depth_ > 0);
+    // Commits are batched across operations, but kept small enough that the
+    // journal always has room for the next one.
+    if ((--txn_depth_ == 0) && (jnl_dirty_ >= jnl_count_ / 4)) {
+        CommitLocked();
+    }
+}
+
 int Bcache::Sync() {
-    return fsync(fd_);
+    BcacheAutoLock lock(&lock_);
+    CommitLocked();
+    FlushLocked();
+    BcacheAutoLock io_lock(&io_lock_);
+    return (SyncRuns() == NO_ERROR) ? 0 : -1;
+}
+
+uint32_t Bcache::CacheSizeFor(uint32_t blockmax) {
+    // 1/256th of the device: 4MB of cache per GB
+    return mxtl::min(mxtl::max(blockmax / 256, kMinfsBlockCacheMin), kMinfsBlockCacheMax);
 }
 
 mx_status_t Bcache::Create(Bcache** out, int fd, uint32_t blockmax, uint32_t blocksize,
@@ -163,6 +491,12 @@ mx_status_t Bcache::Create(Bcache** out, int fd, uint32_t blockmax, uint32_t blo
     if (bc == nullptr) {
         return ERR_NO_MEMORY;
     }
+    bc->dirty_.reset(static_cast<BlockNode**>(malloc(num * sizeof(BlockNode*))));
+    bc->run_buf_.reset(static_cast<char*>(malloc(kMinfsMaxRun * blocksize)));
+    if ((bc->dirty_ == nullptr) || (bc->run_buf_ == nullptr)) {
+        return ERR_NO_MEMORY;
+    }
+    bc->dirty_cap_ = num;
     while (num > 0) {
         mx_status_t status;
         if ((status = BlockNode::Create(bc.get())) != NO_ERROR) {
@@ -170,11 +504,41 @@ mx_status_t Bcache::Create(Bcache** out, int fd, uint32_t blockmax, uint32_t blo
         }
         num--;
     }
+#ifdef __Fuchsia__
+    // Without a flusher, write-behind falls back to flushing from Put().
+    if (cnd_init(&bc->flush_cnd_) == thrd_success) {
+        if (thrd_create_with_name(&bc->flusher_, FlusherThread, bc.get(),
+                                  "minfs-flusher") == thrd_success) {
+            bc->flusher_running_ = true;
+        } else {
+            cnd_destroy(&bc->flush_cnd_);
+        }
+    }
+#endif
     *out = bc.release();
     return NO_ERROR;
 }
 
 int Bcache::Close() {
+#ifdef __Fuchsia__
+    if (flusher_running_) {
+        lock_.Acquire();
+        flusher_exit_ = true;
+        cnd_signal(&flush_cnd_);
+        lock_.Release();
+        thrd_join(flusher_, nullptr);
+        cnd_destroy(&flush_cnd_);
+        flusher_running_ = false;
+    }
+#endif
+    {
+        BcacheAutoLock lock(&lock_);
+        CommitLocked();
+        if (jnl_count_ != 0) {
+            CheckpointLocked();
+        }
+    }
+    Sync();
     return close(fd_);
 }
 
@@ -182,35 +546,40 @@ Bcache::Bcache(int fd, uint32_t blockmax, uint32_t blocksize) :
     fd_(fd), blockmax_(blockmax), blocksize_(blocksize) {}
 Bcache::~Bcache() {}
 
-size_t BcacheLists::SizeAllSlow() const {
-    return list_busy_.size_slow() + list_lru_.size_slow() + list_free_.size_slow();
+void BcacheLists::Add(mxtl::RefPtr<BlockNode> blk) {
+    count_++;
+    PushBack(mxtl::move(blk), kBlockFree);
 }
 
 void BcacheLists::PushBack(mxtl::RefPtr<BlockNode> blk, uint32_t block_type) {
-    assert(SizeAllSlow() < kMinfsBlockCacheSize);
+    assert(listed_ < count_);
     block_type &= kBlockLLFlags;
     auto ll = GetList(block_type);
     blk->flags_ |= block_type;
     ll->push_back(mxtl::move(blk));
+    listed_++;
 }
 
 mxtl::RefPtr<BlockNode> BcacheLists::PopFront(uint32_t block_type) {
-    assert(SizeAllSlow() == kMinfsBlockCacheSize);
+    assert(listed_ == count_);
     block_type &= kBlockLLFlags;
     auto ll = GetList(block_type);
     auto blk = ll->pop_front();
-    if (blk != nullptr)
+    if (blk != nullptr) {
         blk->flags_ &= ~block_type;
+        listed_--;
+    }
     return blk;
 }
 
 mxtl::RefPtr<BlockNode> BcacheLists::Erase(mxtl::RefPtr<BlockNode> blk, uint32_t block_type) {
-    assert(SizeAllSlow() == kMinfsBlockCacheSize);
+    assert(listed_ == count_);
     block_type &= kBlockLLFlags;
     auto ll = GetList(block_type);
     blk->flags_ &= ~block_type;
     auto ptr = ll->erase(*blk);
     assert(ptr != nullptr);
+    listed_--;
     return ptr;
 }
 
@@ -233,7 +602,7 @@ mx_status_t BlockNode::Create(Bcache* bc) {
     if (blk->data_ == nullptr) {
         return ERR_NO_MEMORY;
     }
-    bc->lists_.PushBack(mxtl::move(blk), kBlockFree);
+    bc->lists_.Add(mxtl::move(blk));
     return NO_ERROR;
 }
 
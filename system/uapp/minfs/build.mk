@@ -37,7 +37,7 @@ endif
 
 SRCS += main.cpp test.cpp
 LIBMINFS_SRCS += host.cpp bitmap.cpp bcache.cpp
-LIBMINFS_SRCS += minfs.cpp minfs-ops.cpp minfs-check.cpp
+LIBMINFS_SRCS += minfs.cpp minfs-ops.cpp minfs-check.cpp journal.cpp
 LIBFS_SRCS += vfs.c
 LIBMXCPP_SRCS := new.cpp pure_virtual.cpp
 
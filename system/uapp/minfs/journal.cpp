@@ -0,0 +1,339 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <fs/trace.h>
+
+#include <mxtl/algorithm.h>
+#include <mxtl/unique_free_ptr.h>
+
+#include "minfs.h"
+#include "minfs-private.h"
+
+uint32_t minfs_journal_checksum(uint32_t sum, const void* data, size_t len) {
+    const uint8_t* ptr = static_cast<const uint8_t*>(data);
+    while (len-- > 0) {
+        sum = (sum ^ (*ptr++)) * FNV32_PRIME;
+    }
+    return sum;
+}
+
+mx_status_t Bcache::WriteEntry(BlockNode** blks, uint32_t count, uint32_t flags) {
+    assert((count > 0) && (count <= kMinfsJournalEntryMax));
+    assert(jnl_head_ + 1 + count <= jnl_count_);
+
+    io_lock_.Acquire();
+    char* buf = run_buf_.get();
+    minfs_journal_entry_t* hdr = reinterpret_cast<minfs_journal_entry_t*>(buf);
+    memset(hdr, 0, blocksize_);
+    hdr->magic = kMinfsJournalEntryMagic;
+    hdr->seq = jnl_seq_;
+    hdr->count = count;
+    hdr->flags = flags;
+    uint32_t sum = FNV32_OFFSET_BASIS;
+    for (uint32_t n = 0; n < count; n++) {
+        hdr->bno[n] = blks[n]->bno_;
+        sum = minfs_journal_checksum(sum, blks[n]->data(), blocksize_);
+    }
+    sum = minfs_journal_checksum(sum, hdr->bno, count * sizeof(uint32_t));
+    hdr->checksum = minfs_journal_checksum(sum, &hdr->flags, sizeof(hdr->flags));
+
+    // The header shares the first transfer with as many blocks as fit; the
+    // rest of the entry follows contiguously.
+    mx_status_t status = NO_ERROR;
+    uint32_t bno = jnl_start_ + jnl_head_;
+    uint32_t used = 1;
+    for (uint32_t n = 0; n <= count; n++) {
+        if ((used == kMinfsMaxRun) || (n == count)) {
+            if ((status = WriteRun(bno, used, buf)) != NO_ERROR) {
+                break;
+            }
+            bno += used;
+            used = 0;
+        }
+        if (n < count) {
+            memcpy(buf + used * blocksize_, blks[n]->data(), blocksize_);
+            used++;
+        }
+    }
+    // Only the last entry of a commit is synced: replay checks every entry
+    // of the commit before applying any of them.
+    if ((status == NO_ERROR) && !(flags & kMinfsJournalEntryMore)) {
+        status = SyncRuns();
+    }
+    io_lock_.Release();
+
+    if (status != NO_ERROR) {
+        return status;
+    }
+    trace(IO, "journal: committed seq %llu, %u blocks @%u\n",
+          (unsigned long long)jnl_seq_, count, jnl_start_ + jnl_head_);
+    jnl_head_ += 1 + count;
+    jnl_seq_++;
+    return NO_ERROR;
+}
+
+namespace {
+
+int bno_cmp(const void* a, const void* b) {
+    uint32_t x = *static_cast<const uint32_t*>(a);
+    uint32_t y = *static_cast<const uint32_t*>(b);
+    return (x > y) - (x < y);
+}
+
+} // namespace
+
+bool Bcache::JournalHolds(uint32_t bno) const {
+    return bsearch(&bno, jnl_bnos_.get(), jnl_bno_count_, sizeof(uint32_t), bno_cmp) != nullptr;
+}
+
+void Bcache::CommitLocked() {
+    if ((jnl_count_ == 0) || (txn_depth_ > 0) || (jnl_dirty_ == 0)) {
+        return;
+    }
+
+    // A busy journaled block is still in use, so the commit waits for it
+    // rather than leaving part of a transaction behind. Nothing can become
+    // busy once the commit starts, since lock_ is held throughout.
+    BlockNode** dirty = dirty_.get();
+    for (uint32_t n = 0; n < dirty_count_; n++) {
+        if ((dirty[n]->flags_ & (kBlockJournal | kBlockBusy)) == (kBlockJournal | kBlockBusy)) {
+            trace(IO, "journal: bno %u busy, commit deferred\n", dirty[n]->bno_);
+            return;
+        }
+    }
+
+    // File data goes in place first, and must be durable before any entry
+    // is, so that committed metadata never points at blocks which have yet
+    // to land.
+    FlushLocked();
+    io_lock_.Acquire();
+    mx_status_t status = SyncRuns();
+    io_lock_.Release();
+    if (status != NO_ERROR) {
+        error("minfs: cannot sync data before commit: %d\n", status);
+        return;
+    }
+
+    // A commit must fit in the journal at once: one entry header for every
+    // kMinfsJournalEntryMax blocks. Transactions are committed once they
+    // reach a quarter of the journal, so only a single operation larger than
+    // that is split, into commits separated by checkpoints. Each is atomic,
+    // but a crash between them leaves the operation partly applied.
+    const uint32_t room = jnl_count_ - 1;
+    const uint32_t max = room - (room + kMinfsJournalEntryMax) / (kMinfsJournalEntryMax + 1);
+    if (jnl_dirty_ > max) {
+        error("minfs: transaction of %u blocks exceeds journal of %u blocks; split\n",
+              jnl_dirty_, jnl_count_);
+    }
+
+    while (jnl_dirty_ > 0) {
+        uint32_t count = mxtl::min(jnl_dirty_, max);
+        uint32_t need = count + (count + kMinfsJournalEntryMax - 1) / kMinfsJournalEntryMax;
+        if ((need > jnl_count_ - jnl_head_) && (CheckpointLocked() != NO_ERROR)) {
+            return;
+        }
+
+        // Gather the journaled blocks at the front of the dirty set, which
+        // writing back has reordered.
+        uint32_t found = 0;
+        for (uint32_t n = 0; n < dirty_count_; n++) {
+            if (dirty[n]->flags_ & kBlockJournal) {
+                BlockNode* tmp = dirty[found];
+                dirty[found++] = dirty[n];
+                dirty[n] = tmp;
+            }
+        }
+        assert(found == jnl_dirty_);
+
+        uint32_t head = jnl_head_;
+        uint64_t seq = jnl_seq_;
+        for (uint32_t done = 0; done < count;) {
+            uint32_t len = mxtl::min(count - done, kMinfsJournalEntryMax);
+            uint32_t flags = (done + len < count) ? kMinfsJournalEntryMore : 0;
+            if (WriteEntry(dirty + done, len, flags) != NO_ERROR) {
+                // Leave the blocks journaled; the commit is retried later,
+                // over the entries written so far.
+                error("minfs: journal write error!\n");
+                jnl_head_ = head;
+                jnl_seq_ = seq;
+                return;
+            }
+            done += len;
+        }
+
+        // Committed: write the blocks in place now, while nothing can modify
+        // them. Until they land, the journal holds their only durable copy,
+        // so they must not be dirtied again before a checkpoint.
+        uint32_t* bnos = jnl_bnos_.get();
+        for (uint32_t n = 0; n < count; n++) {
+            dirty[n]->flags_ &= ~kBlockJournal;
+            bnos[jnl_bno_count_++] = dirty[n]->bno_;
+        }
+        qsort(bnos, jnl_bno_count_, sizeof(uint32_t), bno_cmp);
+        jnl_dirty_ -= count;
+        FlushLocked();
+    }
+
+    if (jnl_head_ > jnl_count_ / 2) {
+        CheckpointLocked();
+    }
+}
+
+mx_status_t Bcache::CheckpointLocked() {
+    FlushLocked();
+
+    io_lock_.Acquire();
+    mx_status_t status = NO_ERROR;
+    // Everything committed must be durable in place before the entries
+    // which describe it are invalidated. Committed blocks are written in
+    // place as soon as they are committed; if any write back failed, the
+    // journal is kept so that replay at the next mount can repair them.
+    if (write_error_) {
+        status = ERR_IO;
+    } else if ((status = SyncRuns()) == NO_ERROR) {
+        minfs_journal_info_t* ji = reinterpret_cast<minfs_journal_info_t*>(run_buf_.get());
+        memset(ji, 0, blocksize_);
+        ji->magic = kMinfsJournalMagic;
+        ji->seq = jnl_seq_;
+        if ((status = WriteRun(jnl_start_, 1, ji)) == NO_ERROR) {
+            status = SyncRuns();
+        }
+    }
+    io_lock_.Release();
+
+    if (status != NO_ERROR) {
+        error("minfs: journal checkpoint failed: %d\n", status);
+        return status;
+    }
+    trace(IO, "journal: checkpoint, next seq %llu\n", (unsigned long long)jnl_seq_);
+    jnl_head_ = 1;
+    jnl_bno_count_ = 0;
+    return NO_ERROR;
+}
+
+mx_status_t Bcache::SetJournal(uint32_t start, uint32_t count, uint64_t seq) {
+    if (count < 2) {
+        return ERR_INVALID_ARGS;
+    }
+    uint32_t* bnos = static_cast<uint32_t*>(malloc(count * sizeof(uint32_t)));
+    if (bnos == nullptr) {
+        return ERR_NO_MEMORY;
+    }
+    lock_.Acquire();
+    jnl_bnos_.reset(bnos);
+    jnl_bno_count_ = 0;
+    jnl_start_ = start;
+    jnl_count_ = count;
+    jnl_seq_ = seq;
+    mx_status_t status = CheckpointLocked();
+    lock_.Release();
+    return status;
+}
+
+// Read and verify the journal entry at 'pos', which should have sequence
+// number 'seq'. Returns its block count, zero if it marks the end of the
+// journal, or an error if it targets blocks outside the data area.
+static mx_status_t journal_read_entry(Bcache* bc, const minfs_info_t* info, uint32_t pos,
+                                      uint64_t seq, char* hbuf, char* dbuf) {
+    const minfs_journal_entry_t* hdr = reinterpret_cast<minfs_journal_entry_t*>(hbuf);
+    if (bc->Readblk(info->jnl_block + pos, hbuf) != NO_ERROR) {
+        return 0;
+    }
+    if ((hdr->magic != kMinfsJournalEntryMagic) || (hdr->seq != seq) ||
+        (hdr->count == 0) || (hdr->count > kMinfsJournalEntryMax) ||
+        (hdr->count > info->jnl_blocks - pos - 1)) {
+        return 0;
+    }
+    if (bc->Readblks(info->jnl_block + pos + 1, hdr->count, dbuf) != NO_ERROR) {
+        return 0;
+    }
+    uint32_t sum = minfs_journal_checksum(FNV32_OFFSET_BASIS, dbuf,
+                                          hdr->count * kMinfsBlockSize);
+    sum = minfs_journal_checksum(sum, hdr->bno, hdr->count * sizeof(uint32_t));
+    sum = minfs_journal_checksum(sum, &hdr->flags, sizeof(hdr->flags));
+    if (sum != hdr->checksum) {
+        // torn by a crash during commit
+        trace(MINFS, "journal: seq %llu fails checksum\n", (unsigned long long)seq);
+        return 0;
+    }
+    for (uint32_t n = 0; n < hdr->count; n++) {
+        if ((hdr->bno[n] == 0) || (hdr->bno[n] >= info->block_count) ||
+            ((hdr->bno[n] >= info->jnl_block) &&
+             (hdr->bno[n] < info->jnl_block + info->jnl_blocks))) {
+            error("minfs: journal entry %llu targets bad block %u\n",
+                  (unsigned long long)seq, hdr->bno[n]);
+            return ERR_IO;
+        }
+    }
+    return hdr->count;
+}
+
+mx_status_t minfs_journal_replay(Bcache* bc, const minfs_info_t* info) {
+    mxtl::unique_free_ptr<char> hbuf(static_cast<char*>(malloc(kMinfsBlockSize)));
+    mxtl::unique_free_ptr<char> dbuf(static_cast<char*>(malloc(kMinfsJournalEntryMax *
+                                                               kMinfsBlockSize)));
+    if ((hbuf == nullptr) || (dbuf == nullptr)) {
+        return ERR_NO_MEMORY;
+    }
+
+    if (bc->Readblk(info->jnl_block, hbuf.get()) != NO_ERROR) {
+        error("minfs: cannot read journal info\n");
+        return ERR_IO;
+    }
+    const minfs_journal_info_t* ji = reinterpret_cast<minfs_journal_info_t*>(hbuf.get());
+    if (ji->magic != kMinfsJournalMagic) {
+        error("minfs: bad journal magic\n");
+        return ERR_IO;
+    }
+    const uint64_t first = ji->seq;
+    const minfs_journal_entry_t* hdr = reinterpret_cast<minfs_journal_entry_t*>(hbuf.get());
+
+    // Find the end of the last complete commit. The entries of a commit
+    // which is cut short are left out entirely.
+    mx_status_t status;
+    uint64_t seq = first;
+    uint64_t end = first;
+    uint32_t pos = 1;
+    while (pos < info->jnl_blocks) {
+        if ((status = journal_read_entry(bc, info, pos, seq, hbuf.get(), dbuf.get())) <= 0) {
+            if (status < 0) {
+                return status;
+            }
+            break;
+        }
+        pos += 1 + status;
+        seq++;
+        if (!(hdr->flags & kMinfsJournalEntryMore)) {
+            end = seq;
+        }
+    }
+
+    pos = 1;
+    for (seq = first; seq < end; seq++) {
+        if ((status = journal_read_entry(bc, info, pos, seq, hbuf.get(), dbuf.get())) <= 0) {
+            error("minfs: journal entry %llu vanished during replay\n", (unsigned long long)seq);
+            return (status < 0) ? status : ERR_IO;
+        }
+        for (uint32_t n = 0; n < hdr->count; n++) {
+            if (bc->Writeblk(hdr->bno[n], dbuf.get() + n * kMinfsBlockSize, kBlockData)) {
+                return ERR_IO;
+            }
+        }
+        trace(MINFS, "journal: replayed seq %llu, %u blocks\n",
+              (unsigned long long)seq, hdr->count);
+        pos += 1 + hdr->count;
+    }
+
+    // Writes the replayed blocks in place before resetting the journal past
+    // the entries just applied.
+    if ((status = bc->SetJournal(info->jnl_block, info->jnl_blocks, end)) != NO_ERROR) {
+        return status;
+    }
+    return static_cast<mx_status_t>(end - first);
+}
@@ -225,8 +225,8 @@ struct {
 } CMDS[] = {
     {"create", do_minfs_mkfs, O_RDWR | O_CREAT, "initialize filesystem"},
     {"mkfs", do_minfs_mkfs, O_RDWR | O_CREAT, "initialize filesystem"},
-    {"check", do_minfs_check, O_RDONLY, "check filesystem integrity"},
-    {"fsck", do_minfs_check, O_RDONLY, "check filesystem integrity"},
+    {"check", do_minfs_check, O_RDWR, "check filesystem integrity"},
+    {"fsck", do_minfs_check, O_RDWR, "check filesystem integrity"},
 #ifdef __Fuchsia__
     {"mount", do_minfs_mount, O_RDWR, "mount filesystem"},
 #else
@@ -364,14 +364,18 @@ found:
     size /= kMinfsBlockSize;
 
     Bcache* bc;
-    if (Bcache::Create(&bc, fd, (uint32_t) size, kMinfsBlockSize, kMinfsBlockCacheSize) < 0) {
+    if (Bcache::Create(&bc, fd, (uint32_t) size, kMinfsBlockSize,
+                       Bcache::CacheSizeFor((uint32_t) size)) < 0) {
         fprintf(stderr, "error: cannot create block cache\n");
         return -1;
     }
 
     for (unsigned i = 0; i < countof(CMDS); i++) {
         if (!strcmp(cmd, CMDS[i].name)) {
-            return CMDS[i].func(bc, argc - 3, argv + 3);
+            int r = CMDS[i].func(bc, argc - 3, argv + 3);
+            // write back anything the command left in the cache
+            bc->Sync();
+            return r;
         }
     }
     return -1;
@@ -320,6 +320,15 @@ mx_status_t minfs_check(Bcache* bc) {
         return -1;
     }
 
+    // committed transactions are part of the filesystem; check what a mount
+    // would see
+    if ((status = minfs_journal_replay(bc, &info)) < 0) {
+        error("check: journal is corrupt\n");
+        return status;
+    } else if (status > 0) {
+        info("check: replayed %d journal entries\n", status);
+    }
+
     CheckMaps chk;
     if ((status = chk.checked_inodes.Init(info.inode_count)) < 0) {
         return status;
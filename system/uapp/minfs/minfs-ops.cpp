@@ -178,18 +178,46 @@ static mx_status_t vn_blocks_shrink(vnode_t* vn, uint32_t start) {
 }
 
 #ifdef __Fuchsia__
-// Read data from disk at block 'bno', into the 'nth' logical block of the file.
-static mx_status_t vn_fill_block(vnode_t* vn, uint32_t n, uint32_t bno) {
+// A run of file blocks which are contiguous both within the file and on disk.
+struct fill_run {
+    uint32_t n;     // first logical block
+    uint32_t bno;   // first disk block
+    uint32_t count;
+    char* bdata;    // room for kMinfsMaxRun blocks
+};
+
+// Read the pending run from disk with a single transfer, into the VMO.
+static mx_status_t vn_fill_run(vnode_t* vn, fill_run* run) {
+    if (run->count == 0) {
+        return NO_ERROR;
+    }
     // TODO(smklein): read directly from block device into vmo; no need to copy
     // into an intermediate buffer.
-    char bdata[kMinfsBlockSize];
-    if (vn->fs->bc->Readblk(bno, bdata)) {
+    if (vn->fs->bc->Readblks(run->bno, run->count, run->bdata)) {
+        error("Failed to fill bno %u; error: %d\n", run->bno, ERR_IO);
         return ERR_IO;
     }
-    mx_status_t status = vmo_write_exact(vn->vmo, bdata, n * kMinfsBlockSize, kMinfsBlockSize);
-    if (status != NO_ERROR) {
+    mx_status_t status = vmo_write_exact(vn->vmo, run->bdata, run->n * kMinfsBlockSize,
+                                         run->count * kMinfsBlockSize);
+    run->count = 0;
+    return status;
+}
+
+// Queue the read of disk block 'bno' into the 'nth' logical block of the file,
+// extending the pending run when possible.
+static mx_status_t vn_fill_block(vnode_t* vn, fill_run* run, uint32_t n, uint32_t bno) {
+    if ((run->count > 0) && (run->count < kMinfsMaxRun) &&
+        (n == run->n + run->count) && (bno == run->bno + run->count)) {
+        run->count++;
+        return NO_ERROR;
+    }
+    mx_status_t status;
+    if ((status = vn_fill_run(vn, run)) != NO_ERROR) {
         return status;
     }
+    run->n = n;
+    run->bno = bno;
+    run->count = 1;
     return NO_ERROR;
 }
 
@@ -211,12 +239,18 @@ static mx_status_t vn_init_vmo(vnode_t* vn) {
         return status;
     }
 
+    mxtl::unique_free_ptr<char> bdata(static_cast<char*>(malloc(kMinfsMaxRun * kMinfsBlockSize)));
+    if (bdata == nullptr) {
+        return ERR_NO_MEMORY;
+    }
+    fill_run run = {};
+    run.bdata = bdata.get();
+
     // Initialize all direct blocks
     uint32_t bno;
     for (uint32_t d = 0; d < kMinfsDirect; d++) {
         if ((bno = vn->inode.dnum[d]) != 0) {
-            if ((status = vn_fill_block(vn, d, bno)) != NO_ERROR) {
-                error("Failed to fill bno %u; error: %d\n", bno, status);
+            if ((status = vn_fill_block(vn, &run, d, bno)) != NO_ERROR) {
                 return status;
             }
         }
@@ -237,7 +271,7 @@ static mx_status_t vn_init_vmo(vnode_t* vn) {
             for (uint32_t j = 0; j < direct_per_indirect; j++) {
                 if ((bno = ientry[j]) != 0) {
                     uint32_t n = kMinfsDirect + i * direct_per_indirect + j;
-                    if ((status = vn_fill_block(vn, n, bno)) != NO_ERROR) {
+                    if ((status = vn_fill_block(vn, &run, n, bno)) != NO_ERROR) {
                         vn->fs->bc->Put(iblk, 0);
                         return status;
                     }
@@ -247,7 +281,7 @@ static mx_status_t vn_init_vmo(vnode_t* vn) {
         }
     }
 
-    return NO_ERROR;
+    return vn_fill_run(vn, &run);
 }
 #endif
 
@@ -706,6 +740,7 @@ static void fs_release(vnode_t* vn) {
     trace(MINFS, "minfs_release() vn=%p(#%u)%s\n", vn, vn->ino,
           vn->inode.link_count ? "" : " link-count is zero");
     if (vn->inode.link_count == 0) {
+        Transaction txn(vn->fs->bc);
         minfs_inode_destroy(vn);
     }
     list_delete(&vn->hashnode);
@@ -805,6 +840,7 @@ static ssize_t fs_write(vnode_t* vn, const void* data, size_t len, size_t off) {
     if (VNODE_IS_DIR(vn)) {
         return ERR_NOT_FILE;
     }
+    Transaction txn(vn->fs->bc);
     size_t actual;
     mx_status_t status = _fs_write(vn, data, len, off, &actual);
     if (status != NO_ERROR) {
@@ -874,7 +910,7 @@ static mx_status_t _fs_write(vnode_t* vn, const void* data, size_t len, size_t o
             return status;
         }
         assert(bno != 0);
-        if (vn->fs->bc->Writeblk(bno, wdata)) {
+        if (vn->fs->bc->Writeblk(bno, wdata, VNODE_IS_DIR(vn) ? 0 : kBlockData)) {
             return ERR_IO;
         }
 #else
@@ -888,7 +924,7 @@ static mx_status_t _fs_write(vnode_t* vn, const void* data, size_t len, size_t o
             return ERR_IO;
         }
         memcpy(wdata + adjust, data, xfer);
-        if (vn->fs->bc->Writeblk(bno, wdata)) {
+        if (vn->fs->bc->Writeblk(bno, wdata, VNODE_IS_DIR(vn) ? 0 : kBlockData)) {
             return ERR_IO;
         }
 #endif
@@ -958,6 +994,7 @@ static mx_status_t fs_setattr(vnode_t* vn, vnattr_t* a) {
     if ((a->valid & ~(ATTR_CTIME|ATTR_MTIME)) != 0) {
         return ERR_NOT_SUPPORTED;
     }
+    Transaction txn(vn->fs->bc);
     if ((a->valid & ATTR_CTIME) != 0) {
         vn->inode.create_time = a->create_time;
         dirty = 1;
@@ -1056,6 +1093,7 @@ static mx_status_t fs_create(vnode_t* vndir, vnode_t** out,
     if (!VNODE_IS_DIR(vndir)) {
         return ERR_NOT_SUPPORTED;
     }
+    Transaction txn(vndir->fs->bc);
 
     dir_args_t args = dir_args_t();
     args.name = name;
@@ -1134,6 +1172,7 @@ static mx_status_t fs_unlink(vnode_t* vn, const char* name, size_t len, bool mus
     args.name = name;
     args.len = len;
     args.type = must_be_dir ? kMinfsTypeDir : 0;
+    Transaction txn(vn->fs->bc);
     return vn_dir_for_each(vn, &args, cb_dir_unlink);
 }
 
@@ -1142,6 +1181,7 @@ static mx_status_t fs_truncate(vnode_t* vn, size_t len) {
         return ERR_NOT_FILE;
     }
 
+    Transaction txn(vn->fs->bc);
     return _fs_truncate(vn, len);
 }
 
@@ -1199,7 +1239,7 @@ static mx_status_t _fs_truncate(vnode_t* vn, size_t len) {
                 memset(bdata + adjust, 0, kMinfsBlockSize - adjust);
 #endif
 
-                if (vn->fs->bc->Writeblk(bno, bdata)) {
+                if (vn->fs->bc->Writeblk(bno, bdata, VNODE_IS_DIR(vn) ? 0 : kBlockData)) {
                     return ERR_IO;
                 }
             }
@@ -1264,6 +1304,7 @@ static mx_status_t fs_rename(vnode_t* olddir, vnode_t* newdir,
     // ensure that the vnodes containin oldname and newname are directories
     if (!(VNODE_IS_DIR(olddir) && VNODE_IS_DIR(newdir)))
         return ERR_NOT_SUPPORTED;
+    Transaction txn(olddir->fs->bc);
 
     // rule out any invalid new/old names
     if ((oldlen == 1) && (oldname[0] == '.'))
@@ -20,7 +20,33 @@ constexpr uint32_t kMxFsSyncDefault = 0;     // default: no implicit time update
 constexpr uint32_t kMxFsSyncMtime   = (1<<0);
 constexpr uint32_t kMxFsSyncCtime   = (1<<1);
 
-constexpr uint32_t kMinfsBlockCacheSize = 64;
+// Bounds on the number of blocks cached, chosen at mount time from the device size.
+constexpr uint32_t kMinfsBlockCacheMin = 64;
+constexpr uint32_t kMinfsBlockCacheMax = 4096;
+
+// Longest run of blocks moved by a single device transfer.
+constexpr uint32_t kMinfsMaxRun = 32;
+
+// Write-behind: how long dirty blocks may linger before the flusher writes
+// them back, and what fraction of the cache may be dirty before it is woken.
+constexpr uint32_t kMinfsFlushIntervalMs = 1000;
+constexpr uint32_t kMinfsDirtyRatio = 4;
+
+// Bounds on the size of the metadata journal, chosen by mkfs.
+constexpr uint32_t kMinfsJournalMin = 32;
+constexpr uint32_t kMinfsJournalMax = 1024;
+
+// Scoped filesystem operation: the metadata it modifies reaches the disk
+// through one journal commit.
+class Transaction {
+public:
+    DISALLOW_COPY_ASSIGN_AND_MOVE(Transaction);
+    explicit Transaction(Bcache* bc) : bc_(bc) { bc_->BeginTxn(); }
+    ~Transaction() { bc_->EndTxn(); }
+
+private:
+    Bcache* bc_;
+};
 
 // Used by fsck
 struct CheckMaps {
@@ -116,6 +142,13 @@ void minfs_dump_info(minfs_info_t* info);
 
 int minfs_mkfs(Bcache* bc);
 
+// Replay committed journal entries into place, then enable journaling.
+// Returns the number of entries replayed.
+mx_status_t minfs_journal_replay(Bcache* bc, const minfs_info_t* info);
+
+// Running checksum of journal entry contents.
+uint32_t minfs_journal_checksum(uint32_t sum, const void* data, size_t len);
+
 mx_status_t minfs_check(Bcache* bc);
 
 mx_status_t minfs_mount(vnode_t** root_out, Bcache* bc);
@@ -10,6 +10,7 @@
 #include <time.h>
 #include <unistd.h>
 
+#include <mxtl/algorithm.h>
 #include <mxtl/unique_ptr.h>
 
 #include "minfs-private.h"
@@ -20,6 +21,7 @@ void minfs_dump_info(minfs_info_t* info) {
     printf("minfs: inode bitmap @ %10u\n", info->ibm_block);
     printf("minfs: alloc bitmap @ %10u\n", info->abm_block);
     printf("minfs: inode table  @ %10u\n", info->ino_block);
+    printf("minfs: journal      @ %10u (%u blocks)\n", info->jnl_block, info->jnl_blocks);
     printf("minfs: data blocks  @ %10u\n", info->dat_block);
 }
 
@@ -51,6 +53,11 @@ mx_status_t minfs_check_info(minfs_info_t* info, uint32_t max) {
         error("minfs: too large for device\n");
         return ERR_INVALID_ARGS;
     }
+    if ((info->jnl_blocks < 2) || (info->jnl_block <= info->ino_block) ||
+        (info->jnl_block + info->jnl_blocks > info->dat_block)) {
+        error("minfs: bad journal %u/%u\n", info->jnl_block, info->jnl_blocks);
+        return ERR_INVALID_ARGS;
+    }
     //TODO: validate layout
     return 0;
 }
@@ -394,6 +401,14 @@ mx_status_t minfs_mount(vnode_t** out, Bcache* bc) {
         return -1;
     }
 
+    mx_status_t status;
+    if ((status = minfs_journal_replay(bc, &info)) < 0) {
+        error("minfs: journal replay failed\n");
+        return -1;
+    } else if (status > 0) {
+        info("minfs: replayed %d journal entries\n", status);
+    }
+
     Minfs* fs;
     if (Minfs::Create(&fs, bc, &info)) {
         error("minfs: mount failed\n");
@@ -424,6 +439,8 @@ int minfs_mkfs(Bcache* bc) {
     uint32_t inoblks = (inodes + kMinfsInodesPerBlock - 1) / kMinfsInodesPerBlock;
     uint32_t abmblks = (blocks + kMinfsBlockBits - 1) / kMinfsBlockBits;
     uint32_t ibmblks = (inodes + kMinfsBlockBits - 1) / kMinfsBlockBits;
+    // 1/64th of the device for the metadata journal
+    uint32_t jnlblks = mxtl::min(mxtl::max(blocks / 64, kMinfsJournalMin), kMinfsJournalMax);
 
     minfs_info_t info;
     memset(&info, 0x00, sizeof(info));
@@ -438,7 +455,9 @@ int minfs_mkfs(Bcache* bc) {
     info.ibm_block = 8;
     info.abm_block = 16;
     info.ino_block = info.abm_block + ((abmblks + 8) & (~7));
-    info.dat_block = info.ino_block + inoblks;
+    info.jnl_block = info.ino_block + inoblks;
+    info.jnl_blocks = jnlblks;
+    info.dat_block = info.jnl_block + info.jnl_blocks;
     minfs_dump_info(&info);
 
     Bitmap abm;
@@ -507,5 +526,12 @@ int minfs_mkfs(Bcache* bc) {
     blk = bc->GetZero(0);
     memcpy(blk->data(), &info, sizeof(info));
     bc->Put(blk, kBlockDirty);
+
+    // Starting from the format time keeps entries left over from a previous
+    // filesystem out of sequence.
+    if (bc->SetJournal(info.jnl_block, info.jnl_blocks, minfs_gettime_utc()) != NO_ERROR) {
+        error("mkfs: cannot initialize journal\n");
+        return -1;
+    }
     return 0;
 }
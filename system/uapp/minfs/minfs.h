@@ -11,6 +11,13 @@
 #include <mxtl/ref_ptr.h>
 #include <mxtl/unique_free_ptr.h>
 
+#ifdef __Fuchsia__
+#include <threads.h>
+#include <mxtl/mutex.h>
+#else
+#include <mxtl/null_lock.h>
+#endif
+
 #include <magenta/types.h>
 
 #include <assert.h>
@@ -24,7 +31,7 @@
 
 constexpr uint64_t kMinfsMagic0 = (0x002153466e694d21ULL);
 constexpr uint64_t kMinfsMagic1 = (0x385000d3d3d3d304ULL);
-constexpr uint32_t kMinfsVersion = 0x00000002;
+constexpr uint32_t kMinfsVersion = 0x00000003;
 
 constexpr uint32_t kMinfsRootIno        = 1;
 constexpr uint32_t kMinfsFlagClean      = 1;
@@ -62,10 +69,12 @@ typedef struct {
     uint32_t abm_block;     // first blockno of block allocation bitmap
     uint32_t ino_block;     // first blockno of inode table
     uint32_t dat_block;     // first blockno available for file data
+    uint32_t jnl_block;     // first blockno of metadata journal
+    uint32_t jnl_blocks;    // number of blocks in metadata journal
 } minfs_info_t;
 
 // Notes:
-// - the ibm, abm, ino, and dat regions must be in that order
+// - the ibm, abm, ino, jnl, and dat regions must be in that order
 //   and may not overlap
 // - the abm has an entry for every block on the volume, including
 //   the info block (0), the bitmaps, etc
@@ -139,6 +148,46 @@ static_assert(kMinfsMaxDirectorySize <= kMinfsReclenMask,
 //   also increase in size.
 
 
+// Metadata journal
+//
+// Bitmap, inode, indirect and directory blocks are not written in place until
+// the transaction which modified them has been committed to the journal:
+// a single sequential write of an entry header followed by the new contents
+// of each block. A commit larger than one entry is written as several, all
+// but the last flagged kMinfsJournalEntryMore. Entries have consecutive
+// sequence numbers, starting from the one in the journal info block at
+// jnl_block + 0. At mount, every complete commit is replayed, up to the first
+// entry which is missing, torn, or out of sequence; the entries of a commit
+// whose last entry never made it are not applied at all.
+// Once every committed block has been written in place, the info block is
+// rewritten with the next sequence number and the journal starts over.
+// Until then, a block freed and reused for file data is also written through
+// the journal, so that replay does not put back its older metadata contents.
+
+constexpr uint64_t kMinfsJournalMagic      = (0x6c6e724a53466e4dULL); // "MnFSJrnl"
+constexpr uint64_t kMinfsJournalEntryMagic = (0x7972746e45466e4dULL); // "MnFEntry"
+
+typedef struct {
+    uint64_t magic;
+    uint64_t seq;           // sequence number of the entry at jnl_block + 1
+} minfs_journal_info_t;
+
+// the commit continues in the next entry
+constexpr uint32_t kMinfsJournalEntryMore = 1;
+
+typedef struct {
+    uint64_t magic;
+    uint64_t seq;
+    uint32_t count;         // number of blocks following this header
+    uint32_t checksum;      // over the blocks which follow, bno[] and flags
+    uint32_t flags;
+    uint32_t reserved;
+    uint32_t bno[];         // home location of each block
+} minfs_journal_entry_t;
+
+constexpr uint32_t kMinfsJournalEntryMax =
+    (kMinfsBlockSize - sizeof(minfs_journal_entry_t)) / sizeof(uint32_t);
+
 // blocksize   8K    16K    32K
 // 16 dir =  128K   256K   512K
 // 32 ind =  512M  1024M  2048M
@@ -161,6 +210,13 @@ constexpr uint32_t kBlockFree  = 0x08;
 
 constexpr uint32_t kBlockLLFlags = (kBlockBusy | kBlockLRU | kBlockFree);
 
+// Flag passed to Put()/Writeblk() for file data, which is written in place
+// without passing through the journal.
+constexpr uint32_t kBlockData = 0x10;
+// Flag denoting a dirty block which must be committed to the journal before
+// it may be written in place.
+constexpr uint32_t kBlockJournal = 0x20;
+
 constexpr uint32_t kMinfsHashBits = (8);
 constexpr uint32_t kMinfsBuckets = (1 << kMinfsHashBits);
 
@@ -205,32 +261,56 @@ private:
 // one list to another.
 class BcacheLists {
 public:
+    // Take ownership of a newly created block, placing it on the free list.
+    void Add(mxtl::RefPtr<BlockNode> blk);
+
     void PushBack(mxtl::RefPtr<BlockNode> blk, uint32_t block_type);
     mxtl::RefPtr<BlockNode> PopFront(uint32_t block_type);
     mxtl::RefPtr<BlockNode> Erase(mxtl::RefPtr<BlockNode> blk, uint32_t block_type);
 
+    // Total number of blocks owned by the cache
+    uint32_t Count() const { return count_; }
+
 private:
     using LinkedList = mxtl::DoublyLinkedList<mxtl::RefPtr<BlockNode>, BlockNode::TypeListTraits>;
     LinkedList* GetList(uint32_t block_type);
-    size_t SizeAllSlow() const; // Used for debugging
 
     LinkedList list_busy_;  // Between Get() and Put(). In hash.
     LinkedList list_lru_;   // Available for re-use. In hash.
     LinkedList list_free_;  // Never been used. Not in hash.
+    uint32_t count_ = 0;    // Blocks owned by the cache.
+    uint32_t listed_ = 0;   // Blocks currently on one of the lists. Used for debugging.
 };
 
+#ifdef __Fuchsia__
+using BcacheLock = mxtl::Mutex;
+#else
+// Host tools drive the cache from a single thread.
+using BcacheLock = mxtl::NullLock;
+#endif
+
 class Bcache {
 public:
     DISALLOW_COPY_ASSIGN_AND_MOVE(Bcache);
     friend class BlockNode;
 
+    // 'num' is the initial number of cached blocks; the cache grows past it
+    // only when every block is busy.
     static mx_status_t Create(Bcache** out, int fd, uint32_t blockmax, uint32_t blocksize,
                               uint32_t num);
 
-    // Raw block read functions.
-    // These do not track blocks (or attempt to access the block cache)
+    // Pick a cache size for a device of 'blockmax' blocks.
+    static uint32_t CacheSizeFor(uint32_t blockmax);
+
+    // Whole-block transfers which do not hold onto the block.
+    // Reads observe any cached (possibly dirty) copy, otherwise going to disk
+    // without populating the cache; writes are staged in the cache and
+    // written back with their neighbours.
     mx_status_t Readblk(uint32_t bno, void* data);
-    mx_status_t Writeblk(uint32_t bno, const void* data);
+    mx_status_t Writeblk(uint32_t bno, const void* data, uint32_t flags);
+
+    // Read 'count' contiguous blocks starting at 'bno' in a single transfer.
+    mx_status_t Readblks(uint32_t bno, uint32_t count, void* data);
 
     uint32_t Maxblk() const { return blockmax_; };
 
@@ -242,15 +322,28 @@ public:
     mxtl::RefPtr<BlockNode> GetZero(uint32_t bno);
 
     // release a block back to the cache
-    // flags *must* contain kBlockDirty if it was modified
+    // flags *must* contain kBlockDirty if it was modified.
+    // Dirty blocks are written back later, by Sync() or the flusher; unless
+    // flags contains kBlockData, via the journal if one is enabled.
     void Put(mxtl::RefPtr<BlockNode> blk, uint32_t flags);
 
+    // Journal metadata writes in the 'count' blocks starting at 'start',
+    // beginning with sequence number 'seq'. Everything dirty is written in
+    // place first, and the journal info block is reset.
+    mx_status_t SetJournal(uint32_t start, uint32_t count, uint64_t seq);
+
+    // Bracket a filesystem operation. Metadata dirtied within the outermost
+    // pair is committed to the journal atomically, after it ends.
+    void BeginTxn();
+    void EndTxn();
+
     // Helper function which combines 'Get' and 'Put'.
     mx_status_t Read(uint32_t bno, void* data, uint32_t off, uint32_t len);
 
-    // drop all non-busy, non-dirty blocks
+    // write back dirty blocks, then drop all non-busy blocks
     void Invalidate();
 
+    // write back all dirty blocks and flush the underlying device
     int Sync();
     int Close();
 
@@ -261,6 +354,55 @@ private:
 
     mxtl::RefPtr<BlockNode> Get(uint32_t bno, uint32_t mode);
 
+    // Grow the cache by one block, placing it on the free list.
+    mx_status_t Grow();
+
+    // Obtain an unused block (free, or evicted from the LRU), or nullptr.
+    mxtl::RefPtr<BlockNode> Reclaim();
+
+    // Fill a newly hashed, busy block from disk, reading ahead on
+    // sequential access.
+    mx_status_t Load(const mxtl::RefPtr<BlockNode>& blk);
+
+    // Track a block which must be written back.
+    void MarkDirty(BlockNode* blk, uint32_t flags);
+
+    // Write back all non-busy dirty blocks, coalescing contiguous runs.
+    // Called with lock_ held.
+    void FlushLocked();
+
+    // Copy the lowest-numbered contiguous run of non-busy dirty blocks into
+    // 'run_buf_', marking them clean. Returns the run length (zero if none),
+    // with its first block in 'bno_out'. Called with lock_ and io_lock_ held.
+    uint32_t CollectRun(uint32_t* bno_out);
+
+    // Commit every journaled block to the journal, then write them in place,
+    // once no transaction is open and none of them is busy. Called with
+    // lock_ held.
+    void CommitLocked();
+
+    // Write one journal entry covering 'count' blocks, with entry 'flags'.
+    // Called with lock_ held.
+    mx_status_t WriteEntry(BlockNode** blks, uint32_t count, uint32_t flags);
+
+    // Write back everything committed and reset the journal. Called with
+    // lock_ held.
+    mx_status_t CheckpointLocked();
+
+    // Whether the journal holds a copy of block 'bno' which has not yet been
+    // retired by a checkpoint. Called with lock_ held.
+    bool JournalHolds(uint32_t bno) const;
+
+    // Raw device access. Called with io_lock_ held.
+    mx_status_t ReadRun(uint32_t bno, uint32_t count, void* data);
+    mx_status_t WriteRun(uint32_t bno, uint32_t count, const void* data);
+    // Make everything written so far durable. Called with io_lock_ held.
+    mx_status_t SyncRuns();
+
+#ifdef __Fuchsia__
+    static int FlusherThread(void* arg);
+#endif
+
     using HashTableBucket = mxtl::DoublyLinkedList<mxtl::RefPtr<BlockNode>, BlockNode::TypeHashTraits>;
     using HashTable = mxtl::HashTable<uint32_t, mxtl::RefPtr<BlockNode>, HashTableBucket>;
     HashTable hash_; // Map of all 'in use' blocks, accessible by bno
@@ -268,6 +410,49 @@ private:
     int fd_;
     uint32_t blockmax_;
     uint32_t blocksize_;
+
+    // Protects the lists, hash and dirty set.
+    BcacheLock lock_;
+    // Serializes access to fd_ and run_buf_. Acquired after lock_.
+    BcacheLock io_lock_;
+
+    // Blocks awaiting writeback, unordered.
+    mxtl::unique_free_ptr<BlockNode*> dirty_;
+    uint32_t dirty_count_ = 0;
+    uint32_t dirty_cap_ = 0;
+
+    // Staging buffer for multi-block transfers.
+    mxtl::unique_free_ptr<char> run_buf_;
+
+    // Journal region, next entry location and sequence number.
+    uint32_t jnl_start_ = 0;
+    uint32_t jnl_count_ = 0;
+    uint32_t jnl_head_ = 0;
+    uint64_t jnl_seq_ = 0;
+    // Number of dirty blocks awaiting commit.
+    uint32_t jnl_dirty_ = 0;
+    // Home locations of the blocks in the journal since the last checkpoint,
+    // sorted. There is room for one per journal block.
+    mxtl::unique_free_ptr<uint32_t> jnl_bnos_;
+    uint32_t jnl_bno_count_ = 0;
+    // A write back failed, so the journal may hold the only good copy of
+    // some blocks. Set with io_lock_ held.
+    bool write_error_ = false;
+    // Something was written since the last fsync. Set with io_lock_ held.
+    bool unsynced_ = false;
+    // Nesting depth of BeginTxn().
+    uint32_t txn_depth_ = 0;
+
+    // Sequential readahead state.
+    uint32_t last_miss_ = 0;
+    uint32_t ra_window_ = 0;
+
+#ifdef __Fuchsia__
+    thrd_t flusher_;
+    cnd_t flush_cnd_;
+    bool flusher_running_ = false;
+    bool flusher_exit_ = false;
+#endif
 };
 
 // Allocation Bitmap (bitmap.c)
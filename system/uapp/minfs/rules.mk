@@ -23,6 +23,7 @@ MODULE_SRCS += \
     $(LOCAL_DIR)/minfs.cpp \
     $(LOCAL_DIR)/minfs-ops.cpp \
     $(LOCAL_DIR)/minfs-check.cpp \
+    $(LOCAL_DIR)/journal.cpp \
 
 MODULE_STATIC_LIBS := \
     ulib/fs \
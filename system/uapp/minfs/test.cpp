@@ -11,6 +11,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/stat.h>
+#include <time.h>
 #include <unistd.h>
 
 #include <magenta/compiler.h>
@@ -308,6 +309,104 @@ int test_rename(void) {
     return 0;
 }
 
+static uint64_t perf_now(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void perf_report(const char* what, size_t bytes, uint64_t ns) {
+    double secs = (double)ns / 1000000000.0;
+    fprintf(stderr, "%-12s %6zu MB in %7.3fs: %8.2f MB/s\n", what,
+            bytes / MB(1), secs, (double)bytes / MB(1) / secs);
+}
+
+#define PERF_FILE_SIZE MB(32)
+#define PERF_SEQ_IOSIZE KB(64)
+#define PERF_RAND_IOSIZE KB(8)
+
+// like TRY, but fails the run instead of exiting, so that test_perf() still
+// cleans up after it
+#define PERF_TRY(func) ({\
+    int ret = (func); \
+    if (ret < 0) { \
+        printf("%s:%d:error: %s -> %d\n", __FILE__, __LINE__, #func, ret); \
+        return FAIL; \
+    } \
+    ret; })
+
+// Throughput of sequential (64K) or random (8K, block-aligned) transfers on a
+// 32MB file. The cache is dropped between the write and read passes, so
+// writes include their writeback and reads come from the device. Data is
+// verified on the way back in.
+static int perf_run(int fd, uint8_t* wbuf, uint8_t* rbuf, size_t iosize, bool random) {
+    const uint32_t count = PERF_FILE_SIZE / iosize;
+    rand32_t rops = RAND32SEED(0x12345678);
+
+    if (random) {
+        // lay the file out first, so random writes only update blocks
+        memset(wbuf, 0, iosize);
+        for (uint32_t n = 0; n < count; n++) {
+            PERF_TRY(emu_write(fd, wbuf, iosize));
+        }
+        drop_cache();
+    }
+
+    uint64_t t0 = perf_now();
+    for (uint32_t n = 0; n < count; n++) {
+        uint32_t chunk = random ? (rand32(&rops) % count) : n;
+        memset(wbuf, chunk & 0xff, iosize);
+        PERF_TRY(emu_lseek(fd, (off_t)chunk * iosize, SEEK_SET));
+        if (PERF_TRY(emu_write(fd, wbuf, iosize)) != (ssize_t)iosize) {
+            fprintf(stderr, "perf: short write\n");
+            return FAIL;
+        }
+    }
+    drop_cache();
+    perf_report(random ? "rand write" : "seq write", PERF_FILE_SIZE, perf_now() - t0);
+
+    t0 = perf_now();
+    for (uint32_t n = 0; n < count; n++) {
+        uint32_t chunk = random ? (rand32(&rops) % count) : n;
+        PERF_TRY(emu_lseek(fd, (off_t)chunk * iosize, SEEK_SET));
+        if (PERF_TRY(emu_read(fd, rbuf, iosize)) != (ssize_t)iosize) {
+            fprintf(stderr, "perf: short read\n");
+            return FAIL;
+        }
+        // random reads may land on chunks which were never rewritten
+        if (!random && (rbuf[0] != (chunk & 0xff) || rbuf[iosize - 1] != (chunk & 0xff))) {
+            fprintf(stderr, "perf: verify failed @%u\n", chunk);
+            return FAIL;
+        }
+    }
+    perf_report(random ? "rand read" : "seq read", PERF_FILE_SIZE, perf_now() - t0);
+    return 0;
+}
+
+int test_perf(bool random) {
+    const size_t iosize = random ? PERF_RAND_IOSIZE : PERF_SEQ_IOSIZE;
+    uint8_t* wbuf = (uint8_t*) malloc(iosize);
+    uint8_t* rbuf = (uint8_t*) malloc(iosize);
+    int r = FAIL;
+    int fd;
+    if ((wbuf == nullptr) || (rbuf == nullptr)) {
+        fprintf(stderr, "perf: out of memory\n");
+    } else if ((fd = emu_open("::perffile", O_RDWR | O_CREAT | O_EXCL, 0644)) < 0) {
+        fprintf(stderr, "perf: cannot create ::perffile: %d\n", fd);
+    } else {
+        r = perf_run(fd, wbuf, rbuf, iosize, random);
+        emu_close(fd);
+        int status = emu_unlink("::perffile");
+        if (status < 0) {
+            fprintf(stderr, "perf: cannot unlink ::perffile: %d\n", status);
+            r = FAIL;
+        }
+    }
+    free(wbuf);
+    free(rbuf);
+    return r;
+}
+
 int run_fs_tests(int argc, char** argv) {
     fprintf(stderr, "--- fs tests ---\n");
     if (argc > 0) {
@@ -323,6 +422,12 @@ int run_fs_tests(int argc, char** argv) {
         if (!strcmp(argv[0], "rename")) {
             return test_rename();
         }
+        if (!strcmp(argv[0], "seqperf")) {
+            return test_perf(false);
+        }
+        if (!strcmp(argv[0], "randperf")) {
+            return test_perf(true);
+        }
         fprintf(stderr, "unknown test: %s\n", argv[0]);
         return -1;
     }
@@ -0,0 +1,117 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// Measures how long a program takes to start and exit, with and without the
+// dynamic linker's symbol cache (LD_SYMCACHE). Pick a program that links
+// many libraries and exits at once, such as one asked for its usage message.
+
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <launchpad/launchpad.h>
+#include <magenta/syscalls.h>
+
+static unsigned iters = 20;
+
+static mx_status_t launch(int argc, const char* const* argv, const char* const* envp,
+                          mx_time_t* elapsed) {
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+
+    launchpad_t* lp;
+    launchpad_create(0, argv[0], &lp);
+    launchpad_load_from_file(lp, argv[0]);
+    launchpad_clone(lp, LP_CLONE_MXIO_ALL | LP_CLONE_DEFAULT_JOB);
+    launchpad_set_args(lp, argc, argv);
+    launchpad_set_environ(lp, envp);
+    const char* errmsg;
+    mx_handle_t proc;
+    mx_status_t status = launchpad_go(lp, &proc, &errmsg);
+    if (status < 0) {
+        fprintf(stderr, "startup-bench: cannot launch %s: %d: %s\n", argv[0], status, errmsg);
+        return status;
+    }
+    status = mx_object_wait_one(proc, MX_PROCESS_SIGNALED, MX_TIME_INFINITE, NULL);
+    mx_handle_close(proc);
+
+    *elapsed = mx_time_get(MX_CLOCK_MONOTONIC) - start;
+    return status;
+}
+
+static int run(const char* label, int argc, const char* const* argv, const char* const* envp,
+               bool warmup) {
+    if (warmup) {
+        // the first start records the cache for the rest
+        mx_time_t elapsed;
+        if (launch(argc, argv, envp, &elapsed) < 0) {
+            return -1;
+        }
+    }
+    mx_time_t total = 0;
+    mx_time_t best = UINT64_MAX;
+    for (unsigned i = 0; i < iters; i++) {
+        mx_time_t elapsed;
+        if (launch(argc, argv, envp, &elapsed) < 0) {
+            return -1;
+        }
+        total += elapsed;
+        if (elapsed < best) {
+            best = elapsed;
+        }
+    }
+    printf("%-12s mean %8" PRIu64 " us  min %8" PRIu64 " us\n",
+           label, total / iters / 1000, best / 1000);
+    return 0;
+}
+
+static int usage(void) {
+    fprintf(stderr, "usage: startup-bench [-n <iterations>] <program> [<args>...]\n");
+    return -1;
+}
+
+int main(int argc, char** argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1) {
+        switch (opt) {
+        case 'n':
+            iters = strtoul(optarg, NULL, 0);
+            break;
+        default:
+            return usage();
+        }
+    }
+    if ((optind == argc) || (iters == 0)) {
+        return usage();
+    }
+
+    // the environment as it is, minus LD_SYMCACHE, then with it set
+    size_t envc = 0;
+    while (environ[envc] != NULL) {
+        envc++;
+    }
+    const char** envp = calloc(envc + 2, sizeof(char*));
+    if (envp == NULL) {
+        return -1;
+    }
+    size_t n = 0;
+    for (size_t i = 0; i < envc; i++) {
+        if (strncmp(environ[i], "LD_SYMCACHE=", 12)) {
+            envp[n++] = environ[i];
+        }
+    }
+
+    const char* const* args = (const char* const*)argv + optind;
+    printf("%s: %u starts each\n", args[0], iters);
+    if (run("uncached", argc - optind, args, envp, false) < 0) {
+        return -1;
+    }
+    envp[n] = "LD_SYMCACHE=1";
+    if (run("LD_SYMCACHE", argc - optind, args, envp, true) < 0) {
+        return -1;
+    }
+    return 0;
+}
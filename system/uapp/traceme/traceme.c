@@ -3,15 +3,94 @@
 // found in the LICENSE file.
 
 #include <fcntl.h>
+#include <inttypes.h>
+#include <stdbool.h>
 #include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include <magenta/device/ktrace.h>
+#include <magenta/ktrace.h>
+#include <magenta/syscalls.h>
 
 // 1. Run:            magenta> traceme
 // 2. Stop tracing:   magenta> dm ktraceoff
 // 3. Grab trace:     host> netcp :/dev/class/misc/ktrace test.trace
 // 4. Examine trace:  host> tracevic test.trace
+//
+// traceme also reads its probes back out of the live trace buffer, the way
+// a streaming consumer would: it notes where each cpu's ring ends before
+// emitting them, then reads every cpu from there, merging by timestamp.
+
+typedef struct {
+    ktrace_cpu_header_t* hdr;
+    const uint8_t* ring;
+    uint64_t pos;
+    uint64_t end;
+    ktrace_rec_32b_t rec;
+    bool valid;
+} stream_t;
+
+static void stream_init(stream_t* s, ktrace_buffer_header_t* kb, uint32_t cpu) {
+    s->hdr = &kb->cpu[cpu];
+    s->ring = (uint8_t*)kb + kb->buffer_offset + cpu * kb->cpu_bufsize;
+    s->pos = __atomic_load_n(&s->hdr->head, __ATOMIC_ACQUIRE);
+    s->valid = false;
+}
+
+// Reads the next event before s->end into s->rec.
+static bool stream_next(stream_t* s, uint32_t size) {
+    while (s->pos < s->end) {
+        uint64_t tail = __atomic_load_n(&s->hdr->tail, __ATOMIC_ACQUIRE);
+        if (s->pos < tail) {
+            // the kernel has overwritten these already
+            s->pos = tail;
+            continue;
+        }
+        const uint8_t* p = s->ring + s->pos % size;
+        uint32_t len = KTRACE_LEN(*(const uint32_t*)p);
+        memcpy(&s->rec, p, (len < sizeof(s->rec)) ? len : sizeof(s->rec));
+        if (__atomic_load_n(&s->hdr->tail, __ATOMIC_ACQUIRE) > s->pos) {
+            // and this one went while we copied it
+            continue;
+        }
+        if (len == 0) {
+            break;
+        }
+        s->pos += len;
+        if (KTRACE_GROUP(s->rec.tag)) {
+            return s->valid = true;
+        }
+    }
+    s->pos = s->end;
+    return s->valid = false;
+}
+
+static void print_probes(ktrace_buffer_header_t* kb, stream_t* streams, uint32_t id) {
+    for (uint32_t cpu = 0; cpu < kb->cpu_count; cpu++) {
+        streams[cpu].end = __atomic_load_n(&streams[cpu].hdr->head, __ATOMIC_ACQUIRE);
+        stream_next(&streams[cpu], kb->cpu_bufsize);
+    }
+    for (;;) {
+        stream_t* first = NULL;
+        uint32_t first_cpu = 0;
+        for (uint32_t cpu = 0; cpu < kb->cpu_count; cpu++) {
+            if (streams[cpu].valid && ((first == NULL) || (streams[cpu].rec.ts < first->rec.ts))) {
+                first = &streams[cpu];
+                first_cpu = cpu;
+            }
+        }
+        if (first == NULL) {
+            break;
+        }
+        if (first->rec.tag == (uint32_t)TAG_PROBE_24(id)) {
+            printf("cpu %u: ts %" PRIu64 " probe %u (%u, %u)\n",
+                   first_cpu, first->rec.ts, id, first->rec.a, first->rec.b);
+        }
+        stream_next(first, kb->cpu_bufsize);
+    }
+}
 
 int main(int argc, char** argv) {
     int fd;
@@ -34,14 +113,38 @@ int main(int argc, char** argv) {
         return -1;
     }
 
+    // map the trace buffer, to read the probes back
+    ktrace_buffer_header_t* kb = NULL;
+    mx_handle_t vmo;
+    uint64_t size;
+    uintptr_t addr;
+    if ((ioctl_ktrace_get_buffer(fd, &vmo) >= 0)) {
+        if ((mx_vmo_get_size(vmo, &size) == NO_ERROR) &&
+            (mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                         MX_VM_FLAG_PERM_READ, &addr) == NO_ERROR)) {
+            kb = (ktrace_buffer_header_t*)addr;
+        }
+        mx_handle_close(vmo);
+    }
+
     // once all probes are registered, you can close the device
     close(fd);
 
+    stream_t* streams = NULL;
+    if ((kb != NULL) && (kb->magic == KTRACE_BUFFER_MAGIC) &&
+        ((streams = calloc(kb->cpu_count, sizeof(stream_t))) != NULL)) {
+        for (uint32_t cpu = 0; cpu < kb->cpu_count; cpu++) {
+            stream_init(&streams[cpu], kb, cpu);
+        }
+    }
+
     // use the ktrace handle to emit probes into the trace stream
     mx_ktrace_write(kth, id, 1, 0);
     printf("hello, ktrace! id = %u\n", id);
     mx_ktrace_write(kth, id, 2, 0);
 
+    if (streams != NULL) {
+        print_probes(kb, streams, id);
+    }
     return 0;
 }
-
@@ -0,0 +1,699 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <ddk/binding.h>
+#include <ddk/completion.h>
+#include <ddk/device.h>
+#include <ddk/driver.h>
+#include <ddk/protocol/block.h>
+
+#include <magenta/listnode.h>
+#include <magenta/syscalls.h>
+#include <magenta/types.h>
+#include <sys/param.h>
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <threads.h>
+
+// This block device schedules the requests of its clients onto the
+// underlying block device.  Requests are held in a queue sorted by offset
+// and issued in elevator order, a bounded number at a time, and a request
+// which continues where another ends is merged with it into one transfer.
+// Each request carries a deadline; one which has waited past it is issued
+// ahead of the elevator.  Every open instance is a separate client whose
+// share of the queue is limited, so a busy client cannot starve the others.
+//
+// Requests flagged IOTXN_SYNC_BEFORE or IOTXN_SYNC_AFTER, and anything
+// other than a read or write, are barriers: they are issued alone, after
+// everything queued before them has completed, and nothing queued after
+// them is issued until they complete.
+
+#define SCHED_MAX_INFLIGHT    8             // requests outstanding at the device
+#define SCHED_CLIENT_DEPTH    32            // requests queued per client
+#define SCHED_MAX_MERGE       (256 * 1024)  // largest merged transfer
+#define SCHED_MAX_MERGE_COUNT 32            // most requests in a merged transfer
+#define SCHED_READ_DEADLINE   MX_MSEC(50)
+#define SCHED_WRITE_DEADLINE  MX_MSEC(500)
+
+typedef struct sched_device sched_device_t;
+
+// a source of requests: each open instance, plus the device itself for
+// drivers stacked directly on it
+typedef struct sched_client {
+    list_node_t node;
+    sched_device_t* sdev;
+
+    // held by the open instance (or the device) and by each of its requests
+    // until that request has completed; the client holds a reference to the
+    // device until the last is dropped
+    uint32_t refcount;
+
+    // requests queued or in flight
+    uint32_t active;
+    // requests held back by SCHED_CLIENT_DEPTH
+    list_node_t backlog;
+} sched_client_t;
+
+typedef struct sched_instance {
+    mx_device_t device;
+    sched_client_t client;
+} sched_instance_t;
+
+struct sched_device {
+    mx_device_t device;
+    mx_device_t* parent;
+
+    mtx_t lock;
+    completion_t worker_completion;
+    thrd_t worker;
+    bool dead;
+
+    // each client holds a reference
+    uint32_t refcount;
+
+    list_node_t clients;
+    sched_client_t client;
+
+    // queued requests, by offset
+    list_node_t queue;
+    // queued requests, by arrival
+    list_node_t read_fifo;
+    list_node_t write_fifo;
+    list_node_t barriers;
+    uint64_t seq;
+
+    // end of the last request issued, where the elevator resumes
+    mx_off_t head;
+    uint32_t inflight;
+    // a barrier is in flight
+    bool draining;
+
+    block_stats_t stats;
+};
+
+// per-request state, kept in the extra space of the clone of the client's
+// iotxn which the request is issued as
+typedef struct sched_io {
+    // in a fifo or the barrier list; the clone's node is in the queue, a
+    // client backlog, or a merged transfer
+    list_node_t fifo_node;
+    iotxn_t* clone;
+    iotxn_t* txn;
+    sched_client_t* client;
+    uint64_t seq;
+    mx_time_t queued;
+    mx_time_t deadline;
+} sched_io_t;
+
+// the requests in a merged transfer, in offset order
+typedef struct sched_batch {
+    list_node_t ios;
+} sched_batch_t;
+
+#define get_sched_device(dev) containerof(dev, sched_device_t, device)
+#define get_sched_instance(dev) containerof(dev, sched_instance_t, device)
+#define get_sched_io(clone) iotxn_to(clone, sched_io_t)
+
+static void sched_io_complete(iotxn_t* clone, void* cookie);
+static void sched_batch_complete(iotxn_t* merged, void* cookie);
+
+static void sched_downref(sched_device_t* sdev) {
+    mtx_lock(&sdev->lock);
+    sdev->refcount--;
+    if (sdev->refcount == 0) {
+        mtx_unlock(&sdev->lock);
+        free(sdev);
+    } else {
+        mtx_unlock(&sdev->lock);
+    }
+}
+
+// drops a reference to a client; the last one frees an instance's client
+// and drops the client's reference to the device
+static void sched_client_put(sched_client_t* client) {
+    sched_device_t* sdev = client->sdev;
+
+    mtx_lock(&sdev->lock);
+    bool last = (--client->refcount == 0);
+    if (last) {
+        list_delete(&client->node);
+    }
+    mtx_unlock(&sdev->lock);
+
+    if (last) {
+        if (client != &sdev->client) {
+            free(containerof(client, sched_instance_t, client));
+        }
+        sched_downref(sdev);
+    }
+}
+
+static bool sched_is_barrier(iotxn_t* txn) {
+    return (txn->flags & (IOTXN_SYNC_BEFORE | IOTXN_SYNC_AFTER)) ||
+           ((txn->opcode != IOTXN_OP_READ) && (txn->opcode != IOTXN_OP_WRITE));
+}
+
+static void sched_insert_locked(sched_device_t* sdev, iotxn_t* clone) {
+    sched_io_t* io = get_sched_io(clone);
+    io->seq = sdev->seq++;
+
+    if (sched_is_barrier(clone)) {
+        list_add_tail(&sdev->barriers, &io->fifo_node);
+        return;
+    }
+
+    list_add_tail((clone->opcode == IOTXN_OP_WRITE) ? &sdev->write_fifo : &sdev->read_fifo,
+                  &io->fifo_node);
+
+    // requests mostly arrive in ascending order, so search from the tail
+    list_node_t* prev = list_peek_tail(&sdev->queue);
+    while (prev != NULL) {
+        if (containerof(prev, iotxn_t, node)->offset <= clone->offset) {
+            break;
+        }
+        prev = list_prev(&sdev->queue, prev);
+    }
+    if (prev != NULL) {
+        list_add_after(prev, &clone->node);
+    } else {
+        list_add_head(&sdev->queue, &clone->node);
+    }
+}
+
+// records a finished request and admits the next one its client held back
+static void sched_retire_locked(sched_device_t* sdev, sched_io_t* io,
+                                mx_status_t status, mx_off_t actual) {
+    block_stats_t* stats = &sdev->stats;
+    uint64_t* latency;
+    if (io->txn->opcode == IOTXN_OP_WRITE) {
+        stats->writes++;
+        stats->bytes_written += (status == NO_ERROR) ? actual : 0;
+        latency = stats->write_latency;
+    } else {
+        stats->reads++;
+        stats->bytes_read += (status == NO_ERROR) ? actual : 0;
+        latency = stats->read_latency;
+    }
+    uint64_t usec = (mx_time_get(MX_CLOCK_MONOTONIC) - io->queued) / MX_USEC(1);
+    uint32_t bucket = (usec > 1) ? (63 - __builtin_clzll(usec)) : 0;
+    latency[MIN(bucket, BLOCK_LATENCY_BUCKETS - 1)]++;
+
+    sched_client_t* client = io->client;
+    client->active--;
+    iotxn_t* next = list_remove_head_type(&client->backlog, iotxn_t, node);
+    if (next != NULL) {
+        client->active++;
+        sched_insert_locked(sdev, next);
+    }
+}
+
+// picks the next request to issue from those queued before limit
+static iotxn_t* sched_pick_locked(sched_device_t* sdev, uint64_t limit) {
+    // one which has waited past its deadline goes first, reads before writes
+    mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+    list_node_t* fifos[] = { &sdev->read_fifo, &sdev->write_fifo };
+    for (size_t i = 0; i < countof(fifos); i++) {
+        sched_io_t* io = list_peek_head_type(fifos[i], sched_io_t, fifo_node);
+        if ((io != NULL) && (io->seq < limit) && (io->deadline <= now)) {
+            sdev->stats.expired++;
+            return io->clone;
+        }
+    }
+
+    // otherwise continue the sweep upward from the last request issued,
+    // wrapping to the lowest offset at the top
+    iotxn_t* clone;
+    iotxn_t* lowest = NULL;
+    list_for_every_entry (&sdev->queue, clone, iotxn_t, node) {
+        if (get_sched_io(clone)->seq >= limit) {
+            continue;
+        }
+        if (clone->offset >= sdev->head) {
+            return clone;
+        }
+        if (lowest == NULL) {
+            lowest = clone;
+        }
+    }
+    return lowest;
+}
+
+// removes the next request (or merged transfer) to issue from the queue,
+// or returns NULL if nothing may be issued now
+static iotxn_t* sched_next_locked(sched_device_t* sdev) {
+    if (sdev->draining || (sdev->inflight >= SCHED_MAX_INFLIGHT)) {
+        return NULL;
+    }
+
+    uint64_t limit = UINT64_MAX;
+    sched_io_t* barrier = list_peek_head_type(&sdev->barriers, sched_io_t, fifo_node);
+    if (barrier != NULL) {
+        limit = barrier->seq;
+    }
+
+    iotxn_t* first = sched_pick_locked(sdev, limit);
+    if (first == NULL) {
+        // everything queued ahead of the barrier has been issued; it may go
+        // once that has completed
+        if ((barrier == NULL) || (sdev->inflight > 0)) {
+            return NULL;
+        }
+        list_delete(&barrier->fifo_node);
+        sdev->draining = true;
+        sdev->inflight++;
+        sdev->stats.dispatched++;
+        return barrier->clone;
+    }
+
+    // find the requests which continue where this one ends
+    size_t count = 1;
+    mx_off_t length = first->length;
+    list_node_t* node = list_next(&sdev->queue, &first->node);
+    while ((node != NULL) && (count < SCHED_MAX_MERGE_COUNT)) {
+        iotxn_t* clone = containerof(node, iotxn_t, node);
+        if ((clone->opcode != first->opcode) || (clone->offset != first->offset + length) ||
+            (get_sched_io(clone)->seq >= limit) || (length + clone->length > SCHED_MAX_MERGE)) {
+            break;
+        }
+        length += clone->length;
+        count++;
+        node = list_next(&sdev->queue, node);
+    }
+
+    iotxn_t* merged = NULL;
+    if ((count > 1) && (iotxn_alloc(&merged, 0, length, sizeof(sched_batch_t)) != NO_ERROR)) {
+        // issue this one alone
+        merged = NULL;
+        count = 1;
+    }
+
+    sdev->head = first->offset + first->length;
+    sdev->inflight++;
+    sdev->stats.dispatched++;
+    if (merged == NULL) {
+        list_delete(&first->node);
+        list_delete(&get_sched_io(first)->fifo_node);
+        return first;
+    }
+
+    sched_batch_t* batch = iotxn_to(merged, sched_batch_t);
+    list_initialize(&batch->ios);
+    merged->opcode = first->opcode;
+    merged->offset = first->offset;
+    merged->length = length;
+    merged->protocol = first->protocol;
+    memcpy(merged->protocol_data, first->protocol_data, sizeof(merged->protocol_data));
+    merged->complete_cb = sched_batch_complete;
+    merged->cookie = sdev;
+
+    iotxn_t* clone = first;
+    while (count-- > 0) {
+        iotxn_t* next = list_next_type(&sdev->queue, &clone->node, iotxn_t, node);
+        list_delete(&clone->node);
+        list_delete(&get_sched_io(clone)->fifo_node);
+        list_add_tail(&batch->ios, &clone->node);
+        sdev->head = clone->offset + clone->length;
+        clone = next;
+    }
+    sdev->stats.merged += list_length(&batch->ios) - 1;
+    return merged;
+}
+
+static void sched_io_complete(iotxn_t* clone, void* cookie) {
+    sched_device_t* sdev = cookie;
+    sched_io_t* io = get_sched_io(clone);
+    iotxn_t* txn = io->txn;
+    sched_client_t* client = io->client;
+    mx_status_t status = clone->status;
+    mx_off_t actual = clone->actual;
+
+    mtx_lock(&sdev->lock);
+    sdev->inflight--;
+    sdev->draining = false;
+    sched_retire_locked(sdev, io, status, actual);
+    mtx_unlock(&sdev->lock);
+    completion_signal(&sdev->worker_completion);
+
+    clone->ops->release(clone);
+    txn->ops->complete(txn, status, actual);
+    // may free the client and the device
+    sched_client_put(client);
+}
+
+static void sched_batch_complete(iotxn_t* merged, void* cookie) {
+    sched_device_t* sdev = cookie;
+    sched_batch_t* batch = iotxn_to(merged, sched_batch_t);
+    mx_status_t status = merged->status;
+
+    mtx_lock(&sdev->lock);
+    sdev->inflight--;
+    mtx_unlock(&sdev->lock);
+
+    void* buffer = NULL;
+    if ((status == NO_ERROR) && (merged->opcode == IOTXN_OP_READ)) {
+        merged->ops->mmap(merged, &buffer);
+    }
+
+    // the device stays alive while the requests still to be completed hold
+    // their clients
+    iotxn_t* clone;
+    while ((clone = list_remove_head_type(&batch->ios, iotxn_t, node)) != NULL) {
+        sched_io_t* io = get_sched_io(clone);
+        iotxn_t* txn = io->txn;
+        sched_client_t* client = io->client;
+
+        // each request gets its share of a short transfer
+        mx_off_t start = clone->offset - merged->offset;
+        mx_off_t actual = 0;
+        if ((status == NO_ERROR) && (merged->actual > start)) {
+            actual = MIN(merged->actual - start, clone->length);
+        }
+        if (buffer != NULL) {
+            txn->ops->copyto(txn, buffer + start, actual, 0);
+        }
+
+        mtx_lock(&sdev->lock);
+        sched_retire_locked(sdev, io, status, actual);
+        mtx_unlock(&sdev->lock);
+        completion_signal(&sdev->worker_completion);
+
+        clone->ops->release(clone);
+        txn->ops->complete(txn, status, actual);
+        sched_client_put(client);
+    }
+
+    merged->ops->release(merged);
+}
+
+// fails every request not yet issued
+static void sched_flush(sched_device_t* sdev) {
+    list_node_t list = LIST_INITIAL_VALUE(list);
+    iotxn_t* clone;
+    sched_io_t* io;
+
+    // queued requests count against their client's depth and backlogged ones
+    // do not. requests in flight still do, until they complete
+    mtx_lock(&sdev->lock);
+    while ((clone = list_remove_head_type(&sdev->queue, iotxn_t, node)) != NULL) {
+        io = get_sched_io(clone);
+        list_delete(&io->fifo_node);
+        io->client->active--;
+        list_add_tail(&list, &clone->node);
+    }
+    while ((io = list_remove_head_type(&sdev->barriers, sched_io_t, fifo_node)) != NULL) {
+        io->client->active--;
+        list_add_tail(&list, &io->clone->node);
+    }
+    sched_client_t* client;
+    list_for_every_entry (&sdev->clients, client, sched_client_t, node) {
+        while ((clone = list_remove_head_type(&client->backlog, iotxn_t, node)) != NULL) {
+            list_add_tail(&list, &clone->node);
+        }
+    }
+    mtx_unlock(&sdev->lock);
+
+    while ((clone = list_remove_head_type(&list, iotxn_t, node)) != NULL) {
+        iotxn_t* txn = get_sched_io(clone)->txn;
+        sched_client_t* client = get_sched_io(clone)->client;
+        clone->ops->release(clone);
+        txn->ops->complete(txn, ERR_REMOTE_CLOSED, 0);
+        sched_client_put(client);
+    }
+}
+
+static int sched_worker(void* arg) {
+    sched_device_t* sdev = arg;
+
+    for (;;) {
+        completion_wait(&sdev->worker_completion, MX_TIME_INFINITE);
+        completion_reset(&sdev->worker_completion);
+
+        mtx_lock(&sdev->lock);
+        if (sdev->dead) {
+            mtx_unlock(&sdev->lock);
+            break;
+        }
+        iotxn_t* txn;
+        while ((txn = sched_next_locked(sdev)) != NULL) {
+            mtx_unlock(&sdev->lock);
+
+            // gather the data of a merged write
+            if ((txn->complete_cb == sched_batch_complete) && (txn->opcode == IOTXN_OP_WRITE)) {
+                void* buffer;
+                txn->ops->mmap(txn, &buffer);
+                iotxn_t* clone;
+                list_for_every_entry (&iotxn_to(txn, sched_batch_t)->ios, clone, iotxn_t, node) {
+                    clone->ops->copyfrom(clone, buffer + (clone->offset - txn->offset),
+                                         clone->length, 0);
+                }
+            }
+            iotxn_queue(sdev->parent, txn);
+
+            mtx_lock(&sdev->lock);
+        }
+        mtx_unlock(&sdev->lock);
+    }
+
+    // fail what is queued, then wait for what the device already has, so
+    // that release() returns only once all I/O is done
+    sched_flush(sdev);
+    for (;;) {
+        completion_reset(&sdev->worker_completion);
+        mtx_lock(&sdev->lock);
+        uint32_t inflight = sdev->inflight;
+        mtx_unlock(&sdev->lock);
+        if (inflight == 0) {
+            break;
+        }
+        completion_wait(&sdev->worker_completion, MX_TIME_INFINITE);
+    }
+    return 0;
+}
+
+static void sched_queue(sched_client_t* client, iotxn_t* txn) {
+    sched_device_t* sdev = client->sdev;
+
+    iotxn_t* clone;
+    mx_status_t status = txn->ops->clone(txn, &clone, sizeof(sched_io_t));
+    if (status != NO_ERROR) {
+        txn->ops->complete(txn, status, 0);
+        return;
+    }
+    clone->complete_cb = sched_io_complete;
+    clone->cookie = sdev;
+
+    sched_io_t* io = get_sched_io(clone);
+    io->clone = clone;
+    io->txn = txn;
+    io->client = client;
+    io->queued = mx_time_get(MX_CLOCK_MONOTONIC);
+    io->deadline = io->queued + ((txn->opcode == IOTXN_OP_WRITE) ? SCHED_WRITE_DEADLINE
+                                                                 : SCHED_READ_DEADLINE);
+
+    mtx_lock(&sdev->lock);
+    if (sdev->dead) {
+        mtx_unlock(&sdev->lock);
+        clone->ops->release(clone);
+        txn->ops->complete(txn, ERR_REMOTE_CLOSED, 0);
+        return;
+    }
+    client->refcount++;
+    if (client->active >= SCHED_CLIENT_DEPTH) {
+        sdev->stats.throttled++;
+        list_add_tail(&client->backlog, &clone->node);
+    } else {
+        client->active++;
+        sched_insert_locked(sdev, clone);
+    }
+    mtx_unlock(&sdev->lock);
+
+    completion_signal(&sdev->worker_completion);
+}
+
+static ssize_t sched_do_ioctl(sched_device_t* sdev, uint32_t op, const void* cmd,
+                              size_t cmdlen, void* reply, size_t max) {
+    switch (op) {
+    case IOCTL_BLOCK_GET_STATS: {
+        if (max < sizeof(block_stats_t)) {
+            return ERR_BUFFER_TOO_SMALL;
+        }
+        mtx_lock(&sdev->lock);
+        memcpy(reply, &sdev->stats, sizeof(block_stats_t));
+        mtx_unlock(&sdev->lock);
+        return sizeof(block_stats_t);
+    }
+    default: {
+        mx_device_t* parent = sdev->parent;
+        return parent->ops->ioctl(parent, op, cmd, cmdlen, reply, max);
+    }
+    }
+}
+
+static void sched_client_init(sched_device_t* sdev, sched_client_t* client) {
+    client->sdev = sdev;
+    client->refcount = 1;
+    client->active = 0;
+    list_initialize(&client->backlog);
+}
+
+// implement instance device protocol:
+
+static void sched_instance_iotxn_queue(mx_device_t* dev, iotxn_t* txn) {
+    sched_queue(&get_sched_instance(dev)->client, txn);
+}
+
+static ssize_t sched_instance_ioctl(mx_device_t* dev, uint32_t op, const void* cmd,
+                                    size_t cmdlen, void* reply, size_t max) {
+    sched_device_t* sdev = get_sched_instance(dev)->client.sdev;
+    return sched_do_ioctl(sdev, op, cmd, cmdlen, reply, max);
+}
+
+static mx_off_t sched_instance_getsize(mx_device_t* dev) {
+    mx_device_t* parent = get_sched_instance(dev)->client.sdev->parent;
+    return parent->ops->get_size(parent);
+}
+
+static mx_status_t sched_instance_release(mx_device_t* dev) {
+    // requests still queued or in flight keep the instance until they complete
+    sched_client_put(&get_sched_instance(dev)->client);
+    return NO_ERROR;
+}
+
+static mx_protocol_device_t sched_instance_proto = {
+    .ioctl = sched_instance_ioctl,
+    .iotxn_queue = sched_instance_iotxn_queue,
+    .get_size = sched_instance_getsize,
+    .release = sched_instance_release,
+};
+
+// implement device protocol:
+
+extern mx_driver_t _driver_block_sched;
+
+static mx_status_t sched_open(mx_device_t* dev, mx_device_t** out, uint32_t flags) {
+    sched_device_t* sdev = get_sched_device(dev);
+
+    sched_instance_t* inst = calloc(1, sizeof(sched_instance_t));
+    if (!inst) {
+        return ERR_NO_MEMORY;
+    }
+    device_init(&inst->device, &_driver_block_sched, "block-sched", &sched_instance_proto);
+    inst->device.protocol_id = MX_PROTOCOL_BLOCK;
+    sched_client_init(sdev, &inst->client);
+
+    mx_status_t status;
+    if ((status = device_add_instance(&inst->device, dev)) < 0) {
+        free(inst);
+        return status;
+    }
+
+    mtx_lock(&sdev->lock);
+    sdev->refcount++;
+    list_add_tail(&sdev->clients, &inst->client.node);
+    mtx_unlock(&sdev->lock);
+
+    *out = &inst->device;
+    return NO_ERROR;
+}
+
+static ssize_t sched_ioctl(mx_device_t* dev, uint32_t op, const void* cmd,
+                           size_t cmdlen, void* reply, size_t max) {
+    return sched_do_ioctl(get_sched_device(dev), op, cmd, cmdlen, reply, max);
+}
+
+static void sched_iotxn_queue(mx_device_t* dev, iotxn_t* txn) {
+    sched_device_t* sdev = get_sched_device(dev);
+    sched_queue(&sdev->client, txn);
+}
+
+static mx_off_t sched_getsize(mx_device_t* dev) {
+    mx_device_t* parent = dev->parent;
+    return parent->ops->get_size(parent);
+}
+
+static void sched_unbind(mx_device_t* dev) {
+    sched_device_t* sdev = get_sched_device(dev);
+
+    mtx_lock(&sdev->lock);
+    sdev->dead = true;
+    mtx_unlock(&sdev->lock);
+    completion_signal(&sdev->worker_completion);
+
+    device_remove(dev);
+}
+
+static mx_status_t sched_release(mx_device_t* dev) {
+    sched_device_t* sdev = get_sched_device(dev);
+    int ret;
+    thrd_join(sdev->worker, &ret);
+    sched_client_put(&sdev->client);
+    return NO_ERROR;
+}
+
+static mx_protocol_device_t sched_proto = {
+    .open = sched_open,
+    .ioctl = sched_ioctl,
+    .iotxn_queue = sched_iotxn_queue,
+    .get_size = sched_getsize,
+    .unbind = sched_unbind,
+    .release = sched_release,
+};
+
+static mx_status_t sched_bind(mx_driver_t* drv, mx_device_t* dev, void** cookie) {
+    sched_device_t* sdev = calloc(1, sizeof(sched_device_t));
+    if (!sdev) {
+        return ERR_NO_MEMORY;
+    }
+    char name[MX_DEVICE_NAME_MAX + 1];
+    snprintf(name, sizeof(name), "%s (sched)", dev->name);
+    device_init(&sdev->device, drv, name, &sched_proto);
+    sdev->device.protocol_id = MX_PROTOCOL_BLOCK;
+    sdev->parent = dev;
+
+    mtx_init(&sdev->lock, mtx_plain);
+    sdev->worker_completion = COMPLETION_INIT;
+    list_initialize(&sdev->clients);
+    list_initialize(&sdev->queue);
+    list_initialize(&sdev->read_fifo);
+    list_initialize(&sdev->write_fifo);
+    list_initialize(&sdev->barriers);
+    sched_client_init(sdev, &sdev->client);
+    list_add_tail(&sdev->clients, &sdev->client.node);
+
+    // the device's own client holds a reference until release()
+    sdev->refcount = 1;
+
+    if (thrd_create_with_name(&sdev->worker, sched_worker, sdev, "block-sched") != thrd_success) {
+        free(sdev);
+        return ERR_NO_RESOURCES;
+    }
+
+    mx_status_t status;
+    if ((status = device_add(&sdev->device, dev)) != NO_ERROR) {
+        mtx_lock(&sdev->lock);
+        sdev->dead = true;
+        mtx_unlock(&sdev->lock);
+        completion_signal(&sdev->worker_completion);
+        int ret;
+        thrd_join(sdev->worker, &ret);
+        free(sdev);
+        return status;
+    }
+    return NO_ERROR;
+}
+
+mx_driver_t _driver_block_sched = {
+    .ops = {
+        .bind = sched_bind,
+    },
+    .flags = DRV_FLAG_NO_AUTOBIND,
+};
+
+MAGENTA_DRIVER_BEGIN(_driver_block_sched, "block-sched", "magenta", "0.1", 1)
+    BI_MATCH_IF(EQ, BIND_PROTOCOL, MX_PROTOCOL_BLOCK),
+MAGENTA_DRIVER_END(_driver_block_sched)
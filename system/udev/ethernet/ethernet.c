@@ -43,6 +43,9 @@ typedef struct ethdev0 {
 
     ethmac_info_t info;
 
+    // received packets no client buffer was available for
+    uint64_t rx_dropped;
+
     mx_device_t dev;
 } ethdev0_t;
 
@@ -93,6 +96,20 @@ typedef struct ethdev {
     void* io_buf;
     size_t io_size;
 
+    // rx fifo entries fetched from the client, not yet filled
+    eth_fifo_entry_t rx_free[FIFO_DEPTH];
+    uint32_t rx_free_next;
+    uint32_t rx_free_count;
+
+    // filled rx entries, not yet returned to the client
+    eth_fifo_entry_t rx_done[FIFO_DEPTH];
+    uint32_t rx_done_count;
+
+    // how long filled entries may be held (0 = return every burst),
+    // and when the oldest held entry must go back
+    mx_time_t rx_coalesce;
+    mx_time_t rx_deadline;
+
     // fifo thread
     thrd_t tx_thr;
 
@@ -102,17 +119,31 @@ typedef struct ethdev {
 #define get_ethdev(d) containerof(d, ethdev_t, dev)
 #define get_ethdev0(d) containerof(d, ethdev0_t, dev)
 
+// the tx thread also returns coalesced rx entries; this wakes it
+#define ETHDEV_SIGNAL_RX_DEADLINE MX_USER_SIGNAL_0
+
 static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t extra) {
-    eth_fifo_entry_t e;
     mx_status_t status;
-    uint32_t count;
 
-    // TODO: read multiple and cache locally to reduce syscalls
-    if ((status = mx_fifo_read(edev->rx_fifo, &e, sizeof(e), &count)) < 0) {
-        printf("eth: rx_fifo: cannot read: %d\n", status);
-        return;
+    // take free entries from the client in bulk, rather than one per packet
+    if (edev->rx_free_count == 0) {
+        uint32_t count;
+        if ((status = mx_fifo_read(edev->rx_fifo, edev->rx_free,
+                                   sizeof(edev->rx_free), &count)) < 0) {
+            if (status != ERR_SHOULD_WAIT) {
+                printf("eth: rx_fifo: cannot read: %d\n", status);
+            }
+            // no buffers available. drop packet
+            edev->edev0->rx_dropped++;
+            return;
+        }
+        edev->rx_free_next = 0;
+        edev->rx_free_count = count;
     }
 
+    eth_fifo_entry_t e = edev->rx_free[edev->rx_free_next++];
+    edev->rx_free_count--;
+
     if ((e.offset >= edev->io_size) || ((e.length > (edev->io_size - e.offset)))) {
         // invalid offset/length. report error. drop packet
         e.length = 0;
@@ -127,10 +158,42 @@ static void eth_handle_rx(ethdev_t* edev, const void* data, size_t len, uint32_t
         e.flags = ETH_FIFO_RX_OK | extra;
     }
 
-    if ((status = mx_fifo_write(edev->rx_fifo, &e, sizeof(e), &count)) < 0) {
+    edev->rx_done[edev->rx_done_count++] = e;
+}
+
+// return all filled rx entries to the client in one fifo write
+static void eth_rx_flush_locked(ethdev_t* edev) {
+    if (edev->rx_done_count == 0) {
+        return;
+    }
+
+    mx_status_t status;
+    uint32_t count;
+    if ((status = mx_fifo_write(edev->rx_fifo, edev->rx_done,
+                                sizeof(eth_fifo_entry_t) * edev->rx_done_count, &count)) < 0) {
         printf("eth: rx_fifo: cannot write: %d\n", status);
+    } else if (count != edev->rx_done_count) {
+        printf("eth: rx_fifo: only wrote %u of %u!\n", count, edev->rx_done_count);
+    }
+    edev->rx_done_count = 0;
+    edev->rx_deadline = 0;
+}
+
+// called at the end of each burst of received packets
+static void eth_rx_end_burst_locked(ethdev_t* edev) {
+    if (edev->rx_done_count == 0) {
         return;
     }
+
+    // hold the entries back if the client asked for coalescing, unless
+    // it is running out of buffers to receive into
+    if ((edev->rx_coalesce == 0) || (edev->rx_free_count == 0) ||
+        (edev->rx_done_count >= FIFO_DEPTH / 2)) {
+        eth_rx_flush_locked(edev);
+    } else if (edev->rx_deadline == 0) {
+        edev->rx_deadline = mx_time_get(MX_CLOCK_MONOTONIC) + edev->rx_coalesce;
+        mx_object_signal(edev->tx_fifo, 0, ETHDEV_SIGNAL_RX_DEADLINE);
+    }
 }
 
 static void eth0_status(void* cookie, uint32_t status) {
@@ -139,20 +202,37 @@ static void eth0_status(void* cookie, uint32_t status) {
 
 // TODO: I think if this arrives at the wrong time during teardown we
 // can deadlock with the ethermac device
-static void eth0_recv(void* cookie, void* data, size_t len, uint32_t flags) {
+static void eth0_recv_batch(void* cookie, ethmac_rx_frame_t* frames, size_t count) {
     ethdev0_t* edev0 = cookie;
 
     ethdev_t* edev;
     mtx_lock(&edev0->lock);
     list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
-        eth_handle_rx(edev, data, len, 0);
+        for (size_t n = 0; n < count; n++) {
+            uint32_t extra = (frames[n].flags & ETHMAC_RX_CSUM_VALID) ? ETH_FIFO_RX_CSUM : 0;
+            eth_handle_rx(edev, frames[n].data, frames[n].length, extra);
+            if (edev->rx_done_count == FIFO_DEPTH) {
+                eth_rx_flush_locked(edev);
+            }
+        }
+        eth_rx_end_burst_locked(edev);
     }
     mtx_unlock(&edev0->lock);
 }
 
+static void eth0_recv(void* cookie, void* data, size_t len, uint32_t flags) {
+    ethmac_rx_frame_t frame = {
+        .data = data,
+        .length = len,
+        .flags = flags,
+    };
+    eth0_recv_batch(cookie, &frame, 1);
+}
+
 static ethmac_ifc_t ethmac_ifc = {
     .status = eth0_status,
     .recv = eth0_recv,
+    .recv_batch = eth0_recv_batch,
 };
 
 static void eth_tx_echo(ethdev0_t* edev0, const void* data, size_t len) {
@@ -161,6 +241,7 @@ static void eth_tx_echo(ethdev0_t* edev0, const void* data, size_t len) {
     list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
         if (edev->state & ETHDEV_TX_LISTEN) {
             eth_handle_rx(edev, data, len, ETH_FIFO_RX_TX);
+            eth_rx_end_burst_locked(edev);
         }
     }
     mtx_unlock(&edev0->lock);
@@ -196,6 +277,27 @@ static mx_status_t eth_tx_listen_locked(ethdev_t* edev, bool yes) {
     return NO_ERROR;
 }
 
+// time until held rx entries are due back to the client
+static mx_time_t eth_rx_timeout(ethdev_t* edev) {
+    mx_time_t timeout = MX_TIME_INFINITE;
+    mtx_lock(&edev->edev0->lock);
+    if (edev->rx_deadline != 0) {
+        mx_time_t now = mx_time_get(MX_CLOCK_MONOTONIC);
+        timeout = (edev->rx_deadline > now) ? (edev->rx_deadline - now) : 0;
+    }
+    mtx_unlock(&edev->edev0->lock);
+    return timeout;
+}
+
+static void eth_rx_expire(ethdev_t* edev) {
+    mtx_lock(&edev->edev0->lock);
+    if ((edev->rx_deadline != 0) &&
+        (mx_time_get(MX_CLOCK_MONOTONIC) >= edev->rx_deadline)) {
+        eth_rx_flush_locked(edev);
+    }
+    mtx_unlock(&edev->edev0->lock);
+}
+
 static int eth_tx_thread(void* arg) {
     ethdev_t* edev = (ethdev_t*)arg;
     ethdev0_t* edev0 = edev->edev0;
@@ -206,12 +308,23 @@ static int eth_tx_thread(void* arg) {
     for (;;) {
         if ((status = mx_fifo_read(edev->tx_fifo, entries, sizeof(entries), &count)) < 0) {
             if (status == ERR_SHOULD_WAIT) {
-                if ((status = mx_object_wait_one(edev->tx_fifo,
-                                                 MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED,
-                                                 MX_TIME_INFINITE, NULL)) < 0) {
+                mx_signals_t observed;
+                status = mx_object_wait_one(edev->tx_fifo,
+                                            MX_FIFO_READABLE | MX_FIFO_PEER_CLOSED |
+                                            ETHDEV_SIGNAL_RX_DEADLINE,
+                                            eth_rx_timeout(edev), &observed);
+                if (status == ERR_TIMED_OUT) {
+                    eth_rx_expire(edev);
+                    continue;
+                }
+                if (status < 0) {
                     printf("eth: tx_fifo: error waiting: %d\n", status);
                     break;
                 }
+                if (observed & ETHDEV_SIGNAL_RX_DEADLINE) {
+                    // a deadline was set; wait again with it in effect
+                    mx_object_signal(edev->tx_fifo, ETHDEV_SIGNAL_RX_DEADLINE, 0);
+                }
                 continue;
             } else {
                 printf("eth: tx_fifo: cannot read: %d\n", status);
@@ -313,6 +426,52 @@ fail:
     return status;
 }
 
+static ssize_t eth_set_rx_coalesce_locked(ethdev_t* edev, const void* in_buf, size_t in_len) {
+    if (in_len < sizeof(uint32_t)) {
+        return ERR_INVALID_ARGS;
+    }
+    edev->rx_coalesce = MX_USEC(*((const uint32_t*) in_buf));
+    if (edev->rx_coalesce == 0) {
+        eth_rx_flush_locked(edev);
+    }
+    return NO_ERROR;
+}
+
+// These two call into the ethermac without the lock held, since its
+// interrupt thread may hold its own lock while waiting for ours.
+static ssize_t eth_get_stats(ethdev_t* edev, void* out_buf, size_t out_len) {
+    ethdev0_t* edev0 = edev->edev0;
+
+    if (out_len < sizeof(eth_stats_t)) {
+        return ERR_BUFFER_TOO_SMALL;
+    }
+
+    eth_stats_t* stats = out_buf;
+    memset(stats, 0, sizeof(*stats));
+    if (edev0->macops->get_stats != NULL) {
+        mx_status_t status;
+        if ((status = edev0->macops->get_stats(edev0->mac, stats)) < 0) {
+            return status;
+        }
+    }
+    mtx_lock(&edev0->lock);
+    stats->rx_dropped += edev0->rx_dropped;
+    mtx_unlock(&edev0->lock);
+    return sizeof(*stats);
+}
+
+static ssize_t eth_set_moderation(ethdev_t* edev, const void* in_buf, size_t in_len) {
+    ethdev0_t* edev0 = edev->edev0;
+
+    if (in_len < sizeof(eth_moderation_t)) {
+        return ERR_INVALID_ARGS;
+    }
+    if (edev0->macops->set_moderation == NULL) {
+        return ERR_NOT_SUPPORTED;
+    }
+    return edev0->macops->set_moderation(edev0->mac, in_buf);
+}
+
 static mx_status_t eth_start_locked(ethdev_t* edev) {
     ethdev0_t* edev0 = edev->edev0;
 
@@ -359,6 +518,7 @@ static mx_status_t eth_stop_locked(ethdev_t* edev) {
     ethdev0_t* edev0 = edev->edev0;
 
     if (edev->state & ETHDEV_RUNNING) {
+        eth_rx_flush_locked(edev);
         edev->state &= (~ETHDEV_RUNNING);
         list_delete(&edev->node);
         list_add_tail(&edev0->list_idle, &edev->node);
@@ -377,6 +537,20 @@ static ssize_t eth_ioctl(mx_device_t* dev, uint32_t op,
                          void* out_buf, size_t out_len) {
 
     ethdev_t* edev = get_ethdev(dev);
+    if ((op == IOCTL_ETHERNET_GET_STATS) || (op == IOCTL_ETHERNET_SET_MODERATION)) {
+        mtx_lock(&edev->edev0->lock);
+        bool dead = (edev->state & ETHDEV_DEAD);
+        mtx_unlock(&edev->edev0->lock);
+        if (dead) {
+            return ERR_BAD_STATE;
+        }
+        if (op == IOCTL_ETHERNET_GET_STATS) {
+            return eth_get_stats(edev, out_buf, out_len);
+        } else {
+            return eth_set_moderation(edev, in_buf, in_len);
+        }
+    }
+
     mtx_lock(&edev->edev0->lock);
     mx_status_t status;
     if (edev->state & ETHDEV_DEAD) {
@@ -415,6 +589,9 @@ static ssize_t eth_ioctl(mx_device_t* dev, uint32_t op,
     case IOCTL_ETHERNET_TX_LISTEN_STOP:
         status = eth_tx_listen_locked(edev, false);
         break;
+    case IOCTL_ETHERNET_SET_RX_COALESCE:
+        status = eth_set_rx_coalesce_locked(edev, in_buf, in_len);
+        break;
     default:
         status = ERR_NOT_SUPPORTED;
     }
@@ -427,6 +604,8 @@ done:
 
 // kill tx thread, release buffers, etc
 // called from unbind and close
+// the lock is dropped while the tx thread is joined, since it takes the
+// lock itself
 static void eth_kill_locked(ethdev_t* edev) {
     if (edev->state & ETHDEV_DEAD) {
         return;
@@ -456,7 +635,9 @@ static void eth_kill_locked(ethdev_t* edev) {
     if (edev->state & ETHDEV_TX_THREAD) {
         edev->state &= (~ETHDEV_TX_THREAD);
         int ret;
+        mtx_unlock(&edev->edev0->lock);
         thrd_join(edev->tx_thr, &ret);
+        mtx_lock(&edev->edev0->lock);
         printf("eth: kill: tx thread exited\n");
     }
 
@@ -531,12 +712,20 @@ static void eth0_unbind(mx_device_t* dev) {
 
     // tear down shared memory, fifos, and threads
     // to encourage any open instances to close
+    // eth_kill_locked() drops the lock, so start over after each
     ethdev_t* edev;
+again:
     list_for_every_entry(&edev0->list_active, edev, ethdev_t, node) {
-        eth_kill_locked(edev);
+        if (!(edev->state & ETHDEV_DEAD)) {
+            eth_kill_locked(edev);
+            goto again;
+        }
     }
     list_for_every_entry(&edev0->list_idle, edev, ethdev_t, node) {
-        eth_kill_locked(edev);
+        if (!(edev->state & ETHDEV_DEAD)) {
+            eth_kill_locked(edev);
+            goto again;
+        }
     }
 
     mtx_unlock(&edev0->lock);
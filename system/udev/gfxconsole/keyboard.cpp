@@ -75,6 +75,28 @@ static void vc_process_kb_report(uint8_t* report_buf, hid_keys_t* key_state,
     *prev_idx = 1 - *prev_idx;
 }
 
+// Waits for a report in the ring. Reports already there are taken without a
+// syscall, so a burst of them costs one wakeup.
+static mx_status_t vc_ring_wait(input_ring_t* ring, mx_handle_t event, mx_time_t timeout) {
+    for (;;) {
+        if (input_ring_pending(ring)) {
+            return NO_ERROR;
+        }
+        mx_signals_t pending;
+        mx_status_t rc = mx_object_wait_one(event,
+                                            INPUT_RING_SIGNAL_READABLE | INPUT_RING_SIGNAL_CLOSED,
+                                            timeout, &pending);
+        if (rc != NO_ERROR) {
+            return rc;
+        }
+        if (pending & INPUT_RING_SIGNAL_CLOSED) {
+            return input_ring_pending(ring) ? NO_ERROR : ERR_REMOTE_CLOSED;
+        }
+        // clear before looking again, so a report added after the check re-signals
+        mx_object_signal(event, INPUT_RING_SIGNAL_READABLE, 0);
+    }
+}
+
 struct vc_input_thread_args {
     int fd;
     keypress_handler_t keypress_handler;
@@ -101,9 +123,30 @@ static int vc_input_thread(void* arg) {
         repeat_enabled = false;
     }
 
+    // take reports from the shared ring if the device has one, else read() them
+    input_report_ring_t ring_info;
+    input_ring_t* ring = nullptr;
+    if (ioctl_input_get_report_ring(args.fd, &ring_info) == sizeof(ring_info)) {
+        uintptr_t addr;
+        if (mx_vmar_map(mx_vmar_root_self(), 0, ring_info.vmo, 0, ring_info.size,
+                        MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &addr) == NO_ERROR) {
+            ring = reinterpret_cast<input_ring_t*>(addr);
+        } else {
+            mx_handle_close(ring_info.vmo);
+            mx_handle_close(ring_info.event);
+        }
+    }
+
     for (;;) {
-        mx_status_t rc = mxio_wait_fd(args.fd, MXIO_EVT_READABLE, NULL,
-                                      repeat_interval);
+        mx_status_t rc;
+        if (ring != nullptr) {
+            rc = vc_ring_wait(ring, ring_info.event, repeat_interval);
+            if (rc != NO_ERROR && rc != ERR_TIMED_OUT) {
+                break;
+            }
+        } else {
+            rc = mxio_wait_fd(args.fd, MXIO_EVT_READABLE, NULL, repeat_interval);
+        }
 
         if (rc == ERR_TIMED_OUT) {
             // Times out only when need to repeat.
@@ -119,7 +162,12 @@ static int vc_input_thread(void* arg) {
         }
 
         memcpy(previous_report_buf, report_buf, sizeof(report_buf));
-        ssize_t r = read(args.fd, report_buf, sizeof(report_buf));
+        ssize_t r;
+        if (ring != nullptr) {
+            r = input_ring_read(ring, report_buf, sizeof(report_buf));
+        } else {
+            r = read(args.fd, report_buf, sizeof(report_buf));
+        }
         if (r < 0) {
             break; // will be restarted by poll thread if needed
         }
@@ -159,6 +207,11 @@ static int vc_input_thread(void* arg) {
             }
         }
     }
+    if (ring != nullptr) {
+        mx_vmar_unmap(mx_vmar_root_self(), reinterpret_cast<uintptr_t>(ring), ring_info.size);
+        mx_handle_close(ring_info.vmo);
+        mx_handle_close(ring_info.event);
+    }
     return 0;
 }
 
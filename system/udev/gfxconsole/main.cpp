@@ -304,6 +304,8 @@ static ssize_t vc_device_read(mx_device_t* dev, void* buf, size_t count, mx_off_
 ssize_t vc_device_write(mx_device_t* dev, const void* buf, size_t count, mx_off_t off) {
     vc_device_t* vc = get_vc_device(dev);
     mtx_lock(&vc->lock);
+    vc->invx0 = vc->columns + 1;
+    vc->invx1 = -1;
     vc->invy0 = vc_device_rows(vc) + 1;
     vc->invy1 = -1;
     const uint8_t* str = (const uint8_t*)buf;
@@ -311,7 +313,7 @@ ssize_t vc_device_write(mx_device_t* dev, const void* buf, size_t count, mx_off_
         vc->textcon.putc(&vc->textcon, str[i]);
     }
     if (vc->invy1 >= 0) {
-        vc_gfx_invalidate(vc, 0, vc->invy0, vc->columns, vc->invy1 - vc->invy0);
+        vc_gfx_invalidate(vc, vc->invx0, vc->invy0, vc->invx1 - vc->invx0, vc->invy1 - vc->invy0);
     }
     if (!vc->active && !(vc->flags & VC_FLAG_HASINPUT)) {
         vc->flags |= VC_FLAG_HASINPUT;
@@ -432,26 +434,30 @@ static int vc_log_reader_thread(void* arg) {
         return -1;
     }
 
-    char buf[MX_LOG_RECORD_MAX];
-    mx_log_record_t* rec = (mx_log_record_t*)buf;
+    alignas(mx_log_record_t) char buf[MX_LOG_RECORD_MAX * 16];
     mx_status_t status;
     for (;;) {
-        if ((status = mx_log_read(h, MX_LOG_RECORD_MAX, rec, 0)) < 0) {
+        if ((status = mx_log_read(h, sizeof(buf), buf, MX_LOG_FLAG_BATCH)) < 0) {
             if (status == ERR_SHOULD_WAIT) {
                 mx_object_wait_one(h, MX_LOG_READABLE, MX_TIME_INFINITE, NULL);
                 continue;
             }
             break;
         }
-        char tmp[64];
-        snprintf(tmp, 64, "\033[32m%05d.%03d\033[39m] \033[31m%05" PRIu64 ".\033[36m%05" PRIu64 "\033[39m> ",
-                 (int)(rec->timestamp / 1000000000ULL),
-                 (int)((rec->timestamp / 1000000ULL) % 1000ULL),
-                 rec->pid, rec->tid);
-        vc_device_write(dev, tmp, strlen(tmp), 0);
-        vc_device_write(dev, rec->data, rec->datalen, 0);
-        if ((rec->datalen == 0) || (rec->data[rec->datalen - 1] != '\n')) {
-            vc_device_write(dev, "\n", 1, 0);
+        for (size_t off = 0; off < (size_t)status;) {
+            auto* rec = reinterpret_cast<mx_log_record_t*>(buf + off);
+            off += MX_LOG_RECORD_SIZE(rec);
+
+            char tmp[64];
+            snprintf(tmp, 64, "\033[32m%05d.%03d\033[39m] \033[31m%05" PRIu64 ".\033[36m%05" PRIu64 "\033[39m> ",
+                     (int)(rec->timestamp / 1000000000ULL),
+                     (int)((rec->timestamp / 1000000ULL) % 1000ULL),
+                     rec->pid, rec->tid);
+            vc_device_write(dev, tmp, strlen(tmp), 0);
+            vc_device_write(dev, rec->data, rec->datalen, 0);
+            if ((rec->datalen == 0) || (rec->data[rec->datalen - 1] != '\n')) {
+                vc_device_write(dev, "\n", 1, 0);
+            }
         }
     }
 
@@ -528,6 +534,11 @@ static void display_flush(uint starty, uint endy)
     g_fb_display_protocol->flush(g_fb_device);
 }
 
+static void display_flush_rect(uint x, uint y, uint width, uint height)
+{
+    g_fb_display_protocol->flush_region(g_fb_device, x, y, width, height);
+}
+
 static mx_status_t vc_root_bind(mx_driver_t* drv, mx_device_t* dev, void** cookie) {
     if (g_vc_initialized) {
         // disallow multiple instances
@@ -565,6 +576,10 @@ static mx_status_t vc_root_bind(mx_driver_t* drv, mx_device_t* dev, void** cooki
     if (disp->flush) {
         g_hw_gfx.flush = display_flush;
     }
+    // and if it can take just the damaged part, hand it that
+    if (disp->flush_region) {
+        g_hw_gfx.flush_rect = display_flush_rect;
+    }
 
     // publish the root vc device. opening this device will create a new vc
     mx_device_t* device;
@@ -92,16 +92,27 @@ static void vc_device_invalidate(void* cookie, int x0, int y0, int w, int h) {
 
 // implement tc callbacks:
 
-static inline void vc_invalidate_lines(vc_device_t* dev, int y, int h) {
+static inline void vc_invalidate_rect(vc_device_t* dev, int x, int y, int w, int h) {
+    if (x < dev->invx0) {
+        dev->invx0 = x;
+    }
     if (y < dev->invy0) {
         dev->invy0 = y;
     }
+    x += w;
     y += h;
+    if (x > dev->invx1) {
+        dev->invx1 = x;
+    }
     if (y > dev->invy1) {
         dev->invy1 = y;
     }
 }
 
+static inline void vc_invalidate_lines(vc_device_t* dev, int y, int h) {
+    vc_invalidate_rect(dev, 0, y, dev->columns, h);
+}
+
 static void vc_tc_invalidate(void* cookie, int x0, int y0, int w, int h) {
     vc_device_t* dev = reinterpret_cast<vc_device_t*>(cookie);
     if (dev->flags & VC_FLAG_RESETSCROLL) {
@@ -111,17 +122,17 @@ static void vc_tc_invalidate(void* cookie, int x0, int y0, int w, int h) {
     if (dev->vpy < 0)
         return;
     vc_device_invalidate(cookie, x0, y0, w, h);
-    vc_invalidate_lines(dev, y0, h);
+    vc_invalidate_rect(dev, x0, y0, w, h);
 }
 
 static void vc_tc_movecursor(void* cookie, int x, int y) {
     vc_device_t* dev = reinterpret_cast<vc_device_t*>(cookie);
     if (!dev->hide_cursor) {
         vc_device_invalidate(cookie, dev->x, dev->y, 1, 1);
-        vc_invalidate_lines(dev, dev->y, 1);
+        vc_invalidate_rect(dev, dev->x, dev->y, 1, 1);
         gfx_fillrect(dev->gfx, x * dev->charw, y * dev->charh, dev->charw, dev->charh,
                      palette_to_color(dev, dev->front_color));
-        vc_invalidate_lines(dev, y, 1);
+        vc_invalidate_rect(dev, x, y, 1, 1);
     }
     dev->x = x;
     dev->y = y;
@@ -180,14 +191,14 @@ static void vc_tc_setparam(void* cookie, int param, uint8_t* arg, size_t arglen)
             vc_tc_movecursor(dev, dev->x, dev->y);
             gfx_fillrect(dev->gfx, dev->x * dev->charw, dev->y * dev->charh, dev->charw, dev->charh,
                          palette_to_color(dev, dev->front_color));
-            vc_invalidate_lines(dev, dev->y, 1);
+            vc_invalidate_rect(dev, dev->x, dev->y, 1, 1);
         }
         break;
     case TC_HIDE_CURSOR:
         if (!dev->hide_cursor) {
             dev->hide_cursor = true;
             vc_device_invalidate(cookie, dev->x, dev->y, 1, 1);
-            vc_invalidate_lines(dev, dev->y, 1);
+            vc_invalidate_rect(dev, dev->x, dev->y, 1, 1);
         }
     default:; // nothing
     }
@@ -46,17 +46,17 @@ void vc_gfx_invalidate(vc_device_t* dev, unsigned x, unsigned y, unsigned w, uns
         gfx_blend(dev->hw_gfx, dev->gfx, x * dev->charw, y * dev->charh,
                   w * dev->charw, h * dev->charh, x * dev->charw, desty);
     }
-    gfx_flush_rows(dev->hw_gfx, desty, desty + h * dev->charh);
+    gfx_flush_rect(dev->hw_gfx, x * dev->charw, desty, w * dev->charw, h * dev->charh);
 }
 
 void vc_gfx_invalidate_region(vc_device_t* dev, unsigned x, unsigned y, unsigned w, unsigned h) {
     if (!dev->active)
         return;
     unsigned desty = dev->flags & VC_FLAG_FULLSCREEN ? y : dev->st_gfx->height + y;
-    if ((x == 0) && (w == dev->columns)) {
+    if ((x == 0) && (w == dev->gfx->width)) {
         gfx_copylines(dev->hw_gfx, dev->gfx, y, desty, h);
     } else {
         gfx_blend(dev->hw_gfx, dev->gfx, x, y, w, h, x, desty);
     }
-    gfx_flush_rows(dev->hw_gfx, desty, desty + h);
+    gfx_flush_rect(dev->hw_gfx, x, desty, w, h);
 }
@@ -60,8 +60,8 @@ typedef struct vc_device {
     unsigned scrollback_rows;
     // number of rows in scrollback
 
-    int invy0, invy1;
-    // offscreen invalid lines, tracked during textcon drawing
+    int invx0, invy0, invx1, invy1;
+    // offscreen invalid rectangle, in cells, tracked during textcon drawing
 
     unsigned x, y;
     // cursor
@@ -12,6 +12,7 @@
 
 #include <magenta/syscalls.h>
 #include <magenta/types.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -23,6 +24,8 @@ typedef mx_status_t status_t;
 typedef struct ethernet_device {
     ethdev_t eth;
     mtx_t lock;
+    // guards the tx counters, which send() updates without lock
+    mtx_t tx_lock;
     mx_device_t dev;
     pci_protocol_t* pci;
     mx_device_t* pcidev;
@@ -32,6 +35,13 @@ typedef struct ethernet_device {
     thrd_t thread;
     io_buffer_t buffer;
 
+    // interrupt moderation (see eth_moderation_t)
+    uint32_t irq_usec;
+    uint32_t poll_budget;
+
+    // rx and irq counters are kept under lock, tx under tx_lock
+    eth_stats_t stats;
+
     // callback interface to attached ethernet layer
     ethmac_ifc_t* ifc;
     void* cookie;
@@ -39,6 +49,50 @@ typedef struct ethernet_device {
 
 #define get_eth_device(d) containerof(d, ethernet_device_t, dev)
 
+#define ETH_IRQ_USEC_DEFAULT 50
+#define ETH_POLL_BUDGET_DEFAULT 64
+
+// hand up at most budget received packets; returns how many there were
+static uint32_t eth_rx_service_locked(ethernet_device_t* edev, uint32_t budget) {
+    uint32_t total = 0;
+    uint32_t count;
+    do {
+        uint32_t max = budget - total;
+        if (max > ETH_RXBUF_COUNT) {
+            max = ETH_RXBUF_COUNT;
+        }
+        // hand up everything the hardware has received in one batch
+        ethmac_rx_frame_t frames[ETH_RXBUF_COUNT];
+        for (count = 0; count < max; count++) {
+            ethmac_rx_frame_t* f = &frames[count];
+            if (eth_rx_peek(&edev->eth, count, &f->data, &f->length) != NO_ERROR) {
+                break;
+            }
+            f->flags = 0;
+            edev->stats.rx_bytes += f->length;
+        }
+        if (count && edev->ifc) {
+            edev->ifc->recv_batch(edev->cookie, frames, count);
+        }
+        eth_rx_ack_n(&edev->eth, count);
+        total += count;
+    } while ((count > 0) && (total < budget));
+    edev->stats.rx_packets += total;
+    return total;
+}
+
+// Deal with whatever irq reports.  Returns true if the poll budget ran
+// out, meaning the hardware is busy enough that polling it is cheaper
+// than taking interrupts.
+static bool eth_service_locked(ethernet_device_t* edev, unsigned irq) {
+    uint32_t budget = edev->poll_budget ? edev->poll_budget : UINT32_MAX;
+    uint32_t count = 0;
+    if (irq & ETH_IRQ_RX) {
+        count = eth_rx_service_locked(edev, budget);
+    }
+    return (edev->poll_budget != 0) && (count >= budget);
+}
+
 static int irq_thread(void* arg) {
     ethernet_device_t* edev = arg;
     for (;;) {
@@ -53,21 +107,29 @@ static int irq_thread(void* arg) {
             mx_interrupt_complete(edev->irqh);
 
         mtx_lock(&edev->lock);
-        if (eth_handle_irq(&edev->eth) & ETH_IRQ_RX) {
-            void* data;
-            size_t len;
-
-            while (eth_rx(&edev->eth, &data, &len) == NO_ERROR) {
-                if (edev->ifc) {
-                    edev->ifc->recv(edev->cookie, data, len, 0);
-                }
-                eth_rx_ack(&edev->eth);
-            }
+        edev->stats.irqs++;
+        bool busy = eth_service_locked(edev, eth_handle_irq(&edev->eth));
+        if (busy) {
+            // under load: stop taking rx interrupts and poll instead
+            eth_irq_enable(&edev->eth, ETH_IRQ_RX, false);
         }
         mtx_unlock(&edev->lock);
 
         if (!edev->edge_triggered_irq)
             mx_interrupt_complete(edev->irqh);
+
+        while (busy) {
+            thrd_yield();
+            mtx_lock(&edev->lock);
+            edev->stats.polls++;
+            busy = eth_service_locked(edev, ETH_IRQ_RX);
+            if (!busy) {
+                // caught up: anything arriving from here on interrupts,
+                // including a packet that came in just now
+                eth_irq_enable(&edev->eth, ETH_IRQ_RX, true);
+            }
+            mtx_unlock(&edev->lock);
+        }
     }
     return 0;
 }
@@ -111,7 +173,35 @@ static mx_status_t eth_start(mx_device_t* dev, ethmac_ifc_t* ifc, void* cookie)
 
 static void eth_send(mx_device_t* dev, uint32_t options, void* data, size_t length) {
     ethernet_device_t* edev = get_eth_device(dev);
-    eth_tx(&edev->eth, data, length);
+    mtx_lock(&edev->tx_lock);
+    if (eth_tx(&edev->eth, data, length) < 0) {
+        edev->stats.tx_dropped++;
+    } else {
+        edev->stats.tx_packets++;
+        edev->stats.tx_bytes += length;
+    }
+    mtx_unlock(&edev->tx_lock);
+}
+
+static mx_status_t eth_get_stats(mx_device_t* dev, eth_stats_t* stats) {
+    ethernet_device_t* edev = get_eth_device(dev);
+    mtx_lock(&edev->lock);
+    edev->stats.rx_dropped += eth_rx_missed(&edev->eth);
+    mtx_lock(&edev->tx_lock);
+    *stats = edev->stats;
+    mtx_unlock(&edev->tx_lock);
+    mtx_unlock(&edev->lock);
+    return NO_ERROR;
+}
+
+static mx_status_t eth_set_moderation(mx_device_t* dev, const eth_moderation_t* mod) {
+    ethernet_device_t* edev = get_eth_device(dev);
+    mtx_lock(&edev->lock);
+    edev->irq_usec = mod->irq_usec;
+    edev->poll_budget = mod->poll_budget;
+    eth_set_irq_interval(&edev->eth, edev->irq_usec);
+    mtx_unlock(&edev->lock);
+    return NO_ERROR;
 }
 
 static ethmac_protocol_t ethmac_ops = {
@@ -119,6 +209,8 @@ static ethmac_protocol_t ethmac_ops = {
     .stop = eth_stop,
     .start = eth_start,
     .send = eth_send,
+    .get_stats = eth_get_stats,
+    .set_moderation = eth_set_moderation,
 };
 
 static mx_status_t eth_release(mx_device_t* dev) {
@@ -141,6 +233,7 @@ static mx_status_t eth_bind(mx_driver_t* drv, mx_device_t* dev, void** cookie) {
         return ERR_NO_MEMORY;
     }
     mtx_init(&edev->lock, mtx_plain);
+    mtx_init(&edev->tx_lock, mtx_plain);
 
     pci_protocol_t* pci;
     if (device_get_protocol(dev, MX_PROTOCOL_PCI, (void**)&pci)) {
@@ -205,6 +298,9 @@ static mx_status_t eth_bind(mx_driver_t* drv, mx_device_t* dev, void** cookie) {
 
     eth_setup_buffers(&edev->eth, io_buffer_virt(&edev->buffer), io_buffer_phys(&edev->buffer));
     eth_init_hw(&edev->eth);
+    edev->irq_usec = ETH_IRQ_USEC_DEFAULT;
+    edev->poll_budget = ETH_POLL_BUDGET_DEFAULT;
+    eth_set_irq_interval(&edev->eth, edev->irq_usec);
 
     device_init(&edev->dev, drv, "intel-ethernet", &device_ops);
     edev->dev.protocol_id = MX_PROTOCOL_ETHERMAC;
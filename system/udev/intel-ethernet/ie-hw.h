@@ -18,6 +18,7 @@
 #define IE_ICS       0x00C8 // Interrupt Cause Set
 #define IE_IMS       0x00D0 // Interrupt Mask Set / Read
 #define IE_IMC       0x00D8 // Interrupt Mask Clear
+#define IE_ITR       0x00C4 // Interrupt Throttling Rate (256ns units)
 
 #define IE_RCTL      0x0100 // Receive Control
 #define IE_RDBAL     0x2800 // RX Descriptor Base Low
@@ -25,7 +26,7 @@
 #define IE_RDLEN     0x2808 // RX Descriptor Length
 #define IE_RDH       0x2810 // RX Descriptor Head
 #define IE_RDT       0x2818 // RX Descriptor Tail
-#define IE_RDTR      0x3820 // RX Delay Timer
+#define IE_RDTR      0x2820 // RX Delay Timer
 
 #define IE_TCTL      0x0400 // Transmit Control
 #define IE_TIPG      0x0410 // TX IPG
@@ -45,6 +46,8 @@
 #define IE_RAL(n)    (0x5400 + ((n) * 8)) // RX Address Low
 #define IE_RAH(n)    (0x5404 + ((n) * 8)) // RX Address High
 
+#define IE_MPC       0x4010 // Missed Packets Count (clears on read)
+
 
 #define IE_CTRL_FD        (1 << 0) // Full Duplex
 #define IE_CTRL_LRST      (1 << 3) // Link Reset  (Halt TX and RX)
@@ -45,7 +45,15 @@ unsigned eth_handle_irq(ethdev_t* eth) {
 }
 
 status_t eth_rx(ethdev_t* eth, void** data, size_t* len) {
-    uint32_t n = eth->rx_rd_ptr;
+    return eth_rx_peek(eth, 0, data, len);
+}
+
+status_t eth_rx_peek(ethdev_t* eth, uint32_t index, void** data, size_t* len) {
+    if (index >= ETH_RXBUF_COUNT - 1) {
+        return ERR_SHOULD_WAIT;
+    }
+
+    uint32_t n = (eth->rx_rd_ptr + index) & (ETH_RXBUF_COUNT - 1);
     uint64_t info = eth->rxd[n].info;
 
     if (!(info & IE_RXD_DONE)) {
@@ -62,12 +70,21 @@ status_t eth_rx(ethdev_t* eth, void** data, size_t* len) {
 }
 
 void eth_rx_ack(ethdev_t* eth) {
-    uint32_t n = eth->rx_rd_ptr;
+    eth_rx_ack_n(eth, 1);
+}
+
+void eth_rx_ack_n(ethdev_t* eth, uint32_t count) {
+    if (count == 0) {
+        return;
+    }
 
-    // make buffer available to hw
-    eth->rxd[n].info = 0;
-    writel(n, IE_RDT);
-    n = (n + 1) & (ETH_RXBUF_COUNT - 1);
+    // make buffers available to hw, with one tail update for the lot
+    uint32_t n = eth->rx_rd_ptr;
+    for (uint32_t i = 0; i < count; i++) {
+        eth->rxd[n].info = 0;
+        n = (n + 1) & (ETH_RXBUF_COUNT - 1);
+    }
+    writel((n - 1) & (ETH_RXBUF_COUNT - 1), IE_RDT);
     eth->rx_rd_ptr = n;
 }
 
@@ -114,6 +131,19 @@ status_t eth_tx(ethdev_t* eth, const void* data, size_t len) {
     return len;
 }
 
+void eth_set_irq_interval(ethdev_t* eth, uint32_t usec) {
+    uint64_t itr = ((uint64_t)usec * 1000) / 256;
+    writel((itr > 0xFFFF) ? 0xFFFF : itr, IE_ITR);
+}
+
+void eth_irq_enable(ethdev_t* eth, unsigned irqs, bool enable) {
+    writel(irqs, enable ? IE_IMS : IE_IMC);
+}
+
+uint32_t eth_rx_missed(ethdev_t* eth) {
+    return readl(IE_MPC);
+}
+
 status_t eth_reset_hw(ethdev_t* eth) {
     // TODO: don't rely on bootloader having initialized the
     // controller in order to obtain the mac address
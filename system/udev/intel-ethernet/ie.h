@@ -64,7 +64,19 @@ void eth_dump_regs(ethdev_t* eth);
 status_t eth_rx(ethdev_t* eth, void** data, size_t* len);
 void eth_rx_ack(ethdev_t* eth);
 
+// look at the index'th received buffer past the read pointer, and
+// give the first count buffers back to the hardware
+status_t eth_rx_peek(ethdev_t* eth, uint32_t index, void** data, size_t* len);
+void eth_rx_ack_n(ethdev_t* eth, uint32_t count);
+
 status_t eth_tx(ethdev_t* eth, const void* data, size_t len);
 
+// minimum interval between interrupts, 0 for none
+void eth_set_irq_interval(ethdev_t* eth, uint32_t usec);
+void eth_irq_enable(ethdev_t* eth, unsigned irqs, bool enable);
+
+// packets dropped by hw for lack of rx descriptors since the last call
+uint32_t eth_rx_missed(ethdev_t* eth);
+
 #define ETH_IRQ_RX IE_INT_RXT0
 unsigned eth_handle_irq(ethdev_t* eth);
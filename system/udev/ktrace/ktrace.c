@@ -17,17 +17,180 @@
 #include <string.h>
 #include <threads.h>
 
+// The kernel keeps a ring per cpu (see ktrace_buffer_header_t). Readers of
+// the device get the classic single stream instead: the metadata records,
+// then the names, then every cpu's events merged by timestamp. Each open of
+// the device reads its own snapshot: a read at offset 0 takes a new one, and
+// reading to the end releases it.
+static ktrace_buffer_header_t* ktrace_buffer;
+
+#define from_mx_device(d) containerof(d, ktrace_instance_t, dev)
+
+mx_driver_t _driver_ktrace;
+
+typedef struct ktrace_instance {
+    mx_device_t dev;
+
+    mtx_t lock;
+    uint8_t* snapshot;
+    size_t snapshot_len;
+} ktrace_instance_t;
+
+typedef struct {
+    uint8_t* data;
+    size_t len;
+    size_t pos;
+} cpu_events_t;
+
+// Copies the records still in one cpu's ring. The kernel moves tail before
+// it overwrites anything, so whatever lies below tail once the copy is done
+// may have changed under us and is discarded.
+static mx_status_t copy_cpu_events(uint32_t cpu, cpu_events_t* ev) {
+    ktrace_cpu_header_t* ch = &ktrace_buffer->cpu[cpu];
+    uint32_t size = ktrace_buffer->cpu_bufsize;
+    const uint8_t* ring = (uint8_t*)ktrace_buffer + ktrace_buffer->buffer_offset + cpu * size;
+
+    uint64_t head = __atomic_load_n(&ch->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = __atomic_load_n(&ch->tail, __ATOMIC_ACQUIRE);
+    ev->len = head - tail;
+    ev->pos = 0;
+    if ((ev->data = malloc(ev->len ? ev->len : 1)) == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    size_t off = tail % size;
+    size_t first = (ev->len < size - off) ? ev->len : size - off;
+    memcpy(ev->data, ring + off, first);
+    memcpy(ev->data + first, ring, ev->len - first);
+
+    uint64_t new_tail = __atomic_load_n(&ch->tail, __ATOMIC_ACQUIRE);
+    if (new_tail > tail) {
+        ev->pos = (new_tail < head) ? new_tail - tail : ev->len;
+    }
+    return NO_ERROR;
+}
+
+static ktrace_header_t* next_event(cpu_events_t* ev) {
+    while (ev->len - ev->pos >= sizeof(ktrace_header_t)) {
+        ktrace_header_t* hdr = (ktrace_header_t*)(ev->data + ev->pos);
+        size_t len = KTRACE_LEN(hdr->tag);
+        if ((len == 0) || (len > ev->len - ev->pos)) {
+            break;
+        }
+        if (KTRACE_GROUP(hdr->tag)) {
+            return hdr;
+        }
+        // padding at the end of the ring
+        ev->pos += len;
+    }
+    ev->pos = ev->len;
+    return NULL;
+}
+
+static mx_status_t take_snapshot(ktrace_instance_t* inst) {
+    free(inst->snapshot);
+    inst->snapshot = NULL;
+    inst->snapshot_len = 0;
+    if (ktrace_buffer == NULL) {
+        return NO_ERROR;
+    }
+
+    uint32_t cpus = ktrace_buffer->cpu_count;
+    cpu_events_t* ev = calloc(cpus, sizeof(cpu_events_t));
+    if (ev == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    mx_status_t status = NO_ERROR;
+    size_t names = __atomic_load_n(&ktrace_buffer->names_used, __ATOMIC_ACQUIRE);
+    if (names > ktrace_buffer->names_size) {
+        names = ktrace_buffer->names_size;
+    }
+    size_t total = 2 * sizeof(ktrace_rec_32b_t) + names;
+    for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+        if ((status = copy_cpu_events(cpu, &ev[cpu])) < 0) {
+            goto done;
+        }
+        total += ev[cpu].len;
+    }
+    uint8_t* snapshot;
+    if ((snapshot = malloc(total)) == NULL) {
+        status = ERR_NO_MEMORY;
+        goto done;
+    }
+    inst->snapshot = snapshot;
+
+    ktrace_rec_32b_t* rec = (ktrace_rec_32b_t*)snapshot;
+    memset(rec, 0, 2 * sizeof(*rec));
+    rec[0].tag = TAG_VERSION;
+    rec[0].a = ktrace_buffer->version;
+    rec[1].tag = TAG_TICKS_PER_MS;
+    rec[1].a = (uint32_t)ktrace_buffer->ticks_per_ms;
+    rec[1].b = (uint32_t)(ktrace_buffer->ticks_per_ms >> 32);
+    size_t len = 2 * sizeof(*rec);
+    memcpy(snapshot + len, (uint8_t*)ktrace_buffer + ktrace_buffer->names_offset, names);
+    len += names;
+
+    // merge the cpus' events, each of which is already in timestamp order
+    for (;;) {
+        cpu_events_t* next = NULL;
+        ktrace_header_t* first = NULL;
+        for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+            ktrace_header_t* hdr = next_event(&ev[cpu]);
+            if (hdr && ((first == NULL) || (hdr->ts < first->ts))) {
+                first = hdr;
+                next = &ev[cpu];
+            }
+        }
+        if (first == NULL) {
+            break;
+        }
+        size_t n = KTRACE_LEN(first->tag);
+        memcpy(snapshot + len, first, n);
+        len += n;
+        next->pos += n;
+    }
+    inst->snapshot_len = len;
+
+done:
+    for (uint32_t cpu = 0; cpu < cpus; cpu++) {
+        free(ev[cpu].data);
+    }
+    free(ev);
+    return status;
+}
+
 static ssize_t ktrace_read(mx_device_t* dev, void* buf, size_t count, mx_off_t off) {
-    uint32_t actual;
-    mx_status_t status = mx_ktrace_read(get_root_resource(),
-                                        buf, off, count, &actual);
-    return status != NO_ERROR ? (ssize_t)status : (ssize_t)actual;
+    ktrace_instance_t* inst = from_mx_device(dev);
+    mtx_lock(&inst->lock);
+    ssize_t r;
+    if ((off == 0) || (inst->snapshot == NULL)) {
+        if ((r = take_snapshot(inst)) < 0) {
+            goto done;
+        }
+    }
+    if (off >= inst->snapshot_len) {
+        // the reader is done with it
+        free(inst->snapshot);
+        inst->snapshot = NULL;
+        r = 0;
+        goto done;
+    }
+    if (count > inst->snapshot_len - off) {
+        count = inst->snapshot_len - off;
+    }
+    memcpy(buf, inst->snapshot + off, count);
+    r = count;
+done:
+    mtx_unlock(&inst->lock);
+    return r;
 }
 
 static mx_off_t ktrace_get_size(mx_device_t* dev) {
-    uint32_t size;
-    mx_status_t status = mx_ktrace_read(get_root_resource(), NULL, 0, 0, &size);
-    return status != NO_ERROR ? (mx_off_t)status : (mx_off_t)size;
+    ktrace_instance_t* inst = from_mx_device(dev);
+    mtx_lock(&inst->lock);
+    mx_status_t status = take_snapshot(inst);
+    mx_off_t size = (status < 0) ? 0 : inst->snapshot_len;
+    mtx_unlock(&inst->lock);
+    return size;
 }
 
 static ssize_t ktrace_ioctl(mx_device_t* dev, uint32_t op,
@@ -47,6 +210,18 @@ static ssize_t ktrace_ioctl(mx_device_t* dev, uint32_t op,
         *((mx_handle_t*) reply) = h;
         return sizeof(mx_handle_t);
     }
+    case IOCTL_KTRACE_GET_BUFFER: {
+        if (max < sizeof(mx_handle_t)) {
+            return ERR_BUFFER_TOO_SMALL;
+        }
+        mx_handle_t h;
+        mx_status_t status = mx_ktrace_control(get_root_resource(), KTRACE_ACTION_GET_BUFFER, 0, &h);
+        if (status < 0) {
+            return status;
+        }
+        *((mx_handle_t*) reply) = h;
+        return sizeof(mx_handle_t);
+    }
     case IOCTL_KTRACE_ADD_PROBE: {
         char name[MX_MAX_NAME_LEN];
         if ((cmdlen >= MX_MAX_NAME_LEN) || (cmdlen < 1) || (max != sizeof(uint32_t))) {
@@ -66,13 +241,63 @@ static ssize_t ktrace_ioctl(mx_device_t* dev, uint32_t op,
     }
 }
 
-static mx_protocol_device_t ktrace_device_proto = {
+static mx_status_t ktrace_release(mx_device_t* dev) {
+    ktrace_instance_t* inst = from_mx_device(dev);
+    free(inst->snapshot);
+    free(inst);
+    return NO_ERROR;
+}
+
+static mx_protocol_device_t ktrace_instance_proto = {
     .read = ktrace_read,
     .ioctl = ktrace_ioctl,
     .get_size = ktrace_get_size,
+    .release = ktrace_release,
+};
+
+static mx_status_t ktrace_open(mx_device_t* dev, mx_device_t** dev_out, uint32_t flags) {
+    ktrace_instance_t* inst = calloc(1, sizeof(ktrace_instance_t));
+    if (inst == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    mtx_init(&inst->lock, mtx_plain);
+
+    device_init(&inst->dev, &_driver_ktrace, "ktrace-inst", &ktrace_instance_proto);
+    mx_status_t status = device_add_instance(&inst->dev, dev);
+    if (status != NO_ERROR) {
+        free(inst);
+        return status;
+    }
+    *dev_out = &inst->dev;
+    return NO_ERROR;
+}
+
+static mx_protocol_device_t ktrace_device_proto = {
+    .open = ktrace_open,
 };
 
+// Maps the trace buffer, if tracing is enabled.
+static void ktrace_map_buffer(void) {
+    mx_handle_t vmo;
+    if (mx_ktrace_control(get_root_resource(), KTRACE_ACTION_GET_BUFFER, 0, &vmo) < 0) {
+        return;
+    }
+    uint64_t size;
+    uintptr_t addr;
+    if ((mx_vmo_get_size(vmo, &size) == NO_ERROR) &&
+        (mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size, MX_VM_FLAG_PERM_READ, &addr) == NO_ERROR)) {
+        if (((ktrace_buffer_header_t*)addr)->magic == KTRACE_BUFFER_MAGIC) {
+            ktrace_buffer = (ktrace_buffer_header_t*)addr;
+        } else {
+            mx_vmar_unmap(mx_vmar_root_self(), addr, size);
+        }
+    }
+    mx_handle_close(vmo);
+}
+
 mx_status_t ktrace_init(mx_driver_t* driver) {
+    ktrace_map_buffer();
+
     mx_device_t* dev;
     if (device_create(&dev, driver, "ktrace", &ktrace_device_proto) == NO_ERROR) {
         mx_status_t status;
@@ -11,6 +11,7 @@
 
 #include <assert.h>
 #include <hexdump/hexdump.h>
+#include <inttypes.h>
 #include <magenta/listnode.h>
 #include <magenta/syscalls.h>
 #include <magenta/types.h>
@@ -75,6 +76,7 @@ typedef struct ahci_port {
 
     uint32_t running; // bitmask of running commands
     iotxn_t* commands[AHCI_MAX_COMMANDS]; // commands in flight
+    io_buffer_t bounce[AHCI_MAX_COMMANDS]; // for buffers the PRDs can't describe
 
     list_node_t txn_list;
     io_buffer_t buffer;
@@ -217,6 +219,20 @@ static bool cmd_is_queued(uint8_t cmd) {
     return (cmd == SATA_CMD_READ_FPDMA_QUEUED) || (cmd == SATA_CMD_WRITE_FPDMA_QUEUED);
 }
 
+// copies a read back out of the slot's bounce buffer, if it used one, and
+// frees the buffer
+static void ahci_port_release_bounce(ahci_port_t* port, int slot, iotxn_t* txn,
+                                     mx_status_t status) {
+    io_buffer_t* bounce = &port->bounce[slot];
+    if (!io_buffer_is_valid(bounce)) {
+        return;
+    }
+    if ((status == NO_ERROR) && cmd_is_read(sata_iotxn_pdata(txn)->cmd)) {
+        txn->ops->copyto(txn, io_buffer_virt(bounce), txn->length, 0);
+    }
+    io_buffer_release(bounce);
+}
+
 static void ahci_port_complete_txn(ahci_device_t* dev, ahci_port_t* port, mx_status_t status) {
     iotxn_t* txn;
     uint32_t sact = ahci_read(&port->regs->sact);
@@ -237,6 +253,7 @@ static void ahci_port_complete_txn(ahci_device_t* dev, ahci_port_t* port, mx_sta
             }
             mtx_unlock(&port->lock);
 
+            ahci_port_release_bounce(port, i, txn, status);
             txn->ops->complete(txn, status, txn->length);
         }
     }
@@ -261,8 +278,47 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
         return NO_ERROR;
     }
 
-    mx_paddr_t phys;
-    txn->ops->physmap(txn, &phys);
+    // map the buffer as it lies; each physically contiguous run becomes one
+    // or more PRDs
+    iotxn_sg_t sg[AHCI_MAX_PRDS];
+    size_t sg_count;
+    mx_status_t status = txn->ops->physmap_sg(txn, 0, txn->length, sg, countof(sg), &sg_count);
+    size_t prd_count = 0;
+    for (size_t i = 0; (status == NO_ERROR) && (i < sg_count); i++) {
+        // the hardware requires word aligned addresses and byte counts
+        if ((sg[i].paddr & 1) || (sg[i].length & 1)) {
+            status = ERR_INVALID_ARGS;
+        }
+        prd_count += (sg[i].length + AHCI_PRD_MAX_SIZE - 1) / AHCI_PRD_MAX_SIZE;
+    }
+    if ((status == NO_ERROR) && (prd_count > AHCI_MAX_PRDS)) {
+        status = ERR_BUFFER_TOO_SMALL;
+    }
+    if ((status == ERR_BUFFER_TOO_SMALL) || (status == ERR_INVALID_ARGS)) {
+        // too fragmented or misaligned for the PRDs: go through a contiguous
+        // buffer instead
+        io_buffer_t* bounce = &port->bounce[slot];
+        status = io_buffer_init(bounce, txn->length, IO_BUFFER_RW);
+        if (status == NO_ERROR) {
+            if (cmd_is_write(pdata->cmd)) {
+                txn->ops->copyfrom(txn, io_buffer_virt(bounce), txn->length, 0);
+            }
+            sg[0].paddr = io_buffer_phys(bounce);
+            sg[0].length = txn->length;
+            sg_count = 1;
+            prd_count = (txn->length + AHCI_PRD_MAX_SIZE - 1) / AHCI_PRD_MAX_SIZE;
+        }
+    }
+    if (status != NO_ERROR) {
+        xprintf("ahci.%d: cannot map txn %p length 0x%" PRIx64 ": %d\n", port->nr, txn,
+                txn->length, status);
+        if ((port->flags & AHCI_PORT_FLAG_SYNC_PAUSED) && !port->running) {
+            port->flags &= ~AHCI_PORT_FLAG_SYNC_PAUSED;
+        }
+        txn->ops->complete(txn, status, 0);
+        completion_signal(&dev->worker_completion);
+        return status;
+    }
 
     if (dev->cap & AHCI_CAP_NCQ) {
         if (pdata->cmd == SATA_CMD_READ_DMA_EXT) {
@@ -272,7 +328,7 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
         }
     }
 
-    //xprintf("ahci.%d: do_txn slot=%d cmd=0x%x device=0x%x lba=0x%lx count=%u phys=0x%lx data_sz=0x%lx offset=0x%lx\n", port->nr, slot, pdata->cmd, pdata->device, pdata->lba, pdata->count, phys, txn->length, txn->offset);
+    //xprintf("ahci.%d: do_txn slot=%d cmd=0x%x device=0x%x lba=0x%lx count=%u prds=%zu data_sz=0x%lx offset=0x%lx\n", port->nr, slot, pdata->cmd, pdata->device, pdata->lba, pdata->count, prd_count, txn->length, txn->offset);
 
     // build the command
     ahci_cl_t* cl = port->cl + slot;
@@ -280,7 +336,7 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
     cl->prdtl_flags_cfl = 0;
     cl->cfl = 5; // 20 bytes
     cl->w = cmd_is_write(pdata->cmd) ? 1 : 0;
-    cl->prdtl = txn->length / AHCI_PRD_MAX_SIZE + 1;
+    cl->prdtl = prd_count;
     cl->prdbc = 0;
     memset(port->ct[slot], 0, sizeof(ahci_ct_t));
 
@@ -314,14 +370,20 @@ static mx_status_t ahci_do_txn(ahci_device_t* dev, ahci_port_t* port, int slot,
         cfis[13] = 0; // normal priority
     }
 
-    ahci_prd_t* prd = NULL;
-    for (int i = 0; i < cl->prdtl; i++) {
-        prd = (ahci_prd_t*)((void*)port->ct[slot] + sizeof(ahci_ct_t)) + i;
-        prd->dba = LO32(phys);
-        prd->dbau = HI32(phys);
-        prd->dbc = ((txn->length - 1) & 0x3fffff); // 0-based byte count
+    ahci_prd_t* prd = (ahci_prd_t*)((void*)port->ct[slot] + sizeof(ahci_ct_t));
+    for (size_t i = 0; i < sg_count; i++) {
+        mx_paddr_t phys = sg[i].paddr;
+        size_t remaining = sg[i].length;
+        while (remaining > 0) {
+            size_t length = MIN(remaining, AHCI_PRD_MAX_SIZE);
+            prd->dba = LO32(phys);
+            prd->dbau = HI32(phys);
+            prd->dbc = ((length - 1) & (AHCI_PRD_MAX_SIZE - 1)); // 0-based byte count
+            prd++;
 
-        phys += AHCI_PRD_MAX_SIZE;
+            phys += length;
+            remaining -= length;
+        }
     }
 
     port->running |= (1 << slot);
@@ -533,10 +595,11 @@ static int ahci_watchdog_thread(void* arg) {
                     if (pdata->timeout < now) {
                         // time out
                         printf("ahci: txn time out on port %d\n", port->nr);
-                        iotxn_t* txn = port->commands[i];
-                        port->running &= ~(1 << i);
-                        port->commands[i] = NULL;
+                        iotxn_t* txn = port->commands[j];
+                        port->running &= ~(1 << j);
+                        port->commands[j] = NULL;
                         mtx_unlock(&port->lock);
+                        ahci_port_release_bounce(port, j, txn, ERR_TIMED_OUT);
                         txn->ops->complete(txn, ERR_TIMED_OUT, 0);
                         mtx_lock(&port->lock);
                     }
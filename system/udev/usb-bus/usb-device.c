@@ -162,6 +162,19 @@ static ssize_t usb_device_ioctl(mx_device_t* device, uint32_t op,
         int* args = (int *)in_buf;
         return usb_device_set_interface(dev, args[0], args[1]);
     }
+    case IOCTL_USB_ENABLE_STREAMS: {
+        if (in_len != 2 * sizeof(int)) return ERR_INVALID_ARGS;
+        int* args = (int *)in_buf;
+        if (args[1] < 0) return ERR_INVALID_ARGS;
+        if (!dev->hci_protocol->enable_streams) return ERR_NOT_SUPPORTED;
+        return dev->hci_protocol->enable_streams(dev->hci_device, dev->device_id, args[0], args[1]);
+    }
+    case IOCTL_USB_RESET_ENDPOINT: {
+        if (in_len != sizeof(int)) return ERR_INVALID_ARGS;
+        int ep_address = *((int *)in_buf);
+        if (!dev->hci_protocol->reset_endpoint) return ERR_NOT_SUPPORTED;
+        return dev->hci_protocol->reset_endpoint(dev->hci_device, dev->device_id, ep_address);
+    }
     case IOCTL_USB_GET_CURRENT_FRAME: {
         uint64_t* reply = out_buf;
         if (out_len < sizeof(*reply)) return ERR_BUFFER_TOO_SMALL;
@@ -40,6 +40,7 @@
 #define RX_HEADER_SIZE 4
 #define AX88179_MTU 1500
 #define MAX_ETH_HDRS 26
+#define AX88179_RX_BATCH 32
 
 typedef struct {
     mx_device_t* device;
@@ -218,10 +219,16 @@ static mx_status_t ax88179_recv(ax88179_t* eth, iotxn_t* request) {
     size_t offset = 0;
     size_t packet = 0;
 
+    // frames in this transfer, handed up together
+    ethmac_rx_frame_t frames[AX88179_RX_BATCH];
+    size_t count = 0;
+    mx_status_t status = NO_ERROR;
+
     while (offset < request->actual) {
         if (request->actual < 4) {
             printf("ax88179_recv short packet\n");
-            return ERR_INTERNAL;
+            status = ERR_INTERNAL;
+            break;
         }
 
         uint8_t* read_data = NULL;
@@ -232,7 +239,8 @@ static mx_status_t ax88179_recv(ax88179_t* eth, iotxn_t* request) {
         xprintf("rxhdr offset %u, num %u\n", rxhdr->pkt_hdr_off, rxhdr->num_pkts);
         if (rxhdr->num_pkts < 1 || rxhdr->pkt_hdr_off >= rxhdr_off) {
             printf("%s bad packet\n", __func__);
-            return ERR_IO_DATA_INTEGRITY;
+            status = ERR_IO_DATA_INTEGRITY;
+            break;
         }
 
         xprintf("next packet: %zd\n", packet);
@@ -241,7 +249,8 @@ static mx_status_t ax88179_recv(ax88179_t* eth, iotxn_t* request) {
         if ((uintptr_t)pkt_hdr >= (uintptr_t)(read_data + request->actual)) {
             printf("%s packet header out of bounds %p > %p\n", __func__, pkt_hdr,
                     read_data + request->actual);
-            return ERR_IO_DATA_INTEGRITY;
+            status = ERR_IO_DATA_INTEGRITY;
+            break;
         }
         uint16_t pkt_len = le16toh((*pkt_hdr & AX88179_RX_PKTLEN) >> 16);
         xprintf("pkt_hdr: %0#x pkt_len: %u\n", *pkt_hdr, pkt_len);
@@ -264,7 +273,14 @@ static mx_status_t ax88179_recv(ax88179_t* eth, iotxn_t* request) {
         }
         if (!drop) {
             xprintf("offset = %zd\n", offset);
-            eth->ifc->recv(eth->cookie, read_data + offset + 2, pkt_len - 2, 0);
+            if (count == AX88179_RX_BATCH) {
+                eth->ifc->recv_batch(eth->cookie, frames, count);
+                count = 0;
+            }
+            frames[count].data = read_data + offset + 2;
+            frames[count].length = pkt_len - 2;
+            frames[count].flags = 0;
+            count++;
         }
 
         // Advance past this packet in the completed read
@@ -272,7 +288,10 @@ static mx_status_t ax88179_recv(ax88179_t* eth, iotxn_t* request) {
         offset = ALIGN(offset, 8);
     }
 
-    return NO_ERROR;
+    if (count > 0) {
+        eth->ifc->recv_batch(eth->cookie, frames, count);
+    }
+    return status;
 }
 
 static void ax88179_read_complete(iotxn_t* request, void* cookie) {
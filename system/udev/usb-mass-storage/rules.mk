@@ -8,7 +8,9 @@ MODULE := $(LOCAL_DIR)
 
 MODULE_TYPE := driver
 
-MODULE_SRCS := $(LOCAL_DIR)/usb-mass-storage.c
+MODULE_SRCS := \
+    $(LOCAL_DIR)/usb-mass-storage.c \
+    $(LOCAL_DIR)/ums-uas.c \
 
 MODULE_STATIC_LIBS := ulib/ddk
 
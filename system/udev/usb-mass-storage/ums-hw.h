@@ -24,9 +24,23 @@
 #define UMS_READ16                   0x88
 #define UMS_WRITE16                  0x8A
 #define UMS_READ_CAPACITY16          0x9E
-#define UMS_READ12                   0x8A
+#define UMS_READ12                   0xA8
 #define UMS_WRITE12                  0xAA
 
+// INQUIRY command bits and vital product data pages
+#define UMS_INQUIRY_EVPD             0x01
+#define UMS_VPD_SUPPORTED_PAGES      0x00
+#define UMS_VPD_BLOCK_LIMITS         0xB0
+
+// SCSI status codes
+#define UMS_STATUS_GOOD              0x00
+#define UMS_STATUS_CHECK_CONDITION   0x02
+
+// interface subclass and protocols
+#define USB_SUBCLASS_MSC_SCSI        0x06
+#define USB_PROTOCOL_MSC_BOT         0x50
+#define USB_PROTOCOL_MSC_UAS         0x62
+
 // control request values
 #define USB_REQ_RESET               0xFF
 #define USB_REQ_GET_MAX_LUN         0xFE
@@ -39,6 +53,9 @@
 typedef enum {CSW_SUCCESS, CSW_FAILED, CSW_PHASE_ERROR, CSW_INVALID,
                 CSW_TAG_MISMATCH} csw_status_t;
 
+// CBW flags
+#define CBW_FLAGS_DATA_IN           0x80
+
 // signatures in header and status
 #define CBW_SIGNATURE               0x43425355
 #define CSW_SIGNATURE               0x53425355
@@ -60,6 +77,7 @@ typedef enum {CSW_SUCCESS, CSW_FAILED, CSW_PHASE_ERROR, CSW_INVALID,
 #define UMS_WRITE12_COMMAND_LENGTH                 12
 #define UMS_WRITE16_COMMAND_LENGTH                 16
 #define UMS_TOGGLE_REMOVABLE_COMMAND_LENGTH        12
+#define UMS_MAX_COMMAND_LENGTH                     16
 
 // transfer lengths
 #define UMS_NO_TRANSFER_LENGTH                     0
@@ -67,4 +85,45 @@ typedef enum {CSW_SUCCESS, CSW_FAILED, CSW_PHASE_ERROR, CSW_INVALID,
 #define UMS_REQUEST_SENSE_TRANSFER_LENGTH          0x12
 #define UMS_READ_FORMAT_CAPACITIES_TRANSFER_LENGTH 0xFC
 #define UMS_READ_CAPACITY10_TRANSFER_LENGTH        0x08
-#define UMS_READ_CAPACITY16_TRANSFER_LENGTH        0x20
\ No newline at end of file
+#define UMS_READ_CAPACITY16_TRANSFER_LENGTH        0x20
+#define UMS_VPD_TRANSFER_LENGTH                    0x40
+
+// offsets into the Block Limits VPD page
+#define UMS_VPD_MAX_TRANSFER_LENGTH                8
+
+// USB Attached SCSI (UAS)
+
+// class specific descriptor naming the role of each endpoint
+#define UAS_DT_PIPE_USAGE                          0x24
+
+typedef struct {
+    uint8_t bLength;
+    uint8_t bDescriptorType;    // UAS_DT_PIPE_USAGE
+    uint8_t bPipeID;
+    uint8_t reserved;
+} __attribute__ ((packed)) uas_pipe_usage_descriptor_t;
+
+// bPipeID values
+#define UAS_PIPE_COMMAND                           1
+#define UAS_PIPE_STATUS                            2
+#define UAS_PIPE_DATA_IN                           3
+#define UAS_PIPE_DATA_OUT                          4
+
+// information unit IDs
+#define UAS_IU_COMMAND                             0x01
+#define UAS_IU_SENSE                               0x03
+#define UAS_IU_RESPONSE                            0x04
+#define UAS_IU_READ_READY                          0x06
+#define UAS_IU_WRITE_READY                         0x07
+
+#define UAS_COMMAND_IU_LENGTH                      32
+// a sense IU is 16 bytes plus up to 96 of sense data
+#define UAS_STATUS_IU_LENGTH                       112
+
+// offsets into information units
+#define UAS_IU_ID                                  0
+#define UAS_IU_TAG                                 2
+#define UAS_COMMAND_IU_LUN                         8
+#define UAS_COMMAND_IU_CDB                         16
+#define UAS_SENSE_IU_STATUS                        6
+
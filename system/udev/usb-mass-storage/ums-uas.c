@@ -0,0 +1,202 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// USB Attached SCSI over SuperSpeed streams. Each command slot owns one stream,
+// and its tag is the stream ID, so the device can run commands in any order and
+// the host controller matches status and data to the right command for us.
+
+#include <ddk/common/usb.h>
+#include <magenta/hw/usb.h>
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ums.h"
+
+static bool ums_uas_complete(ums_uas_t* uas) {
+    return uas->command_addr && uas->status_addr && uas->data_in_addr && uas->data_out_addr;
+}
+
+void ums_uas_probe(usb_desc_iter_t* iter, ums_uas_t* uas) {
+    ums_uas_t found;
+    bool in_uas = false;
+    uint8_t ep_address = 0;
+    uint32_t ep_streams = 0;
+
+    memset(uas, 0, sizeof(*uas));
+    memset(&found, 0, sizeof(found));
+    usb_desc_iter_reset(iter);
+
+    usb_descriptor_header_t* header;
+    while ((header = usb_desc_iter_next(iter)) != NULL) {
+        switch (header->bDescriptorType) {
+        case USB_DT_INTERFACE: {
+            if (in_uas && ums_uas_complete(&found)) {
+                goto done;
+            }
+            usb_interface_descriptor_t* intf = (usb_interface_descriptor_t*)header;
+            in_uas = (intf->bInterfaceClass == USB_CLASS_MSC &&
+                      intf->bInterfaceSubClass == USB_SUBCLASS_MSC_SCSI &&
+                      intf->bInterfaceProtocol == USB_PROTOCOL_MSC_UAS);
+            memset(&found, 0, sizeof(found));
+            found.alt_setting = intf->bAlternateSetting;
+            found.max_streams = UINT32_MAX;
+            ep_address = 0;
+            break;
+        }
+        case USB_DT_ENDPOINT: {
+            usb_endpoint_descriptor_t* endp = (usb_endpoint_descriptor_t*)header;
+            ep_address = (usb_ep_type(endp) == USB_ENDPOINT_BULK ? endp->bEndpointAddress : 0);
+            ep_streams = 0;
+            break;
+        }
+        case USB_DT_SS_EP_COMPANION: {
+            usb_ss_ep_comp_descriptor_t* comp = (usb_ss_ep_comp_descriptor_t*)header;
+            uint32_t max_streams = comp->bmAttributes & 0x1f;
+            ep_streams = (max_streams ? 1u << max_streams : 0);
+            break;
+        }
+        case UAS_DT_PIPE_USAGE: {
+            if (!in_uas || !ep_address) break;
+            uas_pipe_usage_descriptor_t* usage = (uas_pipe_usage_descriptor_t*)header;
+            switch (usage->bPipeID) {
+            case UAS_PIPE_COMMAND:
+                found.command_addr = ep_address;
+                break;
+            case UAS_PIPE_STATUS:
+                found.status_addr = ep_address;
+                break;
+            case UAS_PIPE_DATA_IN:
+                found.data_in_addr = ep_address;
+                break;
+            case UAS_PIPE_DATA_OUT:
+                found.data_out_addr = ep_address;
+                break;
+            default:
+                break;
+            }
+            // the companion descriptor comes before the pipe usage descriptor
+            if (usage->bPipeID >= UAS_PIPE_STATUS && usage->bPipeID <= UAS_PIPE_DATA_OUT &&
+                    ep_streams < found.max_streams) {
+                found.max_streams = ep_streams;
+            }
+            break;
+        }
+        }
+    }
+
+done:
+    if (in_uas && ums_uas_complete(&found)) {
+        *uas = found;
+        uas->present = true;
+    }
+}
+
+mx_status_t ums_uas_start(ums_t* msd) {
+    ums_uas_t* uas = &msd->uas;
+    if (uas->max_streams == 0) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    mx_status_t status = usb_set_interface(msd->udev, msd->interface_number, uas->alt_setting);
+    if (status < 0) {
+        return status;
+    }
+
+    // stream IDs run from 1 to count
+    int count = (uas->max_streams < UMS_UAS_DEPTH ? uas->max_streams : UMS_UAS_DEPTH);
+    const uint8_t pipes[] = { uas->status_addr, uas->data_in_addr, uas->data_out_addr };
+    for (unsigned i = 0; i < countof(pipes); i++) {
+        status = usb_enable_streams(msd->udev, pipes[i], count);
+        if (status < 1) {
+            goto fail;
+        }
+        if (count > status) {
+            count = status;
+        }
+    }
+    return count;
+
+fail:
+    // selecting the Bulk-Only alternate setting disables the UAS endpoints,
+    // freeing any streams we did get
+    usb_set_interface(msd->udev, msd->interface_number, msd->bot_alt_setting);
+    return (status < 0 ? status : ERR_NOT_SUPPORTED);
+}
+
+static void ums_uas_command_complete(iotxn_t* txn, void* cookie) {
+    ums_stage_complete(cookie, txn->status);
+}
+
+static void ums_uas_status_complete(iotxn_t* txn, void* cookie) {
+    ums_cmd_t* cmd = cookie;
+    mx_status_t status = txn->status;
+    if (status == NO_ERROR) {
+        uint8_t iu[16];
+        if (txn->actual < sizeof(iu)) {
+            status = ERR_INTERNAL;
+        } else {
+            txn->ops->copyfrom(txn, iu, sizeof(iu), 0);
+            uint16_t tag = (iu[UAS_IU_TAG] << 8) | iu[UAS_IU_TAG + 1];
+            if (tag != cmd->tag) {
+                status = ERR_INTERNAL;
+            } else if (iu[UAS_IU_ID] == UAS_IU_SENSE) {
+                // CHECK CONDITION or anything else: the command ran and failed
+                status = (iu[UAS_SENSE_IU_STATUS] == UMS_STATUS_GOOD ? NO_ERROR : ERR_IO);
+            } else {
+                // a response IU means the device didn't accept the command IU
+                printf("ums: UAS IU 0x%02x for tag %u\n", iu[UAS_IU_ID], tag);
+                status = ERR_INTERNAL;
+            }
+        }
+    }
+    ums_stage_complete(cmd, status);
+}
+
+mx_status_t ums_uas_init_cmd(ums_t* msd, ums_cmd_t* cmd, uint32_t tag) {
+    ums_uas_t* uas = &msd->uas;
+    cmd->tag = tag;
+    cmd->command_req = usb_alloc_iotxn(uas->command_addr, UAS_COMMAND_IU_LENGTH, 0);
+    cmd->status_req = usb_alloc_iotxn(uas->status_addr, UAS_STATUS_IU_LENGTH, 0);
+    if (!cmd->command_req || !cmd->status_req) {
+        return ERR_NO_MEMORY;
+    }
+    cmd->command_req->length = UAS_COMMAND_IU_LENGTH;
+    cmd->command_req->complete_cb = ums_uas_command_complete;
+    cmd->command_req->cookie = cmd;
+    cmd->status_req->length = UAS_STATUS_IU_LENGTH;
+    usb_iotxn_set_stream(cmd->status_req, tag);
+    cmd->status_req->complete_cb = ums_uas_status_complete;
+    cmd->status_req->cookie = cmd;
+    return NO_ERROR;
+}
+
+void ums_uas_queue(ums_t* msd, ums_cmd_t* cmd) {
+    uint8_t iu[UAS_COMMAND_IU_LENGTH];
+    memset(iu, 0, sizeof(iu));
+    iu[UAS_IU_ID] = UAS_IU_COMMAND;
+    iu[UAS_IU_TAG] = cmd->tag >> 8;
+    iu[UAS_IU_TAG + 1] = cmd->tag & 0xff;
+    // SIMPLE task attribute, no additional CDB bytes. single level LUN addressing
+    iu[UAS_COMMAND_IU_LUN + 1] = msd->lun;
+    memcpy(iu + UAS_COMMAND_IU_CDB, cmd->cdb, cmd->cdb_length);
+    cmd->command_req->ops->copyto(cmd->command_req, iu, sizeof(iu), 0);
+
+    // status and data wait on the command's stream before the command goes out,
+    // so the device finds them there whenever it gets to it
+    cmd->stages = (cmd->data ? 3 : 2);
+    iotxn_queue(msd->udev, cmd->status_req);
+    if (cmd->data) {
+        iotxn_queue(msd->udev, cmd->data);
+    }
+    iotxn_queue(msd->udev, cmd->command_req);
+}
+
+void ums_uas_cancel(ums_t* msd) {
+    ums_uas_t* uas = &msd->uas;
+    usb_reset_endpoint(msd->udev, uas->command_addr);
+    usb_reset_endpoint(msd->udev, uas->status_addr);
+    usb_reset_endpoint(msd->udev, uas->data_in_addr);
+    usb_reset_endpoint(msd->udev, uas->data_out_addr);
+}
@@ -0,0 +1,136 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <ddk/common/usb.h>
+#include <ddk/completion.h>
+#include <ddk/device.h>
+#include <ddk/driver.h>
+#include <ddk/iotxn.h>
+#include <magenta/listnode.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <threads.h>
+
+#include "ums-hw.h"
+
+// Bulk-Only devices execute one command at a time. We keep a second one queued
+// so that its CBW and data transfers are already on the rings when the first completes.
+#define UMS_BOT_DEPTH 2
+// UAS devices queue commands themselves, one per stream
+#define UMS_UAS_DEPTH 32
+#define UMS_MAX_DEPTH UMS_UAS_DEPTH
+
+// largest READ or WRITE we issue, unless the device asks for less. Client iotxns
+// are transferred in place, so this also bounds how many pages the host controller
+// has to gather from.
+#define UMS_MAX_TRANSFER (512 * 1024)
+
+typedef struct ums ums_t;
+
+// a SCSI command and the USB transfers that carry it
+typedef struct {
+    ums_t* msd;
+    // for ums_t.free_cmds and ums_t.retry_cmds
+    list_node_t node;
+
+    uint8_t cdb[UMS_MAX_COMMAND_LENGTH];
+    uint8_t cdb_length;
+    uint8_t direction;      // USB_DIR_IN or USB_DIR_OUT
+    uint32_t length;        // bytes in the data stage
+
+    // the iotxn this command carries all or part of, and where in it the data stage starts
+    iotxn_t* txn;
+    mx_off_t offset;
+    // data stage: a clone of txn, or a bounce buffer when txn is split. NULL if length is 0
+    iotxn_t* data;
+
+    // CBW and CSW, or command and sense IUs. allocated once, reused for every command
+    iotxn_t* command_req;
+    iotxn_t* status_req;
+
+    // BOT: tag of the last CBW sent. UAS: stream ID, fixed for the slot
+    uint32_t tag;
+
+    int stages;             // USB transfers still outstanding
+    mx_status_t status;     // first error seen by any stage
+    mx_off_t actual;        // bytes moved by the data stage
+    uint32_t residue;       // BOT: bytes the device says it did not process
+    bool internal;          // txn came from ums_exec() rather than a client
+    bool failed;            // this command's error started recovery
+} ums_cmd_t;
+
+// endpoints of the UAS alternate setting
+typedef struct {
+    bool present;
+    uint8_t alt_setting;
+    uint8_t command_addr;
+    uint8_t status_addr;
+    uint8_t data_in_addr;
+    uint8_t data_out_addr;
+    uint32_t max_streams;   // fewest streams supported by the status and data pipes
+} ums_uas_t;
+
+struct ums {
+    mx_device_t device;
+    mx_device_t* udev;
+    mx_driver_t* driver;
+
+    uint8_t interface_number;
+    uint8_t lun;
+    uint64_t total_blocks;
+    uint32_t block_size;
+    uint32_t max_transfer;  // bytes per READ or WRITE command
+
+    // Bulk-Only endpoints
+    uint8_t bot_alt_setting;
+    uint8_t bulk_in_addr;
+    uint8_t bulk_out_addr;
+    uint32_t tag_send;      // next tag to send in CBW
+
+    // set if we are talking to the device using UAS rather than Bulk-Only
+    bool use_uas;
+    ums_uas_t uas;
+
+    ums_cmd_t cmds[UMS_MAX_DEPTH];
+    int depth;              // number of cmds in use
+
+    list_node_t free_cmds;
+    // commands that were in flight when recovery began, to be sent again in order
+    list_node_t retry_cmds;
+    // iotxns from ums_exec(), which go ahead of client iotxns
+    list_node_t internal_txns;
+    // client iotxns, and how much of the one at the head already has commands
+    list_node_t queued_iotxns;
+    mx_off_t queued_offset;
+
+    int busy_cmds;          // commands with transfers outstanding
+    bool issuing;           // a thread is in ums_issue()
+    bool recovering;        // no new commands until recovery is done
+    bool dead;              // device is going away
+    completion_t drained;   // signalled when busy_cmds drops to zero during recovery
+
+    // for IOCTL_DEVICE_SYNC
+    int outstanding_iotxns;
+    completion_t idle;
+
+    mtx_t mutex;
+};
+#define get_ums(dev) containerof(dev, ums_t, device)
+
+// called by the transports as each USB transfer of cmd completes
+void ums_stage_complete(ums_cmd_t* cmd, mx_status_t status);
+void ums_data_complete(iotxn_t* txn, void* cookie);
+
+// UAS transport, in ums-uas.c
+
+// looks for a UAS alternate setting among the interface's descriptors
+void ums_uas_probe(usb_desc_iter_t* iter, ums_uas_t* uas);
+// switches to the UAS alternate setting and allocates streams.
+// returns how many commands may be queued at once
+mx_status_t ums_uas_start(ums_t* msd);
+mx_status_t ums_uas_init_cmd(ums_t* msd, ums_cmd_t* cmd, uint32_t tag);
+void ums_uas_queue(ums_t* msd, ums_cmd_t* cmd);
+void ums_uas_cancel(ums_t* msd);
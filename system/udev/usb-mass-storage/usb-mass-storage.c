@@ -19,11 +19,7 @@
 #include <threads.h>
 #include <unistd.h>
 
-#include "ums-hw.h"
-
-#define READ_REQ_COUNT 3
-#define WRITE_REQ_COUNT 3
-#define USB_BUF_SIZE 0x8000
+#include "ums.h"
 
 // comment the next line if you don't want debug messages
 #define DEBUG 0
@@ -33,54 +29,14 @@
 # define DEBUG_PRINT(x) do {} while (0)
 #endif
 
-// used to implement IOCTL_DEVICE_SYNC
-typedef struct {
-    // iotxn we are waiting to complete
-    iotxn_t* iotxn;
-    // completion for IOCTL_DEVICE_SYNC to wait on
-    completion_t completion;
-    // node for ums_t.sync_nodes list
-    list_node_t node;
-} ums_sync_node_t;
-
+// a command issued by the driver itself. the CDB travels in the iotxn's extra space
 typedef struct {
-    mx_device_t device;
-    mx_device_t* udev;
-    mx_driver_t* driver;
-
-    uint32_t tag_send;      // next tag to send in CBW
-    uint32_t tag_receive;   // next tag we expect to receive in CSW
-
-    uint8_t lun;
-    uint64_t total_blocks;
-    uint32_t block_size;
-
-    bool use_read_write_16; // use READ16 and WRITE16 if total_blocks > 0xFFFFFFFF
-
-    uint8_t bulk_in_addr;
-    uint8_t bulk_out_addr;
-
-    // pool of free USB requests
-    list_node_t free_csw_reqs;
-    list_node_t free_read_reqs;
-    list_node_t free_write_reqs;
-
-    // list of queued io transactions
-    list_node_t queued_iotxns;
-
-    // list of active ums_sync_node_t
-    list_node_t sync_nodes;
+    uint8_t cdb[UMS_MAX_COMMAND_LENGTH];
+    uint8_t cdb_length;
+    uint8_t direction;
+} ums_exec_t;
 
-    // list of received packets not yet read by upper layer
-    list_node_t completed_reads;
-    list_node_t completed_csws;
-
-    mtx_t mutex;
-} ums_t;
-#define get_ums(dev) containerof(dev, ums_t, device)
-
-static void ums_csw_complete(iotxn_t* csw_request, void* cookie);
-static csw_status_t ums_verify_csw(ums_t* msd, iotxn_t* csw_request);
+static void ums_issue(ums_t* msd);
 
 static inline uint16_t read16be(uint8_t* ptr) {
     return betoh16(*((uint16_t*)ptr));
@@ -106,20 +62,18 @@ static inline void write64be(uint8_t* ptr, uint64_t n) {
     *((uint64_t*)ptr) = htobe64(n);
 }
 
+// Bulk-Only reset recovery: after this the device expects a CBW on a clean pair of pipes
 static mx_status_t ums_reset(ums_t* msd) {
-    // for all these control requests, data is null, length is 0 because nothing is passed back
-    // value and index not used for first command, though index is supposed to be set to interface number
-    // TODO: check interface number, see if index needs to be set
     DEBUG_PRINT(("UMS: performing reset recovery\n"));
     mx_status_t status = usb_control(msd->udev, USB_DIR_OUT | USB_TYPE_CLASS
-                                            | USB_RECIP_INTERFACE, USB_REQ_RESET, 0x00, 0x00, NULL, 0);
-    status = usb_control(msd->udev, USB_DIR_OUT | USB_TYPE_CLASS
-                                           | USB_RECIP_INTERFACE, USB_REQ_CLEAR_FEATURE, FS_ENDPOINT_HALT,
-                                           msd->bulk_in_addr, NULL, 0);
-    status = usb_control(msd->udev, USB_DIR_OUT | USB_TYPE_CLASS
-                                           | USB_RECIP_INTERFACE, USB_REQ_CLEAR_FEATURE, FS_ENDPOINT_HALT,
-                                           msd->bulk_out_addr, NULL, 0);
-    return status;
+                                            | USB_RECIP_INTERFACE, USB_REQ_RESET, 0x00,
+                                            msd->interface_number, NULL, 0);
+    if (status < 0) return status;
+    status = usb_clear_feature(msd->udev, USB_RECIP_ENDPOINT, FS_ENDPOINT_HALT,
+                               msd->bulk_in_addr);
+    if (status < 0) return status;
+    return usb_clear_feature(msd->udev, USB_RECIP_ENDPOINT, FS_ENDPOINT_HALT,
+                             msd->bulk_out_addr);
 }
 
 static mx_status_t ums_get_max_lun(ums_t* msd, void* data) {
@@ -128,365 +82,499 @@ static mx_status_t ums_get_max_lun(ums_t* msd, void* data) {
     return status;
 }
 
-static iotxn_t* get_free_write(ums_t* msd) {
-    list_node_t* node = list_remove_head(&msd->free_write_reqs);
-    if (!node) {
-        return NULL;
-    }
-    return containerof(node, iotxn_t, node);
+// true if the command carries only part of its iotxn
+static inline bool ums_cmd_is_split(ums_cmd_t* cmd) {
+    return cmd->offset != 0 || cmd->length != cmd->txn->length;
 }
 
-static void ums_queue_request(ums_t* msd, iotxn_t* txn) {
-    iotxn_queue(msd->udev, txn);
-}
-
-static mx_status_t ums_send_cbw(ums_t* msd, uint32_t transfer_length, uint8_t flags,
-                                uint8_t command_len, void* command) {
-    iotxn_t* txn = get_free_write(msd);
-    if (!txn) {
-        return ERR_BUFFER_TOO_SMALL;
+static mx_status_t ums_verify_csw(ums_cmd_t* cmd, iotxn_t* csw_request) {
+    if (csw_request->actual != UMS_COMMAND_STATUS_WRAPPER_SIZE) {
+        DEBUG_PRINT(("UMS: CSW is %" PRIu64 " bytes\n", csw_request->actual));
+        return ERR_INTERNAL;
     }
-    // CBWs always have 31 bytes
-    txn->length = 31;
 
-    // first three blocks are 4 byte
-    uint32_t buf_32[3];
-    buf_32[0] = htole32(CBW_SIGNATURE);
-    buf_32[1] = htole32(msd->tag_send++);
-    buf_32[2] = htole32(transfer_length);
-    txn->ops->copyto(txn, buf_32, sizeof(buf_32), 0);
+    uint8_t csw[UMS_COMMAND_STATUS_WRAPPER_SIZE];
+    csw_request->ops->copyfrom(csw_request, csw, sizeof(csw), 0);
+    uint32_t* ptr_32 = (uint32_t*)csw;
 
-    // get a 3 x 1 byte buffer and start at 12 because of uint32's
-    uint8_t buf_8[3];
-    buf_8[0] = flags;
-    buf_8[1] = msd->lun;
-    buf_8[2] = command_len;
-    txn->ops->copyto(txn, buf_8, sizeof(buf_8), sizeof(buf_32));
+    if (letoh32(ptr_32[0]) != CSW_SIGNATURE) {
+        DEBUG_PRINT(("UMS: invalid CSW signature 0x%08x\n", letoh32(ptr_32[0])));
+        return ERR_INTERNAL;
+    }
+    if (letoh32(ptr_32[1]) != cmd->tag) {
+        DEBUG_PRINT(("UMS: CSW tag 0x%08x, expected 0x%08x\n", letoh32(ptr_32[1]), cmd->tag));
+        return ERR_INTERNAL;
+    }
+    // data residue field is the 3rd uint32_t in csw buffer
+    uint32_t residue = letoh32(ptr_32[2]);
+    if (residue > cmd->length) {
+        return ERR_INTERNAL;
+    }
+    cmd->residue = residue;
 
-    // copy command_len bytes from the command passed in into the command_len
-    txn->ops->copyto(txn, command, command_len, sizeof(buf_32) + sizeof(buf_8));
-    ums_queue_request(msd, txn);
-    return NO_ERROR;
+    switch (csw[12]) {
+    case CSW_SUCCESS:
+        return NO_ERROR;
+    case CSW_FAILED:
+        // the device ran the command and says it failed. the transport is fine
+        return ERR_IO;
+    default:
+        DEBUG_PRINT(("UMS: CSW status %d\n", csw[12]));
+        return ERR_INTERNAL;
+    }
 }
 
-static mx_status_t ums_queue_csw(ums_t* msd) {
-    list_node_t* csw_node = list_remove_head(&msd->free_csw_reqs);
-    if (!csw_node) {
-        DEBUG_PRINT(("UMS:error, no CSW reqs left\n"));
-        return ERR_BUFFER_TOO_SMALL;
+static void ums_cbw_complete(iotxn_t* txn, void* cookie) {
+    ums_stage_complete(cookie, txn->status);
+}
+
+static void ums_csw_complete(iotxn_t* txn, void* cookie) {
+    ums_cmd_t* cmd = cookie;
+    mx_status_t status = txn->status;
+    if (status == NO_ERROR) {
+        status = ums_verify_csw(cmd, txn);
     }
-    iotxn_t* csw_request = containerof(csw_node, iotxn_t, node);
-    csw_request->complete_cb = ums_csw_complete;
-    csw_request->cookie = msd;
-    ums_queue_request(msd, csw_request);
-    return NO_ERROR;
+    ums_stage_complete(cmd, status);
 }
 
-static void ums_read_csw_complete(iotxn_t* txn, void* cookie) {
-    completion_signal((completion_t *)cookie);
+void ums_data_complete(iotxn_t* txn, void* cookie) {
+    ums_cmd_t* cmd = cookie;
+    cmd->actual = txn->actual;
+    ums_stage_complete(cmd, txn->status);
 }
 
-static mx_status_t ums_read_csw(ums_t* msd) {
-    list_node_t* csw_node = list_remove_head(&msd->free_csw_reqs);
-    if (!csw_node) {
-        DEBUG_PRINT(("UMS:error, no CSW reqs left\n"));
-        return ERR_BUFFER_TOO_SMALL;
+static mx_status_t ums_alloc_bot_cmd(ums_t* msd, ums_cmd_t* cmd) {
+    cmd->command_req = usb_alloc_iotxn(msd->bulk_out_addr, UMS_COMMAND_BLOCK_WRAPPER_SIZE, 0);
+    cmd->status_req = usb_alloc_iotxn(msd->bulk_in_addr, UMS_COMMAND_STATUS_WRAPPER_SIZE, 0);
+    if (!cmd->command_req || !cmd->status_req) {
+        return ERR_NO_MEMORY;
     }
+    cmd->command_req->length = UMS_COMMAND_BLOCK_WRAPPER_SIZE;
+    cmd->command_req->complete_cb = ums_cbw_complete;
+    cmd->command_req->cookie = cmd;
+    cmd->status_req->length = UMS_COMMAND_STATUS_WRAPPER_SIZE;
+    cmd->status_req->complete_cb = ums_csw_complete;
+    cmd->status_req->cookie = cmd;
+    return NO_ERROR;
+}
 
-    completion_t completion = COMPLETION_INIT;
-    iotxn_t* csw_request = containerof(csw_node, iotxn_t, node);
-    csw_request->complete_cb = ums_read_csw_complete;
-    csw_request->cookie = &completion;
-    ums_queue_request(msd, csw_request);
-    completion_wait(&completion, MX_TIME_INFINITE);
+static void ums_bot_queue(ums_t* msd, ums_cmd_t* cmd) {
+    cmd->tag = msd->tag_send++;
+
+    uint8_t cbw[UMS_COMMAND_BLOCK_WRAPPER_SIZE];
+    memset(cbw, 0, sizeof(cbw));
+    uint32_t* ptr_32 = (uint32_t*)cbw;
+    ptr_32[0] = htole32(CBW_SIGNATURE);
+    ptr_32[1] = htole32(cmd->tag);
+    ptr_32[2] = htole32(cmd->length);
+    cbw[12] = (cmd->direction == USB_DIR_IN ? CBW_FLAGS_DATA_IN : 0);
+    cbw[13] = msd->lun;
+    cbw[14] = cmd->cdb_length;
+    memcpy(cbw + 15, cmd->cdb, cmd->cdb_length);
+    cmd->command_req->ops->copyto(cmd->command_req, cbw, sizeof(cbw), 0);
 
-    csw_status_t csw_error = ums_verify_csw(msd, csw_request);
-    list_add_tail(&msd->free_csw_reqs, &csw_request->node);
+    // the device works through its pipes strictly in order, so the next command's
+    // transfers can wait on the rings behind these
+    cmd->stages = (cmd->data ? 3 : 2);
+    iotxn_queue(msd->udev, cmd->command_req);
+    if (cmd->data) {
+        iotxn_queue(msd->udev, cmd->data);
+    }
+    iotxn_queue(msd->udev, cmd->status_req);
+}
 
-    if (csw_error == CSW_SUCCESS) {
+// points cmd->data at the part of cmd->txn the command transfers
+static mx_status_t ums_setup_data(ums_t* msd, ums_cmd_t* cmd) {
+    cmd->data = NULL;
+    if (cmd->length == 0) {
         return NO_ERROR;
-    } else if (csw_error == CSW_FAILED) {
-        return ERR_BAD_STATE;
+    }
+
+    iotxn_t* txn = cmd->txn;
+    iotxn_t* data;
+    mx_status_t status;
+    if (!ums_cmd_is_split(cmd)) {
+        // transfer straight to or from the client's pages
+        status = txn->ops->clone(txn, &data, 0);
+        if (status != NO_ERROR) return status;
     } else {
-        // FIXME - best way to handle this?
-        // print error and then reset device due to it
-        DEBUG_PRINT(("UMS: CSW verify returned error. Check ums-hw.h csw_status_t for enum = %d\n", csw_error));
-        ums_reset(msd);
-        return ERR_INTERNAL;
+        status = iotxn_alloc(&data, 0, cmd->length, 0);
+        if (status != NO_ERROR) return status;
+        if (cmd->direction == USB_DIR_OUT) {
+            void* buffer;
+            data->ops->mmap(data, &buffer);
+            txn->ops->copyfrom(txn, buffer, cmd->length, cmd->offset);
+        }
     }
-}
 
-static mx_status_t ums_queue_read(ums_t* msd, uint16_t transfer_length) {
-    // read request sense response
-    list_node_t* read_node = list_remove_head(&msd->free_read_reqs);
-    if (!read_node) {
-        DEBUG_PRINT(("UMS:error, no read reqs left\n"));
-        return ERR_BUFFER_TOO_SMALL;
+    bool in = (cmd->direction == USB_DIR_IN);
+    data->protocol = MX_PROTOCOL_USB;
+    data->length = cmd->length;
+    usb_protocol_data_t* pdata = iotxn_pdata(data, usb_protocol_data_t);
+    memset(pdata, 0, sizeof(*pdata));
+    if (msd->use_uas) {
+        pdata->ep_address = (in ? msd->uas.data_in_addr : msd->uas.data_out_addr);
+        pdata->stream_id = cmd->tag;
+    } else {
+        pdata->ep_address = (in ? msd->bulk_in_addr : msd->bulk_out_addr);
     }
-    iotxn_t* read_request = containerof(read_node, iotxn_t, node);
-    read_request->length = transfer_length;
-    ums_queue_request(msd, read_request);
+    data->complete_cb = ums_data_complete;
+    data->cookie = cmd;
+    cmd->data = data;
     return NO_ERROR;
 }
 
-static mx_status_t ums_queue_write(ums_t* msd, uint16_t transfer_length, iotxn_t* txn) {
-    list_node_t* write_node = list_remove_head(&msd->free_write_reqs);
-    if (!write_node) {
-        DEBUG_PRINT(("UMS:error, no write reqs left\n"));
-        return ERR_BUFFER_TOO_SMALL;
+static void ums_cmd_finish(ums_cmd_t* cmd) {
+    ums_t* msd = cmd->msd;
+    iotxn_t* txn = cmd->txn;
+    mx_status_t status = cmd->status;
+    bool internal = cmd->internal;
+
+    mx_off_t actual = cmd->actual;
+    if (actual > cmd->length - cmd->residue) {
+        actual = cmd->length - cmd->residue;
+    }
+    // internal commands often get less than they allow for. reads and writes must not
+    if (status == NO_ERROR && !internal && actual != cmd->length) {
+        status = ERR_IO;
     }
-    iotxn_t* write_request = containerof(write_node, iotxn_t, node);
-    write_request->length = transfer_length;
-    void* buffer;
-    write_request->ops->mmap(write_request, &buffer);
-    txn->ops->copyfrom(txn, buffer, (size_t)transfer_length, 0);
-    ums_queue_request(msd, write_request);
-    return NO_ERROR;
-}
 
-static csw_status_t ums_verify_csw(ums_t* msd, iotxn_t* csw_request) {
-    uint8_t buffer[UMS_COMMAND_STATUS_WRAPPER_SIZE];
-    csw_request->ops->copyfrom(csw_request, buffer, sizeof(buffer), 0);
+    if (cmd->data) {
+        if (status == NO_ERROR && cmd->direction == USB_DIR_IN && ums_cmd_is_split(cmd)) {
+            void* buffer;
+            cmd->data->ops->mmap(cmd->data, &buffer);
+            txn->ops->copyto(txn, buffer, actual, cmd->offset);
+        }
+        cmd->data->ops->release(cmd->data);
+        cmd->data = NULL;
+    }
 
-    // check signature is "USBS"
-    uint32_t* ptr_32 = (uint32_t*)buffer;
-    if (letoh32(ptr_32[0]) != CSW_SIGNATURE) {
-        DEBUG_PRINT(("UMS:invalid csw sig, expected:%08x got:%08x \n", CSW_SIGNATURE, letoh32(ptr_32[0])));
-        return CSW_INVALID;
+    bool complete = false;
+    mtx_lock(&msd->mutex);
+    if (status != NO_ERROR && msd->recovering && !cmd->failed && !msd->dead) {
+        // an innocent bystander of someone else's error. send it again once recovery is done
+        list_add_tail(&msd->retry_cmds, &cmd->node);
+    } else {
+        if (status != NO_ERROR && txn->status == NO_ERROR) {
+            txn->status = status;
+        }
+        if (internal) {
+            txn->actual = actual;
+            complete = true;
+        } else {
+            // txn->actual counts the bytes whose commands are done until we complete it
+            txn->actual += cmd->length;
+            complete = (txn->actual == txn->length);
+            if (complete && --msd->outstanding_iotxns == 0) {
+                completion_signal(&msd->idle);
+            }
+        }
+        cmd->txn = NULL;
+        cmd->failed = false;
+        list_add_tail(&msd->free_cmds, &cmd->node);
     }
-    // check if tag matches the tag of last CBW
-    if (letoh32(ptr_32[1]) != msd->tag_receive++) {
-        DEBUG_PRINT(("UMS:csw tag mismatch, expected:%08x got in csw:%08x \n", msd->tag_receive - 1, letoh32(ptr_32[1])));
-        return CSW_TAG_MISMATCH;
+    if (--msd->busy_cmds == 0 && msd->recovering) {
+        completion_signal(&msd->drained);
     }
-    // check if success is true or not?
-    uint8_t* ptr_8 = (uint8_t*)buffer;
-    if (ptr_8[12] == CSW_FAILED) {
-        return CSW_FAILED;
-    } else if (ptr_8[12] == CSW_PHASE_ERROR) {
-        return CSW_PHASE_ERROR;
+    mtx_unlock(&msd->mutex);
+
+    if (complete) {
+        status = txn->status;
+        actual = (internal ? txn->actual : txn->length);
+        txn->ops->complete(txn, status, status == NO_ERROR ? actual : 0);
     }
-    return CSW_SUCCESS;
+    ums_issue(msd);
 }
 
-static void ums_read_complete(iotxn_t* txn, void* cookie) {
-    ums_t* msd = (ums_t*)cookie;
-    list_add_tail(&msd->completed_reads, &txn->node);
-}
+static int ums_recovery_thread(void* arg) {
+    ums_t* msd = (ums_t*)arg;
 
-static iotxn_t* pop_completed_read(ums_t* msd) {
-    list_node_t* node = list_remove_head(&msd->completed_reads);
-    if (!node) {
-        printf("msd->completed_reads empty in pop_completed_read\n");
-        return NULL;
+    DEBUG_PRINT(("UMS: recovering from transport error\n"));
+    // cancelling whatever is still on the rings finishes every command in flight.
+    // the ones that did nothing wrong go on retry_cmds
+    if (msd->use_uas) {
+        ums_uas_cancel(msd);
+    } else {
+        usb_reset_endpoint(msd->udev, msd->bulk_out_addr);
+        usb_reset_endpoint(msd->udev, msd->bulk_in_addr);
+    }
+    completion_wait(&msd->drained, MX_TIME_INFINITE);
+
+    if (!msd->use_uas) {
+        mx_status_t status = ums_reset(msd);
+        if (status < 0) {
+            printf("ums: reset recovery failed: %d\n", status);
+        }
     }
-    return containerof(node, iotxn_t, node);
-}
 
-static void ums_csw_complete(iotxn_t* csw_request, void* cookie) {
-    ums_t* msd = (ums_t*)cookie;
+    mtx_lock(&msd->mutex);
+    msd->recovering = false;
+    mtx_unlock(&msd->mutex);
+    ums_issue(msd);
+    return 0;
+}
 
-    // TODO: handle error case for CSW by setting iotxn to error and returning
-    iotxn_t* curr_txn = list_remove_head_type(&msd->queued_iotxns, iotxn_t, node);
+void ums_stage_complete(ums_cmd_t* cmd, mx_status_t status) {
+    ums_t* msd = cmd->msd;
+    bool recover = false;
 
-    // unblock calls to IOCTL_DEVICE_SYNC that are waiting for curr_txn to complete
     mtx_lock(&msd->mutex);
-    ums_sync_node_t* sync_node;
-    list_for_every_entry(&msd->sync_nodes, sync_node, ums_sync_node_t, node) {
-        if (sync_node->iotxn == curr_txn) {
-            list_delete(&sync_node->node);
-            completion_signal(&sync_node->completion);
+    if (status < 0 && cmd->status == NO_ERROR) {
+        cmd->status = status;
+        // ERR_IO means the device reported an error for the command. for anything else
+        // we can no longer be sure where the device is up to
+        if (status != ERR_IO && !msd->recovering && !msd->dead) {
+            msd->recovering = true;
+            completion_reset(&msd->drained);
+            cmd->failed = true;
+            recover = true;
         }
     }
+    bool done = (--cmd->stages == 0);
     mtx_unlock(&msd->mutex);
 
-    csw_status_t csw_error = ums_verify_csw(msd, csw_request);
-    if (csw_error) {
-        // print error and then reset device due to it
-        DEBUG_PRINT(("UMS: CSW verify returned error. Check ums-hw.h csw_status_t for enum = %d\n", csw_error));
-        if (csw_error != CSW_FAILED) {
-            ums_reset(msd);
+    if (recover) {
+        thrd_t thread;
+        if (thrd_create_with_name(&thread, ums_recovery_thread, msd, "ums_recovery_thread")
+                == thrd_success) {
+            thrd_detach(thread);
+        } else {
+            printf("ums: unable to start recovery thread\n");
         }
-        list_add_tail(&msd->free_csw_reqs, &csw_request->node);
-        curr_txn->ops->complete(curr_txn, ERR_BAD_STATE, 0);
-        return;
     }
-    // if head of iotxn list is a read iotxn and CSW reports success, then set its buffer to that
-    // of the latest read request, with limited length based on data residue field in CSW
-    if (curr_txn->opcode == IOTXN_OP_READ) {
-        iotxn_t* read_request = pop_completed_read(msd);
-        if (!read_request) {
-            list_add_tail(&msd->free_csw_reqs, &csw_request->node);
-            return;
+    if (done) {
+        ums_cmd_finish(cmd);
+    }
+}
+
+static void ums_prepare_internal(ums_cmd_t* cmd, iotxn_t* txn) {
+    ums_exec_t* exec = iotxn_to(txn, ums_exec_t);
+    memset(cmd->cdb, 0, sizeof(cmd->cdb));
+    memcpy(cmd->cdb, exec->cdb, exec->cdb_length);
+    cmd->cdb_length = exec->cdb_length;
+    cmd->direction = exec->direction;
+    cmd->txn = txn;
+    cmd->offset = 0;
+    cmd->length = txn->length;
+    cmd->internal = true;
+}
+
+// builds a READ or WRITE for the next max_transfer bytes of the iotxn at the head of
+// queued_iotxns, removing it from the queue once all of it has been given to commands
+static void ums_prepare_rw(ums_t* msd, ums_cmd_t* cmd, iotxn_t* txn) {
+    mx_off_t offset = msd->queued_offset;
+    if (offset == 0) {
+        txn->status = NO_ERROR;
+        txn->actual = 0;
+    }
+    uint32_t length = msd->max_transfer;
+    if (length > txn->length - offset) {
+        length = txn->length - offset;
+    }
+    msd->queued_offset += length;
+    if (msd->queued_offset == txn->length) {
+        list_delete(&txn->node);
+        msd->queued_offset = 0;
+    }
+
+    bool read = (txn->opcode == IOTXN_OP_READ);
+    uint64_t lba = (txn->offset + offset) / msd->block_size;
+    uint32_t num_blocks = length / msd->block_size;
+
+    cmd->txn = txn;
+    cmd->offset = offset;
+    cmd->length = length;
+    cmd->internal = false;
+    cmd->direction = (read ? USB_DIR_IN : USB_DIR_OUT);
+    memset(cmd->cdb, 0, sizeof(cmd->cdb));
+    if (lba + num_blocks > UINT32_MAX || num_blocks > UINT16_MAX) {
+        cmd->cdb[0] = (read ? UMS_READ16 : UMS_WRITE16);
+        write64be(cmd->cdb + 2, lba);
+        write32be(cmd->cdb + 10, num_blocks);
+        cmd->cdb_length = UMS_READ16_COMMAND_LENGTH;
+    } else {
+        cmd->cdb[0] = (read ? UMS_READ10 : UMS_WRITE10);
+        write32be(cmd->cdb + 2, lba);
+        write16be(cmd->cdb + 7, num_blocks);
+        cmd->cdb_length = UMS_READ10_COMMAND_LENGTH;
+    }
+}
+
+// takes the next command to send, or NULL if there is nothing to send or no free slot
+static ums_cmd_t* ums_next_cmd_locked(ums_t* msd) {
+    if (msd->recovering || msd->dead) {
+        return NULL;
+    }
+
+    ums_cmd_t* cmd = list_remove_head_type(&msd->retry_cmds, ums_cmd_t, node);
+    if (!cmd) {
+        if (list_is_empty(&msd->free_cmds)) {
+            return NULL;
+        }
+        iotxn_t* txn = list_remove_head_type(&msd->internal_txns, iotxn_t, node);
+        if (txn) {
+            cmd = list_remove_head_type(&msd->free_cmds, ums_cmd_t, node);
+            ums_prepare_internal(cmd, txn);
+        } else {
+            txn = list_peek_head_type(&msd->queued_iotxns, iotxn_t, node);
+            if (!txn) {
+                return NULL;
+            }
+            cmd = list_remove_head_type(&msd->free_cmds, ums_cmd_t, node);
+            ums_prepare_rw(msd, cmd, txn);
         }
-        // data residue field is the 3rd uint32_t in csw buffer
-        uint32_t temp;
-        csw_request->ops->copyfrom(csw_request, &temp, sizeof(temp), 2 * sizeof(temp));
-        uint32_t residue = letoh32(temp);
-        uint32_t length = read_request->actual - residue;
-        void* buffer;
-        curr_txn->ops->mmap(curr_txn, &buffer);
-        read_request->ops->copyfrom(read_request, buffer, length, 0);
-        list_add_tail(&msd->free_read_reqs, &read_request->node);
     }
+    msd->busy_cmds++;
+    return cmd;
+}
+
+static void ums_start_cmd(ums_t* msd, ums_cmd_t* cmd) {
+    cmd->status = NO_ERROR;
+    cmd->actual = 0;
+    cmd->residue = 0;
+    cmd->failed = false;
 
-    list_add_tail(&msd->free_csw_reqs, &csw_request->node);
-    curr_txn->ops->complete(curr_txn, NO_ERROR, curr_txn->length);
+    mx_status_t status = ums_setup_data(msd, cmd);
+    if (status != NO_ERROR) {
+        cmd->status = status;
+        ums_cmd_finish(cmd);
+        return;
+    }
+    if (msd->use_uas) {
+        ums_uas_queue(msd, cmd);
+    } else {
+        ums_bot_queue(msd, cmd);
+    }
 }
 
-static void ums_write_complete(iotxn_t* txn, void* cookie) {
-    ums_t* msd = (ums_t*)cookie;
-    // FIXME what to do with error here?
-    list_add_tail(&msd->free_write_reqs, &txn->node);
+// sends commands while there are free slots for them. only one thread sends at a time,
+// so each command's transfers reach the rings together and in order
+static void ums_issue(ums_t* msd) {
+    mtx_lock(&msd->mutex);
+    if (msd->issuing) {
+        // whoever is sending will see what we came to send
+        mtx_unlock(&msd->mutex);
+        return;
+    }
+    msd->issuing = true;
+
+    ums_cmd_t* cmd;
+    while ((cmd = ums_next_cmd_locked(msd)) != NULL) {
+        // completions call back into ums_issue(), so the lock can't be held here
+        mtx_unlock(&msd->mutex);
+        ums_start_cmd(msd, cmd);
+        mtx_lock(&msd->mutex);
+    }
+    msd->issuing = false;
+    mtx_unlock(&msd->mutex);
 }
 
-static mx_status_t ums_inquiry(ums_t* msd, uint8_t* out_data) {
-    mx_status_t status = NO_ERROR;
+static void ums_exec_complete(iotxn_t* txn, void* cookie) {
+    completion_signal((completion_t*)cookie);
+}
 
-    // CBW Configuration
-    uint8_t command[UMS_INQUIRY_COMMAND_LENGTH];
-    memset(command, 0, UMS_INQUIRY_COMMAND_LENGTH);
-    // set command type
-    command[0] = UMS_INQUIRY;
-    // set allocated length in scsi command
-    command[4] = UMS_INQUIRY_TRANSFER_LENGTH;
-    status = ums_send_cbw(msd, UMS_INQUIRY_TRANSFER_LENGTH, USB_DIR_IN,
-                          UMS_INQUIRY_COMMAND_LENGTH, command);
-    if (status == ERR_BUFFER_TOO_SMALL) {
+// runs a SCSI command for the driver itself, ahead of any queued client iotxns.
+// returns the number of bytes transferred
+static mx_status_t ums_exec(ums_t* msd, const uint8_t* cdb, uint8_t cdb_length,
+                            uint8_t direction, void* data, size_t length) {
+    iotxn_t* txn;
+    mx_status_t status = iotxn_alloc(&txn, 0, length, sizeof(ums_exec_t));
+    if (status != NO_ERROR) {
         return status;
     }
+    ums_exec_t* exec = iotxn_to(txn, ums_exec_t);
+    memcpy(exec->cdb, cdb, cdb_length);
+    exec->cdb_length = cdb_length;
+    exec->direction = direction;
+    txn->length = length;
+    if (direction == USB_DIR_OUT && length > 0) {
+        txn->ops->copyto(txn, data, length, 0);
+    }
 
-    // read inquiry response
-    status = ums_queue_read(msd, UMS_INQUIRY_TRANSFER_LENGTH);
-    if (status == ERR_BUFFER_TOO_SMALL) {
-        return status;
+    completion_t completion = COMPLETION_INIT;
+    txn->complete_cb = ums_exec_complete;
+    txn->cookie = &completion;
+
+    mtx_lock(&msd->mutex);
+    if (msd->dead) {
+        mtx_unlock(&msd->mutex);
+        txn->ops->release(txn);
+        return ERR_REMOTE_CLOSED;
     }
+    list_add_tail(&msd->internal_txns, &txn->node);
+    mtx_unlock(&msd->mutex);
+
+    ums_issue(msd);
+    completion_wait(&completion, MX_TIME_INFINITE);
 
-    // wait for CSW
-    status = ums_read_csw(msd);
-    iotxn_t* read_request = pop_completed_read(msd);
+    status = txn->status;
     if (status == NO_ERROR) {
-        read_request->ops->copyfrom(read_request, out_data, UMS_INQUIRY_TRANSFER_LENGTH, 0);
+        status = txn->actual;
+        if (direction == USB_DIR_IN) {
+            txn->ops->copyfrom(txn, data, txn->actual, 0);
+        }
     }
-    list_add_tail(&msd->free_read_reqs, &read_request->node);
+    txn->ops->release(txn);
     return status;
 }
 
-static mx_status_t ums_test_unit_ready(ums_t* msd) {
-    mx_status_t status = NO_ERROR;
+static mx_status_t ums_inquiry(ums_t* msd, uint8_t* out_data) {
+    uint8_t command[UMS_INQUIRY_COMMAND_LENGTH];
+    memset(command, 0, UMS_INQUIRY_COMMAND_LENGTH);
+    // set command type
+    command[0] = UMS_INQUIRY;
+    // set allocated length in scsi command
+    command[4] = UMS_INQUIRY_TRANSFER_LENGTH;
+    mx_status_t status = ums_exec(msd, command, sizeof(command), USB_DIR_IN, out_data,
+                                  UMS_INQUIRY_TRANSFER_LENGTH);
+    return (status < 0 ? status : NO_ERROR);
+}
+
+// returns the length of the vital product data page read
+static mx_status_t ums_inquiry_vpd(ums_t* msd, uint8_t page, uint8_t* out_data) {
+    uint8_t command[UMS_INQUIRY_COMMAND_LENGTH];
+    memset(command, 0, UMS_INQUIRY_COMMAND_LENGTH);
+    command[0] = UMS_INQUIRY;
+    command[1] = UMS_INQUIRY_EVPD;
+    command[2] = page;
+    write16be(command + 3, UMS_VPD_TRANSFER_LENGTH);
+    return ums_exec(msd, command, sizeof(command), USB_DIR_IN, out_data,
+                    UMS_VPD_TRANSFER_LENGTH);
+}
 
-    // CBW Configuration
+static mx_status_t ums_test_unit_ready(ums_t* msd) {
     uint8_t command[UMS_TEST_UNIT_READY_COMMAND_LENGTH];
     memset(command, 0, UMS_TEST_UNIT_READY_COMMAND_LENGTH);
     // set command type
     command[0] = (char)UMS_TEST_UNIT_READY;
-    status = ums_send_cbw(msd, UMS_NO_TRANSFER_LENGTH, USB_DIR_IN,
-                          UMS_TEST_UNIT_READY_COMMAND_LENGTH, command);
-    if (status == ERR_BUFFER_TOO_SMALL) {
-        return status;
-    }
-
-    // wait for CSW
-    return ums_read_csw(msd);
+    mx_status_t status = ums_exec(msd, command, sizeof(command), USB_DIR_IN, NULL,
+                                  UMS_NO_TRANSFER_LENGTH);
+    return (status < 0 ? status : NO_ERROR);
 }
 
 static mx_status_t ums_request_sense(ums_t* msd, uint8_t* out_data) {
-    mx_status_t status = NO_ERROR;
-
-    // CBW Configuration
     uint8_t command[UMS_REQUEST_SENSE_COMMAND_LENGTH];
     memset(command, 0, UMS_REQUEST_SENSE_COMMAND_LENGTH);
     // set command type
     command[0] = UMS_REQUEST_SENSE;
     // set allocated length in scsi command
     command[4] = UMS_REQUEST_SENSE_TRANSFER_LENGTH;
-    status = ums_send_cbw(msd, UMS_REQUEST_SENSE_TRANSFER_LENGTH, USB_DIR_IN,
-                            UMS_REQUEST_SENSE_COMMAND_LENGTH, command);
-    if (status == ERR_BUFFER_TOO_SMALL) {
-        return status;
-    }
-
-    // read request sense response
-    status = ums_queue_read(msd, UMS_REQUEST_SENSE_TRANSFER_LENGTH);
-    if (status == ERR_BUFFER_TOO_SMALL) {
-        return status;
-    }
-
-    // wait for CSW
-    status = ums_read_csw(msd);
-    iotxn_t* read_request = pop_completed_read(msd);
-    if (status == NO_ERROR) {
-        read_request->ops->copyfrom(read_request, out_data, UMS_REQUEST_SENSE_TRANSFER_LENGTH, 0);
-    }
-    list_add_tail(&msd->free_read_reqs, &read_request->node);
-    return status;
-}
-
-static mx_status_t ums_read_format_capacities(ums_t* msd, uint8_t* out_data) {
-    mx_status_t status = NO_ERROR;
-
-    // CBW Configuration
-    uint8_t command[UMS_READ_FORMAT_CAPACITIES_COMMAND_LENGTH];
-    memset(command, 0, UMS_READ_FORMAT_CAPACITIES_COMMAND_LENGTH);
-    // set command type
-    command[0] = UMS_READ_FORMAT_CAPACITIES;
-    // set allocated length in scsi command
-    command[8] = UMS_READ_FORMAT_CAPACITIES_TRANSFER_LENGTH;
-    status = ums_send_cbw(msd, UMS_READ_FORMAT_CAPACITIES_TRANSFER_LENGTH, USB_DIR_IN,
-                            UMS_READ_FORMAT_CAPACITIES_COMMAND_LENGTH, command);
-    if (status == ERR_BUFFER_TOO_SMALL) {
-        return status;
-    }
-
-    // read request sense response
-    status = ums_queue_read(msd, UMS_READ_FORMAT_CAPACITIES_TRANSFER_LENGTH);
-    if (status == ERR_BUFFER_TOO_SMALL) {
-        return status;
-    }
-
-    // wait for CSW
-    status = ums_read_csw(msd);
-    iotxn_t* read_request = pop_completed_read(msd);
-    if (status == NO_ERROR) {
-        read_request->ops->copyfrom(read_request, out_data, UMS_READ_FORMAT_CAPACITIES_TRANSFER_LENGTH, 0);
-    }
-    list_add_tail(&msd->free_read_reqs, &read_request->node);
-    return status;
+    mx_status_t status = ums_exec(msd, command, sizeof(command), USB_DIR_IN, out_data,
+                                  UMS_REQUEST_SENSE_TRANSFER_LENGTH);
+    return (status < 0 ? status : NO_ERROR);
 }
 
 static mx_status_t ums_read_capacity10(ums_t* msd, uint8_t* out_data) {
-    mx_status_t status = NO_ERROR;
-
-    // CBW Configuration
     uint8_t command[UMS_READ_CAPACITY10_COMMAND_LENGTH];
     memset(command, 0, UMS_READ_CAPACITY10_COMMAND_LENGTH);
     // set command type
     command[0] = UMS_READ_CAPACITY10;
-    status = ums_send_cbw(msd, UMS_READ_CAPACITY10_TRANSFER_LENGTH, USB_DIR_IN,
-                            UMS_READ_CAPACITY10_COMMAND_LENGTH, command);
-    if (status == ERR_BUFFER_TOO_SMALL) {
-        return status;
-    }
-
-    // read capacity10 response
-    status = ums_queue_read(msd, UMS_READ_CAPACITY10_TRANSFER_LENGTH);
-    if (status == ERR_BUFFER_TOO_SMALL) {
-        return status;
-    }
-
-    status = ums_read_csw(msd);
-    iotxn_t* read_request = pop_completed_read(msd);
-    if (status == NO_ERROR) {
-        read_request->ops->copyfrom(read_request, out_data, UMS_READ_CAPACITY10_TRANSFER_LENGTH, 0);
-    }
-    list_add_tail(&msd->free_read_reqs, &read_request->node);
-    return status;
+    mx_status_t status = ums_exec(msd, command, sizeof(command), USB_DIR_IN, out_data,
+                                  UMS_READ_CAPACITY10_TRANSFER_LENGTH);
+    return (status < 0 ? status : NO_ERROR);
 }
 
 static mx_status_t ums_read_capacity16(ums_t* msd, uint8_t* out_data) {
-    mx_status_t status = NO_ERROR;
-
-    // CBW Configuration
     uint8_t command[UMS_READ_CAPACITY16_COMMAND_LENGTH];
     memset(command, 0, UMS_READ_CAPACITY16_COMMAND_LENGTH);
     // set command type
@@ -494,195 +582,109 @@ static mx_status_t ums_read_capacity16(ums_t* msd, uint8_t* out_data) {
     // service action = 10, not sure what that means
     command[1] = 0x10;
     command[13] = UMS_READ_CAPACITY16_TRANSFER_LENGTH;  // LSB of allocation length
-    status = ums_send_cbw(msd, UMS_READ_CAPACITY16_TRANSFER_LENGTH, USB_DIR_IN,
-                            UMS_READ_CAPACITY16_COMMAND_LENGTH, command);
-    if (status == ERR_BUFFER_TOO_SMALL) {
-        return status;
-    }
+    mx_status_t status = ums_exec(msd, command, sizeof(command), USB_DIR_IN, out_data,
+                                  UMS_READ_CAPACITY16_TRANSFER_LENGTH);
+    return (status < 0 ? status : NO_ERROR);
+}
 
-    // read capacity16 response
-    status = ums_queue_read(msd, UMS_READ_CAPACITY16_TRANSFER_LENGTH);
-    if (status == ERR_BUFFER_TOO_SMALL) {
-        return status;
+// reads MAXIMUM TRANSFER LENGTH from the Block Limits page. returns 0 if the device
+// doesn't say
+static uint32_t ums_get_max_transfer_blocks(ums_t* msd, uint8_t* inquiry_data) {
+    // older devices tend to choke on VPD requests rather than reject them
+    if (inquiry_data[2] < 0x05) {
+        return 0;
     }
 
-    status = ums_read_csw(msd);
-    iotxn_t* read_request = pop_completed_read(msd);
-    if (status == NO_ERROR) {
-        read_request->ops->copyfrom(read_request, out_data, UMS_READ_CAPACITY16_TRANSFER_LENGTH, 0);
+    uint8_t vpd[UMS_VPD_TRANSFER_LENGTH];
+    mx_status_t length = ums_inquiry_vpd(msd, UMS_VPD_SUPPORTED_PAGES, vpd);
+    if (length < 4) {
+        return 0;
     }
-    list_add_tail(&msd->free_read_reqs, &read_request->node);
-    return status;
-}
-
-static mx_status_t ums_read(mx_device_t* device, iotxn_t* txn) {
-    if (txn->length > UINT32_MAX) return ERR_INVALID_ARGS;
-    ums_t* msd = get_ums(device);
-    mx_status_t status = NO_ERROR;
-
-    uint64_t lba = txn->offset/msd->block_size;
-    uint32_t num_blocks = txn->length/msd->block_size;
-    uint32_t transfer_length = txn->length;
-
-    // CBW Configuration
-
-    if (msd->use_read_write_16) {
-        uint8_t command[UMS_READ16_COMMAND_LENGTH];
-        memset(command, 0, UMS_READ16_COMMAND_LENGTH);
-        // set command type
-        command[0] = UMS_READ16;
-        // set lba
-        write64be(command + 2, lba);
-        // set transfer length in blocks
-        write32be(command + 10, num_blocks);
-        status = ums_send_cbw(msd, transfer_length, USB_DIR_IN,
-                                UMS_READ16_COMMAND_LENGTH, command);
-        if (status == ERR_BUFFER_TOO_SMALL) {
-            return status;
-        }
-    } else if (num_blocks <= UINT16_MAX) {
-        uint8_t command[UMS_READ10_COMMAND_LENGTH];
-        memset(command, 0, UMS_READ10_COMMAND_LENGTH);
-        // set command type
-        command[0] = UMS_READ10;
-        // set lba
-        write32be(command + 2, lba);
-        // set transfer length in blocks
-        write16be(command + 7, num_blocks);
-        status = ums_send_cbw(msd, transfer_length, USB_DIR_IN, UMS_READ10_COMMAND_LENGTH, command);
-        if (status == ERR_BUFFER_TOO_SMALL) {
-            return status;
-        }
-    } else {
-        uint8_t command[UMS_READ12_COMMAND_LENGTH];
-        memset(command, 0, UMS_READ12_COMMAND_LENGTH);
-        // set command type
-        command[0] = UMS_READ12;
-        // set lba
-        write32be(command + 2, lba);
-        // set transfer length in blocks
-        write32be(command + 6, num_blocks);
-        status = ums_send_cbw(msd, transfer_length, USB_DIR_IN,
-            UMS_READ12_COMMAND_LENGTH, command);
-        if (status == ERR_BUFFER_TOO_SMALL) {
-            return status;
+    int count = vpd[3];
+    if (count > length - 4) {
+        count = length - 4;
+    }
+    bool found = false;
+    for (int i = 0; i < count; i++) {
+        if (vpd[4 + i] == UMS_VPD_BLOCK_LIMITS) {
+            found = true;
+            break;
         }
     }
-
-    // read request sense response
-    status = ums_queue_read(msd, transfer_length);
-    if (status == ERR_BUFFER_TOO_SMALL) {
-        return status;
+    if (!found) {
+        return 0;
     }
 
-    // receive CSW
-    return ums_queue_csw(msd);
+    length = ums_inquiry_vpd(msd, UMS_VPD_BLOCK_LIMITS, vpd);
+    if (length < UMS_VPD_MAX_TRANSFER_LENGTH + 4) {
+        return 0;
+    }
+    return read32be(vpd + UMS_VPD_MAX_TRANSFER_LENGTH);
 }
 
-static mx_status_t ums_write(mx_device_t* device, iotxn_t* txn) {
-    if (txn->length > UINT32_MAX) return ERR_INVALID_ARGS;
-    ums_t* msd = get_ums(device);
-    mx_status_t status = NO_ERROR;
-
-    uint64_t lba = txn->offset/msd->block_size;
-    uint32_t num_blocks = txn->length/msd->block_size;
-    uint32_t transfer_length = txn->length;
-
-    if (msd->use_read_write_16) {
-        uint8_t command[UMS_WRITE16_COMMAND_LENGTH];
-        memset(command, 0, UMS_WRITE16_COMMAND_LENGTH);
-        // set command type
-        command[0] = UMS_WRITE16;
-        // set lba
-        uint64_t* lba_ptr = (uint64_t*)&(command[2]);
-        *lba_ptr = htobe64(lba);
-        // set transfer length
-        uint32_t* transfer_len_ptr = (uint32_t*)&(command[10]);
-        *transfer_len_ptr = htobe32(num_blocks);
-        status = ums_send_cbw(msd, transfer_length, USB_DIR_OUT,
-                                UMS_WRITE16_COMMAND_LENGTH, command);
-        if (status == ERR_BUFFER_TOO_SMALL) {
-            return status;
-        }
-    } else if (num_blocks <= UINT16_MAX) {
-        uint8_t command[UMS_WRITE10_COMMAND_LENGTH];
-        memset(command, 0, UMS_WRITE10_COMMAND_LENGTH);
-        // set command type
-        command[0] = UMS_WRITE10;
-        // set lba
-        uint32_t* lba_ptr = (uint32_t*)&(command[2]);
-        *lba_ptr = htobe32(lba);
-        // set transfer length in blocks
-        uint16_t* transfer_len_ptr = (uint16_t*)&(command[7]);
-        *transfer_len_ptr = htobe16(num_blocks);
-        status = ums_send_cbw(msd, transfer_length, USB_DIR_OUT,
-                                UMS_WRITE10_COMMAND_LENGTH, command);
-        if (status == ERR_BUFFER_TOO_SMALL) {
-            return status;
-        }
-    } else {
-        uint8_t command[UMS_WRITE12_COMMAND_LENGTH];
-        memset(command, 0, UMS_WRITE12_COMMAND_LENGTH);
-        // set command type
-        command[0] = UMS_WRITE12;
-        // set lba
-        uint32_t* lba_ptr = (uint32_t*)&(command[2]);
-        *lba_ptr = htobe32(lba);
-        // set transfer length
-        uint32_t* transfer_len_ptr = (uint32_t*)&(command[6]);
-        *transfer_len_ptr = htobe32(num_blocks);
-        status = ums_send_cbw(msd, transfer_length, USB_DIR_OUT,
-                                UMS_WRITE12_COMMAND_LENGTH, command);
-        if (status == ERR_BUFFER_TOO_SMALL) {
-            return status;
+// fails everything that hasn't been handed to a command yet
+static void ums_fail_queued(ums_t* msd, mx_status_t status) {
+    list_node_t txns = LIST_INITIAL_VALUE(txns);
+    iotxn_t* partial = NULL;
+
+    mtx_lock(&msd->mutex);
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(&msd->internal_txns, iotxn_t, node)) != NULL) {
+        list_add_tail(&txns, &txn->node);
+    }
+    txn = list_peek_head_type(&msd->queued_iotxns, iotxn_t, node);
+    if (txn && msd->queued_offset > 0) {
+        // part of this one is on the wire. count the rest as done so that whichever of
+        // its commands finishes last completes it
+        list_delete(&txn->node);
+        txn->status = status;
+        txn->actual += txn->length - msd->queued_offset;
+        msd->queued_offset = 0;
+        if (txn->actual == txn->length) {
+            partial = txn;
         }
     }
-
-    //write response
-    status = ums_queue_write(msd, transfer_length, txn);
-    if (status == ERR_BUFFER_TOO_SMALL) {
-        return status;
+    while ((txn = list_remove_head_type(&msd->queued_iotxns, iotxn_t, node)) != NULL) {
+        list_add_tail(&txns, &txn->node);
+        msd->outstanding_iotxns--;
     }
-
-    // receive CSW
-    return ums_queue_csw(msd);
-}
-
-static mx_status_t ums_toggle_removable(mx_device_t* device, bool removable) {
-    ums_t* msd = get_ums(device);
-    mx_status_t status = NO_ERROR;
-
-    // CBW Configuration
-    uint8_t command[UMS_TOGGLE_REMOVABLE_COMMAND_LENGTH];
-    memset(command, 0, UMS_TOGGLE_REMOVABLE_COMMAND_LENGTH);
-    // set command type
-    command[0] = UMS_TOGGLE_REMOVABLE;
-    status = ums_send_cbw(msd, UMS_NO_TRANSFER_LENGTH, USB_DIR_OUT,
-                            UMS_TOGGLE_REMOVABLE_COMMAND_LENGTH, command);
-    if (status == ERR_BUFFER_TOO_SMALL) {
-        return status;
+    if (partial) {
+        msd->outstanding_iotxns--;
     }
+    if (msd->outstanding_iotxns == 0) {
+        completion_signal(&msd->idle);
+    }
+    mtx_unlock(&msd->mutex);
 
-    // receive CSW
-    return ums_read_csw(msd);
+    while ((txn = list_remove_head_type(&txns, iotxn_t, node)) != NULL) {
+        txn->ops->complete(txn, status, 0);
+    }
+    if (partial) {
+        partial->ops->complete(partial, status, 0);
+    }
 }
 
 static void ums_unbind(mx_device_t* device) {
     ums_t* msd = get_ums(device);
+
+    mtx_lock(&msd->mutex);
+    msd->dead = true;
+    mtx_unlock(&msd->mutex);
+    ums_fail_queued(msd, ERR_REMOTE_CLOSED);
+
     device_remove(&msd->device);
 }
 
 static mx_status_t ums_release(mx_device_t* device) {
     ums_t* msd = get_ums(device);
-    iotxn_t* txn;
-    while ((txn = list_remove_head_type(&msd->free_csw_reqs, iotxn_t, node)) != NULL) {
-        txn->ops->release(txn);
-    }
-    while ((txn = list_remove_head_type(&msd->free_read_reqs, iotxn_t, node)) != NULL) {
-        txn->ops->release(txn);
-    }
-    while ((txn = list_remove_head_type(&msd->free_write_reqs, iotxn_t, node)) != NULL) {
-        txn->ops->release(txn);
+    for (int i = 0; i < UMS_MAX_DEPTH; i++) {
+        ums_cmd_t* cmd = &msd->cmds[i];
+        if (cmd->command_req) {
+            cmd->command_req->ops->release(cmd->command_req);
+        }
+        if (cmd->status_req) {
+            cmd->status_req->ops->release(cmd->status_req);
+        }
     }
 
     free(msd);
@@ -691,38 +693,47 @@ static mx_status_t ums_release(mx_device_t* device) {
 
 static void ums_iotxn_queue(mx_device_t* dev, iotxn_t* txn) {
     ums_t* msd = get_ums(dev);
-    mtx_lock(&msd->mutex);
 
     uint32_t block_size = msd->block_size;
     // offset must be aligned to block size
     if (txn->offset % block_size) {
         DEBUG_PRINT(("UMS:offset on iotxn (%" PRIu64 ") not aligned to block size(%d)\n", txn->offset, block_size));
         txn->ops->complete(txn, ERR_INVALID_ARGS, 0);
-        goto out;
+        return;
     }
 
     if (txn->length % block_size) {
         DEBUG_PRINT(("UMS:length on iotxn (%" PRIu64 ") not aligned to block size(%d)\n", txn->length, block_size));
         txn->ops->complete(txn, ERR_INVALID_ARGS, 0);
-        goto out;
+        return;
     }
 
-    mx_status_t status;
-    if (txn->opcode == IOTXN_OP_READ) {
-        status = ums_read(dev, txn);
-    }else if (txn->opcode == IOTXN_OP_WRITE) {
-        status = ums_write(dev, txn);
-    } else {
-        status = ERR_INVALID_ARGS;
+    if (txn->opcode != IOTXN_OP_READ && txn->opcode != IOTXN_OP_WRITE) {
+        txn->ops->complete(txn, ERR_INVALID_ARGS, 0);
+        return;
     }
-    if (status == NO_ERROR) {
-        list_add_tail(&msd->queued_iotxns, &txn->node);
-    } else {
-        txn->ops->complete(txn, status, 0);
+    if (txn->offset / block_size + txn->length / block_size > msd->total_blocks) {
+        txn->ops->complete(txn, ERR_OUT_OF_RANGE, 0);
+        return;
+    }
+    if (txn->length == 0) {
+        txn->ops->complete(txn, NO_ERROR, 0);
+        return;
     }
 
-out:
+    mtx_lock(&msd->mutex);
+    if (msd->dead) {
+        mtx_unlock(&msd->mutex);
+        txn->ops->complete(txn, ERR_REMOTE_CLOSED, 0);
+        return;
+    }
+    list_add_tail(&msd->queued_iotxns, &txn->node);
+    if (msd->outstanding_iotxns++ == 0) {
+        completion_reset(&msd->idle);
+    }
     mtx_unlock(&msd->mutex);
+
+    ums_issue(msd);
 }
 
 static ssize_t ums_ioctl(mx_device_t* dev, uint32_t op, const void* cmd, size_t cmdlen, void* reply, size_t max) {
@@ -741,22 +752,9 @@ static ssize_t ums_ioctl(mx_device_t* dev, uint32_t op, const void* cmd, size_t
          *blksize = msd->block_size;
          return sizeof(*blksize);
     }
-    case IOCTL_DEVICE_SYNC: {
-        ums_sync_node_t node;
-
-        mtx_lock(&msd->mutex);
-        if (list_is_empty(&msd->queued_iotxns)) {
-            mtx_unlock(&msd->mutex);
-            return NO_ERROR;
-        }
-        // queue a stack allocated sync node on ums_t.sync_nodes
-        node.iotxn = list_peek_tail_type(&msd->queued_iotxns, iotxn_t, node);
-        completion_reset(&node.completion);
-        list_add_head(&msd->sync_nodes, &node.node);
-        mtx_unlock(&msd->mutex);
-
-        return completion_wait(&node.completion, MX_TIME_INFINITE);
-    }
+    case IOCTL_DEVICE_SYNC:
+        // waits until nothing is queued, which includes anything queued before the sync
+        return completion_wait(&msd->idle, MX_TIME_INFINITE);
     default:
         return ERR_NOT_SUPPORTED;
     }
@@ -775,12 +773,60 @@ static mx_protocol_device_t ums_device_proto = {
     .get_size = ums_get_size,
 };
 
+// chooses a transport and sets up the command slots for it
+static mx_status_t ums_init_cmds(ums_t* msd) {
+    int depth = 0;
+    if (msd->uas.present && usb_get_speed(msd->udev) == USB_SPEED_SUPER) {
+        mx_status_t status = ums_uas_start(msd);
+        if (status > 0) {
+            msd->use_uas = true;
+            depth = status;
+        } else {
+            printf("ums: UAS unavailable (%d), using Bulk-Only\n", status);
+        }
+    }
+    if (!msd->use_uas) {
+        // a command can only be pulled back out from behind another one if the host
+        // controller can cancel transfers
+        depth = 1;
+        if (usb_reset_endpoint(msd->udev, msd->bulk_out_addr) == NO_ERROR &&
+            usb_reset_endpoint(msd->udev, msd->bulk_in_addr) == NO_ERROR) {
+            depth = UMS_BOT_DEPTH;
+        }
+    }
+
+    for (int i = 0; i < depth; i++) {
+        ums_cmd_t* cmd = &msd->cmds[i];
+        cmd->msd = msd;
+        mx_status_t status;
+        if (msd->use_uas) {
+            // stream 0 is reserved, so tags start at 1
+            status = ums_uas_init_cmd(msd, cmd, i + 1);
+        } else {
+            status = ums_alloc_bot_cmd(msd, cmd);
+        }
+        if (status != NO_ERROR) {
+            return status;
+        }
+        list_add_tail(&msd->free_cmds, &cmd->node);
+    }
+    msd->depth = depth;
+    DEBUG_PRINT(("UMS: %s, %d commands in flight\n", msd->use_uas ? "UAS" : "Bulk-Only", depth));
+    return NO_ERROR;
+}
+
 static int ums_start_thread(void* arg) {
     ums_t* msd = (ums_t*)arg;
     device_init(&msd->device, msd->driver, "usb_mass_storage", &ums_device_proto);
 
+    mx_status_t status = ums_init_cmds(msd);
+    if (status < 0) {
+        printf("ums_init_cmds failed: %d\n", status);
+        goto fail;
+    }
+
     uint8_t inquiry_data[UMS_INQUIRY_TRANSFER_LENGTH];
-    mx_status_t status = ums_inquiry(msd, inquiry_data);
+    status = ums_inquiry(msd, inquiry_data);
     if (status < 0) {
         printf("ums_inquiry failed: %d\n", status);
         goto fail;
@@ -792,7 +838,7 @@ static int ums_start_thread(void* arg) {
         if (status == NO_ERROR) {
             ready = true;
             break;
-        } else if (status != ERR_BAD_STATE) {
+        } else if (status != ERR_IO) {
             printf("ums_test_unit_ready failed: %d\n", status);
             goto fail;
         } else {
@@ -830,16 +876,29 @@ static int ums_start_thread(void* arg) {
             goto fail;
         }
 
-        msd->total_blocks = read64be((uint8_t*)&read_capacity16_data);
+        msd->total_blocks = read64be((uint8_t*)&read_capacity16_data) + 1;
         msd->block_size = read32be((uint8_t*)&read_capacity16_data + 8);
     }
+    if (msd->block_size == 0) {
+        printf("ums: device reports a block size of zero\n");
+        status = ERR_NOT_SUPPORTED;
+        goto fail;
+    }
 
-    // Need to use READ16/WRITE16 if block addresses are greater than 32 bit
-    msd->use_read_write_16 = msd->total_blocks > UINT32_MAX;
+    uint64_t max_transfer = UMS_MAX_TRANSFER / msd->block_size * msd->block_size;
+    uint64_t max_blocks = ums_get_max_transfer_blocks(msd, inquiry_data);
+    if (max_blocks && max_blocks * msd->block_size < max_transfer) {
+        max_transfer = max_blocks * msd->block_size;
+    }
+    if (max_transfer == 0) {
+        max_transfer = msd->block_size;
+    }
+    msd->max_transfer = max_transfer;
 
     DEBUG_PRINT(("UMS:block size is: 0x%08x\n", msd->block_size));
     DEBUG_PRINT(("UMS:total blocks is: %" PRId64 "\n", msd->total_blocks));
     DEBUG_PRINT(("UMS:total size is: %" PRId64 "\n", msd->total_blocks * msd->block_size));
+    DEBUG_PRINT(("UMS:max transfer is: %u\n", msd->max_transfer));
     msd->device.protocol_id = MX_PROTOCOL_BLOCK;
     status = device_add(&msd->device, msd->udev);
     if (status == NO_ERROR) return NO_ERROR;
@@ -866,11 +925,13 @@ static mx_status_t ums_bind(mx_driver_t* driver, mx_device_t* device, void** coo
         usb_desc_iter_release(&iter);
         return ERR_NOT_SUPPORTED;
     }
+    uint8_t interface_number = intf->bInterfaceNumber;
+    uint8_t bot_alt_setting = intf->bAlternateSetting;
 
     uint8_t bulk_in_addr = 0;
     uint8_t bulk_out_addr = 0;
 
-   usb_endpoint_descriptor_t* endp = usb_desc_iter_next_endpoint(&iter);
+    usb_endpoint_descriptor_t* endp = usb_desc_iter_next_endpoint(&iter);
     while (endp) {
         if (usb_ep_direction(endp) == USB_ENDPOINT_OUT) {
             if (usb_ep_type(endp) == USB_ENDPOINT_BULK) {
@@ -885,6 +946,9 @@ static mx_status_t ums_bind(mx_driver_t* driver, mx_device_t* device, void** coo
         }
         endp = usb_desc_iter_next_endpoint(&iter);
     }
+
+    ums_uas_t uas;
+    ums_uas_probe(&iter, &uas);
     usb_desc_iter_release(&iter);
 
     if (!bulk_in_addr || !bulk_out_addr) {
@@ -898,55 +962,28 @@ static mx_status_t ums_bind(mx_driver_t* driver, mx_device_t* device, void** coo
         return ERR_NO_MEMORY;
     }
 
-    list_initialize(&msd->free_read_reqs);
-    list_initialize(&msd->free_csw_reqs);
-    list_initialize(&msd->free_write_reqs);
+    list_initialize(&msd->free_cmds);
+    list_initialize(&msd->retry_cmds);
+    list_initialize(&msd->internal_txns);
     list_initialize(&msd->queued_iotxns);
-    list_initialize(&msd->completed_reads);
-    list_initialize(&msd->completed_csws);
-    list_initialize(&msd->sync_nodes);
+    mtx_init(&msd->mutex, mtx_plain);
+    completion_signal(&msd->idle);
 
     msd->udev = device;
     msd->driver = driver;
+    msd->interface_number = interface_number;
+    msd->bot_alt_setting = bot_alt_setting;
     msd->bulk_in_addr = bulk_in_addr;
     msd->bulk_out_addr = bulk_out_addr;
-
-    mx_status_t status = NO_ERROR;
-    for (int i = 0; i < READ_REQ_COUNT; i++) {
-        iotxn_t* txn = usb_alloc_iotxn(bulk_in_addr, USB_BUF_SIZE, 0);
-        if (!txn) {
-            status = ERR_NO_MEMORY;
-            goto fail;
-        }
-        txn->complete_cb = ums_read_complete;
-        txn->cookie = msd;
-        list_add_head(&msd->free_read_reqs, &txn->node);
-    }
-    for (int i = 0; i < READ_REQ_COUNT; i++) {
-        iotxn_t* txn = usb_alloc_iotxn(bulk_in_addr, UMS_COMMAND_STATUS_WRAPPER_SIZE, 0);
-        if (!txn) {
-            status = ERR_NO_MEMORY;
-            goto fail;
-        }
-        txn->length = UMS_COMMAND_STATUS_WRAPPER_SIZE;
-        // complete_cb and cookie are set later
-        list_add_head(&msd->free_csw_reqs, &txn->node);
-    }
-    for (int i = 0; i < WRITE_REQ_COUNT; i++) {
-        iotxn_t* txn = usb_alloc_iotxn(bulk_out_addr, USB_BUF_SIZE, 0);
-        if (!txn) {
-            status = ERR_NO_MEMORY;
-            goto fail;
-        }
-        txn->complete_cb = ums_write_complete;
-        txn->cookie = msd;
-        list_add_head(&msd->free_write_reqs, &txn->node);
-    }
+    msd->uas = uas;
+    // enough to read the capacity. the real value is set once we know the block size
+    msd->block_size = 1;
+    msd->max_transfer = UMS_MAX_TRANSFER;
 
     uint8_t lun = 0;
     ums_get_max_lun(msd, (void*)&lun);
     DEBUG_PRINT(("UMS:Max lun is: %02x\n", (unsigned char)lun));
-    msd->tag_send = msd->tag_receive = 8;
+    msd->tag_send = 8;
     // TODO: get this lun from some sort of valid way. not sure how multilun support works
     msd->lun = 0;
     thrd_t thread;
@@ -954,11 +991,6 @@ static mx_status_t ums_bind(mx_driver_t* driver, mx_device_t* device, void** coo
     thrd_detach(thread);
 
     return NO_ERROR;
-
-fail:
-    printf("ums_bind failed: %d\n", status);
-    ums_release(&msd->device);
-    return status;
 }
 
 mx_driver_t _driver_usb_mass_storage = {
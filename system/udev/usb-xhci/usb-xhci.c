@@ -6,12 +6,14 @@
 #include <ddk/device.h>
 #include <ddk/driver.h>
 #include <ddk/io-alloc.h>
+#include <ddk/io-buffer.h>
 #include <ddk/protocol/pci.h>
 #include <ddk/protocol/usb-bus.h>
 #include <ddk/protocol/usb-hci.h>
 #include <ddk/protocol/usb.h>
 
 #include <hw/reg.h>
+#include <magenta/device/usb.h>
 #include <magenta/syscalls.h>
 #include <magenta/types.h>
 #include <stdio.h>
@@ -29,6 +31,10 @@
 
 #define MAX_SLOTS 255
 
+// Buffers in more physically contiguous runs than this are bounced through a
+// contiguous buffer, rather than tying up a large part of the transfer ring.
+#define XHCI_MAX_SG_RUNS (TRANSFER_RING_SIZE / 4)
+
 typedef struct usb_xhci {
     xhci_t xhci;
     // the device we implement
@@ -162,6 +168,24 @@ static mx_status_t xhci_enable_ep(mx_device_t* hci_device, uint32_t device_id,
     return xhci_enable_endpoint(&uxhci->xhci, device_id, ep_desc, enable);
 }
 
+static mx_status_t xhci_enable_stream(mx_device_t* hci_device, uint32_t device_id,
+                                      uint8_t ep_address, uint32_t count) {
+    usb_xhci_t* uxhci = dev_to_usb_xhci(hci_device);
+    return xhci_enable_streams(&uxhci->xhci, device_id, ep_address, count);
+}
+
+static mx_status_t xhci_reset_ep(mx_device_t* hci_device, uint32_t device_id,
+                                 uint8_t ep_address) {
+    usb_xhci_t* uxhci = dev_to_usb_xhci(hci_device);
+    if (xhci_is_root_hub(&uxhci->xhci, device_id)) {
+        return ERR_NOT_SUPPORTED;
+    }
+    if (device_id < 1 || device_id > uxhci->xhci.max_slots) {
+        return ERR_INVALID_ARGS;
+    }
+    return xhci_cancel_transfers(&uxhci->xhci, device_id, xhci_endpoint_index(ep_address));
+}
+
 static uint64_t xhci_get_frame(mx_device_t* hci_device) {
     usb_xhci_t* uxhci = dev_to_usb_xhci(hci_device);
     return xhci_get_current_frame(&uxhci->xhci);
@@ -189,14 +213,31 @@ usb_hci_protocol_t xhci_hci_protocol = {
     .set_bus_device = xhci_set_bus_device,
     .get_max_device_count = xhci_get_max_device_count,
     .enable_endpoint = xhci_enable_ep,
+    .enable_streams = xhci_enable_stream,
+    .reset_endpoint = xhci_reset_ep,
     .get_current_frame = xhci_get_frame,
     .configure_hub = xhci_config_hub,
     .hub_device_added = xhci_hub_device_added,
     .hub_device_removed = xhci_hub_device_removed,
 };
 
+typedef struct {
+    xhci_transfer_context_t context;
+    // contiguous copy of a buffer too fragmented to map directly
+    io_buffer_t bounce;
+    uint8_t direction;
+} xhci_iotxn_context_t;
+
+static void xhci_iotxn_context_free(iotxn_t* txn) {
+    xhci_iotxn_context_t* ctx = txn->context;
+    io_buffer_release(&ctx->bounce);
+    free(ctx);
+    txn->context = NULL;
+}
+
 static void xhci_iotxn_callback(mx_status_t result, void* cookie) {
     iotxn_t* txn = (iotxn_t*)cookie;
+    xhci_iotxn_context_t* ctx = txn->context;
     mx_status_t status;
     size_t actual;
 
@@ -207,8 +248,10 @@ static void xhci_iotxn_callback(mx_status_t result, void* cookie) {
         actual = 0;
         status = result;
     }
-    free(txn->context);
-    txn->context = NULL;
+    if (io_buffer_is_valid(&ctx->bounce) && (ctx->direction == USB_DIR_IN)) {
+        txn->ops->copyto(txn, io_buffer_virt(&ctx->bounce), actual, 0);
+    }
+    xhci_iotxn_context_free(txn);
 
     txn->ops->complete(txn, status, actual);
 }
@@ -226,26 +269,46 @@ static mx_status_t xhci_do_iotxn_queue(xhci_t* xhci, iotxn_t* txn) {
     if (ep_index >= XHCI_NUM_EPS) {
         return ERR_INVALID_ARGS;
     }
-    mx_paddr_t phys_addr;
-    txn->ops->physmap(txn, &phys_addr);
-
-    xhci_transfer_context_t* context = malloc(sizeof(xhci_transfer_context_t));
-    if (!context) {
+    xhci_iotxn_context_t* ctx = calloc(1, sizeof(xhci_iotxn_context_t));
+    if (!ctx) {
         return ERR_NO_MEMORY;
     }
+    ctx->context.callback = xhci_iotxn_callback;
+    ctx->context.data = txn;
+    txn->context = ctx;
 
-    context->callback = xhci_iotxn_callback;
-    context->data = txn;
-    txn->context = context;
     usb_setup_t* setup = (ep_index == 0 ? &data->setup : NULL);
-    uint8_t direction;
     if (setup) {
-        direction = setup->bmRequestType & USB_ENDPOINT_DIR_MASK;
+        ctx->direction = setup->bmRequestType & USB_ENDPOINT_DIR_MASK;
     } else {
-        direction = data->ep_address & USB_ENDPOINT_DIR_MASK;
+        ctx->direction = data->ep_address & USB_ENDPOINT_DIR_MASK;
+    }
+
+    // each physically contiguous run of the buffer becomes one or more data TRBs
+    iotxn_sg_t sg[XHCI_MAX_SG_RUNS];
+    size_t sg_count;
+    mx_status_t status = txn->ops->physmap_sg(txn, 0, txn->length, sg, countof(sg), &sg_count);
+    if (status == ERR_BUFFER_TOO_SMALL) {
+        status = io_buffer_init(&ctx->bounce, txn->length, IO_BUFFER_RW);
+        if (status == NO_ERROR) {
+            if (ctx->direction == USB_DIR_OUT) {
+                txn->ops->copyfrom(txn, io_buffer_virt(&ctx->bounce), txn->length, 0);
+            }
+            sg[0].paddr = io_buffer_phys(&ctx->bounce);
+            sg[0].length = txn->length;
+            sg_count = 1;
+        }
+    }
+    if (status == NO_ERROR) {
+        status = xhci_queue_transfer(xhci, data->device_id, setup, sg, sg_count, txn->length,
+                                     ep_index, ctx->direction, data->frame, data->stream_id,
+                                     &ctx->context, &txn->node);
+    }
+    if (status != NO_ERROR) {
+        // the context is rebuilt if a deferred txn is requeued
+        xhci_iotxn_context_free(txn);
     }
-    return xhci_queue_transfer(xhci, data->device_id, setup, phys_addr, txn->length,
-                               ep_index, direction, data->frame, context, &txn->node);
+    return status;
 }
 
 void xhci_process_deferred_txns(xhci_t* xhci, xhci_transfer_ring_t* ring, bool closed) {
@@ -304,7 +367,32 @@ static mx_status_t xhci_release(mx_device_t* device) {
     return NO_ERROR;
 }
 
+static ssize_t xhci_ioctl(mx_device_t* dev, uint32_t op, const void* in_buf, size_t in_len,
+                          void* out_buf, size_t out_len) {
+    usb_xhci_t* uxhci = dev_to_usb_xhci(dev);
+    xhci_t* xhci = &uxhci->xhci;
+
+    switch (op) {
+    case IOCTL_USB_HCI_SET_IRQ_INTERVAL: {
+        if (in_len != sizeof(uint32_t)) return ERR_INVALID_ARGS;
+        return xhci_set_irq_interval(xhci, *(const uint32_t*)in_buf);
+    }
+    case IOCTL_USB_HCI_GET_STATS: {
+        usb_hci_stats_t* stats = out_buf;
+        if (out_len < sizeof(*stats)) return ERR_BUFFER_TOO_SMALL;
+        memset(stats, 0, sizeof(*stats));
+        stats->irqs = xhci->irqs;
+        stats->events = xhci->events;
+        stats->irq_usec = xhci->imod_interval / 4;
+        return sizeof(*stats);
+    }
+    default:
+        return ERR_NOT_SUPPORTED;
+    }
+}
+
 static mx_protocol_device_t xhci_device_proto = {
+    .ioctl = xhci_ioctl,
     .iotxn_queue = xhci_iotxn_queue,
     .unbind = xhci_unbind,
     .release = xhci_release,
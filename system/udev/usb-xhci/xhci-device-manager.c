@@ -286,6 +286,45 @@ disable_slot_exit:
 }
 
 // returns true if endpoint was enabled
+// takes the pending requests off a ring that is shutting down and adds them to list,
+// so they can be completed outside of the ring's mutex
+static void xhci_close_ring(xhci_transfer_ring_t* ring, list_node_t* list) {
+    list_node_t* node;
+
+    mtx_lock(&ring->mutex);
+    while ((node = list_remove_head(&ring->pending_requests)) != NULL) {
+        list_add_tail(list, node);
+    }
+    ring->enabled = false;
+    mtx_unlock(&ring->mutex);
+}
+
+static void xhci_complete_closed(list_node_t* list) {
+    xhci_transfer_context_t* context;
+    while ((context = list_remove_head_type(list, xhci_transfer_context_t, node)) != NULL) {
+        context->callback(ERR_REMOTE_CLOSED, context->data);
+    }
+}
+
+// completes whatever is left on the stream rings and frees them
+static void xhci_free_streams(xhci_t* xhci, xhci_streams_t* streams) {
+    list_node_t list;
+    list_initialize(&list);
+
+    for (uint32_t i = 0; i < streams->count; i++) {
+        xhci_close_ring(&streams->rings[i], &list);
+    }
+    xhci_complete_closed(&list);
+    for (uint32_t i = 0; i < streams->count; i++) {
+        xhci_process_deferred_txns(xhci, &streams->rings[i], true);
+        xhci_transfer_ring_free(xhci, &streams->rings[i]);
+    }
+    if (streams->contexts) {
+        xhci_free(xhci, (void*)streams->contexts);
+    }
+    free(streams);
+}
+
 static bool xhci_stop_endpoint(xhci_t* xhci, uint32_t slot_id, int ep_index) {
     xhci_slot_t* slot = &xhci->slots[slot_id];
     xhci_transfer_ring_t* transfer_ring = &slot->transfer_rings[ep_index];
@@ -308,27 +347,20 @@ static bool xhci_stop_endpoint(xhci_t* xhci, uint32_t slot_id, int ep_index) {
 
     list_node_t list;
     list_initialize(&list);
-    list_node_t* node;
-
-    mtx_lock(&transfer_ring->mutex);
-
-    // copy pending requests to a different list so we can complete them outside of the mutex
-    while ((node = list_remove_head(&transfer_ring->pending_requests)) != NULL) {
-        list_add_tail(&list, node);
-    }
-    transfer_ring->enabled = false;
-
-    mtx_unlock(&transfer_ring->mutex);
+    xhci_close_ring(transfer_ring, &list);
 
     // complete pending requests
-    xhci_transfer_context_t* context;
-    while ((context = list_remove_head_type(&list, xhci_transfer_context_t, node)) != NULL) {
-        context->callback(ERR_REMOTE_CLOSED, context->data);
-    }
+    xhci_complete_closed(&list);
     // and any deferred requests
     xhci_process_deferred_txns(xhci, transfer_ring, true);
     xhci_transfer_ring_free(xhci, transfer_ring);
 
+    xhci_streams_t* streams = slot->streams[ep_index];
+    if (streams) {
+        slot->streams[ep_index] = NULL;
+        xhci_free_streams(xhci, streams);
+    }
+
     return true;
 }
 
@@ -572,6 +604,149 @@ mx_status_t xhci_enable_endpoint(xhci_t* xhci, uint32_t slot_id, usb_endpoint_de
     return NO_ERROR;
 }
 
+// drops and re-adds an endpoint with a new dequeue pointer, which is either a transfer ring
+// or, when max_pstreams is non-zero, a linear primary stream array of 2^(max_pstreams + 1) entries
+static mx_status_t xhci_reconfigure_endpoint(xhci_t* xhci, uint32_t slot_id, uint32_t index,
+                                             uint32_t max_pstreams, uint64_t tr_dequeue) {
+    xhci_slot_t* slot = &xhci->slots[slot_id];
+    uint8_t* input_context = (uint8_t*)xhci_memalign(xhci, 64, xhci->context_size * (index + 3));
+    if (!input_context) {
+        printf("out of DMA memory!\n");
+        return ERR_NO_MEMORY;
+    }
+    memset(input_context, 0, xhci->context_size * (index + 3));
+
+    xhci_input_control_context_t* icc = (xhci_input_control_context_t*)&input_context[0 * xhci->context_size];
+    xhci_slot_context_t* sc = (xhci_slot_context_t*)&input_context[1 * xhci->context_size];
+    xhci_endpoint_context_t* epc = (xhci_endpoint_context_t*)&input_context[(index + 2) * xhci->context_size];
+    xhci_endpoint_context_t* current = slot->epcs[index];
+
+    XHCI_WRITE32(&icc->drop_context_flags, XHCI_ICC_EP_FLAG(index));
+    XHCI_WRITE32(&icc->add_context_flags, XHCI_ICC_SLOT_FLAG | XHCI_ICC_EP_FLAG(index));
+    XHCI_WRITE32(&sc->sc0, XHCI_READ32(&slot->sc->sc0));
+    XHCI_WRITE32(&sc->sc1, XHCI_READ32(&slot->sc->sc1));
+    XHCI_WRITE32(&sc->sc2, XHCI_READ32(&slot->sc->sc2));
+
+    XHCI_WRITE32(&epc->epc0, XHCI_READ32(&current->epc0));
+    XHCI_WRITE32(&epc->epc1, XHCI_READ32(&current->epc1));
+    XHCI_WRITE32(&epc->epc4, XHCI_READ32(&current->epc4));
+    XHCI_SET_BITS32(&epc->epc0, EP_CTX_EP_STATE_START, EP_CTX_EP_STATE_BITS, 0);
+    XHCI_SET_BITS32(&epc->epc0, EP_CTX_MAX_P_STREAMS_START, EP_CTX_MAX_P_STREAMS_BITS, max_pstreams);
+    if (max_pstreams) {
+        XHCI_WRITE32(&epc->epc0, XHCI_READ32(&epc->epc0) | EP_CTX_LSA);
+        // DCS must be zero when the dequeue pointer is a stream array
+        XHCI_WRITE32(&epc->epc2, (uint32_t)tr_dequeue & EP_CTX_TR_DEQUEUE_LO_MASK);
+    } else {
+        XHCI_WRITE32(&epc->epc0, XHCI_READ32(&epc->epc0) & ~EP_CTX_LSA);
+        XHCI_WRITE32(&epc->epc2, (uint32_t)tr_dequeue);
+    }
+    XHCI_WRITE32(&epc->tr_dequeue_hi, (uint32_t)(tr_dequeue >> 32));
+
+    xhci_sync_command_t command;
+    xhci_sync_command_init(&command);
+    xhci_post_command(xhci, TRB_CMD_CONFIGURE_EP, xhci_virt_to_phys(xhci, (mx_vaddr_t)icc),
+                      (slot_id << TRB_SLOT_ID_START), &command.context);
+    int cc = xhci_sync_command_wait(&command);
+
+    xhci_free(xhci, input_context);
+
+    if (cc != TRB_CC_SUCCESS) {
+        printf("TRB_CMD_CONFIGURE_EP failed cc: %d\n", cc);
+        return ERR_INTERNAL;
+    }
+    return NO_ERROR;
+}
+
+mx_status_t xhci_enable_streams(xhci_t* xhci, uint32_t slot_id, uint8_t ep_address, uint32_t count) {
+    xprintf("xhci_enable_streams slot_id: %d ep: 0x%02X count: %u\n", slot_id, ep_address, count);
+    if (xhci_is_root_hub(xhci, slot_id)) {
+        return ERR_NOT_SUPPORTED;
+    }
+    if (slot_id < 1 || slot_id > xhci->max_slots) return ERR_INVALID_ARGS;
+
+    xhci_slot_t* slot = &xhci->slots[slot_id];
+    uint32_t index = xhci_endpoint_index(ep_address);
+    if (index >= XHCI_NUM_EPS) return ERR_INVALID_ARGS;
+    xhci_transfer_ring_t* transfer_ring = &slot->transfer_rings[index];
+    if (!transfer_ring->enabled) return ERR_BAD_STATE;
+
+    xhci_streams_t* streams = slot->streams[index];
+    if (count == 0) {
+        if (!streams) {
+            return 0;
+        }
+        // back to the endpoint's own ring, which has sat unused since streams were enabled
+        slot->streams[index] = NULL;
+        uint64_t tr_dequeue = xhci_virt_to_phys(xhci, (mx_vaddr_t)transfer_ring->current);
+        mx_status_t status = xhci_reconfigure_endpoint(xhci, slot_id, index, 0,
+                                                       tr_dequeue | transfer_ring->pcs);
+        xhci_free_streams(xhci, streams);
+        return status;
+    }
+    if (streams) {
+        return ERR_BAD_STATE;
+    }
+
+    uint32_t ep_type = XHCI_GET_BITS32(&slot->epcs[index]->epc1, EP_CTX_EP_TYPE_START,
+                                       EP_CTX_EP_TYPE_BITS);
+    if (slot->speed != USB_SPEED_SUPER || xhci->max_psa_size == 0 ||
+        (ep_type != EP_CTX_EP_TYPE_BULK_IN && ep_type != EP_CTX_EP_TYPE_BULK_OUT)) {
+        return ERR_NOT_SUPPORTED;
+    }
+
+    // the stream array has a power of two entries, the first of which is reserved
+    if (count > XHCI_MAX_STREAMS) {
+        count = XHCI_MAX_STREAMS;
+    }
+    uint32_t max_pstreams = 1;
+    while (max_pstreams < xhci->max_psa_size && (1u << (max_pstreams + 1)) < count + 1) {
+        max_pstreams++;
+    }
+    uint32_t entries = 1 << (max_pstreams + 1);
+    if (count > entries - 1) {
+        count = entries - 1;
+    }
+
+    streams = calloc(1, sizeof(xhci_streams_t) + count * sizeof(xhci_transfer_ring_t));
+    if (!streams) {
+        return ERR_NO_MEMORY;
+    }
+    streams->contexts = xhci_memalign(xhci, 64, entries * sizeof(xhci_stream_context_t));
+    if (!streams->contexts) {
+        free(streams);
+        return ERR_NO_MEMORY;
+    }
+    memset((void*)streams->contexts, 0, entries * sizeof(xhci_stream_context_t));
+
+    mx_status_t status = NO_ERROR;
+    for (uint32_t i = 0; i < count; i++) {
+        xhci_transfer_ring_t* ring = &streams->rings[i];
+        status = xhci_transfer_ring_init(xhci, ring, TRANSFER_RING_SIZE);
+        if (status != NO_ERROR) {
+            break;
+        }
+        streams->count++;
+        ring->enabled = true;
+
+        uint64_t tr = xhci_virt_to_phys(xhci, (mx_vaddr_t)ring->start);
+        xhci_stream_context_t* sc = &streams->contexts[i + 1];
+        XHCI_WRITE32(&sc->sc0, ((uint32_t)tr & STREAM_CTX_TR_DEQUEUE_LO_MASK) |
+                               (STREAM_CTX_SCT_PRIMARY_TR << STREAM_CTX_SCT_START) | STREAM_CTX_DCS);
+        XHCI_WRITE32(&sc->sc1, (uint32_t)(tr >> 32));
+    }
+    if (status == NO_ERROR) {
+        status = xhci_reconfigure_endpoint(xhci, slot_id, index, max_pstreams,
+                                           xhci_virt_to_phys(xhci, (mx_vaddr_t)streams->contexts));
+    }
+    if (status != NO_ERROR) {
+        xhci_free_streams(xhci, streams);
+        return status;
+    }
+
+    slot->streams[index] = streams;
+    return count;
+}
+
 mx_status_t xhci_configure_hub(xhci_t* xhci, uint32_t slot_id, usb_speed_t speed,
                                usb_hub_descriptor_t* descriptor) {
     xprintf("xhci_configure_hub slot_id: %d speed: %d\n", slot_id, speed);
@@ -17,5 +17,6 @@ void xhci_start_device_thread(xhci_t* xhci);
 mx_status_t xhci_queue_start_root_hubs(xhci_t* xhci);
 mx_status_t xhci_enable_endpoint(xhci_t* xhci, uint32_t slot_id, usb_endpoint_descriptor_t* ep,
                                  bool enable);
+mx_status_t xhci_enable_streams(xhci_t* xhci, uint32_t slot_id, uint8_t ep_address, uint32_t count);
 mx_status_t xhci_configure_hub(xhci_t* xhci, uint32_t slot_id, usb_speed_t speed,
                                usb_hub_descriptor_t* descriptor);
@@ -270,6 +270,10 @@ typedef volatile struct {
 // Interruptor register bits
 #define IMAN_IP         (1 << 0)    // Interrupt Pending
 #define IMAN_IE         (1 << 1)    // Interrupt Enable
+#define IMODI_START     0           // Interrupt Moderation Interval, in 250ns units
+#define IMODI_BITS      16
+#define IMODC_START     16          // Interrupt Moderation Counter
+#define IMODC_BITS      16
 #define ERSTSZ_MASK     0x0000FFFF
 #define ERDP_DESI_START 0           // First bit of Dequeue ERST Segment Index
 #define ERDP_DESI_BITS  2           // Bit length of Dequeue ERST Segment Index
@@ -460,6 +464,13 @@ typedef volatile struct {
 #define TRB_ENDPOINT_ID_START       16
 #define TRB_ENDPOINT_ID_BITS        5
 
+// Doorbell register bits
+#define DB_STREAM_ID_START          16
+
+// Set TR Dequeue Pointer command (status)
+#define TRB_STREAM_ID_START         16
+#define TRB_STREAM_ID_BITS          16
+
 // Slot context bits (sc0)
 #define SLOT_CTX_ROUTE_STRING_START         0
 #define SLOT_CTX_ROUTE_STRING_BITS          20
@@ -532,6 +543,15 @@ typedef volatile struct {
 #define EP_CTX_DCS                          (1 << 0)
 #define EP_CTX_TR_DEQUEUE_LO_MASK           0xFFFFFFF0
 
+// Stream context bits (sc0)
+#define STREAM_CTX_DCS                      (1 << 0)
+#define STREAM_CTX_SCT_START                1
+#define STREAM_CTX_SCT_BITS                 3
+#define STREAM_CTX_TR_DEQUEUE_LO_MASK       0xFFFFFFF0
+
+// STREAM_CTX_SCT values
+#define STREAM_CTX_SCT_PRIMARY_TR           1
+
 // Endpoint context bits (epc4)
 #define EP_CTX_AVG_TRB_LENGTH_START         0
 #define EP_CTX_AVG_TRB_LENGTH_BITS          16
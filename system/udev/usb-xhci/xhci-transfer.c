@@ -28,11 +28,32 @@ static void print_trb(xhci_t* xhci, xhci_transfer_ring_t* ring, xhci_trb_t* trb)
 // reads a range of bits from an integer
 #define READ_FIELD(i, start, bits) (((i) >> (start)) & ((1 << (bits)) - 1))
 
+// moves a ring's dequeue pointer past the transfers on it. called with the ring's mutex held
+static int xhci_set_tr_dequeue(xhci_t* xhci, uint32_t slot_id, uint32_t endpoint,
+                               xhci_transfer_ring_t* ring, uint16_t stream_id) {
+    xhci_sync_command_t command;
+    xhci_sync_command_init(&command);
+    uint64_t ptr = xhci_virt_to_phys(xhci, (mx_vaddr_t)ring->current);
+    ptr |= ring->pcs;
+    if (stream_id) {
+        ptr |= (STREAM_CTX_SCT_PRIMARY_TR << STREAM_CTX_SCT_START);
+    }
+    // command expects device context index, so increment endpoint by 1
+    uint32_t control = (slot_id << TRB_SLOT_ID_START) | ((endpoint + 1) << TRB_ENDPOINT_ID_START);
+    xhci_post_command_status(xhci, TRB_CMD_SET_TR_DEQUEUE, ptr,
+                             (uint32_t)stream_id << TRB_STREAM_ID_START, control, &command.context);
+    int cc = xhci_sync_command_wait(&command);
+
+    ring->dequeue_ptr = ring->current;
+    return cc;
+}
+
 static mx_status_t xhci_reset_endpoint(xhci_t* xhci, uint32_t slot_id, uint32_t endpoint) {
     xprintf("xhci_reset_endpoint %d %d\n", slot_id, endpoint);
 
     xhci_slot_t* slot = &xhci->slots[slot_id];
     xhci_transfer_ring_t* transfer_ring = &slot->transfer_rings[endpoint];
+    xhci_streams_t* streams = slot->streams[endpoint];
 
     mtx_lock(&transfer_ring->mutex);
 
@@ -49,27 +70,111 @@ static mx_status_t xhci_reset_endpoint(xhci_t* xhci, uint32_t slot_id, uint32_t
         return ERR_INTERNAL;
     }
 
-    // then move transfer ring's dequeue pointer passed the failed transaction
-    xhci_sync_command_init(&command);
-    uint64_t ptr = xhci_virt_to_phys(xhci, (mx_vaddr_t)transfer_ring->current);
-    ptr |= transfer_ring->pcs;
-    // command expects device context index, so increment endpoint by 1
-    control = (slot_id << TRB_SLOT_ID_START) | ((endpoint + 1) << TRB_ENDPOINT_ID_START);
-    xhci_post_command(xhci, TRB_CMD_SET_TR_DEQUEUE, ptr, control, &command.context);
-    cc = xhci_sync_command_wait(&command);
-
-    transfer_ring->dequeue_ptr = transfer_ring->current;
+    // then move transfer ring's dequeue pointer passed the failed transaction.
+    // with streams we cannot tell which stream failed, so we skip ahead on all of them
+    if (streams) {
+        for (uint32_t i = 0; i < streams->count && cc == TRB_CC_SUCCESS; i++) {
+            xhci_transfer_ring_t* ring = &streams->rings[i];
+            mtx_lock(&ring->mutex);
+            cc = xhci_set_tr_dequeue(xhci, slot_id, endpoint, ring, i + 1);
+            mtx_unlock(&ring->mutex);
+        }
+    } else {
+        cc = xhci_set_tr_dequeue(xhci, slot_id, endpoint, transfer_ring, 0);
+    }
 
     mtx_unlock(&transfer_ring->mutex);
 
     return (cc == TRB_CC_SUCCESS ? NO_ERROR : ERR_INTERNAL);
 }
 
-mx_status_t xhci_queue_transfer(xhci_t* xhci, uint32_t slot_id, usb_setup_t* setup, mx_paddr_t data,
-                        uint16_t length, int endpoint, int direction, uint64_t frame,
-                        xhci_transfer_context_t* context, list_node_t* txn_node) {
-    xprintf("xhci_queue_transfer slot_id: %d setup: %p endpoint: %d length: %d\n",
-            slot_id, setup, endpoint, length);
+// takes the pending requests off a ring and skips its dequeue pointer past them.
+// called with the endpoint stopped
+static int xhci_flush_ring(xhci_t* xhci, uint32_t slot_id, uint32_t ep_index,
+                           xhci_transfer_ring_t* ring, uint16_t stream_id, list_node_t* list) {
+    list_node_t* node;
+
+    mtx_lock(&ring->mutex);
+    while ((node = list_remove_head(&ring->pending_requests)) != NULL) {
+        list_add_tail(list, node);
+    }
+    int cc = xhci_set_tr_dequeue(xhci, slot_id, ep_index, ring, stream_id);
+    mtx_unlock(&ring->mutex);
+    return cc;
+}
+
+mx_status_t xhci_cancel_transfers(xhci_t* xhci, uint32_t slot_id, uint32_t ep_index) {
+    xprintf("xhci_cancel_transfers %d %d\n", slot_id, ep_index);
+    if (ep_index == 0 || ep_index >= XHCI_NUM_EPS) {
+        return ERR_INVALID_ARGS;
+    }
+    xhci_slot_t* slot = &xhci->slots[slot_id];
+    xhci_transfer_ring_t* transfer_ring = &slot->transfer_rings[ep_index];
+    if (!transfer_ring->enabled) {
+        return ERR_BAD_STATE;
+    }
+
+    // a halted endpoint is already stopped, but needs resetting before it runs again
+    xhci_sync_command_t command;
+    xhci_sync_command_init(&command);
+    // commands expect device context index, so increment ep_index by 1
+    uint32_t control = (slot_id << TRB_SLOT_ID_START) | ((ep_index + 1) << TRB_ENDPOINT_ID_START);
+    xhci_endpoint_context_t* epc = slot->epcs[ep_index];
+    bool halted = (XHCI_GET_BITS32(&epc->epc0, EP_CTX_EP_STATE_START, EP_CTX_EP_STATE_BITS) == 2);
+    xhci_post_command(xhci, (halted ? TRB_CMD_RESET_ENDPOINT : TRB_CMD_STOP_ENDPOINT), 0, control,
+                      &command.context);
+    int cc = xhci_sync_command_wait(&command);
+    if (cc != TRB_CC_SUCCESS && cc != TRB_CC_CONTEXT_STATE_ERROR) {
+        printf("xhci_cancel_transfers: stopping endpoint failed cc: %d\n", cc);
+        return ERR_INTERNAL;
+    }
+
+    list_node_t list;
+    list_initialize(&list);
+    mx_status_t status = NO_ERROR;
+    xhci_streams_t* streams = slot->streams[ep_index];
+    if (streams) {
+        for (uint32_t i = 0; i < streams->count; i++) {
+            if (xhci_flush_ring(xhci, slot_id, ep_index, &streams->rings[i], i + 1,
+                                &list) != TRB_CC_SUCCESS) {
+                status = ERR_INTERNAL;
+            }
+        }
+    } else if (xhci_flush_ring(xhci, slot_id, ep_index, transfer_ring, 0, &list) != TRB_CC_SUCCESS) {
+        status = ERR_INTERNAL;
+    }
+
+    xhci_transfer_context_t* context;
+    while ((context = list_remove_head_type(&list, xhci_transfer_context_t, node)) != NULL) {
+        context->callback(ERR_REMOTE_CLOSED, context->data);
+    }
+    if (streams) {
+        for (uint32_t i = 0; i < streams->count; i++) {
+            xhci_process_deferred_txns(xhci, &streams->rings[i], true);
+        }
+    } else {
+        xhci_process_deferred_txns(xhci, transfer_ring, true);
+    }
+
+    // the next doorbell restarts the endpoint
+    return status;
+}
+
+// TRB data buffers may not cross a 64K boundary (XHCI spec, section 4.11.7.1)
+#define XHCI_TRB_BOUNDARY (1 << 16)
+
+// returns the length of the next data TRB for a buffer run at addr
+static size_t xhci_trb_length(mx_paddr_t addr, size_t remaining) {
+    size_t to_boundary = XHCI_TRB_BOUNDARY - (addr & (XHCI_TRB_BOUNDARY - 1));
+    return (remaining < to_boundary ? remaining : to_boundary);
+}
+
+mx_status_t xhci_queue_transfer(xhci_t* xhci, uint32_t slot_id, usb_setup_t* setup,
+                                const iotxn_sg_t* sg, size_t sg_count, size_t length,
+                                int endpoint, int direction, uint64_t frame, uint16_t stream_id,
+                                xhci_transfer_context_t* context, list_node_t* txn_node) {
+    xprintf("xhci_queue_transfer slot_id: %d setup: %p endpoint: %d stream: %d length: %zu "
+            "segments: %zu\n", slot_id, setup, endpoint, stream_id, length, sg_count);
 
     if ((setup && endpoint != 0) || (!setup && endpoint == 0)) {
         return ERR_INVALID_ARGS;
@@ -82,6 +187,16 @@ mx_status_t xhci_queue_transfer(xhci_t* xhci, uint32_t slot_id, usb_setup_t* set
     xhci_transfer_ring_t* ring = &slot->transfer_rings[endpoint];
     if (!ring->enabled)
         return ERR_REMOTE_CLOSED;
+    if (stream_id) {
+        xhci_streams_t* streams = slot->streams[endpoint];
+        if (!streams || stream_id > streams->count) {
+            return ERR_INVALID_ARGS;
+        }
+        ring = &streams->rings[stream_id - 1];
+    } else if (slot->streams[endpoint]) {
+        // stream 0 is reserved once an endpoint has streams
+        return ERR_INVALID_ARGS;
+    }
 
     // reset endpoint if it is halted
     xhci_endpoint_context_t* epc = slot->epcs[endpoint];
@@ -90,8 +205,23 @@ mx_status_t xhci_queue_transfer(xhci_t* xhci, uint32_t slot_id, usb_setup_t* set
     }
 
     uint32_t interruptor_target = 0;
-    size_t max_transfer_size = 1 << (XFER_TRB_XFER_LENGTH_BITS - 1);
-    size_t data_packets = (length ? (length + max_transfer_size - 1) / max_transfer_size : 0);
+    // one data TRB per buffer run, split where a run crosses a 64K boundary
+    size_t data_packets = 0;
+    size_t sg_length = 0;
+    for (size_t i = 0; i < sg_count; i++) {
+        mx_paddr_t addr = sg[i].paddr;
+        size_t remaining = sg[i].length;
+        while (remaining > 0) {
+            size_t transfer_size = xhci_trb_length(addr, remaining);
+            addr += transfer_size;
+            remaining -= transfer_size;
+            data_packets++;
+        }
+        sg_length += sg[i].length;
+    }
+    if (sg_length != length) {
+        return ERR_INVALID_ARGS;
+    }
     size_t required_trbs = data_packets + 1;   // add 1 for event data TRB
     if (setup) {
         required_trbs += 2;
@@ -106,12 +236,12 @@ mx_status_t xhci_queue_transfer(xhci_t* xhci, uint32_t slot_id, usb_setup_t* set
     if (ep_type >= 4) ep_type -= 4;
     bool isochronous = (ep_type == USB_ENDPOINT_ISOCHRONOUS);
     if (isochronous) {
-        if (!data || !length) return ERR_INVALID_ARGS;
+        if (sg_count != 1 || !length) return ERR_INVALID_ARGS;
         // we currently do not support isoch buffers that span page boundaries
         // Section 3.2.11 in the XHCI spec describes how to handle this, but since
         // iotxn buffers are always close to the beginning of a page, this shouldn't be necessary.
-        mx_paddr_t start_page = data & ~(xhci->page_size - 1);
-        mx_paddr_t end_page = (data + length - 1) & ~(xhci->page_size - 1);
+        mx_paddr_t start_page = sg[0].paddr & ~(xhci->page_size - 1);
+        mx_paddr_t end_page = (sg[0].paddr + length - 1) & ~(xhci->page_size - 1);
         if (start_page != end_page) {
             printf("isoch buffer spans page boundary in xhci_queue_transfer\n");
             return ERR_INVALID_ARGS;
@@ -172,43 +302,54 @@ mx_status_t xhci_queue_transfer(xhci_t* xhci, uint32_t slot_id, usb_setup_t* set
 
     // Data Stage
     if (length > 0) {
-        size_t remaining = length;
-
-        for (size_t i = 0; i < data_packets; i++) {
-            size_t transfer_size = (remaining > max_transfer_size ? max_transfer_size : remaining);
-            remaining -= transfer_size;
-
-            xhci_trb_t* trb = ring->current;
-            xhci_clear_trb(trb);
-            XHCI_WRITE64(&trb->ptr, data + (i * max_transfer_size));
-            XHCI_SET_BITS32(&trb->status, XFER_TRB_XFER_LENGTH_START, XFER_TRB_XFER_LENGTH_BITS, transfer_size);
-            uint32_t td_size = data_packets - i - 1;
-            XHCI_SET_BITS32(&trb->status, XFER_TRB_TD_SIZE_START, XFER_TRB_TD_SIZE_BITS, td_size);
-            XHCI_SET_BITS32(&trb->status, XFER_TRB_INTR_TARGET_START, XFER_TRB_INTR_TARGET_BITS, interruptor_target);
-
-            uint32_t control_bits = TRB_CHAIN;
-            if (td_size == 0) {
-                control_bits |= XFER_TRB_ENT;
-            }
-            if (setup && i == 0) {
-                // use TRB_TRANSFER_DATA for first data packet on setup requests
-                control_bits |= (direction == USB_DIR_IN ? XFER_TRB_DIR_IN : XFER_TRB_DIR_OUT);
-                trb_set_control(trb, TRB_TRANSFER_DATA, control_bits);
-            } else if (isochronous) {
-                if (frame == 0) {
-                    // set SIA bit to schedule packet ASAP
-                    control_bits |= XFER_TRB_SIA;
+        size_t packet = 0;
+
+        for (size_t i = 0; i < sg_count; i++) {
+            mx_paddr_t addr = sg[i].paddr;
+            size_t remaining = sg[i].length;
+
+            while (remaining > 0) {
+                size_t transfer_size = xhci_trb_length(addr, remaining);
+
+                xhci_trb_t* trb = ring->current;
+                xhci_clear_trb(trb);
+                XHCI_WRITE64(&trb->ptr, addr);
+                XHCI_SET_BITS32(&trb->status, XFER_TRB_XFER_LENGTH_START, XFER_TRB_XFER_LENGTH_BITS, transfer_size);
+                uint32_t td_size = data_packets - packet - 1;
+                // TD size saturates at the width of its field
+                uint32_t td_size_max = (1 << XFER_TRB_TD_SIZE_BITS) - 1;
+                XHCI_SET_BITS32(&trb->status, XFER_TRB_TD_SIZE_START, XFER_TRB_TD_SIZE_BITS,
+                                (td_size > td_size_max ? td_size_max : td_size));
+                XHCI_SET_BITS32(&trb->status, XFER_TRB_INTR_TARGET_START, XFER_TRB_INTR_TARGET_BITS, interruptor_target);
+
+                uint32_t control_bits = TRB_CHAIN;
+                if (td_size == 0) {
+                    control_bits |= XFER_TRB_ENT;
+                }
+                if (setup && packet == 0) {
+                    // use TRB_TRANSFER_DATA for first data packet on setup requests
+                    control_bits |= (direction == USB_DIR_IN ? XFER_TRB_DIR_IN : XFER_TRB_DIR_OUT);
+                    trb_set_control(trb, TRB_TRANSFER_DATA, control_bits);
+                } else if (isochronous) {
+                    if (frame == 0) {
+                        // set SIA bit to schedule packet ASAP
+                        control_bits |= XFER_TRB_SIA;
+                    } else {
+                        // schedule packet for specified frame
+                        control_bits |= (((frame % 2048) << XFER_TRB_FRAME_ID_START) &
+                                         XHCI_MASK(XFER_TRB_FRAME_ID_START, XFER_TRB_FRAME_ID_BITS));
+                   }
+                    trb_set_control(trb, TRB_TRANSFER_ISOCH, control_bits);
                 } else {
-                    // schedule packet for specified frame
-                    control_bits |= (((frame % 2048) << XFER_TRB_FRAME_ID_START) &
-                                     XHCI_MASK(XFER_TRB_FRAME_ID_START, XFER_TRB_FRAME_ID_BITS));
-               }
-                trb_set_control(trb, TRB_TRANSFER_ISOCH, control_bits);
-            } else {
-                trb_set_control(trb, TRB_TRANSFER_NORMAL, control_bits);
+                    trb_set_control(trb, TRB_TRANSFER_NORMAL, control_bits);
+                }
+                print_trb(xhci, ring, trb);
+                xhci_increment_ring(xhci, ring);
+
+                addr += transfer_size;
+                remaining -= transfer_size;
+                packet++;
             }
-            print_trb(xhci, ring, trb);
-            xhci_increment_ring(xhci, ring);
         }
 
         // Follow up with event data TRB
@@ -248,7 +389,7 @@ mx_status_t xhci_queue_transfer(xhci_t* xhci, uint32_t slot_id, usb_setup_t* set
     // update dequeue_ptr to TRB following this transaction
     context->dequeue_ptr = ring->current;
 
-    XHCI_WRITE32(&xhci->doorbells[slot_id], endpoint + 1);
+    XHCI_WRITE32(&xhci->doorbells[slot_id], (endpoint + 1) | ((uint32_t)stream_id << DB_STREAM_ID_START));
 
     mtx_unlock(&ring->mutex);
 
@@ -270,8 +411,10 @@ int xhci_control_request(xhci_t* xhci, uint32_t slot_id, uint8_t request_type, u
     xhci_sync_transfer_t xfer;
     xhci_sync_transfer_init(&xfer);
 
-    mx_status_t result = xhci_queue_transfer(xhci, slot_id, &setup, data, length, 0,
-                                             request_type & USB_DIR_MASK, 0, &xfer.context, NULL);
+    iotxn_sg_t sg = { .paddr = data, .length = length };
+    mx_status_t result = xhci_queue_transfer(xhci, slot_id, &setup, &sg, (length ? 1 : 0), length,
+                                             0, request_type & USB_DIR_MASK, 0, 0, &xfer.context,
+                                             NULL);
     if (result != NO_ERROR)
         return result;
 
@@ -287,6 +430,24 @@ mx_status_t xhci_get_descriptor(xhci_t* xhci, uint32_t slot_id, uint8_t type, ui
                                 USB_REQ_GET_DESCRIPTOR, value, index, phys_addr, length);
 }
 
+// returns the stream ring that context is pending on, or NULL if it has already completed
+static xhci_transfer_ring_t* xhci_find_stream_ring(xhci_streams_t* streams,
+                                                   xhci_transfer_context_t* context) {
+    for (uint32_t i = 0; i < streams->count; i++) {
+        xhci_transfer_ring_t* ring = &streams->rings[i];
+        mtx_lock(&ring->mutex);
+        xhci_transfer_context_t* test;
+        list_for_every_entry(&ring->pending_requests, test, xhci_transfer_context_t, node) {
+            if (test == context) {
+                mtx_unlock(&ring->mutex);
+                return ring;
+            }
+        }
+        mtx_unlock(&ring->mutex);
+    }
+    return NULL;
+}
+
 void xhci_handle_transfer_event(xhci_t* xhci, xhci_trb_t* trb) {
     xprintf("xhci_handle_transfer_event: %08X %08X %08X %08X\n",
             ((uint32_t*)trb)[0], ((uint32_t*)trb)[1], ((uint32_t*)trb)[2], ((uint32_t*)trb)[3]);
@@ -360,6 +521,16 @@ void xhci_handle_transfer_event(xhci_t* xhci, xhci_trb_t* trb) {
         return;
     }
 
+    xhci_streams_t* streams = slot->streams[ep_index];
+    if (streams) {
+        // transfer events do not say which stream they belong to
+        ring = xhci_find_stream_ring(streams, context);
+        if (!ring) {
+            printf("ignoring transfer event for completed transfer\n");
+            return;
+        }
+    }
+
     mtx_lock(&ring->mutex);
 
     // when transaction errors occur, we sometimes receive multiple events for the same transfer.
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include <ddk/iotxn.h>
 #include <magenta/types.h>
 
 #include "xhci.h"
@@ -22,12 +23,17 @@ typedef struct {
     list_node_t node;
 } xhci_transfer_context_t;
 
-mx_status_t xhci_queue_transfer(xhci_t* xhci, uint32_t slot_id, usb_setup_t* setup, mx_paddr_t data,
-                                uint16_t length, int ep, int direction, uint64_t frame,
+// queues a transfer whose data stage gathers from (or scatters to) the
+// sg_count physically contiguous runs in sg, totalling length bytes.
+// stream_id selects the stream ring on endpoints with streams enabled, and must be 0 otherwise
+mx_status_t xhci_queue_transfer(xhci_t* xhci, uint32_t slot_id, usb_setup_t* setup,
+                                const iotxn_sg_t* sg, size_t sg_count, size_t length,
+                                int ep, int direction, uint64_t frame, uint16_t stream_id,
                                 xhci_transfer_context_t* context, list_node_t* txn_node);
 mx_status_t xhci_control_request(xhci_t* xhci, uint32_t slot_id, uint8_t request_type, uint8_t request,
                                  uint16_t value, uint16_t index, mx_paddr_t data, uint16_t length);
-void xhci_cancel_transfers(xhci_t* xhci, xhci_transfer_ring_t* ring);
+// completes all transfers queued on an endpoint (on all of its streams) with ERR_REMOTE_CLOSED
+mx_status_t xhci_cancel_transfers(xhci_t* xhci, uint32_t slot_id, uint32_t ep_index);
 mx_status_t xhci_get_descriptor(xhci_t* xhci, uint32_t slot_id, uint8_t type, uint16_t value,
                                 uint16_t index, void* data, uint16_t length);
 void xhci_handle_transfer_event(xhci_t* xhci, xhci_trb_t* trb);
@@ -157,10 +157,20 @@ mx_status_t xhci_init(xhci_t* xhci, void* mmio) {
                                          HCSPARAMS1_MAX_PORTS_BITS);
     xhci->context_size = (XHCI_READ32(hccparams1) & HCCPARAMS1_CSZ ? 64 : 32);
     xhci->large_esit = !!(XHCI_READ32(hccparams2) & HCCPARAMS2_LEC);
+    xhci->max_psa_size = XHCI_GET_BITS32(hccparams1, HCCPARAMS1_MAX_PSA_SIZE_START,
+                                         HCCPARAMS1_MAX_PSA_SIZE_BITS);
 
     uint32_t scratch_pad_bufs = XHCI_GET_BITS32(hcsparams2, HCSPARAMS2_MAX_SBBUF_HI_START,
                                                 HCSPARAMS2_MAX_SBBUF_HI_BITS);
 
+    // the moderation interval may be given on the command line, in microseconds
+    xhci->imod_interval = XHCI_IMOD_INTERVAL;
+    const char* imod = getenv("xhci.imod");
+    if (imod) {
+        unsigned long usec = strtoul(imod, NULL, 10);
+        xhci->imod_interval = (uint32_t)(usec < XHCI_IMOD_MAX_USEC ? usec : XHCI_IMOD_MAX_USEC) * 4;
+    }
+
     // allocate array to hold our slots
     // add 1 to allow 1-based indexing of slots
     xhci->slots = (xhci_slot_t*)calloc(xhci->max_slots + 1, sizeof(xhci_slot_t));
@@ -274,6 +284,7 @@ static void xhci_interruptor_init(xhci_t* xhci, int interruptor) {
 
     xhci_update_erdp(xhci, interruptor);
 
+    XHCI_WRITE32(&intr_regs->imod, xhci->imod_interval << IMODI_START);
     XHCI_SET32(&intr_regs->iman, IMAN_IE, IMAN_IE);
     XHCI_SET32(&intr_regs->erstsz, ERSTSZ_MASK, ERST_ARRAY_SIZE);
     XHCI_WRITE64(&intr_regs->erstba, xhci_virt_to_phys(xhci,
@@ -327,6 +338,11 @@ void xhci_start(xhci_t* xhci) {
 
 void xhci_post_command(xhci_t* xhci, uint32_t command, uint64_t ptr, uint32_t control_bits,
                        xhci_command_context_t* context) {
+    xhci_post_command_status(xhci, command, ptr, 0, control_bits, context);
+}
+
+void xhci_post_command_status(xhci_t* xhci, uint32_t command, uint64_t ptr, uint32_t status,
+                              uint32_t control_bits, xhci_command_context_t* context) {
     // FIXME - check that command ring is not full?
 
     mtx_lock(&xhci->command_ring.mutex);
@@ -337,7 +353,7 @@ void xhci_post_command(xhci_t* xhci, uint32_t command, uint64_t ptr, uint32_t co
     xhci->command_contexts[index] = context;
 
     XHCI_WRITE64(&trb->ptr, ptr);
-    XHCI_WRITE32(&trb->status, 0);
+    XHCI_WRITE32(&trb->status, status);
     trb_set_control(trb, command, control_bits);
 
     xhci_increment_ring(xhci, cr);
@@ -389,6 +405,7 @@ uint64_t xhci_get_current_frame(xhci_t* xhci) {
 
 static void xhci_handle_events(xhci_t* xhci, int interruptor) {
     xhci_event_ring_t* er = &xhci->event_rings[interruptor];
+    int handled = 0;
 
     // process all TRBs with cycle bit matching our CCS
     while ((XHCI_READ32(&er->current->control) & TRB_C) == er->ccs) {
@@ -411,13 +428,21 @@ static void xhci_handle_events(xhci_t* xhci, int interruptor) {
             break;
         }
 
+        xhci->events++;
         er->current++;
         if (er->current == er->end) {
             er->current = er->start;
             er->ccs ^= TRB_C;
         }
-        xhci_update_erdp(xhci, interruptor);
+        // the controller only sees the space we have freed when ERDP moves, so hand it
+        // back part way through a long batch rather than let the ring fill up
+        if (++handled == EVENT_RING_SIZE / 2) {
+            xhci_update_erdp(xhci, interruptor);
+            handled = 0;
+        }
     }
+    // one ERDP write for the whole batch, which also clears Event Handler Busy
+    xhci_update_erdp(xhci, interruptor);
 }
 
 void xhci_handle_interrupt(xhci_t* xhci, bool legacy) {
@@ -427,6 +452,7 @@ void xhci_handle_interrupt(xhci_t* xhci, bool legacy) {
     uint32_t status = XHCI_READ32(usbsts);
     uint32_t clear = status & USBSTS_CLEAR_BITS;
     XHCI_WRITE32(usbsts, clear);
+    xhci->irqs++;
 
     // If we are in legacy IRQ mode, clear the IP (Interrupt Pending) bit
     // from the IMAN register of our interrupter.
@@ -442,3 +468,15 @@ void xhci_handle_interrupt(xhci_t* xhci, bool legacy) {
         xhci_handle_root_hub_change(xhci);
     }
 }
+
+mx_status_t xhci_set_irq_interval(xhci_t* xhci, uint32_t usec) {
+    if (usec > XHCI_IMOD_MAX_USEC) {
+        return ERR_INVALID_ARGS;
+    }
+    // IMODC is written as zero, so the next interrupt goes out at once and the
+    // new interval counts from there
+    xhci_intr_regs_t* intr_regs = &xhci->runtime_regs->intr_regs[0];
+    xhci->imod_interval = usec * 4;
+    XHCI_WRITE32(&intr_regs->imod, xhci->imod_interval << IMODI_START);
+    return NO_ERROR;
+}
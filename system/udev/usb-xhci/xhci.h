@@ -17,19 +17,42 @@
 #include "xhci-trb.h"
 
 #define COMMAND_RING_SIZE 8
-#define EVENT_RING_SIZE 64
-#define TRANSFER_RING_SIZE 64
+// room for a completion from every TD a busy bulk or streams endpoint can have queued
+#define EVENT_RING_SIZE 256
+// large enough for a 256K transfer scattered across 4K pages
+#define TRANSFER_RING_SIZE 256
 #define ERST_ARRAY_SIZE 1
 
 #define XHCI_RH_USB_2 0 // index of USB 2.0 virtual root hub device
 #define XHCI_RH_USB_3 1 // index of USB 2.0 virtual root hub device
 #define XHCI_RH_COUNT 2 // number of virtual root hub devices
 
+// default interrupter moderation interval, in 250ns units. events arriving within 40us
+// of the last interrupt are handled together by the next one
+#define XHCI_IMOD_INTERVAL 160
+// the interval is set in microseconds, and IMODI holds up to 0xffff 250ns units
+#define XHCI_IMOD_MAX_USEC (0xffff / 4)
+
+// most streams we allocate on one endpoint, each of which has its own transfer ring
+#define XHCI_MAX_STREAMS 64
+
+// transfer rings for an endpoint with streams enabled
+typedef struct xhci_streams {
+    // primary stream array in DMA memory; entry 0 is reserved
+    xhci_stream_context_t* contexts;
+    // streams are numbered 1 to count
+    uint32_t count;
+    // rings[i] is the ring for stream i + 1
+    xhci_transfer_ring_t rings[];
+} xhci_streams_t;
+
 typedef struct xhci_slot {
     xhci_slot_context_t* sc;
     // epcs point into DMA memory past sc
     xhci_endpoint_context_t* epcs[XHCI_NUM_EPS];
     xhci_transfer_ring_t transfer_rings[XHCI_NUM_EPS];
+    // for bulk endpoints with streams enabled, otherwise NULL
+    xhci_streams_t* streams[XHCI_NUM_EPS];
     uint32_t hub_address;
     uint32_t port;
     uint32_t rh_port;
@@ -69,6 +92,8 @@ struct xhci {
     size_t context_size;
     // true if controller supports large ESIT payloads
     bool large_esit;
+    // largest primary stream array is 2^(max_psa_size + 1) entries, zero if no stream support
+    uint32_t max_psa_size;
 
     // total number of ports for the root hub
     uint32_t rh_num_ports;
@@ -105,13 +130,23 @@ struct xhci {
     uint64_t mfindex_wrap_count;
    // time of last mfindex wrap
     mx_time_t last_mfindex_wrap;
+
+    // interrupter moderation interval, in 250ns units
+    uint32_t imod_interval;
+    // counted by the irq thread, for IOCTL_USB_HCI_GET_STATS
+    uint64_t irqs;
+    uint64_t events;
 };
 
 mx_status_t xhci_init(xhci_t* xhci, void* mmio);
 void xhci_start(xhci_t* xhci);
 void xhci_handle_interrupt(xhci_t* xhci, bool legacy);
+mx_status_t xhci_set_irq_interval(xhci_t* xhci, uint32_t usec);
 void xhci_post_command(xhci_t* xhci, uint32_t command, uint64_t ptr, uint32_t control_bits,
                        xhci_command_context_t* context);
+// as above, for commands that also take parameters in the TRB's status field
+void xhci_post_command_status(xhci_t* xhci, uint32_t command, uint64_t ptr, uint32_t status,
+                              uint32_t control_bits, xhci_command_context_t* context);
 void xhci_wait_bits(volatile uint32_t* ptr, uint32_t bits, uint32_t expected);
 
 // returns monotonically increasing frame count
@@ -8,10 +8,13 @@
 #include <hexdump/hexdump.h>
 #include <inttypes.h>
 #include <magenta/compiler.h>
+#include <magenta/new.h>
+#include <magenta/syscalls.h>
 #include <mxtl/auto_lock.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <sys/param.h>
+#include <threads.h>
 
 #include "trace.h"
 #include "utils.h"
@@ -29,6 +32,7 @@
 #define VIRTIO_BLK_F_FLUSH    (1<<9)
 #define VIRTIO_BLK_F_TOPOLOGY (1<<10)
 #define VIRTIO_BLK_F_CONFIG_WCE (1<<11)
+#define VIRTIO_BLK_F_MQ       (1<<12)
 
 #define VIRTIO_BLK_T_IN         0
 #define VIRTIO_BLK_T_OUT        1
@@ -121,6 +125,21 @@ mx_status_t BlockDevice::Init() {
     // reset the device
     Reset();
 
+    // ack and set the driver status bit
+    StatusAcknowledgeDriver();
+
+    // take the features we know how to use
+    uint32_t device_features = ReadFeatures();
+    features_ = device_features & (VIRTIO_BLK_F_SIZE_MAX | VIRTIO_BLK_F_SEG_MAX |
+                                   VIRTIO_BLK_F_GEOMETRY | VIRTIO_BLK_F_BLK_SIZE |
+                                   VIRTIO_BLK_F_TOPOLOGY | VIRTIO_BLK_F_MQ |
+                                   (1u << VIRTIO_RING_F_INDIRECT_DESC) |
+                                   (1u << VIRTIO_RING_F_EVENT_IDX));
+    LTRACEF("device features %#x, driver features %#x\n", device_features, features_);
+    mx_status_t r = WriteFeatures(features_);
+    if (r != NO_ERROR)
+        return r;
+
     // read our configuration
     CopyDeviceConfig(&config_, sizeof(config_));
 
@@ -129,34 +148,31 @@ mx_status_t BlockDevice::Init() {
     LTRACEF("seg_max  %#x\n", config_.seg_max);
     LTRACEF("blk_size %#x\n", config_.blk_size);
 
-    // ack and set the driver status bit
-    StatusAcknowledgeDriver();
-
-    // XXX check features bits and ack/nak them
+    if ((features_ & VIRTIO_BLK_F_SEG_MAX) && config_.seg_max > 0)
+        seg_max_ = MIN(seg_max_, config_.seg_max);
 
-    // allocate the main vring
-    auto err = vring_.Init(0, 128); // 128 matches legacy pci
-    if (err < 0) {
-        VIRTIO_ERROR("failed to allocate vring\n");
-        return err;
+    // one queue per cpu, as far as the device goes
+    uint16_t count = 1;
+    if (features_ & VIRTIO_BLK_F_MQ) {
+        count = (uint16_t)MIN(MIN(config_.num_queues, mx_num_cpus()), blk_queue_max);
+        count = MAX(count, 1);
     }
 
-    // allocate a queue of block requests
-    size_t size = sizeof(virtio_blk_req) * blk_req_count + sizeof(uint8_t) * blk_req_count;
-
-    mx_status_t r = map_contiguous_memory(size, (uintptr_t*)&blk_req_, &blk_req_pa_);
-    if (r < 0) {
-        VIRTIO_ERROR("cannot alloc blk_req buffers %d\n", r);
-        return r;
+    for (uint16_t i = 0; i < count; i++) {
+        AllocChecker ac;
+        queues_[i].reset(new (&ac) Queue(this));
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+        if ((r = InitQueue(queues_[i].get(), i)) != NO_ERROR) {
+            if (i == 0)
+                return r;
+            // run with the queues we have
+            queues_[i].reset();
+            break;
+        }
+        queue_count_ = (uint16_t)(i + 1);
     }
-
-    LTRACEF("allocated blk request at %p, physical address %#" PRIxPTR "\n", blk_req_, blk_req_pa_);
-
-    // responses are 32 words at the end of the allocated block
-    blk_res_pa_ = blk_req_pa_ + sizeof(virtio_blk_req) * blk_req_count;
-    blk_res_ = (uint8_t*)((uintptr_t)blk_req_ + sizeof(virtio_blk_req) * blk_req_count);
-
-    LTRACEF("allocated blk responses at %p, physical address %#" PRIxPTR "\n", blk_res_, blk_res_pa_);
+    LTRACEF("%u queues, %zu segments per request\n", queue_count_, seg_max_);
 
     // start the interrupt thread
     StartIrqThread();
@@ -181,50 +197,139 @@ mx_status_t BlockDevice::Init() {
     return NO_ERROR;
 }
 
+mx_status_t BlockDevice::InitQueue(Queue* q, uint16_t index) {
+    // legacy devices dictate the ring size; modern ones take what we ask for
+    uint16_t size = GetRingSize(index);
+    if (size == 0) {
+        VIRTIO_ERROR("queue %u not available\n", index);
+        return ERR_NOT_FOUND;
+    }
+    if (!trans_)
+        size = MIN(size, blk_ring_max);
+
+    bool indirect = (features_ & (1u << VIRTIO_RING_F_INDIRECT_DESC)) != 0;
+    if (!indirect)
+        seg_max_ = MIN(seg_max_, (size_t)size - 2);
+
+    AllocChecker ac;
+    q->head_req.reset(new (&ac) uint8_t[size]);
+    if (!ac.check())
+        return ERR_NO_MEMORY;
+
+    auto err = q->ring.Init(index, size, (features_ & (1u << VIRTIO_RING_F_EVENT_IDX)) != 0);
+    if (err < 0) {
+        VIRTIO_ERROR("failed to allocate vring %u\n", index);
+        return err;
+    }
+
+    // allocate the block requests: indirect tables first to keep them
+    // aligned, then the request headers, then the status bytes
+    size_t indirect_size = indirect ? sizeof(vring_desc) * blk_indirect_count * blk_req_count : 0;
+    size_t size_bytes = indirect_size + sizeof(virtio_blk_req) * blk_req_count +
+                        sizeof(uint8_t) * blk_req_count;
+
+    uintptr_t va;
+    mx_paddr_t pa;
+    mx_status_t r = map_contiguous_memory(size_bytes, &va, &pa);
+    if (r < 0) {
+        VIRTIO_ERROR("cannot alloc blk_req buffers %d\n", r);
+        return r;
+    }
+
+    if (indirect) {
+        q->indirect = (vring_desc*)va;
+        q->indirect_pa = pa;
+    }
+    q->req = (virtio_blk_req*)(va + indirect_size);
+    q->req_pa = pa + indirect_size;
+    q->res = (uint8_t*)((uintptr_t)q->req + sizeof(virtio_blk_req) * blk_req_count);
+    q->res_pa = q->req_pa + sizeof(virtio_blk_req) * blk_req_count;
+
+    LTRACEF("queue %u: ring size %u, blk requests at %p, physical address %#" PRIxPTR "\n",
+            index, size, q->req, q->req_pa);
+
+    return NO_ERROR;
+}
+
+// a submitting thread stays on one queue, which keeps its requests in order
+// and spreads independent submitters across the device's queues
+BlockDevice::Queue* BlockDevice::SelectQueue() {
+    if (queue_count_ == 1)
+        return queues_[0].get();
+
+    uint64_t id = (uint64_t)(uintptr_t)thrd_current();
+    id *= 0x9e3779b97f4a7c15ull;
+    return queues_[(id >> 32) % queue_count_].get();
+}
+
+void BlockDevice::CompleteTxns(list_node* list) {
+    iotxn_t* txn;
+    while ((txn = list_remove_head_type(list, iotxn_t, node)) != nullptr) {
+        txn->ops->complete(txn, txn->status, txn->actual);
+    }
+}
+
 void BlockDevice::IrqRingUpdate() {
     LTRACE_ENTRY;
 
+    // there is one interrupt for the device, so look at every queue
+    for (uint16_t i = 0; i < queue_count_; i++) {
+        QueueRingUpdate(queues_[i].get());
+    }
+}
+
+void BlockDevice::QueueRingUpdate(Queue* q) {
+    list_node done = LIST_INITIAL_VALUE(done);
+
+    q->lock.Acquire();
+
     // parse our descriptor chain, add back to the free queue
-    auto free_chain = [this](vring_used_elem* used_elem) {
-        uint32_t i = (uint16_t)used_elem->id;
-        struct vring_desc* desc = vring_.DescFromIndex((uint16_t)i);
-        auto head_desc = desc; // save the first element
-        for (;;) {
-            int next;
+    auto free_chain = [q, &done](vring_used_elem* used_elem) {
+        uint16_t head = (uint16_t)used_elem->id;
 
 #if LOCAL_TRACE > 0
-            virtio_dump_desc(desc);
+        virtio_dump_desc(q->ring.DescFromIndex(head));
 #endif
+        q->ring.FreeDescChain(head);
 
-            if (desc->flags & VRING_DESC_F_NEXT) {
-                next = desc->next;
-            } else {
-                /* end of chain */
-                next = -1;
-            }
-
-            vring_.FreeDesc((uint16_t)i);
+        unsigned int index = q->head_req[head];
+        iotxn_t* txn = q->req_txn[index];
+        q->req_txn[index] = nullptr;
 
-            if (next < 0)
+        // a split txn takes the first error of any of its requests
+        if (txn->status == NO_ERROR) {
+            switch (q->res[index]) {
+            case VIRTIO_BLK_S_OK:
                 break;
-            i = next;
-            desc = vring_.DescFromIndex((uint16_t)i);
-        }
-
-        // search our pending txn list to see if this completes it
-        iotxn_t* txn;
-        list_for_every_entry (&iotxn_list, txn, iotxn_t, node) {
-            if (txn->context == head_desc) {
-                LTRACEF("completes txn %p\n", txn);
-                list_delete(&txn->node);
-                txn->ops->complete(txn, NO_ERROR, txn->length);
+            case VIRTIO_BLK_S_UNSUPP:
+                txn->status = ERR_NOT_SUPPORTED;
+                break;
+            default:
+                txn->status = ERR_IO;
                 break;
             }
         }
+        q->free_req(index);
+
+        if (q->txn_busy(txn))
+            return;
+        txn->actual = (txn->status == NO_ERROR) ? txn->length : 0;
+        LTRACEF("completes txn %p status %d\n", txn, txn->status);
+        list_add_tail(&done, &txn->node);
     };
 
     // tell the ring to find free chains and hand it back to our lambda
-    vring_.IrqRingUpdate(free_chain);
+    q->ring.IrqRingUpdate(free_chain);
+
+    // descriptors were returned; start anything that was waiting on them,
+    // with a single notification for the lot
+    StartPendingTxns(q, &done);
+    q->ring.KickIfNeeded();
+
+    q->lock.Release();
+
+    // completion callbacks may queue more work, so run them unlocked
+    CompleteTxns(&done);
 }
 
 void BlockDevice::IrqConfigChange() {
@@ -234,10 +339,6 @@ void BlockDevice::IrqConfigChange() {
 void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
     LTRACEF("txn %p\n", txn);
 
-    mxtl::AutoLock lock(lock_);
-
-    bool write = (txn->opcode == IOTXN_OP_WRITE);
-
     // offset must be aligned to block size
     if (txn->offset % config_.blk_size) {
         TRACEF("offset %#" PRIx64 " is not aligned to sector size %u!\n", txn->offset, config_.blk_size);
@@ -246,28 +347,164 @@ void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
     }
 
     // constrain to device capacity
+    if (txn->offset >= GetSize()) {
+        txn->ops->complete(txn, NO_ERROR, 0);
+        return;
+    }
     txn->length = MIN(txn->length, GetSize() - txn->offset);
 
-    // allocate and start filling out a block request
-    auto index = alloc_blk_req();
-    LTRACEF("request index %u\n", index);
-    auto req = &blk_req_[index];
+    Queue* q = SelectQueue();
+    q->lock.Acquire();
+
+    // preserve ordering behind anything already waiting for descriptors
+    if (!list_is_empty(&q->pending_txn_list)) {
+        list_add_tail(&q->pending_txn_list, &txn->node);
+        q->lock.Release();
+        return;
+    }
+
+    auto status = StartTxn(q, txn);
+    if (status == ERR_SHOULD_WAIT) {
+        list_add_tail(&q->pending_txn_list, &txn->node);
+    } else if (status == NO_ERROR) {
+        q->ring.KickIfNeeded();
+    }
+    q->lock.Release();
+
+    if (status != NO_ERROR && status != ERR_SHOULD_WAIT) {
+        txn->ops->complete(txn, status, 0);
+    }
+}
+
+// start txns deferred for lack of ring descriptors, in order; any which
+// cannot be started at all are moved to |failed|
+void BlockDevice::StartPendingTxns(Queue* q, list_node* failed) {
+    iotxn_t* txn;
+    while ((txn = list_peek_head_type(&q->pending_txn_list, iotxn_t, node)) != nullptr) {
+        list_delete(&txn->node);
+        auto status = StartTxn(q, txn);
+        if (status == ERR_SHOULD_WAIT) {
+            list_add_head(&q->pending_txn_list, &txn->node);
+            return;
+        }
+        if (status != NO_ERROR) {
+            txn->status = status;
+            txn->actual = 0;
+            list_add_tail(failed, &txn->node);
+        }
+    }
+}
+
+// submit a txn, starting |q->partial| bytes in. a txn in more physically
+// contiguous runs than one request can carry is split across several, and
+// completes when the last of them does. returns ERR_SHOULD_WAIT if the queue
+// ran out of descriptors or request slots first; the txn is then kept at the
+// head of the pending list, with |q->partial| recording how far it got. the
+// caller notifies the device.
+mx_status_t BlockDevice::StartTxn(Queue* q, iotxn_t* txn) {
+    if (q->partial == 0)
+        txn->status = NO_ERROR;
+
+    while (q->partial < txn->length) {
+        mx_off_t offset = q->partial;
+        mx_off_t length = txn->length - offset;
+
+        // gather the txn's pages directly; no bounce buffer
+        iotxn_sg_t sg[blk_seg_max];
+        size_t sg_count;
+        auto status = txn->ops->physmap_sg(txn, offset, length, sg, seg_max_, &sg_count);
+        if (status == ERR_BUFFER_TOO_SMALL) {
+            // a page per run, plus one for a misaligned start, always fits;
+            // halve from there for devices with tiny seg_max
+            length = MIN(length, MAX(seg_max_ - 1, (size_t)1) * PAGE_SIZE);
+            for (;;) {
+                if (length > config_.blk_size)
+                    length -= length % config_.blk_size;
+                status = txn->ops->physmap_sg(txn, offset, length, sg, seg_max_, &sg_count);
+                if ((status != ERR_BUFFER_TOO_SMALL) || (length <= config_.blk_size))
+                    break;
+                length /= 2;
+            }
+        }
+        if (status != NO_ERROR) {
+            TRACEF("cannot map txn %p offset %#" PRIx64 " length %#" PRIx64 ": %d\n",
+                   txn, offset, length, status);
+            q->partial = 0;
+            if (offset == 0)
+                return status;
+            // requests still in flight complete the txn, with this error
+            txn->status = status;
+            return q->txn_busy(txn) ? NO_ERROR : status;
+        }
+
+        status = StartRequest(q, txn, offset, sg, sg_count);
+        if (status != NO_ERROR)
+            return status;
+        q->partial += length;
+    }
+    q->partial = 0;
+    return NO_ERROR;
+}
+
+// build and submit the descriptor chain for one request, covering the runs
+// in |sg| at |offset| into the txn; returns ERR_SHOULD_WAIT if the queue does
+// not currently have enough free descriptors or request slots.
+mx_status_t BlockDevice::StartRequest(Queue* q, iotxn_t* txn, mx_off_t offset,
+                                      const iotxn_sg_t* sg, size_t sg_count) {
+    bool write = (txn->opcode == IOTXN_OP_WRITE);
+
+    // large scatter lists go in an indirect table so that they take a
+    // single ring descriptor
+    bool indirect = (q->indirect != nullptr) && (sg_count > 1);
+
+    int index = q->alloc_req();
+    if (index < 0) {
+        LTRACEF("out of requests\n");
+        return ERR_SHOULD_WAIT;
+    }
+
+    /* put together a transfer: header, data segments, status */
+    uint16_t i;
+    auto head = q->ring.AllocDescChain(indirect ? 1 : (uint16_t)(sg_count + 2), &i);
+    if (head == nullptr) {
+        LTRACEF("out of descriptors for %zu segments\n", sg_count);
+        q->free_req(index);
+        return ERR_SHOULD_WAIT;
+    }
+    LTRACEF("after alloc chain desc %p, i %u\n", head, i);
+
+    // fill out the block request
+    LTRACEF("request index %d\n", index);
+    auto req = &q->req[index];
     req->type = write ? VIRTIO_BLK_T_OUT : VIRTIO_BLK_T_IN;
     req->ioprio = 0;
-    req->sector = txn->offset / 512;
+    req->sector = (txn->offset + offset) / 512;
+    q->res[index] = VIRTIO_BLK_S_IOERR;
     LTRACEF("blk_req type %u ioprio %u sector %" PRIu64 "\n",
             req->type, req->ioprio, req->sector);
 
-    /* put together a transfer */
-    uint16_t i;
-    auto desc = vring_.AllocDescChain(3, &i);
-    LTRACEF("after alloc chain desc %p, i %u\n", desc, i);
+    /* point the ring descriptor at the indirect table, if we have one */
+    vring_desc* desc = head;
+    if (indirect) {
+        vring_desc* table = &q->indirect[index * blk_indirect_count];
+        head->addr = q->indirect_pa + index * blk_indirect_count * sizeof(vring_desc);
+        head->len = (uint32_t)((sg_count + 2) * sizeof(vring_desc));
+        head->flags = VRING_DESC_F_INDIRECT;
 
-    /* point the iotxn at this head descriptor */
-    txn->context = desc;
+#if LOCAL_TRACE > 0
+        virtio_dump_desc(head);
+#endif
+
+        // table entries are chained in order
+        for (size_t n = 0; n < sg_count + 2; n++) {
+            table[n].flags = VRING_DESC_F_NEXT;
+            table[n].next = (uint16_t)(n + 1);
+        }
+        desc = table;
+    }
 
     /* set up the descriptor pointing to the head */
-    desc->addr = blk_req_pa_ + index * sizeof(virtio_blk_req);
+    desc->addr = q->req_pa + index * sizeof(virtio_blk_req);
     desc->len = sizeof(struct virtio_blk_req);
     desc->flags |= VRING_DESC_F_NEXT;
 
@@ -275,26 +512,25 @@ void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
     virtio_dump_desc(desc);
 #endif
 
-    /* set up the descriptor pointing to the buffer */
-    desc = vring_.DescFromIndex(desc->next);
+    /* set up a descriptor for each physically contiguous run of the buffer */
+    for (size_t n = 0; n < sg_count; n++) {
+        desc = indirect ? desc + 1 : q->ring.DescFromIndex(desc->next);
 
-    mx_paddr_t pa;
-    txn->ops->physmap(txn, &pa);
-
-    desc->addr = (uint64_t)pa;
-    desc->len = (uint32_t)txn->length;
+        desc->addr = (uint64_t)sg[n].paddr;
+        desc->len = (uint32_t)sg[n].length;
 
-    if (!write)
-        desc->flags |= VRING_DESC_F_WRITE; /* mark buffer as write-only if its a block read */
-    desc->flags |= VRING_DESC_F_NEXT;
+        if (!write)
+            desc->flags |= VRING_DESC_F_WRITE; /* mark buffer as write-only if its a block read */
+        desc->flags |= VRING_DESC_F_NEXT;
 
 #if LOCAL_TRACE > 0
-    virtio_dump_desc(desc);
+        virtio_dump_desc(desc);
 #endif
+    }
 
     /* set up the descriptor pointing to the response */
-    desc = vring_.DescFromIndex(desc->next);
-    desc->addr = blk_res_pa_ + index;
+    desc = indirect ? desc + 1 : q->ring.DescFromIndex(desc->next);
+    desc->addr = q->res_pa + index;
     desc->len = 1;
     desc->flags = VRING_DESC_F_WRITE;
 
@@ -302,14 +538,14 @@ void BlockDevice::QueueReadWriteTxn(iotxn_t* txn) {
     virtio_dump_desc(desc);
 #endif
 
-    // save the iotxn in a list
-    list_add_tail(&iotxn_list, &txn->node);
+    // remember which txn this chain belongs to
+    q->head_req[i] = (uint8_t)index;
+    q->req_txn[index] = txn;
 
     /* submit the transfer */
-    vring_.SubmitChain(i);
+    q->ring.SubmitChain(i);
 
-    /* kick it off */
-    vring_.Kick();
+    return NO_ERROR;
 }
 
 } // namespace virtio
@@ -7,6 +7,8 @@
 #include "ring.h"
 
 #include <magenta/compiler.h>
+#include <mxtl/mutex.h>
+#include <mxtl/unique_ptr.h>
 #include <stdlib.h>
 
 namespace virtio {
@@ -34,10 +36,17 @@ private:
     static ssize_t virtio_block_ioctl(mx_device_t* dev, uint32_t op, const void* in_buf, size_t in_len,
                                       void* out_buf, size_t out_len);
 
-    void QueueReadWriteTxn(iotxn_t* txn);
+    struct Queue;
 
-    // the main virtio ring
-    Ring vring_ = {this};
+    void QueueReadWriteTxn(iotxn_t* txn);
+    Queue* SelectQueue();
+    mx_status_t InitQueue(Queue* q, uint16_t index);
+    mx_status_t StartTxn(Queue* q, iotxn_t* txn);
+    mx_status_t StartRequest(Queue* q, iotxn_t* txn, mx_off_t offset,
+                             const iotxn_sg_t* sg, size_t sg_count);
+    void StartPendingTxns(Queue* q, list_node* failed);
+    void QueueRingUpdate(Queue* q);
+    static void CompleteTxns(list_node* list);
 
     // saved block device configuration out of the pci config BAR
     struct virtio_blk_config {
@@ -50,6 +59,15 @@ private:
             uint8_t sectors;
         } geometry;
         uint32_t blk_size;
+        struct virtio_blk_topology {
+            uint8_t physical_block_exp;
+            uint8_t alignment_offset;
+            uint16_t min_io_size;
+            uint32_t opt_io_size;
+        } topology;
+        uint8_t writeback;
+        uint8_t unused0;
+        uint16_t num_queues;
     } config_ __PACKED = {};
 
     struct virtio_blk_req {
@@ -58,29 +76,81 @@ private:
         uint64_t sector;
     } __PACKED;
 
-    // a queue of block request/responses
-    static const size_t blk_req_count = 32;
-
-    mx_paddr_t blk_req_pa_ = 0;
-    virtio_blk_req* blk_req_ = nullptr;
-
-    mx_paddr_t blk_res_pa_ = 0;
-    uint8_t* blk_res_ = nullptr;
-
-    uint32_t blk_req_bitmap_ = 0;
-
-    unsigned int alloc_blk_req() {
-        unsigned int i = 31 - __builtin_clz(blk_req_bitmap_);
-        blk_req_bitmap_ |= (1 << i);
-        return i;
-    }
-
-    void free_blk_req(unsigned int i) {
-        blk_req_bitmap_ &= ~(1 << i);
-    }
-
-    // pending iotxns
-    list_node iotxn_list = LIST_INITIAL_VALUE(iotxn_list);
+    // block requests in flight per queue
+    static const size_t blk_req_count = 64;
+
+    // maximum data descriptors in a single request
+    static const size_t blk_seg_max = 64;
+
+    // an indirect table holds the header, the data segments and the status
+    static const size_t blk_indirect_count = blk_seg_max + 2;
+
+    // upper bound on virtqueues and on the ring size asked of modern devices
+    static const size_t blk_queue_max = 16;
+    static const uint16_t blk_ring_max = 1024;
+
+    // one virtqueue and its request state; each has its own lock so that
+    // submitters on different queues do not contend
+    struct Queue {
+        Queue(Device* device)
+            : ring(device) {}
+
+        Ring ring;
+        mxtl::Mutex lock;
+
+        // request headers, status bytes and (if negotiated) indirect
+        // descriptor tables, one of each per request slot
+        mx_paddr_t req_pa = 0;
+        virtio_blk_req* req = nullptr;
+        mx_paddr_t res_pa = 0;
+        uint8_t* res = nullptr;
+        mx_paddr_t indirect_pa = 0;
+        vring_desc* indirect = nullptr;
+
+        uint64_t req_bitmap = 0;
+        iotxn_t* req_txn[blk_req_count] = {};
+
+        // request slot for each descriptor chain head
+        mxtl::unique_ptr<uint8_t[]> head_req;
+
+        // iotxns waiting for ring descriptors or request slots
+        list_node pending_txn_list = LIST_INITIAL_VALUE(pending_txn_list);
+        // bytes of the txn at the head of the pending list already submitted
+        mx_off_t partial = 0;
+
+        int alloc_req() {
+            if (req_bitmap == ~0ull)
+                return -1;
+            int i = __builtin_ctzll(~req_bitmap);
+            req_bitmap |= (1ull << i);
+            return i;
+        }
+
+        void free_req(unsigned int i) {
+            req_bitmap &= ~(1ull << i);
+        }
+
+        // a txn split across several requests is done once none of them is
+        // in flight and the rest of it is not waiting to be submitted
+        bool txn_busy(iotxn_t* txn) {
+            if (list_peek_head(&pending_txn_list) == &txn->node)
+                return true;
+            for (size_t i = 0; i < blk_req_count; i++) {
+                if (req_txn[i] == txn)
+                    return true;
+            }
+            return false;
+        }
+    };
+
+    mxtl::unique_ptr<Queue> queues_[blk_queue_max];
+    uint16_t queue_count_ = 0;
+
+    // negotiated feature bits
+    uint32_t features_ = 0;
+
+    // data segments per request, limited by the device and the ring
+    size_t seg_max_ = blk_seg_max;
 };
 
 } // namespace virtio
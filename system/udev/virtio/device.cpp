@@ -274,6 +274,22 @@ mx_status_t Device::CopyDeviceConfig(void* _buf, size_t len) {
     return NO_ERROR;
 }
 
+uint16_t Device::GetRingSize(uint16_t index) {
+    if (trans_) {
+        if (bar0_pio_base_) {
+            outpw((bar0_pio_base_ + VIRTIO_PCI_QUEUE_SELECT) & 0xffff, index);
+            return inpw((bar0_pio_base_ + VIRTIO_PCI_QUEUE_SIZE) & 0xffff);
+        } else {
+            // XXX implement
+            assert(0);
+            return 0;
+        }
+    } else {
+        mmio_regs_.common_config->queue_select = index;
+        return mmio_regs_.common_config->queue_size;
+    }
+}
+
 void Device::SetRing(uint16_t index, uint16_t count, mx_paddr_t pa_desc, mx_paddr_t pa_avail, mx_paddr_t pa_used) {
     LTRACEF("index %u, count %u, pa_desc %#" PRIxPTR ", pa_avail %#" PRIxPTR ", pa_used %#" PRIxPTR "\n",
             index, count, pa_desc, pa_avail, pa_used);
@@ -331,6 +347,49 @@ void Device::StatusAcknowledgeDriver() {
     }
 }
 
+uint32_t Device::ReadFeatures() {
+    if (trans_) {
+        if (bar0_pio_base_) {
+            return inpd((bar0_pio_base_ + VIRTIO_PCI_DEVICE_FEATURES) & 0xffff);
+        } else {
+            // XXX implement
+            assert(0);
+            return 0;
+        }
+    } else {
+        mmio_regs_.common_config->device_feature_select = 0;
+        return mmio_regs_.common_config->device_feature;
+    }
+}
+
+mx_status_t Device::WriteFeatures(uint32_t features) {
+    LTRACEF("features %#x\n", features);
+
+    if (trans_) {
+        if (bar0_pio_base_) {
+            outpd((bar0_pio_base_ + VIRTIO_PCI_DRIVER_FEATURES) & 0xffff, features);
+        } else {
+            // XXX implement
+            assert(0);
+        }
+        // legacy devices have no FEATURES_OK handshake
+        return NO_ERROR;
+    }
+
+    mmio_regs_.common_config->driver_feature_select = 0;
+    mmio_regs_.common_config->driver_feature = features;
+    mmio_regs_.common_config->driver_feature_select = 1;
+    mmio_regs_.common_config->driver_feature = VIRTIO_F_VERSION_1_HI;
+    mmio_regs_.common_config->device_status |= VIRTIO_STATUS_FEATURES_OK;
+
+    // the device clears FEATURES_OK if it cannot operate with this subset
+    if (!(mmio_regs_.common_config->device_status & VIRTIO_STATUS_FEATURES_OK)) {
+        VIRTIO_ERROR("device rejected features %#x\n", features);
+        return ERR_NOT_SUPPORTED;
+    }
+    return NO_ERROR;
+}
+
 void Device::StatusDriverOK() {
     if (trans_) {
         uint8_t val = ReadConfigBar(VIRTIO_PCI_DEVICE_STATUS);
@@ -35,6 +35,7 @@ public:
     virtual void IrqConfigChange() {}
 
     // used by Ring class to manipulate config registers
+    uint16_t GetRingSize(uint16_t index);
     void SetRing(uint16_t index, uint16_t count, mx_paddr_t pa_desc, mx_paddr_t pa_avail, mx_paddr_t pa_used);
     void RingKick(uint16_t ring_index);
 
@@ -48,6 +49,10 @@ protected:
     void StatusAcknowledgeDriver();
     void StatusDriverOK();
 
+    // feature negotiation; only the low 32 feature bits are used
+    uint32_t ReadFeatures();
+    mx_status_t WriteFeatures(uint32_t features);
+
     static int IrqThreadEntry(void* arg);
     void IrqWorker();
 
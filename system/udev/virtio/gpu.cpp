@@ -74,6 +74,15 @@ void GpuDevice::virtio_gpu_flush(mx_device_t* dev) {
     gd->Flush();
 }
 
+void GpuDevice::virtio_gpu_flush_region(mx_device_t* dev, uint32_t x, uint32_t y,
+                                        uint32_t width, uint32_t height) {
+    GpuDevice* gd = static_cast<GpuDevice*>(dev->ctx);
+
+    LTRACEF("dev %p, x %u y %u w %u h %u\n", gd, x, y, width, height);
+
+    gd->FlushRegion(x, y, width, height);
+}
+
 GpuDevice::GpuDevice(mx_driver_t* driver, mx_device_t* bus_device)
     : Device(driver, bus_device) {
 
@@ -266,8 +275,9 @@ mx_status_t GpuDevice::set_scanout(uint32_t scanout_id, uint32_t resource_id, ui
     return err;
 }
 
-mx_status_t GpuDevice::flush_resource(uint32_t resource_id, uint32_t width, uint32_t height) {
-    LTRACEF("dev %p, resource_id %u, width %u, height %u\n", this, resource_id, width, height);
+mx_status_t GpuDevice::flush_resource(uint32_t resource_id, const virtio_gpu_rect& r) {
+    LTRACEF("dev %p, resource_id %u, x %u y %u w %u h %u\n", this, resource_id,
+            r.x, r.y, r.width, r.height);
 
     /* grab a lock to keep this single message at a time */
     mxtl::AutoLock lock(request_lock_);
@@ -277,9 +287,7 @@ mx_status_t GpuDevice::flush_resource(uint32_t resource_id, uint32_t width, uint
     memset(&req, 0, sizeof(req));
 
     req.hdr.type = VIRTIO_GPU_CMD_RESOURCE_FLUSH;
-    req.r.x = req.r.y = 0;
-    req.r.width = width;
-    req.r.height = height;
+    req.r = r;
     req.resource_id = resource_id;
 
     /* send the command and get a response */
@@ -294,8 +302,9 @@ mx_status_t GpuDevice::flush_resource(uint32_t resource_id, uint32_t width, uint
     return err;
 }
 
-mx_status_t GpuDevice::transfer_to_host_2d(uint32_t resource_id, uint32_t width, uint32_t height) {
-    LTRACEF("dev %p, resource_id %u, width %u, height %u\n", this, resource_id, width, height);
+mx_status_t GpuDevice::transfer_to_host_2d(uint32_t resource_id, const virtio_gpu_rect& r) {
+    LTRACEF("dev %p, resource_id %u, x %u y %u w %u h %u\n", this, resource_id,
+            r.x, r.y, r.width, r.height);
 
     /* grab a lock to keep this single message at a time */
     mxtl::AutoLock lock(request_lock_);
@@ -305,10 +314,9 @@ mx_status_t GpuDevice::transfer_to_host_2d(uint32_t resource_id, uint32_t width,
     memset(&req, 0, sizeof(req));
 
     req.hdr.type = VIRTIO_GPU_CMD_TRANSFER_TO_HOST_2D;
-    req.r.x = req.r.y = 0;
-    req.r.width = width;
-    req.r.height = height;
-    req.offset = 0;
+    req.r = r;
+    // where the rectangle starts in the backing store
+    req.offset = ((uint64_t)r.y * pmode_.r.width + r.x) * 4;
     req.resource_id = resource_id;
 
     /* send the command and get a response */
@@ -324,35 +332,103 @@ mx_status_t GpuDevice::transfer_to_host_2d(uint32_t resource_id, uint32_t width,
 }
 
 void GpuDevice::Flush() {
+    FlushRegion(0, 0, pmode_.r.width, pmode_.r.height);
+}
+
+void GpuDevice::FlushRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+    // clip to the display
+    if (x >= pmode_.r.width || y >= pmode_.r.height)
+        return;
+    width = MIN(width, pmode_.r.width - x);
+    height = MIN(height, pmode_.r.height - y);
+    if (width == 0 || height == 0)
+        return;
+
     mxtl::AutoLock al(flush_lock_);
-    flush_pending_ = true;
+    AddDamageLocked({x, y, width, height});
     cnd_signal(&flush_cond_);
 }
 
+static virtio_gpu_rect rect_union(const virtio_gpu_rect& a, const virtio_gpu_rect& b) {
+    uint32_t x0 = MIN(a.x, b.x);
+    uint32_t y0 = MIN(a.y, b.y);
+    uint32_t x1 = MAX(a.x + a.width, b.x + b.width);
+    uint32_t y1 = MAX(a.y + a.height, b.y + b.height);
+    return {x0, y0, x1 - x0, y1 - y0};
+}
+
+static uint64_t rect_area(const virtio_gpu_rect& r) {
+    return (uint64_t)r.width * r.height;
+}
+
+// true if the rectangles overlap or share an edge
+static bool rect_touches(const virtio_gpu_rect& a, const virtio_gpu_rect& b) {
+    return (a.x <= b.x + b.width) && (b.x <= a.x + a.width) &&
+           (a.y <= b.y + b.height) && (b.y <= a.y + a.height);
+}
+
+void GpuDevice::AddDamageLocked(virtio_gpu_rect r) {
+    // absorb every rectangle the new one touches; each merge may make it
+    // touch others, so start over after one
+    for (size_t i = 0; i < damage_count_;) {
+        if (rect_touches(r, damage_[i])) {
+            r = rect_union(r, damage_[i]);
+            damage_[i] = damage_[--damage_count_];
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    if (damage_count_ < gpu_damage_max) {
+        damage_[damage_count_++] = r;
+        return;
+    }
+
+    // out of room: merge with whichever rectangle costs least extra area
+    size_t best = 0;
+    uint64_t best_cost = UINT64_MAX;
+    for (size_t i = 0; i < damage_count_; i++) {
+        uint64_t cost = rect_area(rect_union(r, damage_[i])) - rect_area(damage_[i]);
+        if (cost < best_cost) {
+            best = i;
+            best_cost = cost;
+        }
+    }
+    r = rect_union(r, damage_[best]);
+    damage_[best] = damage_[--damage_count_];
+    AddDamageLocked(r);
+}
+
 void GpuDevice::virtio_gpu_flusher() {
     LTRACE_ENTRY;
     for (;;) {
+        virtio_gpu_rect damage[gpu_damage_max];
+        size_t count;
         {
             mxtl::AutoLock al(flush_lock_);
-            if (!flush_pending_)
+            while (damage_count_ == 0)
                 cnd_wait(&flush_cond_, flush_lock_.GetInternal());
-            flush_pending_ = false;
+            count = damage_count_;
+            memcpy(damage, damage_, count * sizeof(damage[0]));
+            damage_count_ = 0;
         }
 
-        LTRACEF("flushing\n");
+        LTRACEF("flushing %zu regions\n", count);
 
-        /* transfer to host 2d */
-        auto err = transfer_to_host_2d(display_resource_id_, pmode_.r.width, pmode_.r.height);
-        if (err < 0) {
-            LTRACEF("failed to flush resource\n");
-            continue;
-        }
+        for (size_t i = 0; i < count; i++) {
+            /* transfer to host 2d */
+            auto err = transfer_to_host_2d(display_resource_id_, damage[i]);
+            if (err < 0) {
+                LTRACEF("failed to flush resource\n");
+                continue;
+            }
 
-        /* resource flush */
-        err = flush_resource(display_resource_id_, pmode_.r.width, pmode_.r.height);
-        if (err < 0) {
-            LTRACEF("failed to flush resource\n");
-            continue;
+            /* resource flush */
+            err = flush_resource(display_resource_id_, damage[i]);
+            if (err < 0) {
+                LTRACEF("failed to flush resource\n");
+                continue;
+            }
         }
     }
 }
@@ -433,6 +509,7 @@ mx_status_t GpuDevice::virtio_gpu_start() {
     display_proto_ops_.get_mode = virtio_gpu_get_mode;
     display_proto_ops_.get_framebuffer = virtio_gpu_get_framebuffer;
     display_proto_ops_.flush = virtio_gpu_flush;
+    display_proto_ops_.flush_region = virtio_gpu_flush_region;
 
     device_.protocol_id = MX_PROTOCOL_DISPLAY;
     device_.protocol_ops = &display_proto_ops_;
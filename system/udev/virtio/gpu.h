@@ -30,6 +30,7 @@ public:
     const virtio_gpu_resp_display_info::virtio_gpu_display_one* pmode() const { return &pmode_; }
 
     void Flush();
+    void FlushRegion(uint32_t x, uint32_t y, uint32_t width, uint32_t height);
 
 private:
     // DDK driver hooks
@@ -37,6 +38,8 @@ private:
     static mx_status_t virtio_gpu_get_mode(mx_device_t* dev, mx_display_info_t* info);
     static mx_status_t virtio_gpu_get_framebuffer(mx_device_t* dev, void** framebuffer);
     static void virtio_gpu_flush(mx_device_t* dev);
+    static void virtio_gpu_flush_region(mx_device_t* dev, uint32_t x, uint32_t y,
+                                        uint32_t width, uint32_t height);
 
     // internal routines
     mx_status_t send_command_response(const void* cmd, size_t cmd_len, void** _res, size_t res_len);
@@ -44,8 +47,8 @@ private:
     mx_status_t allocate_2d_resource(uint32_t* resource_id, uint32_t width, uint32_t height);
     mx_status_t attach_backing(uint32_t resource_id, mx_paddr_t ptr, size_t buf_len);
     mx_status_t set_scanout(uint32_t scanout_id, uint32_t resource_id, uint32_t width, uint32_t height);
-    mx_status_t flush_resource(uint32_t resource_id, uint32_t width, uint32_t height);
-    mx_status_t transfer_to_host_2d(uint32_t resource_id, uint32_t width, uint32_t height);
+    mx_status_t flush_resource(uint32_t resource_id, const virtio_gpu_rect& r);
+    mx_status_t transfer_to_host_2d(uint32_t resource_id, const virtio_gpu_rect& r);
 
     mx_status_t virtio_gpu_start();
     static int virtio_gpu_start_entry(void* arg);
@@ -85,7 +88,14 @@ private:
     thrd_t flush_thread_ = {};
     mxtl::Mutex flush_lock_;
     cnd_t flush_cond_ = {};
-    bool flush_pending_ = false;
+
+    // damaged regions waiting for the flusher; overlapping or touching
+    // rectangles are merged as they come in, and once the list is full
+    // each new one is merged wherever it grows the total least
+    static const size_t gpu_damage_max = 8;
+    virtio_gpu_rect damage_[gpu_damage_max] = {};
+    size_t damage_count_ = 0;
+    void AddDamageLocked(virtio_gpu_rect r);
 };
 
 } // namespace virtio
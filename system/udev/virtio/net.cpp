@@ -0,0 +1,563 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include "net.h"
+
+#include <inttypes.h>
+#include <magenta/compiler.h>
+#include <magenta/new.h>
+#include <magenta/syscalls.h>
+#include <mxtl/auto_lock.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/param.h>
+#include <threads.h>
+
+#include "trace.h"
+#include "utils.h"
+
+#define LOCAL_TRACE 0
+
+// clang-format off
+#define VIRTIO_NET_F_CSUM           (1<<0)
+#define VIRTIO_NET_F_GUEST_CSUM     (1<<1)
+#define VIRTIO_NET_F_MAC            (1<<5)
+#define VIRTIO_NET_F_MRG_RXBUF      (1<<15)
+#define VIRTIO_NET_F_STATUS         (1<<16)
+#define VIRTIO_NET_F_CTRL_VQ        (1<<17)
+#define VIRTIO_NET_F_MQ             (1<<22)
+#define VIRTIO_F_ANY_LAYOUT         (1<<27)
+
+#define VIRTIO_NET_S_LINK_UP        1
+
+#define VIRTIO_NET_HDR_F_NEEDS_CSUM 1
+#define VIRTIO_NET_HDR_F_DATA_VALID 2
+
+#define VIRTIO_NET_CTRL_MQ          4
+#define VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET 0
+
+#define VIRTIO_NET_OK               0
+#define VIRTIO_NET_ERR              1
+// clang-format on
+
+namespace virtio {
+
+// DDK level ops
+
+mx_status_t NetDevice::virtio_net_query(mx_device_t* dev, uint32_t options, ethmac_info_t* info) {
+    NetDevice* nd = static_cast<NetDevice*>(dev->ctx);
+
+    if (options)
+        return ERR_INVALID_ARGS;
+
+    memset(info, 0, sizeof(*info));
+    info->mtu = 1500;
+    memcpy(info->mac, nd->config_.mac, sizeof(info->mac));
+    return NO_ERROR;
+}
+
+void NetDevice::virtio_net_stop(mx_device_t* dev) {
+    NetDevice* nd = static_cast<NetDevice*>(dev->ctx);
+
+    mxtl::AutoLock lock(nd->ifc_lock_);
+    nd->ifc_ = nullptr;
+    nd->cookie_ = nullptr;
+}
+
+mx_status_t NetDevice::virtio_net_start(mx_device_t* dev, ethmac_ifc_t* ifc, void* cookie) {
+    NetDevice* nd = static_cast<NetDevice*>(dev->ctx);
+
+    mxtl::AutoLock lock(nd->ifc_lock_);
+    if (nd->ifc_ != nullptr)
+        return ERR_BAD_STATE;
+    nd->ifc_ = ifc;
+    nd->cookie_ = cookie;
+    return NO_ERROR;
+}
+
+void NetDevice::virtio_net_send(mx_device_t* dev, uint32_t options, void* data, size_t length) {
+    NetDevice* nd = static_cast<NetDevice*>(dev->ctx);
+    nd->Send(data, length);
+}
+
+mx_status_t NetDevice::virtio_net_get_stats(mx_device_t* dev, eth_stats_t* stats) {
+    NetDevice* nd = static_cast<NetDevice*>(dev->ctx);
+
+    memset(stats, 0, sizeof(*stats));
+    for (uint16_t i = 0; i < nd->pair_count_; i++) {
+        Queue* rx = nd->rx_[i].get();
+        Queue* tx = nd->tx_[i].get();
+        stats->rx_packets += rx->packets;
+        stats->rx_bytes += rx->bytes;
+        stats->rx_dropped += rx->dropped;
+
+        mxtl::AutoLock lock(tx->lock);
+        stats->tx_packets += tx->packets;
+        stats->tx_bytes += tx->bytes;
+        stats->tx_dropped += tx->dropped;
+    }
+    stats->irqs = nd->irqs_;
+    return NO_ERROR;
+}
+
+NetDevice::NetDevice(mx_driver_t* driver, mx_device_t* bus_device)
+    : Device(driver, bus_device) {
+    // so that Bind() knows how much io space to allocate
+    bar0_size_ = 0x40;
+}
+
+NetDevice::~NetDevice() {
+    // TODO: clean up allocated physical memory
+}
+
+mx_status_t NetDevice::Init() {
+    LTRACE_ENTRY;
+
+    // reset the device
+    Reset();
+
+    // ack and set the driver status bit
+    StatusAcknowledgeDriver();
+
+    // take the features we know how to use. the send() interface carries
+    // no checksum metadata, so transmit checksum offload is not asked for.
+    uint32_t device_features = ReadFeatures();
+    features_ = device_features & (VIRTIO_NET_F_MAC | VIRTIO_NET_F_STATUS |
+                                   VIRTIO_NET_F_MRG_RXBUF | VIRTIO_NET_F_GUEST_CSUM |
+                                   VIRTIO_NET_F_CTRL_VQ | VIRTIO_F_ANY_LAYOUT |
+                                   (1u << VIRTIO_RING_F_EVENT_IDX));
+    // queue pairs are enabled through the control queue
+    if ((features_ & VIRTIO_NET_F_CTRL_VQ) && (device_features & VIRTIO_NET_F_MQ))
+        features_ |= VIRTIO_NET_F_MQ;
+    LTRACEF("device features %#x, driver features %#x\n", device_features, features_);
+    mx_status_t r = WriteFeatures(features_);
+    if (r != NO_ERROR)
+        return r;
+
+    // read our configuration
+    CopyDeviceConfig(&config_, sizeof(config_));
+
+    if (!(features_ & VIRTIO_NET_F_MAC)) {
+        // make up a locally administered unicast address
+        size_t actual;
+        mx_cprng_draw(config_.mac, sizeof(config_.mac), &actual);
+        config_.mac[0] = (uint8_t)((config_.mac[0] & ~0x01) | 0x02);
+    }
+    LTRACEF("mac %02x:%02x:%02x:%02x:%02x:%02x\n", config_.mac[0], config_.mac[1],
+            config_.mac[2], config_.mac[3], config_.mac[4], config_.mac[5]);
+
+    hdr_len_ = (features_ & VIRTIO_NET_F_MRG_RXBUF) ? sizeof(virtio_net_hdr)
+                                                    : offsetof(virtio_net_hdr, num_buffers);
+
+    // a queue pair per cpu, as far as the device goes
+    uint16_t max_pairs = 1;
+    if (features_ & VIRTIO_NET_F_MQ)
+        max_pairs = MAX(config_.max_virtqueue_pairs, 1);
+    uint16_t count = (uint16_t)MIN(MIN(max_pairs, mx_num_cpus()), net_queue_max);
+    count = MAX(count, 1);
+
+    for (uint16_t i = 0; i < count; i++) {
+        AllocChecker ac;
+        rx_[i].reset(new (&ac) Queue(this));
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+        tx_[i].reset(new (&ac) Queue(this));
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+        if ((r = InitQueue(rx_[i].get(), (uint16_t)(2 * i), true)) != NO_ERROR ||
+            (r = InitQueue(tx_[i].get(), (uint16_t)(2 * i + 1), false)) != NO_ERROR) {
+            if (i == 0)
+                return r;
+            // run with the pairs we have
+            rx_[i].reset();
+            tx_[i].reset();
+            break;
+        }
+        pair_count_ = (uint16_t)(i + 1);
+    }
+
+    if (features_ & VIRTIO_NET_F_CTRL_VQ) {
+        AllocChecker ac;
+        ctrl_.reset(new (&ac) Queue(this));
+        if (!ac.check())
+            return ERR_NO_MEMORY;
+        if ((r = InitQueue(ctrl_.get(), (uint16_t)(2 * max_pairs), false)) != NO_ERROR) {
+            ctrl_.reset();
+            pair_count_ = 1;
+        }
+    } else {
+        pair_count_ = 1;
+    }
+
+    if (features_ & VIRTIO_NET_F_MRG_RXBUF) {
+        for (uint16_t i = 0; i < pair_count_; i++) {
+            AllocChecker ac;
+            rx_[i]->merge_buf.reset(new (&ac) uint8_t[net_merge_max]);
+            if (!ac.check())
+                return ERR_NO_MEMORY;
+        }
+    }
+
+    // start the interrupt thread
+    StartIrqThread();
+
+    // set DRIVER_OK
+    StatusDriverOK();
+
+    // the device starts out on one pair; ask for the rest
+    if ((features_ & VIRTIO_NET_F_MQ) && pair_count_ > 1) {
+        if (SetQueuePairs(pair_count_) != NO_ERROR) {
+            VIRTIO_ERROR("cannot enable %u queue pairs, using one\n", pair_count_);
+            pair_count_ = 1;
+        }
+    }
+    LTRACEF("%u queue pairs, header %zu bytes\n", pair_count_, hdr_len_);
+
+    // initialize the mx_device and publish us
+    ethmac_ops_.query = &virtio_net_query;
+    ethmac_ops_.stop = &virtio_net_stop;
+    ethmac_ops_.start = &virtio_net_start;
+    ethmac_ops_.send = &virtio_net_send;
+    ethmac_ops_.get_stats = &virtio_net_get_stats;
+    device_init(&device_, driver_, "virtio-net", &device_ops_);
+
+    // point the ctx of our embedded device structure at ourself
+    device_.ctx = this;
+
+    device_.protocol_id = MX_PROTOCOL_ETHERMAC;
+    device_.protocol_ops = &ethmac_ops_;
+    auto status = device_add(&device_, bus_device_);
+    if (status < 0)
+        return status;
+
+    return NO_ERROR;
+}
+
+mx_status_t NetDevice::InitQueue(Queue* q, uint16_t index, bool rx) {
+    uint16_t size = GetRingSize(index);
+    if (size == 0) {
+        VIRTIO_ERROR("queue %u not available\n", index);
+        return ERR_NOT_FOUND;
+    }
+
+    auto err = q->ring.Init(index, size, (features_ & (1u << VIRTIO_RING_F_EVENT_IDX)) != 0);
+    if (err < 0) {
+        VIRTIO_ERROR("failed to allocate vring %u\n", index);
+        return err;
+    }
+
+    uintptr_t va;
+    mx_paddr_t pa;
+    mx_status_t r = map_contiguous_memory(size * net_buf_size, &va, &pa);
+    if (r < 0) {
+        VIRTIO_ERROR("cannot alloc buffers for queue %u: %d\n", index, r);
+        return r;
+    }
+    q->buf = (uint8_t*)va;
+    q->buf_pa = pa;
+
+    LTRACEF("queue %u: ring size %u, buffers at %p, physical address %#" PRIxPTR "\n",
+            index, size, q->buf, q->buf_pa);
+
+    if (!rx) {
+        // completed transmits are collected as more are queued
+        q->ring.SuppressInterrupts();
+        return NO_ERROR;
+    }
+
+    // fill the ring with receive buffers
+    uint16_t head;
+    while (q->ring.AllocDescChain(ChainLength(), &head) != nullptr) {
+        FillChain(q, head, net_buf_size, VRING_DESC_F_WRITE);
+        q->ring.SubmitChain(head);
+    }
+    q->ring.Kick();
+
+    return NO_ERROR;
+}
+
+// without ANY_LAYOUT the header must have a descriptor to itself
+uint16_t NetDevice::ChainLength() const {
+    return (features_ & VIRTIO_F_ANY_LAYOUT) ? 1 : 2;
+}
+
+// point the chain at |head| at its buffer, header first
+void NetDevice::FillChain(Queue* q, uint16_t head, size_t length, uint16_t flags) {
+    mx_paddr_t pa = q->buf_pa + head * net_buf_size;
+    vring_desc* desc = q->ring.DescFromIndex(head);
+
+    desc->addr = pa;
+    if (ChainLength() == 1) {
+        desc->len = (uint32_t)length;
+        desc->flags = flags;
+    } else {
+        desc->len = (uint32_t)hdr_len_;
+        desc->flags = (uint16_t)(flags | VRING_DESC_F_NEXT);
+        desc = q->ring.DescFromIndex(desc->next);
+        desc->addr = pa + hdr_len_;
+        desc->len = (uint32_t)(length - hdr_len_);
+        desc->flags = flags;
+    }
+
+#if LOCAL_TRACE > 0
+    virtio_dump_desc(q->ring.DescFromIndex(head));
+#endif
+}
+
+// a sending thread stays on one queue, which keeps its frames in order
+// and spreads independent senders across the device's queues
+NetDevice::Queue* NetDevice::SelectTxQueue() {
+    if (pair_count_ == 1)
+        return tx_[0].get();
+
+    uint64_t id = (uint64_t)(uintptr_t)thrd_current();
+    id *= 0x9e3779b97f4a7c15ull;
+    return tx_[(id >> 32) % pair_count_].get();
+}
+
+void NetDevice::Send(const void* data, size_t length) {
+    Queue* q = SelectTxQueue();
+    mxtl::AutoLock lock(q->lock);
+
+    if (length > net_buf_size - hdr_len_) {
+        q->dropped++;
+        return;
+    }
+
+    // pick up whatever the device has finished sending
+    q->ring.Reclaim([q](vring_used_elem* used_elem) {
+        q->ring.FreeDescChain((uint16_t)used_elem->id);
+    });
+
+    uint16_t head;
+    if (q->ring.AllocDescChain(ChainLength(), &head) == nullptr) {
+        LTRACEF("tx ring full\n");
+        q->dropped++;
+        return;
+    }
+
+    // no offloads are requested, so the header is all zeroes
+    uint8_t* buf = q->buffer(head);
+    memset(buf, 0, hdr_len_);
+    memcpy(buf + hdr_len_, data, length);
+    FillChain(q, head, hdr_len_ + length, 0);
+
+    q->ring.SubmitChain(head);
+    q->ring.KickIfNeeded();
+
+    q->packets++;
+    q->bytes += length;
+}
+
+void NetDevice::IrqRingUpdate() {
+    LTRACE_ENTRY;
+
+    mxtl::AutoLock lock(ifc_lock_);
+    irqs_++;
+
+    // there is one interrupt for the device, so look at every rx queue;
+    // tx and control queues are reclaimed by their users
+    for (uint16_t i = 0; i < pair_count_; i++) {
+        RxRingUpdate(rx_[i].get());
+    }
+}
+
+// hand up the frames gathered so far, then give their buffers back to the
+// device
+void NetDevice::RxFlushLocked(Queue* q) {
+    if (rx_batch_count_ == 0)
+        return;
+
+    if (ifc_ != nullptr) {
+        ifc_->recv_batch(cookie_, rx_batch_, rx_batch_count_);
+    } else {
+        q->dropped += rx_batch_count_;
+    }
+
+    for (size_t n = 0; n < rx_batch_count_; n++) {
+        q->ring.SubmitChain(rx_heads_[n]);
+    }
+    rx_batch_count_ = 0;
+}
+
+void NetDevice::RxRingUpdate(Queue* q) {
+    auto rx_frame = [this, q](vring_used_elem* used_elem) {
+        uint16_t head = (uint16_t)used_elem->id;
+        uint8_t* buf = q->buffer(head);
+        size_t length = MIN(used_elem->len, net_buf_size);
+        const virtio_net_hdr* hdr = reinterpret_cast<const virtio_net_hdr*>(buf);
+
+        // the rest of a frame spread over several buffers
+        if (q->merge_left > 0) {
+            if (q->merge_len + length <= net_merge_max) {
+                memcpy(q->merge_buf.get() + q->merge_len, buf, length);
+            }
+            q->merge_len += length;
+            q->ring.SubmitChain(head);
+            if (--q->merge_left > 0)
+                return;
+
+            if (q->merge_len > net_merge_max) {
+                q->dropped++;
+            } else {
+                ethmac_rx_frame_t frame = {q->merge_buf.get(), q->merge_len,
+                                           RxChecksum(q->merge_buf.get(), q->merge_len, &q->merge_hdr)};
+                if (ifc_ != nullptr) {
+                    ifc_->recv_batch(cookie_, &frame, 1);
+                } else {
+                    q->dropped++;
+                }
+                q->packets++;
+                q->bytes += q->merge_len;
+            }
+            return;
+        }
+
+        if (length < hdr_len_) {
+            q->dropped++;
+            q->ring.SubmitChain(head);
+            return;
+        }
+        uint8_t* data = buf + hdr_len_;
+        length -= hdr_len_;
+
+        if ((features_ & VIRTIO_NET_F_MRG_RXBUF) && hdr->num_buffers > 1) {
+            // gather the frame, keeping its header aside for the checksum;
+            // the frames before it go up first so that order is kept
+            RxFlushLocked(q);
+            memcpy(&q->merge_hdr, hdr, hdr_len_);
+            memcpy(q->merge_buf.get(), data, length);
+            q->merge_len = length;
+            q->merge_left = (uint16_t)(hdr->num_buffers - 1);
+            q->ring.SubmitChain(head);
+            return;
+        }
+
+        ethmac_rx_frame_t* frame = &rx_batch_[rx_batch_count_];
+        frame->data = data;
+        frame->length = length;
+        frame->flags = RxChecksum(data, length, hdr);
+        rx_heads_[rx_batch_count_++] = head;
+        q->packets++;
+        q->bytes += length;
+
+        if (rx_batch_count_ == net_rx_batch)
+            RxFlushLocked(q);
+    };
+
+    // tell the ring to find received chains and hand them to our lambda
+    q->ring.IrqRingUpdate(rx_frame);
+
+    RxFlushLocked(q);
+    q->ring.KickIfNeeded();
+}
+
+// report what the device says about the frame's tcp/udp checksum; a
+// frame marked as needing one (sent by another guest on the same host,
+// say) has it completed here so that the stack can skip the check
+uint32_t NetDevice::RxChecksum(uint8_t* frame, size_t length, const virtio_net_hdr* hdr) {
+    if (!(features_ & VIRTIO_NET_F_GUEST_CSUM))
+        return 0;
+    if (hdr->flags & VIRTIO_NET_HDR_F_DATA_VALID)
+        return ETHMAC_RX_CSUM_VALID;
+    if (!(hdr->flags & VIRTIO_NET_HDR_F_NEEDS_CSUM))
+        return 0;
+
+    // the checksum field holds the pseudo-header sum; fold in the rest
+    size_t start = hdr->csum_start;
+    size_t offset = start + hdr->csum_offset;
+    if (start >= length || offset + 2 > length)
+        return 0;
+
+    uint32_t sum = 0;
+    size_t i;
+    for (i = start; i + 1 < length; i += 2) {
+        sum += (uint32_t)((frame[i] << 8) | frame[i + 1]);
+    }
+    if (i < length)
+        sum += (uint32_t)(frame[i] << 8);
+    while (sum >> 16) {
+        sum = (sum & 0xffff) + (sum >> 16);
+    }
+    uint16_t csum = (uint16_t)~sum;
+    if (csum == 0)
+        csum = 0xffff;
+
+    frame[offset] = (uint8_t)(csum >> 8);
+    frame[offset + 1] = (uint8_t)csum;
+    return ETHMAC_RX_CSUM_VALID;
+}
+
+// change the number of queue pairs the device spreads traffic across;
+// the device answers on the control queue, which is polled
+mx_status_t NetDevice::SetQueuePairs(uint16_t pairs) {
+    Queue* q = ctrl_.get();
+    if (q == nullptr)
+        return ERR_NOT_SUPPORTED;
+
+    mxtl::AutoLock lock(q->lock);
+
+    /* put together a command: class and command, the pair count, the ack */
+    uint16_t i;
+    auto desc = q->ring.AllocDescChain(3, &i);
+    if (desc == nullptr)
+        return ERR_NO_RESOURCES;
+
+    uint8_t* buf = q->buffer(i);
+    mx_paddr_t pa = q->buf_pa + i * net_buf_size;
+    buf[0] = VIRTIO_NET_CTRL_MQ;
+    buf[1] = VIRTIO_NET_CTRL_MQ_VQ_PAIRS_SET;
+    memcpy(buf + 2, &pairs, sizeof(pairs));
+    volatile uint8_t* ack = buf + 4;
+    *ack = VIRTIO_NET_ERR;
+
+    desc->addr = pa;
+    desc->len = 2;
+    desc = q->ring.DescFromIndex(desc->next);
+    desc->addr = pa + 2;
+    desc->len = sizeof(pairs);
+    desc = q->ring.DescFromIndex(desc->next);
+    desc->addr = pa + 4;
+    desc->len = 1;
+    desc->flags = VRING_DESC_F_WRITE;
+
+    q->ring.SubmitChain(i);
+    q->ring.Kick();
+
+    bool done = false;
+    for (int n = 0; n < 100 && !done; n++) {
+        q->ring.Reclaim([q, &done](vring_used_elem* used_elem) {
+            q->ring.FreeDescChain((uint16_t)used_elem->id);
+            done = true;
+        });
+        if (!done)
+            mx_nanosleep(MX_MSEC(1));
+    }
+    if (!done)
+        return ERR_TIMED_OUT;
+
+    return (*ack == VIRTIO_NET_OK) ? NO_ERROR : ERR_IO;
+}
+
+uint32_t NetDevice::LinkStatus() {
+    if (!(features_ & VIRTIO_NET_F_STATUS))
+        return ETHMAC_STATUS_ONLINE;
+    return (config_.status & VIRTIO_NET_S_LINK_UP) ? ETHMAC_STATUS_ONLINE : 0;
+}
+
+void NetDevice::IrqConfigChange() {
+    LTRACE_ENTRY;
+
+    // only the link status is of interest; the mac may be our own
+    virtio_net_config config;
+    CopyDeviceConfig(&config, sizeof(config));
+
+    mxtl::AutoLock lock(ifc_lock_);
+    config_.status = config.status;
+    if (ifc_ != nullptr)
+        ifc_->status(cookie_, LinkStatus());
+}
+
+} // namespace virtio
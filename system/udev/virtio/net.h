@@ -0,0 +1,136 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+#pragma once
+
+#include "device.h"
+#include "ring.h"
+
+#include <ddk/protocol/ethernet.h>
+#include <magenta/compiler.h>
+#include <mxtl/mutex.h>
+#include <mxtl/unique_ptr.h>
+#include <stdlib.h>
+
+namespace virtio {
+
+class Ring;
+
+class NetDevice : public Device {
+public:
+    NetDevice(mx_driver_t* driver, mx_device_t* device);
+    virtual ~NetDevice();
+
+    virtual mx_status_t Init();
+
+    virtual void IrqRingUpdate();
+    virtual void IrqConfigChange();
+
+private:
+    // DDK ethermac hooks
+    static mx_status_t virtio_net_query(mx_device_t* dev, uint32_t options, ethmac_info_t* info);
+    static void virtio_net_stop(mx_device_t* dev);
+    static mx_status_t virtio_net_start(mx_device_t* dev, ethmac_ifc_t* ifc, void* cookie);
+    static void virtio_net_send(mx_device_t* dev, uint32_t options, void* data, size_t length);
+    static mx_status_t virtio_net_get_stats(mx_device_t* dev, eth_stats_t* stats);
+
+    struct Queue;
+    struct virtio_net_hdr;
+
+    mx_status_t InitQueue(Queue* q, uint16_t index, bool rx);
+    uint16_t ChainLength() const;
+    void FillChain(Queue* q, uint16_t head, size_t length, uint16_t flags);
+    void Send(const void* data, size_t length);
+    Queue* SelectTxQueue();
+    void RxRingUpdate(Queue* q);
+    void RxFlushLocked(Queue* q);
+    uint32_t RxChecksum(uint8_t* frame, size_t length, const virtio_net_hdr* hdr);
+    mx_status_t SetQueuePairs(uint16_t pairs);
+    uint32_t LinkStatus();
+
+    // saved network device configuration out of the pci config BAR
+    struct virtio_net_config {
+        uint8_t mac[6];
+        uint16_t status;
+        uint16_t max_virtqueue_pairs;
+    } config_ __PACKED = {};
+
+    // the header which precedes every frame on the rings; num_buffers is
+    // only present if mergeable rx buffers were negotiated
+    struct virtio_net_hdr {
+        uint8_t flags;
+        uint8_t gso_type;
+        uint16_t hdr_len;
+        uint16_t gso_size;
+        uint16_t csum_start;
+        uint16_t csum_offset;
+        uint16_t num_buffers;
+    } __PACKED;
+
+    // every descriptor chain owns one buffer, holding the header followed
+    // by up to a full frame
+    static const size_t net_buf_size = 2048;
+
+    // upper bound on queue pairs in use
+    static const size_t net_queue_max = 4;
+
+    // received frames handed up per call to recv_batch()
+    static const size_t net_rx_batch = 64;
+
+    // largest frame reassembled from mergeable rx buffers
+    static const size_t net_merge_max = 16 * net_buf_size;
+
+    // one virtqueue and its buffers
+    struct Queue {
+        Queue(Device* device)
+            : ring(device) {}
+
+        Ring ring;
+        mxtl::Mutex lock;
+
+        // buffer i belongs to the chain headed by descriptor i
+        mx_paddr_t buf_pa = 0;
+        uint8_t* buf = nullptr;
+
+        // counters, kept per queue under its lock (tx) or by the irq
+        // thread (rx)
+        uint64_t packets = 0;
+        uint64_t bytes = 0;
+        uint64_t dropped = 0;
+
+        // a received frame spread over several buffers, gathered as they
+        // come in, which may be over more than one interrupt
+        mxtl::unique_ptr<uint8_t[]> merge_buf;
+        virtio_net_hdr merge_hdr = {};
+        size_t merge_len = 0;
+        uint16_t merge_left = 0;
+
+        uint8_t* buffer(uint16_t head) { return buf + head * net_buf_size; }
+    };
+
+    mxtl::unique_ptr<Queue> rx_[net_queue_max];
+    mxtl::unique_ptr<Queue> tx_[net_queue_max];
+    mxtl::unique_ptr<Queue> ctrl_;
+    uint16_t pair_count_ = 0;
+
+    // negotiated feature bits
+    uint32_t features_ = 0;
+
+    // bytes of virtio_net_hdr in use
+    size_t hdr_len_ = 0;
+
+    // rx state, touched only by the irq thread
+    ethmac_rx_frame_t rx_batch_[net_rx_batch] = {};
+    uint16_t rx_heads_[net_rx_batch] = {};
+    size_t rx_batch_count_ = 0;
+    uint64_t irqs_ = 0;
+
+    // the ethernet layer's callbacks, present while started
+    mxtl::Mutex ifc_lock_;
+    ethmac_ifc_t* ifc_ = nullptr;
+    void* cookie_ = nullptr;
+
+    ethmac_protocol_t ethmac_ops_ = {};
+};
+
+} // namespace virtio
@@ -35,12 +35,17 @@ Ring::~Ring() {
     mx::vmar::root_self().unmap(ring_va_, ring_va_len_);
 }
 
-mx_status_t Ring::Init(uint16_t index, uint16_t count) {
-    LTRACEF("index %u, count %u\n", index, count);
+mx_status_t Ring::Init(uint16_t index, uint16_t count, bool event_idx) {
+    LTRACEF("index %u, count %u, event_idx %d\n", index, count, event_idx);
 
-    // XXX check that count is a power of 2
+    if (count == 0 || (count & (count - 1)) != 0) {
+        VIRTIO_ERROR("ring size %u is not a power of 2\n", count);
+        return ERR_INVALID_ARGS;
+    }
 
     index_ = index;
+    event_idx_ = event_idx;
+    kicked_idx_ = 0;
 
     // allocate a ring
     size_t size = vring_size(count, PAGE_SIZE);
@@ -149,14 +154,47 @@ void Ring::SubmitChain(uint16_t desc_index) {
     struct vring_avail* avail = ring_.avail;
 
     avail->ring[avail->idx & ring_.num_mask] = desc_index;
-    //mb();
-    avail->idx++;
+
+    // the ring entry must be visible before the device can see the new index
+    __atomic_store_n(&avail->idx, (uint16_t)(avail->idx + 1), __ATOMIC_RELEASE);
 }
 
 void Ring::Kick() {
     LTRACE_ENTRY;
 
+    kicked_idx_ = ring_.avail->idx;
     device_->RingKick(index_);
 }
 
+void Ring::SuppressInterrupts() {
+    // without event index the flag is only a hint, but devices honor it
+    ring_.avail->flags = VRING_AVAIL_F_NO_INTERRUPT;
+    if (event_idx_)
+        __atomic_store_n(&vring_used_event(&ring_), (uint16_t)(ring_.last_used - 1), __ATOMIC_RELAXED);
+}
+
+void Ring::KickIfNeeded() {
+    uint16_t new_idx = ring_.avail->idx;
+    uint16_t old_idx = kicked_idx_;
+    if (new_idx == old_idx)
+        return;
+
+    // order the avail index update against reading the device's state
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+
+    bool kick;
+    if (event_idx_) {
+        uint16_t avail_event = __atomic_load_n(&vring_avail_event(&ring_), __ATOMIC_RELAXED);
+        kick = vring_need_event(avail_event, new_idx, old_idx);
+    } else {
+        kick = !(__atomic_load_n(&ring_.used->flags, __ATOMIC_RELAXED) & VRING_USED_F_NO_NOTIFY);
+    }
+
+    kicked_idx_ = new_idx;
+    if (kick) {
+        LTRACEF("kick index %u\n", index_);
+        device_->RingKick(index_);
+    }
+}
+
 } // namespace virtio
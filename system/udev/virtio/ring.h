@@ -18,7 +18,8 @@ public:
     Ring(Device* device);
     ~Ring();
 
-    mx_status_t Init(uint16_t index, uint16_t count);
+    // |event_idx| is true if VIRTIO_RING_F_EVENT_IDX was negotiated with the device
+    mx_status_t Init(uint16_t index, uint16_t count, bool event_idx = false);
 
     void FreeDesc(uint16_t desc_index);
     void FreeDescChain(uint16_t chain_head);
@@ -27,6 +28,13 @@ public:
     void SubmitChain(uint16_t desc_index);
     void Kick();
 
+    // notify the device of chains submitted since the last kick, unless it
+    // has told us it does not need to hear about them yet
+    void KickIfNeeded();
+
+    uint16_t index() const { return index_; }
+    uint16_t free_count() const { return ring_.free_count; }
+
     struct vring_desc* DescFromIndex(uint16_t index) {
         return &ring_.desc[index];
     }
@@ -34,6 +42,13 @@ public:
     template <typename T>
     void IrqRingUpdate(T free_chain);
 
+    // stop the device interrupting as chains on this ring complete; the
+    // owner picks them up with Reclaim() when it needs descriptors
+    void SuppressInterrupts();
+
+    template <typename T>
+    void Reclaim(T free_chain);
+
 private:
     Device* device_ = nullptr;
 
@@ -43,6 +58,10 @@ private:
 
     uint16_t index_ = 0;
 
+    // avail index as of the last notification sent to the device
+    uint16_t kicked_idx_ = 0;
+    bool event_idx_ = false;
+
     vring ring_ = {};
 };
 
@@ -52,19 +71,42 @@ inline void Ring::IrqRingUpdate(T free_chain) {
     //TRACEF("used flags 0x%hhx idx 0x%hhx last_used %u\n",
     //        ring_.used->flags, ring_.used->idx, ring_.last_used);
 
-    // find a new free chain of descriptors
-    unsigned int cur_idx = ring_.used->idx;
-    for (unsigned int i = ring_.last_used; i != (cur_idx & ring_.num_mask); i = (i + 1) & ring_.num_mask) {
-        //TRACEF("looking at idx %u\n", i);
-
-        struct vring_used_elem* used_elem = &ring_.used->ring[i];
-        //TRACEF("used chain id %u, len %u\n", used_elem->id, used_elem->len);
-
-        // free the chain
-        free_chain(used_elem);
+    for (;;) {
+        // find a new free chain of descriptors
+        uint16_t cur_idx = __atomic_load_n(&ring_.used->idx, __ATOMIC_ACQUIRE);
+        for (; ring_.last_used != cur_idx; ring_.last_used++) {
+            struct vring_used_elem* used_elem = &ring_.used->ring[ring_.last_used & ring_.num_mask];
+            //TRACEF("used chain id %u, len %u\n", used_elem->id, used_elem->len);
+
+            // free the chain
+            free_chain(used_elem);
+        }
+
+        if (!event_idx_)
+            break;
+
+        // the device holds off interrupts until it moves past used_event, so
+        // everything completed while we were draining arrives as one batch.
+        // re-arm, then pick up anything that raced in ahead of the update.
+        __atomic_store_n(&vring_used_event(&ring_), ring_.last_used, __ATOMIC_RELAXED);
+        __atomic_thread_fence(__ATOMIC_SEQ_CST);
+        if (__atomic_load_n(&ring_.used->idx, __ATOMIC_ACQUIRE) == ring_.last_used)
+            break;
+    }
+}
 
-        ring_.last_used = ((ring_.last_used + 1) & ring_.num_mask) & 0xffff;
+// collect completed chains without asking for an interrupt for later ones
+template <typename T>
+inline void Ring::Reclaim(T free_chain) {
+    uint16_t cur_idx = __atomic_load_n(&ring_.used->idx, __ATOMIC_ACQUIRE);
+    for (; ring_.last_used != cur_idx; ring_.last_used++) {
+        free_chain(&ring_.used->ring[ring_.last_used & ring_.num_mask]);
     }
+
+    // keep used_event just behind the device, where it cannot be crossed
+    // before the ring is reclaimed again
+    if (event_idx_)
+        __atomic_store_n(&vring_used_event(&ring_), (uint16_t)(ring_.last_used - 1), __ATOMIC_RELAXED);
 }
 
 void virtio_dump_desc(const struct vring_desc* desc);
@@ -6,6 +6,7 @@
 #include <ddk/common/hid-fifo.h>
 
 #include <magenta/listnode.h>
+#include <magenta/syscalls.h>
 
 #include <assert.h>
 #include <stdio.h>
@@ -32,6 +33,10 @@
 // needs a hack as well.
 #define BOOT_MOUSE_HACK 1
 
+// bytes of reports in a shared report ring. at 1000 reports per second this
+// holds more than a second of 8 byte reports
+#define HID_RING_DATA_SIZE 16384
+
 typedef struct mx_hid_instance {
     mx_device_t dev;
     mx_hid_device_t* root;
@@ -40,6 +45,14 @@ typedef struct mx_hid_instance {
 
     mx_hid_fifo_t fifo;
 
+    // once set, reports go to the shared ring rather than the fifo.
+    // protected by fifo.lock
+    input_ring_t* ring;
+    size_t ring_size;
+    uint32_t ring_head;     // our copy, since the reader can write the mapping
+    mx_handle_t ring_vmo;
+    mx_handle_t ring_event;
+
     struct list_node node;
 } mx_hid_instance_t;
 
@@ -207,9 +220,92 @@ static void hid_cleanup_instance(mx_hid_instance_t* dev) {
         list_delete(&dev->node);
         mtx_unlock(&dev->root->instance_lock);
     }
+    if (dev->ring) {
+        mx_vmar_unmap(mx_vmar_root_self(), (uintptr_t)dev->ring, dev->ring_size);
+        mx_handle_close(dev->ring_vmo);
+        mx_handle_close(dev->ring_event);
+    }
     free(dev);
 }
 
+static mx_status_t hid_get_report_ring(mx_hid_instance_t* hid, void* out_buf, size_t out_len) {
+    if (out_len < sizeof(input_report_ring_t)) return ERR_INVALID_ARGS;
+
+    input_report_ring_t* reply = out_buf;
+    size_t size = sizeof(input_ring_t) + HID_RING_DATA_SIZE;
+    mx_handle_t vmo = MX_HANDLE_INVALID;
+    mx_handle_t event = MX_HANDLE_INVALID;
+    uintptr_t addr = 0;
+    mx_status_t status;
+
+    mtx_lock(&hid->fifo.lock);
+    if (hid->ring) {
+        status = ERR_ALREADY_BOUND;
+        goto fail;
+    }
+    if ((status = mx_vmo_create(size, 0, &vmo)) < 0 ||
+        (status = mx_event_create(0, &event)) < 0) {
+        goto fail;
+    }
+    if ((status = mx_vmar_map(mx_vmar_root_self(), 0, vmo, 0, size,
+                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE, &addr)) < 0) {
+        goto fail;
+    }
+    if ((status = mx_handle_duplicate(vmo, MX_RIGHT_SAME_RIGHTS, &reply->vmo)) < 0) {
+        goto fail;
+    }
+    if ((status = mx_handle_duplicate(event, MX_RIGHT_SAME_RIGHTS, &reply->event)) < 0) {
+        mx_handle_close(reply->vmo);
+        goto fail;
+    }
+    reply->size = size;
+
+    hid->ring = (input_ring_t*)addr;
+    hid->ring->data_size = HID_RING_DATA_SIZE;
+    hid->ring_size = size;
+    hid->ring_head = 0;
+    hid->ring_vmo = vmo;
+    hid->ring_event = event;
+    mtx_unlock(&hid->fifo.lock);
+    return sizeof(*reply);
+
+fail:
+    mtx_unlock(&hid->fifo.lock);
+    if (addr) {
+        mx_vmar_unmap(mx_vmar_root_self(), addr, size);
+    }
+    mx_handle_close(vmo);
+    mx_handle_close(event);
+    return status;
+}
+
+// called with fifo.lock held
+static void hid_ring_write(mx_hid_instance_t* hid, const uint8_t* buf, size_t len) {
+    input_ring_t* ring = hid->ring;
+    uint32_t mask = HID_RING_DATA_SIZE - 1;
+    uint32_t head = hid->ring_head;
+    uint32_t tail = __atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST);
+    if (len > UINT16_MAX || head - tail > HID_RING_DATA_SIZE ||
+        HID_RING_DATA_SIZE - (head - tail) < 2 + len) {
+        __atomic_fetch_add(&ring->dropped, 1, __ATOMIC_RELAXED);
+        return;
+    }
+
+    ring->data[head & mask] = len & 0xff;
+    ring->data[(head + 1) & mask] = len >> 8;
+    for (size_t i = 0; i < len; i++) {
+        ring->data[(head + 2 + i) & mask] = buf[i];
+    }
+    hid->ring_head = head + 2 + len;
+    __atomic_store_n(&ring->head, hid->ring_head, __ATOMIC_SEQ_CST);
+
+    // the reader only sleeps after finding the ring empty, so it needs waking
+    // only if it had already taken everything before this report
+    if (__atomic_load_n(&ring->tail, __ATOMIC_SEQ_CST) == head) {
+        mx_object_signal(hid->ring_event, 0, INPUT_RING_SIGNAL_READABLE);
+    }
+}
+
 static ssize_t hid_read_instance(mx_device_t* dev, void* buf, size_t count, mx_off_t off) {
     mx_hid_instance_t* hid = to_hid_instance(dev);
 
@@ -283,6 +379,8 @@ static ssize_t hid_ioctl_instance(mx_device_t* dev, uint32_t op,
         return hid_get_report(hid->root, in_buf, in_len, out_buf, out_len);
     case IOCTL_INPUT_SET_REPORT:
         return hid_set_report(hid->root, in_buf, in_len);
+    case IOCTL_INPUT_GET_REPORT_RING:
+        return hid_get_report_ring(hid, out_buf, out_len);
     }
     return ERR_NOT_SUPPORTED;
 }
@@ -566,6 +664,11 @@ static void hid_unbind_device(mx_device_t* dev) {
     foreach_instance(hid, instance) {
         instance->flags |= HID_FLAGS_DEAD;
         device_state_set(&instance->dev, DEV_STATE_READABLE);
+        mtx_lock(&instance->fifo.lock);
+        if (instance->ring) {
+            mx_object_signal(instance->ring_event, 0, INPUT_RING_SIGNAL_CLOSED);
+        }
+        mtx_unlock(&instance->fifo.lock);
     }
     mtx_unlock(&hid->instance_lock);
     device_remove(&hid->dev);
@@ -588,6 +691,11 @@ void hid_io_queue(mx_hid_device_t* hid, const uint8_t* buf, size_t len) {
     mx_hid_instance_t* instance;
     foreach_instance(hid, instance) {
         mtx_lock(&instance->fifo.lock);
+        if (instance->ring) {
+            hid_ring_write(instance, buf, len);
+            mtx_unlock(&instance->fifo.lock);
+            continue;
+        }
         bool was_empty = mx_hid_fifo_size(&instance->fifo) == 0;
         ssize_t wrote = mx_hid_fifo_write(&instance->fifo, buf, len);
         if (wrote <= 0) {
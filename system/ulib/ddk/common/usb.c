@@ -33,6 +33,7 @@ mx_status_t usb_control(mx_device_t* device, uint8_t request_type, uint8_t reque
     setup->wLength = length;
     proto_data->ep_address = 0;
     proto_data->frame = 0;
+    proto_data->stream_id = 0;
 
     bool out = !!((request_type & USB_DIR_MASK) == USB_DIR_OUT);
     if (length > 0 && out) {
@@ -133,6 +134,16 @@ mx_status_t usb_set_interface(mx_device_t* device, int interface_number, int alt
     return device->ops->ioctl(device, IOCTL_USB_SET_INTERFACE, args, sizeof(args), NULL, 0);
 }
 
+mx_status_t usb_enable_streams(mx_device_t* device, uint8_t ep_address, int count) {
+    int args[2] = {ep_address, count};
+    return device->ops->ioctl(device, IOCTL_USB_ENABLE_STREAMS, args, sizeof(args), NULL, 0);
+}
+
+mx_status_t usb_reset_endpoint(mx_device_t* device, uint8_t ep_address) {
+    int arg = ep_address;
+    return device->ops->ioctl(device, IOCTL_USB_RESET_ENDPOINT, &arg, sizeof(arg), NULL, 0);
+}
+
 mx_status_t usb_set_feature(mx_device_t* device, uint8_t request_type, int feature, int index) {
     return usb_control(device, request_type, USB_REQ_SET_FEATURE, feature, index, NULL, 0);
 }
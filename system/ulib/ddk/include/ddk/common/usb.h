@@ -29,6 +29,12 @@ mx_status_t usb_set_configuration(mx_device_t* device, int config);
 
 mx_status_t usb_set_interface(mx_device_t* device, int interface_number, int alt_setting);
 
+// allocates streams on a SuperSpeed bulk endpoint; returns the number allocated
+mx_status_t usb_enable_streams(mx_device_t* device, uint8_t ep_address, int count);
+
+// cancels all transfers on an endpoint and clears a halt on the host side
+mx_status_t usb_reset_endpoint(mx_device_t* device, uint8_t ep_address);
+
 mx_status_t usb_set_feature(mx_device_t* device, uint8_t request_type, int feature, int index);
 
 mx_status_t usb_clear_feature(mx_device_t* device, uint8_t request_type, int feature, int index);
@@ -41,6 +47,11 @@ inline void usb_iotxn_set_frame(iotxn_t* txn, uint64_t frame) {
     ((usb_protocol_data_t *)iotxn_pdata(txn, usb_protocol_data_t))->frame = frame;
 }
 
+// sets the stream a USB iotxn is queued on, for endpoints with streams enabled
+inline void usb_iotxn_set_stream(iotxn_t* txn, uint16_t stream_id) {
+    ((usb_protocol_data_t *)iotxn_pdata(txn, usb_protocol_data_t))->stream_id = stream_id;
+}
+
 // Utilities for iterating through descriptors within a device's USB configuration descriptor
 typedef struct {
     uint8_t* desc;      // start of configuration descriptor
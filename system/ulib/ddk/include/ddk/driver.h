@@ -27,6 +27,9 @@ typedef struct mx_driver_ops {
     // Requests that the driver bind to the provided device,
     // initialize it, and publish and children.
     // On success, the cookie is remembered and passed back on unbind.
+    // A driver that has claimed the device but is still bringing it up
+    // (enumerating a bus, spinning up disks) may return DRV_BIND_PENDING
+    // and call device_bind_complete() when it is done.
 
     void (*unbind)(mx_driver_t* driver, mx_device_t* device, void* cookie);
     // Notifies driver that the device which the driver bound to
@@ -39,6 +42,9 @@ typedef struct mx_driver_ops {
 
 #define DRV_FLAG_NO_AUTOBIND 0x00000001
 
+// returned by bind() when device_bind_complete() will follow
+#define DRV_BIND_PENDING 1
+
 struct mx_driver {
     const char* name;
 
@@ -80,6 +86,10 @@ mx_status_t device_rebind(mx_device_t* device);
 mx_device_t* driver_get_root_device(void);
 mx_device_t* driver_get_misc_device(void);
 
+// Finishes a bind() that returned DRV_BIND_PENDING. If status is an error,
+// the driver is detached from the device as if bind() had failed.
+void device_bind_complete(mx_device_t* dev, mx_status_t status);
+
 // Devices are bindable by drivers by default.
 // This can be used to prevent a device from being bound by a driver
 void device_set_bindable(mx_device_t* dev, bool bindable);
@@ -13,6 +13,7 @@ __BEGIN_CDECLS;
 
 typedef struct iotxn iotxn_t;
 typedef struct iotxn_ops iotxn_ops_t;
+typedef struct iotxn_sg iotxn_sg_t;
 
 // An IO Transaction (iotxn) is an object that records all the state
 // necessary to accomplish an io operation -- the general (len/off)
@@ -97,6 +98,12 @@ struct iotxn {
     uint8_t extra[0];
 };
 
+// a physically contiguous run of an iotxn's buffer, as returned by physmap_sg()
+struct iotxn_sg {
+    mx_paddr_t paddr;
+    size_t length;
+};
+
 #define iotxn_to(txn, type) ((type*) (txn)->extra)
 #define iotxn_pdata(txn, type) ((type*) (txn)->protocol_data)
 
@@ -142,6 +149,18 @@ struct iotxn_ops {
     // be the buffer itself, or a temporary, depending on conditions.
     void (*physmap)(iotxn_t* txn, mx_paddr_t* addr);
 
+    // physmap_sg() describes the physical memory backing length bytes of the
+    // iotxn's buffer, starting at offset, as a list of physically contiguous
+    // runs.  Physically adjacent pages are merged into a single run.  Unlike
+    // physmap(), no temporary buffer is ever used, so it is suitable for
+    // hardware which can gather from (or scatter to) multiple addresses.
+    //
+    // On success *count holds the number of runs written to sg.  Returns
+    // ERR_BUFFER_TOO_SMALL if the range needs more than max runs, and
+    // ERR_OUT_OF_RANGE if it extends beyond the iotxn's buffer.
+    mx_status_t (*physmap_sg)(iotxn_t* txn, mx_off_t offset, size_t length,
+                              iotxn_sg_t* sg, size_t max, size_t* count);
+
     // mmap() returns a void* pointing at the data in the iotxn's buffer.
     // This may have to do an expensive memory map operation or copy data
     // to a local buffer.  copyfrom(), copyto(), or physmap() are almost
@@ -29,6 +29,11 @@ typedef struct mx_display_protocol {
 
     void (*flush)(mx_device_t* dev);
     // flushes the framebuffer
+
+    void (*flush_region)(mx_device_t* dev, uint32_t x, uint32_t y, uint32_t width, uint32_t height);
+    // optional: flushes only the given rectangle of the framebuffer; for
+    // devices which copy the framebuffer out, this saves moving pixels
+    // which did not change
 } mx_display_protocol_t;
 
 __END_CDECLS;
@@ -6,6 +6,7 @@
 
 #include <ddk/driver.h>
 #include <magenta/compiler.h>
+#include <magenta/device/ethernet.h>
 #include <magenta/hw/usb.h>
 #include <stdbool.h>
 
@@ -27,7 +28,8 @@ typedef struct ethernet_protocol {
 //
 // TODO: Implement zero-copy interface in the ethernet common
 // middle layer driver.  Currently ethermac drivers that request
-// these will not be loaded.
+// these will not be loaded.  Programming a client's io buffer
+// pages into descriptors first needs the kernel to pin them.
 
 #define ETHMAC_FEATURE_RX_QUEUE (1u)
 #define ETHMAC_FEATURE_TX_QUEUE (2u)
@@ -42,12 +44,28 @@ typedef struct ethmac_info {
 
 #define ETHMAC_STATUS_ONLINE (1u)
 
+// flags for recv() and ethmac_rx_frame_t
+// the device has checked the frame's tcp/udp checksum
+#define ETHMAC_RX_CSUM_VALID (1u)
+
+// A received frame, as handed up by recv_batch()
+typedef struct ethmac_rx_frame {
+    void* data;
+    size_t length;
+    uint32_t flags;
+} ethmac_rx_frame_t;
+
 typedef struct ethmac_ifc_virt {
     void (*status)(void* cookie, uint32_t status);
 
     // recv() is invoked when FEATURE_RX_QUEUE is not present
     void (*recv)(void* cookie, void* data, size_t length, uint32_t flags);
 
+    // recv_batch() may be used instead of recv() to hand up every frame
+    // received in one interrupt or transfer at once, which lets the
+    // ethernet layer return them to its clients together
+    void (*recv_batch)(void* cookie, ethmac_rx_frame_t* frames, size_t count);
+
     // complete_?x() is invoked when FEATURE_?X_QUEUE is present
     void (*complete_rx)(void* cookie, uint32_t length, uint32_t flags);
     void (*complete_tx)(void* cookie, uint32_t count);
@@ -81,6 +99,13 @@ typedef struct ethmac_protocol {
                      uintptr_t pa0, uintptr_t pa1, size_t length);
     void (*queue_rx)(mx_device_t* dev, uint32_t options,
                      uintptr_t pa0, uintptr_t pa1, size_t length);
+
+    // Optional.  get_stats() fills in the counters the ethermac keeps;
+    // the ethernet layer adds packets it drops itself.
+    // set_moderation() applies interrupt moderation settings, and may
+    // be called whether running or not.
+    mx_status_t (*get_stats)(mx_device_t* dev, eth_stats_t* stats);
+    mx_status_t (*set_moderation)(mx_device_t* dev, const eth_moderation_t* mod);
 } ethmac_protocol_t;
 
 
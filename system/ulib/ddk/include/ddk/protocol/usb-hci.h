@@ -19,6 +19,15 @@ typedef struct usb_hci_protocol {
     mx_status_t (*enable_endpoint)(mx_device_t* hci_device, uint32_t device_id,
                                    usb_endpoint_descriptor_t* ep_desc, bool enable);
 
+    // allocates count streams on a SuperSpeed bulk endpoint, or frees them if count is zero.
+    // returns the number of streams allocated, which may be fewer than count
+    mx_status_t (*enable_streams)(mx_device_t* hci_device, uint32_t device_id, uint8_t ep_address,
+                                  uint32_t count);
+
+    // completes everything queued on an endpoint with ERR_REMOTE_CLOSED, and
+    // resets the endpoint if it has halted
+    mx_status_t (*reset_endpoint)(mx_device_t* hci_device, uint32_t device_id, uint8_t ep_address);
+
     // returns the current frame (in milliseconds), used for isochronous transfers
     uint64_t (*get_current_frame)(mx_device_t* hci_device);
 
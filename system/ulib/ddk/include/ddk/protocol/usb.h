@@ -17,6 +17,7 @@ typedef struct usb_protocol_data {
     uint64_t frame;         // frame number for scheduling isochronous transfers
     uint32_t device_id;
     uint8_t ep_address;     // bEndpointAddress from endpoint descriptor
+    uint16_t stream_id;     // for bulk endpoints with streams enabled, 0 otherwise
 } usb_protocol_data_t;
 
 __END_CDECLS;
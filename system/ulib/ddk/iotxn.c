@@ -7,6 +7,7 @@
 #include <ddk/iotxn.h>
 #include <ddk/device.h>
 #include <magenta/syscalls.h>
+#include <limits.h>
 #include <sys/param.h>
 #include <stdlib.h>
 #include <stdio.h>
@@ -25,6 +26,10 @@
 
 #define IOTXN_FLAG_CLONE (1 << 0)
 #define IOTXN_FLAG_FREE  (1 << 1)   // for double-free checking
+#define IOTXN_FLAG_CONTIGUOUS (1 << 2) // buffer is physically contiguous
+
+// pages looked up per MX_VMO_OP_LOOKUP call in physmap_sg()
+#define IOTXN_SG_LOOKUP_PAGES 32
 
 typedef struct iotxn_priv iotxn_priv_t;
 
@@ -74,6 +79,67 @@ static void iotxn_physmap(iotxn_t* txn, mx_paddr_t* addr) {
     *addr = priv->buffer.phys;
 }
 
+static mx_status_t iotxn_physmap_sg(iotxn_t* txn, mx_off_t offset, size_t length,
+                                    iotxn_sg_t* sg, size_t max, size_t* count) {
+    iotxn_priv_t* priv = get_priv(txn);
+    if ((offset > priv->data_size) || (length > priv->data_size - offset)) {
+        return ERR_OUT_OF_RANGE;
+    }
+    if (length == 0) {
+        *count = 0;
+        return NO_ERROR;
+    }
+    if (max == 0) {
+        return ERR_BUFFER_TOO_SMALL;
+    }
+
+    if (priv->flags & IOTXN_FLAG_CONTIGUOUS) {
+        sg[0].paddr = io_buffer_phys(&priv->buffer) + offset;
+        sg[0].length = length;
+        *count = 1;
+        return NO_ERROR;
+    }
+
+    // pages must be committed before they can be looked up
+    mx_handle_t vmo = priv->buffer.vmo_handle;
+    mx_off_t start = priv->buffer.offset + offset;
+    mx_off_t end = start + length;
+    mx_status_t status = mx_vmo_op_range(vmo, MX_VMO_OP_COMMIT, start, length, NULL, 0);
+    if (status != NO_ERROR) {
+        xprintf("iotxn_physmap_sg: commit failed %d\n", status);
+        return status;
+    }
+
+    mx_paddr_t pages[IOTXN_SG_LOOKUP_PAGES];
+    size_t n = 0;
+    mx_off_t page = start & ~((mx_off_t)PAGE_SIZE - 1);
+    while (page < end) {
+        size_t chunk = MIN(end - page, sizeof(pages) / sizeof(pages[0]) * PAGE_SIZE);
+        status = mx_vmo_op_range(vmo, MX_VMO_OP_LOOKUP, page, chunk, pages, sizeof(pages));
+        if (status != NO_ERROR) {
+            xprintf("iotxn_physmap_sg: lookup failed %d\n", status);
+            return status;
+        }
+        size_t npages = (chunk + PAGE_SIZE - 1) / PAGE_SIZE;
+        for (size_t i = 0; i < npages; i++, page += PAGE_SIZE) {
+            mx_off_t lo = MAX(page, start);
+            mx_off_t hi = MIN(page + PAGE_SIZE, end);
+            mx_paddr_t paddr = pages[i] + (lo - page);
+            if ((n > 0) && (sg[n - 1].paddr + sg[n - 1].length == paddr)) {
+                sg[n - 1].length += hi - lo;
+            } else if (n == max) {
+                return ERR_BUFFER_TOO_SMALL;
+            } else {
+                sg[n].paddr = paddr;
+                sg[n].length = hi - lo;
+                n++;
+            }
+        }
+    }
+    *count = n;
+    return NO_ERROR;
+}
+
 static void iotxn_mmap(iotxn_t* txn, void** data) {
     iotxn_priv_t* priv = get_priv(txn);
     *data = io_buffer_virt(&priv->buffer);
@@ -152,6 +218,7 @@ static mx_status_t iotxn_clone(iotxn_t* txn, iotxn_t** out, size_t extra_size) {
         return status;
     }
     cpriv->data_size = priv->data_size;
+    cpriv->flags = (cpriv->flags & ~IOTXN_FLAG_CONTIGUOUS) | (priv->flags & IOTXN_FLAG_CONTIGUOUS);
     memcpy(&cpriv->txn, txn, sizeof(iotxn_t));
     cpriv->txn.complete_cb = NULL; // clear the complete cb
     *out = &cpriv->txn;
@@ -168,6 +235,7 @@ static iotxn_ops_t ops = {
     .copyfrom = iotxn_copyfrom,
     .copyto = iotxn_copyto,
     .physmap = iotxn_physmap,
+    .physmap_sg = iotxn_physmap_sg,
     .mmap = iotxn_mmap,
     .clone = iotxn_clone,
     .release = iotxn_release,
@@ -213,6 +281,7 @@ mx_status_t iotxn_alloc(iotxn_t** out, uint32_t flags, size_t data_size, size_t
 
     // layout is iotxn_priv_t | extra_size
     priv->extra_size = extra_size;
+    priv->flags |= IOTXN_FLAG_CONTIGUOUS;
 out:
     priv->data_size = data_size;
     priv->txn.ops = &ops;
@@ -228,6 +297,7 @@ mx_status_t iotxn_alloc_vmo(iotxn_t** out, mx_handle_t vmo_handle, size_t data_s
 
     io_buffer_init_vmo(&priv->buffer, vmo_handle, data_offset, IO_BUFFER_RW);
     priv->data_size = data_size;
+    priv->flags &= ~IOTXN_FLAG_CONTIGUOUS;
 
     *out = &priv->txn;
     return NO_ERROR;
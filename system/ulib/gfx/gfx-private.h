@@ -0,0 +1,131 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <magenta/compiler.h>
+
+__BEGIN_CDECLS
+
+// Row kernels behind fills, blends and format conversions. Every set
+// produces bit-identical results to the scalar one, which the vector sets
+// also use for the pixels left over at the end of a row.
+typedef struct gfx_kernels {
+    unsigned simd;
+
+    void (*fill16)(uint16_t* dst, uint16_t color, size_t count);
+    void (*fill32)(uint32_t* dst, uint32_t color, size_t count);
+
+    // ARGB8888 over ARGB8888; blend takes straight alpha in the source,
+    // blend_premul premultiplied alpha
+    void (*blend)(uint32_t* dst, const uint32_t* src, size_t count);
+    void (*blend_premul)(uint32_t* dst, const uint32_t* src, size_t count);
+
+    // ARGB8888 to the narrower formats
+    void (*to_rgb565)(uint16_t* dst, const uint32_t* src, size_t count);
+    void (*to_rgb332)(uint8_t* dst, const uint32_t* src, size_t count);
+    void (*to_rgb2220)(uint8_t* dst, const uint32_t* src, size_t count);
+    void (*to_luma)(uint8_t* dst, const uint32_t* src, size_t count);
+} gfx_kernels_t;
+
+extern const gfx_kernels_t gfx_kernels_c;
+#if defined(__x86_64__)
+extern const gfx_kernels_t gfx_kernels_sse2;
+extern const gfx_kernels_t gfx_kernels_avx2;
+bool gfx_cpu_has_avx2(void);
+#elif defined(__aarch64__)
+extern const gfx_kernels_t gfx_kernels_neon;
+#endif
+
+// the kernel set in use, chosen for this cpu on first call
+const gfx_kernels_t* gfx_kernels(void);
+
+// x / 255, rounded, for x in [0, 255 * 255]
+static inline uint32_t gfx_div255(uint32_t x) {
+    x += 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+// Source over destination, straight alpha. The destination is taken to be
+// opaque for the color channels; its alpha is combined as for
+// premultiplied over so that an opaque destination stays opaque.
+static inline uint32_t gfx_blend_pixel(uint32_t dst, uint32_t src) {
+    uint32_t a = src >> 24;
+    if (a == 0) {
+        return dst;
+    } else if (a == 255) {
+        return src;
+    }
+    uint32_t ia = 255 - a;
+    uint32_t out = gfx_div255(255 * a + (dst >> 24) * ia) << 24;
+    for (unsigned shift = 0; shift < 24; shift += 8) {
+        uint32_t s = (src >> shift) & 0xff;
+        uint32_t d = (dst >> shift) & 0xff;
+        out |= gfx_div255(s * a + d * ia) << shift;
+    }
+    return out;
+}
+
+// Source over destination, premultiplied alpha. Channels of a malformed
+// source (color above alpha) saturate rather than wrap.
+static inline uint32_t gfx_blend_premul_pixel(uint32_t dst, uint32_t src) {
+    uint32_t ia = 255 - (src >> 24);
+    uint32_t out = 0;
+    for (unsigned shift = 0; shift < 32; shift += 8) {
+        uint32_t c = ((src >> shift) & 0xff) + gfx_div255(((dst >> shift) & 0xff) * ia);
+        out |= (c > 255 ? 255 : c) << shift;
+    }
+    return out;
+}
+
+// Convert a 32bit ARGB image to its respective gamma corrected grayscale value.
+static inline uint32_t ARGB8888_to_Luma(uint32_t in) {
+    uint8_t out;
+
+    uint32_t blue = (in & 0xFF) * 74;
+    uint32_t green = ((in >> 8) & 0xFF) * 732;
+    uint32_t red = ((in >> 16) & 0xFF) * 218;
+
+    uint32_t intensity = red + blue + green;
+
+    out = (intensity >> 10) & 0xFF;
+
+    return out;
+}
+
+static inline uint32_t ARGB8888_to_RGB565(uint32_t in) {
+    uint16_t out;
+
+    out = (in >> 3) & 0x1f;           // b
+    out |= ((in >> 10) & 0x3f) << 5;  // g
+    out |= ((in >> 19) & 0x1f) << 11; // r
+
+    return out;
+}
+
+static inline uint32_t ARGB8888_to_RGB332(uint32_t in) {
+    uint8_t out = 0;
+
+    out = (in >> 6) & 0x3;          // b
+    out |= ((in >> 13) & 0x7) << 2; // g
+    out |= ((in >> 21) & 0x7) << 5; // r
+
+    return out;
+}
+
+static inline uint32_t ARGB8888_to_RGB2220(uint32_t in) {
+    uint8_t out = 0;
+
+    out = ((in >> 6) & 0x3) << 2;
+    out |= ((in >> 14) & 0x3) << 4;
+    out |= ((in >> 22) & 0x3) << 6;
+
+    return out;
+}
+
+__END_CDECLS
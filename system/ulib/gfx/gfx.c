@@ -21,6 +21,8 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include "gfx-private.h"
+
 #define TRACE 0
 
 #if TRACE
@@ -31,51 +33,6 @@
     } while (0)
 #endif
 
-// Convert a 32bit ARGB image to its respective gamma corrected grayscale value.
-static uint32_t ARGB8888_to_Luma(uint32_t in) {
-    uint8_t out;
-
-    uint32_t blue = (in & 0xFF) * 74;
-    uint32_t green = ((in >> 8) & 0xFF) * 732;
-    uint32_t red = ((in >> 16) & 0xFF) * 218;
-
-    uint32_t intensity = red + blue + green;
-
-    out = (intensity >> 10) & 0xFF;
-
-    return out;
-}
-
-static uint32_t ARGB8888_to_RGB565(uint32_t in) {
-    uint16_t out;
-
-    out = (in >> 3) & 0x1f;           // b
-    out |= ((in >> 10) & 0x3f) << 5;  // g
-    out |= ((in >> 19) & 0x1f) << 11; // r
-
-    return out;
-}
-
-static uint32_t ARGB8888_to_RGB332(uint32_t in) {
-    uint8_t out = 0;
-
-    out = (in >> 6) & 0x3;          // b
-    out |= ((in >> 13) & 0x7) << 2; // g
-    out |= ((in >> 21) & 0x7) << 5; // r
-
-    return out;
-}
-
-static uint32_t ARGB8888_to_RGB2220(uint32_t in) {
-    uint8_t out = 0;
-
-    out = ((in >> 6) & 0x3) << 2;
-    out |= ((in >> 14) & 0x3) << 4;
-    out |= ((in >> 22) & 0x3) << 6;
-
-    return out;
-}
-
 /**
  * @brief  Copy a rectangle of pixels from one part of the display to another.
  */
@@ -214,154 +171,75 @@ void gfx_putchar(gfx_surface* surface, const gfx_font* font, unsigned ch, unsign
     surface->putchar(surface, font, ch, x, y, fg, bg);
 }
 
-static void copyrect8(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
-    // copy
-    const uint8_t* src = &((const uint8_t*)surface->ptr)[x + y * surface->stride];
-    uint8_t* dest = &((uint8_t*)surface->ptr)[x2 + y2 * surface->stride];
-    unsigned stride_diff = surface->stride - width;
+// Rows are moved whole; memmove copes with the overlap within a row and the
+// row order copes with the overlap between rows.
+static void copyrect(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
+    size_t pitch = surface->stride * surface->pixelsize;
+    size_t len = width * surface->pixelsize;
+    const uint8_t* src = (const uint8_t*)surface->ptr + y * pitch + x * surface->pixelsize;
+    uint8_t* dest = (uint8_t*)surface->ptr + y2 * pitch + x2 * surface->pixelsize;
 
     if (dest < src) {
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += stride_diff;
-            src += stride_diff;
+        for (unsigned i = 0; i < height; i++) {
+            memmove(dest, src, len);
+            dest += pitch;
+            src += pitch;
         }
     } else {
         // copy backwards
-        src += (height-1) * surface->stride + (width-1);
-        dest += (height-1) * surface->stride + (width-1);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest--;
-                src--;
-            }
-            dest -= stride_diff;
-            src -= stride_diff;
+        src += (height - 1) * pitch;
+        dest += (height - 1) * pitch;
+        for (unsigned i = 0; i < height; i++) {
+            memmove(dest, src, len);
+            dest -= pitch;
+            src -= pitch;
         }
     }
 }
 
 static void fillrect8(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
     uint8_t* dest = &((uint8_t*)surface->ptr)[x + y * surface->stride];
-    unsigned stride_diff = surface->stride - width;
 
     uint8_t color8 = (uint8_t)(surface->translate_color(color));
 
-    unsigned i, j;
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            *dest = color8;
-            dest++;
-        }
-        dest += stride_diff;
+    // whole rows are contiguous, so fill them in one go
+    if (width == surface->stride) {
+        width *= height;
+        height = 1;
     }
-}
-
-static void copyrect16(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
-    // copy
-    const uint16_t* src = &((const uint16_t*)surface->ptr)[x + y * surface->stride];
-    uint16_t* dest = &((uint16_t*)surface->ptr)[x2 + y2 * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    if (dest < src) {
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += stride_diff;
-            src += stride_diff;
-        }
-    } else {
-        // copy backwards
-        src += (height-1) * surface->stride + (width-1);
-        dest += (height-1) * surface->stride + (width-1);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest--;
-                src--;
-            }
-            dest -= stride_diff;
-            src -= stride_diff;
-        }
+    for (unsigned i = 0; i < height; i++) {
+        memset(dest, color8, width);
+        dest += surface->stride;
     }
 }
 
 static void fillrect16(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
     uint16_t* dest = &((uint16_t*)surface->ptr)[x + y * surface->stride];
-    unsigned stride_diff = surface->stride - width;
 
     uint16_t color16 = (uint16_t)(surface->translate_color(color));
 
-    unsigned i, j;
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            *dest = color16;
-            dest++;
-        }
-        dest += stride_diff;
+    const gfx_kernels_t* k = gfx_kernels();
+    if (width == surface->stride) {
+        width *= height;
+        height = 1;
     }
-}
-
-static void copyrect32(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned x2, unsigned y2) {
-    // copy
-    const uint32_t* src = &((const uint32_t*)surface->ptr)[x + y * surface->stride];
-    uint32_t* dest = &((uint32_t*)surface->ptr)[x2 + y2 * surface->stride];
-    unsigned stride_diff = surface->stride - width;
-
-    if (dest < src) {
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += stride_diff;
-            src += stride_diff;
-        }
-    } else {
-        // copy backwards
-        src += (height-1) * surface->stride + (width-1);
-        dest += (height-1) * surface->stride + (width-1);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest--;
-                src--;
-            }
-            dest -= stride_diff;
-            src -= stride_diff;
-        }
+    for (unsigned i = 0; i < height; i++) {
+        k->fill16(dest, color16, width);
+        dest += surface->stride;
     }
 }
 
 static void fillrect32(gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height, unsigned color) {
     uint32_t* dest = &((uint32_t*)surface->ptr)[x + y * surface->stride];
-    unsigned stride_diff = surface->stride - width;
 
-    unsigned i, j;
-    for (i = 0; i < height; i++) {
-        for (j = 0; j < width; j++) {
-            *dest = color;
-            dest++;
-        }
-        dest += stride_diff;
+    const gfx_kernels_t* k = gfx_kernels();
+    if (width == surface->stride) {
+        width *= height;
+        height = 1;
+    }
+    for (unsigned i = 0; i < height; i++) {
+        k->fill32(dest, color, width);
+        dest += surface->stride;
     }
 }
 
@@ -416,57 +294,105 @@ void gfx_line(gfx_surface* surface, unsigned x1, unsigned y1, unsigned x2, unsig
     }
 }
 
-uint32_t alpha32_add_ignore_destalpha(uint32_t dest, uint32_t src) {
-    uint32_t cdest[3];
-    uint32_t csrc[3];
+/**
+ * @brief  Blend all of the source onto the target.
+ */
+void gfx_surface_blend(struct gfx_surface* target, struct gfx_surface* source, unsigned destx, unsigned desty) {
+    gfx_blend(target, source, 0, 0, source->width, source->height, destx, desty);
+}
 
-    uint32_t srca;
-    uint32_t srcainv;
+// pixels converted per pass when source and target formats differ
+#define BLEND_CHUNK 256
 
-    srca = (src >> 24) & 0xff;
-    if (srca == 0) {
-        return dest;
-    } else if (srca == 255) {
-        return src;
+// widen a row of any supported format to ARGB8888
+static void expand_row(uint32_t* dst, const void* src, unsigned format, size_t count) {
+    switch (format) {
+    case MX_PIXEL_FORMAT_ARGB_8888:
+        memcpy(dst, src, count * 4);
+        break;
+    case MX_PIXEL_FORMAT_RGB_x888: {
+        const uint32_t* s = src;
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = s[i] | 0xff000000;
+        }
+        break;
     }
-    srca++;
-    srcainv = (255 - srca);
-
-    cdest[0] = (dest >> 16) & 0xff;
-    cdest[1] = (dest >> 8) & 0xff;
-    cdest[2] = (dest >> 0) & 0xff;
-
-    csrc[0] = (src >> 16) & 0xff;
-    csrc[1] = (src >> 8) & 0xff;
-    csrc[2] = (src >> 0) & 0xff;
-
-    //    if (srca > 0)
-    //        printf("s %d %d %d d %d %d %d a %d ai %d\n", csrc[0], csrc[1], csrc[2], cdest[0], cdest[1], cdest[2], srca, srcainv);
-
-    uint32_t cres[3];
-
-    cres[0] = ((csrc[0] * srca) / 256) + ((cdest[0] * srcainv) / 256);
-    cres[1] = ((csrc[1] * srca) / 256) + ((cdest[1] * srcainv) / 256);
-    cres[2] = ((csrc[2] * srca) / 256) + ((cdest[2] * srcainv) / 256);
+    case MX_PIXEL_FORMAT_RGB_565: {
+        const uint16_t* s = src;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t r = (s[i] >> 11) & 0x1f;
+            uint32_t g = (s[i] >> 5) & 0x3f;
+            uint32_t b = s[i] & 0x1f;
+            r = (r << 3) | (r >> 2);
+            g = (g << 2) | (g >> 4);
+            b = (b << 3) | (b >> 2);
+            dst[i] = 0xff000000 | (r << 16) | (g << 8) | b;
+        }
+        break;
+    }
+    case MX_PIXEL_FORMAT_RGB_332: {
+        const uint8_t* s = src;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t r = (s[i] >> 5) & 0x7;
+            uint32_t g = (s[i] >> 2) & 0x7;
+            uint32_t b = s[i] & 0x3;
+            r = (r << 5) | (r << 2) | (r >> 1);
+            g = (g << 5) | (g << 2) | (g >> 1);
+            b *= 0x55;
+            dst[i] = 0xff000000 | (r << 16) | (g << 8) | b;
+        }
+        break;
+    }
+    case MX_PIXEL_FORMAT_RGB_2220: {
+        const uint8_t* s = src;
+        for (size_t i = 0; i < count; i++) {
+            uint32_t r = ((s[i] >> 6) & 0x3) * 0x55;
+            uint32_t g = ((s[i] >> 4) & 0x3) * 0x55;
+            uint32_t b = ((s[i] >> 2) & 0x3) * 0x55;
+            dst[i] = 0xff000000 | (r << 16) | (g << 8) | b;
+        }
+        break;
+    }
+    case MX_PIXEL_FORMAT_MONO_1: {
+        const uint8_t* s = src;
+        for (size_t i = 0; i < count; i++) {
+            dst[i] = 0xff000000 | (s[i] * 0x010101);
+        }
+        break;
+    }
+    }
+}
 
-    return (srca << 24) | (cres[0] << 16) | (cres[1] << 8) | (cres[2]);
+// narrow a row of ARGB8888 to any supported format
+static void convert_row(const gfx_kernels_t* k, void* dst, const uint32_t* src, unsigned format, size_t count) {
+    switch (format) {
+    case MX_PIXEL_FORMAT_ARGB_8888:
+    case MX_PIXEL_FORMAT_RGB_x888:
+        memcpy(dst, src, count * 4);
+        break;
+    case MX_PIXEL_FORMAT_RGB_565:
+        k->to_rgb565(dst, src, count);
+        break;
+    case MX_PIXEL_FORMAT_RGB_332:
+        k->to_rgb332(dst, src, count);
+        break;
+    case MX_PIXEL_FORMAT_RGB_2220:
+        k->to_rgb2220(dst, src, count);
+        break;
+    case MX_PIXEL_FORMAT_MONO_1:
+        k->to_luma(dst, src, count);
+        break;
+    }
 }
 
-/**
- * @brief  Copy pixels from source to dest.
- *
- * Currently does not support alpha channel.
- */
-void gfx_surface_blend(struct gfx_surface* target, struct gfx_surface* source, unsigned destx, unsigned desty) {
-    gfx_blend(target, source, 0, 0, source->width, source->height, destx, desty);
+static bool format_is_32bit(unsigned format) {
+    return (format == MX_PIXEL_FORMAT_ARGB_8888) || (format == MX_PIXEL_FORMAT_RGB_x888);
 }
 
 /**
- * @brief  Copy pixels from source to dest.
+ * @brief  Blend or copy pixels from source to dest.
  */
 void gfx_blend(gfx_surface* target, gfx_surface* source, unsigned srcx, unsigned srcy, unsigned width, unsigned height, unsigned destx, unsigned desty) {
-    assert(target->format == source->format);
-
     xprintf("target %p, source %p, srcx %u, srcy %u, width %u, height %u, destx %u, desty %u\n", target, source, srcx, srcy, width, height, destx, desty);
 
     if (destx >= target->width)
@@ -489,87 +415,49 @@ void gfx_blend(gfx_surface* target, gfx_surface* source, unsigned srcx, unsigned
     if (srcy + height > source->height)
         height = source->height - srcy;
 
-    // XXX total hack to deal with various blends
-    if (source->format == MX_PIXEL_FORMAT_RGB_565 && target->format == MX_PIXEL_FORMAT_RGB_565) {
-        // 16 bit to 16 bit
-        const uint16_t* src = &((const uint16_t*)source->ptr)[srcx + srcy * source->stride];
-        uint16_t* dest = &((uint16_t*)target->ptr)[destx + desty * target->stride];
-        unsigned dest_stride_diff = target->stride - width;
-        unsigned source_stride_diff = source->stride - width;
-
-        xprintf("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += dest_stride_diff;
-            src += source_stride_diff;
-        }
-    } else if (source->format == MX_PIXEL_FORMAT_ARGB_8888 && target->format == MX_PIXEL_FORMAT_ARGB_8888) {
-        // both are 32 bit modes, both alpha
-        const uint32_t* src = &((const uint32_t*)source->ptr)[srcx + srcy * source->stride];
-        uint32_t* dest = &((uint32_t*)target->ptr)[destx + desty * target->stride];
-        unsigned dest_stride_diff = target->stride - width;
-        unsigned source_stride_diff = source->stride - width;
-
-        xprintf("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                // XXX ignores destination alpha
-                *dest = alpha32_add_ignore_destalpha(*dest, *src);
-                dest++;
-                src++;
-            }
-            dest += dest_stride_diff;
-            src += source_stride_diff;
-        }
-    } else if (source->format == MX_PIXEL_FORMAT_RGB_x888 && target->format == MX_PIXEL_FORMAT_RGB_x888) {
-        // both are 32 bit modes, no alpha
-        const uint32_t* src = &((const uint32_t*)source->ptr)[srcx + srcy * source->stride];
-        uint32_t* dest = &((uint32_t*)target->ptr)[destx + desty * target->stride];
-        unsigned dest_stride_diff = target->stride - width;
-        unsigned source_stride_diff = source->stride - width;
-
-        xprintf("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
-            }
-            dest += dest_stride_diff;
-            src += source_stride_diff;
-        }
-    } else if (source->format == MX_PIXEL_FORMAT_MONO_1 && target->format == MX_PIXEL_FORMAT_MONO_1) {
-        // both are 8 bit modes, no alpha
-        const uint8_t* src = &((const uint8_t*)source->ptr)[srcx + srcy * source->stride];
-        uint8_t* dest = &((uint8_t*)target->ptr)[destx + desty * target->stride];
-        unsigned dest_stride_diff = target->stride - width;
-        unsigned source_stride_diff = source->stride - width;
-
-        xprintf("w %u h %u dstride %u sstride %u\n", width, height, dest_stride_diff, source_stride_diff);
-
-        unsigned i, j;
-        for (i = 0; i < height; i++) {
-            for (j = 0; j < width; j++) {
-                *dest = *src;
-                dest++;
-                src++;
+    if (width == 0 || height == 0)
+        return;
+
+    const gfx_kernels_t* k = gfx_kernels();
+    void (*blend)(uint32_t*, const uint32_t*, size_t) = NULL;
+    if (source->format == MX_PIXEL_FORMAT_ARGB_8888) {
+        blend = (source->flags & GFX_FLAG_PREMULTIPLIED) ? k->blend_premul : k->blend;
+    }
+
+    size_t src_pitch = source->stride * source->pixelsize;
+    size_t dest_pitch = target->stride * target->pixelsize;
+    const uint8_t* src = (const uint8_t*)source->ptr + srcy * src_pitch + srcx * source->pixelsize;
+    uint8_t* dest = (uint8_t*)target->ptr + desty * dest_pitch + destx * target->pixelsize;
+
+    for (unsigned i = 0; i < height; i++) {
+        if (blend && format_is_32bit(target->format)) {
+            // 32 bit targets are blended in place
+            blend((uint32_t*)dest, (const uint32_t*)src, width);
+        } else if (source->format == target->format) {
+            memmove(dest, src, width * source->pixelsize);
+        } else if (source->format == MX_PIXEL_FORMAT_RGB_x888 &&
+                   target->format == MX_PIXEL_FORMAT_ARGB_8888) {
+            expand_row((uint32_t*)dest, src, source->format, width);
+        } else if (format_is_32bit(source->format) && !blend) {
+            convert_row(k, dest, (const uint32_t*)src, target->format, width);
+        } else {
+            // anything else goes through ARGB8888, a chunk at a time
+            uint32_t tmp[BLEND_CHUNK];
+            for (unsigned x = 0; x < width; x += BLEND_CHUNK) {
+                unsigned n = (width - x < BLEND_CHUNK) ? (width - x) : BLEND_CHUNK;
+                const uint8_t* s = src + x * source->pixelsize;
+                uint8_t* d = dest + x * target->pixelsize;
+                if (blend) {
+                    expand_row(tmp, d, target->format, n);
+                    blend(tmp, (const uint32_t*)s, n);
+                } else {
+                    expand_row(tmp, s, source->format, n);
+                }
+                convert_row(k, d, tmp, target->format, n);
             }
-            dest += dest_stride_diff;
-            src += source_stride_diff;
         }
-    } else {
-        xprintf("gfx_surface_blend: unimplemented colorspace combination (source %d target %d)\n", source->format, target->format);
-        assert(0);
+        src += src_pitch;
+        dest += dest_pitch;
     }
 }
 
@@ -582,7 +470,9 @@ void gfx_flush(gfx_surface* surface) {
         arch_clean_cache_range((addr_t)surface->ptr, surface->len);
 #endif
 
-    if (surface->flush)
+    if (surface->flush_rect)
+        surface->flush_rect(0, 0, surface->width, surface->height);
+    else if (surface->flush)
         surface->flush(0, surface->height - 1);
 }
 
@@ -608,10 +498,29 @@ void gfx_flush_rows(struct gfx_surface* surface, unsigned start, unsigned end) {
     }
 #endif
 
-    if (surface->flush)
+    if (surface->flush_rect)
+        surface->flush_rect(0, start, surface->width, end - start + 1);
+    else if (surface->flush)
         surface->flush(start, end);
 }
 
+/**
+ * @brief  Ensure that a rectangle of the display is up to date.
+ */
+void gfx_flush_rect(struct gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height) {
+    if (x >= surface->width || y >= surface->height || width == 0 || height == 0)
+        return;
+    if (width > surface->width - x)
+        width = surface->width - x;
+    if (height > surface->height - y)
+        height = surface->height - y;
+
+    if (surface->flush_rect)
+        surface->flush_rect(x, y, width, height);
+    else if (surface->flush)
+        surface->flush(y, y + height - 1);
+}
+
 /**
  * @brief  Create a new graphics surface object
  */
@@ -644,7 +553,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
     switch (format) {
     case MX_PIXEL_FORMAT_RGB_565:
         surface->translate_color = &ARGB8888_to_RGB565;
-        surface->copyrect = &copyrect16;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect16;
         surface->putpixel = &putpixel16;
         surface->putchar = &putchar16;
@@ -654,7 +563,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
     case MX_PIXEL_FORMAT_RGB_x888:
     case MX_PIXEL_FORMAT_ARGB_8888:
         surface->translate_color = NULL;
-        surface->copyrect = &copyrect32;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect32;
         surface->putpixel = &putpixel32;
         surface->putchar = &putchar32;
@@ -663,7 +572,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
         break;
     case MX_PIXEL_FORMAT_MONO_1:
         surface->translate_color = &ARGB8888_to_Luma;
-        surface->copyrect = &copyrect8;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect8;
         surface->putpixel = &putpixel8;
         surface->putchar = &putchar8;
@@ -672,7 +581,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
         break;
     case MX_PIXEL_FORMAT_RGB_332:
         surface->translate_color = &ARGB8888_to_RGB332;
-        surface->copyrect = &copyrect8;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect8;
         surface->putpixel = &putpixel8;
         surface->putchar = &putchar8;
@@ -681,7 +590,7 @@ int gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, unsigned h
         break;
     case MX_PIXEL_FORMAT_RGB_2220:
         surface->translate_color = &ARGB8888_to_RGB2220;
-        surface->copyrect = &copyrect8;
+        surface->copyrect = &copyrect;
         surface->fillrect = &fillrect8;
         surface->putpixel = &putpixel8;
         surface->putchar = &putchar8;
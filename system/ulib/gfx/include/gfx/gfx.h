@@ -22,6 +22,13 @@ __BEGIN_CDECLS
 // surface flags
 #define GFX_FLAG_FREE_ON_DESTROY (1 << 0) // free the ptr at destroy
 #define GFX_FLAG_FLUSH_CPU_CACHE (1 << 1) // do a cache flush during gfx_flush
+#define GFX_FLAG_PREMULTIPLIED   (1 << 2) // ARGB pixels carry premultiplied alpha
+
+// vector kernel sets used for fills, blends and format conversions
+#define GFX_SIMD_NONE 0
+#define GFX_SIMD_SSE2 1
+#define GFX_SIMD_AVX2 2
+#define GFX_SIMD_NEON 3
 
 typedef struct gfx_surface gfx_surface;
 typedef struct gfx_font gfx_font;
@@ -53,6 +60,9 @@ struct gfx_surface {
     void (*putpixel)(gfx_surface*, unsigned x, unsigned y, unsigned color);
     void (*putchar)(gfx_surface*, const gfx_font*, unsigned ch, unsigned x, unsigned y, unsigned fg, unsigned bg);
     void (*flush)(unsigned starty, unsigned endy);
+    // optional: if set, flushes go through here instead, naming the
+    // rectangle which changed
+    void (*flush_rect)(unsigned x, unsigned y, unsigned width, unsigned height);
 };
 
 struct gfx_font {
@@ -77,6 +87,10 @@ void gfx_putchar(gfx_surface*, const gfx_font*, unsigned ch, unsigned x, unsigne
 void gfx_line(gfx_surface* surface, unsigned x1, unsigned y1, unsigned x2, unsigned y2, unsigned color);
 
 // blend source surface to target surface
+//
+// An ARGB_8888 source is blended over the target, using premultiplied
+// alpha if the source has GFX_FLAG_PREMULTIPLIED set; any other source is
+// copied. Pixels are converted when the formats differ.
 void gfx_surface_blend(struct gfx_surface* target, struct gfx_surface* source, unsigned destx, unsigned desty);
 
 // blend an area from the source surface to the target surface
@@ -91,6 +105,9 @@ void gfx_flush(struct gfx_surface* surface);
 // flush a subset of the surface
 void gfx_flush_rows(struct gfx_surface* surface, unsigned start, unsigned end);
 
+// flush a rectangle of the surface
+void gfx_flush_rect(struct gfx_surface* surface, unsigned x, unsigned y, unsigned width, unsigned height);
+
 // clear the entire surface with a color
 static inline void gfx_clear(gfx_surface* surface, unsigned color) {
     surface->fillrect(surface, 0, 0, surface->width, surface->height, color);
@@ -105,6 +122,14 @@ mx_status_t gfx_init_surface(gfx_surface* surface, void* ptr, unsigned width, un
 // optionally frees the buffer if the free bit is set
 void gfx_surface_destroy(struct gfx_surface* surface);
 
+// the vector kernel set in use, chosen for this cpu on first use
+unsigned gfx_get_simd(void);
+
+// force a kernel set, e.g. for benchmarking; fails if the cpu lacks it
+mx_status_t gfx_set_simd(unsigned simd);
+
+const char* gfx_simd_name(unsigned simd);
+
 // utility routine to fill the display with a little moire pattern
 void gfx_draw_pattern(void);
 
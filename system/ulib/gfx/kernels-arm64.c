@@ -0,0 +1,159 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// NEON is part of the arm64 baseline, so these are always the kernels in
+// use there. Pixels are loaded eight at a time de-interleaved into planes
+// of b, g, r and a.
+
+#include <arm_neon.h>
+
+#include <gfx/gfx.h>
+
+#include "gfx-private.h"
+
+static void fill16_neon(uint16_t* dst, uint16_t color, size_t count) {
+    uint16x8_t c = vdupq_n_u16(color);
+    for (; count >= 32; count -= 32, dst += 32) {
+        vst1q_u16(dst, c);
+        vst1q_u16(dst + 8, c);
+        vst1q_u16(dst + 16, c);
+        vst1q_u16(dst + 24, c);
+    }
+    for (; count >= 8; count -= 8, dst += 8) {
+        vst1q_u16(dst, c);
+    }
+    gfx_kernels_c.fill16(dst, color, count);
+}
+
+static void fill32_neon(uint32_t* dst, uint32_t color, size_t count) {
+    uint32x4_t c = vdupq_n_u32(color);
+    for (; count >= 16; count -= 16, dst += 16) {
+        vst1q_u32(dst, c);
+        vst1q_u32(dst + 4, c);
+        vst1q_u32(dst + 8, c);
+        vst1q_u32(dst + 12, c);
+    }
+    for (; count >= 4; count -= 4, dst += 4) {
+        vst1q_u32(dst, c);
+    }
+    gfx_kernels_c.fill32(dst, color, count);
+}
+
+// x / 255, rounded, narrowed to 8 bits; see gfx_div255()
+static inline uint8x8_t div255_neon(uint16x8_t x) {
+    x = vaddq_u16(x, vdupq_n_u16(128));
+    return vshrn_n_u16(vsraq_n_u16(x, x, 8), 8);
+}
+
+static void blend_neon(uint32_t* dst, const uint32_t* src, size_t count) {
+    const uint8x8_t c255 = vdup_n_u8(255);
+    for (; count >= 8; count -= 8, dst += 8, src += 8) {
+        uint8x8x4_t s = vld4_u8((const uint8_t*)src);
+        uint64_t alpha = vget_lane_u64(vreinterpret_u64_u8(s.val[3]), 0);
+        if (alpha == UINT64_MAX) {
+            vst1q_u32(dst, vld1q_u32(src));
+            vst1q_u32(dst + 4, vld1q_u32(src + 4));
+            continue;
+        }
+        if (alpha == 0) {
+            continue;
+        }
+        uint8x8x4_t d = vld4_u8((const uint8_t*)dst);
+        uint8x8_t a = s.val[3];
+        uint8x8_t ia = vsub_u8(c255, a);
+        uint8x8x4_t out;
+        for (int i = 0; i < 3; i++) {
+            out.val[i] = div255_neon(vmlal_u8(vmull_u8(s.val[i], a), d.val[i], ia));
+        }
+        out.val[3] = div255_neon(vmlal_u8(vmull_u8(a, c255), d.val[3], ia));
+        vst4_u8((uint8_t*)dst, out);
+    }
+    gfx_kernels_c.blend(dst, src, count);
+}
+
+static void blend_premul_neon(uint32_t* dst, const uint32_t* src, size_t count) {
+    const uint8x8_t c255 = vdup_n_u8(255);
+    for (; count >= 8; count -= 8, dst += 8, src += 8) {
+        uint8x8x4_t s = vld4_u8((const uint8_t*)src);
+        if (vget_lane_u64(vreinterpret_u64_u8(s.val[3]), 0) == UINT64_MAX) {
+            vst1q_u32(dst, vld1q_u32(src));
+            vst1q_u32(dst + 4, vld1q_u32(src + 4));
+            continue;
+        }
+        uint8x8x4_t d = vld4_u8((const uint8_t*)dst);
+        uint8x8_t ia = vsub_u8(c255, s.val[3]);
+        uint8x8x4_t out;
+        for (int i = 0; i < 4; i++) {
+            out.val[i] = vqadd_u8(s.val[i], div255_neon(vmull_u8(d.val[i], ia)));
+        }
+        vst4_u8((uint8_t*)dst, out);
+    }
+    gfx_kernels_c.blend_premul(dst, src, count);
+}
+
+static void to_rgb565_neon(uint16_t* dst, const uint32_t* src, size_t count) {
+    for (; count >= 8; count -= 8, dst += 8, src += 8) {
+        uint8x8x4_t p = vld4_u8((const uint8_t*)src);
+        uint16x8_t out = vshlq_n_u16(vmovl_u8(vshr_n_u8(p.val[2], 3)), 11);
+        out = vorrq_u16(out, vshlq_n_u16(vmovl_u8(vshr_n_u8(p.val[1], 2)), 5));
+        out = vorrq_u16(out, vmovl_u8(vshr_n_u8(p.val[0], 3)));
+        vst1q_u16(dst, out);
+    }
+    gfx_kernels_c.to_rgb565(dst, src, count);
+}
+
+static void to_rgb332_neon(uint8_t* dst, const uint32_t* src, size_t count) {
+    for (; count >= 8; count -= 8, dst += 8, src += 8) {
+        uint8x8x4_t p = vld4_u8((const uint8_t*)src);
+        uint8x8_t out = vand_u8(p.val[2], vdup_n_u8(0xe0));
+        out = vorr_u8(out, vshr_n_u8(vand_u8(p.val[1], vdup_n_u8(0xe0)), 3));
+        out = vorr_u8(out, vshr_n_u8(p.val[0], 6));
+        vst1_u8(dst, out);
+    }
+    gfx_kernels_c.to_rgb332(dst, src, count);
+}
+
+static void to_rgb2220_neon(uint8_t* dst, const uint32_t* src, size_t count) {
+    for (; count >= 8; count -= 8, dst += 8, src += 8) {
+        uint8x8x4_t p = vld4_u8((const uint8_t*)src);
+        uint8x8_t out = vand_u8(p.val[2], vdup_n_u8(0xc0));
+        out = vorr_u8(out, vshr_n_u8(vand_u8(p.val[1], vdup_n_u8(0xc0)), 2));
+        out = vorr_u8(out, vshr_n_u8(vand_u8(p.val[0], vdup_n_u8(0xc0)), 4));
+        vst1_u8(dst, out);
+    }
+    gfx_kernels_c.to_rgb2220(dst, src, count);
+}
+
+// (b * 74 + g * 732 + r * 218) >> 10; g's weight needs 32 bit products
+static inline uint16x4_t luma4_neon(uint16x4_t b, uint16x4_t g, uint16x4_t r) {
+    uint32x4_t sum = vmull_n_u16(b, 74);
+    sum = vmlal_n_u16(sum, g, 732);
+    sum = vmlal_n_u16(sum, r, 218);
+    return vshrn_n_u32(sum, 10);
+}
+
+static void to_luma_neon(uint8_t* dst, const uint32_t* src, size_t count) {
+    for (; count >= 8; count -= 8, dst += 8, src += 8) {
+        uint8x8x4_t p = vld4_u8((const uint8_t*)src);
+        uint16x8_t b = vmovl_u8(p.val[0]);
+        uint16x8_t g = vmovl_u8(p.val[1]);
+        uint16x8_t r = vmovl_u8(p.val[2]);
+        uint16x4_t lo = luma4_neon(vget_low_u16(b), vget_low_u16(g), vget_low_u16(r));
+        uint16x4_t hi = luma4_neon(vget_high_u16(b), vget_high_u16(g), vget_high_u16(r));
+        vst1_u8(dst, vmovn_u16(vcombine_u16(lo, hi)));
+    }
+    gfx_kernels_c.to_luma(dst, src, count);
+}
+
+const gfx_kernels_t gfx_kernels_neon = {
+    .simd = GFX_SIMD_NEON,
+    .fill16 = fill16_neon,
+    .fill32 = fill32_neon,
+    .blend = blend_neon,
+    .blend_premul = blend_premul_neon,
+    .to_rgb565 = to_rgb565_neon,
+    .to_rgb332 = to_rgb332_neon,
+    .to_rgb2220 = to_rgb2220_neon,
+    .to_luma = to_luma_neon,
+};
@@ -0,0 +1,354 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+// SSE2 is part of the x86-64 baseline and is used unconditionally; the
+// AVX2 kernels are compiled for that target alone and only chosen once
+// cpuid and XCR0 say the cpu and kernel both support it.
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#include <gfx/gfx.h>
+
+#include "gfx-private.h"
+
+bool gfx_cpu_has_avx2(void) {
+    unsigned a, b, c, d;
+    if (!__get_cpuid(1, &a, &b, &c, &d)) {
+        return false;
+    }
+    if (!(c & bit_OSXSAVE) || !(c & bit_AVX)) {
+        return false;
+    }
+    // the kernel must be saving the sse and avx register state
+    uint32_t xcr0_lo, xcr0_hi;
+    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 0x6) != 0x6) {
+        return false;
+    }
+    if (__get_cpuid_max(0, NULL) < 7) {
+        return false;
+    }
+    __cpuid_count(7, 0, a, b, c, d);
+    return (b & bit_AVX2) != 0;
+}
+
+// SSE2
+
+static void fill16_sse2(uint16_t* dst, uint16_t color, size_t count) {
+    while ((count > 0) && ((uintptr_t)dst & 15)) {
+        *dst++ = color;
+        count--;
+    }
+    __m128i c = _mm_set1_epi16((short)color);
+    for (; count >= 32; count -= 32, dst += 32) {
+        _mm_store_si128((__m128i*)dst, c);
+        _mm_store_si128((__m128i*)(dst + 8), c);
+        _mm_store_si128((__m128i*)(dst + 16), c);
+        _mm_store_si128((__m128i*)(dst + 24), c);
+    }
+    for (; count >= 8; count -= 8, dst += 8) {
+        _mm_store_si128((__m128i*)dst, c);
+    }
+    gfx_kernels_c.fill16(dst, color, count);
+}
+
+static void fill32_sse2(uint32_t* dst, uint32_t color, size_t count) {
+    while ((count > 0) && ((uintptr_t)dst & 15)) {
+        *dst++ = color;
+        count--;
+    }
+    __m128i c = _mm_set1_epi32((int)color);
+    for (; count >= 16; count -= 16, dst += 16) {
+        _mm_store_si128((__m128i*)dst, c);
+        _mm_store_si128((__m128i*)(dst + 4), c);
+        _mm_store_si128((__m128i*)(dst + 8), c);
+        _mm_store_si128((__m128i*)(dst + 12), c);
+    }
+    for (; count >= 4; count -= 4, dst += 4) {
+        _mm_store_si128((__m128i*)dst, c);
+    }
+    gfx_kernels_c.fill32(dst, color, count);
+}
+
+// x / 255, rounded, per 16 bit lane; see gfx_div255()
+static inline __m128i div255_sse2(__m128i x) {
+    x = _mm_add_epi16(x, _mm_set1_epi16(128));
+    return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+}
+
+// each pixel's alpha, copied into all four of its 16 bit lanes
+static inline __m128i alpha16_sse2(__m128i px16) {
+    px16 = _mm_shufflelo_epi16(px16, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm_shufflehi_epi16(px16, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+// two pixels, widened to 16 bits per channel
+static inline __m128i blend2_sse2(__m128i s, __m128i d) {
+    __m128i a = alpha16_sse2(s);
+    __m128i ia = _mm_sub_epi16(_mm_set1_epi16(255), a);
+    // the source alpha lane is scaled by 255 rather than by itself
+    __m128i sa = _mm_or_si128(_mm_and_si128(a, _mm_set_epi16(0, -1, -1, -1, 0, -1, -1, -1)),
+                              _mm_set_epi16(255, 0, 0, 0, 255, 0, 0, 0));
+    return div255_sse2(_mm_add_epi16(_mm_mullo_epi16(s, sa), _mm_mullo_epi16(d, ia)));
+}
+
+static void blend_sse2(uint32_t* dst, const uint32_t* src, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i amask = _mm_set1_epi32((int)0xff000000);
+    for (; count >= 4; count -= 4, dst += 4, src += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)src);
+        __m128i alpha = _mm_and_si128(s, amask);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, amask)) == 0xffff) {
+            _mm_storeu_si128((__m128i*)dst, s);
+            continue;
+        }
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(alpha, zero)) == 0xffff) {
+            continue;
+        }
+        __m128i d = _mm_loadu_si128((const __m128i*)dst);
+        __m128i lo = blend2_sse2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero));
+        __m128i hi = blend2_sse2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero));
+        _mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(lo, hi));
+    }
+    gfx_kernels_c.blend(dst, src, count);
+}
+
+static void blend_premul_sse2(uint32_t* dst, const uint32_t* src, size_t count) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i amask = _mm_set1_epi32((int)0xff000000);
+    const __m128i c255 = _mm_set1_epi16(255);
+    for (; count >= 4; count -= 4, dst += 4, src += 4) {
+        __m128i s = _mm_loadu_si128((const __m128i*)src);
+        if (_mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, amask), amask)) == 0xffff) {
+            _mm_storeu_si128((__m128i*)dst, s);
+            continue;
+        }
+        __m128i d = _mm_loadu_si128((const __m128i*)dst);
+        __m128i ia_lo = _mm_sub_epi16(c255, alpha16_sse2(_mm_unpacklo_epi8(s, zero)));
+        __m128i ia_hi = _mm_sub_epi16(c255, alpha16_sse2(_mm_unpackhi_epi8(s, zero)));
+        __m128i lo = div255_sse2(_mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), ia_lo));
+        __m128i hi = div255_sse2(_mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ia_hi));
+        _mm_storeu_si128((__m128i*)dst, _mm_adds_epu8(s, _mm_packus_epi16(lo, hi)));
+    }
+    gfx_kernels_c.blend_premul(dst, src, count);
+}
+
+// narrow 32 bit lanes holding 16 bit values; packs_epi32 saturates signed,
+// so each value is sign extended from bit 15 first
+static inline __m128i pack32to16_sse2(__m128i a, __m128i b) {
+    a = _mm_srai_epi32(_mm_slli_epi32(a, 16), 16);
+    b = _mm_srai_epi32(_mm_slli_epi32(b, 16), 16);
+    return _mm_packs_epi32(a, b);
+}
+
+static inline __m128i rgb565_sse2(__m128i p) {
+    __m128i b = _mm_and_si128(_mm_srli_epi32(p, 3), _mm_set1_epi32(0x001f));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 5), _mm_set1_epi32(0x07e0));
+    __m128i r = _mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0xf800));
+    return _mm_or_si128(_mm_or_si128(b, g), r);
+}
+
+static void to_rgb565_sse2(uint16_t* dst, const uint32_t* src, size_t count) {
+    for (; count >= 8; count -= 8, dst += 8, src += 8) {
+        __m128i lo = rgb565_sse2(_mm_loadu_si128((const __m128i*)src));
+        __m128i hi = rgb565_sse2(_mm_loadu_si128((const __m128i*)(src + 4)));
+        _mm_storeu_si128((__m128i*)dst, pack32to16_sse2(lo, hi));
+    }
+    gfx_kernels_c.to_rgb565(dst, src, count);
+}
+
+static inline __m128i rgb332_sse2(__m128i p) {
+    __m128i b = _mm_and_si128(_mm_srli_epi32(p, 6), _mm_set1_epi32(0x03));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 11), _mm_set1_epi32(0x1c));
+    __m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), _mm_set1_epi32(0xe0));
+    return _mm_or_si128(_mm_or_si128(b, g), r);
+}
+
+static inline __m128i rgb2220_sse2(__m128i p) {
+    __m128i b = _mm_and_si128(_mm_srli_epi32(p, 4), _mm_set1_epi32(0x0c));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 10), _mm_set1_epi32(0x30));
+    __m128i r = _mm_and_si128(_mm_srli_epi32(p, 16), _mm_set1_epi32(0xc0));
+    return _mm_or_si128(_mm_or_si128(b, g), r);
+}
+
+// (b * 74 + g * 732 + r * 218) >> 10, by multiply-adding the b/r and g/0
+// halves of each pixel
+static inline __m128i luma_sse2(__m128i p) {
+    __m128i br = _mm_and_si128(p, _mm_set1_epi32(0x00ff00ff));
+    __m128i g = _mm_and_si128(_mm_srli_epi32(p, 8), _mm_set1_epi32(0x000000ff));
+    __m128i sum = _mm_add_epi32(_mm_madd_epi16(br, _mm_set1_epi32((218 << 16) | 74)),
+                                _mm_madd_epi16(g, _mm_set1_epi32(732)));
+    return _mm_srli_epi32(sum, 10);
+}
+
+// sixteen pixels at a time through an 8 bit conversion
+#define TO_8BIT_SSE2(name, convert, tail)                                     \
+static void name(uint8_t* dst, const uint32_t* src, size_t count) {          \
+    for (; count >= 16; count -= 16, dst += 16, src += 16) {                 \
+        __m128i a = convert(_mm_loadu_si128((const __m128i*)src));           \
+        __m128i b = convert(_mm_loadu_si128((const __m128i*)(src + 4)));     \
+        __m128i c = convert(_mm_loadu_si128((const __m128i*)(src + 8)));     \
+        __m128i d = convert(_mm_loadu_si128((const __m128i*)(src + 12)));    \
+        __m128i ab = _mm_packs_epi32(a, b);                                  \
+        __m128i cd = _mm_packs_epi32(c, d);                                  \
+        _mm_storeu_si128((__m128i*)dst, _mm_packus_epi16(ab, cd));           \
+    }                                                                        \
+    tail(dst, src, count);                                                   \
+}
+
+TO_8BIT_SSE2(to_rgb332_sse2, rgb332_sse2, gfx_kernels_c.to_rgb332)
+TO_8BIT_SSE2(to_rgb2220_sse2, rgb2220_sse2, gfx_kernels_c.to_rgb2220)
+TO_8BIT_SSE2(to_luma_sse2, luma_sse2, gfx_kernels_c.to_luma)
+
+const gfx_kernels_t gfx_kernels_sse2 = {
+    .simd = GFX_SIMD_SSE2,
+    .fill16 = fill16_sse2,
+    .fill32 = fill32_sse2,
+    .blend = blend_sse2,
+    .blend_premul = blend_premul_sse2,
+    .to_rgb565 = to_rgb565_sse2,
+    .to_rgb332 = to_rgb332_sse2,
+    .to_rgb2220 = to_rgb2220_sse2,
+    .to_luma = to_luma_sse2,
+};
+
+// AVX2
+//
+// The same kernels eight pixels wide. The 8 bit conversions gain little
+// over SSE2 once lane-crossing packs are paid for, so they are shared.
+
+#define AVX2 __attribute__((target("avx2")))
+
+AVX2 static void fill16_avx2(uint16_t* dst, uint16_t color, size_t count) {
+    while ((count > 0) && ((uintptr_t)dst & 31)) {
+        *dst++ = color;
+        count--;
+    }
+    __m256i c = _mm256_set1_epi16((short)color);
+    for (; count >= 64; count -= 64, dst += 64) {
+        _mm256_store_si256((__m256i*)dst, c);
+        _mm256_store_si256((__m256i*)(dst + 16), c);
+        _mm256_store_si256((__m256i*)(dst + 32), c);
+        _mm256_store_si256((__m256i*)(dst + 48), c);
+    }
+    for (; count >= 16; count -= 16, dst += 16) {
+        _mm256_store_si256((__m256i*)dst, c);
+    }
+    gfx_kernels_c.fill16(dst, color, count);
+}
+
+AVX2 static void fill32_avx2(uint32_t* dst, uint32_t color, size_t count) {
+    while ((count > 0) && ((uintptr_t)dst & 31)) {
+        *dst++ = color;
+        count--;
+    }
+    __m256i c = _mm256_set1_epi32((int)color);
+    for (; count >= 32; count -= 32, dst += 32) {
+        _mm256_store_si256((__m256i*)dst, c);
+        _mm256_store_si256((__m256i*)(dst + 8), c);
+        _mm256_store_si256((__m256i*)(dst + 16), c);
+        _mm256_store_si256((__m256i*)(dst + 24), c);
+    }
+    for (; count >= 8; count -= 8, dst += 8) {
+        _mm256_store_si256((__m256i*)dst, c);
+    }
+    gfx_kernels_c.fill32(dst, color, count);
+}
+
+AVX2 static inline __m256i div255_avx2(__m256i x) {
+    x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+    return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+}
+
+AVX2 static inline __m256i alpha16_avx2(__m256i px16) {
+    px16 = _mm256_shufflelo_epi16(px16, _MM_SHUFFLE(3, 3, 3, 3));
+    return _mm256_shufflehi_epi16(px16, _MM_SHUFFLE(3, 3, 3, 3));
+}
+
+AVX2 static inline __m256i blend4_avx2(__m256i s, __m256i d) {
+    __m256i a = alpha16_avx2(s);
+    __m256i ia = _mm256_sub_epi16(_mm256_set1_epi16(255), a);
+    __m256i sa = _mm256_or_si256(
+        _mm256_and_si256(a, _mm256_set_epi16(0, -1, -1, -1, 0, -1, -1, -1,
+                                             0, -1, -1, -1, 0, -1, -1, -1)),
+        _mm256_set_epi16(255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0, 255, 0, 0, 0));
+    return div255_avx2(_mm256_add_epi16(_mm256_mullo_epi16(s, sa), _mm256_mullo_epi16(d, ia)));
+}
+
+AVX2 static void blend_avx2(uint32_t* dst, const uint32_t* src, size_t count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i amask = _mm256_set1_epi32((int)0xff000000);
+    for (; count >= 8; count -= 8, dst += 8, src += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)src);
+        __m256i alpha = _mm256_and_si256(s, amask);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, amask)) == -1) {
+            _mm256_storeu_si256((__m256i*)dst, s);
+            continue;
+        }
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(alpha, zero)) == -1) {
+            continue;
+        }
+        __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+        // unpack and pack both work within 128 bit lanes, so pixel order
+        // comes back out unchanged
+        __m256i lo = blend4_avx2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero));
+        __m256i hi = blend4_avx2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero));
+        _mm256_storeu_si256((__m256i*)dst, _mm256_packus_epi16(lo, hi));
+    }
+    blend_sse2(dst, src, count);
+}
+
+AVX2 static void blend_premul_avx2(uint32_t* dst, const uint32_t* src, size_t count) {
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i amask = _mm256_set1_epi32((int)0xff000000);
+    const __m256i c255 = _mm256_set1_epi16(255);
+    for (; count >= 8; count -= 8, dst += 8, src += 8) {
+        __m256i s = _mm256_loadu_si256((const __m256i*)src);
+        if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(_mm256_and_si256(s, amask), amask)) == -1) {
+            _mm256_storeu_si256((__m256i*)dst, s);
+            continue;
+        }
+        __m256i d = _mm256_loadu_si256((const __m256i*)dst);
+        __m256i ia_lo = _mm256_sub_epi16(c255, alpha16_avx2(_mm256_unpacklo_epi8(s, zero)));
+        __m256i ia_hi = _mm256_sub_epi16(c255, alpha16_avx2(_mm256_unpackhi_epi8(s, zero)));
+        __m256i lo = div255_avx2(_mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), ia_lo));
+        __m256i hi = div255_avx2(_mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), ia_hi));
+        _mm256_storeu_si256((__m256i*)dst, _mm256_adds_epu8(s, _mm256_packus_epi16(lo, hi)));
+    }
+    blend_premul_sse2(dst, src, count);
+}
+
+AVX2 static inline __m256i rgb565_avx2(__m256i p) {
+    __m256i b = _mm256_and_si256(_mm256_srli_epi32(p, 3), _mm256_set1_epi32(0x001f));
+    __m256i g = _mm256_and_si256(_mm256_srli_epi32(p, 5), _mm256_set1_epi32(0x07e0));
+    __m256i r = _mm256_and_si256(_mm256_srli_epi32(p, 8), _mm256_set1_epi32(0xf800));
+    // sign extend from bit 15 so the signed pack below is exact
+    __m256i out = _mm256_or_si256(_mm256_or_si256(b, g), r);
+    return _mm256_srai_epi32(_mm256_slli_epi32(out, 16), 16);
+}
+
+AVX2 static void to_rgb565_avx2(uint16_t* dst, const uint32_t* src, size_t count) {
+    for (; count >= 16; count -= 16, dst += 16, src += 16) {
+        __m256i lo = rgb565_avx2(_mm256_loadu_si256((const __m256i*)src));
+        __m256i hi = rgb565_avx2(_mm256_loadu_si256((const __m256i*)(src + 8)));
+        // the pack interleaves 128 bit lanes; put them back in order
+        __m256i out = _mm256_permute4x64_epi64(_mm256_packs_epi32(lo, hi),
+                                               _MM_SHUFFLE(3, 1, 2, 0));
+        _mm256_storeu_si256((__m256i*)dst, out);
+    }
+    to_rgb565_sse2(dst, src, count);
+}
+
+const gfx_kernels_t gfx_kernels_avx2 = {
+    .simd = GFX_SIMD_AVX2,
+    .fill16 = fill16_avx2,
+    .fill32 = fill32_avx2,
+    .blend = blend_avx2,
+    .blend_premul = blend_premul_avx2,
+    .to_rgb565 = to_rgb565_avx2,
+    .to_rgb332 = to_rgb332_sse2,
+    .to_rgb2220 = to_rgb2220_sse2,
+    .to_luma = to_luma_sse2,
+};
@@ -0,0 +1,132 @@
+// Copyright 2017 The Fuchsia Authors. All rights reserved.
+// Use of this source code is governed by a BSD-style license that can be
+// found in the LICENSE file.
+
+#include <gfx/gfx.h>
+
+#include "gfx-private.h"
+
+static void fill16_c(uint16_t* dst, uint16_t color, size_t count) {
+    while (count-- > 0) {
+        *dst++ = color;
+    }
+}
+
+static void fill32_c(uint32_t* dst, uint32_t color, size_t count) {
+    while (count-- > 0) {
+        *dst++ = color;
+    }
+}
+
+static void blend_c(uint32_t* dst, const uint32_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = gfx_blend_pixel(dst[i], src[i]);
+    }
+}
+
+static void blend_premul_c(uint32_t* dst, const uint32_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = gfx_blend_premul_pixel(dst[i], src[i]);
+    }
+}
+
+static void to_rgb565_c(uint16_t* dst, const uint32_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (uint16_t)ARGB8888_to_RGB565(src[i]);
+    }
+}
+
+static void to_rgb332_c(uint8_t* dst, const uint32_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (uint8_t)ARGB8888_to_RGB332(src[i]);
+    }
+}
+
+static void to_rgb2220_c(uint8_t* dst, const uint32_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (uint8_t)ARGB8888_to_RGB2220(src[i]);
+    }
+}
+
+static void to_luma_c(uint8_t* dst, const uint32_t* src, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        dst[i] = (uint8_t)ARGB8888_to_Luma(src[i]);
+    }
+}
+
+const gfx_kernels_t gfx_kernels_c = {
+    .simd = GFX_SIMD_NONE,
+    .fill16 = fill16_c,
+    .fill32 = fill32_c,
+    .blend = blend_c,
+    .blend_premul = blend_premul_c,
+    .to_rgb565 = to_rgb565_c,
+    .to_rgb332 = to_rgb332_c,
+    .to_rgb2220 = to_rgb2220_c,
+    .to_luma = to_luma_c,
+};
+
+static const gfx_kernels_t* kernels_for(unsigned simd) {
+    switch (simd) {
+    case GFX_SIMD_NONE:
+        return &gfx_kernels_c;
+#if defined(__x86_64__)
+    case GFX_SIMD_SSE2:
+        return &gfx_kernels_sse2;
+    case GFX_SIMD_AVX2:
+        return gfx_cpu_has_avx2() ? &gfx_kernels_avx2 : NULL;
+#elif defined(__aarch64__)
+    case GFX_SIMD_NEON:
+        return &gfx_kernels_neon;
+#endif
+    default:
+        return NULL;
+    }
+}
+
+// Written once on first use and again only by gfx_set_simd(); racing first
+// users all store the same value.
+static const gfx_kernels_t* current;
+
+const gfx_kernels_t* gfx_kernels(void) {
+    const gfx_kernels_t* k = __atomic_load_n(&current, __ATOMIC_ACQUIRE);
+    if (unlikely(k == NULL)) {
+#if defined(__x86_64__)
+        k = gfx_cpu_has_avx2() ? &gfx_kernels_avx2 : &gfx_kernels_sse2;
+#elif defined(__aarch64__)
+        k = &gfx_kernels_neon;
+#else
+        k = &gfx_kernels_c;
+#endif
+        __atomic_store_n(&current, k, __ATOMIC_RELEASE);
+    }
+    return k;
+}
+
+unsigned gfx_get_simd(void) {
+    return gfx_kernels()->simd;
+}
+
+mx_status_t gfx_set_simd(unsigned simd) {
+    const gfx_kernels_t* k = kernels_for(simd);
+    if (k == NULL) {
+        return ERR_NOT_SUPPORTED;
+    }
+    __atomic_store_n(&current, k, __ATOMIC_RELEASE);
+    return NO_ERROR;
+}
+
+const char* gfx_simd_name(unsigned simd) {
+    switch (simd) {
+    case GFX_SIMD_NONE:
+        return "scalar";
+    case GFX_SIMD_SSE2:
+        return "sse2";
+    case GFX_SIMD_AVX2:
+        return "avx2";
+    case GFX_SIMD_NEON:
+        return "neon";
+    default:
+        return "unknown";
+    }
+}
@@ -16,5 +16,14 @@ MODULE_LIBS := \
 
 MODULE_SRCS += \
     $(LOCAL_DIR)/gfx.c \
+    $(LOCAL_DIR)/kernels.c \
+
+ifeq ($(ARCH),arm64)
+MODULE_SRCS += $(LOCAL_DIR)/kernels-arm64.c
+else ifeq ($(ARCH),x86)
+    ifeq ($(SUBARCH),x86-64)
+    MODULE_SRCS += $(LOCAL_DIR)/kernels-x86.c
+    endif
+endif
 
 include make/module.mk
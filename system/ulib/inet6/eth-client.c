@@ -136,6 +136,41 @@ mx_status_t eth_complete_rx(eth_client_t* eth, void* ctx,
     return NO_ERROR;
 }
 
+mx_status_t eth_recycle_rx(eth_client_t* eth, void* ctx,
+                           size_t (*func)(void* ctx, void* cookie, void* data,
+                                          size_t len, uint32_t flags)) {
+    eth_fifo_entry_t entries[eth->rx_size];
+    mx_status_t status;
+    uint32_t count;
+    if ((status = mx_fifo_read(eth->rx_fifo, entries, sizeof(entries), &count)) < 0) {
+        if (status == ERR_SHOULD_WAIT) {
+            return NO_ERROR;
+        } else {
+            return status;
+        }
+    }
+
+    // entries to be re-queued are compacted at the front of the array
+    uint32_t requeue = 0;
+    for (uint32_t n = 0; n < count; n++) {
+        eth_fifo_entry_t* e = entries + n;
+        IORING_TRACE("eth:rx- c=%p o=%u l=%u f=%u\n",
+                     e->cookie, e->offset, e->length, e->flags);
+        size_t len = func(ctx, e->cookie, eth->iobuf + e->offset, e->length, e->flags);
+        if (len > 0) {
+            e->length = len;
+            e->flags = 0;
+            IORING_TRACE("eth:rx+ c=%p o=%u l=%u f=%u\n",
+                         e->cookie, e->offset, e->length, e->flags);
+            entries[requeue++] = *e;
+        }
+    }
+
+    if (requeue == 0) {
+        return NO_ERROR;
+    }
+    return mx_fifo_write(eth->rx_fifo, entries, sizeof(eth_fifo_entry_t) * requeue, &count);
+}
 
 // Wait for completed rx packets
 // ERR_REMOTE_CLOSED - far side disconnected
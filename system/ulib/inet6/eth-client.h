@@ -38,6 +38,13 @@ mx_status_t eth_queue_rx(eth_client_t* eth, void* cookie,
 mx_status_t eth_complete_rx(eth_client_t* eth, void* ctx,
                             void (*func)(void* ctx, void* cookie, size_t len, uint32_t flags));
 
+// Process all received buffers, then re-queue them for reception with a
+// single fifo write.  func() is handed each buffer and returns the length
+// to re-queue it with, or 0 to keep the buffer.
+mx_status_t eth_recycle_rx(eth_client_t* eth, void* ctx,
+                           size_t (*func)(void* ctx, void* cookie, void* data,
+                                          size_t len, uint32_t flags));
+
 // Wait for completed rx packets
 // ERR_REMOTE_CLOSED - far side disconnected
 // ERR_TIMED_OUT - timeout expired
@@ -372,17 +372,19 @@ void netifc_close(void) {
     mtx_unlock(&eth_lock);
 }
 
-static void rx_complete(void* ctx, void* cookie, size_t len, uint32_t flags) {
+// each rx buffer goes straight back to the driver after the stack has
+// seen it; the whole batch is requeued with one fifo write
+static size_t rx_recycle(void* ctx, void* cookie, void* data, size_t len, uint32_t flags) {
     eth_buffer_t* ethbuf = cookie;
     check_ethbuf(ethbuf, ETH_BUFFER_RX);
     netifc_recv(ethbuf->data, len);
-    eth_queue_rx(eth, ethbuf, ethbuf->data, NET_BUFFERSZ, 0);
+    return NET_BUFFERSZ;
 }
 
 int netifc_poll(void) {
     for (;;) {
         mx_status_t status;
-        if ((status = eth_complete_rx(eth, NULL, rx_complete)) < 0) {
+        if ((status = eth_recycle_rx(eth, NULL, rx_recycle)) < 0) {
             printf("netifc: eth rx failed: %d\n", status);
             return -1;
         }
@@ -63,59 +63,60 @@
 #define MX_SYS_log_create 59
 #define MX_SYS_log_write 60
 #define MX_SYS_log_read 61
-#define MX_SYS_ktrace_read 62
-#define MX_SYS_ktrace_control 63
-#define MX_SYS_ktrace_write 64
-#define MX_SYS_mtrace_control 65
-#define MX_SYS_debug_transfer_handle 66
-#define MX_SYS_debug_read 67
-#define MX_SYS_debug_write 68
-#define MX_SYS_debug_send_command 69
-#define MX_SYS_interrupt_create 70
-#define MX_SYS_interrupt_complete 71
-#define MX_SYS_interrupt_wait 72
-#define MX_SYS_interrupt_signal 73
-#define MX_SYS_mmap_device_io 74
-#define MX_SYS_mmap_device_memory 75
-#define MX_SYS_io_mapping_get_info 76
-#define MX_SYS_vmo_create_contiguous 77
-#define MX_SYS_vmar_allocate 78
-#define MX_SYS_vmar_destroy 79
-#define MX_SYS_vmar_map 80
-#define MX_SYS_vmar_unmap 81
-#define MX_SYS_vmar_protect 82
-#define MX_SYS_bootloader_fb_get_info 83
-#define MX_SYS_set_framebuffer 84
-#define MX_SYS_clock_adjust 85
-#define MX_SYS_pci_get_nth_device 86
-#define MX_SYS_pci_claim_device 87
-#define MX_SYS_pci_enable_bus_master 88
-#define MX_SYS_pci_enable_pio 89
-#define MX_SYS_pci_reset_device 90
-#define MX_SYS_pci_map_mmio 91
-#define MX_SYS_pci_io_write 92
-#define MX_SYS_pci_io_read 93
-#define MX_SYS_pci_map_interrupt 94
-#define MX_SYS_pci_map_config 95
-#define MX_SYS_pci_query_irq_mode_caps 96
-#define MX_SYS_pci_set_irq_mode 97
-#define MX_SYS_pci_init 98
-#define MX_SYS_pci_add_subtract_io_range 99
-#define MX_SYS_acpi_uefi_rsdp 100
-#define MX_SYS_acpi_cache_flush 101
-#define MX_SYS_resource_create 102
-#define MX_SYS_resource_get_handle 103
-#define MX_SYS_resource_do_action 104
-#define MX_SYS_resource_connect 105
-#define MX_SYS_resource_accept 106
-#define MX_SYS_hypervisor_create 107
-#define MX_SYS_syscall_test_0 108
-#define MX_SYS_syscall_test_1 109
-#define MX_SYS_syscall_test_2 110
-#define MX_SYS_syscall_test_3 111
-#define MX_SYS_syscall_test_4 112
-#define MX_SYS_syscall_test_5 113
-#define MX_SYS_syscall_test_6 114
-#define MX_SYS_syscall_test_7 115
-#define MX_SYS_syscall_test_8 116
+#define MX_SYS_log_get_buffer 62
+#define MX_SYS_ktrace_read 63
+#define MX_SYS_ktrace_control 64
+#define MX_SYS_ktrace_write 65
+#define MX_SYS_mtrace_control 66
+#define MX_SYS_debug_transfer_handle 67
+#define MX_SYS_debug_read 68
+#define MX_SYS_debug_write 69
+#define MX_SYS_debug_send_command 70
+#define MX_SYS_interrupt_create 71
+#define MX_SYS_interrupt_complete 72
+#define MX_SYS_interrupt_wait 73
+#define MX_SYS_interrupt_signal 74
+#define MX_SYS_mmap_device_io 75
+#define MX_SYS_mmap_device_memory 76
+#define MX_SYS_io_mapping_get_info 77
+#define MX_SYS_vmo_create_contiguous 78
+#define MX_SYS_vmar_allocate 79
+#define MX_SYS_vmar_destroy 80
+#define MX_SYS_vmar_map 81
+#define MX_SYS_vmar_unmap 82
+#define MX_SYS_vmar_protect 83
+#define MX_SYS_bootloader_fb_get_info 84
+#define MX_SYS_set_framebuffer 85
+#define MX_SYS_clock_adjust 86
+#define MX_SYS_pci_get_nth_device 87
+#define MX_SYS_pci_claim_device 88
+#define MX_SYS_pci_enable_bus_master 89
+#define MX_SYS_pci_enable_pio 90
+#define MX_SYS_pci_reset_device 91
+#define MX_SYS_pci_map_mmio 92
+#define MX_SYS_pci_io_write 93
+#define MX_SYS_pci_io_read 94
+#define MX_SYS_pci_map_interrupt 95
+#define MX_SYS_pci_map_config 96
+#define MX_SYS_pci_query_irq_mode_caps 97
+#define MX_SYS_pci_set_irq_mode 98
+#define MX_SYS_pci_init 99
+#define MX_SYS_pci_add_subtract_io_range 100
+#define MX_SYS_acpi_uefi_rsdp 101
+#define MX_SYS_acpi_cache_flush 102
+#define MX_SYS_resource_create 103
+#define MX_SYS_resource_get_handle 104
+#define MX_SYS_resource_do_action 105
+#define MX_SYS_resource_connect 106
+#define MX_SYS_resource_accept 107
+#define MX_SYS_hypervisor_create 108
+#define MX_SYS_syscall_test_0 109
+#define MX_SYS_syscall_test_1 110
+#define MX_SYS_syscall_test_2 111
+#define MX_SYS_syscall_test_3 112
+#define MX_SYS_syscall_test_4 113
+#define MX_SYS_syscall_test_5 114
+#define MX_SYS_syscall_test_6 115
+#define MX_SYS_syscall_test_7 116
+#define MX_SYS_syscall_test_8 117
 
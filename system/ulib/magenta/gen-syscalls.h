@@ -365,6 +365,10 @@ __attribute__((visibility("hidden"))) extern mx_status_t VDSO_mx_log_read(
     void* buffer,
     uint32_t options) __attribute__((__leaf__));
 
+__attribute__((visibility("hidden"))) extern mx_status_t VDSO_mx_log_get_buffer(
+    mx_handle_t handle,
+    mx_handle_t out[1]) __attribute__((__leaf__));
+
 __attribute__((visibility("hidden"))) extern mx_status_t VDSO_mx_ktrace_read(
     mx_handle_t handle,
     void* data,
@@ -19,6 +19,7 @@
 
 #include <magenta/compiler.h>
 #include <magenta/device/dmctl.h>
+#include <magenta/listnode.h>
 #include <magenta/processargs.h>
 #include <magenta/syscalls.h>
 #include <magenta/threads.h>
@@ -46,6 +47,98 @@ static const char* libpaths[] = {
     "/boot/lib",
 };
 
+// Every process loads the same few libraries (libc, libmxio, drivers), so
+// the default loader keeps one VMO per file and hands out read-only
+// duplicates of it. All of those processes then map the same text pages.
+// Nothing writes through these handles: loaders copy writable segments into
+// a VMO of their own before mapping them. An entry is reused only while the
+// file's inode, size and modification time are unchanged.
+#define VMO_CACHE_MAX 128
+
+#define VMO_CACHE_RIGHTS (MX_RIGHT_READ | MX_RIGHT_EXECUTE | MX_RIGHT_MAP | \
+                          MX_RIGHT_DUPLICATE | MX_RIGHT_TRANSFER | MX_RIGHT_GET_PROPERTY)
+
+typedef struct {
+    list_node_t node;
+    mx_handle_t vmo;
+    ino_t ino;
+    off_t size;
+    struct timespec mtime;
+    char path[];
+} vmo_cache_entry_t;
+
+// most recently used first
+static list_node_t vmo_cache = LIST_INITIAL_VALUE(vmo_cache);
+static size_t vmo_cache_count;
+static mtx_t vmo_cache_lock = MTX_INIT;
+
+static bool vmo_cache_entry_matches(vmo_cache_entry_t* entry, const struct stat* s) {
+    return (entry->ino == s->st_ino) && (entry->size == s->st_size) &&
+           (entry->mtime.tv_sec == s->st_mtim.tv_sec) &&
+           (entry->mtime.tv_nsec == s->st_mtim.tv_nsec);
+}
+
+static void vmo_cache_remove(vmo_cache_entry_t* entry) {
+    list_delete(&entry->node);
+    vmo_cache_count--;
+    mx_handle_close(entry->vmo);
+    free(entry);
+}
+
+// Returns a duplicate of the cached VMO for path if the file is unchanged,
+// and drops a stale entry.
+static mx_handle_t vmo_cache_lookup(const char* path, const struct stat* s) {
+    mx_handle_t vmo = MX_HANDLE_INVALID;
+    mtx_lock(&vmo_cache_lock);
+    vmo_cache_entry_t* entry;
+    list_for_every_entry (&vmo_cache, entry, vmo_cache_entry_t, node) {
+        if (strcmp(entry->path, path)) {
+            continue;
+        }
+        if (!vmo_cache_entry_matches(entry, s)) {
+            vmo_cache_remove(entry);
+        } else if (mx_handle_duplicate(entry->vmo, VMO_CACHE_RIGHTS, &vmo) == NO_ERROR) {
+            list_delete(&entry->node);
+            list_add_head(&vmo_cache, &entry->node);
+        }
+        break;
+    }
+    mtx_unlock(&vmo_cache_lock);
+    return vmo;
+}
+
+// Takes ownership of vmo, which must not be written after this.
+static void vmo_cache_insert(const char* path, const struct stat* s, mx_handle_t vmo) {
+    size_t len = strlen(path) + 1;
+    vmo_cache_entry_t* entry = malloc(sizeof(vmo_cache_entry_t) + len);
+    if (entry == NULL) {
+        mx_handle_close(vmo);
+        return;
+    }
+    entry->vmo = vmo;
+    entry->ino = s->st_ino;
+    entry->size = s->st_size;
+    entry->mtime = s->st_mtim;
+    memcpy(entry->path, path, len);
+
+    mtx_lock(&vmo_cache_lock);
+    // a racing load of the same file may have beaten us here
+    vmo_cache_entry_t* old;
+    list_for_every_entry (&vmo_cache, old, vmo_cache_entry_t, node) {
+        if (!strcmp(old->path, path)) {
+            vmo_cache_remove(old);
+            break;
+        }
+    }
+    if (vmo_cache_count == VMO_CACHE_MAX) {
+        // processes keep their own handles to the evicted VMO
+        vmo_cache_remove(list_peek_tail_type(&vmo_cache, vmo_cache_entry_t, node));
+    }
+    list_add_head(&vmo_cache, &entry->node);
+    vmo_cache_count++;
+    mtx_unlock(&vmo_cache_lock);
+}
+
 static mx_handle_t default_load_object(void* ignored, const char* fn) {
     char buffer[8192];  // 8K is the max io size of the mxio layer right now
     char path[PATH_MAX];
@@ -71,6 +164,11 @@ found:
         goto fail;
     }
 
+    if ((vmo = vmo_cache_lookup(path, &s)) > 0) {
+        close(fd);
+        return vmo;
+    }
+
     if ((err = mx_vmo_create(s.st_size, 0, &vmo)) < 0) {
         goto fail;
     }
@@ -96,7 +194,15 @@ found:
         size -= xfer;
     }
     close(fd);
-    return vmo;
+
+    // the cache keeps the writable original
+    mx_handle_t dup;
+    if ((err = mx_handle_duplicate(vmo, VMO_CACHE_RIGHTS, &dup)) < 0) {
+        mx_handle_close(vmo);
+        return err;
+    }
+    vmo_cache_insert(path, &s, vmo);
+    return dup;
 
 fail:
     close(fd);
@@ -104,6 +210,173 @@ fail:
     return err;
 }
 
+// Symbol resolution tables that the dynamic linker records with LD_SYMCACHE
+// set, keyed by the build IDs of the program's libraries in search order
+// (see <magenta/processargs.h>). The service checks the layout of each table
+// against its key and keeps a private copy, so the process that stored it
+// cannot change it under later readers. A newer table replaces an older one
+// under the same key. The dynamic linker still checks every answer it takes
+// from a table against its own DSOs.
+#define SYMCACHE_MAX 32
+#define SYMCACHE_SIZE_MAX (1024 * 1024)
+
+#define SYMCACHE_RIGHTS (MX_RIGHT_READ | MX_RIGHT_MAP | MX_RIGHT_DUPLICATE | \
+                         MX_RIGHT_TRANSFER | MX_RIGHT_GET_PROPERTY)
+
+typedef struct {
+    list_node_t node;
+    mx_handle_t vmo;
+    char key[];
+} symcache_entry_t;
+
+// most recently used first
+static list_node_t symcache = LIST_INITIAL_VALUE(symcache);
+static size_t symcache_count;
+static mtx_t symcache_lock = MTX_INIT;
+
+static void symcache_remove(symcache_entry_t* entry) {
+    list_delete(&entry->node);
+    symcache_count--;
+    mx_handle_close(entry->vmo);
+    free(entry);
+}
+
+static symcache_entry_t* symcache_find_locked(const char* key) {
+    symcache_entry_t* entry;
+    list_for_every_entry (&symcache, entry, symcache_entry_t, node) {
+        if (!strcmp(entry->key, key)) {
+            return entry;
+        }
+    }
+    return NULL;
+}
+
+static mx_handle_t symcache_load(const char* key) {
+    mx_handle_t vmo = ERR_NOT_FOUND;
+    mtx_lock(&symcache_lock);
+    symcache_entry_t* entry = symcache_find_locked(key);
+    if (entry != NULL) {
+        mx_status_t status = mx_handle_duplicate(entry->vmo, SYMCACHE_RIGHTS, &vmo);
+        if (status < 0) {
+            vmo = status;
+        }
+        list_delete(&entry->node);
+        list_add_head(&symcache, &entry->node);
+    }
+    mtx_unlock(&symcache_lock);
+    return vmo;
+}
+
+// Whether a table has one mx_symcache_dso_t for each build ID in key, in
+// the same order, each DSO's slots following the last's within the table,
+// and every slot naming a DSO in the key and a symbol that DSO has.
+static bool symcache_check(const char* key, const void* table, size_t size) {
+    const mx_symcache_header_t* hdr = table;
+    if ((size < sizeof(*hdr)) || (hdr->magic != MX_SYMCACHE_MAGIC) ||
+        (hdr->version != MX_SYMCACHE_VERSION) || (hdr->dso_count == 0) ||
+        (hdr->dso_count > (size - sizeof(*hdr)) / sizeof(mx_symcache_dso_t))) {
+        return false;
+    }
+    uint32_t count = hdr->dso_count;
+    const mx_symcache_dso_t* dsos = (const void*)(hdr + 1);
+
+    const char* id = key;
+    uint64_t end = sizeof(*hdr) + (uint64_t)count * sizeof(*dsos);
+    for (uint32_t i = 0; i < count; i++) {
+        if ((i > 0) && (*id++ != '/')) {
+            return false;
+        }
+        size_t len = strcspn(id, "/");
+        if ((len == 0) || (len >= sizeof(dsos[i].buildid)) ||
+            memcmp(dsos[i].buildid, id, len) || (dsos[i].buildid[len] != 0)) {
+            return false;
+        }
+        id += len;
+        if (dsos[i].offset != end) {
+            return false;
+        }
+        end += (uint64_t)dsos[i].nsyms * 2 * sizeof(mx_symcache_slot_t);
+        if (end > size) {
+            return false;
+        }
+    }
+    if (*id != 0) {
+        return false;
+    }
+
+    for (uint32_t i = 0; i < count; i++) {
+        const mx_symcache_slot_t* slots = (const void*)((const char*)table + dsos[i].offset);
+        for (uint64_t n = 0; n < (uint64_t)dsos[i].nsyms * 2; n++) {
+            uint32_t dso = slots[n].dso;
+            if ((dso == MX_SYMCACHE_UNSET) || (dso == MX_SYMCACHE_NONE)) {
+                continue;
+            }
+            if ((dso >= count) || (slots[n].sym >= dsos[dso].nsyms)) {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+static mx_status_t symcache_store(const char* key, mx_handle_t src) {
+    uint64_t size;
+    mx_status_t status;
+    if ((status = mx_vmo_get_size(src, &size)) < 0) {
+        return status;
+    }
+    if (size > SYMCACHE_SIZE_MAX) {
+        return ERR_OUT_OF_RANGE;
+    }
+
+    // check a copy, since the storing process can still write to src
+    void* table = malloc(size);
+    if (table == NULL) {
+        return ERR_NO_MEMORY;
+    }
+    size_t n;
+    if ((status = mx_vmo_read(src, table, 0, size, &n)) < 0) {
+        free(table);
+        return status;
+    }
+    if ((n != size) || !symcache_check(key, table, size)) {
+        free(table);
+        return ERR_INVALID_ARGS;
+    }
+
+    size_t len = strlen(key) + 1;
+    symcache_entry_t* entry = malloc(sizeof(symcache_entry_t) + len);
+    if (entry == NULL) {
+        free(table);
+        return ERR_NO_MEMORY;
+    }
+    memcpy(entry->key, key, len);
+    if ((status = mx_vmo_create(size, 0, &entry->vmo)) < 0) {
+        free(entry);
+        free(table);
+        return status;
+    }
+    status = mx_vmo_write(entry->vmo, table, 0, size, &n);
+    free(table);
+    if ((status < 0) || (n != size)) {
+        mx_handle_close(entry->vmo);
+        free(entry);
+        return (status < 0) ? status : ERR_IO;
+    }
+
+    mtx_lock(&symcache_lock);
+    symcache_entry_t* old = symcache_find_locked(key);
+    if (old != NULL) {
+        symcache_remove(old);
+    } else if (symcache_count == SYMCACHE_MAX) {
+        symcache_remove(list_peek_tail_type(&symcache, symcache_entry_t, node));
+    }
+    list_add_head(&symcache, &entry->node);
+    symcache_count++;
+    mtx_unlock(&symcache_lock);
+    return NO_ERROR;
+}
+
 struct startup {
     mxio_loader_service_function_t loader;
     void* loader_arg;
@@ -116,8 +389,10 @@ static mx_status_t handle_loader_rpc(mx_handle_t h, mxio_loader_service_function
     uint8_t data[1024];
     mx_loader_svc_msg_t* msg = (void*) data;
     uint32_t sz = sizeof(data);
+    mx_handle_t request_handle = MX_HANDLE_INVALID;
+    uint32_t hcount;
     mx_status_t r;
-    if ((r = mx_channel_read(h, 0, msg, sz, &sz, NULL, 0, NULL)) < 0) {
+    if ((r = mx_channel_read(h, 0, msg, sz, &sz, &request_handle, 1, &hcount)) < 0) {
         // This is the normal error for the other end going away,
         // which happens when the process dies.
         if (r != ERR_REMOTE_CLOSED)
@@ -126,8 +401,14 @@ static mx_status_t handle_loader_rpc(mx_handle_t h, mxio_loader_service_function
     }
     if ((sz <= sizeof(mx_loader_svc_msg_t))) {
         fprintf(stderr, "dlsvc: runt message\n");
+        if (hcount > 0) {
+            mx_handle_close(request_handle);
+        }
         return ERR_IO;
     }
+    if (hcount == 0) {
+        request_handle = MX_HANDLE_INVALID;
+    }
 
     // forcibly null-terminate the message data argument
     data[sz - 1] = 0;
@@ -144,13 +425,30 @@ static mx_status_t handle_loader_rpc(mx_handle_t h, mxio_loader_service_function
         log_printf(sys_log, "dlsvc: debug: %s\n", (const char*) msg->data);
         msg->arg = NO_ERROR;
         break;
+    case LOADER_SVC_OP_LOAD_SYMCACHE:
+        handle = symcache_load((const char*) msg->data);
+        msg->arg = handle < 0 ? handle : NO_ERROR;
+        break;
+    case LOADER_SVC_OP_STORE_SYMCACHE:
+        if (request_handle == MX_HANDLE_INVALID) {
+            msg->arg = ERR_INVALID_ARGS;
+            break;
+        }
+        msg->arg = symcache_store((const char*) msg->data, request_handle);
+        break;
     case LOADER_SVC_OP_DONE:
+        if (request_handle != MX_HANDLE_INVALID) {
+            mx_handle_close(request_handle);
+        }
         return ERR_REMOTE_CLOSED;
     default:
         fprintf(stderr, "dlsvc: invalid opcode 0x%x\n", msg->opcode);
         msg->arg = ERR_INVALID_ARGS;
         break;
     }
+    if (request_handle != MX_HANDLE_INVALID) {
+        mx_handle_close(request_handle);
+    }
 
     // msg->txid returned as received from the client.
     msg->opcode = LOADER_SVC_OP_STATUS;
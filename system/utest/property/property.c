@@ -104,9 +104,55 @@ static bool thread_name_test(void)
     END_TEST;
 }
 
+static bool thread_timer_slack_test(void)
+{
+    BEGIN_TEST;
+
+    mx_handle_t main_thread = thrd_get_mx_handle(thrd_current());
+    mx_time_t slack = 1;
+    EXPECT_EQ(mx_object_get_property(main_thread, MX_PROP_TIMER_SLACK, &slack, sizeof(slack)),
+              NO_ERROR, "");
+    EXPECT_EQ(slack, 0u, "threads start with no slack");
+
+    slack = MX_MSEC(1);
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_TIMER_SLACK, &slack, sizeof(slack)),
+              NO_ERROR, "");
+    slack = 0;
+    EXPECT_EQ(mx_object_get_property(main_thread, MX_PROP_TIMER_SLACK, &slack, sizeof(slack)),
+              NO_ERROR, "");
+    EXPECT_EQ(slack, MX_MSEC(1), "");
+
+    // a sleep may end late by the slack, but never early
+    mx_time_t start = mx_time_get(MX_CLOCK_MONOTONIC);
+    EXPECT_EQ(mx_nanosleep(MX_MSEC(5)), NO_ERROR, "");
+    EXPECT_GE(mx_time_get(MX_CLOCK_MONOTONIC) - start, MX_MSEC(5), "");
+
+    slack = (mx_time_t)-1;
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_TIMER_SLACK, &slack, sizeof(slack)),
+              ERR_INVALID_ARGS, "negative slack is rejected");
+
+    slack = MX_TIMER_SLACK_MAX + 1;
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_TIMER_SLACK, &slack, sizeof(slack)),
+              NO_ERROR, "");
+    slack = 0;
+    EXPECT_EQ(mx_object_get_property(main_thread, MX_PROP_TIMER_SLACK, &slack, sizeof(slack)),
+              NO_ERROR, "");
+    EXPECT_EQ(slack, MX_TIMER_SLACK_MAX, "slack is clamped");
+
+    slack = 0;
+    EXPECT_EQ(mx_object_set_property(main_thread, MX_PROP_TIMER_SLACK, &slack, sizeof(slack)),
+              NO_ERROR, "");
+
+    EXPECT_EQ(mx_object_get_property(mx_process_self(), MX_PROP_TIMER_SLACK, &slack, sizeof(slack)),
+              ERR_WRONG_TYPE, "only threads have timer slack");
+
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(property_tests)
 RUN_TEST(process_name_test);
 RUN_TEST(thread_name_test);
+RUN_TEST(thread_timer_slack_test);
 END_TEST_CASE(property_tests)
 
 int main(int argc, char **argv)
@@ -14,6 +14,7 @@
 #include <unistd.h>
 
 #include <magenta/device/block.h>
+#include <magenta/device/devmgr.h>
 #include <magenta/device/ramdisk.h>
 #include <magenta/syscalls.h>
 #include <unittest/unittest.h>
@@ -138,10 +139,37 @@ bool ramdisk_test_multiple(void) {
     END_TEST;
 }
 
+bool ramdisk_test_settled(void) {
+    BEGIN_TEST;
+    int dirfd = open("/dev", O_RDONLY | O_DIRECTORY);
+    ASSERT_GE(dirfd, 0, "Could not open /dev");
+    mx_handle_t settled;
+    ASSERT_EQ(ioctl_devmgr_get_settled_event(dirfd, &settled), (ssize_t) sizeof(mx_handle_t),
+              "Could not get settled event");
+    close(dirfd);
+
+    // The ramdisk is bound to the block driver by a devhost bind worker,
+    // after which devfs settles again
+    int fd = get_ramdisk("ramdisk-test-settled", PAGE_SIZE, 512);
+    mx_signals_t pending;
+    ASSERT_EQ(mx_object_wait_one(settled, DEVMGR_SIGNAL_SETTLED,
+                                 MX_SEC(10), &pending), NO_ERROR,
+              "devfs did not settle");
+    ASSERT_TRUE(pending & DEVMGR_SIGNAL_SETTLED, "");
+
+    // Only the coordinator may signal it
+    ASSERT_EQ(mx_object_signal(settled, DEVMGR_SIGNAL_SETTLED, 0), ERR_ACCESS_DENIED, "");
+
+    close(fd);
+    mx_handle_close(settled);
+    END_TEST;
+}
+
 BEGIN_TEST_CASE(ramdisk_tests)
 RUN_TEST(ramdisk_test_simple)
 RUN_TEST(ramdisk_test_bad_requests)
 RUN_TEST(ramdisk_test_multiple)
+RUN_TEST(ramdisk_test_settled)
 END_TEST_CASE(ramdisk_tests)
 
 int main(int argc, char** argv) {
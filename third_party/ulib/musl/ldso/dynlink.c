@@ -37,6 +37,12 @@
 static void error(const char*, ...);
 static void debugmsg(const char*, ...);
 static mx_status_t get_library_vmo(const char* name, mx_handle_t* vmo);
+static mx_status_t loader_svc_rpc(uint32_t opcode,
+                                  const void* data, size_t len,
+                                  mx_handle_t request_handle,
+                                  mx_handle_t* result);
+
+#define LOADER_SVC_MSG_MAX 1024
 
 #define MAXP2(a, b) (-(-(a) & -(b)))
 #define ALIGN(x, y) ((x) + (y)-1 & -(y))
@@ -88,6 +94,10 @@ struct dso {
         size_t* got;
     } * funcdescs;
     size_t* got;
+    // Startup only: this DSO's slots in the symbol cache, its position in
+    // the cache's DSO list and the number of symbols it has there.
+    mx_symcache_slot_t* symcache;
+    uint32_t symcache_index, symcache_nsyms;
     struct dso* buf[];
 };
 
@@ -305,11 +315,28 @@ static Sym* gnu_lookup_filtered(uint32_t h1, uint32_t* hashtab, struct dso* dso,
 #define ARCH_SYM_REJECT_UND(s) 0
 #endif
 
-static struct symdef find_sym(struct dso* dso, const char* s, int need_def) {
+// whether sym, found under the name being looked up, may satisfy it
+static int sym_usable(const Sym* sym, int need_def) {
+    if (!sym->st_shndx)
+        if (need_def || (sym->st_info & 0xf) == STT_TLS || ARCH_SYM_REJECT_UND(sym))
+            return 0;
+    if (!sym->st_value)
+        if ((sym->st_info & 0xf) != STT_TLS)
+            return 0;
+    if (!(1 << (sym->st_info & 0xf) & OK_TYPES))
+        return 0;
+    if (!(1 << (sym->st_info >> 4) & OK_BINDS))
+        return 0;
+    return 1;
+}
+
+// find_sym over the DSOs from dso up to, but not including, stop
+static struct symdef find_sym_until(struct dso* dso, struct dso* stop,
+                                    const char* s, int need_def) {
     uint32_t h = 0, gh, gho, *ght;
     size_t ghm = 0;
     struct symdef def = {};
-    for (; dso; dso = dso->next) {
+    for (; dso != stop; dso = dso->next) {
         Sym* sym;
         if (!dso->global)
             continue;
@@ -328,15 +355,7 @@ static struct symdef find_sym(struct dso* dso, const char* s, int need_def) {
         }
         if (!sym)
             continue;
-        if (!sym->st_shndx)
-            if (need_def || (sym->st_info & 0xf) == STT_TLS || ARCH_SYM_REJECT_UND(sym))
-                continue;
-        if (!sym->st_value)
-            if ((sym->st_info & 0xf) != STT_TLS)
-                continue;
-        if (!(1 << (sym->st_info & 0xf) & OK_TYPES))
-            continue;
-        if (!(1 << (sym->st_info >> 4) & OK_BINDS))
+        if (!sym_usable(sym, need_def))
             continue;
 
         if (def.sym && sym->st_info >> 4 == STB_WEAK)
@@ -349,6 +368,65 @@ static struct symdef find_sym(struct dso* dso, const char* s, int need_def) {
     return def;
 }
 
+static struct symdef find_sym(struct dso* dso, const char* s, int need_def) {
+    return find_sym_until(dso, NULL, s, need_def);
+}
+
+// Symbol resolution cache, enabled by setting LD_SYMCACHE.
+//
+// Resolving a symbol by name hashes it and probes each DSO in turn, for
+// every symbolic relocation of every DSO at every start. With the same DSOs
+// loaded in the same order the answers never change, so the first start
+// records each one and gives the table to the loader service, which hands it
+// back to later starts of programs with the same DSOs. See symcache_start.
+//
+// Each DSO gets two slots per symbol table entry, one for each value of
+// find_sym's need_def, naming the defining DSO by its position in the list.
+// The layout is in <magenta/processargs.h>. A table from the loader service
+// is only a hint: each answer is checked against the name being looked up
+// and against the DSOs ahead of it in the search list, and anything that
+// does not check out (including "no definition") is looked up the slow way.
+static struct dso** symcache_dsos;
+static uint32_t symcache_dso_count;
+static bool symcache_recording;
+
+static struct symdef find_sym_cached(struct dso* dso, size_t sym_index,
+                                     const char* name, int need_def) {
+    if (sym_index >= dso->symcache_nsyms)
+        return find_sym(head, name, need_def);
+    mx_symcache_slot_t* slot = &dso->symcache[sym_index * 2 + !!need_def];
+
+    if (symcache_recording) {
+        struct symdef def = find_sym(head, name, need_def);
+        if (def.sym == NULL) {
+            slot->dso = MX_SYMCACHE_NONE;
+        } else if (def.dso->symcache != NULL) {
+            slot->dso = def.dso->symcache_index;
+            slot->sym = def.sym - def.dso->syms;
+        }
+        return def;
+    }
+
+    if (slot->dso < symcache_dso_count) {
+        struct dso* def_dso = symcache_dsos[slot->dso];
+        if (slot->sym < def_dso->symcache_nsyms && def_dso->global) {
+            Sym* sym = def_dso->syms + slot->sym;
+            // find_sym takes the first global definition in the search
+            // list, so a global one here stands unless a DSO ahead of it
+            // defines the name globally too. A weak answer could be beaten
+            // by any DSO, so it gets the full lookup.
+            if (sym_usable(sym, need_def) && sym->st_info >> 4 == STB_GLOBAL &&
+                !strcmp(def_dso->strings + sym->st_name, name)) {
+                struct symdef def = find_sym_until(head, def_dso, name, need_def);
+                if (def.sym && def.sym->st_info >> 4 == STB_GLOBAL)
+                    return def;
+                return (struct symdef){.dso = def_dso, .sym = sym};
+            }
+        }
+    }
+    return find_sym(head, name, need_def);
+}
+
 __attribute__((__visibility__("hidden"))) ptrdiff_t __tlsdesc_static(void), __tlsdesc_dynamic(void);
 
 static void do_relocs(struct dso* dso, size_t* rel, size_t rel_size, size_t stride) {
@@ -386,8 +464,12 @@ static void do_relocs(struct dso* dso, size_t* rel, size_t rel_size, size_t stri
             sym = syms + sym_index;
             name = strings + sym->st_name;
             ctx = type == REL_COPY ? head->next : head;
-            def = (sym->st_info & 0xf) == STT_SECTION ? (struct symdef){.dso = dso, .sym = sym}
-                                                      : find_sym(ctx, name, type == REL_PLT);
+            if ((sym->st_info & 0xf) == STT_SECTION)
+                def = (struct symdef){.dso = dso, .sym = sym};
+            else if (dso->symcache != NULL && type != REL_COPY)
+                def = find_sym_cached(dso, sym_index, name, type == REL_PLT);
+            else
+                def = find_sym(ctx, name, type == REL_PLT);
             if (!def.sym && (sym->st_shndx != SHN_UNDEF || sym->st_info >> 4 != STB_WEAK)) {
                 error("Error relocating %s: %s: symbol not found", dso->name, name);
                 if (runtime)
@@ -930,6 +1012,127 @@ static void trace_load(struct dso* p) {
     ++seqno;
 }
 
+_Static_assert(MAX_BUILDID_SIZE * 2 + 4 <= MX_SYMCACHE_BUILDID_MAX,
+               "build IDs must fit in a symbol cache table");
+
+static mx_handle_t symcache_vmo = MX_HANDLE_INVALID;
+static uintptr_t symcache_map;
+static size_t symcache_size;
+static char symcache_key[LOADER_SVC_MSG_MAX - sizeof(mx_loader_svc_msg_t)];
+
+static bool symcache_valid(const mx_symcache_dso_t* dsos, uint32_t count) {
+    uint64_t size;
+    if (_mx_vmo_get_size(symcache_vmo, &size) != NO_ERROR || size < symcache_size)
+        return false;
+    if (_mx_vmar_map(_mx_vmar_root_self(), 0, symcache_vmo, 0, symcache_size,
+                     MX_VM_FLAG_PERM_READ, &symcache_map) != NO_ERROR) {
+        symcache_map = 0;
+        return false;
+    }
+    const mx_symcache_header_t* hdr = (const void*)symcache_map;
+    if (hdr->magic == MX_SYMCACHE_MAGIC && hdr->version == MX_SYMCACHE_VERSION &&
+        hdr->dso_count == count && !memcmp(hdr + 1, dsos, count * sizeof(*dsos)))
+        return true;
+    _mx_vmar_unmap(_mx_vmar_root_self(), symcache_map, symcache_size);
+    symcache_map = 0;
+    return false;
+}
+
+// Called with every DSO loaded but before any relocation. The key for the
+// cache is the whole search list, as the DSOs' build IDs in order; the cache
+// itself repeats the build IDs and symbol counts, and on any mismatch it is
+// recorded anew. DSOs without a build ID can't be identified, so they
+// disable the cache, as does a list too long to send as a key.
+static void symcache_start(void) {
+    uint32_t count = 0;
+    for (struct dso* p = head; p != NULL; p = p->next)
+        ++count;
+    struct dso** dsos = dl_alloc(count * sizeof(*dsos));
+    mx_symcache_dso_t* ids = dl_alloc(count * sizeof(*ids));
+    if (dsos == NULL || ids == NULL)
+        return;
+    // the cache compares whole entries, padding included
+    memset(ids, 0, count * sizeof(*ids));
+
+    size_t size = sizeof(mx_symcache_header_t) + count * sizeof(*ids);
+    size_t keylen = 0;
+    uint32_t i = 0;
+    for (struct dso* p = head; p != NULL; p = p->next, ++i) {
+        read_buildid(p, ids[i].buildid, sizeof(ids[i].buildid));
+        if (!strcmp(ids[i].buildid, "<none>")) {
+            debugmsg("%s: no build ID, not using LD_SYMCACHE\n", p->name);
+            return;
+        }
+        size_t len = strlen(ids[i].buildid);
+        if (keylen + len + 1 >= sizeof(symcache_key)) {
+            debugmsg("too many DSOs, not using LD_SYMCACHE\n");
+            return;
+        }
+        if (i > 0)
+            symcache_key[keylen++] = '/';
+        memcpy(symcache_key + keylen, ids[i].buildid, len + 1);
+        keylen += len;
+        ids[i].nsyms = count_syms(p);
+        ids[i].offset = size;
+        size += ids[i].nsyms * 2 * sizeof(mx_symcache_slot_t);
+        dsos[i] = p;
+    }
+    symcache_size = (size + PAGE_SIZE - 1) & -PAGE_SIZE;
+
+    mx_status_t status = loader_svc_rpc(LOADER_SVC_OP_LOAD_SYMCACHE,
+                                        symcache_key, strlen(symcache_key),
+                                        MX_HANDLE_INVALID, &symcache_vmo);
+    if (status != NO_ERROR || !symcache_valid(ids, count)) {
+        _mx_handle_close(symcache_vmo);
+        symcache_vmo = MX_HANDLE_INVALID;
+        if (_mx_vmo_create(symcache_size, 0, &symcache_vmo) != NO_ERROR)
+            return;
+        status = _mx_vmar_map(_mx_vmar_root_self(), 0, symcache_vmo, 0,
+                              symcache_size,
+                              MX_VM_FLAG_PERM_READ | MX_VM_FLAG_PERM_WRITE,
+                              &symcache_map);
+        if (status != NO_ERROR) {
+            _mx_handle_close(symcache_vmo);
+            symcache_vmo = MX_HANDLE_INVALID;
+            return;
+        }
+        mx_symcache_header_t* hdr = (void*)symcache_map;
+        hdr->magic = MX_SYMCACHE_MAGIC;
+        hdr->version = MX_SYMCACHE_VERSION;
+        hdr->dso_count = count;
+        memcpy(hdr + 1, ids, count * sizeof(*ids));
+        memset((char*)symcache_map + ids[0].offset, 0xff, size - ids[0].offset);
+        symcache_recording = true;
+    }
+
+    for (i = 0; i < count; ++i) {
+        dsos[i]->symcache = (void*)(symcache_map + ids[i].offset);
+        dsos[i]->symcache_index = i;
+        dsos[i]->symcache_nsyms = ids[i].nsyms;
+    }
+    symcache_dsos = dsos;
+    symcache_dso_count = count;
+}
+
+// Called once startup relocation is done. A newly recorded cache goes to the
+// loader service under the same key symcache_start computed.
+static void symcache_finish(void) {
+    if (symcache_vmo == MX_HANDLE_INVALID)
+        return;
+    for (uint32_t i = 0; i < symcache_dso_count; ++i)
+        symcache_dsos[i]->symcache = NULL;
+    _mx_vmar_unmap(_mx_vmar_root_self(), symcache_map, symcache_size);
+
+    if (symcache_recording && !ldso_fail) {
+        loader_svc_rpc(LOADER_SVC_OP_STORE_SYMCACHE,
+                       symcache_key, strlen(symcache_key),
+                       symcache_vmo, NULL);
+    } else {
+        _mx_handle_close(symcache_vmo);
+    }
+    symcache_vmo = MX_HANDLE_INVALID;
+}
+
 static mx_status_t load_library_vmo(mx_handle_t vmo, const char* name,
                                     int rtld_mode,
                                     struct dso* needed_by,
@@ -1421,6 +1624,8 @@ static void* dls3(mx_handle_t exec_vmo, int argc, char** argv) {
     const char* ld_debug = getenv("LD_DEBUG");
     if (ld_debug != NULL && ld_debug[0] != '\0')
         log_libs = true;
+    const char* ld_symcache = getenv("LD_SYMCACHE");
+    bool use_symcache = ld_symcache != NULL && ld_symcache[0] != '\0';
 
     {
         // Features like Intel Processor Trace require specific output in a
@@ -1528,11 +1733,16 @@ static void* dls3(mx_handle_t exec_vmo, int argc, char** argv) {
         }
     }
 
+    if (use_symcache && !ldd_mode)
+        symcache_start();
+
     /* The main program must be relocated LAST since it may contin
      * copy relocations which depend on libraries' relocations. */
     reloc_all(app.next);
     reloc_all(&app);
 
+    symcache_finish();
+
     update_tls_size();
     static_tls_cnt = tls_cnt;
 
@@ -1994,14 +2204,13 @@ int dl_iterate_phdr(int (*callback)(struct dl_phdr_info* info, size_t size, void
 
 __attribute__((__visibility__("hidden"))) void __dl_vseterr(const char*, va_list);
 
-#define LOADER_SVC_MSG_MAX 1024
-
 // This detects recursion via the error function.
 static bool loader_svc_rpc_in_progress;
 static uint32_t loader_svc_txid;
 
 static mx_status_t loader_svc_rpc(uint32_t opcode,
                                   const void* data, size_t len,
+                                  mx_handle_t request_handle,
                                   mx_handle_t* result) {
     mx_status_t status;
     struct {
@@ -2014,6 +2223,8 @@ static mx_status_t loader_svc_rpc(uint32_t opcode,
     if (len >= sizeof msg.data) {
         error("message of %zu bytes too large for loader service protocol",
               len);
+        if (request_handle != MX_HANDLE_INVALID)
+            _mx_handle_close(request_handle);
         status = ERR_OUT_OF_RANGE;
         goto out;
     }
@@ -2027,6 +2238,8 @@ static mx_status_t loader_svc_rpc(uint32_t opcode,
     mx_channel_call_args_t call = {
         .wr_bytes = &msg,
         .wr_num_bytes = sizeof(msg.header) + len + 1,
+        .wr_handles = &request_handle,
+        .wr_num_handles = request_handle == MX_HANDLE_INVALID ? 0 : 1,
         .rd_bytes = &msg,
         .rd_num_bytes = sizeof(msg),
         .rd_handles = result,
@@ -2062,7 +2275,7 @@ static mx_status_t loader_svc_rpc(uint32_t opcode,
         goto out;
     }
     if (msg.header.arg != NO_ERROR) {
-        if (*result != MX_HANDLE_INVALID) {
+        if (result != NULL && *result != MX_HANDLE_INVALID) {
             error("loader service error %d reply contains handle %#x",
                   msg.header.arg, *result);
             status = ERR_INVALID_ARGS;
@@ -2082,7 +2295,7 @@ static mx_status_t get_library_vmo(const char* name, mx_handle_t* result) {
         return ERR_UNAVAILABLE;
     }
     return loader_svc_rpc(LOADER_SVC_OP_LOAD_OBJECT, name, strlen(name),
-                          result);
+                          MX_HANDLE_INVALID, result);
 }
 
 static void log_write(const void* buf, size_t len) {
@@ -2095,7 +2308,8 @@ static void log_write(const void* buf, size_t len) {
     if (logger != MX_HANDLE_INVALID)
         status = _mx_log_write(logger, len, buf, 0);
     else if (!loader_svc_rpc_in_progress && loader_svc != MX_HANDLE_INVALID)
-        status = loader_svc_rpc(LOADER_SVC_OP_DEBUG_PRINT, buf, len, NULL);
+        status = loader_svc_rpc(LOADER_SVC_OP_DEBUG_PRINT, buf, len,
+                                MX_HANDLE_INVALID, NULL);
     else {
         int n = _mx_debug_write(buf, len);
         status = n < 0 ? n : NO_ERROR;